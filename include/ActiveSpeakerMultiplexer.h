@@ -3,6 +3,7 @@
 #include "config.h"
 #include "rtp/RTPIncomingMediaStream.h"
 #include "rtp/RTPStreamTransponder.h"
+#include "rtp/RTPIncomingMediaStreamSilenceGate.h"
 #include "TimeService.h"
 
 
@@ -14,13 +15,17 @@ private:
 	{
 		uint32_t id;
 		RTPIncomingMediaStream::shared incoming;
+		//Stream attached to the transponders, the silence gate of the incoming one if enabled
+		RTPIncomingMediaStream::shared forwarded;
+		std::shared_ptr<RTPIncomingMediaStreamSilenceGate> gate;
 		uint64_t score = 0;
 		uint64_t ts = 0;
 		std::vector<RTPPacket::shared> packets;
 
 		Source(uint32_t id, RTPIncomingMediaStream::shared incoming) :
 			id(id),
-			incoming(incoming)
+			incoming(incoming),
+			forwarded(incoming)
 		{
 		}
 
@@ -70,6 +75,8 @@ public:
 	void SetMaxAccumulatedScore(uint64_t maxAcummulatedScore)	{ this->maxAcummulatedScore = maxAcummulatedScore;	}
 	void SetNoiseGatingThreshold(uint8_t noiseGatingThreshold)	{ this->noiseGatingThreshold = noiseGatingThreshold;	}
 	void SetMinActivationScore(uint32_t minActivationScore)		{ this->minActivationScore = minActivationScore;	}
+	//Forward only the voiced packets of the sources, using the noise gating threshold. Must be set before adding any source
+	bool SetSilenceGating(bool silenceGating);
 
 	void Stop();
 private:
@@ -83,6 +90,7 @@ private:
 	uint64_t maxAcummulatedScore = 2500;
 	uint8_t noiseGatingThreshold = 127;
 	uint64_t minActivationScore = 0;
+	bool silenceGating = false;
 
 	std::map<RTPIncomingMediaStream*, Source, std::less<>> sources;
 	std::map<RTPStreamTransponder*, Destination> destinations;
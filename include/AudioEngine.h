@@ -0,0 +1,123 @@
+#ifndef AUDIOENGINE_H
+#define AUDIOENGINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "config.h"
+
+// Tick driven audio processing scheduler.
+//
+// Instead of having a thread per decoder, mixer and encoder, all of them are
+// registered as tasks and run by a fixed pool of threads in rounds, one each
+// period. Each round runs all decode tasks, then all mix tasks and then all
+// encode tasks, so samples decoded in a round are mixed and encoded in the
+// same round. Tasks of the same phase are spread across the pool threads.
+//
+// Tasks must not block, and must not add tasks from OnTick. Tasks removed from
+// OnTick are skipped for the rest of the round and dropped once it finishes.
+// Removing a task from OnTick waits for a run of it in progress on another
+// thread, so two tasks must not remove each other on the same round.
+class AudioEngine
+{
+public:
+	enum Phase
+	{
+		Decode	= 0,
+		Mix	= 1,
+		Encode	= 2
+	};
+	static constexpr DWORD NumPhases = 3;
+
+	class Task
+	{
+	public:
+		virtual ~Task() = default;
+		// Called once per round, now is the round time in microseconds
+		virtual void OnTick(Phase phase, QWORD now) = 0;
+	};
+
+	struct Stats
+	{
+		QWORD rounds		= 0;
+		//Rounds not finished before next one was due
+		QWORD missed		= 0;
+		//Rounds not run because we were too late
+		QWORD skipped		= 0;
+		QWORD lastRoundTime	= 0;
+		QWORD maxRoundTime	= 0;
+	};
+
+	static constexpr DWORD DefaultPeriod = 10;
+	static constexpr DWORD MaxDefaultThreads = 4;
+public:
+	explicit AudioEngine(const std::string& name = "audio");
+	~AudioEngine();
+
+	// Use min(cores,MaxDefaultThreads) threads if not set, period in ms
+	bool Start(DWORD threads = 0, DWORD period = DefaultPeriod);
+	bool Stop();
+
+	// Block until current round has finished, so task is not run anymore once they return.
+	// From OnTick, removing only waits for the task to finish if it is running on another
+	// thread. A task removing itself is still running when it returns.
+	void AddTask(Phase phase, Task* task);
+	bool RemoveTask(Phase phase, Task* task);
+
+	Stats GetStats() const;
+	DWORD GetNumThreads() const	{ return threads.size();	}
+	DWORD GetNumTasks() const;
+
+	// Engine shared by all audio workers, started on first use
+	static AudioEngine& GetInstance();
+	static void SetDefaultNumThreads(DWORD num)	{ defaultNumThreads = num;	}
+private:
+	void Run(std::atomic<Task*>* slot);
+	void Help(std::atomic<Task*>* slot);
+	void RunPhase(std::vector<Task*>& tasks, Phase phase, QWORD now);
+	void Work(std::vector<Task*>* tasks, Phase phase, QWORD now);
+	void Tick(Task* task, Phase phase, QWORD now);
+	bool IsRemoved(Task* task, Phase phase);
+	void PurgeRemoved();
+private:
+	static DWORD defaultNumThreads;
+
+	std::string name;
+	std::vector<std::thread> threads;
+	std::atomic<bool> running = false;
+	DWORD period = DefaultPeriod;
+
+	//Tasks per phase, locked while a round is being run
+	mutable std::mutex tasksMutex;
+	std::vector<Task*> tasks[NumPhases];
+
+	//Tasks removed from OnTick during current round
+	std::mutex removedMutex;
+	std::vector<std::pair<Phase,Task*>> removed;
+	std::atomic<size_t> numRemoved = 0;
+
+	//Task being run by each thread
+	std::unique_ptr<std::atomic<Task*>[]> runningTasks;
+	DWORD numRunningTasks = 0;
+
+	//Current phase shared with the helper threads
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::condition_variable done;
+	QWORD generation = 0;
+	DWORD active = 0;
+	std::vector<Task*>* current = nullptr;
+	Phase currentPhase = Decode;
+	QWORD currentTime = 0;
+	std::atomic<size_t> next = 0;
+	std::atomic<size_t> remaining = 0;
+
+	mutable std::mutex statsMutex;
+	Stats stats;
+};
+
+#endif /* AUDIOENGINE_H */
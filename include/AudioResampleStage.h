@@ -0,0 +1,86 @@
+#ifndef AUDIORESAMPLESTAGE_H
+#define AUDIORESAMPLESTAGE_H
+
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include "config.h"
+#include "speex/speex_resampler.h"
+
+// Sample rate conversion shared by all the outputs of a mixer.
+//
+// In a mixed rate room every participant listening to the same mix had its
+// own resampler converting it to the rate of its encoder. The stage keeps a
+// resampler per source, input rate, output rate and number of channels and runs
+// each of them once per tick, so all the legs asking for the same conversion
+// get the same output.
+//
+// Conversion is done in float, each source is converted to float once per tick
+// no matter how many rates it is converted to, and float consumers can take
+// the output before it is converted back to int16. Float samples keep the
+// int16 scale.
+//
+// Not thread safe, it is expected to be used from the mixer tick only.
+class AudioResampleStage
+{
+public:
+	struct Stats
+	{
+		//Resampler runs
+		QWORD conversions	= 0;
+		//Conversions served from the ones already done on the tick
+		QWORD shared		= 0;
+	};
+	//Remove resamplers not used after this number of ticks
+	static constexpr DWORD MaxIdleTicks = 100;
+public:
+	explicit AudioResampleStage(int quality = SPEEX_RESAMPLER_QUALITY_MAX);
+	~AudioResampleStage() = default;
+
+	// Starts a new tick, outputs of previous one are not valid anymore
+	void Tick();
+
+	// Converts num frames of source, which must have the same samples on all calls of the same tick.
+	// Returns output valid until next tick, or null on error.
+	const SWORD* Convert(const void* source, const SWORD* samples, DWORD num, DWORD inputRate, DWORD outputRate, DWORD* outputNum, DWORD numChannels = 1);
+	const float* ConvertFloat(const void* source, const SWORD* samples, DWORD num, DWORD inputRate, DWORD outputRate, DWORD* outputNum, DWORD numChannels = 1);
+
+	const Stats& GetStats() const	{ return stats;			}
+	DWORD GetNumResamplers() const	{ return conversions.size();	}
+
+	static void ToFloat(const SWORD* in, float* out, DWORD num);
+	static void ToInt16(const float* in, SWORD* out, DWORD num);
+private:
+	using Key = std::tuple<const void*, DWORD, DWORD, DWORD>;
+
+	struct Input
+	{
+		std::vector<float> samples;
+		QWORD tick = 0;
+	};
+
+	struct Conversion
+	{
+		std::unique_ptr<SpeexResamplerState, void(*)(SpeexResamplerState*)> resampler;
+		std::vector<float> output;
+		std::vector<SWORD> converted;
+		DWORD num	= 0;
+		QWORD tick	= 0;
+		//Output converted to int16 on this tick
+		bool  int16	= false;
+
+		Conversion(SpeexResamplerState* resampler);
+	};
+
+	const float* GetInput(const void* source, const SWORD* samples, DWORD len);
+	Conversion* Process(const void* source, const SWORD* samples, DWORD num, DWORD inputRate, DWORD outputRate, DWORD numChannels);
+private:
+	int quality;
+	QWORD tick = 1;
+	std::map<const void*, Input> inputs;
+	std::map<Key, Conversion> conversions;
+	Stats stats;
+};
+
+#endif /* AUDIORESAMPLESTAGE_H */
@@ -9,16 +9,73 @@
 #define	CPUMONITOR_H
 
 #include <set>
+#include <map>
+#include <string>
+#include <vector>
 #include "wait.h"
+#include "EventLoop.h"
+#include "VideoWorkerPool.h"
 
 
 class CPUMonitor
 {
 public:
+	//Loads are in percentage of a single cpu
+	struct ThreadLoad
+	{
+		pid_t		tid	= 0;
+		std::string	name;
+		int		user	= 0;
+		int		sys	= 0;
+		int		load	= 0;
+	};
+	
+	struct LoopLoad
+	{
+		pid_t		tid			= 0;
+		std::string	name;
+		int		load			= 0;	//Thread cpu load
+		int		utilization		= 0;	//Time not waiting on poll
+		QWORD		iterations		= 0;
+		QWORD		tasks			= 0;
+		QWORD		timers			= 0;
+		size_t		sendQueueSize		= 0;
+		EventLoop::State state			= EventLoop::State::Normal;
+		QWORD		laggingTransitions	= 0;
+		QWORD		overflownTransitions	= 0;
+	};
+	
+	struct WorkerLoad
+	{
+		QWORD		id		= 0;
+		std::string	pool;
+		std::string	name;
+		int		load		= 0;	//Time running tasks
+		QWORD		tasks		= 0;
+		QWORD		missed		= 0;	//Tasks finished after their deadline
+		QWORD		maxLateness	= 0;
+		size_t		pending		= 0;
+		DWORD		codecThreads	= 0;
+		int		cpu		= -1;
+	};
+	
+	struct Load
+	{
+		int user	= 0;
+		int sys		= 0;
+		int load	= 0;
+		int numcpu	= 0;
+		std::vector<ThreadLoad> threads;
+		std::vector<LoopLoad>	loops;
+		std::vector<WorkerLoad>	workers;
+	};
+	
 	class Listener
 	{
 	public:
 		virtual void onCPULoad(int user, int sys, int load, int numcpu) = 0;
+		//Per thread and event loop load, counters are for the last interval
+		virtual void onLoad(const Load& load) {}
 	};
 public:
 	CPUMonitor();
@@ -32,6 +89,15 @@ protected:
 private:
 	typedef std::set<Listener*> Listeners;
         static void * run(void *par);
+	
+	struct ThreadTimes
+	{
+		std::string name;
+		QWORD user = 0;
+		QWORD sys = 0;
+	};
+	
+	static std::map<pid_t,ThreadTimes> GetThreadTimes();
 
 private:
 	int		numcpu = 0;
@@ -31,6 +31,8 @@
 #include "Endpoint.h"
 #include "SRTPSession.h"
 #include "SendSideBandwidthEstimation.h"
+#include "StatsSnapshot.h"
+#include "LatencyHistogram.h"
 
 class DTLSICETransport : 
 	public RTPSender,
@@ -115,6 +117,8 @@ public:
 	const char* GetRemotePwd()	const { return iceRemotePwd.c_str();		};
 	const char* GetLocalUsername()	const { return iceLocalUsername.c_str();	};
 	const char* GetLocalPwd()	const { return iceLocalPwd.c_str();		};
+	const STUNMessage::Key& GetRemoteKey() const { return iceRemoteKey;		};
+	const STUNMessage::Key& GetLocalKey()	const { return iceLocalKey;		};
 	
 	virtual void onDTLSSetup(DTLSConnection::Suite suite,BYTE* localMasterKey,DWORD localMasterKeySize,BYTE* remoteMasterKey,DWORD remoteMasterKeySize)  override;
 	virtual void onDTLSPendingData() override;
@@ -123,6 +127,8 @@ public:
 	virtual int onData(const ICERemoteCandidate* candidate,const BYTE* data,DWORD size)  override;
 	
 	DWORD GetRTT() const { return rtt; }
+	const LatencyHistogram& GetReceiveToSendLatency() const	{ return receiveToSendLatency;	}
+	const LatencyHistogram& GetSRTPProtectLatency() const	{ return srtpProtectLatency;	}
 	
 	TimeService& GetTimeService() { return timeService; }
 	
@@ -140,6 +146,7 @@ private:
 	DWORD SendProbe(const RTPPacket::shared& packet);
 	DWORD SendProbe(RTPOutgoingSourceGroup *group,BYTE padding);
 	void SendTransportWideFeedbackMessage(DWORD ssrc);
+	void PublishStats(QWORD now);
 	
 	int SetLocalCryptoSDES(const char* suite, const BYTE* key, const DWORD len);
 	int SetRemoteCryptoSDES(const char* suite, const BYTE* key, const DWORD len);
@@ -190,6 +197,8 @@ private:
 	std::string iceRemotePwd;
 	std::string iceLocalUsername;
 	std::string iceLocalPwd;
+	STUNMessage::Key iceRemoteKey;
+	STUNMessage::Key iceLocalKey;
 	
 	Acumulator<uint32_t, uint64_t> outgoingBitrate;
 	Acumulator<uint32_t, uint64_t> rtxBitrate;
@@ -220,6 +229,12 @@ private:
 	uint32_t remoteOverrideBitrate = 0;
 
 	Timer::shared iceTimeoutTimer;
+
+	Timer::shared statsTimer;
+	StatsSnapshotRegistry::Publisher statsPublisher;
+
+	LatencyHistogram receiveToSendLatency	{ "transport.receive_to_send" };
+	LatencyHistogram srtpProtectLatency	{ "transport.srtp_protect" };
 };
 
 
@@ -23,14 +23,24 @@ public:
 	VideoCodec::Type GetCodec()	const override { return codec;			}
 	bool IsWaitingForIntra()	const override { return waitingForIntra;	}
 	
-	std::optional<std::vector<bool>> GetForwardedDecodeTargets() const { return forwardedDecodeTargets;	}
+	std::optional<uint32_t> GetForwardedDecodeTargetsMask() const { return forwardedDecodeTargets;	}
+	std::optional<std::vector<bool>> GetForwardedDecodeTargets() const;
 	
 	static std::vector<LayerInfo> GetLayerIds(const RTPPacket::shared& packet);
+private:
+	void UpdateSelectedDecodeTargets(const TemplateDependencyStructure::shared& structure);
 private:
 	WrapExtender<uint16_t,uint64_t> frameNumberExtender;
 	uint64_t currentFrameNumber = std::numeric_limits<uint64_t>::max();
 	BitHistory<256> forwardedFrames;
-	std::optional<std::vector<bool>> forwardedDecodeTargets;
+	std::optional<uint32_t> forwardedDecodeTargets;
+	
+	//Decode targets allowed by current layer selection, recalculated only when structure or selection changes
+	TemplateDependencyStructure::shared templateDependencyStructure;
+	BYTE selectedTemporalLayerId = LayerInfo::MaxLayerId;
+	BYTE selectedSpatialLayerId  = LayerInfo::MaxLayerId;
+	uint32_t selectedDecodeTargets = 0;
+	uint32_t currentDecodeTarget = std::numeric_limits<uint32_t>::max();
 	
 	VideoCodec::Type codec;
 	BYTE temporalLayerId = LayerInfo::MaxLayerId;
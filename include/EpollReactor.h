@@ -0,0 +1,65 @@
+#ifndef EPOLLREACTOR_H
+#define EPOLLREACTOR_H
+
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include "EventLoop.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+//Same values as the poll ones, used by handlers to check readiness
+#define EPOLLIN		POLLIN
+#define EPOLLOUT	POLLOUT
+#define EPOLLERR	POLLERR
+#define EPOLLHUP	POLLHUP
+#endif
+
+// Event loop multiplexing many stream sockets with epoll.
+//
+// Handlers are registered per file descriptor and called on the loop thread
+// when the socket is ready, while tasks and timers are run as in the EventLoop.
+// All handler management must be done from the loop thread, use Async() from
+// other threads. On systems without epoll the registered sockets are polled
+// on each iteration instead.
+class EpollReactor : public EventLoop
+{
+public:
+	class Handler
+	{
+	public:
+		virtual ~Handler() = default;
+		virtual void OnEvent(uint32_t events) = 0;
+	};
+
+	static constexpr int MaxEvents = 256;
+public:
+	EpollReactor();
+	virtual ~EpollReactor();
+
+	bool Start();
+	bool Stop();
+
+	bool AddHandler(int fd, uint32_t events, const std::shared_ptr<Handler>& handler);
+	bool ModifyHandler(int fd, uint32_t events);
+	bool RemoveHandler(int fd);
+
+	size_t GetNumHandlers() const	{ return numHandlers;				}
+	bool IsReactorThread() const	{ return std::this_thread::get_id()==loopThread;	}
+private:
+	void Loop();
+private:
+#if defined(__linux__)
+	int epoll = FD_INVALID;
+#else
+	//Requested events for each socket
+	std::unordered_map<int,uint32_t> interests;
+#endif
+	std::thread::id loopThread;
+	std::unordered_map<int,std::shared_ptr<Handler>> handlers;
+	std::atomic<size_t> numHandlers = 0;
+};
+
+#endif /* EPOLLREACTOR_H */
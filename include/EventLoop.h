@@ -7,7 +7,9 @@
 #include <optional>
 #include <poll.h>
 #include <cassert>
-#include <optional>
+#include <atomic>
+#include <vector>
+#include <sys/types.h>
 #include "config.h"
 #include "concurrentqueue.h"
 #include "Packet.h"
@@ -15,6 +17,7 @@
 #include "TimeService.h"
 #include "FileDescriptor.h"
 #include "PacketHeader.h"
+#include "LatencyHistogram.h"
 
 using namespace std::chrono_literals;
 
@@ -34,6 +37,24 @@ public:
 		Overflown
 	};
 	
+	//Accumulated loop counters, times in microseconds
+	struct Stats
+	{
+		pid_t	tid			= 0;
+		QWORD	iterations		= 0;
+		QWORD	busyTime		= 0;
+		QWORD	waitTime		= 0;
+		QWORD	tasks			= 0;
+		QWORD	timers			= 0;
+		size_t	sendQueueSize		= 0;
+		State	state			= State::Normal;
+		QWORD	laggingTransitions	= 0;
+		QWORD	overflownTransitions	= 0;
+	};
+	
+	//Stats of all loops currently running
+	static std::vector<Stats> GetRunningStats();
+	
 	static bool SetAffinity(std::thread::native_handle_type thread, int cpu);
 	static bool SetThreadName(std::thread::native_handle_type thread, const std::string& name);
 private:
@@ -109,6 +130,9 @@ public:
 	bool SetThreadName(const std::string& name);
 	bool SetPriority(int priority);
 	bool IsRunning() const { return running; }
+	bool IsLoopThread() const { return std::this_thread::get_id()==thread.get_id(); }
+	Stats GetStats() const;
+	const LatencyHistogram& GetSendQueueLatency() const { return sendQueueLatency; }
 	
 
 	ObjectPool<Packet>& GetPacketPool() { return packetPool; }
@@ -128,6 +152,12 @@ protected:
 	}
 
 	const std::chrono::milliseconds Now();
+
+	//Stats for loops run by subclasses, must be called from the loop thread
+	void AddRunning();
+	void RemoveRunning();
+	void AddWaitTime(QWORD beforeWait, QWORD afterWait) { waitTime.fetch_add(afterWait - beforeWait, std::memory_order_relaxed); }
+	void UpdateStats(QWORD afterWait);
 private:
 	struct SendBuffer
 	{
@@ -150,7 +180,8 @@ private:
 			port(other.port),
 			packet(std::move(other.packet)),
 			rawTxData(other.rawTxData),
-			callback(other.callback)
+			callback(other.callback),
+			enqueued(other.enqueued)
 		{
 		}
 		SendBuffer& operator=(SendBuffer&&) = default;
@@ -163,6 +194,7 @@ private:
 		Packet   packet;
 		std::optional<PacketHeader::FlowRoutingInfo> rawTxData;
 		std::optional<std::function<void(std::chrono::milliseconds)>> callback;
+		QWORD enqueued = 0;
 		
 	};
 	static const size_t MaxSendingQueueSize;
@@ -171,7 +203,7 @@ private:
 	static const size_t PacketPoolSize;
 private:
 	std::thread	thread;
-	State		state		= State::Normal;
+	std::atomic<State> state	= State::Normal;
 	Listener*	listener	= nullptr;
 	int		fd		= 0;
 	int		pipe[2]		= {FD_INVALID, FD_INVALID};
@@ -189,7 +221,17 @@ private:
 	std::multimap<std::chrono::milliseconds,TimerImpl::shared> timers;
 	ObjectPool<Packet> packetPool;
 	std::optional<RawTx> rawTx;
-
+	
+	//Updated by the loop thread, read by monitors
+	std::atomic<pid_t>	tid			= 0;
+	std::atomic<QWORD>	iterations		= 0;
+	std::atomic<QWORD>	busyTime		= 0;
+	std::atomic<QWORD>	waitTime		= 0;
+	std::atomic<QWORD>	processedTasks		= 0;
+	std::atomic<QWORD>	processedTimers		= 0;
+	std::atomic<QWORD>	laggingTransitions	= 0;
+	std::atomic<QWORD>	overflownTransitions	= 0;
+	LatencyHistogram	sendQueueLatency	{ "eventloop.send_queue" };
 };
 
 #endif /* EVENTLOOP_H */
@@ -0,0 +1,161 @@
+#ifndef FRAGMENTEDMP4WRITER_H
+#define FRAGMENTEDMP4WRITER_H
+
+#include <string>
+#include <vector>
+#include "config.h"
+#include "codecs.h"
+
+// Native fragmented MP4 writer.
+//
+// Samples are kept in memory per track and written as a moof+mdat fragment on
+// each video key frame or every few ms, serialized in a single buffer and
+// written with one write call. The init segment (ftyp+moov) is written before
+// the first fragment, so the file is playable up to the last fragment written
+// even if the process dies.
+//
+// Optionally, CMAF segments are written instead in a directory, as init.mp4
+// and numbered .m4s files, together with a LL-HLS playlist where each
+// fragment is a part of the segment.
+//
+// Tracks must be added before the first fragment is written. Timestamps and
+// durations are in the clock rate of each track.
+class FragmentedMP4Writer
+{
+public:
+	struct Options
+	{
+		//Start a new fragment on each key frame of the first video track
+		bool	fragmentOnKeyFrame	= true;
+		//Max duration of a fragment in ms, 0 for no limit
+		DWORD	fragmentDuration	= 2000;
+		//Max bytes buffered per track before forcing a fragment
+		DWORD	maxTrackBytes		= 8*1024*1024;
+		//Pad fragments with a free box to a multiple of this size, 0 for none
+		DWORD	alignment		= 0;
+		//Bypass page cache, requires alignment, falls back to buffered io if not supported
+		bool	directIO		= false;
+		//Write CMAF segments and playlist in this directory instead of a single file
+		std::string segmentDir;
+		//Min duration of a segment in ms, cut at the first fragment after it
+		DWORD	segmentDuration		= 6000;
+	};
+
+	struct Stats
+	{
+		QWORD	fragments	= 0;
+		QWORD	segments	= 0;
+		QWORD	samples		= 0;
+		QWORD	bytes		= 0;
+		QWORD	writes		= 0;
+		QWORD	dropped		= 0;
+		//Max bytes buffered by any track
+		DWORD	maxTrackBytes	= 0;
+	};
+public:
+	FragmentedMP4Writer();
+	explicit FragmentedMP4Writer(const Options& options);
+	~FragmentedMP4Writer();
+
+	// In segment mode, filename is the name of the playlist inside the segment dir
+	bool Open(const char* filename);
+	// Writes pending samples and playlist end
+	bool Close();
+	bool IsOpened() const	{ return opened;	}
+
+	// Returns track id or 0 on error. Config is the AudioSpecificConfig for AAC,
+	// if not set it is generated from rate and channels.
+	DWORD AddAudioTrack(AudioCodec::Type codec, DWORD rate, DWORD channels = 1, const BYTE* config = nullptr, DWORD size = 0);
+	// For H264, SPS and PPS are taken from the first key frame if not set
+	DWORD AddVideoTrack(VideoCodec::Type codec, DWORD rate, DWORD width, DWORD height);
+	void  SetTrackName(DWORD trackId, const std::string& name);
+	bool  SetH264ParameterSets(DWORD trackId, const BYTE* sps, DWORD spsSize, const BYTE* pps, DWORD ppsSize);
+
+	// H264 samples are length prefixed NALs, dts is the decode time in the
+	// track timeline, only used for the first sample of each fragment.
+	bool WriteSample(DWORD trackId, const BYTE* data, DWORD size, QWORD dts, DWORD duration, bool sync, int cto = 0);
+	// Writes all pending samples as a new fragment
+	bool Flush();
+
+	const Stats& GetStats() const	{ return stats;	}
+private:
+	struct Sample
+	{
+		DWORD size;
+		DWORD duration;
+		DWORD flags;
+		int   cto;
+	};
+
+	struct Track
+	{
+		DWORD id		= 0;
+		MediaFrame::Type media	= MediaFrame::Unknown;
+		BYTE  codec		= 0;
+		DWORD rate		= 0;
+		DWORD channels		= 0;
+		DWORD width		= 0;
+		DWORD height		= 0;
+		std::string name;
+		std::vector<BYTE> config;
+		std::vector<BYTE> sps;
+		std::vector<BYTE> pps;
+		//Pending samples, data of all of them is contiguous
+		std::vector<Sample> samples;
+		std::vector<BYTE> data;
+		QWORD firstDts		= 0;
+		QWORD duration		= 0;
+		//Got first sync sample
+		bool  started		= false;
+	};
+
+	Track* GetTrack(DWORD trackId);
+	Track* GetReferenceTrack();
+	// True when all H264 tracks have both SPS and PPS so the init segment can be written
+	bool   HasParameterSets() const;
+	void   DropSamples();
+	bool   WriteInit();
+	bool   WriteFragment();
+	bool   StartSegment();
+	bool   WritePlaylist(bool ended);
+	// Writes boxes followed by pending data of the tracks, returns written size or 0 on error
+	DWORD  Write(int fd, const std::vector<BYTE>& boxes, const std::vector<Track*>& payload = {});
+	bool   Reserve(DWORD size);
+
+	void   SerializeInit(std::vector<BYTE>& out) const;
+	void   SerializeTrack(std::vector<BYTE>& out, const Track& track) const;
+	void   SerializeSampleEntry(std::vector<BYTE>& out, const Track& track) const;
+private:
+	struct Part
+	{
+		QWORD offset;
+		DWORD size;
+		double duration;
+		bool independent;
+	};
+	struct Segment
+	{
+		std::string name;
+		double duration;
+		std::vector<Part> parts;
+	};
+
+	Options options;
+	Stats stats;
+	std::vector<Track> tracks;
+	bool opened		= false;
+	bool initialized	= false;
+	bool direct		= false;
+	int fd			= FD_INVALID;
+	std::string filename;
+	QWORD offset		= 0;
+	DWORD sequence		= 0;
+	//Fragment output buffer, aligned for direct io
+	BYTE* buffer		= nullptr;
+	DWORD bufferSize	= 0;
+	//Segment mode, last one is the one being written
+	std::vector<Segment> segments;
+	double maxPartDuration	= 0;
+};
+
+#endif /* FRAGMENTEDMP4WRITER_H */
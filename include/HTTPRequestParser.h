@@ -0,0 +1,91 @@
+#ifndef HTTPREQUESTPARSER_H
+#define HTTPREQUESTPARSER_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Incremental HTTP/1.x request parser that does not copy the request.
+//
+// Data is parsed from a buffer owned by the caller, which must hold all the
+// data received since the start of the current request. The buffer can be
+// moved between calls, as positions are stored as offsets and only turned
+// into views on the buffer passed to the last call. Once a request is
+// complete the number of consumed bytes is returned, so pipelined requests
+// can be parsed from the rest of the buffer.
+//
+// Only Content-Length delimited bodies are supported.
+class HTTPRequestParser
+{
+public:
+	enum Result
+	{
+		NeedMoreData,
+		Complete,
+		Failed
+	};
+
+	static constexpr size_t MaxHeaderSize	= 16*1024;
+	static constexpr size_t MaxHeaders	= 64;
+	static constexpr size_t MaxBodySize	= 16*1024*1024;
+
+	class Request
+	{
+	public:
+		std::string_view GetMethod() const	{ return View(method);		}
+		std::string_view GetURI() const		{ return View(uri);		}
+		std::string_view GetVersion() const	{ return View(version);		}
+		std::string_view GetBody() const	{ return View(body);		}
+		bool IsKeepAlive() const		{ return keepAlive;		}
+		size_t GetNumHeaders() const		{ return headers.size();	}
+		std::string_view GetHeaderName(size_t i) const	{ return View(headers[i].name);	}
+		std::string_view GetHeaderValue(size_t i) const	{ return View(headers[i].value);	}
+
+		// Case insensitive search, returns empty view if not found
+		std::string_view GetHeader(std::string_view name) const;
+		bool HasHeader(std::string_view name) const;
+	private:
+		friend class HTTPRequestParser;
+		struct Span
+		{
+			uint32_t pos = 0;
+			uint32_t len = 0;
+		};
+		struct Header
+		{
+			Span name;
+			Span value;
+		};
+
+		std::string_view View(const Span& span) const	{ return std::string_view(data+span.pos,span.len);	}
+	private:
+		const char* data = nullptr;
+		Span method;
+		Span uri;
+		Span version;
+		Span body;
+		std::vector<Header> headers;
+		bool keepAlive = true;
+	};
+
+public:
+	// Parse the current request from the start of data, consumed is set when complete
+	Result Parse(const char* data, size_t size, size_t& consumed);
+	// Valid until next call to Parse() or the buffer is modified
+	const Request& GetRequest() const { return request; }
+	void Reset();
+
+	static bool EqualsIgnoreCase(std::string_view a, std::string_view b);
+private:
+	bool ParseHeaders(const char* data, size_t size);
+private:
+	Request request;
+	//Bytes already searched for the end of headers
+	size_t scanned = 0;
+	//Size of request line and headers once found
+	size_t headersSize = 0;
+	size_t contentLength = 0;
+	bool completed = false;
+};
+
+#endif /* HTTPREQUESTPARSER_H */
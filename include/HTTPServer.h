@@ -0,0 +1,77 @@
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include <netinet/in.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "ReactorServer.h"
+#include "HTTPRequestParser.h"
+#include "OrderedWorkerPool.h"
+
+// HTTP/1.1 server for small request/response APIs.
+//
+// Connections are multiplexed on a pool of reactors and parsed in place with
+// HTTPRequestParser, supporting keep-alive and pipelining. Requests are
+// processed on a worker pool, so a slow request does not block the others,
+// and responses are sent back in the order the requests were received.
+// Handlers can return an ordering key so related requests are processed one
+// after the other even if they come from different connections.
+class HTTPServer
+{
+public:
+	struct Response
+	{
+		WORD code = 200;
+		std::string contentType;
+		std::string body;
+	};
+
+	class Handler
+	{
+	public:
+		virtual ~Handler() = default;
+		// Called on the reactor thread, requests with same non zero key are processed in order
+		virtual QWORD GetOrderingKey(const HTTPRequestParser::Request& request) { return 0; }
+		// Called on a worker thread, request data is valid until it returns
+		virtual void ProcessRequest(const HTTPRequestParser::Request& request, Response& response) = 0;
+	};
+
+	//Max number of reactor threads used by default
+	static constexpr DWORD MaxDefaultThreads = ReactorServer::MaxDefaultThreads;
+	//Max number of requests of a connection being processed before we stop reading from it
+	static constexpr size_t MaxPipelinedRequests = 32;
+public:
+	HTTPServer();
+	~HTTPServer();
+
+	void AddHandler(const std::string& base, Handler* handler);
+
+	// Use port 0 to listen on any free port
+	int Init(int port, const char* iface = nullptr, DWORD threads = 0, DWORD workers = 0);
+	int End();
+
+	int GetPort() const	{ return listener.GetPort();	}
+
+	static const char* GetReason(WORD code);
+private:
+	class Connection;
+
+	void CreateConnection(int fd, EpollReactor* reactor);
+	void OnDisconnected(const std::shared_ptr<Connection>& connection);
+	Handler* GetHandler(std::string_view uri) const;
+private:
+	int inited = 0;
+	ReactorServer listener;
+
+	std::map<std::string,Handler*> handlers;
+	std::set<std::shared_ptr<Connection>> connections;
+	OrderedWorkerPool workers;
+	std::mutex mutex;
+};
+
+#endif /* HTTPSERVER_H */
@@ -0,0 +1,261 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Always-on log bucketed histogram for latencies in microseconds.
+//
+// Each power of two is split in SubBuckets linear buckets, so the relative error
+// of any reported value is below 1/SubBuckets. Recording only increments relaxed
+// counters on a shard owned by the recording thread, shards are allocated on
+// first use and merged when reading.
+//
+// Histograms are registered by name while alive, so stats for the whole server
+// can be obtained by merging all the live and already destroyed instances.
+class LatencyHistogram
+{
+public:
+	static constexpr uint32_t SubBucketBits	= 3;
+	static constexpr uint32_t SubBuckets	= 1 << SubBucketBits;
+	//Max value is 2^36-1 us, ~19 hours
+	static constexpr uint32_t MaxMagnitude	= 35;
+	static constexpr uint32_t Buckets	= (MaxMagnitude - SubBucketBits + 2) * SubBuckets;
+	static constexpr uint64_t MaxValue	= (1ull << (MaxMagnitude + 1)) - 1;
+	static constexpr uint32_t Shards	= 8;
+
+	struct Snapshot
+	{
+		std::array<uint64_t, Buckets> counts = {};
+		uint64_t count	= 0;
+		uint64_t sum	= 0;
+		uint64_t max	= 0;
+
+		void Merge(const Snapshot& other)
+		{
+			for (uint32_t i = 0; i < Buckets; ++i)
+				counts[i] += other.counts[i];
+			count += other.count;
+			sum += other.sum;
+			max = std::max(max, other.max);
+		}
+
+		// Highest value equivalent to the one at the requested percentile (0-100)
+		uint64_t GetPercentile(double percentile) const
+		{
+			//Check we have values
+			if (!count)
+				return 0;
+			//Get the number of values that must be below
+			uint64_t target = percentile >= 100 ? count : static_cast<uint64_t>(percentile * count / 100.0 + 0.5);
+			//At least one
+			if (!target)
+				target = 1;
+			uint64_t accumulated = 0;
+			//Find bucket
+			for (uint32_t i = 0; i < Buckets; ++i)
+			{
+				accumulated += counts[i];
+				if (accumulated >= target)
+					return std::min(GetBucketUpperBound(i), max);
+			}
+			return max;
+		}
+
+		uint64_t GetP50()  const { return GetPercentile(50);	}
+		uint64_t GetP99()  const { return GetPercentile(99);	}
+		uint64_t GetP999() const { return GetPercentile(99.9);	}
+		double   GetMean() const { return count ? static_cast<double>(sum) / count : 0; }
+	};
+
+public:
+	explicit LatencyHistogram(const std::string& name) :
+		name(name)
+	{
+		std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+		//Register
+		GetRegistry().entries[name].live.insert(this);
+	}
+
+	~LatencyHistogram()
+	{
+		//Get our values
+		auto snapshot = GetSnapshot();
+		{
+			std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+			auto& entry = GetRegistry().entries[name];
+			//Unregister
+			entry.live.erase(this);
+			//Keep values for the global stats
+			entry.retired.Merge(snapshot);
+		}
+		//Free shards
+		for (auto& shard : shards)
+			delete shard.load(std::memory_order_relaxed);
+	}
+
+	LatencyHistogram(const LatencyHistogram&) = delete;
+	LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+	void Record(uint64_t value)
+	{
+		//Get shard for current thread
+		auto index = GetThreadIndex();
+		Shard* shard = shards[index].load(std::memory_order_acquire);
+		//Create on first use
+		if (__builtin_expect(!shard, 0))
+			shard = CreateShard(index);
+		//Update counters
+		shard->counts[GetBucket(value)].fetch_add(1, std::memory_order_relaxed);
+		shard->count.fetch_add(1, std::memory_order_relaxed);
+		shard->sum.fetch_add(value, std::memory_order_relaxed);
+		//Update max
+		uint64_t max = shard->max.load(std::memory_order_relaxed);
+		while (value > max && !shard->max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+	}
+
+	// Merge all shards
+	Snapshot GetSnapshot() const
+	{
+		Snapshot snapshot;
+		for (auto& ptr : shards)
+		{
+			//Get shard
+			const Shard* shard = ptr.load(std::memory_order_acquire);
+			//If not used
+			if (!shard)
+				continue;
+			for (uint32_t i = 0; i < Buckets; ++i)
+				snapshot.counts[i] += shard->counts[i].load(std::memory_order_relaxed);
+			snapshot.count += shard->count.load(std::memory_order_relaxed);
+			snapshot.sum += shard->sum.load(std::memory_order_relaxed);
+			snapshot.max = std::max(snapshot.max, shard->max.load(std::memory_order_relaxed));
+		}
+		return snapshot;
+	}
+
+	const std::string& GetName() const { return name; }
+
+	// Merge all histograms with the same name, including the ones already destroyed
+	static Snapshot GetSnapshot(const std::string& name)
+	{
+		Snapshot snapshot;
+		std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+		//Find entry
+		auto it = GetRegistry().entries.find(name);
+		//If not found
+		if (it == GetRegistry().entries.end())
+			return snapshot;
+		//Merge them all
+		snapshot.Merge(it->second.retired);
+		for (auto histogram : it->second.live)
+			snapshot.Merge(histogram->GetSnapshot());
+		return snapshot;
+	}
+
+	static std::vector<std::string> GetNames()
+	{
+		std::vector<std::string> names;
+		std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+		for (const auto& [name, entry] : GetRegistry().entries)
+			names.push_back(name);
+		return names;
+	}
+
+	static uint32_t GetBucket(uint64_t value)
+	{
+		//Clamp
+		if (value > MaxValue)
+			value = MaxValue;
+		//Linear for small values
+		if (value < SubBuckets)
+			return static_cast<uint32_t>(value);
+		//Get magnitude
+		uint32_t magnitude = 63 - __builtin_clzll(value);
+		//Get bucket within the magnitude
+		uint32_t sub = static_cast<uint32_t>(value >> (magnitude - SubBucketBits)) - SubBuckets;
+		return (magnitude - SubBucketBits + 1) * SubBuckets + sub;
+	}
+
+	static uint64_t GetBucketLowerBound(uint32_t bucket)
+	{
+		//Linear for small values
+		if (bucket < SubBuckets)
+			return bucket;
+		//Get magnitude and bucket within it
+		uint32_t magnitude = bucket / SubBuckets + SubBucketBits - 1;
+		uint64_t sub = bucket % SubBuckets;
+		return (SubBuckets + sub) << (magnitude - SubBucketBits);
+	}
+
+	static uint64_t GetBucketUpperBound(uint32_t bucket)
+	{
+		//Linear for small values
+		if (bucket < SubBuckets)
+			return bucket;
+		//Get magnitude
+		uint32_t magnitude = bucket / SubBuckets + SubBucketBits - 1;
+		return GetBucketLowerBound(bucket) + (1ull << (magnitude - SubBucketBits)) - 1;
+	}
+
+private:
+	struct alignas(64) Shard
+	{
+		std::array<std::atomic<uint64_t>, Buckets> counts = {};
+		std::atomic<uint64_t> count	= 0;
+		std::atomic<uint64_t> sum	= 0;
+		std::atomic<uint64_t> max	= 0;
+	};
+
+	struct Entry
+	{
+		std::set<const LatencyHistogram*> live;
+		Snapshot retired;
+	};
+
+	struct Registry
+	{
+		std::mutex mutex;
+		std::map<std::string, Entry> entries;
+	};
+
+	static Registry& GetRegistry()
+	{
+		static Registry registry;
+		return registry;
+	}
+
+	static uint32_t GetThreadIndex()
+	{
+		static std::atomic<uint32_t> threads = 0;
+		//Assign shards round robin to threads
+		thread_local uint32_t index = threads.fetch_add(1, std::memory_order_relaxed) % Shards;
+		return index;
+	}
+
+	Shard* CreateShard(uint32_t index)
+	{
+		Shard* expected = nullptr;
+		Shard* shard = new Shard();
+		//Other thread sharing the index may have created it already
+		if (!shards[index].compare_exchange_strong(expected, shard, std::memory_order_acq_rel))
+		{
+			delete shard;
+			return expected;
+		}
+		return shard;
+	}
+
+private:
+	std::string name;
+	std::array<std::atomic<Shard*>, Shards> shards = {};
+};
+
+#endif /* LATENCYHISTOGRAM_H */
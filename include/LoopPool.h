@@ -0,0 +1,82 @@
+#ifndef LOOPPOOL_H_
+#define LOOPPOOL_H_
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "config.h"
+#include "log.h"
+
+// Shared loops, each object is assigned to the one with less users.
+//
+// Loops are started on first use and kept running for next users until the
+// pool is destroyed. Loop can be an EventLoop or any class derived from it.
+template<typename Loop>
+class LoopPool
+{
+public:
+	LoopPool(const std::string& name, DWORD maxDefaultThreads) :
+		name(name),
+		maxDefaultThreads(maxDefaultThreads)
+	{
+	}
+
+	// Starts num loops on first use, min(cores,maxDefaultThreads) if 0
+	Loop* Acquire(DWORD num = 0)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		//Start them on first use
+		if (loops.empty())
+		{
+			//Use one per core by default, up to max
+			if (!num)
+				num = std::min(std::max(std::thread::hardware_concurrency(),1u),maxDefaultThreads);
+
+			Log("-LoopPool::Acquire() | starting shared loops [name:%s,num:%u]\n",name.c_str(),num);
+
+			for (DWORD i=0;i<num;++i)
+			{
+				auto loop = std::make_unique<Loop>();
+				loop->Start();
+				loop->SetThreadName(name + "-" + std::to_string(i));
+				loops.emplace_back(std::move(loop),0);
+			}
+		}
+
+		//Get the one with less users
+		auto it = std::min_element(loops.begin(),loops.end(),[](const auto& a, const auto& b){ return a.second<b.second; });
+		//One more
+		it->second++;
+
+		return it->first.get();
+	}
+
+	void Release(Loop* loop)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		//Find it and decrease usage, loops are kept running for next users
+		for (auto& [used,count] : loops)
+			if (used.get()==loop && count)
+				count--;
+	}
+
+	size_t GetNumLoops()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return loops.size();
+	}
+private:
+	std::string name;
+	DWORD maxDefaultThreads;
+	std::mutex mutex;
+	//Loops and number of users of each one
+	std::vector<std::pair<std::unique_ptr<Loop>,DWORD>> loops;
+};
+
+#endif /* LOOPPOOL_H_ */
@@ -0,0 +1,55 @@
+#ifndef ORDEREDWORKERPOOL_H
+#define ORDEREDWORKERPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Pool of threads running tasks that must keep ordering per key.
+//
+// Tasks posted with the same non zero key are run one after the other in the
+// order they were posted, while tasks with different keys run in parallel.
+// Tasks with key 0 have no ordering constraints.
+class OrderedWorkerPool
+{
+public:
+	using Task = std::function<void()>;
+public:
+	explicit OrderedWorkerPool(const std::string& name = "worker");
+	~OrderedWorkerPool();
+
+	// Use one thread per core if not set
+	bool Start(uint32_t threads = 0);
+	// Runs all pending tasks before returning
+	bool Stop();
+
+	void Post(uint64_t key, Task&& task);
+
+	size_t GetNumThreads() const	{ return threads.size();	}
+private:
+	void Run();
+private:
+	struct Item
+	{
+		uint64_t key;
+		Task task;
+	};
+
+	std::string name;
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool running = false;
+	//Tasks ready to be run
+	std::deque<Item> ready;
+	//Keys with a task being run or ready, and the tasks waiting for them
+	std::unordered_map<uint64_t,std::deque<Task>> busy;
+};
+
+#endif /* ORDEREDWORKERPOOL_H */
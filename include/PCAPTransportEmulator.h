@@ -18,6 +18,7 @@
 #include "rtp.h"
 #include "PCAPReader.h"
 #include "EventLoop.h"
+#include "fecdecoder.h"
 
 
 class PCAPTransportEmulator : 
@@ -43,8 +44,13 @@ public:
 	virtual int SendPLI(DWORD ssrc) override { return 1; }
 	virtual int Reset(DWORD ssrc)  override { return 1; }
 	TimeService& GetTimeService() { return loop; }
+	// Aggregated stats of fec recovery, only safe when not playing
+	fec::Stats GetFECStats() const;
 private:
 	int Run();
+	void ProcessRTP(BYTE* data, DWORD size, QWORD ts);
+	void ProcessFEC(BYTE codec, DWORD ssrc, const BYTE* payload, DWORD size, QWORD ts);
+	void RecoverFECPackets(FECDecoder& decoder, QWORD ts);
 	RTPIncomingSourceGroup* GetIncomingSourceGroup(DWORD ssrc);
 	RTPIncomingSource* GetIncomingSource(DWORD ssrc);
 private:
@@ -56,6 +62,8 @@ private:
 	RTPMap		aptMap;
 	std::map<DWORD,RTPIncomingSourceGroup*> incoming;
 	std::map<MediaFrame::Type, RTPIncomingSourceGroup*> unknow;
+	//FEC decoders by protected ssrc
+	std::map<DWORD,std::unique_ptr<FECDecoder>> decoders;
 	uint64_t first		= 0;
 	volatile bool running	= false;;
 };
@@ -81,7 +81,7 @@ private:
 	Timer::shared iceTimer;
 	std::chrono::milliseconds iceTimeout = 10000ms;
 
-	std::map<std::string, Connection::shared>	connections;
+	std::map<std::string, Connection::shared, std::less<>>	connections;
 	std::map<std::string, ICERemoteCandidate>	candidates;
 	std::map<std::pair<uint64_t,uint32_t>, std::pair<std::string,std::string>> transactions;
 	uint32_t maxTransId = 0;
@@ -8,11 +8,18 @@
 #ifndef RTPSMOOTHER_H
 #define	RTPSMOOTHER_H
 
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include "config.h"
-#include "waitqueue.h"
 #include "rtp.h"
 #include "rtpsession.h"
 
+// Paces the rtp packets of each frame over its duration.
+//
+// Packets are sent from a timer on the time service of the session, so it
+// does not need its own thread.
 class RTPSmoother
 {
 public:
@@ -23,19 +30,24 @@ public:
 	int Cancel();
 	int End();
 
-protected:
-	int Run();
-
 private:
-	//Funciones propias
-	static void *run(void *par);
+	//Pending packets, shared with the timer callback so it never sees us deleted
+	struct Queue
+	{
+		std::mutex mutex;
+		RTPSession* session = nullptr;
+		Timer::shared timer;
+		//Packets with the time they have to be sent
+		std::deque<std::pair<std::chrono::milliseconds,RTPPacketSched::shared>> packets;
+		//Time last packet enqueued has to be sent
+		std::chrono::milliseconds last = std::chrono::milliseconds(0);
+	};
+
+	static void OnTimer(const std::shared_ptr<Queue>& queue, std::chrono::milliseconds now);
 private:
 	RTPSession	*session;
-	pthread_t	thread;
-	pthread_mutex_t mutex;
-	pthread_cond_t	cond;
 	bool		inited;
-	WaitQueue<RTPPacketSched::shared> queue;
+	std::shared_ptr<Queue> queue;
 };
 
 #endif	/* RTPSMOOTHER_H */
@@ -13,19 +13,26 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <map>
+#include <memory>
+#include <shared_mutex>
 #include <string>
 #include <poll.h>
 #include <srtp2/srtp.h>
 #include "config.h"
 #include "stunmessage.h"
 #include "dtls.h"
-#include "EventLoop.h"
+#include "EpollReactor.h"
 #include "Datachannels.h"
 #include "Endpoint.h"
 #include "PCAPFile.h"
 
+// Plain RTP transport over an UDP socket pair, or a single one with rtcp-mux.
+//
+// Sockets are registered on a small pool of epoll reactors shared by all the
+// transports, so each one does not need its own threads. Packets are received
+// in batches on the reactor thread, and sent directly on the socket from the
+// calling thread. Sockets are only closed while no packet is being sent.
 class RTPTransport :
-	public EventLoop::Listener,
 	public DTLSConnection::Listener
 {
 public:
@@ -46,12 +53,18 @@ public:
 	static bool SetPortRange(int minPort, int maxPort);
 	static DWORD GetMinPort() { return minLocalPort; }
 	static DWORD GetMaxPort() { return maxLocalPort; }
+	// Use min(cores,MaxDefaultThreads) reactors if not set, must be called before first transport is created
+	static void SetDefaultNumThreads(DWORD num)	{ defaultNumThreads = num;	}
 
+	static constexpr DWORD MaxDefaultThreads = 4;
+	//Max datagrams read from a socket on each event, so others are not starved
+	static constexpr DWORD MaxReceivingBatch = 32;
 private:
 	// Admissible port range
 	static DWORD minLocalPort;
 	static DWORD maxLocalPort;
 	static int minLocalPortRange;
+	static DWORD defaultNumThreads;
 
 public:
 	RTPTransport(Listener *listener);
@@ -73,36 +86,57 @@ public:
 	int SetRemoteSTUNCredentials(const char* username, const char* pwd);
 	
 	
-	void SetMuxRTCP(int flag)	{ muxRTCP = flag; };
+	// If enabled before Init only the rtp port is opened, if enabled later the rtcp one is closed
+	void SetMuxRTCP(int flag);
 	void SetSecure(int flag)	{ encript = true; decript = true; };
 
-	virtual void OnRead(const int fd, const uint8_t* data, const size_t size, const uint32_t ipAddr, const uint16_t port) override;
 	virtual void onDTLSSetup(DTLSConnection::Suite suite,BYTE* localMasterKey,DWORD localMasterKeySize,BYTE* remoteMasterKey,DWORD remoteMasterKeySize) override;
 	virtual void onDTLSPendingData() override;
 	virtual void onDTLSSetupError() override;
 	virtual void onDTLSShutdown() override;
 	
-	TimeService& GetTimeService() { return rtpLoop; }
+	TimeService& GetTimeService() { return *loop; }
 	
+private:
+	class Socket : public EpollReactor::Handler
+	{
+	public:
+		Socket(RTPTransport* transport, int fd, bool rtcp) :
+			transport(transport),
+			fd(fd),
+			rtcp(rtcp)
+		{
+		}
+		virtual void OnEvent(uint32_t events) override;
+
+		RTPTransport* transport;
+		int fd;
+		bool rtcp;
+	};
 private:
 	void SendEmptyPacket();
 	int SetLocalCryptoSDES(const char* suite, const BYTE* key, const DWORD len);
 	int SetRemoteCryptoSDES(const char* suite, const BYTE* key, const DWORD len);
 	void Start();
 	void Stop();
+	void Run(const std::function<void(void)>& func);
+	int  Send(bool rtcp, const sockaddr_in& addr, Packet&& packet);
+	void OnRead(bool rtcp, const uint8_t* data, const size_t size, const uint32_t ipAddr, const uint16_t port);
 	int  ReadRTP(const uint8_t* data, const size_t size, const uint32_t ipAddr, const uint16_t port);
 	int  ReadRTCP(const uint8_t* data, const size_t size, const uint32_t ipAddr, const uint16_t port);
-
 private:
 	Listener* listener;
 	bool	muxRTCP;
-	//Sockets
+	//Sockets, closing them is exclusive with sending on them
+	std::shared_mutex socketsMutex;
 	int 	simSocket;
 	int 	simRtcpSocket;
 	int 	simPort;
 	int	simRtcpPort;
-	EventLoop rtpLoop;
-	EventLoop rtcpLoop;
+	//Shared reactor and our sockets registered on it
+	EpollReactor* loop;
+	std::shared_ptr<Socket> rtpHandler;
+	std::shared_ptr<Socket> rtcpHandler;
 
 	datachannels::impl::Endpoint endpoint;
 	DTLSConnection dtls;
@@ -0,0 +1,77 @@
+#ifndef REACTORSERVER_H
+#define REACTORSERVER_H
+
+#include <netinet/in.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "EpollReactor.h"
+
+// Listening TCP socket spreading the accepted connections over a pool of reactors.
+//
+// Connections are accepted on the first reactor and assigned to the one with
+// less connections. Assignments are counted when the reactor is picked, not
+// when the connection gets registered on it, so a burst of accepts is spread
+// too. Servers must call Release() once the connection is closed.
+class ReactorServer
+{
+public:
+	//Called on the first reactor with the non blocking socket and the reactor it is assigned to
+	using Accepted = std::function<void(int fd, EpollReactor* reactor)>;
+
+	//Max number of reactor threads used by default
+	static constexpr DWORD MaxDefaultThreads = 4;
+public:
+	// Name is used as prefix for the reactor thread names
+	ReactorServer(const std::string& name);
+	~ReactorServer();
+
+	// Use port 0 to listen on any free port, and threads 0 for one reactor per core
+	bool Start(int port, in_addr_t iface, DWORD threads, Accepted accepted);
+	// Close the listening socket, assigned connections keep running on their reactors
+	void StopAccepting();
+	// Stop all the reactors
+	void Stop();
+
+	// Connection running on the reactor has been closed
+	void Release(EpollReactor* reactor);
+
+	int GetPort() const			{ return port;			}
+	size_t GetNumReactors() const		{ return reactors.size();	}
+	size_t GetAssigned(size_t i) const	{ return reactors[i]->assigned;	}
+private:
+	//Accepts connections on the first reactor
+	class Acceptor : public EpollReactor::Handler
+	{
+	public:
+		Acceptor(ReactorServer* server) : server(server) {}
+		virtual void OnEvent(uint32_t events) override { server->Accept(events); }
+	private:
+		ReactorServer* server;
+	};
+
+	struct Reactor
+	{
+		EpollReactor loop;
+		std::atomic<size_t> assigned = 0;
+	};
+
+	void Accept(uint32_t events);
+	EpollReactor* Assign();
+	bool BindServer();
+private:
+	std::string name;
+	int port = 0;
+	in_addr_t iface = INADDR_ANY;
+	int server = FD_INVALID;
+	std::atomic<bool> accepting = false;
+	Accepted accepted;
+
+	std::vector<std::unique_ptr<Reactor>> reactors;
+	std::shared_ptr<Acceptor> acceptor;
+};
+
+#endif /* REACTORSERVER_H */
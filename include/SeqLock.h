@@ -0,0 +1,94 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+// Single writer, multiple readers value holder.
+//
+// The writer never blocks and readers never touch the writer thread: they copy
+// the value and retry if a write was in progress while copying. The value is
+// stored as relaxed atomic words so concurrent copies are well defined, and the
+// object has no pointers so it can be placed in shared memory.
+template <typename T>
+class SeqLock
+{
+	static_assert(std::is_trivially_copyable_v<T>, "SeqLock values must be trivially copyable");
+	static constexpr std::size_t Words = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+public:
+	SeqLock()
+	{
+		Store(T{});
+	}
+
+	SeqLock(const SeqLock&) = delete;
+	SeqLock& operator=(const SeqLock&) = delete;
+
+	// Must be called always from the same thread
+	void Publish(const T& value)
+	{
+		//Get current version
+		uint32_t current = sequence.load(std::memory_order_relaxed);
+		//Odd version means write in progress
+		sequence.store(current + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		//Copy value
+		Store(value);
+		//Done
+		sequence.store(current + 2, std::memory_order_release);
+	}
+
+	// Returns false if the value was being written while reading it
+	bool TryRead(T& value) const
+	{
+		//Get version before reading
+		uint32_t before = sequence.load(std::memory_order_acquire);
+		//If write is in progress
+		if (before & 1)
+			return false;
+		//Copy value
+		Load(value);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		//Check it has not been changed meanwhile
+		return sequence.load(std::memory_order_relaxed) == before;
+	}
+
+	T Read() const
+	{
+		T value;
+		//Retry until we get a consistent copy
+		while (!TryRead(value))
+			std::this_thread::yield();
+		return value;
+	}
+
+	// Even number incremented by two on each publish
+	uint32_t GetVersion() const { return sequence.load(std::memory_order_acquire); }
+
+private:
+	void Store(const T& value)
+	{
+		uint64_t buffer[Words] = {};
+		std::memcpy(buffer, &value, sizeof(T));
+		for (std::size_t i = 0; i < Words; ++i)
+			words[i].store(buffer[i], std::memory_order_relaxed);
+	}
+
+	void Load(T& value) const
+	{
+		uint64_t buffer[Words];
+		for (std::size_t i = 0; i < Words; ++i)
+			buffer[i] = words[i].load(std::memory_order_relaxed);
+		std::memcpy(&value, buffer, sizeof(T));
+	}
+
+private:
+	std::atomic<uint32_t> sequence = 0;
+	std::array<std::atomic<uint64_t>, Words> words;
+};
+
+#endif /* SEQLOCK_H */
@@ -0,0 +1,106 @@
+#ifndef STATSSNAPSHOT_H
+#define STATSSNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "SeqLock.h"
+
+// Flat copy of the stats of a transport or a source group, published by the
+// owning loop and readable from any thread.
+struct StatsSnapshot
+{
+	enum Kind : uint32_t
+	{
+		Empty			= 0,
+		IncomingSourceGroup	= 1,
+		OutgoingSourceGroup	= 2,
+		Transport		= 3,
+	};
+
+	uint32_t kind			= Empty;
+	uint32_t media			= 0;
+	uint32_t ssrc			= 0;
+	uint32_t rtxSsrc		= 0;
+	//mid and rid for groups, local ice username for transports
+	char	 id[64]			= {};
+	uint64_t timestamp		= 0;
+
+	uint64_t totalPackets		= 0;
+	uint64_t totalBytes		= 0;
+	uint64_t totalRtxPackets	= 0;
+	uint32_t bitrate		= 0;
+	uint32_t rtxBitrate		= 0;
+	uint32_t numFrames		= 0;
+	uint32_t jitter			= 0;
+	uint32_t rtt			= 0;
+
+	uint32_t lost			= 0;
+	uint32_t lostDelta		= 0;
+	uint32_t fractionLost		= 0;
+	uint32_t totalNACKs		= 0;
+	uint32_t totalPLIs		= 0;
+
+	//Remote estimation for incoming groups, REMB for outgoing, sender side estimation for transports
+	uint32_t estimatedBitrate	= 0;
+	uint32_t availableBitrate	= 0;
+	uint32_t probingBitrate		= 0;
+
+	uint32_t minWaitedTime		= 0;
+	uint32_t maxWaitedTime		= 0;
+	double   avgWaitedTime		= 0;
+};
+
+// Fixed array of seqlock protected snapshots, optionally in shared memory
+class StatsSnapshotRegistry
+{
+public:
+	static constexpr uint32_t Magic		= 0x4d535353;
+	static constexpr uint32_t Version	= 1;
+	static constexpr uint32_t DefaultSlots	= 4096;
+
+	//Shared memory layout: Header followed by the slot array
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t slots;
+		uint32_t slotSize;
+	};
+
+	struct Slot
+	{
+		std::atomic<uint32_t>	used = 0;
+		SeqLock<StatsSnapshot>	snapshot;
+	};
+
+	// Owns a slot while alive, Publish must be called always from the same thread
+	class Publisher
+	{
+	public:
+		Publisher() = default;
+		~Publisher();
+		Publisher(const Publisher&) = delete;
+		Publisher& operator=(const Publisher&) = delete;
+
+		void Publish(const StatsSnapshot& snapshot);
+	private:
+		Slot* slot = nullptr;
+	};
+
+public:
+	// Back the registry by a shared memory object so an external process can scrape it.
+	// Must be called before any snapshot is published.
+	static bool Export(const char* name, uint32_t slots = DefaultSlots);
+
+	static std::vector<StatsSnapshot> GetSnapshots();
+	static uint32_t GetSlots();
+	static uint32_t GetUsedSlots();
+
+private:
+	static Slot* Acquire();
+	static void Release(Slot* slot);
+};
+
+#endif /* STATSSNAPSHOT_H */
@@ -0,0 +1,143 @@
+#ifndef TIMESHIFTBUFFER_H
+#define TIMESHIFTBUFFER_H
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "media.h"
+
+// Time shift buffer for recorders.
+//
+// Frames are stored as their payload on a ring arena plus a compact entry
+// with the metadata needed to rebuild them, instead of keeping a clone of each
+// frame and its buffers alive. The arena grows as needed up to a max size.
+//
+// Eviction is GOP aligned: frames are dropped up to a key frame of the first
+// video stream, so once drained the recording starts on a key frame. Time is
+// the one of the frames, not the wall clock.
+//
+// If a spill dir is set, when the arena is full the oldest frames are moved
+// to a file ring on disk instead of being dropped.
+class TimeShiftBuffer
+{
+public:
+	struct Options
+	{
+		//Duration to keep in ms
+		DWORD	duration	= 0;
+		//Max size of the memory arena
+		size_t	maxMemory	= 16*1024*1024;
+		//Dir of the spill file, empty for not spilling to disk
+		std::string spillDir;
+		//Max size of the spill file
+		size_t	maxSpill	= 256*1024*1024;
+	};
+
+	struct Stats
+	{
+		QWORD	frames		= 0;
+		QWORD	evicted		= 0;
+		QWORD	spilled		= 0;
+		//Dropped because there was no room for them
+		QWORD	overflows	= 0;
+	};
+
+	using Function = std::function<void(DWORD ssrc, const MediaFrame& frame)>;
+public:
+	TimeShiftBuffer();
+	explicit TimeShiftBuffer(const Options& options);
+	~TimeShiftBuffer();
+
+	void SetOptions(const Options& options);
+	const Options& GetOptions() const	{ return options;		}
+	void SetDuration(DWORD duration)	{ options.duration = duration;	}
+	DWORD GetDuration() const		{ return options.duration;	}
+
+	// Copies frame data, frame can be released afterwards. Empty frames are not stored
+	bool Push(DWORD ssrc, const MediaFrame& frame);
+	// Calls func with all frames in order and clears the buffer
+	void Drain(const Function& func);
+	// Drops all frames and releases memory
+	void Clear();
+	// Exchanges frames and options with other buffer
+	void Swap(TimeShiftBuffer& other);
+
+	bool   IsEmpty() const		{ return entries.empty();	}
+	size_t GetNumFrames() const	{ return entries.size();	}
+	// Duration in ms between first and last frame
+	QWORD  GetBufferedDuration() const	{ return !entries.empty() ? entries.back().time-entries.front().time : 0;	}
+	size_t GetMemoryUsage() const	{ return memory.used;		}
+	size_t GetMemorySize() const	{ return memory.capacity;	}
+	size_t GetSpillUsage() const	{ return spill.used;		}
+	const Stats& GetStats() const	{ return stats;			}
+private:
+	struct Entry
+	{
+		QWORD time;
+		QWORD timestamp;
+		QWORD senderTime;
+		DWORD ssrc;
+		DWORD clockRate;
+		DWORD duration;
+		//Location of the record, on memory or spill file
+		size_t offset;
+		DWORD size;
+		DWORD length;
+		WORD  configSize;
+		WORD  numRtpPackets;
+		WORD  width;
+		WORD  height;
+		int   codec;
+		BYTE  type;
+		BYTE  channels;
+		bool  intra;
+		bool  spilled;
+	};
+
+	// FIFO of variable sized records on a circular space
+	struct Ring
+	{
+		size_t capacity	= 0;
+		size_t head	= 0;
+		size_t tail	= 0;
+		size_t used	= 0;
+		size_t count	= 0;
+
+		// Returns offset or -1 if it does not fit
+		size_t Alloc(size_t size);
+		// Free oldest record, next is the offset of the one after it if any
+		void   Free(size_t size, size_t next);
+		void   Reset();
+	};
+
+	bool IsSync(const Entry& entry) const;
+	// Returns offset on the arena or -1 if it does not fit
+	size_t Alloc(DWORD size);
+	bool Grow(size_t size);
+	bool Spill();
+	void EvictOldest();
+	void EvictGOP();
+	// Drops frames before the last sync one out of the window
+	void Trim(QWORD now);
+	size_t NextOffset(size_t i, bool spilled) const;
+	const BYTE* Read(const Entry& entry);
+private:
+	Options options;
+	Stats stats;
+	std::deque<Entry> entries;
+	//Memory arena
+	std::unique_ptr<BYTE[]> arena;
+	Ring memory;
+	//Spill file
+	int fd = FD_INVALID;
+	Ring spill;
+	std::vector<BYTE> scratch;
+	//Video stream whose key frames are used for eviction
+	DWORD reference = 0;
+	bool  hasReference = false;
+};
+
+#endif /* TIMESHIFTBUFFER_H */
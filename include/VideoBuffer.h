@@ -2,17 +2,40 @@
 #define VIDEOBUFFER_H_
 #include "config.h"
 #include <memory>
+#include <sys/mman.h>
 
 class Plane
 {
 public:
-	Plane(DWORD width, DWORD height) :
+	static constexpr size_t HugePageSize = 2*1024*1024;
+public:
+	Plane(DWORD width, DWORD height, bool hugePages = false) :
 		//64 bytes aligned stride
 		stride((width / 64 + 1) * 64),
 		width(width),
 		height(height),
-		size((height + 1) * stride + 64)
+		size(GetRequiredSize(width, height, false))
 	{
+#ifdef MAP_HUGETLB
+		//Only worth for big planes
+		if (hugePages && size >= HugePageSize)
+		{
+			//Round up to huge page size
+			size_t mapped = (size + HugePageSize - 1) / HugePageSize * HugePageSize;
+			//Try to get huge pages
+			void* addr = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			//If got them
+			if (addr != MAP_FAILED)
+			{
+				//Use it
+				buffer = (uint8_t*)addr;
+				size = mapped;
+				this->mapped = true;
+				return;
+			}
+			//Fallback to normal pages
+		}
+#endif
 #ifdef HAVE_STD_ALIGNED_ALLOC
 		buffer = (uint8_t*)std::aligned_alloc(64, size);
 #else
@@ -21,14 +44,35 @@ public:
 	}
 	~Plane()
 	{
-		std::free(buffer);
+		if (mapped)
+			munmap(buffer, size);
+		else
+			std::free(buffer);
+	}
+	
+	//Bytes used by a plane of the given size, upper bound when backed by huge pages
+	static size_t GetRequiredSize(DWORD width, DWORD height, bool hugePages = false)
+	{
+		//64 bytes aligned stride
+		size_t size = (height + 1) * ((width / 64 + 1) * 64) + 64;
+#ifdef MAP_HUGETLB
+		//Rounded up to huge page size if big enough
+		if (hugePages && size >= HugePageSize)
+			size = (size + HugePageSize - 1) / HugePageSize * HugePageSize;
+#endif
+		return size;
 	}
 
+	Plane(const Plane&) = delete;
+	Plane& operator=(const Plane&) = delete;
+
 	const BYTE* GetData() const	{ return buffer;	}
 	BYTE* GetData()			{ return buffer;	}
 	DWORD GetStride() const		{ return stride;	}
 	DWORD GetWidth() const		{ return width;		}
 	DWORD GetHeight() const		{ return height;	}
+	size_t GetSize() const		{ return size;		}
+	bool IsHugePages() const	{ return mapped;	}
 	void Fill(BYTE color)
 	{
 		memset(buffer, color, size);
@@ -40,6 +84,7 @@ private:
 	DWORD height = 0;
 	uint8_t* buffer = nullptr;
 	size_t size = 0;
+	bool mapped = false;
 };
 
 class VideoBuffer
@@ -64,10 +109,10 @@ public:
 	};
 public:
 	VideoBuffer() = default;
-	VideoBuffer(DWORD width, DWORD height) : 
-		planeY(width, height),
-		planeU((width + 1) / 2, (height + 1) / 2),
-		planeV((width + 1) / 2, (height + 1) / 2),
+	VideoBuffer(DWORD width, DWORD height, bool hugePages = false) : 
+		planeY(width, height, hugePages),
+		planeU((width + 1) / 2, (height + 1) / 2, hugePages),
+		planeV((width + 1) / 2, (height + 1) / 2, hugePages),
 		width(width),
 		height(height)
 
@@ -84,6 +129,21 @@ public:
 
 	DWORD GetWidth() const	{ return width;		}
 	DWORD GetHeight() const { return height;	}
+	size_t GetSize() const	{ return planeY.GetSize() + planeU.GetSize() + planeV.GetSize(); }
+
+	//Bytes used by a buffer of the given size, so it can be checked before allocating it
+	static size_t GetRequiredSize(DWORD width, DWORD height, bool hugePages = false)
+	{
+		return Plane::GetRequiredSize(width, height, hugePages) + 2 * Plane::GetRequiredSize((width + 1) / 2, (height + 1) / 2, hugePages);
+	}
+	
+	void Reset()
+	{
+		isInterlaced = false;
+		colorSpace = ColorSpace::Unknown;
+		colorRange = ColorRange::Unknown;
+		time = 0;
+	}
 
 	void Fill(BYTE y, BYTE u, BYTE v)
 	{
@@ -101,6 +161,10 @@ public:
 	ColorRange GetColorRange() const { return colorRange; }
 	ColorSpace GetColorSpace() const { return colorSpace; }
 
+	//Time when the media for this picture was received in us, 0 if unknown
+	void SetTime(QWORD time) { this->time = time; }
+	QWORD GetTime() const { return time; }
+
 private:
 	
 	Plane	planeY;
@@ -111,6 +175,7 @@ private:
 	bool	isInterlaced = false;
 	ColorSpace colorSpace = ColorSpace::Unknown;
 	ColorRange colorRange = ColorRange::Unknown;
+	QWORD	time = 0;
 	
 	
 	
@@ -1,80 +1,253 @@
 #ifndef VIDEOBUFFERPOOL_H_
 #define VIDEOBUFFERPOOL_H_
 
-#include "concurrentqueue.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
 #include "VideoBuffer.h"
 
 class VideoBufferPool
 {
+public:
+	struct Stats
+	{
+		QWORD hits		= 0;
+		QWORD misses		= 0;
+		QWORD failed		= 0;
+		size_t allocated	= 0;
+		size_t idle		= 0;
+		size_t bytesResident	= 0;
+	};
+private:
+	using Size = std::pair<DWORD,DWORD>;
+
+	//Shared with the deleters, so buffers can be released after the pool is gone
+	struct State
+	{
+		std::mutex mutex;
+		std::map<Size,std::vector<VideoBuffer*>> buckets;
+		Size current		= {0,0};
+		std::size_t maxallocate = 0;
+		std::size_t maxMemory	= 0;
+		bool hugePages		= false;
+		bool closed		= false;
+		Stats stats;
+
+		~State()
+		{
+			//Delete all idle buffers
+			for (auto& [size,bucket] : buckets)
+				for (auto buffer : bucket)
+					delete(buffer);
+		}
+
+		void Release(VideoBuffer* buffer)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			//Get bucket
+			auto& bucket = buckets[{buffer->GetWidth(),buffer->GetHeight()}];
+			//If pool is alive and we have room for it
+			if (!closed && bucket.size()<maxallocate)
+			{
+				//Reset metadata
+				buffer->Reset();
+				//Enqueue it back
+				bucket.push_back(buffer);
+				//One more idle
+				stats.idle++;
+			} else {
+				//Not resident anymore
+				stats.bytesResident -= buffer->GetSize();
+				//Delete it
+				delete(buffer);
+			}
+			//One less in use
+			stats.allocated--;
+		}
+
+		void Trim(std::size_t required)
+		{
+			//Remove idle buffers from other sizes until there is room for the new one
+			for (auto it = buckets.begin(); it!=buckets.end() && stats.bytesResident+required>maxMemory; ++it)
+			{
+				//Skip current one
+				if (it->first==current)
+					continue;
+				//Get bucket
+				auto& bucket = it->second;
+				//Delete idle buffers
+				while (!bucket.empty() && stats.bytesResident+required>maxMemory)
+				{
+					//Get last
+					auto buffer = bucket.back();
+					//Not resident anymore
+					stats.bytesResident -= buffer->GetSize();
+					stats.idle--;
+					//Remove it
+					bucket.pop_back();
+					//Delete it
+					delete(buffer);
+				}
+			}
+		}
+	};
 public:
 	VideoBufferPool(std::size_t preallocate, std::size_t maxallocate) :
 		preallocate(preallocate),
-		maxallocate(maxallocate)
+		state(std::make_shared<State>())
 	{
+		//Max number of idle buffers per size
+		state->maxallocate = std::max(preallocate, maxallocate);
+	}
+
+	~VideoBufferPool()
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		//Any buffer released after now will be deleted
+		state->closed = true;
 	}
 
 	void SetSize(DWORD width, DWORD height)
 	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+
 		//Make sure we have a new size
-		if (this->width==width && this->height==height)
+		if (state->current==Size{width,height})
 			//Do nothing
 			return;
 
-		//Try deallocate old buffers now, but we will check the size when allocating a new one
-		VideoBuffer* buffer;
+		//Store new size, keep buffers from previous ones so switching back doesn't reallocate
+		state->current = {width,height};
 
-		//Get all the object from the pool
-		while (pool.try_dequeue(buffer))
-			//Delete them
-			delete(buffer);
+		//Get bucket for the new size
+		auto& bucket = state->buckets[state->current];
 
-		//Store new size
-		this->width = width;
-		this->height = height;
 		//Allocate some buffer objects by default
-		for (std::size_t i = 0; i < preallocate; ++i)
-			pool.enqueue(new VideoBuffer(width, height));
+		while (bucket.size()<preallocate)
+		{
+			//Get buffer size before allocating it
+			std::size_t required = VideoBuffer::GetRequiredSize(width, height, state->hugePages);
+			//If we have a memory limit
+			if (state->maxMemory && state->stats.bytesResident+required>state->maxMemory)
+				//Release idle buffers of other sizes
+				state->Trim(required);
+			//Check again
+			if (state->maxMemory && state->stats.bytesResident+required>state->maxMemory)
+				//Do not preallocate more
+				break;
+			//Create new one
+			auto buffer = new VideoBuffer(width, height, state->hugePages);
+			//Add it
+			bucket.push_back(buffer);
+			//Update stats
+			state->stats.idle++;
+			state->stats.bytesResident += buffer->GetSize();
+		}
 	}
 
-	~VideoBufferPool()
+	//Max memory used by all buffers of the pool, 0 for unlimited
+	void SetMaxMemory(std::size_t maxMemory)
 	{
-		VideoBuffer* buffer;
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->maxMemory = maxMemory;
+	}
 
-		//Get all the object from the pool
-		while (pool.try_dequeue(buffer))
-			//Delete them
-			delete(buffer);
+	//Try to back new buffer planes with huge pages
+	void SetHugePages(bool hugePages)
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->hugePages = hugePages;
 	}
 
+	Stats GetStats() const
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		return state->stats;
+	}
+
+	//Returns an empty buffer when the memory limit has been reached
 	VideoBuffer::shared allocate()
 	{
 		VideoBuffer* buffer = nullptr;
+		DWORD width = 0;
+		DWORD height = 0;
+		bool hugePages = false;
+		std::size_t required = 0;
 
-		//Try to get one from the pool
-		if (!pool.try_dequeue(buffer))
 		{
-			//Create a new one
-			buffer = new VideoBuffer(width, height);
+			std::lock_guard<std::mutex> lock(state->mutex);
+
+			//Get bucket for current size
+			auto& bucket = state->buckets[state->current];
+
+			//Try to get one from the pool
+			if (!bucket.empty())
+			{
+				//Get last one
+				buffer = bucket.back();
+				//Remove from pool
+				bucket.pop_back();
+				//Update stats
+				state->stats.idle--;
+				state->stats.hits++;
+			} else {
+				//Get current size
+				std::tie(width,height) = state->current;
+				hugePages = state->hugePages;
+				//Get buffer size before allocating it
+				required = VideoBuffer::GetRequiredSize(width, height, hugePages);
+				//If we have a memory limit
+				if (state->maxMemory && state->stats.bytesResident+required>state->maxMemory)
+				{
+					//Release idle buffers of other sizes
+					state->Trim(required);
+					//If still not enough room
+					if (state->stats.bytesResident+required>state->maxMemory)
+					{
+						//Back pressure
+						state->stats.failed++;
+						//Error
+						return nullptr;
+					}
+				}
+				//Reserve it
+				state->stats.misses++;
+				state->stats.bytesResident += required;
+			}
+			//One more in use
+			state->stats.allocated++;
 		}
-		//Make sure that it is from same size
-		else if (!buffer || buffer->GetWidth()!=width || buffer->GetHeight()!=height)
+
+		//If we need a new one
+		if (!buffer)
 		{
-			//Delete old one
-			delete (buffer);
-			//Create a new one
-			buffer = new VideoBuffer(width, height);
+			//Allocate it out of the lock
+			buffer = new VideoBuffer(width, height, hugePages);
+			//If huge pages were not available, it is smaller than reserved
+			if (buffer->GetSize()!=required)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				//Fix resident bytes
+				state->stats.bytesResident -= required - buffer->GetSize();
+			}
 		}
 
-
-		//We need to create a new one
-		return VideoBuffer::shared(buffer);
+		//Return it to the pool when released
+		return VideoBuffer::shared(buffer, [weak = std::weak_ptr<State>(state)](VideoBuffer* buffer) {
+			//If pool state is still alive
+			if (auto state = weak.lock())
+				//Return it
+				state->Release(buffer);
+			else
+				//Delete it
+				delete(buffer);
+		});
 	}
 
 private:
 	std::size_t preallocate = 0;
-	std::size_t maxallocate = 0;
-	DWORD width = 0;
-	DWORD height = 0;
-	moodycamel::ConcurrentQueue<VideoBuffer*> pool;
+	std::shared_ptr<State> state;
 };
 #endif // !VIDEOBUFFERPOOL_H_
@@ -3,15 +3,19 @@
 
 #include "codecs.h"
 #include "video.h"
-#include "waitqueue.h"
 #include "rtp.h"
+#include "VideoWorkerPool.h"
 #include "Deinterlacer.h"
+#include "VideoBufferScaler.h"
+#include "VideoOutputFanout.h"
+#include "LatencyHistogram.h"
+#include <atomic>
 
 class VideoDecoderWorker 
 	: public RTPIncomingMediaStream::Listener
 {
 public:
-	VideoDecoderWorker() = default;
+	VideoDecoderWorker();
 	virtual ~VideoDecoderWorker();
 
 	int Start();
@@ -20,24 +24,36 @@ public:
 	virtual void onBye(const RTPIncomingMediaStream* stream);
 	int Stop();
 	
-	void AddVideoOutput(VideoOutput* ouput);
+	void AddVideoOutput(VideoOutput* ouput, uint32_t width = 0, uint32_t height = 0, uint32_t maxFps = 0);
 	void RemoveVideoOutput(VideoOutput* ouput);
+	
+	DWORD GetDroppedFrames(VideoOutput* output);
+	const LatencyHistogram& GetDecodeLatency() const { return decodeLatency; }
+	VideoWorkerPool::Stats GetLoad() const { return worker->GetStats(); }
 
 protected:
-	int Decode();
+	void Decode(const RTPPacket::shared& packet);
 
 private:
-	static void *startDecoding(void *par);
-
+	static constexpr QWORD DefaultFramePeriod = 33000;
+	static constexpr QWORD MinFramePeriod = 5000;
+	static constexpr QWORD MaxFramePeriod = 200000;
 private:
-	std::set<VideoOutput*> outputs;
-	WaitQueue<RTPPacket::shared> packets;
-	pthread_t thread;
-	Mutex mutex;
-	bool decoding	= false;
+	VideoBufferScaler scaler;
+	VideoOutputFanout outputs;
+	std::shared_ptr<VideoWorkerPool::Worker> worker = std::make_shared<VideoWorkerPool::Worker>(VideoWorkerPool::GetInstance(), "video-dec");
+	std::atomic<bool> decoding = false;
 	bool muted	= false;
+	//Decoding state, only accessed from the worker
+	QWORD frameTime	= (QWORD)-1;
+	DWORD lastSeq	= RTPPacket::MaxExtSeqNum;
+	bool  waitIntra	= false;
+	QWORD lastFrameTimestamp = (QWORD)-1;
+	//Estimated frame duration in us, used as decoding deadline
+	std::atomic<QWORD> framePeriod = DefaultFramePeriod;
 	std::unique_ptr<VideoDecoder>	videoDecoder;
 	std::unique_ptr<Deinterlacer>	deinterlacer;
+	LatencyHistogram decodeLatency { "video.receive_to_decode" };
 };
 
 #endif /* VIDEODECODERWORKER_H */
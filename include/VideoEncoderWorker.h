@@ -9,10 +9,18 @@
 #define	VIDEOENCODERWORKER_H
 
 #include <pthread.h>
+#include <atomic>
+#include <memory>
 #include <set>
+#include <vector>
 #include "config.h"
 #include "codecs.h"
 #include "video.h"
+#include "acumulator.h"
+#include "VideoWorkerPool.h"
+#include "VideoBufferScaler.h"
+#include "VideoScaleLadder.h"
+#include "LatencyHistogram.h"
 
 class VideoEncoderWorker
 {
@@ -25,27 +33,53 @@ public:
 	int SetVideoCodec(VideoCodec::Type codec,int width, int height, int fps,int bitrate,int intraPeriod,const Properties & properties);
 	int End();
 
+	int  AddRendition(int width, int height, int bitrate, DWORD ssrc, const std::string& rid);
+	void ClearRenditions();
+	void SetMaxEncodingThreads(int threads);
+
 	int  SetTemporalBitrateLimit(int bitrate);
 	bool AddListener(const MediaFrame::Listener::shared& listener);
 	bool RemoveListener(const MediaFrame::Listener::shared& listener);
 	void SendFPU();
 	
 	bool IsEncoding() { return encoding;	}
+	const LatencyHistogram& GetEncodeLatency() const		{ return encodeLatency;		}
+	const LatencyHistogram& GetReceiveToEncodeLatency() const	{ return receiveToEncodeLatency;	}
+	//Load of the encoding workers, the first one runs the capture and rest the renditions
+	std::vector<VideoWorkerPool::Stats> GetLoad() const;
 	
 	int Start();
 	int Stop();
 	
 protected:
-	int Encode();
+	void Encode();
+	void EncodeLadder();
+	void EncodeRenditions(size_t group);
+	void DeliverLadder();
 
 private:
-	static void *startEncoding(void *par);
+	bool StartEncoder();
+	bool StartLadder();
+	void ClearEncoders();
+	void ScheduleNext(QWORD delay);
+	Properties GetCodecProperties(VideoWorkerPool::Worker& worker);
 
 private:
 	typedef std::set<MediaFrame::Listener::shared> Listeners;
 	
+	struct Rendition
+	{
+		int width	= 0;
+		int height	= 0;
+		int bitrate	= 0;
+		DWORD ssrc	= 0;
+		std::string rid;
+	};
+	
 private:
 	Listeners		listeners;
+	std::vector<Rendition>	renditions;
+	int maxEncodingThreads	= 4;
 	
 	VideoInput *input	= nullptr;
 	VideoCodec::Type codec  = VideoCodec::UNKNOWN;
@@ -59,11 +93,39 @@ private:
 	int bitrateLimitCount	= 0;
 	Properties properties;
 
-	pthread_t	thread;
 	pthread_mutex_t mutex;
-	pthread_cond_t	cond;
-	bool	encoding	 = false;
-	bool	sendFPU		 = false;
+	std::atomic<bool> encoding = false;
+	std::atomic<bool> sendFPU  = false;
+
+	//Capture and encoding of single rendition or scale tree, and ladder rendition encoders
+	std::shared_ptr<VideoWorkerPool::Worker> worker = std::make_shared<VideoWorkerPool::Worker>(VideoWorkerPool::GetInstance(), "video-enc");
+	std::vector<std::shared_ptr<VideoWorkerPool::Worker>> renditionWorkers;
+
+	//Encoding state, only accessed from the workers once started
+	std::unique_ptr<VideoEncoder>			videoEncoder;
+	Properties					encoderProperties;
+	std::vector<Rendition>				ladder;
+	std::vector<std::unique_ptr<VideoEncoder>>	encoders;
+	std::vector<VideoBuffer::const_shared>		scaled;
+	std::vector<VideoFrame*>			encoded;
+	std::atomic<size_t>				pendingRenditions = 0;
+	VideoBufferScaler scaler;
+	VideoScaleLadder scaleLadder { [this](const VideoBuffer::const_shared& input, const VideoBuffer::shared& output) {
+		return scaler.Resize(input, output, true);
+	} };
+	MinMaxAcumulator<> bitrateAcu { 1000 };
+	MinMaxAcumulator<> fpsAcu { 1000 };
+	QWORD first		= 0;
+	QWORD lastFPU		= 0;
+	QWORD next		= 0;
+	QWORD frameTime		= 0;
+	QWORD pictureTime	= 0;
+	int   current		= 0;
+	DWORD num		= 0;
+	bool  forceIntra	= false;
+
+	LatencyHistogram encodeLatency		{ "video.encode" };
+	LatencyHistogram receiveToEncodeLatency	{ "video.receive_to_encode" };
 };
 
 
@@ -0,0 +1,51 @@
+#ifndef VIDEOOUTPUTFANOUT_H
+#define VIDEOOUTPUTFANOUT_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "config.h"
+#include "video.h"
+
+// Delivers decoded pictures to several video outputs.
+//
+// Each output can request a target resolution and a maximum frame rate. A
+// picture is scaled once per distinct target resolution into a pool shared by
+// all the outputs of that size, and it is dropped only for the outputs that
+// are rate limited.
+class VideoOutputFanout
+{
+public:
+	//Scales input into the output buffer, returns false on error
+	using Scaler = std::function<bool(const VideoBuffer::const_shared& input, const VideoBuffer::shared& output)>;
+public:
+	explicit VideoOutputFanout(Scaler scaler);
+
+	void AddOutput(VideoOutput* output, uint32_t width = 0, uint32_t height = 0, uint32_t maxFps = 0);
+	void RemoveOutput(VideoOutput* output);
+
+	DWORD GetDroppedFrames(VideoOutput* output);
+	size_t GetNumPools();
+
+	// Sends the picture to all outputs, time is the presentation time in ms
+	void Deliver(const VideoBuffer::const_shared& frame, QWORD time);
+
+private:
+	struct Output
+	{
+		uint32_t width	= 0;
+		uint32_t height	= 0;
+		uint32_t maxFps	= 0;
+		QWORD	 last	= (QWORD)-1;
+		DWORD	 dropped = 0;
+	};
+	using Size = std::pair<uint32_t,uint32_t>;
+private:
+	Scaler scaler;
+	std::mutex mutex;
+	std::map<VideoOutput*,Output> outputs;
+	std::map<Size,std::unique_ptr<VideoBufferPool>> pools;
+};
+
+#endif /* VIDEOOUTPUTFANOUT_H */
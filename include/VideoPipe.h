@@ -23,12 +23,15 @@ public:
 	/** VideoInput */
 	virtual int   StartVideoCapture(uint32_t width, uint32_t height, uint32_t fps);
 	virtual VideoBuffer::const_shared GrabFrame(uint32_t timeout);
+	virtual VideoBuffer::const_shared TryGrabFrame();
 	virtual void  CancelGrabFrame();
 	virtual int   StopVideoCapture();
 	/** VideoOutput */
 	virtual int NextFrame(const VideoBuffer::const_shared& videoBuffer);
 	virtual void ClearFrame();
 	int End();
+private:
+	VideoBuffer::const_shared Scale(VideoBuffer::const_shared&& videoBuffer);
 private:
 	uint32_t videoWidth = 0;
 	uint32_t videoHeight = 0;
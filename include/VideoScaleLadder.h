@@ -0,0 +1,45 @@
+#ifndef VIDEOSCALELADDER_H
+#define VIDEOSCALELADDER_H
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "config.h"
+#include "video.h"
+
+// Scales a captured picture to all the sizes of an encoding ladder.
+//
+// Sizes are expected from higher to lower resolution, and each level is scaled
+// from the closest larger one that could be scaled, so every level only has a
+// small downscale to do. Scaled pictures are taken from a pool per level.
+class VideoScaleLadder
+{
+public:
+	//Scales input into the output buffer, returns false on error
+	using Scaler = std::function<bool(const VideoBuffer::const_shared& input, const VideoBuffer::shared& output)>;
+	using Size = std::pair<uint32_t,uint32_t>;
+public:
+	explicit VideoScaleLadder(Scaler scaler);
+
+	void SetSizes(const std::vector<Size>& sizes);
+	//Pool settings for each level, applied on next SetSizes
+	void SetMaxMemory(std::size_t maxMemory)	{ this->maxMemory = maxMemory;	}
+	void SetHugePages(bool hugePages)		{ this->hugePages = hugePages;	}
+	void Clear();
+
+	size_t GetNumLevels() const	{ return sizes.size();	}
+
+	// Returns the picture for each level, null for the ones that could not be scaled
+	const std::vector<VideoBuffer::const_shared>& Scale(const VideoBuffer::const_shared& picture);
+
+private:
+	Scaler scaler;
+	std::vector<Size> sizes;
+	std::vector<std::unique_ptr<VideoBufferPool>> pools;
+	std::vector<VideoBuffer::const_shared> scaled;
+	std::size_t maxMemory = 0;
+	bool hugePages = false;
+};
+
+#endif /* VIDEOSCALELADDER_H */
@@ -0,0 +1,157 @@
+#ifndef VIDEOWORKERPOOL_H
+#define VIDEOWORKERPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "config.h"
+
+// Shared pool of threads running video decoding and encoding work.
+//
+// Each decoder or encoder owns a Worker, and posts tasks to it with an
+// absolute deadline, optionally not to be run before a given time. Tasks of
+// the same worker are run one after the other in the order they were posted,
+// and among the workers with tasks ready to be run, the one with the earliest
+// deadline goes first.
+//
+// The pool also keeps a global budget of extra codec threads, so the threads
+// created internally by the codecs do not oversubscribe the cpus, and per
+// worker counters so the load of each worker can be reported.
+//
+// All times are in microseconds, as returned by getTime().
+class VideoWorkerPool
+{
+public:
+	using Function = std::function<void()>;
+
+	struct Stats
+	{
+		QWORD		id		= 0;
+		std::string	pool;
+		std::string	name;
+		QWORD		tasks		= 0;
+		//Tasks finished after their deadline
+		QWORD		missed		= 0;
+		QWORD		maxLateness	= 0;
+		QWORD		busyTime	= 0;
+		size_t		pending		= 0;
+		//Extra codec threads taken from the budget
+		DWORD		codecThreads	= 0;
+		//Cpu where last task was run, -1 if pool threads are not pinned
+		int		cpu		= -1;
+	};
+
+	// Must be created with std::make_shared, the pool keeps a reference while
+	// running its tasks so it can be deleted from them
+	class Worker : public std::enable_shared_from_this<Worker>
+	{
+	public:
+		Worker(VideoWorkerPool& pool, const std::string& name);
+		~Worker();
+
+		// Returns false if worker is stopped
+		bool Post(QWORD deadline, Function&& func, QWORD notBefore = 0);
+		// Accept tasks again after being stopped
+		void Start();
+		// Drop pending tasks, reject new ones and wait for the running one to finish
+		void Stop();
+
+		// Number of threads the codec may use, at least one as the pool thread is always available
+		DWORD AcquireCodecThreads(DWORD requested);
+		void  ReleaseCodecThreads();
+
+		Stats GetStats() const;
+		VideoWorkerPool& GetPool()	{ return pool;	}
+	private:
+		friend class VideoWorkerPool;
+
+		// Must be called with pool mutex held
+		Stats Snapshot() const;
+
+		struct Item
+		{
+			QWORD notBefore;
+			QWORD deadline;
+			Function func;
+		};
+	private:
+		VideoWorkerPool& pool;
+		QWORD id;
+		std::string name;
+		//All protected by pool mutex
+		std::deque<Item> queue;
+		bool enabled	= true;
+		bool running	= false;
+		std::thread::id runner;
+		//Where the worker is scheduled, if it is
+		bool scheduled	= false;
+		bool delayed	= false;
+		QWORD key	= 0;
+		DWORD codecThreads = 0;
+		Stats stats;
+	};
+
+public:
+	explicit VideoWorkerPool(const std::string& name = "video");
+	~VideoWorkerPool();
+
+	// Threads are pinned to the given cpus, round robin. If no thread number is
+	// set, one per cpu given or per core if none.
+	bool Start(DWORD threads = 0, const std::vector<int>& cpus = {});
+	bool Stop();
+
+	// Extra codec threads shared by all workers, by default one per pool thread
+	void  SetCodecThreadBudget(DWORD budget);
+	DWORD GetCodecThreadBudget() const;
+	DWORD GetUsedCodecThreads() const;
+
+	std::vector<Stats> GetWorkerStats() const;
+	const std::string& GetName() const	{ return name;			}
+	DWORD GetNumThreads() const		{ return threads.size();	}
+
+	// Pool shared by all video workers, started on first use
+	static VideoWorkerPool& GetInstance();
+	static void SetDefaultNumThreads(DWORD num)			{ defaultNumThreads = num;	}
+	static void SetDefaultCPUs(const std::vector<int>& cpus)	{ defaultCPUs = cpus;		}
+
+	// Stats of workers of all running pools
+	static std::vector<Stats> GetRunningStats();
+	// Cpus of a numa node, empty if not found
+	static std::vector<int> GetNodeCPUs(int node);
+private:
+	void Run(int cpu);
+	// Must be called with mutex held
+	void Schedule(Worker* worker, QWORD now);
+	void Unschedule(Worker* worker);
+private:
+	static DWORD defaultNumThreads;
+	static std::vector<int> defaultCPUs;
+
+	std::string name;
+	std::vector<std::thread> threads;
+	bool running = false;
+
+	mutable std::mutex mutex;
+	std::condition_variable cond;
+	//Signaled when a task has finished
+	std::condition_variable done;
+	//Workers with a task that can be run, by deadline
+	std::set<std::pair<QWORD,Worker*>> ready;
+	//Workers with a task that can't be run yet, by time
+	std::set<std::pair<QWORD,Worker*>> delayed;
+	std::set<Worker*> workers;
+	QWORD lastId = 0;
+
+	//Not set, one per thread
+	DWORD codecThreadBudget = (DWORD)-1;
+	DWORD usedCodecThreads = 0;
+};
+
+#endif /* VIDEOWORKERPOOL_H */
@@ -64,6 +64,8 @@ public:
 		frame->SetNumChannels(GetNumChannels());
 		//Set config
 		if (HasCodecConfig()) frame->SetCodecConfig(GetCodecConfigData(),GetCodecConfigSize());
+		//Reference same fragments
+		frame->ShareFragments(*this);
 		//If we have disabled the shared buffer for this frame
 		if (disableSharedBuffer)
 			//Copy data
@@ -95,6 +97,8 @@ public:
 	virtual DWORD GetRecordingRate()=0;
 	virtual DWORD GetNumChannels()=0;
 	virtual int RecBuffer(SWORD *buffer,DWORD size)=0;
+	//Non blocking RecBuffer for the audio engine tasks, returns 0 if there are not enough samples yet
+	virtual int TryRecBuffer(SWORD *buffer,DWORD size)=0;
 	virtual int ClearBuffer() = 0;
 	virtual void  CancelRecBuffer()=0;
 	virtual int StartRecording(DWORD samplerate)=0;
@@ -11,9 +11,11 @@
 #include "audio.h"
 #include "waitqueue.h"
 #include "rtp.h"
+#include "AudioEngine.h"
 
 class AudioDecoderWorker 
-	: public RTPIncomingMediaStream::Listener
+	: public RTPIncomingMediaStream::Listener,
+	  public AudioEngine::Task
 {
 public:
 	AudioDecoderWorker() = default;
@@ -31,20 +33,20 @@ public:
 	void AddAudioOuput(AudioOutput* ouput);
 	void RemoveAudioOutput(AudioOutput* ouput);
 
+	//Audio engine task
+	virtual void OnTick(AudioEngine::Phase phase, QWORD now) override;
+
 protected:
 	int Decode();
 
-private:
-	static void *startDecoding(void *par);
-
 private:
 	std::set<AudioOutput*> outputs;
 	WaitQueue<RTPPacket::shared> packets;
-	pthread_t thread;
 	Mutex mutex;
 	bool		decoding	= false;
 	DWORD		rate		= 0;
 	DWORD		numChannels = 0;
+	QWORD		lastTime	= 0;
 	std::unique_ptr<AudioDecoder>	codec;
 };
 
@@ -1,9 +1,12 @@
 #ifndef AUDIOENCODER_H_
 #define	AUDIOENCODER_H_
 #include "audio.h"
+#include "AudioEngine.h"
+#include <memory>
 #include <set>
 
-class AudioEncoderWorker
+class AudioEncoderWorker :
+	public AudioEngine::Task
 {
 public:
 	AudioEncoderWorker();
@@ -19,27 +22,33 @@ public:
 
 	int IsEncoding() { return encodingAudio;}
 
+	//Audio engine task
+	virtual void OnTick(AudioEngine::Phase phase, QWORD now) override;
+
 protected:
 	int Encode();
 
-
 private:
-	//Funciones propias
-	static void *startEncoding(void *par);
-	AudioEncoder* CreateAudioEncoder(AudioCodec::Type type);
+	void UpdateCodecConfig();
 
 private:
 	typedef std::set<MediaFrame::Listener::shared> Listeners;
 	
 private:
 	Listeners		listeners;
-	AudioInput*		audioInput;
+	AudioInput*		audioInput = nullptr;
 	AudioCodec::Type	audioCodec;
 	Properties		audioProperties;
 	pthread_mutex_t		mutex;
-	pthread_t		encodingAudioThread;
 	int			encodingAudio;
+
+	//Encoding state, only used from the audio engine once started
+	std::unique_ptr<AudioEncoder>	codec;
+	std::unique_ptr<AudioFrame>	frame;
+	SWORD				recBuffer[2048];
+	QWORD				frameTime = 0;
+	DWORD				numChannels = 1;
+	DWORD				rate = 0;
 };
 
 #endif	/* AUDIOENCODER_H */
-
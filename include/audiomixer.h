@@ -6,9 +6,13 @@
 #include "pipeaudioinput.h"
 #include "pipeaudiooutput.h"
 #include "sidebar.h"
+#include "AudioEngine.h"
+#include "AudioResampleStage.h"
 #include <map>
 
-class AudioMixer : public VADProxy
+class AudioMixer :
+	public VADProxy,
+	public AudioEngine::Task
 {
 public:
 	AudioMixer();
@@ -36,18 +40,13 @@ public:
 	
 	int SetCalculateVAD(bool vad);
 
+	//Audio engine task
+	virtual void OnTick(AudioEngine::Phase phase, QWORD now) override;
+
 public:
 	static int SidebarDefault;
 	static int NoSidebar;
 	
-protected:
-	//Mix thread
-	int MixAudio();
-
-private:
-	//Mixer thread launcher
-	static void * startMixingAudio(void *par);
-
 private:
 
 	//Tipos
@@ -78,8 +77,8 @@ private:
 	typedef std::map<int,Sidebar *>		Sidebars;
 
 private:
-	pthread_t 	mixAudioThread;
 	int		mixingAudio;
+	QWORD		lastMixed;
 	Use		lstAudiosUse;
 	
 	Audios		audios;
@@ -88,6 +87,8 @@ private:
 	int		numSidebars;
 	bool		vad;
 	DWORD		rate;
+	//Conversions of the sidebar mixes shared by the listeners not mixed in them
+	AudioResampleStage resampleStage;
 
 };
 
@@ -6,8 +6,10 @@
 #include "codecs.h"
 #include "rtpsession.h"
 #include "audio.h"
+#include "AudioEngine.h"
 
-class AudioStream
+class AudioStream :
+	public AudioEngine::Task
 {
 public:
 	AudioStream(RTPSession::Listener* listener);
@@ -32,15 +34,13 @@ public:
 	int IsReceiving() { return receivingAudio;}
 	MediaStatistics GetStatistics();
 
+	//Audio engine task, receives on decode phase and sends on encode phase
+	virtual void OnTick(AudioEngine::Phase phase, QWORD now) override;
+
 protected:
 	int SendAudio();
 	int RecAudio();
 
-private:
-	//Funciones propias
-	static void *startSendingAudio(void *par);
-	static void *startReceivingAudio(void *par);
-
 	//Los objectos gordos
 	RTPSession	rtp;
 	AudioInput	*audioInput;
@@ -50,9 +50,15 @@ private:
 	AudioCodec::Type audioCodec;
 	Properties	 audioProperties;
 	
-	//Las threads
-	pthread_t 	recAudioThread;
-	pthread_t 	sendAudioThread;
+	//Decoding state
+	AudioDecoder*	decoder = nullptr;
+	QWORD		lastTime = 0;
+
+	//Encoding state
+	AudioEncoder*	encoder = nullptr;
+	DWORD		rate = 0;
+	DWORD		clock = 0;
+	QWORD		frameTime = 0;
 
 	//Controlamos si estamos mandando o no
 	volatile int	sendingAudio;
@@ -105,6 +105,8 @@ public:
 		else if (strcasecmp(codec,"VP9")==0) return VP9;
 		else if (strcasecmp(codec,"AV1")==0) return AV1;
 		else if (strcasecmp(codec,"FLEXFEC")==0) return FLEXFEC;
+		else if (strcasecmp(codec,"FLEXFEC-03")==0) return FLEXFEC;
+		else if (strcasecmp(codec,"ULPFEC")==0) return ULPFEC;
 		else if (strcasecmp(codec,"WEBP") == 0) return WEBP;
 		return UNKNOWN;
 	}
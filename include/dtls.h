@@ -42,6 +42,13 @@ public:
 		UNKNOWN_HASH
 	};
 
+	enum KeyType
+	{
+		KEY_RSA,	// RSA 2048, slow to generate and to handshake
+		KEY_ECDSA_P256,	// ECDSA on P-256 curve, same as browsers
+		KEY_ED25519,	// Ed25519, only usable on DTLS by recent openssl versions and not by browsers
+	};
+
 public:
 	class Listener
 	{
@@ -58,6 +65,18 @@ public:
 
 public:
 	static void SetCertificate(const char* cert,const char* key);
+	static void SetKeyType(KeyType keyType);
+	static KeyType GetKeyType()					{ return keyType; }
+	static KeyType KeyTypeFromName(const char* name)
+	{
+		if (strcasecmp(name,"ecdsa")==0)
+			return KEY_ECDSA_P256;
+		else if (strcasecmp(name,"ed25519")==0)
+			return KEY_ED25519;
+		return KEY_RSA;
+	}
+	// Write the generated certificate to the certificate files when none of them exist, so it is reused on next start
+	static void SetSaveCertificate(bool save)			{ saveCertificate = save; }
 	static int Initialize();
 	static int Terminate();
 	static std::string GetCertificateFingerPrint(Hash hash);
@@ -100,6 +119,7 @@ public:
 private:
 	static int GenerateCertificate();
 	static int ReadCertificate();
+	static int SaveCertificate();
 	
 private:
 	typedef std::map<Hash, std::string> LocalFingerPrints;
@@ -111,6 +131,8 @@ private:
 	static SSL_CTX*		ssl_ctx;		// SSL context 
 	static X509*		certificate;		// SSL context 
 	static EVP_PKEY*	privateKey;		// SSL context 
+	static KeyType		keyType;		// Type of key to generate
+	static bool		saveCertificate;	// Store generated certificate on missing files
 	static LocalFingerPrints localFingerPrints;
 	static AvailableHashes	availableHashes;
 	static bool		hasDTLS;
@@ -0,0 +1,108 @@
+#ifndef FEC_H
+#define FEC_H
+
+#include "config.h"
+
+// Definitions shared by the FECEncoder and FECDecoder.
+//
+// Both ULPFEC (RFC 5109) and FlexFEC (draft-ietf-payload-flexible-fec-scheme-03,
+// as negotiated by webrtc) are XOR based: each fec packet protects a set of
+// media packets given by a mask over their sequence numbers, and recovers one of
+// them if all the others have been received. Protection covers the first two
+// bytes of the rtp header, the timestamp, the length after the fixed 12 byte
+// header and everything after it.
+namespace fec
+{
+	enum class Scheme
+	{
+		ULPFEC,
+		FlexFEC
+	};
+
+	//Size of the fixed rtp header
+	static constexpr DWORD RTPHeaderSize = 12;
+	//Max packets protected by a fec packet, flexfec masks have up to 109 bits
+	static constexpr DWORD MaxProtected = 109;
+	//Max packets protected by an ulpfec packet with long mask
+	static constexpr DWORD MaxProtectedULPFEC = 48;
+	//Payload buffers are padded to whole 32 byte blocks, so XOR of stored packets does not need a tail
+	static constexpr DWORD BufferSize = (MTU+31) & ~31u;
+
+	// Bitmask of protected packets, bit i is packet with sequence number base+i
+	struct Mask
+	{
+		QWORD bits[2] = {};
+
+		void Set(DWORD i)		{ bits[i>>6] |= ((QWORD)1) << (i & 63);		}
+		bool Test(DWORD i) const	{ return (bits[i>>6] >> (i & 63)) & 1;		}
+		bool IsEmpty() const		{ return !bits[0] && !bits[1];			}
+		DWORD Count() const		{ return __builtin_popcountll(bits[0]) + __builtin_popcountll(bits[1]);	}
+		// Number of bits needed to hold the highest one set
+		DWORD GetLength() const
+		{
+			if (bits[1]) return 128 - __builtin_clzll(bits[1]);
+			if (bits[0]) return 64 - __builtin_clzll(bits[0]);
+			return 0;
+		}
+		// Calls func for each bit set in ascending order
+		template<typename Func>
+		void ForEach(Func&& func) const
+		{
+			for (DWORD i=0;i<2;++i)
+				for (QWORD b = bits[i]; b; b &= b-1)
+					func(i*64 + __builtin_ctzll(b));
+		}
+	};
+
+	// Fields of the fec header, recovery fields are the XOR of the protected ones
+	struct Header
+	{
+		BYTE  recovery[2]	= {};	//P, X, CC, M and PT of the rtp header
+		DWORD timestamp		= 0;
+		WORD  length		= 0;	//Length of the packet after the fixed header
+		WORD  base		= 0;	//Sequence number of first protected packet
+		DWORD ssrc		= 0;	//Protected ssrc, only on flexfec
+		Mask  mask;
+		DWORD protectionLength	= 0;	//Bytes of fec payload after the header
+	};
+
+	// Parses the fec header from the fec packet payload, returns its size or 0 on error
+	DWORD Parse(Scheme scheme, const BYTE* data, DWORD size, Header& header);
+	// Writes the fec header, returns its size or 0 if it does not fit
+	DWORD Serialize(Scheme scheme, const Header& header, BYTE* data, DWORD size);
+	// Size of the fec header needed for the mask
+	DWORD GetHeaderSize(Scheme scheme, const Mask& mask);
+	// Max packets that can be protected by a fec packet
+	DWORD GetMaxProtected(Scheme scheme);
+
+	// XORs src into dst, dst must be 32 byte aligned
+	void XOR(BYTE* dst, const BYTE* src, DWORD size);
+	// XORs the protected fields of a serialized rtp packet into the header
+	void XORHeader(Header& header, const BYTE* packet, DWORD size);
+
+	// Rounds up to the XOR block size
+	inline DWORD Padded(DWORD size) { return (size+31) & ~31u; }
+
+	struct Stats
+	{
+		//Media packets received or protected
+		QWORD mediaPackets	= 0;
+		QWORD mediaBytes	= 0;
+		//Fec packets received or generated
+		QWORD fecPackets	= 0;
+		QWORD fecBytes		= 0;
+		//Media packets recovered
+		QWORD recovered		= 0;
+		//Fec packets dropped because protected packets were too old or more than one was missing
+		QWORD unrecoverable	= 0;
+		//Fec packets not needed as all protected packets were received
+		QWORD unused		= 0;
+		//Fec packets with invalid headers
+		QWORD invalid		= 0;
+
+		//Percentage of fec bytes over media bytes
+		double GetOverhead() const { return mediaBytes ? fecBytes*100.0/mediaBytes : 0;	}
+	};
+};
+
+#endif /* FEC_H */
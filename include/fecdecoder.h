@@ -1,4 +1,4 @@
-/* 
+/*
  * File:   fecdecoder.h
  * Author: Sergio
  *
@@ -8,122 +8,84 @@
 #ifndef FECDECODER_H
 #define	FECDECODER_H
 
+#include <memory>
+#include <vector>
 #include "config.h"
-#include "rtp.h"
-#include <map>
+#include "fec.h"
+#include "Packet.h"
 
-class FECData
+/**
+ * Recovers lost media packets of a single ssrc from ULPFEC or FlexFEC packets.
+ *
+ * Received media packets are kept on a ring of WindowSize slots indexed by
+ * their extended sequence number, with the payload on a 32 byte aligned and
+ * zero padded buffer so recovery XORs whole blocks. Fec packets waiting for
+ * their protected packets are kept on a ring of MaxPending slots. Each call to
+ * Recover() uses any fec packet with exactly one protected packet missing,
+ * which is added back to the window so it can be used to recover others.
+ */
+class FECDecoder
 {
-
 public:
-	FECData()
-	{
-		size = 0;
-		cycles = 0;
-	}
-	
-	FECData(BYTE* data,DWORD size)
-	{
-		//Copy data
-		memcpy(this->data,data,size);
-		//Set size
-		this->size = size;
-		//No cycles
-		cycles = 0;
-	}
-	
-	/*
-		The FEC header is 10 octets. The format of the header is shown in
-		Figure 3 and consists of extension flag (E bit), long-mask flag (L
-		bit), P recovery field, X recovery field, CC recovery field, M
-		recovery field, PT recovery field, SN base field, TS recovery field,
-		and length recovery field.
-		0                   1                   2                   3
-		 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
-		+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-		|E|L|P|X|   CC  |M| PT recovery |       SN base                 |
-		+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-		|                            TS recovery                        |
-		+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-		| length recovery               |
-		+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+++
-	 */
-	bool  GetExtensionFlag()	{ return data[0] & 0x80;	}
-	bool  GetLongMask()		{ return data[0] & 0x40;	}
-	bool  GetRecoveryP()		{ return data[0] & 0x20;	}
-	bool  GetRecoveryX()		{ return data[0] & 0x10;	}
-	BYTE  GetRecoveryCC()		{ return data[0] & 0x0F;	}
-	bool  GetRecoveryM()		{ return data[1] & 0x80;	}
-	BYTE  GetRecoveryType()		{ return data[1] & 0x7F; 	}
-	WORD  GetBaseSeqNum()		{ return get2(data,2);		}
-	DWORD GetRecoveryTimestamp()	{ return get4(data,4);		}
-	WORD  GetRecoveryLength()	{ return get2(data,8);		}
-	DWORD GetBaseExtSeq()		{ return ((DWORD)cycles) <<16 | GetBaseSeqNum(); }
-	DWORD GetBaseSeqCylcles()	{ return cycles;		}
-	void  SetSeqCycles(WORD cycles)	{ this->cycles = cycles;}
+	//Must be a power of 2 and hold the max number of protected packets
+	static constexpr DWORD WindowSize = 128;
+	static constexpr DWORD MaxPending = 32;
+public:
+	FECDecoder(fec::Scheme scheme, DWORD ssrc);
+	~FECDecoder() = default;
 
-	/*
-	 *	The FEC level header is 4 or 8 octets (depending on the L bit in the
-		FEC header). The formats of the headers are shown in Figure 4.
-		The FEC level headers consist of a protection length field and a mask
-		field. The protection length field is 16 bits long. The mask field
-		is 16 bits long (when the L bit is not set) or 48 bits long (when the
-		L bit is set).
+	// Adds a serialized media rtp packet of the protected ssrc
+	void AddMediaPacket(const BYTE* data, DWORD size);
+	// Adds the payload of a fec packet, returns false if it is not valid
+	bool AddFECPacket(const BYTE* data, DWORD size);
+	// Appends the serialized rtp packets recovered, returns the number of them
+	DWORD Recover(std::vector<Packet>& recovered);
+	void Reset();
 
-		0                   1                   2                   3
-		0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
-		+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-		| Protection Length             |              mask             |
-		+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-		| mask cont. (present only when L = 1)                          |
-		+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-	 */
-	BYTE*	GetLevel0Data()		{ return GetLongMask() ? data+18: data+14;	}
-	DWORD	GetLevel0Size()		{ return get2(data,10);				}
-	QWORD	GetLevel0Mask()
+	fec::Scheme GetScheme() const		{ return scheme;	}
+	DWORD GetSSRC() const			{ return ssrc;		}
+	const fec::Stats& GetStats() const	{ return stats;		}
+private:
+	struct Slot
 	{
-		//Get first part of the mask and shift it to the left
-		QWORD mask = ((QWORD)get2(data,12)) << 48;
-		//If it is long mask
-		if (GetLongMask())
-			//Append the rest
-			mask |= ((QWORD)get4(data,14)) << 16;
-		//REturn it
-		return mask;
-	}
-	bool	IsProtectedAtLevel0(int seq)
+		DWORD extSeq	= 0;
+		WORD  size	= 0;
+		bool  valid	= false;
+		//Fixed rtp header
+		BYTE  header[fec::RTPHeaderSize] = {};
+	};
+
+	struct Pending
 	{
-		//Check if can be check by mask
-		if (seq<GetBaseSeqNum() || seq>GetBaseSeqNum()+48)
-			//Not possible
-			return false;
-		//Check bit for the seq
-		BYTE diff = seq-GetBaseSeqNum();
-		//GEt mask
-		QWORD mask = GetLevel0Mask();
-		//Check if mask has the "diff" bit on
-		return ( mask >> (64-diff-1)) & 1;
-	}
-	
-private:
-	BYTE data[MTU+SRTP_MAX_TRAILER_LEN] ALIGNEDTO32;
-	DWORD size;
-	WORD  cycles;
-};
-class FECDecoder
-{
-public:
-	FECDecoder();
-	~FECDecoder();
-	bool AddPacket(RTPPacket* packet);
-	RTPPacket* Recover();
-private:
-	typedef std::map<DWORD,RTPPacket*> RTPOrderedPackets;
-	typedef std::multimap<DWORD,FECData*> FECOrderedData;
+		fec::Header header;
+		DWORD baseExtSeq	= 0;
+		bool  valid		= false;
+	};
+
+	DWORD Extend(WORD seq) const;
+	DWORD Unwrap(WORD seq);
+	bool IsInWindow(DWORD extSeq) const	{ return extSeq<=highest && highest-extSeq<WindowSize;	}
+	Slot* GetSlot(DWORD extSeq);
+	BYTE* GetPayload(DWORD index)		{ return storage.get() + index*fec::BufferSize;		}
+	BYTE* GetPendingPayload(DWORD index)	{ return GetPayload(WindowSize+index);			}
+	bool Allocate();
+	void Store(DWORD extSeq, const BYTE* data, DWORD size);
+	bool Recover(Pending& pending, DWORD extSeq, std::vector<Packet>& recovered);
 private:
-	RTPOrderedPackets	medias;
-	FECOrderedData		codes;
+	fec::Scheme scheme;
+	DWORD ssrc;
+	fec::Stats stats;
+
+	Slot  slots[WindowSize];
+	Pending pending[MaxPending];
+	DWORD nextPending	= 0;
+	DWORD numPending	= 0;
+
+	bool  started		= false;
+	DWORD highest		= 0;
+
+	//Media payloads followed by fec payloads
+	std::unique_ptr<BYTE,void(*)(void*)> storage;
 };
 
 #endif	/* FECDECODER_H */
-
@@ -0,0 +1,62 @@
+#ifndef FECENCODER_H
+#define FECENCODER_H
+
+#include <memory>
+#include "config.h"
+#include "fec.h"
+
+/**
+ * Generates ULPFEC or FlexFEC packets protecting groups of consecutive media
+ * packets of a single ssrc.
+ *
+ * Packets are XORed on a 32 byte aligned accumulator as they are added, so
+ * media is not copied nor kept. A fec packet is generated each options.group
+ * packets, or on the last packet of a frame so recovery does not wait for the
+ * next one, which is what matters for audio and low bitrate video.
+ */
+class FECEncoder
+{
+public:
+	struct Options
+	{
+		fec::Scheme scheme	= fec::Scheme::FlexFEC;
+		//Protected ssrc, only needed for flexfec
+		DWORD ssrc		= 0;
+		//Media packets protected by each fec packet
+		DWORD group		= 5;
+		//Generate fec on the packet with marker bit even if group is not complete
+		bool  flushOnMarker	= true;
+	};
+public:
+	explicit FECEncoder(const Options& options);
+	~FECEncoder() = default;
+
+	// Adds a serialized media rtp packet, returns true when a fec packet is ready
+	bool AddPacket(const BYTE* data, DWORD size);
+	// Fec packet payload, valid until next packet is added
+	const BYTE* GetFECData() const		{ return packet;		}
+	DWORD GetFECSize() const		{ return fecSize;	}
+	// Drops the current group
+	void Reset();
+
+	void SetGroup(DWORD group);
+	const Options& GetOptions() const	{ return options;	}
+	const fec::Stats& GetStats() const	{ return stats;		}
+private:
+	void Generate();
+private:
+	Options options;
+	fec::Stats stats;
+
+	//Current group
+	fec::Header header;
+	DWORD count		= 0;
+
+	//Accumulator for the XOR of the payloads, and the fec packet generated
+	std::unique_ptr<BYTE,void(*)(void*)> storage;
+	BYTE* accumulator	= nullptr;
+	BYTE* packet		= nullptr;
+	DWORD fecSize		= 0;
+};
+
+#endif /* FECENCODER_H */
@@ -2,15 +2,140 @@
 #define _LOG_H_
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include <atomic>
+#include <cinttypes>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "config.h"
 #include "tools.h"
 
 class Logger
 {
+public:
+	//Per thread ring size and max length of a single formatted message
+	static constexpr size_t RingSize	= 64*1024;
+	static constexpr size_t MaxMessageSize	= 4096;
+	//Default max messages per second for each callsite and thread
+	static constexpr uint32_t DefaultRateLimit = 100;
+private:
+	struct Record
+	{
+		uint32_t size;		//Total size in ring, including header
+		uint32_t len;		//Text length, 0 for padding
+		struct timeval tv;
+		const char* tag;
+	};
+
+	//Single producer (logging thread), single consumer (formatter thread) ring
+	struct Ring
+	{
+		pthread_t thread = pthread_self();
+		char name[16] = {};
+		char lastName[16] = {};
+		time_t nameUpdated = 0;
+		std::atomic<bool> closed = false;
+		std::atomic<size_t> head = 0;
+		std::atomic<size_t> tail = 0;
+		std::atomic<QWORD> dropped = 0;
+		std::atomic<QWORD> suppressed = 0;
+		QWORD reportedDropped = 0;
+		QWORD reportedSuppressed = 0;
+		alignas(8) BYTE data[RingSize];
+
+		bool Push(const struct timeval& tv, const char* tag, const char* text, uint32_t len)
+		{
+			//Record size, 8 bytes aligned
+			size_t size = (sizeof(Record) + len + 7) & ~7;
+			//Get write position and contiguous space till end of ring
+			size_t h = head.load(std::memory_order_relaxed);
+			size_t pos = h % RingSize;
+			size_t contiguous = RingSize - pos;
+			//If it doesn't fit at the end we skip it
+			size_t needed = contiguous < size ? contiguous + size : size;
+			//Check free space
+			if (RingSize - (h - tail.load(std::memory_order_acquire)) < needed)
+				//Overflow
+				return false;
+			//If we have to wrap
+			if (contiguous < size)
+			{
+				//Write padding if header fits, consumer skips smaller gaps by itself
+				if (contiguous >= sizeof(Record))
+					*(Record*)(data + pos) = Record{(uint32_t)contiguous, 0, {}, nullptr};
+				//Wrap
+				h += contiguous;
+				pos = 0;
+			}
+			//Write record
+			*(Record*)(data + pos) = Record{(uint32_t)size, len, tv, tag};
+			memcpy(data + pos + sizeof(Record), text, len);
+			//Publish
+			head.store(h + size, std::memory_order_release);
+			return true;
+		}
+
+		template<typename Func>
+		bool Drain(Func&& func)
+		{
+			size_t t = tail.load(std::memory_order_relaxed);
+			size_t h = head.load(std::memory_order_acquire);
+			//Check if empty
+			if (t == h)
+				return false;
+			while (t < h)
+			{
+				size_t pos = t % RingSize;
+				size_t contiguous = RingSize - pos;
+				//Gap too small for a header
+				if (contiguous < sizeof(Record))
+				{
+					t += contiguous;
+					continue;
+				}
+				//Get record
+				const Record* record = (const Record*)(data + pos);
+				//If it is not padding
+				if (record->tag)
+					func(*record, (const char*)(data + pos + sizeof(Record)));
+				//Next
+				t += record->size;
+			}
+			//Release space
+			tail.store(t, std::memory_order_release);
+			return true;
+		}
+	};
+
+	//Marks the thread ring as closed on thread exit, so formatter can remove it once drained
+	struct RingHolder
+	{
+		std::shared_ptr<Ring> ring;
+		~RingHolder()
+		{
+			if (!ring) return;
+#if defined(__linux__)
+			//Store name before finishing, as it can't be retrieved afterwards
+			pthread_getname_np(pthread_self(), ring->lastName, sizeof(ring->lastName));
+#endif
+			ring->closed.store(true, std::memory_order_release);
+		}
+	};
+
+	struct RateLimit
+	{
+		const char* msg = nullptr;
+		time_t second = 0;
+		uint32_t count = 0;
+	};
 public:
         static Logger& getInstance()
         {
@@ -20,80 +145,273 @@ public:
 	
 	static bool IsUltraDebugEnabled()
 	{
-		return getInstance().ultradebug;
+		return __builtin_expect(ultradebug.load(std::memory_order_relaxed), false);
 	}
 	
 	static bool IsDebugEnabled()
 	{
-		return getInstance().debug;
+		return __builtin_expect(debug.load(std::memory_order_relaxed), false);
 	}
 	
 	static bool IsLogEnabled()
 	{
-		return getInstance().log;
+		return __builtin_expect(log.load(std::memory_order_relaxed), true);
 	}
 
 	static bool EnableDebug(bool debug)
 	{
-		return getInstance().debug = debug;
+		Logger::debug.store(debug, std::memory_order_relaxed);
+		return debug;
 	}
 	
 	static bool EnableUltraDebug(bool ultradebug)
 	{
 		if (ultradebug) EnableDebug(ultradebug);
-		return getInstance().ultradebug = ultradebug;
+		Logger::ultradebug.store(ultradebug, std::memory_order_relaxed);
+		return ultradebug;
 	}
 	
 	static bool EnableLog(bool log)
 	{
-		return getInstance().log = log;
+		Logger::log.store(log, std::memory_order_relaxed);
+		return log;
 	}
 	
-	inline int Log(const char *msg, ...)
+	//Write synchronously from the calling thread instead of using the formatter thread.
+	//When async, messages still buffered are lost if the process crashes, only errors are written straight away
+	static bool EnableAsync(bool async)
 	{
-		return 1;
+		if (!async) Flush();
+		return Logger::async = async;
 	}
-
-	inline int Error(const char *msg, ...)
+	
+	//Max messages per second for each callsite and thread, 0 for unlimited. Errors are never limited
+	static void SetRateLimit(uint32_t rateLimit)
 	{
-		return 0;
+		Logger::rateLimit = rateLimit;
+	}
+	
+	static QWORD GetDroppedMessages()	{ return getInstance().dropped;		}
+	static QWORD GetSuppressedMessages()	{ return getInstance().suppressed;	}
+	
+	//Wait until all pending messages are written
+	static void Flush()
+	{
+		if (!async) return;
+		Logger& logger = getInstance();
+		std::lock_guard<std::mutex> lock(logger.mutex);
+		logger.Drain();
+	}
+	
+	static void Write(const char* tag, const char* prefix, const char* msg, va_list ap, bool limited = true)
+	{
+		struct timeval tv;
+		gettimeofday(&tv,NULL);
+		
+		//If not async
+		if (!async)
+			//Write directly
+			return WriteSync(tv, tag, prefix, msg, ap);
+		
+		//Get thread ring
+		Ring* ring = GetRing();
+		
+		//Check rate limit for this callsite
+		uint32_t rateLimit = Logger::rateLimit;
+		if (limited && rateLimit)
+		{
+			thread_local RateLimit limits[64];
+			//Get entry for callsite
+			auto& limit = limits[((uintptr_t)msg >> 3) % 64];
+			//Reset on new callsite or new second
+			if (limit.msg != msg || limit.second != tv.tv_sec)
+				limit = RateLimit{msg, tv.tv_sec, 0};
+			//Check limit
+			if (++limit.count > rateLimit)
+			{
+				//Suppressed
+				ring->suppressed.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+		}
+		
+		//Format on a scratch buffer
+		thread_local char text[MaxMessageSize];
+		int len = 0;
+		if (prefix)
+			len = snprintf(text, sizeof(text), "%s", prefix);
+		if (len < (int)sizeof(text))
+		{
+			int n = vsnprintf(text + len, sizeof(text) - len, msg, ap);
+			if (n > 0) len += n;
+		}
+		//Truncate
+		if (len >= (int)sizeof(text))
+			len = sizeof(text) - 1;
+		
+		//Enqueue
+		if (!ring->Push(tv, tag, text, len))
+			//Overflow
+			ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		
+		//Wake up formatter if it is sleeping
+		Logger& logger = getInstance();
+		if (logger.sleeping.load(std::memory_order_relaxed) && logger.sleeping.exchange(false))
+			logger.cond.notify_one();
 	}
-protected:
-	bool log;
-	bool debug;
-	bool ultradebug;
 private:
         Logger()
 	{
-		log = true;
-		debug = false;
-		ultradebug = false;
+	}
+	
+	~Logger()
+	{
+		//Log synchronously from now on
+		async = false;
+		//Stop formatter
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+		}
+		cond.notify_one();
+		if (thread.joinable())
+			thread.join();
+		//Write pending
+		Drain();
 	}
         // Dont forget to declare these two. You want to make sure they
         // are unaccessable otherwise you may accidently get copies of
         // your singelton appearing.
         Logger(Logger const&);			// Don't Implement
         void operator=(Logger const&);		// Don't implement
+	
+	static void WriteSync(const struct timeval& tv, const char* tag, const char* prefix, const char* msg, va_list ap)
+	{
+#if defined(__linux__)
+		char name[16];
+		pthread_getname_np(pthread_self(), name,sizeof(name));
+		printf("[%-16s][%.10ld.%.3ld][%s]%s", name, (long)tv.tv_sec, (long)tv.tv_usec / 1000, tag, prefix ? prefix : "");
+#else
+		printf("[0x%lx][%.10ld.%.3ld][%s]%s", (long)pthread_self(), (long)tv.tv_sec, (long)tv.tv_usec / 1000, tag, prefix ? prefix : "");
+#endif
+		vprintf(msg, ap);
+		fflush(stdout);
+	}
+	
+	static Ring* GetRing()
+	{
+		thread_local RingHolder holder;
+		//Register on first use
+		if (!holder.ring)
+			holder.ring = getInstance().Register();
+		return holder.ring.get();
+	}
+	
+	std::shared_ptr<Ring> Register()
+	{
+		auto ring = std::make_shared<Ring>();
+		std::lock_guard<std::mutex> lock(mutex);
+		//Add it
+		rings.push_back(ring);
+		//Start formatter thread on first one
+		if (!thread.joinable())
+			thread = std::thread([this](){ Run(); });
+		return ring;
+	}
+	
+	void Run()
+	{
+#if defined(__linux__)
+		pthread_setname_np(pthread_self(), "logger");
+#endif
+		std::unique_lock<std::mutex> lock(mutex);
+		while (running)
+		{
+			//Write all pending messages
+			if (Drain())
+				continue;
+			//Nothing to do, sleep until a message is logged
+			sleeping = true;
+			cond.wait_for(lock, std::chrono::milliseconds(100));
+			sleeping = false;
+		}
+	}
+	
+	//Must be called with mutex locked
+	bool Drain()
+	{
+		bool written = false;
+		for (auto it = rings.begin(); it != rings.end();)
+		{
+			Ring* ring = it->get();
+			//Check if thread has finished before draining so we don't lose last messages
+			bool closed = ring->closed.load(std::memory_order_acquire);
+			//Use last name of finished threads
+			if (closed && ring->lastName[0])
+				memcpy(ring->name, ring->lastName, sizeof(ring->name));
+			//Refresh thread name once per second, as threads are usually renamed after started
+			time_t now = time(nullptr);
+			if (!closed && ring->nameUpdated != now)
+			{
+#if defined(__linux__)
+				pthread_getname_np(ring->thread, ring->name, sizeof(ring->name));
+#else
+				snprintf(ring->name, sizeof(ring->name), "0x%lx", (long)ring->thread);
+#endif
+				ring->nameUpdated = now;
+			}
+			//Write all messages
+			written |= ring->Drain([&](const Record& record, const char* text) {
+				fprintf(stdout, "[%-16s][%.10ld.%.3ld][%s]%.*s", ring->name, (long)record.tv.tv_sec, (long)record.tv.tv_usec / 1000, record.tag, (int)record.len, text);
+			});
+			//Report overflows and rate limited messages
+			QWORD ringDropped = ring->dropped.load(std::memory_order_relaxed);
+			QWORD ringSuppressed = ring->suppressed.load(std::memory_order_relaxed);
+			if (ringDropped != ring->reportedDropped || ringSuppressed != ring->reportedSuppressed)
+			{
+				fprintf(stdout, "[%-16s][%.10ld.%.3ld][WRN]-Logger | Messages lost [dropped:%" PRIu64 ",suppressed:%" PRIu64 "]\n", ring->name, (long)now, 0L, ringDropped - ring->reportedDropped, ringSuppressed - ring->reportedSuppressed);
+				dropped += ringDropped - ring->reportedDropped;
+				suppressed += ringSuppressed - ring->reportedSuppressed;
+				ring->reportedDropped = ringDropped;
+				ring->reportedSuppressed = ringSuppressed;
+				written = true;
+			}
+			//Remove rings of finished threads
+			if (closed)
+				it = rings.erase(it);
+			else
+				++it;
+		}
+		//Flush once per batch
+		if (written)
+			fflush(stdout);
+		return written;
+	}
+protected:
+	static inline std::atomic<bool> log		= true;
+	static inline std::atomic<bool> debug		= false;
+	static inline std::atomic<bool> ultradebug	= false;
+	static inline std::atomic<bool> async		= true;
+	static inline std::atomic<uint32_t> rateLimit	= DefaultRateLimit;
+private:
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::thread thread;
+	std::vector<std::shared_ptr<Ring>> rings;
+	std::atomic<bool> sleeping = false;
+	std::atomic<QWORD> dropped = 0;
+	std::atomic<QWORD> suppressed = 0;
+	bool running = true;
 };
 
 inline int Log(const char *msg, ...)
 {
 	if (Logger::IsLogEnabled())
 	{
-		struct timeval tv;
 		va_list ap;
-		gettimeofday(&tv,NULL);
-#if defined(__linux__)
-		char name[16];
-		pthread_getname_np(pthread_self(), name,sizeof(name));
-		printf("[%-16s][%.10ld.%.3ld][LOG]", name, (long)tv.tv_sec, (long)tv.tv_usec / 1000);
-#else
-		printf("[0x%lx][%.10ld.%.3ld][LOG]", (long)pthread_self(), (long)tv.tv_sec, (long)tv.tv_usec / 1000);
-#endif
 		va_start(ap, msg);
-		vprintf(msg, ap);
+		Logger::Write("LOG", nullptr, msg, ap);
 		va_end(ap);
-		fflush(stdout);
 	}
 	return 1;
 }
@@ -102,20 +420,10 @@ inline int Log2(const char* prefix,const char *msg, ...)
 {
 	if (Logger::IsLogEnabled())
 	{
-		struct timeval tv;
 		va_list ap;
-		gettimeofday(&tv,NULL);
-#if defined(__linux__)
-		char name[16];
-		pthread_getname_np(pthread_self(), name,sizeof(name));
-		printf("[%-16s][%.10ld.%.3ld][LOG]%s", name, (long)tv.tv_sec, (long)tv.tv_usec / 1000, prefix);
-#else
-		printf("[0x%lx][%.10ld.%.3ld][LOG]%s", (long)pthread_self(), (long)tv.tv_sec, (long)tv.tv_usec / 1000, prefix);
-#endif
 		va_start(ap, msg);
-		vprintf(msg, ap);
+		Logger::Write("LOG", prefix, msg, ap);
 		va_end(ap);
-		fflush(stdout);
 	}
 	return 1;
 }
@@ -124,20 +432,10 @@ inline int UltraDebug(const char *msg, ...)
 {
 	if (Logger::IsUltraDebugEnabled())
 	{
-		struct timeval tv;
 		va_list ap;
-		gettimeofday(&tv,NULL);
-#if defined(__linux__)
-		char name[16];
-		pthread_getname_np(pthread_self(), name,sizeof(name));
-		printf("[%-16s][%.10ld.%.3ld][DBG]", name, (long)tv.tv_sec, (long)tv.tv_usec / 1000);
-#else
-		printf("[0x%lx][%.10ld.%.3ld][DBG]", (long)pthread_self(), (long)tv.tv_sec, (long)tv.tv_usec / 1000);
-#endif
 		va_start(ap, msg);
-		vprintf(msg, ap);
+		Logger::Write("DBG", nullptr, msg, ap);
 		va_end(ap);
-		fflush(stdout);
 	}
 	return 1;
 }
@@ -146,20 +444,23 @@ inline int Debug(const char *msg, ...)
 {
 	if (Logger::IsDebugEnabled())
 	{
-		struct timeval tv;
 		va_list ap;
-		gettimeofday(&tv,NULL);
-#if defined(__linux__)
-		char name[16];
-		pthread_getname_np(pthread_self(), name,sizeof(name));
-		printf("[%-16s][%.10ld.%.3ld][DBG]", name, (long)tv.tv_sec, (long)tv.tv_usec / 1000);
-#else
-		printf("[0x%lx][%.10ld.%.3ld][DBG]", (long)pthread_self(), (long)tv.tv_sec, (long)tv.tv_usec / 1000);
-#endif
 		va_start(ap, msg);
-		vprintf(msg, ap);
+		Logger::Write("DBG", nullptr, msg, ap);
+		va_end(ap);
+	}
+	return 1;
+}
+
+//Not rate limited, used for multi line dumps
+inline int DumpLine(const char *msg, ...)
+{
+	if (Logger::IsDebugEnabled())
+	{
+		va_list ap;
+		va_start(ap, msg);
+		Logger::Write("DBG", nullptr, msg, ap, false);
 		va_end(ap);
-		fflush(stdout);
 	}
 	return 1;
 }
@@ -168,20 +469,10 @@ inline int Warning(const char *msg, ...)
 {
 	if (Logger::IsDebugEnabled())
 	{
-		struct timeval tv;
 		va_list ap;
-		gettimeofday(&tv,NULL);
-#if defined(__linux__)
-		char name[16];
-		pthread_getname_np(pthread_self(), name,sizeof(name));
-		printf("[%-16s][%.10ld.%.3ld][WRN]", name, (long)tv.tv_sec, (long)tv.tv_usec / 1000);
-#else
-		printf("[0x%lx][%.10ld.%.3ld][WRN]", (long)pthread_self(), (long)tv.tv_sec, (long)tv.tv_usec / 1000);
-#endif
 		va_start(ap, msg);
-		vprintf(msg, ap);
+		Logger::Write("WRN", nullptr, msg, ap);
 		va_end(ap);
-		fflush(stdout);
 	}
 	return 0;
 }
@@ -189,20 +480,13 @@ inline int Warning(const char *msg, ...)
 
 inline int Error(const char *msg, ...)
 {
-	struct timeval tv;
 	va_list ap;
-	gettimeofday(&tv,NULL);
-#if defined(__linux__)
-	char name[16];
-	pthread_getname_np(pthread_self(), name,sizeof(name));
-	printf("[%-16s][%.10ld.%.3ld][ERR]", name, (long)tv.tv_sec, (long)tv.tv_usec / 1000);
-#else
-	printf("[0x%lx][%.10ld.%.3ld][ERR]", (long)pthread_self(), (long)tv.tv_sec, (long)tv.tv_usec / 1000);
-#endif
-	
 	va_start(ap, msg);
-	vprintf(msg, ap);
+	//Errors are not rate limited
+	Logger::Write("ERR", nullptr, msg, ap, false);
 	va_end(ap);
+	//Write them straight away, so they are not lost if we are about to crash
+	Logger::Flush();
 	return 0;
 }
 
@@ -255,58 +539,58 @@ inline void Dump(const BYTE *data,DWORD size)
 	for(DWORD i=0;i<(size/8);i++)
 	{
 		DWORD n = 8*i;
-		Debug("[%.4x] [0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x   %c%c%c%c%c%c%c%c]\n",n,data[n],data[n+1],data[n+2],data[n+3],data[n+4],data[n+5],data[n+6],data[n+7],PC(data[n]),PC(data[n+1]),PC(data[n+2]),PC(data[n+3]),PC(data[n+4]),PC(data[n+5]),PC(data[n+6]),PC(data[n+7]));
+		DumpLine("[%.4x] [0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x   %c%c%c%c%c%c%c%c]\n",n,data[n],data[n+1],data[n+2],data[n+3],data[n+4],data[n+5],data[n+6],data[n+7],PC(data[n]),PC(data[n+1]),PC(data[n+2]),PC(data[n+3]),PC(data[n+4]),PC(data[n+5]),PC(data[n+6]),PC(data[n+7]));
 	}
 	switch(size%8)
 	{
 		case 1:
-			Debug("[%.4x] [0x%.2x                                                    %c       ]\n",size-1,data[size-1],PC(data[size-1]));
+			DumpLine("[%.4x] [0x%.2x                                                    %c       ]\n",size-1,data[size-1],PC(data[size-1]));
 			break;
 		case 2:
-			Debug("[%.4x] [0x%.2x   0x%.2x                                             %c%c      ]\n",size-2,data[size-2],data[size-1],PC(data[size-2]),PC(data[size-1]));
+			DumpLine("[%.4x] [0x%.2x   0x%.2x                                             %c%c      ]\n",size-2,data[size-2],data[size-1],PC(data[size-2]),PC(data[size-1]));
 			break;
 		case 3:
-			Debug("[%.4x] [0x%.2x   0x%.2x   0x%.2x                                      %c%c%c     ]\n",size-3,data[size-3],data[size-2],data[size-1],PC(data[size-3]),PC(data[size-2]),PC(data[size-1]));
+			DumpLine("[%.4x] [0x%.2x   0x%.2x   0x%.2x                                      %c%c%c     ]\n",size-3,data[size-3],data[size-2],data[size-1],PC(data[size-3]),PC(data[size-2]),PC(data[size-1]));
 			break;
 		case 4:
-			Debug("[%.4x] [0x%.2x   0x%.2x   0x%.2x   0x%.2x                               %c%c%c%c    ]\n",size-4,data[size-4],data[size-3],data[size-2],data[size-1],PC(data[size-4]),PC(data[size-3]),PC(data[size-2]),PC(data[size-1]));
+			DumpLine("[%.4x] [0x%.2x   0x%.2x   0x%.2x   0x%.2x                               %c%c%c%c    ]\n",size-4,data[size-4],data[size-3],data[size-2],data[size-1],PC(data[size-4]),PC(data[size-3]),PC(data[size-2]),PC(data[size-1]));
 			break;
 		case 5:
-			Debug("[%.4x] [0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x                        %c%c%c%c%c   ]\n",size-5,data[size-5],data[size-4],data[size-3],data[size-2],data[size-1],PC(data[size-5]),PC(data[size-4]),PC(data[size-3]),PC(data[size-2]),PC(data[size-1]));
+			DumpLine("[%.4x] [0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x                        %c%c%c%c%c   ]\n",size-5,data[size-5],data[size-4],data[size-3],data[size-2],data[size-1],PC(data[size-5]),PC(data[size-4]),PC(data[size-3]),PC(data[size-2]),PC(data[size-1]));
 			break;
 		case 6:
-			Debug("[%.4x] [0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x                 %c%c%c%c%c%c  ]\n",size-6,data[size-6],data[size-5],data[size-4],data[size-3],data[size-2],data[size-1],PC(data[size-6]),PC(data[size-5]),PC(data[size-4]),PC(data[size-3]),PC(data[size-2]),PC(data[size-1]));
+			DumpLine("[%.4x] [0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x                 %c%c%c%c%c%c  ]\n",size-6,data[size-6],data[size-5],data[size-4],data[size-3],data[size-2],data[size-1],PC(data[size-6]),PC(data[size-5]),PC(data[size-4]),PC(data[size-3]),PC(data[size-2]),PC(data[size-1]));
 			break;
 		case 7:
-			Debug("[%.4x] [0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x          %c%c%c%c%c%c%c ]\n",size-7,data[size-7],data[size-6],data[size-5],data[size-4],data[size-3],data[size-2],data[size-1],PC(data[size-7]),PC(data[size-6]),PC(data[size-5]),PC(data[size-4]),PC(data[size-3]),PC(data[size-2]),PC(data[size-1]));
+			DumpLine("[%.4x] [0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x   0x%.2x          %c%c%c%c%c%c%c ]\n",size-7,data[size-7],data[size-6],data[size-5],data[size-4],data[size-3],data[size-2],data[size-1],PC(data[size-7]),PC(data[size-6]),PC(data[size-5]),PC(data[size-4]),PC(data[size-3]),PC(data[size-2]),PC(data[size-1]));
 			break;
 	}
 }
 
 inline void DumpAsC(const BYTE *data,DWORD size)
 {
-	Debug("data[%d] = {\n",size);
+	DumpLine("data[%d] = {\n",size);
 	for(DWORD i=0;i<(size/4)-1;i++)
 	{
 		DWORD n = 4*i;
-		Debug("\t0x%.2x, 0x%.2x, 0x%.2x, 0x%.2x,\n",data[n],data[n+1],data[n+2],data[n+3]);
+		DumpLine("\t0x%.2x, 0x%.2x, 0x%.2x, 0x%.2x,\n",data[n],data[n+1],data[n+2],data[n+3]);
 	}
 	switch(size%4)
 	{
 		case 0:
-			Debug("\t0x%.2x, 0x%.2x, 0x%.2x, 0x%.2x\n",data[size-4],data[size-3],data[size-2],data[size-1]);
+			DumpLine("\t0x%.2x, 0x%.2x, 0x%.2x, 0x%.2x\n",data[size-4],data[size-3],data[size-2],data[size-1]);
 			break;
 		case 1:
-			Debug("\t0x%.2x\n",data[size-1]);
+			DumpLine("\t0x%.2x\n",data[size-1]);
 			break;
 		case 2:
-			Debug("\t0x%.2x, 0x%.2x\n",data[size-2],data[size-1]);
+			DumpLine("\t0x%.2x, 0x%.2x\n",data[size-2],data[size-1]);
 			break;
 		case 3:
-			Debug("\t0x%.2x, 0x%.2x, 0x%.2x\n",data[size-3],data[size-2],data[size-1]);
+			DumpLine("\t0x%.2x, 0x%.2x, 0x%.2x\n",data[size-3],data[size-2],data[size-1]);
 			break;
 	}
-	Debug("};\n");
+	DumpLine("};\n");
 }
 
 inline void Dump4(const BYTE *data,DWORD size)
@@ -314,18 +598,18 @@ inline void Dump4(const BYTE *data,DWORD size)
 	for(DWORD i=0;i<(size/4);i++)
 	{
 		DWORD n = 4*i;
-		Debug("[%.4x] [0x%.2x   0x%.2x   0x%.2x   0x%.2x   %c%c%c%c]\n",n,data[n],data[n+1],data[n+2],data[n+3],PC(data[n]),PC(data[n+1]),PC(data[n+2]),PC(data[n+3]));
+		DumpLine("[%.4x] [0x%.2x   0x%.2x   0x%.2x   0x%.2x   %c%c%c%c]\n",n,data[n],data[n+1],data[n+2],data[n+3],PC(data[n]),PC(data[n+1]),PC(data[n+2]),PC(data[n+3]));
 	}
 	switch(size%4)
 	{
 		case 1:
-			Debug("[%.4x] [0x%.2x                      %c]\n",size-1,data[size-1],PC(data[size-1]));
+			DumpLine("[%.4x] [0x%.2x                      %c]\n",size-1,data[size-1],PC(data[size-1]));
 			break;
 		case 2:
-			Debug("[%.4x] [0x%.2x   0x%.2x                %c%c]\n",size-2,data[size-2],data[size-1],PC(data[size-2]),PC(data[size-1]));
+			DumpLine("[%.4x] [0x%.2x   0x%.2x                %c%c]\n",size-2,data[size-2],data[size-1],PC(data[size-2]),PC(data[size-1]));
 			break;
 		case 3:
-			Debug("[%.4x] [0x%.2x   0x%.2x   0x%.2x          %c%c%c]\n",size-3,data[size-3],data[size-2],data[size-1],PC(data[size-3]),PC(data[size-2]),PC(data[size-1]));
+			DumpLine("[%.4x] [0x%.2x   0x%.2x   0x%.2x          %c%c%c]\n",size-3,data[size-3],data[size-2],data[size-1],PC(data[size-3]),PC(data[size-2]),PC(data[size-1]));
 			break;
 	}
 }
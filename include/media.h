@@ -6,8 +6,11 @@
 #include <vector>
 #include <string.h>
 #include <memory>
+#include <array>
+#include <mutex>
 #include "Buffer.h"
 #include "BufferReader.h"
+#include "rtp/RTPPayload.h"
 
 class MediaFrame
 {
@@ -103,6 +106,48 @@ public:
 	};
 
 	typedef std::vector<RtpPacketization> RtpPacketizationInfo;
+
+	class Fragment
+	{
+	public:
+		static constexpr DWORD MaxInlineSize = 8;
+	public:
+		//Reference data owned by a shared RTP payload or buffer without copying it
+		Fragment(const std::shared_ptr<void>& owner,const BYTE* data,DWORD size) :
+			owner(owner),
+			data(data),
+			size(size)
+		{
+		}
+		//Small data (NAL size prefixes, OBU headers..) stored inline
+		Fragment(const BYTE* data,DWORD size) :
+			size(size)
+		{
+			//Copy data
+			memcpy(inlined.data(),data,size);
+		}
+
+		bool  IsInline()	const { return !owner;					}
+		const BYTE* GetData()	const { return owner ? data : inlined.data();		}
+		BYTE* GetInlineData()	      { return inlined.data();				}
+		DWORD GetSize()		const { return size;					}
+		DWORD GetInlineLeft()	const { return owner ? 0 : MaxInlineSize-size;		}
+
+		void AppendInline(const BYTE* data,DWORD size)
+		{
+			//Copy after current inline data
+			memcpy(inlined.data()+this->size,data,size);
+			//Increase size
+			this->size += size;
+		}
+	private:
+		std::shared_ptr<void> owner;
+		const BYTE* data	= nullptr;
+		DWORD size		= 0;
+		std::array<BYTE,MaxInlineSize> inlined;
+	};
+
+	typedef std::vector<Fragment> Fragments;
 public:
 	enum Type {Audio=0,Video=1,Text=2,Unknown=-1};
 
@@ -167,6 +212,15 @@ public:
 		ClearRTPPacketizationInfo();
 	}
 
+	void ClearFragments()
+	{
+		//Release referenced payloads
+		fragments.clear();
+		fragmentsLength = 0;
+		//Drop contiguous copy
+		InvalidateFlattened();
+	}
+
 	void	ClearRTPPacketizationInfo()
 	{
 		//Clear
@@ -208,21 +262,68 @@ public:
 	DWORD GetDuration() const		{ return duration;		}
 	void SetDuration(DWORD duration)	{ this->duration = duration;	}
 
-	DWORD GetLength() const			{ return buffer->GetSize();			}
-	DWORD GetMaxMediaLength() const		{ return buffer->GetCapacity();			}
+	DWORD GetLength() const			{ return buffer->GetSize()+fragmentsLength;	}
+	DWORD GetMaxMediaLength() const		{ return GetContiguousBuffer()->GetCapacity();	}
 
 #ifndef SWIGGO
 	// the SWIG compiler can not handle correctly the 2 GetData signatures for the GoLang target
-	const BYTE* GetData() const		{ return buffer->GetData();			}
+	const BYTE* GetData() const		{ return GetContiguousBuffer()->GetData();	}
 #endif
 	BYTE* GetData()				{ AdquireBuffer(); return buffer->GetData();	}
-	const Buffer::shared& GetBuffer() const	{ return buffer; }
+	const Buffer::shared& GetBuffer() const	{ return GetContiguousBuffer();			}
 	void SetLength(DWORD length)		{ AdquireBuffer(); buffer->SetSize(length);	}
 	
 	void DisableSharedBuffer()		{ disableSharedBuffer = true;			}
 	
+	bool IsFragmented() const		{ return !fragments.empty();			}
+	const Fragments& GetFragments() const	{ return fragments;				}
+	
+	// Const readers of a fragmented frame get a contiguous copy done once and
+	// shared by all of them, the frame itself is not modified so it can be
+	// read from several threads at the same time
+	const Buffer::shared& GetContiguousBuffer() const
+	{
+		//If all data is already contiguous
+		if (fragments.empty())
+			//Use it
+			return buffer;
+		//Lock, readers may race for it
+		std::lock_guard<std::mutex> lock(flattened.mutex);
+		//If not done yet
+		if (!flattened.buffer)
+		{
+			//Copy it
+			flattened.buffer = CopyFragments();
+		}
+		return flattened.buffer;
+	}
+
+	void Flatten()
+	{
+		//If all data is already contiguous
+		if (fragments.empty())
+			//Do nothing
+			return;
+		//If readers already got a contiguous copy
+		if (flattened.buffer)
+		{
+			//Reuse it, but do not own it as they may still be reading it
+			buffer = flattened.buffer;
+			ownedBuffer = false;
+		} else {
+			//Copy it
+			buffer = CopyFragments();
+			//We own the payload
+			ownedBuffer = true;
+		}
+		//No more fragments
+		ClearFragments();
+	}
+	
 	void ResetData(DWORD size = 0) 
 	{
+		//Drop fragments
+		ClearFragments();
 		//Create new owned buffer
 		buffer = std::make_shared<Buffer>(size);
 		//Owned buffer
@@ -239,6 +340,8 @@ public:
 
 	void SetMedia(const BYTE* data,DWORD size)
 	{
+		//Drop fragments, as data is going to be overwritten
+		ClearFragments();
 		//Adquire buffer
 		AdquireBuffer();
 		//Allocate mem
@@ -248,7 +351,15 @@ public:
 	DWORD AppendMedia(const BYTE* data,DWORD size)
 	{
                 //Get current pos
-                DWORD pos = buffer->GetSize();
+                DWORD pos = GetLength();
+		//If we are already referencing fragments
+		if (!fragments.empty())
+		{
+			//Append after them
+			AppendFragment(data,size);
+			//Return previous pos
+			return pos;
+		}
 		//Adquire buffer
 		AdquireBuffer();
 		//Append data
@@ -257,30 +368,86 @@ public:
 		return pos;
 	}
 
-	DWORD AppendMedia(BufferReader& reader, DWORD size)
+	DWORD AppendMedia(const RTPPayload::shared& payload,const BYTE* data,DWORD size)
 	{
+		//If there is no payload to reference
+		if (!payload)
+			//Copy it
+			return AppendMedia(data,size);
 		//Get current pos
-		DWORD pos = buffer->GetSize();
-		//Adquire buffer
-		AdquireBuffer();
-		//Append data
-		buffer->AppendData(reader.GetData(size), size);
+		DWORD pos = GetLength();
+		//Reference payload data, it must be kept unmodified while the frame is alive
+		fragments.emplace_back(payload,data,size);
+		//Increase length
+		fragmentsLength += size;
+		//Drop contiguous copy
+		InvalidateFlattened();
 		//Return previous pos
 		return pos;
 	}
 
-	DWORD AppendMedia(const Buffer& append)
+	DWORD AppendMedia(const Buffer::shared& owner,const BYTE* data,DWORD size)
 	{
+		//If there is no buffer to reference
+		if (!owner)
+			//Copy it
+			return AppendMedia(data,size);
 		//Get current pos
-		DWORD pos = buffer->GetSize();
-		//Adquire buffer
-		AdquireBuffer();
-		//Append data
-		buffer->AppendData(append.GetData(), append.GetSize());
+		DWORD pos = GetLength();
+		//Reference buffer data, it must be kept unmodified while the frame is alive
+		fragments.emplace_back(owner,data,size);
+		//Increase length
+		fragmentsLength += size;
+		//Drop contiguous copy
+		InvalidateFlattened();
 		//Return previous pos
 		return pos;
 	}
 
+	DWORD AppendMedia(BufferReader& reader, DWORD size)
+	{
+		return AppendMedia(reader.GetData(size), size);
+	}
+
+	DWORD AppendMedia(const Buffer& append)
+	{
+		return AppendMedia(append.GetData(), append.GetSize());
+	}
+
+	void WriteMedia(DWORD pos,const BYTE* data,DWORD size)
+	{
+		//Get contiguous size
+		DWORD offset = buffer->GetSize();
+		//If it is on the contiguous part and we can write on it
+		if (pos+size<=offset && ownedBuffer)
+		{
+			//Overwrite
+			memcpy(buffer->GetData()+pos,data,size);
+			//Done
+			return;
+		}
+		//Check in which fragment it is
+		for (auto& fragment : fragments)
+		{
+			//If it is inside a fragment we own
+			if (fragment.IsInline() && pos>=offset && pos+size<=offset+fragment.GetSize())
+			{
+				//Overwrite
+				memcpy(fragment.GetInlineData()+pos-offset,data,size);
+				//Drop contiguous copy
+				InvalidateFlattened();
+				//Done
+				return;
+			}
+			//Next
+			offset += fragment.GetSize();
+		}
+		//Adquire buffer
+		AdquireBuffer();
+		//Overwrite
+		memcpy(buffer->GetData()+pos,data,size);
+	}
+
 	DWORD AppendMedia(BufferReader& reader)
 	{
 		return AppendMedia(reader, reader.GetLeft());
@@ -288,6 +455,8 @@ public:
 
 	void PrependMedia(const BYTE* data,DWORD size)
 	{
+		//Ensure data is contiguous
+		Flatten();
 		//Store old buffer
 		auto old = buffer;
 		//New one
@@ -355,8 +524,64 @@ public:
 	void  SetClockRate(DWORD clockRate)		{ this->clockRate = clockRate;			}
 
 protected:
+	void AppendFragment(const BYTE* data,DWORD size)
+	{
+		//Get last fragment
+		auto& last = fragments.back();
+		//If it fits in the last inline one
+		if (last.GetInlineLeft()>=size)
+			//Append it there
+			last.AppendInline(data,size);
+		//If it is small enough
+		else if (size<=Fragment::MaxInlineSize)
+			//Store it inline
+			fragments.emplace_back(data,size);
+		else {
+			//Copy into a new buffer
+			auto copy = std::make_shared<Buffer>(data,size);
+			//Reference it
+			fragments.emplace_back(copy,copy->GetData(),size);
+		}
+		//Increase length
+		fragmentsLength += size;
+		//Drop contiguous copy
+		InvalidateFlattened();
+	}
+	
+	void ShareFragments(const MediaFrame& other)
+	{
+		//Reference same data than the other frame
+		fragments = other.fragments;
+		fragmentsLength = other.fragmentsLength;
+		//Drop contiguous copy
+		InvalidateFlattened();
+	}
+
+	Buffer::shared CopyFragments() const
+	{
+		//Allocate the whole frame at once
+		auto flat = std::make_shared<Buffer>(GetLength());
+		//Copy contiguous data
+		flat->AppendData(buffer->GetData(),buffer->GetSize());
+		//Copy all fragments
+		for (const auto& fragment : fragments)
+			flat->AppendData(fragment.GetData(),fragment.GetSize());
+		return flat;
+	}
+
+	void InvalidateFlattened()
+	{
+		//Only if it was done
+		if (flattened.buffer)
+			flattened.buffer.reset();
+	}
+	
 	void AdquireBuffer()
 	{
+		//If we have fragments
+		if (!fragments.empty())
+			//Copy them into a contiguous buffer
+			Flatten();
 		//If already owning
 		if (ownedBuffer)
 			//Do nothing
@@ -378,7 +603,22 @@ protected:
 	
 	Buffer::shared	buffer;
 	bool ownedBuffer		= false;
+	Fragments fragments;
+	DWORD fragmentsLength		= 0;
 	bool disableSharedBuffer	= false;
+
+	//Contiguous copy of the fragments done for const readers
+	struct Flattened
+	{
+		Flattened() = default;
+		//Copies do not share it, nor the lock
+		Flattened(const Flattened&) {}
+		Flattened& operator=(const Flattened&) { return *this; }
+
+		std::mutex mutex;
+		Buffer::shared buffer;
+	};
+	mutable Flattened flattened;
 	
 	DWORD	duration		= 0;
 	DWORD	clockRate		= 1000;
@@ -10,8 +10,12 @@
 #include "recordercontrol.h"
 #include "Buffer.h"
 #include "EventLoop.h"
+#include "FragmentedMP4Writer.h"
+#include "TimeShiftBuffer.h"
 
 #include <deque>
+#include <memory>
+#include <mutex>
 #include <optional>
 
 class mp4track
@@ -78,13 +82,29 @@ public:
 	virtual void onMediaFrame(const MediaFrame &frame);
 	virtual void onMediaFrame(DWORD ssrc, const MediaFrame &frame);
 	
-	void SetTimeShiftDuration(DWORD duration) { timeShiftDuration = duration; }
+	void SetTimeShiftDuration(DWORD duration);
+	//Memory limits and spill to disk of the time shift buffer
+	void SetTimeShiftOptions(const TimeShiftBuffer::Options& options);
 	bool SetH264ParameterSets(const std::string& sprop);
+	//Write fragmented mp4 natively instead of using mp4v2, must be called before Create
+	void SetFragmented(const FragmentedMP4Writer::Options& options) { fragmentedOptions = options; }
 	
 private:
 	void processMediaFrame(DWORD ssrc, const MediaFrame &frame, QWORD time);
+	void processFragmentedFrame(DWORD ssrc, const MediaFrame &frame, QWORD time);
+	bool IsOpened() const { return mp4!=MP4_INVALID_FILE_HANDLE || (fragmented && fragmented->IsOpened()); }
 private:	
 	typedef std::map<DWORD,mp4track*>	Tracks;
+	
+	struct FragmentedTrack
+	{
+		DWORD id	= 0;
+		bool  created	= false;
+		//Frames are written when next one arrives to know their duration
+		std::unique_ptr<MediaFrame> prev;
+		QWORD dts	= 0;
+		DWORD duration	= 0;
+	};
 private:
 	EventLoop	loop;
 	Listener*	listener	= nullptr;
@@ -97,9 +117,15 @@ private:
 	bool		disableHints    = false;
 	QWORD		first		= (QWORD)-1;
 	
-	std::deque<std::pair<uint32_t,std::unique_ptr<MediaFrame>>> timeShiftBuffer;
+	//Frames are copied to the time shift buffer from the calling thread
+	std::mutex	timeShiftMutex;
+	TimeShiftBuffer timeShiftBuffer;
 	std::optional<Buffer>	h264SPS;
 	std::optional<Buffer>	h264PPS;
 	DWORD timeShiftDuration = 0;
+	
+	std::optional<FragmentedMP4Writer::Options> fragmentedOptions;
+	std::unique_ptr<FragmentedMP4Writer> fragmented;
+	std::map<std::pair<MediaFrame::Type,DWORD>,FragmentedTrack> fragmentedTracks;
 };
 #endif
@@ -1,6 +1,10 @@
 #ifndef _MP4STREAMER_H_
 #define _MP4STREAMER_H_
 #include <mp4v2/mp4v2.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
 #include "media.h"
 #include "rtp.h"
 #include "text.h"
@@ -22,23 +26,65 @@ struct MP4RtpTrack
 		virtual void onRTPPacket(RTPPacket &packet) = 0;
 	};
 
+	//Sample table entry, read in advance on open
+	struct Sample
+	{
+		//Time of the hint sample in ms
+		QWORD		time;
+		//Timestamp and duration on track timescale
+		MP4Timestamp	timestamp;
+		MP4Duration	duration;
+		bool		sync;
+	};
+
+	//Frames and rtp packets of a track, shared by all streamers of the same file once complete
+	struct Packetization
+	{
+		struct Packet
+		{
+			DWORD offset;
+			DWORD size;
+			bool  mark;
+		};
+		struct Frame
+		{
+			DWORD offset;
+			DWORD size;
+			DWORD packet;
+			DWORD numPackets;
+		};
+		std::vector<BYTE>   data;
+		std::vector<Packet> packets;
+		std::vector<Frame>  frames;
+		bool complete = false;
+
+		void Clear()
+		{
+			data.clear();
+			packets.clear();
+			frames.clear();
+		}
+	};
+
 	MP4FileHandle mp4;
 	MP4TrackId hint;
 	MP4TrackId track;
 	unsigned int timeScale;
 	unsigned int sampleId;
-	unsigned short numHintSamples;
-	unsigned short packetIndex;
 	unsigned short seqNum;
-	unsigned int frameSamples;
-	int frameSize;
-	int frameTime;
-	int frameType;
 	MediaFrame::Type media;
 	MediaFrame *frame;
 	int codec;
 	int type;
 	RTPPacket rtp;
+	std::vector<Sample> samples;
+	//Packetization cache, being built by us or shared
+	std::shared_ptr<Packetization> cache;
+	std::string cacheKey;
+	//Last sample when not cached
+	Packetization current;
+	//STAP-A packets with H264 parameter sets
+	std::vector<std::vector<BYTE>> h264Parameters;
 
 	MP4RtpTrack(MediaFrame::Type media,int codec,int type, DWORD clockrate) : rtp(media,codec)
 	{
@@ -55,14 +101,8 @@ struct MP4RtpTrack
 		track		= -1;
 		timeScale	= 0;
 		sampleId	= -1;
-		numHintSamples	= 0;
-		packetIndex	= -1;
 		seqNum		= 0;
 		frame		= NULL;
-		frameSamples	= 0;
-		frameSize	= 0;
-		frameType	= 0;
-		frameTime	= 0;
 		//Check media type
 		switch (media)
 		{
@@ -88,13 +128,20 @@ struct MP4RtpTrack
 			//Delete it
 			delete(frame);
 	}
+	int Load(const std::string& key, size_t maxCacheSize);
 	int Reset();
-	QWORD Read(Listener *listener);
+	QWORD Read(Listener *listener, size_t maxCacheSize);
 	QWORD SeekNearestSyncFrame(QWORD time);
-	QWORD SearchNearestSyncFrame(QWORD time);
+	QWORD SearchNearestSyncFrame(QWORD time) const;
 	QWORD Seek(QWORD time);
 	int SendH264Parameters(Listener *listener);
-	QWORD GetNextFrameTime();
+	QWORD GetNextFrameTime() const;
+private:
+	int LoadH264Parameters();
+	void AttachCache();
+	void UpdateCache();
+	bool Packetize(Packetization& packetization);
+	MP4SampleId FindSample(QWORD time) const;
 };
 
 struct MP4TextTrack
@@ -138,10 +185,18 @@ struct MP4TextTrack
 	QWORD GetNextFrameTime();
 };
 
+// Plays mp4 files with hint tracks.
+//
+// Playback runs on timers of a small pool of event loops shared by all the
+// streamers, so each one does not need its own thread. Sample tables are read
+// on open and the file is mapped in memory and prefetched in chunks. The rtp
+// packets of each track are cached while played, and once a file has been
+// played completely they are reused on loops and by other streamers of the
+// same file, without reading it again.
 class MP4Streamer
 {
 public:
-	class Listener : 
+	class Listener :
 		public MP4RtpTrack::Listener,
 		public MP4TextTrack::Listener
 	{
@@ -152,6 +207,9 @@ public:
 		//Interface
 		virtual void onEnd() = 0;
 	};
+
+	static constexpr DWORD MaxDefaultThreads = 2;
+	static constexpr size_t DefaultMaxCacheSize = 32*1024*1024;
 public:
 	MP4Streamer(Listener *listener);
 	~MP4Streamer();
@@ -174,18 +232,35 @@ public:
 	QWORD Tell()		{ return t+seeked;	}
 	int Stop();
 	int Close();
-	
-private:
-	int PlayLoop();
 
-protected:
-	EventLoop	loop;
+	// Use min(cores,MaxDefaultThreads) loops if not set, must be called before first streamer is created
+	static void SetDefaultNumThreads(DWORD num)	{ defaultNumThreads = num;	}
+	// Max size of the packets cached per track, 0 to disable caching
+	static void SetMaxCacheSize(size_t size)	{ maxCacheSize = size;		}
+private:
+	void Start();
+	void Halt();
+	void OnTimer();
+	void Run(const std::function<void(void)>& func);
+	void ReleaseTracks();
 private:
+	static DWORD defaultNumThreads;
+	//Set from the control thread, read from the loops
+	static std::atomic<size_t> maxCacheSize;
+
+	EventLoop*	loop;
+	Timer::shared	timer;
 	Listener*	listener;
 	bool		opened	= false;
-	bool		playing = false;
+	std::atomic<bool> playing = false;
+	//Only accessed from the loop
+	bool		running	= false;
 	QWORD		seeked	= 0;
 	QWORD		t	= 0;
+	QWORD		ini	= 0;
+	QWORD		audioNext = MP4_INVALID_TIMESTAMP;
+	QWORD		videoNext = MP4_INVALID_TIMESTAMP;
+	QWORD		textNext  = MP4_INVALID_TIMESTAMP;
 
 	MP4FileHandle	mp4	= MP4_INVALID_FILE_HANDLE;
 	MP4RtpTrack*	audio	= nullptr;
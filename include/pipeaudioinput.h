@@ -13,6 +13,7 @@ public:
 	PipeAudioInput();
 	~PipeAudioInput();
 	virtual int RecBuffer(SWORD *buffer,DWORD size);
+	virtual int TryRecBuffer(SWORD *buffer,DWORD size);
 	virtual int ClearBuffer();
 	virtual void CancelRecBuffer();
 	virtual int StartRecording(DWORD rate);
@@ -24,8 +25,12 @@ public:
 	
 	int Init(DWORD rate);
 	int PutSamples(SWORD *buffer,DWORD size);
+	//Put samples already converted to the given rate, so the transrater is skipped if it is the recording one
+	int PutSamples(const SWORD *buffer,DWORD size,DWORD rate);
 	int End();
 
+private:
+	void Push(const SWORD *buffer,DWORD size);
 private:
 	//Los mutex y condiciones
 	pthread_mutex_t mutex;
@@ -4,6 +4,7 @@
 #include "rtmp.h"
 #include "rtmpmessage.h"
 #include <list>
+#include <memory>
 
 class RTMPChunkStreamInfo
 {
@@ -33,6 +34,21 @@ protected:
 };
 
 
+//Chunk ready to be sent, the payload references the serialized message so it can be written with writev without copying it
+struct RTMPChunk
+{
+	//Basic header (3) + type 0 header (11) + extended timestamp (4)
+	static constexpr DWORD MaxHeaderSize = 18;
+
+	BYTE header[MaxHeaderSize];
+	DWORD headerLen = 0;
+	std::shared_ptr<BYTE[]> buffer;
+	const BYTE* payload = nullptr;
+	DWORD payloadLen = 0;
+
+	DWORD GetSize() const { return headerLen+payloadLen; }
+};
+
 class RTMPChunkOutputStream : public RTMPChunkStreamInfo
 {
 public:
@@ -42,6 +58,7 @@ public:
 	bool HasData();
 	bool ResetStream(DWORD id);
 	DWORD GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSize);
+	bool GetNextChunk(RTMPChunk& chunk,DWORD maxChunkSize);
 
 private:
 	typedef std::list<RTMPMessage*> RTMPMessages;
@@ -50,7 +67,7 @@ private:
 	DWORD chunkStreamId = 0;
 	RTMPMessage* message = nullptr;
 	DWORD pos = 0;
-	BYTE* msgBuffer = nullptr;
+	std::shared_ptr<BYTE[]> msgBuffer;
 	pthread_mutex_t mutex;
 };
 
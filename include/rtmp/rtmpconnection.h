@@ -1,22 +1,26 @@
 #ifndef _RTMPCONNECTION_H_
 #define _RTMPCONNECTION_H_
 #include <pthread.h>
-#include <sys/poll.h>
 #include <sys/socket.h>
 #include "config.h"
+#include "EpollReactor.h"
 #include "rtmp.h"
 #include "rtmpchunk.h"
 #include "rtmpmessage.h"
 #include "rtmpstream.h"
 #include "rtmpapplication.h"
 #include <pthread.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
-#include <thread>
+#include <mutex>
 
 
 class RTMPConnection :
 	public std::enable_shared_from_this<RTMPConnection>,
+	public EpollReactor::Handler,
 	public RTMPNetConnection::Listener,
 	public RTMPMediaStream::Listener,
 	public RTMPNetStream::Listener
@@ -43,12 +47,12 @@ public:
 	RTMPConnection(Listener* listener);
 	~RTMPConnection();
 
-	int Init(int fd);
-	void Start();
+	int Init(int fd,EpollReactor* reactor);
 	void Stop();
 	int End();
 	
 	int GetSocket() { return socket; }
+	EpollReactor* GetReactor() const { return reactor; }
 
 	//Listener from NetConnection
 	virtual void onNetConnectionStatus(QWORD transId,const RTMPNetStatusEventInfo &info,const wchar_t *message) override;
@@ -68,13 +72,18 @@ public:
 	virtual void onDetached(RTMPMediaStream *stream) override;
 	
 	DWORD GetRTT()	{ return rtt; }
+
+	//Reactor events
+	virtual void OnEvent(uint32_t events) override;
 protected:
-	
-	int Run();
 	void PingRequest();
 private:
+	void Start();
+	void Disconnect();
+	void OnTimeout(std::chrono::milliseconds now);
 	void ParseData(BYTE *data,const DWORD size);
-	DWORD SerializeChunkData(BYTE *data,const DWORD size);
+	void Flush();
+	void WaitWritable(bool wait);
 	int WriteData(BYTE *data,const DWORD size);
 
 	void ProcessControlMessage(DWORD messageStremId,BYTE type,RTMPObject* msg);
@@ -95,13 +104,33 @@ private:
 	typedef std::map<DWORD,RTMPChunkInputStream*>  RTMPChunkInputStreams;
 	typedef std::map<DWORD,RTMPChunkOutputStream*> RTMPChunkOutputStreams;
 	typedef std::map<DWORD,RTMPNetStream::shared> RTMPNetStreams;
+	//Max bytes of chunks taken from the output streams waiting to be written
+	static constexpr DWORD MaxPendingSize = 64*1024;
+	static constexpr int MaxIovecs = 64;
 private:
 	int socket;
-	pollfd ufds[1] = {};
 	volatile bool inited;
 	volatile bool running;
 	State state;
 
+	EpollReactor* reactor = nullptr;
+	Timer::shared timeoutTimer;
+	std::chrono::milliseconds lastActivity = 0ms;
+
+	//Chunks pending to be written, first one may be partially written already
+	std::deque<RTMPChunk> pending;
+	DWORD pendingOffset = 0;
+	DWORD pendingSize = 0;
+	bool writable = true;
+	bool waitingWritable = false;
+	bool sending = false;
+	std::atomic<bool> writeSignaled = false;
+
+	//To wait for the disconnection on the reactor
+	std::mutex stopMutex;
+	std::condition_variable stopCond;
+	bool disconnected = false;
+
 	RTMPHandshake01 s01;
 	RTMPHandshake0 c0;
 	RTMPHandshake1 c1;
@@ -128,7 +157,6 @@ private:
 	DWORD maxChunkSize;
 	DWORD maxOutChunkSize;
 
-	std::thread thread;
 	pthread_mutex_t mutex;
 
 	RTMPNetConnection::shared app;
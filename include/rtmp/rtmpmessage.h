@@ -7,6 +7,7 @@
 #include "h265/HEVCDescriptor.h"
 #include "aac/aacconfig.h"
 #include "BufferWritter.h"
+#include <memory>
 #include <vector>
 
 
@@ -48,6 +49,11 @@ public:
 
 	virtual void	Dump();
 
+	//Serialized frame, while cache is enabled it is serialized only once and shared by all the connections sending it
+	std::shared_ptr<BYTE[]> GetSerialized();
+	bool EnableSerializedCache();
+	void DisableSerializedCache();
+
 	static const char* GetTypeName(Type type)
 	{
 		switch (type)
@@ -70,6 +76,8 @@ protected:
 	DWORD mediaSize = 0;
 	DWORD pos = 0;
 	Type type = Type(0);
+	bool caching = false;
+	std::shared_ptr<BYTE[]> serialized;
 };
 
 class RTMPVideoFrame : public RTMPMediaFrame
@@ -344,6 +352,7 @@ public:
 	RTMPMessage(DWORD streamId,QWORD timestamp,RTMPCommandMessage* cmd);
 	RTMPMessage(DWORD streamId,QWORD timestamp,RTMPMediaFrame* media);
 	RTMPMessage(DWORD streamId,QWORD timestamp,RTMPMetaData* meta);
+	RTMPMessage(DWORD streamId,QWORD timestamp,Type type,const std::shared_ptr<BYTE[]>& serialized,DWORD length);
 	~RTMPMessage();
 	
 	DWORD Parse(BYTE* buffer,DWORD size);
@@ -362,6 +371,7 @@ public:
 	RTMPCommandMessage* 	GetCommandMessage()		{ return cmd; 	}
 	RTMPMetaData* 		GetMetaData()			{ return meta;	}
 	RTMPMediaFrame*		GetMediaFrame()			{ return media;	}
+	const std::shared_ptr<BYTE[]>& GetSerialized()		{ return serialized; }
 
 	DWORD	GetStreamId() 	{ return streamId; 	}
 	Type	GetType()	{ return type; 		}
@@ -373,6 +383,8 @@ private:
 	RTMPCommandMessage* 	cmd;
 	RTMPMetaData*		meta;
 	RTMPMediaFrame*		media;
+	//Already serialized body shared with other messages
+	std::shared_ptr<BYTE[]>	serialized;
 
 	//Header values
 	DWORD 	streamId;
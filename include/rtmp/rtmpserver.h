@@ -1,8 +1,8 @@
 #ifndef _RTMPSERVER_H_
 #define _RTPMSERVER_H_
 #include <memory>
-#include "pthread.h"
 #include "use.h"
+#include "ReactorServer.h"
 #include "rtmpstream.h"
 #include "rtmpapplication.h"
 #include "rtmpconnection.h"
@@ -16,7 +16,7 @@ public:
 	RTMPServer();
 	virtual ~RTMPServer();
 
-	int Init(int port);
+	int Init(int port,DWORD threads = 0);
 	int AddApplication(const wchar_t* name,RTMPApplication *app);
 	int End();
 	
@@ -29,25 +29,18 @@ public:
 	) override;
 	virtual void onDisconnect(const RTMPConnection::shared& con) override;
 
-protected:
-	int Run();
-
+	//Max number of reactor threads used by default
+	static constexpr DWORD MaxDefaultThreads = ReactorServer::MaxDefaultThreads;
 private:
-	static void * run(void *par);
-
-	void CreateConnection(int fd);
+	void CreateConnection(int fd,EpollReactor* reactor);
 	void DeleteAllConnections();
 
-	int BindServer();
-
 private:
 	int inited = 0;
-	int serverPort = 0;
-	int server = FD_INVALID;
+	ReactorServer listener;
 
 	std::set<RTMPConnection::shared> connections;
 	std::map<std::wstring,RTMPApplication *> applications;
-	pthread_t serverThread = 0;
 	Mutex mutex;
 };
 
@@ -2,6 +2,7 @@
 #define DEPENDENCYDESCRIPTOR_H
 
 #include "config.h"
+#include <memory>
 #include <optional>
 #include <utility>
 #include <vector>
@@ -50,6 +51,8 @@ struct FrameDependencyTemplate : public LayerInfo
 
 struct TemplateDependencyStructure
 {
+	using shared = std::shared_ptr<const TemplateDependencyStructure>;
+	
 	uint32_t templateIdOffset = 0;
 	uint32_t dtsCount	  = 0;
 	uint32_t chainsCount	  = 0;
@@ -64,6 +67,29 @@ struct TemplateDependencyStructure
 	//Mapping between decode targets and layers, oredered in descending spataila and layer order
 	std::vector<std::pair<uint32_t,LayerInfo>> decodeTargetLayerMapping;
 	
+	//Precomputed bitmasks, bit n is set for decode target n
+	// templateDecodeTargetsMask[templateIndex] : decode targets the template frame is present in
+	// templateSwitchMask[templateIndex]	  : decode targets the template frame is a switch point for
+	// chainDecodeTargetsMask[chainIndex]	  : decode targets protected by the chain
+	std::vector<uint32_t> templateDecodeTargetsMask;
+	std::vector<uint32_t> templateSwitchMask;
+	std::vector<uint32_t> chainDecodeTargetsMask;
+	
+	uint32_t GetAllDecodeTargetsMask() const
+	{
+		return dtsCount>=32 ? 0xFFFFFFFF : (1u << dtsCount) - 1;
+	}
+	
+	//Decode targets with layers lower or equal than the given ones
+	uint32_t GetDecodeTargetsMask(BYTE spatialLayerId, BYTE temporalLayerId) const
+	{
+		uint32_t mask = 0;
+		for (const auto& [decodeTarget,layerInfo] : decodeTargetLayerMapping)
+			if (layerInfo.spatialLayerId <= spatialLayerId && layerInfo.temporalLayerId <= temporalLayerId)
+				mask |= 1u << decodeTarget;
+		return mask;
+	}
+	
 	bool ContainsFrameDependencyTemplate(uint32_t frameDependencyTemplateId) const
 	{
 		return frameDependencyTemplateId >= templateIdOffset
@@ -75,6 +101,7 @@ struct TemplateDependencyStructure
 		return frameDependencyTemplates[frameDependencyTemplateId - templateIdOffset];
 	}
 	
+	//Updates layer mapping and bitmask tables, must be called whenever the structure changes
 	void CalculateLayerMapping();
 	
 	static std::optional<TemplateDependencyStructure> Parse(BitReader& reader);
@@ -117,7 +144,32 @@ struct DependencyDescriptor
 	bool Serialize(BitWritter& writter) const;
 	void Dump() const;
 	
-	static std::optional<DependencyDescriptor> Parse(BitReader& reader, const std::optional<TemplateDependencyStructure>& templateDependencyStructure = std::nullopt);
+	static std::optional<DependencyDescriptor> Parse(BitReader& reader, const TemplateDependencyStructure* templateDependencyStructure = nullptr);
+	
+	//Bitmask helpers, bit n is set for decode target n
+	static uint32_t GetDecodeTargetsMask(const std::vector<bool>& decodeTargets)
+	{
+		uint32_t mask = 0;
+		for (size_t i=0; i<decodeTargets.size() && i<MaxDecodeTargets; ++i)
+			if (decodeTargets[i])
+				mask |= 1u << i;
+		return mask;
+	}
+	static uint32_t GetDecodeTargetsMask(const std::vector<DecodeTargetIndication>& decodeTargetIndications, bool switchOnly = false)
+	{
+		uint32_t mask = 0;
+		for (size_t i=0; i<decodeTargetIndications.size() && i<MaxDecodeTargets; ++i)
+			if (switchOnly ? decodeTargetIndications[i]==DecodeTargetIndication::Switch : decodeTargetIndications[i]!=DecodeTargetIndication::NotPresent)
+				mask |= 1u << i;
+		return mask;
+	}
+	static std::vector<bool> GetDecodeTargets(uint32_t mask, uint32_t dtsCount)
+	{
+		std::vector<bool> decodeTargets(dtsCount);
+		for (uint32_t i=0; i<dtsCount && i<MaxDecodeTargets; ++i)
+			decodeTargets[i] = (mask >> i) & 1;
+		return decodeTargets;
+	}
 
 	friend bool operator==(const DependencyDescriptor& lhs, const DependencyDescriptor& rhs)
 	{
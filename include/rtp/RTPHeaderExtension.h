@@ -224,7 +224,9 @@ public:
 
 public:
 	DWORD Parse(const RTPMap &extMap,const BYTE* data,const DWORD size);
-	bool  ParseDependencyDescriptor(const std::optional<TemplateDependencyStructure>& templateDependencyStructure);
+	bool  ParseDependencyDescriptor(const TemplateDependencyStructure* templateDependencyStructure);
+	void  OverrideDependencyDescriptorFrameNumber(uint16_t frameNumber);
+	void  InvalidateRawDependencyDescriptor()	{ rawDependencyDescryptorLen = 0; }
 	DWORD Serialize(const RTPMap &extMap,BYTE* data,const DWORD size) const;
 	void  Dump() const;
 public:
@@ -240,6 +242,9 @@ public:
 	std::string mid;
 	BitReader dependencyDescryptorReader; 
 	std::optional<::DependencyDescriptor> dependencyDescryptor;
+	//Received dependency descriptor bytes, reused on serialization while it is not modified
+	BYTE rawDependencyDescryptor[16];
+	BYTE rawDependencyDescryptorLen = 0;
 	struct AbsoluteCaptureTime absoluteCaptureTime;
 	struct PlayoutDelay playoutDelay;
 	std::optional<struct ColorSpace> colorSpace;
@@ -0,0 +1,96 @@
+#ifndef RTPINCOMINGMEDIASTREAMSILENCEGATE_H
+#define RTPINCOMINGMEDIASTREAMSILENCEGATE_H
+
+#include <set>
+
+#include "config.h"
+#include "use.h"
+#include "rtp/RTPIncomingMediaStream.h"
+#include "TimeService.h"
+
+/**
+ * Audio stream relay that drops silent packets before they are fanned out to
+ * the listeners, so a large room only pays for the participants that are
+ * actually talking.
+ *
+ * A packet is silent when its audio level is at or below the threshold (the
+ * level is -dBov, so higher is quieter) or when it is an opus DTX frame. Voice
+ * is kept for the hangover time after the last voiced packet so word endings
+ * are not clipped. Forwarded packets are renumbered so listeners see a
+ * contiguous sequence, and the first one after a silence period carries the
+ * marker bit as a talkspurt start.
+ *
+ * Endpoints that do not handle gaps on the stream can get a comfort noise
+ * frame each comfort noise interval while the source is silent: an opus silence
+ * frame, or a silence filled payload for G.711. The gate decides once per
+ * incoming packet, so attach legacy and DTX aware listeners to different gates.
+ */
+class RTPIncomingMediaStreamSilenceGate :
+	public RTPIncomingMediaStream,
+	public RTPIncomingMediaStream::Listener
+{
+public:
+	struct Stats
+	{
+		QWORD forwarded		= 0;
+		QWORD dropped		= 0;
+		QWORD comfortNoise	= 0;
+		QWORD talkspurts	= 0;
+	};
+public:
+	RTPIncomingMediaStreamSilenceGate(const RTPIncomingMediaStream::shared& incomingMediaStream, TimeService& timeService);
+	virtual ~RTPIncomingMediaStreamSilenceGate() = default;
+
+	// RTPIncomingMediaStream interface;
+	virtual void AddListener(RTPIncomingMediaStream::Listener* listener) override;
+	virtual void RemoveListener(RTPIncomingMediaStream::Listener* listener) override;
+	virtual DWORD GetMediaSSRC() const override { return incomingMediaStream ? incomingMediaStream->GetMediaSSRC() : 0; }
+	virtual void Mute(bool muting) override;
+
+	// RTPIncomingMediaStream::Listener interface
+	virtual void onRTP(const RTPIncomingMediaStream* stream, const RTPPacket::shared& packet) override;
+	virtual void onRTP(const RTPIncomingMediaStream* stream, const std::vector<RTPPacket::shared>& packets) override;
+	virtual void onBye(const RTPIncomingMediaStream* stream) override;
+	virtual void onEnded(const RTPIncomingMediaStream* stream) override;
+
+	virtual TimeService& GetTimeService() override { return timeService; }
+
+	void SetThreshold(BYTE threshold)		{ this->threshold = threshold;			}
+	void SetHangover(QWORD hangover)		{ this->hangover = hangover;			}
+	void SetComfortNoiseInterval(QWORD interval)	{ this->comfortNoiseInterval = interval;	}
+	const Stats& GetStats() const			{ return stats;					}
+
+	void Stop();
+
+	// Gets a packet already processed by the gate as it was forwarded, or nullptr if it was dropped, not processed yet
+	// or its number is not known anymore. Used to replay packets to new listeners, must be called from the time service thread
+	RTPPacket::shared GetForwarded(const RTPPacket::shared& packet) const;
+
+	// Checks if packet carries silence or an opus DTX frame
+	static bool IsSilence(const RTPPacket::shared& packet, BYTE threshold);
+private:
+	RTPPacket::shared Gate(const RTPPacket::shared& packet, QWORD now);
+	RTPPacket::shared CreateComfortNoise(const RTPPacket::shared& packet) const;
+	void Dispatch(const RTPPacket::shared& packet);
+private:
+	RTPIncomingMediaStream::shared incomingMediaStream;
+	TimeService& timeService;
+	std::set<RTPIncomingMediaStream::Listener*>  listeners;
+	volatile bool muted = false;
+
+	//Levels below -127dBov only, i.e. digital silence
+	BYTE  threshold			= 127;
+	QWORD hangover			= 200;
+	QWORD comfortNoiseInterval	= 0;
+
+	bool  started		= false;
+	bool  talking		= false;
+	QWORD lastVoice		= 0;
+	QWORD lastComfortNoise	= 0;
+	DWORD lastExtSeqNum	= 0;
+	DWORD lastDroppedExtSeqNum = 0;
+	DWORD dropped		= 0;
+	Stats stats;
+};
+
+#endif //RTPINCOMINGMEDIASTREAMSILENCEGATE_H
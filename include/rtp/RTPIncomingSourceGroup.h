@@ -14,6 +14,8 @@
 #include "rtp/RTPBuffer.h"
 #include "remoterateestimator.h"
 #include "TimeService.h"
+#include "StatsSnapshot.h"
+#include "LatencyHistogram.h"
 
 class RTPIncomingSourceGroup :
 	public RTPIncomingMediaStream,
@@ -40,6 +42,8 @@ public:
 	void ResetMaxWaitTime();
 	void ResetPackets();
 	void Update();
+	//Must be called from the time service thread
+	void UpdateStats(QWORD now);
 	void UpdateAsync(std::function<void(std::chrono::milliseconds)> callback);
 	void SetRTT(DWORD rtt, QWORD now);
 	std::list<RTCPRTPFeedback::NACKField::shared>  GetNacks() { return losts.GetNacks(); }
@@ -53,10 +57,12 @@ public:
 	DWORD GetMinWaitedTime()		const { return minWaitedTime;	}
 	DWORD GetMaxWaitedTime()		const { return maxWaitedTime;	}
 	long double GetAvgWaitedTime()		const {	return avgWaitedTime;	}
+	const LatencyHistogram& GetJitterBufferLatency() const { return jitterBufferLatency; }
 	
 	virtual void onTargetBitrateRequested(DWORD bitrate, DWORD bandwidthEstimation, DWORD targetBitrate) override;
 private:
 	void DispatchPackets(QWORD time);
+	void PublishStats(QWORD now);
 public:	
 	std::string rid;
 	std::string mid;
@@ -82,8 +88,8 @@ private:
 	RTPLostPackets	losts;
 	RTPBuffer	packets;
 	std::set<RTPIncomingMediaStream::Listener*>  listeners;
-	std::optional<std::vector<bool>> activeDecodeTargets;
-	std::optional<TemplateDependencyStructure> templateDependencyStructure;
+	std::optional<uint32_t> activeDecodeTargets;
+	TemplateDependencyStructure::shared templateDependencyStructure;
 	
 	bool  isRTXEnabled = true;
 	WORD  rttrtxSeq	 = 0 ;
@@ -91,6 +97,8 @@ private:
 	bool remb	 = false;
 	std::optional<DWORD> maxWaitingTime;
 	volatile bool muted = false;
+	StatsSnapshotRegistry::Publisher statsPublisher;
+	LatencyHistogram jitterBufferLatency { "rtp.jitter_buffer" };
 	
 };
 
@@ -26,6 +26,8 @@ struct RTPOutgoingSource :
 	BYTE	reportedFractionLost;
 	DWORD	reportedJitter;
 	DWORD	rtt;
+	DWORD	totalPLIs;
+	DWORD	totalNACKs;
 	
 	Acumulator<uint32_t, uint64_t> acumulatorFrames;
 	Acumulator<uint32_t, uint64_t> reportCountAcumulator;
@@ -10,6 +10,7 @@
 #include "rtp/RTPOutgoingSource.h"
 #include "TimeService.h"
 #include "CircularBuffer.h"
+#include "StatsSnapshot.h"
 
 struct RTPOutgoingSourceGroup
 {
@@ -39,6 +40,8 @@ public:
 	void UpdateAsync(std::function<void(std::chrono::milliseconds)> callback);
 	void Update(QWORD now);
 	void Update();
+	//Must be called from the time service thread
+	void UpdateStats(QWORD now);
 	//RTX packets
 	void AddPacket(const RTPPacket::shared& packet);
 	RTPPacket::shared GetPacket(WORD seq) const;
@@ -68,12 +71,15 @@ public:
 	RTPOutgoingSource media;
 	RTPOutgoingSource rtx;
 	QWORD lastUpdated = 0;
+private:
+	void PublishStats(QWORD now);
 private:	
 	TimeService& timeService;
 	CircularBuffer<RTPPacket::shared, uint16_t, 512> packets;
 	CircularBuffer<QWORD, uint16_t, 512> rtxTimes;
 	std::set<Listener*> listeners;
 	std::optional<struct RTPHeaderExtension::PlayoutDelay> forcedPlayoutDelay;
+	StatsSnapshotRegistry::Publisher statsPublisher;
 };
 
 
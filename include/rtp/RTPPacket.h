@@ -36,9 +36,12 @@ public:
 	
 	DWORD Serialize(BYTE* data,DWORD size,const RTPMap& extMap) const;
 	
-	bool SetPayload(const BYTE *data,DWORD size)	{ return payload->SetPayload(data,size);	}
-	bool SkipPayload(DWORD skip)			{ return payload->SkipPayload(skip);		}
-	bool PrefixPayload(BYTE *data,DWORD size)	{ return payload->PrefixPayload(data,size);	}
+	bool SetPayload(const BYTE *data,DWORD size)	{ AdquirePayload(); return payload->SetPayload(data,size);	}
+	bool SkipPayload(DWORD skip)			{ AdquirePayload(); return payload->SkipPayload(skip);		}
+	bool PrefixPayload(BYTE *data,DWORD size)	{ AdquirePayload(); return payload->PrefixPayload(data,size);	}
+	
+	//Share payload for zero copy referencing, any later change on this packet will be done on a copy
+	const RTPPayload::shared& SharePayload()	{ ownedPayload = false; return payload;				}
 	
 	bool RecoverOSN();
 	void SetOSN(DWORD extSeqNum);
@@ -68,7 +71,7 @@ public:
 	MediaFrame::Type GetMediaType()	const { return media;				}
 	BYTE  GetCodec()		const { return codec;				}
 	
-	BYTE* AdquireMediaData();
+	BYTE* AdquireMediaData()		      { AdquirePayload(); return payload->GetMediaData();		}
 	const BYTE* GetMediaData()	const { return payload ? payload->GetMediaData()	: nullptr;	}
 	DWORD GetMediaLength()		const { return payload ? payload->GetMediaLength()	: 0; 		}
 	DWORD GetMaxMediaLength()	const { return payload ? payload->GetMaxMediaLength()	: 0;		}
@@ -94,15 +97,16 @@ public:
 	void  SetRId(const std::string &rid)						{ header.extension = extension.hasRId			= true; extension.rid = rid;			}
 	void  SetRepairedId(const std::string &repairedId)				{ header.extension = extension.hasRepairedId		= true; extension.repairedId = repairedId;	}
 	void  SetMediaStreamId(const std::string &mid)					{ header.extension = extension.hasMediaStreamId		= true; extension.mid = mid;			}
-	void  SetDependencyDescriptor(DependencyDescriptor& dependencyDescriptor)	{ header.extension = extension.hasDependencyDescriptor	= true; extension.dependencyDescryptor = dependencyDescriptor;		}
+	void  SetDependencyDescriptor(DependencyDescriptor& dependencyDescriptor)	{ header.extension = extension.hasDependencyDescriptor	= true; extension.dependencyDescryptor = dependencyDescriptor; extension.InvalidateRawDependencyDescriptor(); }
 	void  SetAbsoluteCaptureTimestamp(QWORD ntp)					{ header.extension = extension.hasAbsoluteCaptureTime	= true; extension.absoluteCaptureTime.SetAbsoluteCaptureTimestamp(ntp); }
 	void  SetAbsoluteCaptureTime(QWORD ms)						{ header.extension = extension.hasAbsoluteCaptureTime	= true; extension.absoluteCaptureTime.SetAbsoluteCaptureTime(ms);	}
+	void  SetAudioLevel(bool vad, BYTE level)					{ header.extension = extension.hasAudioLevel		= true; extension.vad = vad; extension.level = level;	}
 	void  SetPlayoutDelay(uint16_t min, uint16_t max)				{ header.extension = extension.hasPlayoutDelay		= true; extension.playoutDelay.SetPlayoutDelay(min, max);		}
 	void  SetPlayoutDelay(const struct RTPHeaderExtension::PlayoutDelay& playoutDelay)	{ header.extension = extension.hasPlayoutDelay		= true; extension.playoutDelay = playoutDelay;				}
 	void  SetColorSpace(const struct RTPHeaderExtension::ColorSpace& colorSpace)		{ header.extension = extension.hasColorSpace		= true; extension.colorSpace = colorSpace;				}
 	void  SetVideoLayersAllocation(const VideoLayersAllocation& videoLayersAllocation)	{ header.extension = extension.hasVideoLayersAllocation = true; extension.videoLayersAllocation = videoLayersAllocation;	}
 	
-	bool  ParseDependencyDescriptor(const std::optional<TemplateDependencyStructure>& templateDependencyStructure, std::optional<std::vector<bool>>& activeDecodeTargets);
+	bool  ParseDependencyDescriptor(const TemplateDependencyStructure::shared& templateDependencyStructure, const std::optional<uint32_t>& activeDecodeTargets);
 	
 	//Disable extensions
 	void  DisableAbsSentTime()		{ extension.hasAbsSentTime		= false; CheckExtensionMark(); }
@@ -130,8 +134,8 @@ public:
 	
 	const RTPHeaderExtension::FrameMarks&			GetFrameMarks()			 const { return extension.frameMarks;		}
 	const std::optional<DependencyDescriptor>&		GetDependencyDescriptor()	 const { return extension.dependencyDescryptor;	}
-	const std::optional<TemplateDependencyStructure>&	GetTemplateDependencyStructure() const { return templateDependencyStructure;	}
-	const std::optional<std::vector<bool>>&			GetActiveDecodeTargets()	 const { return activeDecodeTargets;		}
+	const TemplateDependencyStructure::shared&		GetTemplateDependencyStructure() const { return templateDependencyStructure;	}
+	const std::optional<uint32_t>&				GetActiveDecodeTargets()	 const { return activeDecodeTargets;		}
 	const VideoOrientation&					GetVideoOrientation()		 const { return extension.cvo;			}
 	const struct RTPHeaderExtension::PlayoutDelay&		GetPlayoutDelay()		 const { return extension.playoutDelay;		}
 	const std::optional<struct RTPHeaderExtension::ColorSpace>&    GetColorSpace()		 const { return extension.colorSpace;		}
@@ -156,19 +160,27 @@ public:
 	bool  HasVideoLayersAllocation()	const	{ return extension.hasVideoLayersAllocation && extension.videoLayersAllocation; }
 
 	
-	void  OverrideActiveDecodeTargets(const std::optional<std::vector<bool>>& activeDecodeTargets) 
+	void  OverrideActiveDecodeTargets(const std::optional<uint32_t>& activeDecodeTargets) 
 	{
-		if (extension.dependencyDescryptor)
-			extension.dependencyDescryptor->activeDecodeTargets = activeDecodeTargets;
+		//Only when carrying the structure, so we know the number of decode targets
+		if (extension.dependencyDescryptor && extension.dependencyDescryptor->templateDependencyStructure)
+		{
+			//Set it
+			if (activeDecodeTargets)
+				extension.dependencyDescryptor->activeDecodeTargets = DependencyDescriptor::GetDecodeTargets(*activeDecodeTargets, extension.dependencyDescryptor->templateDependencyStructure->dtsCount);
+			else
+				extension.dependencyDescryptor->activeDecodeTargets.reset();
+			//Needs to be serialized again
+			extension.InvalidateRawDependencyDescriptor();
+		}
 	}
-	void OverrideTemplateDependencyStructure(const std::optional<TemplateDependencyStructure>& templateDependencyStructure)
+	void OverrideTemplateDependencyStructure(const TemplateDependencyStructure::shared& templateDependencyStructure)
 	{
 		this->templateDependencyStructure = templateDependencyStructure;
 	}
 	void  OverrideFrameNumber(uint16_t frameNumber)
 	{
-		if (extension.dependencyDescryptor)
-			extension.dependencyDescryptor->frameNumber = frameNumber;
+		extension.OverrideDependencyDescriptorFrameNumber(frameNumber);
 	}
 	
 	QWORD GetTime()				const	{ return time;				}
@@ -198,13 +210,14 @@ public:
 	std::optional<VP9PayloadDescription>	vp9PayloadDescriptor;
 	std::optional<H264SeqParameterSet>	h264SeqParameterSet;
 	std::optional<H264PictureParameterSet>	h264PictureParameterSet;
-	std::optional<std::vector<bool>>	activeDecodeTargets;
-	std::optional<TemplateDependencyStructure> templateDependencyStructure;
+	std::optional<uint32_t>			activeDecodeTargets;
+	TemplateDependencyStructure::shared	templateDependencyStructure;
 	Buffer::shared				config;
 
 	bool rewitePictureIds = false;
 	
 protected:
+	void  AdquirePayload();
 	void  CheckExtensionMark()	{ header.extension =  extension.hasAudioLevel
 						|| extension.hasAbsSentTime 
 						|| extension.hasTimeOffset
@@ -216,6 +216,25 @@ public:
 		return rtp;
 	}
 
+	RTPPacket::shared TryWait()
+	{
+		//NO packet
+		RTPPacket::shared rtp;
+
+		//Lock
+		pthread_mutex_lock(&mutex);
+
+		//If not canceled
+		if (!cancel)
+			//Get next one if it is ready
+			rtp = GetOrdered();
+
+		//Unlock
+		pthread_mutex_unlock(&mutex);
+
+		return rtp;
+	}
+
 	void Clear()
 	{
 		//Lock
@@ -10,12 +10,14 @@
 #include "config.h"
 #include "tools.h"
 #include <vector>
+#include <string_view>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <openssl/sha.h>
 
 class STUNMessage
 {
@@ -98,6 +100,65 @@ public:
 		WORD size;
 		BYTE *attr;
 	};
+
+	// HMAC-SHA1 key with the inner and outer pads already hashed, so the message
+	// integrity of each message only hashes the message itself. 
+	class Key
+	{
+	public:
+		static constexpr DWORD Size = SHA_DIGEST_LENGTH;
+	public:
+		Key() = default;
+		explicit Key(const char* pwd)	{ Set(pwd); }
+		void Set(const char* pwd);
+		void Reset()			{ set = false;	}
+		bool IsSet() const		{ return set;	}
+		//Writes Size bytes on hmac, can be called concurrently
+		void Calculate(const BYTE* data,DWORD size,BYTE* hmac) const;
+		void Calculate(const BYTE* first,DWORD firstSize,const BYTE* second,DWORD secondSize,BYTE* hmac) const;
+	private:
+		SHA_CTX inner;
+		SHA_CTX outer;
+		bool set = false;
+	};
+
+	// Non owning parsed message, attribute values point to the received buffer.
+	// Used on the connectivity checks path to avoid allocating for each message.
+	class View
+	{
+	public:
+		static constexpr DWORD MaxAttributes = 16;
+
+		struct AttributeView
+		{
+			WORD type;
+			WORD size;
+			const BYTE *attr;
+		};
+	public:
+		bool Parse(const BYTE* data,DWORD size);
+		bool CheckAuthenticatedFingerPrint(const Key& key) const;
+		DWORD CreateBindingResponse(BYTE* data,DWORD size,uint32_t addr,uint16_t port,const Key& key) const;
+
+		const AttributeView* GetAttribute(Attribute::Type type) const;
+		bool HasAttribute(Attribute::Type type) const	{ return GetAttribute(type);	}
+		std::string_view GetUsername() const;
+		DWORD GetPriority() const;
+
+		Type   GetType()		const { return type;	}
+		Method GetMethod()		const { return method;	}
+		const BYTE*  GetTransactionId()	const { return data+8;	}
+		DWORD  GetNumAttributes()	const { return numAttributes;	}
+		const AttributeView* GetAttributes() const { return attributes;	}
+	private:
+		const BYTE* data	= nullptr;
+		DWORD size		= 0;
+		Type type		= Request;
+		Method method		= Binding;
+		AttributeView attributes[MaxAttributes];
+		DWORD numAttributes	= 0;
+		DWORD posMessageIntegrity = 0;
+	};
 public:
 	static bool IsSTUN(const BYTE* data,DWORD size);
 	static STUNMessage* Parse(const BYTE* data,DWORD size);
@@ -106,6 +167,7 @@ public:
 	~STUNMessage();
 	STUNMessage* CreateResponse();
 	DWORD AuthenticatedFingerPrint(BYTE* data,DWORD size,const char* pwd);
+	DWORD AuthenticatedFingerPrint(BYTE* data,DWORD size,const Key& key);
 	DWORD NonAuthenticatedFingerPrint(BYTE* data,DWORD size);
 	bool CheckAuthenticatedFingerPrint(const BYTE* data,DWORD size,const char* pwd);
 	DWORD GetSize();
@@ -127,6 +189,10 @@ public:
 	
 	void Dump();
 	
+private:
+	static WORD  GetTypeField(Type type,Method method);
+	static void  SetXorAddress(BYTE* data,uint32_t addr,uint16_t port);
+	static DWORD AppendIntegrityAndFingerPrint(BYTE* data,DWORD i,const Key& key);
 private:
 	typedef std::vector<Attribute*> Attributes;
 private:
@@ -63,11 +63,17 @@ public:
 		frame->SetTimestampSkew(GetTimestampSkew());
 		//Set duration
 		frame->SetDuration(GetDuration());
+		//Set decoding timestamp
+		if (dts) frame->SetDecodingTimestamp(*dts);
 		//Set CVO
 		if (cvo) frame->SetVideoOrientation(*cvo);
 		//Copy target bitrate and fps
 		frame->SetTargetBitrate(targetBitrate);
 		frame->SetTargetFps(targetFps);
+		//Copy rendition id
+		frame->SetRId(rid);
+		//Reference same fragments
+		frame->ShareFragments(*this);
 		//If we have disabled the shared buffer for this frame
 		if (disableSharedBuffer)
 			//Copy data
@@ -109,6 +115,13 @@ public:
 	void SetTargetFps(uint32_t targetFps)		{ this->targetFps = targetFps;		}	
 	uint32_t GetTargetFps() const			{ return this->targetFps;		}
 
+	void SetRId(const std::string& rid)		{ this->rid = rid;			}
+	const std::string& GetRId() const		{ return this->rid;			}
+
+	//Only set when frames are reordered, same as timestamp otherwise
+	void SetDecodingTimestamp(QWORD dts)		{ this->dts = dts;			}
+	QWORD GetDecodingTimestamp() const		{ return dts.value_or(GetTimestamp());	}
+
 	void Reset() 
 	{
 		//Reset media frame
@@ -119,6 +132,8 @@ public:
 		ClearCodecConfig();
 		//Clear layers
 		layers.clear();
+		//Not reordered
+		dts.reset();
 	}
 	
 private:
@@ -128,8 +143,10 @@ private:
 	uint32_t height		= 0;
 	uint32_t targetBitrate	= 0;
 	uint32_t targetFps	= 0;
+	std::string rid;
 	std::vector<LayerFrame> layers;
 	std::optional<VideoOrientation> cvo;
+	std::optional<QWORD> dts;
 };
 
 
@@ -140,6 +157,8 @@ public:
 
 	virtual int   StartVideoCapture(uint32_t width, uint32_t height, uint32_t fps)=0;
 	virtual VideoBuffer::const_shared GrabFrame(uint32_t timeout)=0;
+	//Get new picture if there is one, without waiting for it
+	virtual VideoBuffer::const_shared TryGrabFrame()=0;
 	virtual void  CancelGrabFrame()=0;
 	virtual int   StopVideoCapture()=0;
 };
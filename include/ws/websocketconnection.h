@@ -1,14 +1,19 @@
 #ifndef _WebSocketConnection_H_
 #define _WebSocketConnection_H_
-#include <pthread.h>
-#include <sys/poll.h>
-#include <pthread.h>
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
-#include <list>
+#include <memory>
+#include <mutex>
 #include "config.h"
 #include "log.h"
 #include "tools.h"
-#include "fifo.h"
+#include "EpollReactor.h"
 #include "websockets.h"
 #include "http.h"
 #include "httpparser.h"
@@ -174,6 +179,32 @@ public:
 			return get8(data,2);
 		return len;
 	}
+
+	// XOR payload data in place with the mask, pos is the offset of data within the frame payload
+	static void Unmask(BYTE* data,QWORD size,DWORD mask,QWORD pos)
+	{
+		BYTE key[4];
+		//Get mask bytes rotated to current position
+		for (int i=0;i<4;++i)
+			key[i] = mask >> (24-8*((pos+i) & 0x03));
+		//Repeat it over a 32bit word in memory order
+		uint32_t word;
+		memcpy(&word,key,4);
+		QWORD i = 0;
+#ifdef __AVX2__
+		//32 bytes at a time
+		__m256i ymm = _mm256_set1_epi32(word);
+		for (;i+32<=size;i+=32)
+			_mm256_storeu_si256((__m256i*)(data+i),_mm256_xor_si256(_mm256_loadu_si256((__m256i*)(data+i)),ymm));
+#endif
+		//16 bytes at a time
+		__m128i xmm = _mm_set1_epi32(word);
+		for (;i+16<=size;i+=16)
+			_mm_storeu_si128((__m128i*)(data+i),_mm_xor_si128(_mm_loadu_si128((__m128i*)(data+i)),xmm));
+		//Remaining bytes, i is multiple of 4 here
+		for (;i<size;++i)
+			data[i] ^= key[i & 0x03];
+	}
 private:
 	WebSocketFrameHeader()
 	{
@@ -231,6 +262,8 @@ private:
 
 
 class WebSocketConnection :
+	public std::enable_shared_from_this<WebSocketConnection>,
+	public EpollReactor::Handler,
 	public WebSocket,
 	public HTTPParser::Listener
 {
@@ -244,53 +277,74 @@ private:
 			this->opCode = opCode;
 			//Create header
 			WebSocketFrameHeader header(fin,opCode,size,0);
-			//Get size
-			headerSize = header.GetSize();
-			//Calculate total size
-			this->size = size+headerSize;
-			//Set values
-			this->data = (BYTE*)calloc(this->size,1);
 			//Copy header data
-			memcpy(this->data,header.GetData(),header.GetSize());
-			//Set initial length
-			length = header.GetSize();
+			headerSize = header.GetSize();
+			memcpy(this->header,header.GetData(),headerSize);
+			//Allocate payload
+			payloadSize = size;
+			payload.reset(new BYTE[size]);
+			//Nothing appended yet
+			length = 0;
 			//If we have payload
 			if (data)
 				//Append it
 				Append(data,size);
+			//Close connection after sending close frames
+			close = opCode==WebSocketFrameHeader::Close;
+		}
+
+		//Raw data without websocket header, used for the http response
+		Frame(const std::string& raw,bool close)
+		{
+			//Not a websocket frame
+			opCode = WebSocketFrameHeader::ContinuationFrame;
+			headerSize = 0;
+			//Copy data
+			payloadSize = raw.length();
+			payload.reset(new BYTE[payloadSize]);
+			memcpy(payload.get(),raw.data(),payloadSize);
+			length = payloadSize;
+			//Store if we have to close after sending it
+			this->close = close;
 		}
 
+		Frame(Frame&&) = default;
+		Frame& operator=(Frame&&) = default;
+
 		bool Append(const BYTE* data,DWORD size)
 		{
 			//Check
-			if (size+length>this->size)
+			if (size+length>payloadSize)
 				//Error
-				return Error("-WebSocketConnection::Frame not enoguth length for appending data size:%d,length:%d,data:%d",this->size,length,size);
+				return Error("-WebSocketConnection::Frame not enoguth length for appending data size:%d,length:%d,data:%d",payloadSize,length,size);
 			//Copy payload data
-			memcpy(this->data+length,data,size);
+			memcpy(payload.get()+length,data,size);
 			//Set length
 			length += size;
+			//Done
+			return true;
 		}
 
-		~Frame()
-		{
-			free(data);
-		}
-		const WebSocketFrameHeader::OpCode GetOpCode()	{ return opCode;	}
-		
-		const BYTE* GetData()	{ return data;	}
-		const DWORD GetSize()	{ return size;	}
+		WebSocketFrameHeader::OpCode GetOpCode() const	{ return opCode;		}
+		bool  IsClose() const				{ return close;			}
 
-		BYTE*	    GetPayloadData() { return data+headerSize;	}
-		const DWORD GetPayloadSize() { return size-headerSize;	}
+		const BYTE* GetHeaderData() const		{ return header;		}
+		DWORD GetHeaderSize() const			{ return headerSize;		}
+		BYTE* GetPayloadData()				{ return payload.get();		}
+		DWORD GetPayloadSize() const			{ return payloadSize;		}
+		DWORD GetSize() const				{ return headerSize+payloadSize;	}
 	private:
 		WebSocketFrameHeader::OpCode opCode;
-		BYTE* data;
-		DWORD size;
+		BYTE header[14];
 		DWORD headerSize;
+		std::unique_ptr<BYTE[]> payload;
+		DWORD payloadSize;
 		DWORD length;
+		bool close;
 	};
 public:
+	using shared = std::shared_ptr<WebSocketConnection>;
+
 	class Listener
 	{
 	public:
@@ -299,15 +353,16 @@ public:
 	public:
 		//Interface
 		virtual void onUpgradeRequest(WebSocketConnection* conn) = 0;
-		virtual void onDisconnected(WebSocketConnection* conn) = 0;
+		virtual void onDisconnected(const WebSocketConnection::shared& conn) = 0;
 	};
 public:
 	WebSocketConnection(Listener* listener);
 	~WebSocketConnection();
 
-	int Init(int fd);
+	int Init(int fd,EpollReactor* reactor);
 	int End();
 
+	EpollReactor* GetReactor() const { return reactor; }
 
 	//Weksocket
 	virtual void Accept(WebSocket::Listener *listener);
@@ -332,27 +387,59 @@ public:
 	virtual int on_headers_complete (HTTPParser*);
 	virtual int on_message_complete (HTTPParser*);
 
+	//Reactor events
+	virtual void OnEvent(uint32_t events) override;
+
 	HTTPRequest* GetRequest() { return request; }
 protected:
 	void Start();
 	void Stop();
-	int Run();
-	Frame* GetNextFrame();
 private:
-	static  void* run(void *par);
+	void   Disconnect();
+	void   OnTimeout(std::chrono::milliseconds now);
 	void   ProcessData(BYTE *data,DWORD size);
-	int    WriteData(BYTE *data,const DWORD size);
+	void   Enqueue(Frame&& frame);
+	void   Flush();
+	bool   WritePending();
+	void   WaitWritable(bool wait);
 	void   SignalWriteNeeded();
 	void   Ping();
+private:
+	//Max bytes of frames taken from the queue waiting to be written
+	static constexpr DWORD MaxPendingSize = 64*1024;
+	static constexpr int MaxIovecs = 64;
 private:
 	int socket;
-	pollfd ufds[1];
-	bool inited;
-	bool running;
+	volatile bool inited;
+	volatile bool running;
+
+	EpollReactor* reactor = nullptr;
+	Timer::shared keepAliveTimer;
+	std::chrono::milliseconds lastActivity = 0ms;
+
+	//Frames queued from any thread
+	std::mutex mutex;
+	std::deque<Frame> frames;
+	std::atomic<DWORD> outgoingFramesLength = 0;
+
+	//Frames being written on the reactor, first one may be partially written already
+	std::deque<Frame> pending;
+	DWORD pendingOffset = 0;
+	DWORD pendingSize = 0;
+	bool writable = true;
+	bool waitingWritable = false;
+	bool sending = false;
+	bool flushing = false;
+	bool closing = false;
+	std::atomic<bool> writeSignaled = false;
+
+	//To wait for the disconnection on the reactor
+	std::mutex stopMutex;
+	std::condition_variable stopCond;
+	bool disconnected = false;
 
-	pthread_t thread;
-	pthread_mutex_t mutex;
-	pthread_mutex_t mutexListener;
+	//Recursive to be able to call it from within listener
+	std::recursive_mutex mutexListener;
 
 	timeval startTime;
 	Listener *listener;
@@ -364,7 +451,6 @@ private:
 
 	HTTPParser parser;
 	HTTPRequest* request;
-	HTTPResponse* response;
 	std::string headerField;
 	std::string headerValue;
 
@@ -376,12 +462,8 @@ private:
 	QWORD bandIni;
 	DWORD bandSize;
 	DWORD bandCalc;
-	fifo<BYTE,65538> incoming;
-	WORD		 incomingFrameLength;
 
-	std::list<Frame*>  frames;
-	DWORD		   outgoingFramesLength;
-	Frame*		   pong;
+	std::unique_ptr<Frame> pong;
 };
 
 #endif
@@ -1,7 +1,9 @@
 #ifndef _WebSocketServer_H_
 #define _WebSocketServer_H_
-#include "pthread.h"
-#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include "ReactorServer.h"
 #include "websockets.h"
 #include "websocketconnection.h"
 #include "utf8.h"
@@ -22,36 +24,29 @@ public:
 	WebSocketServer();
 	~WebSocketServer();
 
-	int Init(int port);
-	int Start();
+	int Init(int port,DWORD threads = 0);
 	void AddHandler(const std::string base,Handler* hnd);
-	int Stop();
 	int End();
 
 	virtual void onUpgradeRequest(WebSocketConnection* conn);
-	virtual void onDisconnected(WebSocketConnection* conn);
-		
-public:
-        int Run();
+	virtual void onDisconnected(const WebSocketConnection::shared& conn);
 
+	//Max number of reactor threads used by default
+	static constexpr DWORD MaxDefaultThreads = ReactorServer::MaxDefaultThreads;
 private:
 	typedef std::map<std::string,Handler *> Handlers;
-	typedef std::list<WebSocketConnection*>	Connections;
-
-        static void * run(void *par);
+	typedef std::set<WebSocketConnection::shared> Connections;
 
-	void CreateConnection(int fd);
-	void CleanZombies();
+	void CreateConnection(int fd,EpollReactor* reactor);
+	void DeleteAllConnections();
 
 private:
 	int inited;
-	int serverPort;
-	int server;
+	ReactorServer listener;
 
 	Handlers handlers;
-	Connections zombies;
-	pthread_t serverThread;
-	pthread_mutex_t	sessionMutex;
+	Connections connections;
+	std::mutex mutex;
 };
 
 
@@ -2,6 +2,7 @@
 #define _XMLHANDLER_H_
 #include <xmlrpc.h>
 #include "xmlrpcserver.h"
+#include "HTTPServer.h"
 
 xmlrpc_value* xmlerror (xmlrpc_env *env,const char *msg);
 xmlrpc_value* xmlok (xmlrpc_env *env,xmlrpc_value *array=NULL);
@@ -13,7 +14,8 @@ struct XmlHandlerCmd
 };
 
 class XmlHandler :
-	public Handler
+	public Handler,
+	public HTTPServer::Handler
 {
 public:
 	XmlHandler();
@@ -21,6 +23,11 @@ public:
 	~XmlHandler();
 	virtual int AddMethod(const char *name,xmlrpc_method method,void *user_data);
 	virtual int ProcessRequest(TRequestInfo *req,TSession * const ses);
+	//HTTPServer handler, requests for the same conference are processed in order
+	virtual QWORD GetOrderingKey(const HTTPRequestParser::Request& request) override;
+	virtual void ProcessRequest(const HTTPRequestParser::Request& request, HTTPServer::Response& response) override;
+private:
+	xmlrpc_mem_block* ProcessCall(xmlrpc_env *env,const char* buffer,size_t len);
 private:
 	xmlrpc_registry *registry;
 };
@@ -38,8 +38,13 @@ void ActiveSpeakerMultiplexer::Stop()
 
 		//Release incoming sources
 		for (const auto& [incoming,source] : sources)
+		{
 			//Remove listener
 			incoming->RemoveListener(this);
+			//Stop silence gate
+			if (source.gate)
+				source.gate->Stop();
+		}
 		//Clear sources
 		sources.clear();
 	});
@@ -75,6 +80,28 @@ void ActiveSpeakerMultiplexer::RemoveRTPStreamTransponder(RTPStreamTransponder*
 	});
 }
 
+bool ActiveSpeakerMultiplexer::SetSilenceGating(bool silenceGating)
+{
+	Debug("-ActiveSpeakerMultiplexer::SetSilenceGating() [silenceGating:%d]\n", silenceGating);
+
+	bool res = false;
+
+	timeService.Sync([&](const auto& now){
+		//Gates are created when the sources are added
+		if (!sources.empty())
+			return;
+		//Set it
+		this->silenceGating = silenceGating;
+		res = true;
+	});
+
+	//Check
+	if (!res)
+		return Error("-ActiveSpeakerMultiplexer::SetSilenceGating() | sources already added, ignoring it [silenceGating:%d]\n", silenceGating);
+
+	return true;
+}
+
 void ActiveSpeakerMultiplexer::AddIncomingSourceGroup(RTPIncomingMediaStream::shared incoming, uint32_t id)
 {
 	Debug("-ActiveSpeakerMultiplexer::AddIncomingSourceGroup() [incoming:%p,id:%d]\n", incoming, id);
@@ -91,6 +118,15 @@ void ActiveSpeakerMultiplexer::AddIncomingSourceGroup(RTPIncomingMediaStream::sh
 			return;
 		//Add us as rtp listeners
 		incoming->AddListener(this);
+		//If only voice is forwarded
+		if (silenceGating)
+		{
+			//Drop the silence before it is fanned out to the transponders
+			auto& source = it->second;
+			source.gate = std::make_shared<RTPIncomingMediaStreamSilenceGate>(incoming, timeService);
+			source.gate->SetThreshold(noiseGatingThreshold ? noiseGatingThreshold : 127);
+			source.forwarded = source.gate;
+		}
 	});
 }
 
@@ -114,8 +150,9 @@ void ActiveSpeakerMultiplexer::RemoveIncomingSourceGroup(RTPIncomingMediaStream:
 		}
 		//Remove us from listeners
 		incoming->RemoveListener(this);
-		//Get source id
+		//Get source id and gate
 		auto sourceId = it->second.id;
+		auto gate = it->second.gate;
 		//Remove it
 		sources.erase(it);
 		//For each destination transpoder
@@ -136,7 +173,10 @@ void ActiveSpeakerMultiplexer::RemoveIncomingSourceGroup(RTPIncomingMediaStream:
 				Debug("-ActiveSpeakerMultiplexer::RemoveIncomingSourceGroup() | onActiveSpeakerRemoved [multiplexId:%d]\n", destination.id);
 			}
 		}
-		
+		//Stop silence gate once detached
+		if (gate)
+			gate->Stop();
+
 	});
 }
 
@@ -230,6 +270,9 @@ void ActiveSpeakerMultiplexer::onEnded(const RTPIncomingMediaStream* incoming)
 		}
 		//Get source id
 		auto sourceId = it->second.id;
+		//Stop silence gate, so the transponders attached to it get ended too
+		if (it->second.gate)
+			it->second.gate->Stop();
 		//Remove it
 		sources.erase(it);
 		//For each destination transpoder
@@ -261,8 +304,11 @@ void ActiveSpeakerMultiplexer::Process(uint64_t now)
 	//Reduce accumulated voice activity
 	uint64_t decay = diff * ScorePerMiliScond;
 
-	std::vector<Source*> candidates;
-	std::vector<Source*> top(destinations.size());
+	//Min heap by score with the best sources, no more than destinations available
+	auto byScore = [](const Source* a, const Source* b) { return a->score > b->score; };
+	std::vector<Source*> top;
+	top.reserve(destinations.size());
+	bool candidates = false;
 
 	//UltraDebug("-ActiveSpeakerMultiplexer::Process() [now:%llu]\n",now);
 
@@ -280,22 +326,37 @@ void ActiveSpeakerMultiplexer::Process(uint64_t now)
 		//UltraDebug("-ActiveSpeakerMultiplexer::Process() | part [id:%u,score:%llu,decay:%llu]\n",entry.first,entry.second.score,decay);
 
 		//Check if it is active speaker
-		if (entry.second.score>minActivationScore)
-			//Add to potential candidates
-			candidates.push_back(&(entry.second));
+		if (entry.second.score<=minActivationScore)
+			//Skip
+			continue;
+
+		//Got a potential candidate
+		candidates = true;
+
+		//If there is still room on the top ones
+		if (top.size()<destinations.size())
+		{
+			//Add it
+			top.push_back(&(entry.second));
+			std::push_heap(top.begin(), top.end(), byScore);
+		}
+		//If it is better than the worst of the top ones
+		else if (!top.empty() && entry.second.score>top.front()->score)
+		{
+			//Replace it
+			std::pop_heap(top.begin(), top.end(), byScore);
+			top.back() = &(entry.second);
+			std::push_heap(top.begin(), top.end(), byScore);
+		}
 	}
 
 	//If no candidadtes
-	if (candidates.empty())
+	if (!candidates)
 		//Done
 		return;
 
-	//for (auto source : candidates)
-	//	if (source)
-	//		Debug("-ActiveSpeakerMultiplexer::Process() | candidates [id:%d,score:%d]\n", source->id, source->score);
-
-	//Get top candidates by score
-	std::partial_sort_copy(candidates.begin(), candidates.end(), top.begin(), top.end());
+	//Get top candidates in descending score order
+	std::sort_heap(top.begin(), top.end(), byScore);
 	
 	//for (auto source : top)
 	//	if (source)
@@ -323,7 +384,7 @@ void ActiveSpeakerMultiplexer::Process(uint64_t now)
 					//Done
 					break;
 				//If is the attached source
-				if (source->incoming == incoming)
+				if (source->forwarded == incoming)
 				{
 					//Delete the source from the top ones
 					it = top.erase(it);
@@ -374,11 +435,12 @@ void ActiveSpeakerMultiplexer::Process(uint64_t now)
 		UltraDebug("-ActiveSpeakerMultiplexer::Process() | onActiveSpeakerChanged [sourceId:%d,multiplexId:%d]\n", sourceId, multiplexId);
 
 		//Attach them
-		destination->transponder->SetIncoming(source->incoming,nullptr);
-		//Send all pending packets
+		destination->transponder->SetIncoming(source->forwarded,nullptr);
+		//Send all pending packets, as forwarded by the gate if any so they are renumbered as the following ones
 		for (const auto& packet : source->packets)
-			//Send it
-			destination->transponder->onRTP(source->incoming.get(), packet);
+			if (auto forwarded = source->gate ? source->gate->GetForwarded(packet) : packet)
+				//Send it
+				destination->transponder->onRTP(source->forwarded.get(), forwarded);
 		//Event
 		listener->onActiveSpeakerChanged(sourceId, multiplexId);
 		//Set last multiplexed source and timestamp
@@ -0,0 +1,349 @@
+#include "AudioEngine.h"
+
+#include <pthread.h>
+#include <algorithm>
+#include <chrono>
+
+#include "log.h"
+#include "tools.h"
+
+//If we are more than this rounds late, don't try to catch up
+static constexpr DWORD MaxLateRounds = 5;
+
+DWORD AudioEngine::defaultNumThreads = 0;
+
+//Engine running on current thread, if any
+static thread_local AudioEngine* currentEngine = nullptr;
+//Task being run by current thread
+static thread_local std::atomic<AudioEngine::Task*>* currentTask = nullptr;
+
+AudioEngine::AudioEngine(const std::string& name) :
+	name(name)
+{
+}
+
+AudioEngine::~AudioEngine()
+{
+	//Stop just in case
+	Stop();
+}
+
+AudioEngine& AudioEngine::GetInstance()
+{
+	//Created and started on first use
+	static AudioEngine engine;
+	static bool started = engine.Start(defaultNumThreads);
+	(void)started;
+	return engine;
+}
+
+bool AudioEngine::Start(DWORD num, DWORD period)
+{
+	//Use one per core by default, up to max
+	if (!num)
+		num = std::min(std::max(std::thread::hardware_concurrency(),1u),MaxDefaultThreads);
+
+	Log("-AudioEngine::Start() [name:%s,threads:%u,period:%ums]\n",name.c_str(),num,period);
+
+	//Check not already running
+	if (running.exchange(true))
+		return Error("-AudioEngine::Start() | already running\n");
+
+	//Store period
+	this->period = period ? period : DefaultPeriod;
+
+	//One slot per thread for the task it is running
+	runningTasks = std::make_unique<std::atomic<Task*>[]>(num);
+	numRunningTasks = num;
+	for (DWORD i=0;i<num;++i)
+		runningTasks[i] = nullptr;
+
+	//First thread drives the rounds, the rest help running the tasks
+	for (DWORD i=0;i<num;++i)
+	{
+		auto slot = &runningTasks[i];
+		if (!i)
+			threads.emplace_back([this,slot](){ Run(slot); });
+		else
+			threads.emplace_back([this,slot](){ Help(slot); });
+		//Set name, limited to 15 chars
+		pthread_setname_np(threads.back().native_handle(),(name + "-" + std::to_string(i)).substr(0,15).c_str());
+	}
+
+	//Done
+	return true;
+}
+
+bool AudioEngine::Stop()
+{
+	//Check running
+	if (!running.exchange(false))
+		return false;
+
+	Log("-AudioEngine::Stop() [name:%s]\n",name.c_str());
+
+	//Wake up helpers
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cond.notify_all();
+	}
+
+	//Wait for them
+	for (auto& thread : threads)
+		thread.join();
+	threads.clear();
+
+	//Done
+	return true;
+}
+
+void AudioEngine::AddTask(Phase phase, Task* task)
+{
+	//Wait for round to finish
+	std::lock_guard<std::mutex> lock(tasksMutex);
+	//Add it
+	tasks[phase].push_back(task);
+}
+
+bool AudioEngine::RemoveTask(Phase phase, Task* task)
+{
+	//If called from a task, round is running and holding the lock
+	if (currentEngine==this)
+	{
+		//Task list is not modified during the round
+		const auto& list = tasks[phase];
+		//Check it is registered
+		if (std::find(list.begin(),list.end(),task)==list.end() || IsRemoved(task,phase))
+			return false;
+		//Skip it for the rest of the round, removed once it finishes
+		{
+			std::lock_guard<std::mutex> lock(removedMutex);
+			removed.emplace_back(phase,task);
+			numRemoved = removed.size();
+		}
+		//Wait for any run already in progress on other threads, unless it is removing itself
+		for (DWORD i=0;i<numRunningTasks;++i)
+			while (&runningTasks[i]!=currentTask && runningTasks[i]==task)
+				std::this_thread::yield();
+		//Done
+		return true;
+	}
+
+	//Wait for round to finish
+	std::lock_guard<std::mutex> lock(tasksMutex);
+	//Find it
+	auto& list = tasks[phase];
+	auto it = std::find(list.begin(),list.end(),task);
+	//If not found
+	if (it==list.end())
+		return false;
+	//Remove it
+	list.erase(it);
+	//Done
+	return true;
+}
+
+DWORD AudioEngine::GetNumTasks() const
+{
+	std::lock_guard<std::mutex> lock(tasksMutex);
+	DWORD num = 0;
+	for (DWORD i=0;i<NumPhases;++i)
+		num += tasks[i].size();
+	return num;
+}
+
+AudioEngine::Stats AudioEngine::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(statsMutex);
+	return stats;
+}
+
+void AudioEngine::Run(std::atomic<Task*>* slot)
+{
+	using namespace std::chrono;
+
+	Log(">AudioEngine::Run() [name:%s]\n",name.c_str());
+
+	//Tasks run on this thread
+	currentEngine = this;
+	currentTask = slot;
+
+	const auto step = milliseconds(period);
+	auto next = steady_clock::now();
+
+	while (running)
+	{
+		//Wait for next round
+		next += step;
+		std::this_thread::sleep_until(next);
+
+		//Check if we have been stopped meanwhile
+		if (!running)
+			break;
+
+		auto ini = steady_clock::now();
+		QWORD now = getTime();
+
+		//Run each phase one after the other
+		{
+			std::lock_guard<std::mutex> lock(tasksMutex);
+			for (DWORD i=0;i<NumPhases;++i)
+				RunPhase(tasks[i],(Phase)i,now);
+			//Drop tasks removed during the round
+			PurgeRemoved();
+		}
+
+		auto end = steady_clock::now();
+
+		std::lock_guard<std::mutex> lock(statsMutex);
+		//Update stats
+		stats.rounds++;
+		stats.lastRoundTime = duration_cast<microseconds>(end-ini).count();
+		stats.maxRoundTime = std::max(stats.maxRoundTime,stats.lastRoundTime);
+
+		//Check if next round was already due
+		if (end>next+step)
+		{
+			//Missed deadline
+			stats.missed++;
+			//If too late
+			if (end>next+step*MaxLateRounds)
+			{
+				//Skip rounds and restart from now
+				stats.skipped += (end-next)/step;
+				next = end;
+				Warning("-AudioEngine::Run() | too late, skipping rounds [name:%s,roundTime:%lluus,skipped:%llu]\n",name.c_str(),stats.lastRoundTime,stats.skipped);
+			}
+		}
+	}
+
+	Log("<AudioEngine::Run() [name:%s]\n",name.c_str());
+}
+
+void AudioEngine::RunPhase(std::vector<Task*>& list, Phase phase, QWORD now)
+{
+	//Nothing to do
+	if (list.empty())
+		return;
+
+	//If we have no helpers or there is only one task
+	if (threads.size()==1 || list.size()==1)
+	{
+		//Run them here
+		for (auto task : list)
+			Tick(task,phase,now);
+		//Done
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		//Wait for any late helper from previous phase to leave
+		done.wait(lock,[this](){ return !active; });
+		//Set new phase
+		current = &list;
+		currentPhase = phase;
+		currentTime = now;
+		next = 0;
+		remaining = list.size();
+		generation++;
+	}
+
+	//Wake up helpers
+	cond.notify_all();
+
+	//Run tasks here too
+	Work(&list,phase,now);
+
+	//Wait for all tasks to be run and helpers to leave
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock,[this](){ return !remaining && !active; });
+	current = nullptr;
+}
+
+void AudioEngine::Work(std::vector<Task*>* list, Phase phase, QWORD now)
+{
+	size_t i;
+	//Get next task not taken by other thread
+	while ((i = next.fetch_add(1))<list->size())
+	{
+		//Run it
+		Tick((*list)[i],phase,now);
+		//If it was the last one
+		if (remaining.fetch_sub(1)==1)
+		{
+			//Signal phase is done
+			std::lock_guard<std::mutex> lock(mutex);
+			done.notify_all();
+		}
+	}
+}
+
+void AudioEngine::Tick(Task* task, Phase phase, QWORD now)
+{
+	//Set it as running before checking if it is removed, so RemoveTask either waits for it or we skip it
+	currentTask->store(task);
+	//Skip tasks removed during this round
+	if (!numRemoved || !IsRemoved(task,phase))
+		//Run it
+		task->OnTick(phase,now);
+	//Not running anymore
+	currentTask->store(nullptr);
+}
+
+bool AudioEngine::IsRemoved(Task* task, Phase phase)
+{
+	std::lock_guard<std::mutex> lock(removedMutex);
+	return std::find(removed.begin(),removed.end(),std::make_pair(phase,task))!=removed.end();
+}
+
+void AudioEngine::PurgeRemoved()
+{
+	std::lock_guard<std::mutex> lock(removedMutex);
+	//Remove them from their phase
+	for (const auto& [phase,task] : removed)
+	{
+		auto& list = tasks[phase];
+		list.erase(std::remove(list.begin(),list.end(),task),list.end());
+	}
+	removed.clear();
+	numRemoved = 0;
+}
+
+void AudioEngine::Help(std::atomic<Task*>* slot)
+{
+	QWORD seen = 0;
+
+	//Tasks run on this thread
+	currentEngine = this;
+	currentTask = slot;
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true)
+	{
+		//Wait for a new phase
+		cond.wait(lock,[&](){ return (current && generation!=seen) || !running; });
+
+		//Exit if stopped
+		if (!running)
+			break;
+
+		//Get phase
+		seen = generation;
+		auto list = current;
+		auto phase = currentPhase;
+		auto now = currentTime;
+
+		//Run tasks without lock
+		active++;
+		lock.unlock();
+		Work(list,phase,now);
+		lock.lock();
+		active--;
+
+		//Signal we have left
+		if (!active)
+			done.notify_all();
+	}
+}
@@ -0,0 +1,203 @@
+#include "AudioResampleStage.h"
+#include <cmath>
+#include <emmintrin.h>
+#include "log.h"
+
+AudioResampleStage::Conversion::Conversion(SpeexResamplerState* resampler) :
+	resampler(resampler,mcu_resampler_destroy)
+{
+}
+
+AudioResampleStage::AudioResampleStage(int quality) :
+	quality(quality)
+{
+}
+
+void AudioResampleStage::Tick()
+{
+	//Next one
+	tick++;
+
+	//Remove the resamplers not used for a while, so their history does not get stale
+	for (auto it = conversions.begin(); it!=conversions.end(); )
+	{
+		if (tick-it->second.tick>MaxIdleTicks)
+			it = conversions.erase(it);
+		else
+			++it;
+	}
+	//And the sources
+	for (auto it = inputs.begin(); it!=inputs.end(); )
+	{
+		if (tick-it->second.tick>MaxIdleTicks)
+			it = inputs.erase(it);
+		else
+			++it;
+	}
+}
+
+void AudioResampleStage::ToFloat(const SWORD* in, float* out, DWORD num)
+{
+	DWORD i = 0;
+
+	//8 samples each time
+	for (; i+8<=num; i+=8)
+	{
+		__m128i samples = _mm_loadu_si128((const __m128i*)(in+i));
+		//Sign extend to 32 bits
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(samples,samples),16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(samples,samples),16);
+		_mm_storeu_ps(out+i,  _mm_cvtepi32_ps(lo));
+		_mm_storeu_ps(out+i+4,_mm_cvtepi32_ps(hi));
+	}
+	//Rest
+	for (; i<num; ++i)
+		out[i] = in[i];
+}
+
+void AudioResampleStage::ToInt16(const float* in, SWORD* out, DWORD num)
+{
+	DWORD i = 0;
+
+	//8 samples each time, rounding to nearest and saturating
+	for (; i+8<=num; i+=8)
+	{
+		__m128i lo = _mm_cvtps_epi32(_mm_loadu_ps(in+i));
+		__m128i hi = _mm_cvtps_epi32(_mm_loadu_ps(in+i+4));
+		_mm_storeu_si128((__m128i*)(out+i),_mm_packs_epi32(lo,hi));
+	}
+	//Rest
+	for (; i<num; ++i)
+	{
+		float sample = in[i];
+		out[i] = sample < -32768.0f ? -32768 : sample > 32767.0f ? 32767 : (SWORD)lrintf(sample);
+	}
+}
+
+const float* AudioResampleStage::GetInput(const void* source, const SWORD* samples, DWORD len)
+{
+	auto& input = inputs[source];
+
+	//If not already converted on this tick
+	if (input.tick!=tick)
+	{
+		//Convert once for all the output rates
+		input.samples.resize(len);
+		ToFloat(samples,input.samples.data(),len);
+		input.tick = tick;
+	}
+
+	return input.samples.data();
+}
+
+AudioResampleStage::Conversion* AudioResampleStage::Process(const void* source, const SWORD* samples, DWORD num, DWORD inputRate, DWORD outputRate, DWORD numChannels)
+{
+	//Check rates
+	if (!inputRate || !outputRate || !numChannels)
+	{
+		Error("-AudioResampleStage::Process() | Sample rates not correct [in:%u,out:%u,channels:%u]\n",inputRate,outputRate,numChannels);
+		return nullptr;
+	}
+
+	Key key{source,inputRate,outputRate,numChannels};
+
+	//Find resampler
+	auto it = conversions.find(key);
+
+	//If not found
+	if (it==conversions.end())
+	{
+		int err = 0;
+		//Create new one
+		auto resampler = mcu_resampler_init(numChannels, inputRate, outputRate, quality, &err);
+		//Check error
+		if (err || !resampler)
+		{
+			Error("-AudioResampleStage::Process() | Failed to init speex resampler [err:%d]\n",err);
+			return nullptr;
+		}
+		Debug("-AudioResampleStage::Process() | New resampler [in:%u,out:%u,channels:%u]\n",inputRate,outputRate,numChannels);
+		it = conversions.emplace(key,resampler).first;
+	}
+
+	auto& conversion = it->second;
+
+	//If already done on this tick
+	if (conversion.tick==tick)
+	{
+		stats.shared++;
+		return &conversion;
+	}
+
+	//Get input in float
+	const float* in = GetInput(source,samples,num*numChannels);
+
+	//Max output size, with room for the fractional delay of the filter
+	spx_uint32_t inLen = num;
+	spx_uint32_t outLen = (QWORD)num*outputRate/inputRate + 16;
+	conversion.output.resize(outLen*numChannels);
+
+	//Resample
+	int err = mcu_resampler_process_interleaved_float(conversion.resampler.get(), in, &inLen, conversion.output.data(), &outLen);
+
+	//Check error
+	if (err)
+	{
+		Error("-AudioResampleStage::Process() | Resampling error [err:%d]\n",err);
+		return nullptr;
+	}
+
+	//Done
+	conversion.num = outLen;
+	conversion.tick = tick;
+	conversion.int16 = false;
+	stats.conversions++;
+
+	return &conversion;
+}
+
+const float* AudioResampleStage::ConvertFloat(const void* source, const SWORD* samples, DWORD num, DWORD inputRate, DWORD outputRate, DWORD* outputNum, DWORD numChannels)
+{
+	//If no conversion needed
+	if (inputRate==outputRate)
+	{
+		*outputNum = num;
+		return GetInput(source,samples,num*numChannels);
+	}
+
+	//Convert
+	auto conversion = Process(source,samples,num,inputRate,outputRate,numChannels);
+	//Check
+	if (!conversion)
+		return nullptr;
+
+	*outputNum = conversion->num;
+	return conversion->output.data();
+}
+
+const SWORD* AudioResampleStage::Convert(const void* source, const SWORD* samples, DWORD num, DWORD inputRate, DWORD outputRate, DWORD* outputNum, DWORD numChannels)
+{
+	//If no conversion needed
+	if (inputRate==outputRate)
+	{
+		*outputNum = num;
+		return samples;
+	}
+
+	//Convert
+	auto conversion = Process(source,samples,num,inputRate,outputRate,numChannels);
+	//Check
+	if (!conversion)
+		return nullptr;
+
+	//Convert back to int16 only once too
+	if (!conversion->int16)
+	{
+		conversion->converted.resize(conversion->num*numChannels);
+		ToInt16(conversion->output.data(),conversion->converted.data(),conversion->num*numChannels);
+		conversion->int16 = true;
+	}
+
+	*outputNum = conversion->num;
+	return conversion->converted.data();
+}
@@ -6,6 +6,10 @@
  */
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <dirent.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 
 #include "CPUMonitor.h"
 
@@ -72,13 +76,75 @@ void * CPUMonitor::run(void *par)
 	return NULL;
 }
 
+std::map<pid_t,CPUMonitor::ThreadTimes> CPUMonitor::GetThreadTimes()
+{
+	std::map<pid_t,ThreadTimes> threads;
+	
+	//Open threads dir
+	DIR* dir = opendir("/proc/self/task");
+	//Check
+	if (!dir)
+		//Nothing
+		return threads;
+	
+	//For each thread
+	while (struct dirent* entry = readdir(dir))
+	{
+		//Get thread id
+		pid_t tid = atoi(entry->d_name);
+		//Skip . and ..
+		if (!tid)
+			continue;
+		//Read stat line
+		std::ifstream file("/proc/self/task/" + std::string(entry->d_name) + "/stat");
+		std::string line;
+		if (!std::getline(file, line))
+			continue;
+		//Name is enclosed in parenthesis and may contain spaces
+		auto start = line.find('(');
+		auto end = line.rfind(')');
+		if (start == std::string::npos || end == std::string::npos || end < start)
+			continue;
+		//Get fields after name, starting on field 3 (state)
+		std::istringstream fields(line.substr(end + 2));
+		std::string field;
+		QWORD utime = 0;
+		QWORD stime = 0;
+		//utime and stime are fields 14 and 15
+		for (int i = 3; i <= 15 && fields >> field; ++i)
+		{
+			if (i == 14) utime = std::stoull(field);
+			if (i == 15) stime = std::stoull(field);
+		}
+		//Store it
+		threads[tid] = ThreadTimes{line.substr(start + 1, end - start - 1), utime, stime};
+	}
+	
+	//Close dir
+	closedir(dir);
+	
+	return threads;
+}
+
 int CPUMonitor::Run()
 {
 	rusage prev;
 	rusage next;
 	timeval before = {};
+	//Clock ticks per second used in thread times
+	QWORD ticks = sysconf(_SC_CLK_TCK);
 	//Get previous measure
 	getrusage(RUSAGE_SELF,&prev);
+	//Get previous thread times
+	auto prevThreads = GetThreadTimes();
+	//Get previous loop counters
+	std::map<pid_t,EventLoop::Stats> prevLoops;
+	for (const auto& stats : EventLoop::GetRunningStats())
+		prevLoops[stats.tid] = stats;
+	//Get previous video worker counters
+	std::map<QWORD,VideoWorkerPool::Stats> prevWorkers;
+	for (const auto& stats : VideoWorkerPool::GetRunningStats())
+		prevWorkers[stats.id] = stats;
 	//Get current time
 	getUpdDifTime(&before);
 	//While not stopped
@@ -103,6 +169,128 @@ int CPUMonitor::Run()
 		for(Listeners::iterator it = listeners.begin(); it!=listeners.end(); ++it)
 			//call it
 			(*it)->onCPULoad(user,sys,load,numcpu);
+		
+		//Process wide load
+		Load current;
+		current.user	= user;
+		current.sys	= sys;
+		current.load	= load;
+		current.numcpu	= numcpu;
+		
+		//Get current thread times
+		auto threads = GetThreadTimes();
+		//For each thread
+		for (const auto& [tid,times] : threads)
+		{
+			//Get previous
+			auto it = prevThreads.find(tid);
+			//Skip threads created on this interval
+			if (it == prevThreads.end())
+				continue;
+			//Get used time in us
+			QWORD threadUser = (times.user - it->second.user) * 1000000 / ticks;
+			QWORD threadSys  = (times.sys - it->second.sys) * 1000000 / ticks;
+			//Add it
+			current.threads.push_back(ThreadLoad{
+				tid,
+				times.name,
+				(int)(threadUser*100/diff),
+				(int)(threadSys*100/diff),
+				(int)((threadUser+threadSys)*100/diff)
+			});
+		}
+		
+		//Get current loop counters
+		std::map<pid_t,EventLoop::Stats> loops;
+		for (const auto& stats : EventLoop::GetRunningStats())
+			loops[stats.tid] = stats;
+		//For each running loop
+		for (const auto& [tid,stats] : loops)
+		{
+			//Get previous counters, or start from scratch if it has just started
+			auto it = prevLoops.find(tid);
+			EventLoop::Stats prevStats = it != prevLoops.end() ? it->second : EventLoop::Stats{};
+			//Get busy and waiting time on this interval
+			QWORD busy = stats.busyTime - prevStats.busyTime;
+			QWORD wait = stats.waitTime - prevStats.waitTime;
+			//Get thread
+			auto thread = threads.find(tid);
+			//Get thread load
+			auto threadLoad = std::find_if(current.threads.begin(), current.threads.end(), [tid=tid](const auto& threadLoad){ return threadLoad.tid == tid; });
+			//Add it
+			current.loops.push_back(LoopLoad{
+				tid,
+				thread != threads.end() ? thread->second.name : std::string(),
+				threadLoad != current.threads.end() ? threadLoad->load : 0,
+				busy + wait ? (int)(busy*100/(busy+wait)) : 0,
+				stats.iterations - prevStats.iterations,
+				stats.tasks - prevStats.tasks,
+				stats.timers - prevStats.timers,
+				stats.sendQueueSize,
+				stats.state,
+				stats.laggingTransitions - prevStats.laggingTransitions,
+				stats.overflownTransitions - prevStats.overflownTransitions
+			});
+			//Debug
+			Debug("-CPUMonitor::Run() | Loop usage [tid:%d,name:%s,load:%d,utilization:%d,iterations:%llu,tasks:%llu,timers:%llu,queue:%zu,state:%d]\n",
+				tid,
+				current.loops.back().name.c_str(),
+				current.loops.back().load,
+				current.loops.back().utilization,
+				current.loops.back().iterations,
+				current.loops.back().tasks,
+				current.loops.back().timers,
+				current.loops.back().sendQueueSize,
+				current.loops.back().state
+			);
+		}
+		
+		//Get current video worker counters
+		std::map<QWORD,VideoWorkerPool::Stats> workers;
+		for (const auto& stats : VideoWorkerPool::GetRunningStats())
+			workers[stats.id] = stats;
+		//For each one
+		for (const auto& [id,stats] : workers)
+		{
+			//Get previous counters, or start from scratch if it has just been created
+			auto it = prevWorkers.find(id);
+			VideoWorkerPool::Stats prevStats = it != prevWorkers.end() ? it->second : VideoWorkerPool::Stats{};
+			//Add it
+			current.workers.push_back(WorkerLoad{
+				id,
+				stats.pool,
+				stats.name,
+				(int)((stats.busyTime - prevStats.busyTime)*100/diff),
+				stats.tasks - prevStats.tasks,
+				stats.missed - prevStats.missed,
+				stats.maxLateness,
+				stats.pending,
+				stats.codecThreads,
+				stats.cpu
+			});
+			//Debug
+			Debug("-CPUMonitor::Run() | Video worker usage [id:%llu,pool:%s,name:%s,load:%d,tasks:%llu,missed:%llu,pending:%zu,codecThreads:%u,cpu:%d]\n",
+				id,
+				stats.pool.c_str(),
+				stats.name.c_str(),
+				current.workers.back().load,
+				current.workers.back().tasks,
+				current.workers.back().missed,
+				stats.pending,
+				stats.codecThreads,
+				stats.cpu
+			);
+		}
+		
+		//Store for next interval
+		prevThreads = std::move(threads);
+		prevLoops = std::move(loops);
+		prevWorkers = std::move(workers);
+		
+		//Call listeners
+		for (auto listener : listeners)
+			//call it
+			listener->onLoad(current);
 	}
 
 	return 0;
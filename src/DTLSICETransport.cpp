@@ -49,6 +49,7 @@ constexpr auto TransportWideCCMaxPackets	= 100;
 constexpr auto TransportWideCCMaxInterval	= 5E4;	//50ms
 constexpr auto MaxProbingHistorySize		= 50;
 constexpr auto RtxRttThresholdMs 		= 300;
+constexpr auto StatsPublishInterval		= 1000ms;
 
 DTLSICETransport::DTLSICETransport(Sender *sender,TimeService& timeService, ObjectPool<Packet>& packetPool) :
 	sender(sender),
@@ -1501,6 +1502,8 @@ void DTLSICETransport::Reset()
 		iceLocalPwd.clear();
 		iceRemoteUsername.clear();
 		iceRemotePwd.clear();
+		iceLocalKey.Reset();
+		iceRemoteKey.Reset();
 		dumper = NULL;
 		dumpInRTP = false;
 		dumpOutRTP = false;
@@ -1527,6 +1530,8 @@ int DTLSICETransport::SetLocalSTUNCredentials(const char* username, const char*
 	//Store values
 	iceLocalUsername = username;
 	iceLocalPwd = pwd;
+	//Precompute hmac key for connectivity checks
+	iceLocalKey.Set(pwd);
 	//Ok
 	return 1;
 }
@@ -1539,6 +1544,8 @@ int DTLSICETransport::SetRemoteSTUNCredentials(const char* username, const char*
 	//Store values
 	iceRemoteUsername = username;
 	iceRemotePwd = pwd;
+	//Precompute hmac key for connectivity checks
+	iceRemoteKey.Set(pwd);
 	//Ok
 	return 1;
 }
@@ -2097,6 +2104,10 @@ int DTLSICETransport::Send(const RTPPacket::shared& packet)
 	//Get time
 	auto now = getTime();
 	
+	//Update latency since packet was received or created
+	if (now/1000>=packet->GetTime())
+		receiveToSendLatency.Record(now - packet->GetTime()*1000);
+	
 	//If we are using abs send time for sending
 	if (sendMaps.ext.GetTypeForCodec(RTPHeaderExtension::AbsoluteSendTime)!=RTPMap::NotFound)
 		//Set abs send time
@@ -2169,7 +2180,9 @@ int DTLSICETransport::Send(const RTPPacket::shared& packet)
 	}
 
 	//Encript
+	QWORD protecting = getTime();
 	len = send.ProtectRTP(data,len);
+	srtpProtectLatency.Record(getTime() - protecting);
 	
 	//Check error
 	if (!len)
@@ -2422,6 +2435,8 @@ void DTLSICETransport::onRTCP(const RTCPCompoundPacket::shared& rtcp)
 							//Ups! Skip
 							break;
 						}
+						//One more nack received
+						group->media.totalNACKs++;
 						for (DWORD i = 0; i < fb->GetFieldCount(); i++)
 						{
 							//Get field
@@ -2492,6 +2507,8 @@ void DTLSICETransport::onRTCP(const RTCPCompoundPacket::shared& rtcp)
 							//Ups! Skip
 							continue;
 						}
+						//One more pli received
+						group->media.totalPLIs++;
 						//Call listeners
 						group->onPLIRequest(ssrc);
 						break;
@@ -2692,6 +2709,48 @@ void DTLSICETransport::SendTransportWideFeedbackMessage(DWORD ssrc)
 	Send(rtcp);
 }
 
+void DTLSICETransport::PublishStats(QWORD now)
+{
+	TRACE_EVENT("transport", "DTLSICETransport::PublishStats");
+
+	std::set<RTPIncomingSourceGroup*> incomingGroups;
+	std::set<RTPOutgoingSourceGroup*> outgoingGroups;
+
+	//Groups are registered once per ssrc
+	for (const auto& [ssrc,group] : incoming)
+		incomingGroups.insert(group);
+	for (const auto& [rid,group] : rids)
+		incomingGroups.insert(group);
+	for (const auto& [ssrc,group] : outgoing)
+		outgoingGroups.insert(group);
+
+	//Update and publish each group
+	for (auto group : incomingGroups)
+		group->UpdateStats(now);
+	for (auto group : outgoingGroups)
+		group->UpdateStats(now);
+
+	//Update bitrates
+	outgoingBitrate.Update(now);
+	rtxBitrate.Update(now);
+	probingBitrate.Update(now);
+
+	StatsSnapshot snapshot;
+
+	snapshot.kind			= StatsSnapshot::Transport;
+	snprintf(snapshot.id, sizeof(snapshot.id), "%s", iceLocalUsername.c_str());
+	snapshot.timestamp		= now;
+	snapshot.bitrate		= static_cast<uint32_t>(outgoingBitrate.GetInstantAvg()*8);
+	snapshot.rtxBitrate		= static_cast<uint32_t>(rtxBitrate.GetInstantAvg()*8);
+	snapshot.probingBitrate		= static_cast<uint32_t>(probingBitrate.GetInstantAvg()*8);
+	snapshot.rtt			= rtt;
+	snapshot.estimatedBitrate	= senderSideBandwidthEstimator->GetEstimatedBitrate();
+	snapshot.availableBitrate	= senderSideBandwidthEstimator->GetAvailableBitrate();
+
+	//Readers will get it without going through the loop
+	statsPublisher.Publish(snapshot);
+}
+
 void DTLSICETransport::Start()
 {
 	TRACE_EVENT("transport", "DTLSICETransport::Start");
@@ -2730,6 +2789,13 @@ void DTLSICETransport::Start()
 	});
 	//Set name for debug
 	sseTimer->SetName("DTLSICETransport - twcc feedback");
+	//Create stats timer
+	statsTimer = timeService.CreateTimer(StatsPublishInterval, StatsPublishInterval, [this](std::chrono::milliseconds ms) {
+		//Publish stats snapshots
+		PublishStats(ms.count());
+	});
+	//Set name for debug
+	statsTimer->SetName("DTLSICETransport - stats");
 	//Start
 	endpoint.Init(dcOptions);
 	//Started
@@ -2768,6 +2834,15 @@ void DTLSICETransport::Stop()
 		//Stop probing
 		iceTimeoutTimer->Cancel();
 
+	//Check stats timer
+	if (statsTimer)
+	{
+		//Stop publishing
+		statsTimer->Cancel();
+		//Remove timer
+		statsTimer.reset();
+	}
+
 	//Stop
 	endpoint.Close();
 
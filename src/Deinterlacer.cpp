@@ -212,6 +212,14 @@ VideoBuffer::shared Deinterlacer::GetNextFrame()
         //Get new frame
         auto videoBuffer = videoBufferPool.allocate();
 
+        //Check we got one
+        if (!videoBuffer)
+        {
+                //Release frame
+                av_frame_free(&output);
+                return nullptr;
+        }
+
         //Set color range
         switch (output->color_range)
         {
@@ -2,7 +2,6 @@
 
 #include "DependencyDescriptorLayerSelector.h"
 
-constexpr uint32_t NoChain		= std::numeric_limits<uint32_t>::max();
 constexpr uint32_t NoDecodeTarget	= std::numeric_limits<uint32_t>::max();
 constexpr uint64_t NoFrame		= std::numeric_limits<uint64_t>::max();
 	
@@ -85,11 +84,17 @@ bool DependencyDescriptorLayerSelector::Select(const RTPPacket::shared& packet,b
 		//Skip
 		return Warning("-DependencyDescriptorLayerSelector::Select() | Current frame dependency templates don't contain reference templateId [id:%d]\n",dependencyDescriptor->frameDependencyTemplateId);
 	
+	//Get template index
+	auto templateIndex = dependencyDescriptor->frameDependencyTemplateId - templateDependencyStructure->templateIdOffset;
+	
 	//Get template
-	const auto& frameDependencyTemplate = templateDependencyStructure->GetFrameDependencyTemplate(dependencyDescriptor->frameDependencyTemplateId);
+	const auto& frameDependencyTemplate = templateDependencyStructure->frameDependencyTemplates[templateIndex];
+	
+	//Get decode targets in which the current frame is present and the ones it is a switch point for
+	uint32_t presentDecodeTargets	= dependencyDescriptor->customDecodeTargetIndications	? DependencyDescriptor::GetDecodeTargetsMask(*dependencyDescriptor->customDecodeTargetIndications)	: templateDependencyStructure->templateDecodeTargetsMask[templateIndex];
+	uint32_t switchDecodeTargets	= dependencyDescriptor->customDecodeTargetIndications	? DependencyDescriptor::GetDecodeTargetsMask(*dependencyDescriptor->customDecodeTargetIndications,true) : templateDependencyStructure->templateSwitchMask[templateIndex];
 	
-	//Get dtis for current frame
-	const auto& decodeTargetIndications	= dependencyDescriptor->customDecodeTargetIndications	? dependencyDescriptor->customDecodeTargetIndications.value()	: frameDependencyTemplate.decodeTargetIndications; 
+	//Get frame diffs for current frame
 	const auto& frameDiffs			= dependencyDescriptor->customFrameDiffs		? dependencyDescriptor->customFrameDiffs.value()		: frameDependencyTemplate.frameDiffs;
 	const auto& frameDiffsChains		= dependencyDescriptor->customFrameDiffsChains		? dependencyDescriptor->customFrameDiffsChains.value()		: frameDependencyTemplate.frameDiffsChains;
 	
@@ -116,114 +121,105 @@ bool DependencyDescriptorLayerSelector::Select(const RTPPacket::shared& packet,b
 			decodable = forwardedFrames.Contains(referencedFrame);
 	}
 	
-	//No chain or decode target yet
-	[[maybe_unused]] auto topChain		 = NoChain;
-	[[maybe_unused]] auto currentChain	 = NoChain;
-	auto topLayer		 = LayerInfo::NoLayer;
-	auto currentLayer	 = LayerInfo::NoLayer;
-	auto currentDecodeTarget = NoDecodeTarget;
-
-	//Log
-	//UltraDebug("-DependencyDescriptorLayerSelector::Select() | frame [number=%llu,decodable=%d,ts:%lu,mark:%d]\n", extFrameNum, decodable, packet->GetTimestamp(),packet->GetMark());
+	//If the structure or the layer selection has changed
+	if (templateDependencyStructure!=this->templateDependencyStructure || spatialLayerId!=selectedSpatialLayerId || temporalLayerId!=selectedTemporalLayerId)
+		//Recalculate allowed decode targets
+		UpdateSelectedDecodeTargets(templateDependencyStructure);
+	
+	//Get all decode targets
+	uint32_t allDecodeTargets = templateDependencyStructure->GetAllDecodeTargetsMask();
+	//Get active ones
+	uint32_t active = activeDecodeTargets ? *activeDecodeTargets & allDecodeTargets : allDecodeTargets;
+	
+	//If we are disabling any decode target due to content adaptation
+	if (selectedDecodeTargets!=allDecodeTargets)
+		//Override the active decode target mask
+		forwardedDecodeTargets = active & selectedDecodeTargets;
+	else
+		//Do not override it
+		forwardedDecodeTargets.reset();
 	
-	//If we are doing content adaptation
-	if (spatialLayerId!=LayerInfo::MaxLayerId || temporalLayerId!=LayerInfo::MaxLayerId)
+	//Decode targets that can be forwarded
+	uint32_t candidates = active & selectedDecodeTargets;
+	//Decode targets without chain info or which chain is broken
+	uint32_t unprotected = 0;
+	uint32_t broken = 0;
+	
+	//If we have chain info
+	if (!templateDependencyStructure->decodeTargetProtectedByChain.empty())
 	{
-		//If we have active decode target info
-		if (activeDecodeTargets)
+		//None is protected until checked
+		unprotected = allDecodeTargets;
+		//For each chain
+		for (size_t chain=0; chain<templateDependencyStructure->chainDecodeTargetsMask.size(); ++chain)
 		{
-			//Copy it
-			forwardedDecodeTargets = activeDecodeTargets;
-		} else {
-			//Create it
-			forwardedDecodeTargets.emplace(templateDependencyStructure->dtsCount);
-			//All layers are active
-			std::fill(forwardedDecodeTargets->begin(), forwardedDecodeTargets->end(), true);
+			//Get decode targets protected by this chain
+			uint32_t protectedDecodeTargets = templateDependencyStructure->chainDecodeTargetsMask[chain];
+			//They have chain info
+			unprotected &= ~protectedDecodeTargets;
+			//If we are not interested in them
+			if (!(candidates & protectedDecodeTargets))
+				//Skip
+				continue;
+			//If the packet does not report this chain
+			if (chain>=frameDiffsChains.size())
+			{
+				//We can't know if it is broken, so don't trust it
+				broken |= protectedDecodeTargets;
+				//Next
+				continue;
+			}
+			//Get previous frame numner in chain
+			auto prevFrameInChain = extFrameNum - frameDiffsChains[chain];
+			//If it is not us, check if previus frame was not sent
+			if (prevFrameInChain &&
+			    prevFrameInChain!=extFrameNum &&
+			    !forwardedFrames.Contains(prevFrameInChain))
+				//Chain is broken
+				broken |= protectedDecodeTargets;
 		}
 	}
 	
-	//Check if we really need to override the active decode target mask
-	bool needsForwardedDecodeTargets = false;
+	//Top most decode target with chain info and the best one we can forward
+	auto topDecodeTarget	= NoDecodeTarget;
+	auto decodeTarget	= NoDecodeTarget;
 	
-	//Seach best layer target for this spatial and temporal layer
-	for (auto& [decodeTarget,layerInfo] : templateDependencyStructure->decodeTargetLayerMapping)
+	//Seach best decode target in descending layer order
+	for (const auto& [dt,layerInfo] : templateDependencyStructure->decodeTargetLayerMapping)
 	{
-		//Debug
-		//UltraDebug("-DependencyDescriptorLayerSelector::Select() | Trying decode target [dt:%llu,layer:layer:S%dL%d,active:%d]\n",
-		//	decodeTarget,
-		//	layerInfo.spatialLayerId,
-		//	layerInfo.temporalLayerId,
-		//	!activeDecodeTargets || (*activeDecodeTargets)[decodeTarget]
-		// );
-		
-		//Check if layers are lower than our content adaptation selected ones
-		if (layerInfo.spatialLayerId <= spatialLayerId && layerInfo.temporalLayerId <= temporalLayerId )
+		//Masks only have room for 32 decode targets
+		if (dt>=32)
+			continue;
+		//Get bit
+		uint32_t bit = 1u << dt;
+		//Skip if not active, not selected or without chain info
+		if (!(candidates & bit) || (unprotected & bit))
+			continue;
+		//If we don't have a top one yet
+		if (topDecodeTarget==NoDecodeTarget)
+			//Store top most
+			topDecodeTarget = dt;
+		//If chain is not broken
+		if (!(broken & bit))
 		{
-			//If decode target is active
-			if (!activeDecodeTargets || (*activeDecodeTargets)[decodeTarget])
-			{
-				//If we don't have chain info
-				if (templateDependencyStructure->decodeTargetProtectedByChain.empty())
-				{
-					//Use current target	
-					currentDecodeTarget = decodeTarget;
-					break;
-				}
-					
-				//Check we have chain for current target
-				if (templateDependencyStructure->decodeTargetProtectedByChain.size()<decodeTarget)
-					//Try next
-					continue;
-				
-				//Get chain for current target
-				auto chain = templateDependencyStructure->decodeTargetProtectedByChain[decodeTarget];
-				
-				//Check chain info is correct
-				if (frameDiffsChains.size()<chain)
-					//Try next
-					continue;
-				
-				//If we don't have a top layer yet
-				if (!topLayer.IsValid())
-				{
-					//Store top most layer
-					topLayer = layerInfo;
-					topChain = chain;
-				}
-
-				//Get previous frame numner in current chain
-				 auto prevFrameInCurrentChain = extFrameNum - frameDiffsChains[chain];
-				 
-				 //Log
-				 //UltraDebug("-DependencyDescriptorLayerSelector::Select() | Frame [dt:%llu,chain:%d,prev:%d]\n",decodeTarget,chain,prevFrameInCurrentChain);
-				  
-				 //If it is not us, check if previus frame was not sent
-				 if (prevFrameInCurrentChain && 
-				     prevFrameInCurrentChain!=extFrameNum &&
-				     !forwardedFrames.Contains(prevFrameInCurrentChain))
-					//Chain is broken, try next
-					continue;
-
-				//Got it
-				currentLayer = layerInfo;
-				currentChain = chain;
-				currentDecodeTarget = decodeTarget;
-				break;
-			}
-		} else {
-			//Disable layer
-			(*forwardedDecodeTargets)[decodeTarget] = false;
-			needsForwardedDecodeTargets = true;
+			//Got it
+			decodeTarget = dt;
+			break;
 		}
 	}
 	
-	//If we have not changed the targets
-	if (!needsForwardedDecodeTargets)
-		//Do not override it
-		forwardedDecodeTargets.reset();
+	//Without chains we can only switch up to a decode target when the frame is a switch point for it
+	if (templateDependencyStructure->decodeTargetProtectedByChain.empty()
+		&& decodeTarget!=NoDecodeTarget
+		&& currentDecodeTarget!=NoDecodeTarget
+		&& decodeTarget!=currentDecodeTarget
+		&& (candidates & (1u << currentDecodeTarget))
+		&& !(switchDecodeTargets & (1u << decodeTarget)))
+		//Keep previous one
+		decodeTarget = topDecodeTarget = currentDecodeTarget;
 	
 	//If there is none available
-	if (currentDecodeTarget==NoDecodeTarget)
+	if (decodeTarget==NoDecodeTarget)
 	{
 		//Request intra
 		waitingForIntra = true;
@@ -231,29 +227,16 @@ bool DependencyDescriptorLayerSelector::Select(const RTPPacket::shared& packet,b
 		return Warning("-DependencyDescriptorLayerSelector::Select() | No decode target availalable\n");
 	}
 	
-	//Check dti info is correct
-	if (decodeTargetIndications.size()<currentDecodeTarget)
-	{
-		//Request intra
-		waitingForIntra = true;
-		//Ignore packet
-		return Warning("-DependencyDescriptorLayerSelector::Select() | No decode target information available [dt:%d]\n",currentDecodeTarget);
-	}
-	
-	//Get decode target indicattion
-	auto dti = decodeTargetIndications[currentDecodeTarget];
+	//Store current one
+	currentDecodeTarget = decodeTarget;
 
 	//Log
-	//Debug("-DependencyDescriptorLayerSelector::Select() | Selected [number=%llu,t:%d,dt:%llu,chain:%d,dti:%d,top:{S%dT%d],current:{S%dT%d],frame:[S%dT%d]\n",
+	//Debug("-DependencyDescriptorLayerSelector::Select() | Selected [number=%llu,t:%d,dt:%u,top:%u,present:%x,frame:[S%dT%d]\n",
 	//	extFrameNum,
 	//	dependencyDescriptor->frameDependencyTemplateId,
-	//	currentDecodeTarget,
-	//	currentChain,
-	//	dti,
-	//	topLayer.spatialLayerId,
-	// 	topLayer.temporalLayerId,
-	//	currentLayer.spatialLayerId,
-	// 	currentLayer.temporalLayerId,
+	//	decodeTarget,
+	//	topDecodeTarget,
+	//	presentDecodeTargets,
 	//	frameDependencyTemplate.spatialLayerId,
 	//	frameDependencyTemplate.temporalLayerId
 	//);
@@ -261,8 +244,8 @@ bool DependencyDescriptorLayerSelector::Select(const RTPPacket::shared& packet,b
 	//If frame is not decodable
 	if (!decodable)
 	{
-		//Request iframe if chain for the top active layer is broken
-		waitingForIntra = (topLayer!=currentLayer);
+		//Request iframe if chain for the top active decode target is broken
+		waitingForIntra = (topDecodeTarget!=decodeTarget);
 		//Log
 		//UltraDebug("-DependencyDescriptorLayerSelector::Select() | Discarding packet, not decodable\n")
 		//Ignore packet
@@ -270,7 +253,7 @@ bool DependencyDescriptorLayerSelector::Select(const RTPPacket::shared& packet,b
 	}
 	
 	//If frame is not present in selected decode target
-	if (dti==DecodeTargetIndication::NotPresent)
+	if (!(presentDecodeTargets & (1u << decodeTarget)))
 	{
 		//Log
 		//UltraDebug("-DependencyDescriptorLayerSelector::Select() | Discarding packet, not present\n");
@@ -296,6 +279,30 @@ bool DependencyDescriptorLayerSelector::Select(const RTPPacket::shared& packet,b
 	
 }
 
+std::optional<std::vector<bool>> DependencyDescriptorLayerSelector::GetForwardedDecodeTargets() const
+{
+	//If not overriden
+	if (!forwardedDecodeTargets || !templateDependencyStructure)
+		//Nothing
+		return std::nullopt;
+	//Expand mask
+	return DependencyDescriptor::GetDecodeTargets(*forwardedDecodeTargets, templateDependencyStructure->dtsCount);
+}
+
+void DependencyDescriptorLayerSelector::UpdateSelectedDecodeTargets(const TemplateDependencyStructure::shared& structure)
+{
+	//If it is a new structure
+	if (structure!=templateDependencyStructure)
+		//Decode target indexes are not valid anymore
+		currentDecodeTarget = NoDecodeTarget;
+	//Store current structure and selection
+	templateDependencyStructure	= structure;
+	selectedSpatialLayerId		= spatialLayerId;
+	selectedTemporalLayerId		= temporalLayerId;
+	//Get decode targets allowed by the selected layers
+	selectedDecodeTargets		= structure->GetDecodeTargetsMask(spatialLayerId, temporalLayerId);
+}
+
 std::vector<LayerInfo> DependencyDescriptorLayerSelector::GetLayerIds(const RTPPacket::shared& packet)
 {
 	std::vector<LayerInfo> infos;
@@ -309,22 +316,19 @@ std::vector<LayerInfo> DependencyDescriptorLayerSelector::GetLayerIds(const RTPP
 		&& currentTemplateDependencyStructure
 		&& currentTemplateDependencyStructure->ContainsFrameDependencyTemplate(dependencyDescriptor->frameDependencyTemplateId))
 	{
-		//Get dependencey structure from template
-		const auto& templateDependencyStructure = currentTemplateDependencyStructure->GetFrameDependencyTemplate(dependencyDescriptor->frameDependencyTemplateId);
-		//Get decode target indications
-		const auto& decodeTargetIndications = dependencyDescriptor->customDecodeTargetIndications 
-			? dependencyDescriptor->customDecodeTargetIndications.value()
-			: templateDependencyStructure.decodeTargetIndications; 
+		//Get template index
+		auto templateIndex = dependencyDescriptor->frameDependencyTemplateId - currentTemplateDependencyStructure->templateIdOffset;
+		//Get decode targets in which the frame is present
+		uint32_t presentDecodeTargets = dependencyDescriptor->customDecodeTargetIndications 
+			? DependencyDescriptor::GetDecodeTargetsMask(*dependencyDescriptor->customDecodeTargetIndications)
+			: currentTemplateDependencyStructure->templateDecodeTargetsMask[templateIndex]; 
 		//Do not add duplicate layers
 		LayerInfo last;
 		//Traverse all layers
 		for (auto& [decodeTarget,layerInfo] : currentTemplateDependencyStructure->decodeTargetLayerMapping)
 		{
-			
-			//Get decode target indicattion
-			auto dti = decodeTargetIndications[decodeTarget];
 			//If frame is present in selected decode target and it is not a duplicate
-			if (dti!=DecodeTargetIndication::NotPresent && last!=layerInfo)
+			if (decodeTarget<32 && (presentDecodeTargets & (1u << decodeTarget)) && last!=layerInfo)
 			{
 				//Add layer info
 				infos.push_back(layerInfo);
@@ -0,0 +1,271 @@
+#include "EpollReactor.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <vector>
+
+#include "log.h"
+
+EpollReactor::EpollReactor() :
+	//Packets are not used for stream sockets
+	EventLoop(nullptr, 1)
+{
+#if defined(__linux__)
+	//Create epoll instance
+	epoll = epoll_create1(EPOLL_CLOEXEC);
+	//Check
+	if (epoll==FD_INVALID)
+		Error("-EpollReactor::EpollReactor() | could not create epoll [errno:%d]\n",errno);
+#endif
+}
+
+EpollReactor::~EpollReactor()
+{
+	//Stop just in case
+	if (IsRunning())
+		Stop();
+#if defined(__linux__)
+	//Close epoll
+	if (epoll!=FD_INVALID)
+		close(epoll);
+#endif
+}
+
+bool EpollReactor::Start()
+{
+	Debug("-EpollReactor::Start() [this:%p]\n",this);
+
+#if defined(__linux__)
+	//Check epoll was created
+	if (epoll==FD_INVALID)
+		return Error("-EpollReactor::Start() | no epoll instance\n");
+#endif
+
+	//Run our own loop
+	return EventLoop::Start([this](){ Loop(); });
+}
+
+bool EpollReactor::Stop()
+{
+	Debug(">EpollReactor::Stop() [this:%p,handlers:%zu]\n",this,handlers.size());
+
+	//Stop thread
+	if (!EventLoop::Stop())
+		return false;
+
+	//Release handlers still registered, the loop is not running anymore
+#if defined(__linux__)
+	for (const auto& [fd,handler] : handlers)
+		epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+#else
+	interests.clear();
+#endif
+	handlers.clear();
+	numHandlers = 0;
+
+	Debug("<EpollReactor::Stop() [this:%p]\n",this);
+
+	//Done
+	return true;
+}
+
+bool EpollReactor::AddHandler(int fd, uint32_t events, const std::shared_ptr<Handler>& handler)
+{
+	AssertThread();
+
+#if defined(__linux__)
+	epoll_event event = {};
+	event.events = events;
+	event.data.fd = fd;
+
+	//Add to epoll
+	if (epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event)<0)
+		return Error("-EpollReactor::AddHandler() | epoll_ctl failed [fd:%d,errno:%d]\n",fd,errno);
+#else
+	//Check not already added, same as epoll
+	if (!interests.emplace(fd,events).second)
+		return Error("-EpollReactor::AddHandler() | already added [fd:%d]\n",fd);
+#endif
+
+	//Store handler
+	handlers[fd] = handler;
+	numHandlers = handlers.size();
+
+	//Done
+	return true;
+}
+
+bool EpollReactor::ModifyHandler(int fd, uint32_t events)
+{
+	AssertThread();
+
+#if defined(__linux__)
+	epoll_event event = {};
+	event.events = events;
+	event.data.fd = fd;
+
+	//Update events
+	if (epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &event)<0)
+		return Error("-EpollReactor::ModifyHandler() | epoll_ctl failed [fd:%d,errno:%d]\n",fd,errno);
+#else
+	//Find socket
+	auto it = interests.find(fd);
+	//If not found
+	if (it==interests.end())
+		return Error("-EpollReactor::ModifyHandler() | not found [fd:%d]\n",fd);
+	//Update events
+	it->second = events;
+#endif
+
+	//Done
+	return true;
+}
+
+bool EpollReactor::RemoveHandler(int fd)
+{
+	AssertThread();
+
+	//Find handler
+	auto it = handlers.find(fd);
+	//If not found
+	if (it==handlers.end())
+		return false;
+
+#if defined(__linux__)
+	//Remove from epoll, must be done before the socket is closed
+	epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+#else
+	//Not polled anymore
+	interests.erase(fd);
+#endif
+
+	//Release it, the dispatcher holds its own reference if we are inside OnEvent
+	handlers.erase(it);
+	numHandlers = handlers.size();
+
+	//Done
+	return true;
+}
+
+void EpollReactor::Loop()
+{
+#if defined(__linux__)
+	epoll_event events[MaxEvents];
+#else
+	std::vector<pollfd> fds;
+#endif
+
+	//Store thread
+	loopThread = std::this_thread::get_id();
+
+	//Get signaling pipe
+	int signalFd = GetPipe()[0];
+
+	Log(">EpollReactor::Loop() [this:%p]\n",this);
+
+#if defined(__linux__)
+	//Wait for signals
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = signalFd;
+	if (epoll_ctl(epoll, EPOLL_CTL_ADD, signalFd, &event)<0)
+		Error("-EpollReactor::Loop() | could not add signal pipe [fd:%d,errno:%d]\n",signalFd,errno);
+#endif
+
+	//We are running
+	AddRunning();
+
+	//Get now
+	auto now = Now();
+
+	//Run until ended
+	while (IsRunning())
+	{
+		//Until signaled, next timer or one each 10 seconds to prevent deadlocks
+		int timeout = GetNextTimeout(10E3);
+
+		//Get time before waiting
+		QWORD beforeWait = getTime();
+
+#if defined(__linux__)
+		//Wait for events
+		int num = epoll_wait(epoll, events, MaxEvents, timeout);
+#else
+		//Poll signaling pipe and all the sockets
+		fds.clear();
+		fds.push_back({signalFd, POLLIN, 0});
+		for (const auto& [fd,interest] : interests)
+			fds.push_back({fd, (short)interest, 0});
+
+		//Wait for events
+		int num = poll(fds.data(), fds.size(), timeout)>0 ? fds.size() : 0;
+#endif
+
+		//Get time after waiting
+		QWORD afterWait = getTime();
+
+		//Update waiting time
+		AddWaitTime(beforeWait, afterWait);
+
+		//Update now
+		now = Now();
+
+		//Dispatch socket events
+		for (int i = 0; i<num; ++i)
+		{
+#if defined(__linux__)
+			//Get fd and events
+			int fd = events[i].data.fd;
+			uint32_t ready = events[i].events;
+#else
+			//Get fd and events
+			int fd = fds[i].fd;
+			uint32_t ready = fds[i].revents;
+			//Skip not ready ones
+			if (!ready)
+				continue;
+#endif
+
+			//If it is the signaling pipe
+			if (fd==signalFd)
+			{
+				//Clear it, tasks are run below
+				ClearSignal();
+				continue;
+			}
+
+			//Find handler
+			auto it = handlers.find(fd);
+			//It may have been removed by a previous event on this same iteration
+			if (it==handlers.end())
+				continue;
+
+			//Keep a reference so it can remove itself while handling the event
+			auto handler = it->second;
+			//Run it
+			handler->OnEvent(ready);
+		}
+
+		//Process pending tasks
+		ProcessTasks(now);
+
+		//Timers triggered
+		ProcessTriggers(now);
+
+		//Update busy time and iterations
+		UpdateStats(afterWait);
+	}
+
+	//Run queued tasks before exiting
+	ProcessTasks(now);
+
+	//Not running anymore
+	RemoveRunning();
+
+#if defined(__linux__)
+	//Stop waiting for signals, pipe is closed after loop exits
+	epoll_ctl(epoll, EPOLL_CTL_DEL, signalFd, nullptr);
+#endif
+
+	Log("<EpollReactor::Loop() [this:%p]\n",this);
+}
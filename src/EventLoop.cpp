@@ -13,13 +13,20 @@
 #include <signal.h>
 #include <sched.h>
 #include <pthread.h>
+#include <sys/syscall.h>
 #include <cmath>
+#include <mutex>
+#include <set>
 
 #include "log.h"
 
 const size_t EventLoop::MaxSendingQueueSize = 64*1024;
 const size_t EventLoop::PacketPoolSize = 1024;
 
+//Loops currently inside Run(), so they can be monitored
+static std::mutex runningMutex;
+static std::set<const EventLoop*> runningLoops;
+
 
 #if __APPLE__
 #include <mach/mach.h>
@@ -321,6 +328,7 @@ void EventLoop::Send(const uint32_t ipAddr, const uint16_t port, Packet&& packet
 		{
 			//We are overflowing
 			state = State::Overflown;
+			overflownTransitions.fetch_add(1, std::memory_order_relaxed);
 			//Log
 			Error("-EventLoop::Send() | sending queue overflown [aprox:%lu]\n",aprox);
 		}
@@ -329,6 +337,7 @@ void EventLoop::Send(const uint32_t ipAddr, const uint16_t port, Packet&& packet
 	} else if (aprox>MaxSendingQueueSize/2 && state==State::Normal) {
 		//We are lagging behind
 		state = State::Lagging;
+		laggingTransitions.fetch_add(1, std::memory_order_relaxed);
 		//Log
 		Error("-EventLoop::Send() | sending queue lagging behind [aprox:%lu]\n",aprox);
 	} else if (aprox<MaxSendingQueueSize/4 && state!=State::Normal)  {
@@ -340,6 +349,8 @@ void EventLoop::Send(const uint32_t ipAddr, const uint16_t port, Packet&& packet
 	
 	//Create send packet
 	SendBuffer send = {ipAddr, port, rawTxData, std::move(packet), callback};
+	//Set enqueued time for latency stats
+	send.enqueued = getTime();
 	
 	//Move it back to sending queue
 	sending.enqueue(std::move(send));
@@ -570,6 +581,32 @@ void EventLoop::Signal()
 	one = write(pipe[1],(uint8_t*)&one,sizeof(one));
 }
 
+EventLoop::Stats EventLoop::GetStats() const
+{
+	Stats stats;
+	stats.tid			= tid;
+	stats.iterations		= iterations;
+	stats.busyTime			= busyTime;
+	stats.waitTime			= waitTime;
+	stats.tasks			= processedTasks;
+	stats.timers			= processedTimers;
+	stats.sendQueueSize		= sending.size_approx();
+	stats.state			= state;
+	stats.laggingTransitions	= laggingTransitions;
+	stats.overflownTransitions	= overflownTransitions;
+	return stats;
+}
+
+std::vector<EventLoop::Stats> EventLoop::GetRunningStats()
+{
+	std::vector<Stats> stats;
+	std::lock_guard<std::mutex> lock(runningMutex);
+	//Get stats from each running loop
+	for (auto loop : runningLoops)
+		stats.push_back(loop->GetStats());
+	return stats;
+}
+
 void EventLoop::Run(const std::chrono::milliseconds &duration)
 {
 	//Log(">EventLoop::Run() | [%p,running:%d,duration:%llu]\n",this,running,duration.count());
@@ -601,6 +638,9 @@ void EventLoop::Run(const std::chrono::milliseconds &duration)
 	//Catch all IO errors and do nothing
 	signal(SIGIO,[](int){});
 	
+	//We are running
+	AddRunning();
+	
 	//Get now
 	auto now = Now();
 	
@@ -622,12 +662,21 @@ void EventLoop::Run(const std::chrono::milliseconds &duration)
 
 		//UltraDebug(">EventLoop::Run() | poll timeout:%d timers:%d tasks:%d size:%d\n",timeout,timers.size(),tasks.size_approx(), sizeof(ufds) / sizeof(pollfd));
 		
+		//Get time before waiting
+		QWORD beforePoll = getTime();
+		
 		//Wait for events
 		{
 			//TRACE_EVENT("eventloop", "poll", "timeout", timeout);
 			(void)poll(ufds,sizeof(ufds)/sizeof(pollfd),timeout);
 		}
 		
+		//Get time after waiting
+		QWORD afterPoll = getTime();
+		
+		//Update waiting time
+		AddWaitTime(beforePoll, afterPoll);
+		
 		//Update now
 		now = Now();
 		
@@ -769,6 +818,8 @@ void EventLoop::Run(const std::chrono::milliseconds &duration)
 			
 			//Update now
 			now = Now();
+			//Get sent time for latency stats
+			QWORD sent = getTime();
 
 			//First
 			auto it = items.begin();
@@ -785,6 +836,9 @@ void EventLoop::Run(const std::chrono::milliseconds &duration)
 				} else {
 					//Move packet buffer back to the pool
 					packetPool.release(std::move(it->packet));
+					//Update time spent in the send queue
+					if (sent>=it->enqueued)
+						sendQueueLatency.Record(sent - it->enqueued);
 					//If we had a callback
 					if (it->callback)
 						//Set sending time
@@ -808,16 +862,43 @@ void EventLoop::Run(const std::chrono::milliseconds &duration)
 			//Clear signal flag
 			ClearSignal();
 		
+		//Update busy time and iterations
+		UpdateStats(afterPoll);
+		
 		//Update now
 		now = Now();
 	}
 	
 	//Run queued tasks before exiting
 	ProcessTasks(now);
+	
+	//Not running anymore
+	RemoveRunning();
 
 	//Log("<EventLoop::Run()\n");
 }
 
+void EventLoop::AddRunning()
+{
+	//Store thread id for per thread cpu accounting
+	tid = syscall(SYS_gettid);
+	
+	std::lock_guard<std::mutex> lock(runningMutex);
+	runningLoops.insert(this);
+}
+
+void EventLoop::RemoveRunning()
+{
+	std::lock_guard<std::mutex> lock(runningMutex);
+	runningLoops.erase(this);
+}
+
+void EventLoop::UpdateStats(QWORD afterWait)
+{
+	busyTime.fetch_add(getTime() - afterWait, std::memory_order_relaxed);
+	iterations.fetch_add(1, std::memory_order_relaxed);
+}
+
 int EventLoop::GetNextTimeout(int defaultTimeout, const std::chrono::milliseconds& until) const
 {
 	int timeout = defaultTimeout;
@@ -873,6 +954,8 @@ void EventLoop::ProcessTasks(const std::chrono::milliseconds& now)
 		if (task.second.has_value())
 			//Run now
 			task.second.value()(now);
+		//One more
+		processedTasks.fetch_add(1, std::memory_order_relaxed);
 		//UltraDebug("<EventLoop::Run() | task run\n");
 	}
 	TRACE_EVENT_END("eventloop");
@@ -912,6 +995,8 @@ void EventLoop::ProcessTriggers(const std::chrono::milliseconds& now)
 
 		//Execute it
 		timer->callback(now);
+		//One more
+		processedTimers.fetch_add(1, std::memory_order_relaxed);
 
 		//Timer ended
 		TRACE_EVENT_END("eventloop");
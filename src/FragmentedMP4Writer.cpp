@@ -0,0 +1,1062 @@
+#include "FragmentedMP4Writer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+#include "log.h"
+#include "tools.h"
+
+//Alignment of the output buffer, enough for direct io
+static constexpr DWORD BufferAlignment = 4096;
+
+//sample_depends_on=2
+static constexpr DWORD SyncSampleFlags		= 0x02000000;
+//sample_depends_on=1, sample_is_non_sync_sample=1
+static constexpr DWORD NonSyncSampleFlags	= 0x01010000;
+
+//tfhd default-base-is-moof
+static constexpr DWORD DefaultBaseIsMoof	= 0x020000;
+//trun fields present
+static constexpr DWORD DataOffsetPresent	= 0x000001;
+static constexpr DWORD SampleDurationPresent	= 0x000100;
+static constexpr DWORD SampleSizePresent	= 0x000200;
+static constexpr DWORD SampleFlagsPresent	= 0x000400;
+static constexpr DWORD SampleCTOPresent		= 0x000800;
+
+static const DWORD Matrix[9] = {0x00010000,0,0,0,0x00010000,0,0,0,0x40000000};
+
+static void Put1(std::vector<BYTE>& out, BYTE val)	{ out.push_back(val);				}
+static void Put2(std::vector<BYTE>& out, DWORD val)	{ Put1(out,val>>8); Put1(out,val);		}
+static void Put3(std::vector<BYTE>& out, DWORD val)	{ Put1(out,val>>16); Put2(out,val);		}
+static void Put4(std::vector<BYTE>& out, DWORD val)	{ Put2(out,val>>16); Put2(out,val);		}
+static void Put8(std::vector<BYTE>& out, QWORD val)	{ Put4(out,val>>32); Put4(out,val);		}
+static void PutBytes(std::vector<BYTE>& out, const BYTE* data, size_t size) { out.insert(out.end(),data,data+size);	}
+static void PutType(std::vector<BYTE>& out, const char* type)	{ PutBytes(out,(const BYTE*)type,4);	}
+static void PutZeros(std::vector<BYTE>& out, size_t size)	{ out.resize(out.size()+size,0);	}
+
+static size_t BeginBox(std::vector<BYTE>& out, const char* type)
+{
+	//Size is set when box is ended
+	size_t start = out.size();
+	Put4(out,0);
+	PutType(out,type);
+	return start;
+}
+
+static size_t BeginFullBox(std::vector<BYTE>& out, const char* type, BYTE version, DWORD flags)
+{
+	size_t start = BeginBox(out,type);
+	Put1(out,version);
+	Put3(out,flags);
+	return start;
+}
+
+static void EndBox(std::vector<BYTE>& out, size_t start)
+{
+	set4(out.data(),start,out.size()-start);
+}
+
+static int OpenFile(const std::string& path, bool direct)
+{
+	int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+	//Try with direct io first if requested
+	int fd = ::open(path.c_str(),flags | (direct ? O_DIRECT : 0),0644);
+	//If not supported by the filesystem
+	if (fd<0 && direct && errno==EINVAL)
+	{
+		Warning("-FragmentedMP4Writer::OpenFile() | direct io not supported, using buffered io [path:%s]\n",path.c_str());
+		//Open it normally
+		fd = ::open(path.c_str(),flags,0644);
+	}
+	return fd;
+}
+
+FragmentedMP4Writer::FragmentedMP4Writer() :
+	FragmentedMP4Writer(Options{})
+{
+}
+
+FragmentedMP4Writer::FragmentedMP4Writer(const Options& options) :
+	options(options)
+{
+	//Direct io requires sizes multiple of the block size
+	if (this->options.directIO && (!this->options.alignment || this->options.alignment % BufferAlignment))
+		this->options.alignment = BufferAlignment;
+}
+
+FragmentedMP4Writer::~FragmentedMP4Writer()
+{
+	//Close just in case
+	Close();
+	//Free output buffer
+	free(buffer);
+}
+
+bool FragmentedMP4Writer::Open(const char* filename)
+{
+	Log("-FragmentedMP4Writer::Open() [filename:%s,segmentDir:%s,fragmentDuration:%ums,alignment:%u,directIO:%d]\n",
+		filename,options.segmentDir.c_str(),options.fragmentDuration,options.alignment,options.directIO);
+
+	//Check not already opened
+	if (opened)
+		return Error("-FragmentedMP4Writer::Open() | already opened\n");
+
+	//If writing a single file
+	if (options.segmentDir.empty())
+	{
+		//Open it now
+		fd = OpenFile(filename,options.directIO);
+		//Check
+		if (fd<0)
+			return Error("-FragmentedMP4Writer::Open() | could not open file [filename:%s,errno:%d]\n",filename,errno);
+		//Store name
+		this->filename = filename;
+	} else {
+		//Playlist path, segments are opened when written
+		this->filename = options.segmentDir + "/" + filename;
+	}
+
+	//Reset state
+	tracks.clear();
+	segments.clear();
+	stats = {};
+	initialized	= false;
+	offset		= 0;
+	sequence	= 0;
+	maxPartDuration	= 0;
+	opened		= true;
+
+	//Done
+	return true;
+}
+
+bool FragmentedMP4Writer::Close()
+{
+	//Check opened
+	if (!opened)
+		return false;
+
+	//Write pending samples
+	bool res = WriteFragment();
+
+	//Samples held waiting for the parameter sets are lost
+	if (!initialized)
+		DropSamples();
+
+	//Close playlist
+	if (!options.segmentDir.empty() && initialized)
+		res = WritePlaylist(true) && res;
+
+	//Close file
+	if (fd!=FD_INVALID)
+		::close(fd);
+	fd = FD_INVALID;
+
+	Log("-FragmentedMP4Writer::Close() [filename:%s,fragments:%" PRIu64 ",segments:%" PRIu64 ",samples:%" PRIu64 ",bytes:%" PRIu64 ",writes:%" PRIu64 ",dropped:%" PRIu64 ",maxTrackBytes:%u]\n",
+		filename.c_str(),stats.fragments,stats.segments,stats.samples,stats.bytes,stats.writes,stats.dropped,stats.maxTrackBytes);
+
+	//Not opened anymore
+	opened = false;
+	tracks.clear();
+
+	return res;
+}
+
+DWORD FragmentedMP4Writer::AddAudioTrack(AudioCodec::Type codec, DWORD rate, DWORD channels, const BYTE* config, DWORD size)
+{
+	Log("-FragmentedMP4Writer::AddAudioTrack() [codec:%s,rate:%u,channels:%u]\n",AudioCodec::GetNameFor(codec),rate,channels);
+
+	//Tracks are declared on the init segment
+	if (initialized)
+	{
+		Warning("-FragmentedMP4Writer::AddAudioTrack() | init segment already written, track not added [codec:%s]\n",AudioCodec::GetNameFor(codec));
+		return 0;
+	}
+
+	//Check codec
+	switch (codec)
+	{
+		case AudioCodec::OPUS:
+		case AudioCodec::AAC:
+		case AudioCodec::PCMU:
+		case AudioCodec::PCMA:
+			break;
+		default:
+			return Error("-FragmentedMP4Writer::AddAudioTrack() | codec not supported [codec:%s]\n",AudioCodec::GetNameFor(codec));
+	}
+
+	Track track;
+	track.id	= tracks.size()+1;
+	track.media	= MediaFrame::Audio;
+	track.codec	= codec;
+	track.rate	= rate;
+	track.channels	= std::max(channels,1u);
+
+	//If it is aac
+	if (codec==AudioCodec::AAC)
+	{
+		//If we have the config
+		if (config && size)
+		{
+			//Copy it
+			track.config.assign(config,config+size);
+		} else {
+			static const DWORD frequencies[] = {96000,88200,64000,48000,44100,32000,24000,22050,16000,12000,11025,8000,7350};
+			//Find frequency index, or use explicit one
+			DWORD index = std::find(std::begin(frequencies),std::end(frequencies),rate) - std::begin(frequencies);
+			if (index>=std::size(frequencies))
+				index = 0x0F;
+			//Object type AAC LC
+			QWORD bits = 2;
+			DWORD len = 5;
+			//Frequency
+			bits = bits<<4 | index;
+			len += 4;
+			if (index==0x0F)
+			{
+				bits = bits<<24 | rate;
+				len += 24;
+			}
+			//Channels and no extension flags
+			bits = bits<<7 | track.channels<<3;
+			len += 7;
+			//Serialize
+			for (int i=len/8-1;i>=0;--i)
+				track.config.push_back(bits>>(i*8));
+		}
+	}
+
+	//Add it
+	tracks.push_back(std::move(track));
+
+	return tracks.back().id;
+}
+
+DWORD FragmentedMP4Writer::AddVideoTrack(VideoCodec::Type codec, DWORD rate, DWORD width, DWORD height)
+{
+	Log("-FragmentedMP4Writer::AddVideoTrack() [codec:%s,rate:%u,width:%u,height:%u]\n",VideoCodec::GetNameFor(codec),rate,width,height);
+
+	//Tracks are declared on the init segment
+	if (initialized)
+	{
+		Warning("-FragmentedMP4Writer::AddVideoTrack() | init segment already written, track not added [codec:%s]\n",VideoCodec::GetNameFor(codec));
+		return 0;
+	}
+
+	//Check codec
+	switch (codec)
+	{
+		case VideoCodec::H264:
+		case VideoCodec::VP8:
+		case VideoCodec::VP9:
+			break;
+		default:
+			return Error("-FragmentedMP4Writer::AddVideoTrack() | codec not supported [codec:%s]\n",VideoCodec::GetNameFor(codec));
+	}
+
+	Track track;
+	track.id	= tracks.size()+1;
+	track.media	= MediaFrame::Video;
+	track.codec	= codec;
+	track.rate	= rate;
+	track.width	= width;
+	track.height	= height;
+
+	//Add it
+	tracks.push_back(std::move(track));
+
+	return tracks.back().id;
+}
+
+void FragmentedMP4Writer::SetTrackName(DWORD trackId, const std::string& name)
+{
+	if (auto track = GetTrack(trackId))
+		track->name = name;
+}
+
+bool FragmentedMP4Writer::SetH264ParameterSets(DWORD trackId, const BYTE* sps, DWORD spsSize, const BYTE* pps, DWORD ppsSize)
+{
+	auto track = GetTrack(trackId);
+	//Check
+	if (!track || track->codec!=VideoCodec::H264)
+		return Error("-FragmentedMP4Writer::SetH264ParameterSets() | not an h264 track [id:%u]\n",trackId);
+	//Store them
+	track->sps.assign(sps,sps+spsSize);
+	track->pps.assign(pps,pps+ppsSize);
+	return true;
+}
+
+FragmentedMP4Writer::Track* FragmentedMP4Writer::GetTrack(DWORD trackId)
+{
+	return trackId && trackId<=tracks.size() ? &tracks[trackId-1] : nullptr;
+}
+
+FragmentedMP4Writer::Track* FragmentedMP4Writer::GetReferenceTrack()
+{
+	//First video track
+	for (auto& track : tracks)
+		if (track.media==MediaFrame::Video)
+			return &track;
+	//Or first track
+	return !tracks.empty() ? &tracks.front() : nullptr;
+}
+
+bool FragmentedMP4Writer::HasParameterSets() const
+{
+	for (const auto& track : tracks)
+		if (track.codec==VideoCodec::H264 && (track.sps.empty() || track.pps.empty()))
+			return false;
+	return true;
+}
+
+void FragmentedMP4Writer::DropSamples()
+{
+	for (auto& track : tracks)
+	{
+		stats.dropped += track.samples.size();
+		track.samples.clear();
+		track.data.clear();
+		track.duration = 0;
+		//Video must start again with a key frame
+		track.started = false;
+	}
+}
+
+bool FragmentedMP4Writer::WriteSample(DWORD trackId, const BYTE* data, DWORD size, QWORD dts, DWORD duration, bool sync, int cto)
+{
+	//Check opened
+	if (!opened)
+		return false;
+
+	auto track = GetTrack(trackId);
+	//Check
+	if (!track)
+		return Error("-FragmentedMP4Writer::WriteSample() | unknown track [id:%u]\n",trackId);
+
+	//Video must start with a key frame
+	if (track->media==MediaFrame::Video && !track->started && !sync)
+	{
+		stats.dropped++;
+		return true;
+	}
+
+	//Get SPS and PPS from first key frame if not set
+	if (track->codec==VideoCodec::H264 && sync && (track->sps.empty() || track->pps.empty()))
+	{
+		//For each length prefixed NAL
+		for (DWORD pos=0; pos+4<=size;)
+		{
+			DWORD len = get4(data,pos);
+			pos += 4;
+			//Check
+			if (!len || pos+len>size)
+				break;
+			//Get type
+			BYTE type = data[pos] & 0x1F;
+			if (type==0x07 && track->sps.empty())
+				track->sps.assign(data+pos,data+pos+len);
+			else if (type==0x08 && track->pps.empty())
+				track->pps.assign(data+pos,data+pos+len);
+			//Next
+			pos += len;
+		}
+	}
+
+	//If init segment is still waiting for the parameter sets, don't hold more than allowed
+	if (!initialized && track->data.size()+size > options.maxTrackBytes && !HasParameterSets())
+	{
+		Debug("-FragmentedMP4Writer::WriteSample() | no H264 parameter sets yet, dropping pending samples\n");
+		DropSamples();
+		//Check again if it can start
+		if (track->media==MediaFrame::Video && !sync)
+		{
+			stats.dropped++;
+			return true;
+		}
+	}
+
+	//Check if we need to start a new fragment before this sample
+	bool cut = false;
+	//If this track already has pending samples
+	if (!track->samples.empty())
+	{
+		bool reference = track==GetReferenceTrack();
+		//Cut at key frames of the reference track
+		if (reference && sync && options.fragmentOnKeyFrame && track->media==MediaFrame::Video)
+			cut = true;
+		//Cut by duration, allow longer fragments for non reference tracks so they don't split gops
+		else if (options.fragmentDuration && track->duration*1000 >= (QWORD)options.fragmentDuration*track->rate*(reference ? 1 : 2))
+			cut = true;
+		//Bounded memory
+		else if (track->data.size()+size > options.maxTrackBytes)
+			cut = true;
+	}
+
+	//Write previous samples
+	if (cut && !WriteFragment())
+		return false;
+
+	//Set decode time of fragment
+	if (track->samples.empty())
+		track->firstDts = dts;
+
+	//Append sample
+	track->samples.push_back({size,duration,sync || track->media!=MediaFrame::Video ? SyncSampleFlags : NonSyncSampleFlags,cto});
+	track->data.insert(track->data.end(),data,data+size);
+	track->duration += duration;
+	track->started = true;
+
+	//Update stats
+	stats.samples++;
+	stats.maxTrackBytes = std::max<DWORD>(stats.maxTrackBytes,track->data.size());
+
+	return true;
+}
+
+bool FragmentedMP4Writer::Flush()
+{
+	//Check opened
+	if (!opened)
+		return false;
+	return WriteFragment();
+}
+
+bool FragmentedMP4Writer::WriteInit()
+{
+	std::vector<BYTE> boxes;
+
+	//Serialize ftyp and moov
+	SerializeInit(boxes);
+
+	//If writing segments
+	if (!options.segmentDir.empty())
+	{
+		//Init segment goes on its own file
+		std::string path = options.segmentDir + "/init.mp4";
+		int init = OpenFile(path,options.directIO);
+		//Check
+		if (init<0)
+			return Error("-FragmentedMP4Writer::WriteInit() | could not open file [path:%s,errno:%d]\n",path.c_str(),errno);
+		//Write it
+		DWORD written = Write(init,boxes);
+		::close(init);
+		//Check
+		if (!written)
+			return false;
+	} else {
+		//Write at the start of the file
+		DWORD written = Write(fd,boxes);
+		//Check
+		if (!written)
+			return false;
+		offset += written;
+	}
+
+	Debug("-FragmentedMP4Writer::WriteInit() [tracks:%zu,size:%zu]\n",tracks.size(),boxes.size());
+
+	//Done
+	initialized = true;
+	return true;
+}
+
+bool FragmentedMP4Writer::WriteFragment()
+{
+	std::vector<Track*> pending;
+	DWORD payload = 0;
+	double duration = 0;
+
+	//Get tracks with samples
+	for (auto& track : tracks)
+	{
+		if (track.samples.empty())
+			continue;
+		pending.push_back(&track);
+		payload += track.data.size();
+		duration = std::max(duration,(double)track.duration/track.rate);
+	}
+
+	//Nothing to write
+	if (pending.empty())
+		return true;
+
+	//Hold samples until the parameter sets are known, as the avcC would be empty
+	if (!initialized && !HasParameterSets())
+		return true;
+
+	//Write init segment before first fragment
+	if (!initialized && !WriteInit())
+		return false;
+
+	//Check if it starts with a key frame
+	auto reference = GetReferenceTrack();
+	bool independent = reference->media!=MediaFrame::Video || (!reference->samples.empty() && reference->samples.front().flags==SyncSampleFlags);
+
+	//If writing segments, start new one on first fragment or when current is long enough
+	if (!options.segmentDir.empty() && (fd==FD_INVALID || (independent && segments.back().duration*1000>=options.segmentDuration)))
+		if (!StartSegment())
+			return false;
+
+	//Next fragment
+	sequence++;
+
+	std::vector<BYTE> boxes;
+	std::vector<size_t> dataOffsets;
+
+	auto moof = BeginBox(boxes,"moof");
+	auto mfhd = BeginFullBox(boxes,"mfhd",0,0);
+	Put4(boxes,sequence);
+	EndBox(boxes,mfhd);
+	for (auto track : pending)
+	{
+		//Check if we need composition offsets
+		bool hasCTO = std::any_of(track->samples.begin(),track->samples.end(),[](const auto& sample){ return sample.cto; });
+
+		auto traf = BeginBox(boxes,"traf");
+		auto tfhd = BeginFullBox(boxes,"tfhd",0,DefaultBaseIsMoof);
+		Put4(boxes,track->id);
+		EndBox(boxes,tfhd);
+		auto tfdt = BeginFullBox(boxes,"tfdt",1,0);
+		Put8(boxes,track->firstDts);
+		EndBox(boxes,tfdt);
+		//Version 1 for signed offsets
+		auto trun = BeginFullBox(boxes,"trun",hasCTO ? 1 : 0,DataOffsetPresent | SampleDurationPresent | SampleSizePresent | SampleFlagsPresent | (hasCTO ? SampleCTOPresent : 0));
+		Put4(boxes,track->samples.size());
+		//Set when moof size is known
+		dataOffsets.push_back(boxes.size());
+		Put4(boxes,0);
+		for (const auto& sample : track->samples)
+		{
+			Put4(boxes,sample.duration);
+			Put4(boxes,sample.size);
+			Put4(boxes,sample.flags);
+			if (hasCTO)
+				Put4(boxes,sample.cto);
+		}
+		EndBox(boxes,trun);
+		EndBox(boxes,traf);
+	}
+	EndBox(boxes,moof);
+
+	//Data of each track follows the mdat header, offsets are from start of moof
+	DWORD dataOffset = boxes.size() - moof + 8;
+	for (size_t i=0;i<pending.size();++i)
+	{
+		set4(boxes.data(),dataOffsets[i],dataOffset);
+		dataOffset += pending[i]->data.size();
+	}
+
+	//mdat header
+	Put4(boxes,8+payload);
+	PutType(boxes,"mdat");
+
+	//Write all in one go
+	DWORD written = Write(fd,boxes,pending);
+	//Check
+	if (!written)
+		return false;
+
+	//If writing segments
+	if (!options.segmentDir.empty())
+	{
+		//Add part to current segment
+		auto& segment = segments.back();
+		segment.parts.push_back({offset,written,duration,independent});
+		segment.duration += duration;
+		maxPartDuration = std::max(maxPartDuration,duration);
+	}
+	offset += written;
+
+	//Clear pending samples, keeping memory for next fragment
+	for (auto track : pending)
+	{
+		track->samples.clear();
+		track->data.clear();
+		track->duration = 0;
+	}
+
+	stats.fragments++;
+
+	//Update playlist
+	if (!options.segmentDir.empty())
+		WritePlaylist(false);
+
+	return true;
+}
+
+bool FragmentedMP4Writer::StartSegment()
+{
+	//Close previous one
+	if (fd!=FD_INVALID)
+		::close(fd);
+
+	//Create new one
+	Segment segment;
+	segment.name = "segment-" + std::to_string(segments.size()+1) + ".m4s";
+	segment.duration = 0;
+
+	std::string path = options.segmentDir + "/" + segment.name;
+	//Open it
+	fd = OpenFile(path,options.directIO);
+	//Check
+	if (fd<0)
+	{
+		fd = FD_INVALID;
+		return Error("-FragmentedMP4Writer::StartSegment() | could not open file [path:%s,errno:%d]\n",path.c_str(),errno);
+	}
+
+	//Add it
+	segments.push_back(std::move(segment));
+	offset = 0;
+	stats.segments++;
+
+	return true;
+}
+
+bool FragmentedMP4Writer::WritePlaylist(bool ended)
+{
+	char line[256];
+	std::string playlist;
+
+	//Get target duration
+	double target = 1;
+	for (const auto& segment : segments)
+		target = std::max(target,segment.duration);
+
+	//Parts are only listed for the last segments while not ended
+	bool parts = false;
+	for (size_t i=segments.size()>3 ? segments.size()-3 : 0;i<segments.size() && !ended;++i)
+		parts |= !segments[i].parts.empty();
+
+	playlist += "#EXTM3U\n";
+	playlist += "#EXT-X-VERSION:9\n";
+	snprintf(line,sizeof(line),"#EXT-X-TARGETDURATION:%d\n",(int)std::ceil(target));
+	playlist += line;
+	//If there are parts
+	if (parts)
+	{
+		//Players must stay at least three parts behind the live edge
+		snprintf(line,sizeof(line),"#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=%.3f\n",maxPartDuration*3);
+		playlist += line;
+		snprintf(line,sizeof(line),"#EXT-X-PART-INF:PART-TARGET=%.3f\n",maxPartDuration);
+		playlist += line;
+	}
+	playlist += "#EXT-X-PLAYLIST-TYPE:EVENT\n";
+	playlist += "#EXT-X-MAP:URI=\"init.mp4\"\n";
+
+	for (size_t i=0;i<segments.size();++i)
+	{
+		const auto& segment = segments[i];
+		//Parts are only listed for the last segments
+		if (!ended && i+3>=segments.size())
+		{
+			for (const auto& part : segment.parts)
+			{
+				snprintf(line,sizeof(line),"#EXT-X-PART:DURATION=%.3f,URI=\"%s\",BYTERANGE=\"%u@%" PRIu64 "\"%s\n",
+					part.duration,segment.name.c_str(),part.size,part.offset,part.independent ? ",INDEPENDENT=YES" : "");
+				playlist += line;
+			}
+		}
+		//Current segment is not complete yet
+		if (ended || i+1<segments.size())
+		{
+			snprintf(line,sizeof(line),"#EXTINF:%.3f,\n",segment.duration);
+			playlist += line;
+			playlist += segment.name + "\n";
+		}
+	}
+
+	if (ended)
+		playlist += "#EXT-X-ENDLIST\n";
+
+	//Write to temporal file and rename, so readers never see it half written
+	std::string tmp = filename + ".tmp";
+	FILE* file = fopen(tmp.c_str(),"w");
+	//Check
+	if (!file)
+		return Error("-FragmentedMP4Writer::WritePlaylist() | could not open file [path:%s,errno:%d]\n",tmp.c_str(),errno);
+	bool res = fwrite(playlist.data(),1,playlist.size(),file)==playlist.size();
+	res = !fclose(file) && res;
+	//Replace
+	if (!res || rename(tmp.c_str(),filename.c_str()))
+		return Error("-FragmentedMP4Writer::WritePlaylist() | could not write playlist [path:%s,errno:%d]\n",filename.c_str(),errno);
+
+	return true;
+}
+
+bool FragmentedMP4Writer::Reserve(DWORD size)
+{
+	//Check if we have enough
+	if (size<=bufferSize)
+		return true;
+
+	//Round up
+	DWORD capacity = (size + BufferAlignment - 1) / BufferAlignment * BufferAlignment;
+	void* ptr = nullptr;
+	//Allocate aligned
+	if (posix_memalign(&ptr,BufferAlignment,capacity))
+		return Error("-FragmentedMP4Writer::Reserve() | could not allocate buffer [size:%u]\n",capacity);
+
+	//Replace old one, contents not needed
+	free(buffer);
+	buffer = (BYTE*)ptr;
+	bufferSize = capacity;
+
+	return true;
+}
+
+DWORD FragmentedMP4Writer::Write(int fd, const std::vector<BYTE>& boxes, const std::vector<Track*>& payload)
+{
+	//Get size
+	DWORD size = boxes.size();
+	for (auto track : payload)
+		size += track->data.size();
+
+	//Pad to alignment with a free box
+	DWORD padding = 0;
+	if (options.alignment)
+	{
+		padding = (options.alignment - size % options.alignment) % options.alignment;
+		//Free box needs at least its header
+		if (padding && padding<8)
+			padding += options.alignment;
+	}
+
+	DWORD total = size + padding;
+
+	//Get buffer
+	if (!Reserve(total))
+		return 0;
+
+	//Serialize all
+	BYTE* pos = buffer;
+	memcpy(pos,boxes.data(),boxes.size());
+	pos += boxes.size();
+	for (auto track : payload)
+	{
+		memcpy(pos,track->data.data(),track->data.size());
+		pos += track->data.size();
+	}
+	if (padding)
+	{
+		set4(pos,0,padding);
+		memcpy(pos+4,"free",4);
+		memset(pos+8,0,padding-8);
+	}
+
+	//Write it
+	DWORD written = 0;
+	while (written<total)
+	{
+		ssize_t len = ::write(fd,buffer+written,total-written);
+		//Check error
+		if (len<0)
+		{
+			//Retry
+			if (errno==EINTR)
+				continue;
+			int flags = fcntl(fd,F_GETFL);
+			//If direct io is not supported for this write
+			if (errno==EINVAL && flags!=-1 && (flags & O_DIRECT))
+			{
+				Warning("-FragmentedMP4Writer::Write() | direct io write failed, using buffered io [filename:%s]\n",filename.c_str());
+				//Disable it and retry
+				if (fcntl(fd,F_SETFL,flags & ~O_DIRECT)!=-1)
+					continue;
+			}
+			return Error("-FragmentedMP4Writer::Write() | write failed [filename:%s,errno:%d]\n",filename.c_str(),errno);
+		}
+		written += len;
+	}
+
+	//Update stats
+	stats.writes++;
+	stats.bytes += total;
+
+	return total;
+}
+
+void FragmentedMP4Writer::SerializeInit(std::vector<BYTE>& out) const
+{
+	//CMAF compatible
+	auto ftyp = BeginBox(out,"ftyp");
+	PutType(out,"iso6");
+	Put4(out,0);
+	PutType(out,"iso6");
+	PutType(out,"cmfc");
+	PutType(out,"mp41");
+	EndBox(out,ftyp);
+
+	auto moov = BeginBox(out,"moov");
+
+	auto mvhd = BeginFullBox(out,"mvhd",0,0);
+	//Creation and modification time
+	Put4(out,0);
+	Put4(out,0);
+	//Timescale and duration, unknown as it is fragmented
+	Put4(out,1000);
+	Put4(out,0);
+	//Rate and volume
+	Put4(out,0x00010000);
+	Put2(out,0x0100);
+	PutZeros(out,10);
+	for (auto val : Matrix)
+		Put4(out,val);
+	PutZeros(out,24);
+	//Next track id
+	Put4(out,tracks.size()+1);
+	EndBox(out,mvhd);
+
+	for (const auto& track : tracks)
+		SerializeTrack(out,track);
+
+	//Samples are on the fragments
+	auto mvex = BeginBox(out,"mvex");
+	for (const auto& track : tracks)
+	{
+		auto trex = BeginFullBox(out,"trex",0,0);
+		Put4(out,track.id);
+		//Sample description index
+		Put4(out,1);
+		//Default duration, size and flags
+		Put4(out,0);
+		Put4(out,0);
+		Put4(out,0);
+		EndBox(out,trex);
+	}
+	EndBox(out,mvex);
+
+	EndBox(out,moov);
+}
+
+void FragmentedMP4Writer::SerializeTrack(std::vector<BYTE>& out, const Track& track) const
+{
+	bool video = track.media==MediaFrame::Video;
+
+	auto trak = BeginBox(out,"trak");
+
+	//Enabled and in movie
+	auto tkhd = BeginFullBox(out,"tkhd",0,0x03);
+	Put4(out,0);
+	Put4(out,0);
+	Put4(out,track.id);
+	Put4(out,0);
+	//Duration
+	Put4(out,0);
+	PutZeros(out,8);
+	//Layer and alternate group
+	Put2(out,0);
+	Put2(out,0);
+	//Volume
+	Put2(out,video ? 0 : 0x0100);
+	Put2(out,0);
+	for (auto val : Matrix)
+		Put4(out,val);
+	//Width and height in 16.16
+	Put4(out,track.width<<16);
+	Put4(out,track.height<<16);
+	EndBox(out,tkhd);
+
+	auto mdia = BeginBox(out,"mdia");
+
+	auto mdhd = BeginFullBox(out,"mdhd",0,0);
+	Put4(out,0);
+	Put4(out,0);
+	Put4(out,track.rate);
+	Put4(out,0);
+	//Language "und"
+	Put2(out,0x55C4);
+	Put2(out,0);
+	EndBox(out,mdhd);
+
+	auto hdlr = BeginFullBox(out,"hdlr",0,0);
+	Put4(out,0);
+	PutType(out,video ? "vide" : "soun");
+	PutZeros(out,12);
+	const char* handler = video ? "VideoHandler" : "SoundHandler";
+	PutBytes(out,(const BYTE*)handler,strlen(handler)+1);
+	EndBox(out,hdlr);
+
+	auto minf = BeginBox(out,"minf");
+
+	if (video)
+	{
+		auto vmhd = BeginFullBox(out,"vmhd",0,0x01);
+		PutZeros(out,8);
+		EndBox(out,vmhd);
+	} else {
+		auto smhd = BeginFullBox(out,"smhd",0,0);
+		PutZeros(out,4);
+		EndBox(out,smhd);
+	}
+
+	auto dinf = BeginBox(out,"dinf");
+	auto dref = BeginFullBox(out,"dref",0,0);
+	Put4(out,1);
+	//Data in same file
+	auto url = BeginFullBox(out,"url ",0,0x01);
+	EndBox(out,url);
+	EndBox(out,dref);
+	EndBox(out,dinf);
+
+	auto stbl = BeginBox(out,"stbl");
+	auto stsd = BeginFullBox(out,"stsd",0,0);
+	Put4(out,1);
+	SerializeSampleEntry(out,track);
+	EndBox(out,stsd);
+	//Empty tables
+	auto stts = BeginFullBox(out,"stts",0,0);
+	Put4(out,0);
+	EndBox(out,stts);
+	auto stsc = BeginFullBox(out,"stsc",0,0);
+	Put4(out,0);
+	EndBox(out,stsc);
+	auto stsz = BeginFullBox(out,"stsz",0,0);
+	Put4(out,0);
+	Put4(out,0);
+	EndBox(out,stsz);
+	auto stco = BeginFullBox(out,"stco",0,0);
+	Put4(out,0);
+	EndBox(out,stco);
+	EndBox(out,stbl);
+
+	EndBox(out,minf);
+	EndBox(out,mdia);
+
+	//Track name
+	if (!track.name.empty())
+	{
+		auto udta = BeginBox(out,"udta");
+		auto name = BeginBox(out,"name");
+		PutBytes(out,(const BYTE*)track.name.data(),track.name.size());
+		EndBox(out,name);
+		EndBox(out,udta);
+	}
+
+	EndBox(out,trak);
+}
+
+void FragmentedMP4Writer::SerializeSampleEntry(std::vector<BYTE>& out, const Track& track) const
+{
+	if (track.media==MediaFrame::Video)
+	{
+		auto entry = BeginBox(out,track.codec==VideoCodec::H264 ? "avc1" : track.codec==VideoCodec::VP8 ? "vp08" : "vp09");
+		PutZeros(out,6);
+		//Data reference index
+		Put2(out,1);
+		PutZeros(out,16);
+		Put2(out,track.width);
+		Put2(out,track.height);
+		//72 dpi
+		Put4(out,0x00480000);
+		Put4(out,0x00480000);
+		Put4(out,0);
+		//Frame count
+		Put2(out,1);
+		//Compressor name
+		PutZeros(out,32);
+		//Depth
+		Put2(out,0x0018);
+		Put2(out,0xFFFF);
+
+		if (track.codec==VideoCodec::H264)
+		{
+			auto avcC = BeginBox(out,"avcC");
+			Put1(out,1);
+			//Profile, compatibility and level from SPS, baseline 1.3 if not known
+			Put1(out,track.sps.size()>3 ? track.sps[1] : 0x42);
+			Put1(out,track.sps.size()>3 ? track.sps[2] : 0xC0);
+			Put1(out,track.sps.size()>3 ? track.sps[3] : 0x0D);
+			//4 bytes NAL length
+			Put1(out,0xFF);
+			Put1(out,0xE0 | (track.sps.empty() ? 0 : 1));
+			if (!track.sps.empty())
+			{
+				Put2(out,track.sps.size());
+				PutBytes(out,track.sps.data(),track.sps.size());
+			}
+			Put1(out,track.pps.empty() ? 0 : 1);
+			if (!track.pps.empty())
+			{
+				Put2(out,track.pps.size());
+				PutBytes(out,track.pps.data(),track.pps.size());
+			}
+			EndBox(out,avcC);
+		} else {
+			auto vpcC = BeginFullBox(out,"vpcC",1,0);
+			//Profile and level
+			Put1(out,0);
+			Put1(out,0);
+			//8 bits, 4:2:0 colocated, limited range
+			Put1(out,8<<4 | 1<<1);
+			//Unspecified colour primaries, transfer and matrix
+			Put1(out,2);
+			Put1(out,2);
+			Put1(out,2);
+			//No codec initialization data
+			Put2(out,0);
+			EndBox(out,vpcC);
+		}
+		EndBox(out,entry);
+	} else {
+		const char* type = track.codec==AudioCodec::OPUS ? "Opus" : track.codec==AudioCodec::AAC ? "mp4a" : track.codec==AudioCodec::PCMU ? "ulaw" : "alaw";
+		auto entry = BeginBox(out,type);
+		PutZeros(out,6);
+		//Data reference index
+		Put2(out,1);
+		PutZeros(out,8);
+		Put2(out,track.channels);
+		//Sample size
+		Put2(out,16);
+		PutZeros(out,4);
+		//Sample rate in 16.16, if it fits
+		Put4(out,track.rate<0x10000 ? track.rate<<16 : 0);
+
+		if (track.codec==AudioCodec::OPUS)
+		{
+			auto dOps = BeginBox(out,"dOps");
+			Put1(out,0);
+			Put1(out,track.channels);
+			//Pre skip
+			Put2(out,312);
+			Put4(out,track.rate);
+			//Output gain
+			Put2(out,0);
+			//Channel mapping family
+			Put1(out,0);
+			EndBox(out,dOps);
+		} else if (track.codec==AudioCodec::AAC) {
+			DWORD config = track.config.size();
+			auto esds = BeginFullBox(out,"esds",0,0);
+			//ES descriptor
+			Put1(out,0x03);
+			Put1(out,3 + 2+13 + 2+config + 3);
+			Put2(out,track.id);
+			Put1(out,0);
+			//Decoder config descriptor, AAC audio stream
+			Put1(out,0x04);
+			Put1(out,13 + 2+config);
+			Put1(out,0x40);
+			Put1(out,0x15);
+			//Buffer size, max and avg bitrate
+			Put3(out,0);
+			Put4(out,0);
+			Put4(out,0);
+			//Decoder specific info
+			Put1(out,0x05);
+			Put1(out,config);
+			PutBytes(out,track.config.data(),config);
+			//SL config descriptor
+			Put1(out,0x06);
+			Put1(out,1);
+			Put1(out,0x02);
+			EndBox(out,esds);
+		}
+		EndBox(out,entry);
+	}
+}
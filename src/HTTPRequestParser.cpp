@@ -0,0 +1,227 @@
+#include "HTTPRequestParser.h"
+
+#include <string.h>
+
+namespace
+{
+	std::string_view Trim(std::string_view str)
+	{
+		//Remove optional white space
+		while (!str.empty() && (str.front()==' ' || str.front()=='\t'))
+			str.remove_prefix(1);
+		while (!str.empty() && (str.back()==' ' || str.back()=='\t'))
+			str.remove_suffix(1);
+		return str;
+	}
+
+	bool ContainsToken(std::string_view value, std::string_view token)
+	{
+		//Comma separated list
+		while (!value.empty())
+		{
+			auto pos = value.find(',');
+			//Check item
+			if (HTTPRequestParser::EqualsIgnoreCase(Trim(value.substr(0,pos)),token))
+				return true;
+			//If last one
+			if (pos==std::string_view::npos)
+				break;
+			//Next
+			value.remove_prefix(pos+1);
+		}
+		return false;
+	}
+}
+
+bool HTTPRequestParser::EqualsIgnoreCase(std::string_view a, std::string_view b)
+{
+	return a.size()==b.size() && strncasecmp(a.data(),b.data(),a.size())==0;
+}
+
+std::string_view HTTPRequestParser::Request::GetHeader(std::string_view name) const
+{
+	//Linear search, there are only a few of them
+	for (const auto& header : headers)
+		if (EqualsIgnoreCase(View(header.name),name))
+			return View(header.value);
+	//Not found
+	return {};
+}
+
+bool HTTPRequestParser::Request::HasHeader(std::string_view name) const
+{
+	for (const auto& header : headers)
+		if (EqualsIgnoreCase(View(header.name),name))
+			return true;
+	return false;
+}
+
+void HTTPRequestParser::Reset()
+{
+	scanned = 0;
+	headersSize = 0;
+	contentLength = 0;
+	completed = false;
+	//Keep capacity
+	request.headers.clear();
+	request.data = nullptr;
+	request.keepAlive = true;
+}
+
+HTTPRequestParser::Result HTTPRequestParser::Parse(const char* data, size_t size, size_t& consumed)
+{
+	//Start new request if previous one was completed
+	if (completed)
+		Reset();
+
+	//If we don't have the headers yet
+	if (!headersSize)
+	{
+		//Look for the end of headers, continuing where we left it
+		size_t from = scanned>3 ? scanned-3 : 0;
+		const char* end = size>from ? (const char*)memmem(data+from,size-from,"\r\n\r\n",4) : nullptr;
+
+		//If not found
+		if (!end)
+		{
+			//Don't search again what we already have
+			scanned = size;
+			//Check limits
+			return size>MaxHeaderSize ? Failed : NeedMoreData;
+		}
+
+		//Got headers
+		headersSize = end-data+4;
+
+		//Check limits and parse them
+		if (headersSize>MaxHeaderSize || !ParseHeaders(data,headersSize))
+			return Failed;
+	}
+
+	//Check we have the whole body
+	if (size<headersSize+contentLength)
+		return NeedMoreData;
+
+	//Views are created on this buffer
+	request.data = data;
+	request.body.pos = headersSize;
+	request.body.len = contentLength;
+
+	//Done
+	consumed = headersSize+contentLength;
+	completed = true;
+
+	return Complete;
+}
+
+bool HTTPRequestParser::ParseHeaders(const char* data, size_t size)
+{
+	size_t pos = 0;
+
+	//Ignore empty lines before the request line
+	while (pos<size && (data[pos]=='\r' || data[pos]=='\n'))
+		++pos;
+
+	//Get request line
+	const char* eol = (const char*)memmem(data+pos,size-pos,"\r\n",2);
+	if (!eol)
+		return false;
+	std::string_view line(data+pos,eol-data-pos);
+
+	//Get method
+	auto sp = line.find(' ');
+	if (sp==0 || sp==std::string_view::npos)
+		return false;
+	request.method = {(uint32_t)pos,(uint32_t)sp};
+
+	//Get uri
+	auto sp2 = line.find(' ',sp+1);
+	if (sp2==std::string_view::npos || sp2==sp+1)
+		return false;
+	request.uri = {(uint32_t)(pos+sp+1),(uint32_t)(sp2-sp-1)};
+
+	//Get version
+	std::string_view version = line.substr(sp2+1);
+	if (version.substr(0,7)!="HTTP/1.")
+		return false;
+	request.version = {(uint32_t)(pos+sp2+1),(uint32_t)version.size()};
+
+	//Persistent by default only on HTTP/1.1
+	request.keepAlive = version!="HTTP/1.0";
+
+	//Next line
+	pos = eol-data+2;
+
+	bool hasContentLength = false;
+
+	//Until the empty line
+	while (pos+2<size)
+	{
+		//Get header line
+		eol = (const char*)memmem(data+pos,size-pos,"\r\n",2);
+		if (!eol)
+			return false;
+		std::string_view line(data+pos,eol-data-pos);
+
+		//Obsolete line folding is not supported
+		if (line.empty() || line.front()==' ' || line.front()=='\t')
+			return false;
+
+		//Get name
+		auto colon = line.find(':');
+		if (colon==0 || colon==std::string_view::npos)
+			return false;
+		std::string_view name = line.substr(0,colon);
+		//No white space allowed before the colon
+		if (name.back()==' ' || name.back()=='\t')
+			return false;
+
+		//Get value
+		std::string_view value = Trim(line.substr(colon+1));
+
+		//Check limits
+		if (request.headers.size()==MaxHeaders)
+			return false;
+
+		//Add it
+		Request::Header header;
+		header.name = {(uint32_t)pos,(uint32_t)name.size()};
+		header.value = {(uint32_t)(value.data()-data),(uint32_t)value.size()};
+		request.headers.push_back(header);
+
+		//Check the ones we care about
+		if (EqualsIgnoreCase(name,"Content-Length"))
+		{
+			//Must be a number
+			if (value.empty() || value.size()>10)
+				return false;
+			size_t length = 0;
+			for (char c : value)
+			{
+				if (c<'0' || c>'9')
+					return false;
+				length = length*10 + (c-'0');
+			}
+			//Check limits and that it is consistent with any previous one
+			if (length>MaxBodySize || (hasContentLength && length!=contentLength))
+				return false;
+			contentLength = length;
+			hasContentLength = true;
+		} else if (EqualsIgnoreCase(name,"Transfer-Encoding")) {
+			//Chunked bodies not supported
+			return false;
+		} else if (EqualsIgnoreCase(name,"Connection")) {
+			//Check persistence
+			if (ContainsToken(value,"close"))
+				request.keepAlive = false;
+			else if (ContainsToken(value,"keep-alive"))
+				request.keepAlive = true;
+		}
+
+		//Next line
+		pos = eol-data+2;
+	}
+
+	//Done
+	return true;
+}
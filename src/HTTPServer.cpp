@@ -0,0 +1,601 @@
+#include "HTTPServer.h"
+
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+
+#include "log.h"
+#include "assertions.h"
+
+//Close idle keep-alive connections
+constexpr auto IdleTimeout = std::chrono::milliseconds(60000);
+
+/********************************
+ * Connection
+ *	Parses pipelined requests from the receive buffer without copying them
+ *	and sends back responses in order once processed by the workers.
+ ********************************/
+class HTTPServer::Connection :
+	public std::enable_shared_from_this<HTTPServer::Connection>,
+	public EpollReactor::Handler
+{
+public:
+	Connection(HTTPServer* server, int fd, EpollReactor* reactor) :
+		server(server),
+		reactor(reactor),
+		socket(fd)
+	{
+	}
+
+	~Connection()
+	{
+		//If it was never registered on the reactor
+		if (running)
+			MCU_CLOSE(socket);
+	}
+
+	void Start()
+	{
+		//Last time we had activity
+		lastActivity = reactor->GetNow();
+
+		//Wait for requests, the reactor holds a reference to us until disconnected
+		if (!reactor->AddHandler(socket,EPOLLIN,shared_from_this()))
+			return Disconnect();
+
+		//Close idle connections
+		timeoutTimer = reactor->CreateTimer(IdleTimeout,[self=weak_from_this()](auto now){
+			//If still alive
+			if (auto connection = self.lock())
+				//Check activity
+				connection->OnTimeout(now);
+		});
+	}
+
+	void Disconnect()
+	{
+		//Check not already disconnected
+		if (!running)
+			return;
+
+		//Stop timer
+		if (timeoutTimer)
+			timeoutTimer->Cancel();
+		timeoutTimer.reset();
+
+		//Keep us alive until we are done
+		auto self = shared_from_this();
+
+		//Remove from reactor before closing the socket
+		reactor->RemoveHandler(socket);
+		//Close it
+		running = false;
+		MCU_CLOSE(socket);
+
+		//Drop responses, workers may still be processing requests and hold references to us
+		exchanges.clear();
+		output.clear();
+
+		//Remove from server
+		server->OnDisconnected(self);
+	}
+
+	EpollReactor* GetReactor() const { return reactor; }
+
+	virtual void OnEvent(uint32_t events) override
+	{
+		//Check if we can write more
+		if (events & EPOLLOUT)
+		{
+			//We can write again
+			writable = true;
+			//Write pending data
+			Flush();
+		}
+
+		//Read incoming data
+		if ((events & EPOLLIN) && running)
+			Read();
+
+		//Check errors
+		if ((events & EPOLLHUP) || (events & EPOLLERR))
+			Disconnect();
+	}
+private:
+	struct Exchange
+	{
+		Response response;
+		bool keepAlive = true;
+		bool done = false;
+		std::string head;
+	};
+
+	void Read()
+	{
+		//Get unparsed data size
+		size_t pending = end-start;
+		//If there is no room left for reading
+		if (end+ReadSize>capacity)
+		{
+			//If nobody else is using the buffer
+			if (buffer.use_count()==1 && pending+ReadSize<=capacity)
+			{
+				//Move unparsed data to the beginning
+				memmove(buffer.get(),buffer.get()+start,pending);
+			} else {
+				//Allocate new one, in flight requests keep referencing the old one
+				size_t size = capacity;
+				//Grow it if needed for big requests
+				if (pending+ReadSize>size)
+					size = std::max(pending+ReadSize,capacity*2);
+				std::shared_ptr<char[]> aux(new char[size]);
+				//Copy unparsed data only
+				if (pending)
+					memcpy(aux.get(),buffer.get()+start,pending);
+				buffer = aux;
+				capacity = size;
+			}
+			start = 0;
+			end = pending;
+		}
+
+		//Read data from connection
+		ssize_t len = read(socket,buffer.get()+end,capacity-end);
+
+		//Check error
+		if (len<0 && (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR))
+			//Nothing to read yet
+			return;
+		if (len<=0)
+			//Closed by peer
+			return Disconnect();
+
+		//Got more data
+		end += len;
+		//We had activity
+		lastActivity = reactor->GetNow();
+
+		//Process all the requests we got
+		Process();
+	}
+
+	void Process()
+	{
+		//While we can accept more requests
+		while (running && !closing && exchanges.size()<MaxPipelinedRequests && end>start)
+		{
+			size_t consumed = 0;
+
+			//Parse next request in place
+			auto result = parser.Parse(buffer.get()+start,end-start,consumed);
+
+			//If not enough
+			if (result==HTTPRequestParser::NeedMoreData)
+				break;
+
+			//Create new exchange, responses must be sent in order
+			auto exchange = std::make_shared<Exchange>();
+			exchanges.push_back(exchange);
+
+			//If it could not be parsed
+			if (result==HTTPRequestParser::Failed)
+			{
+				Debug("-HTTPServer::Connection::Process() | Bad request [socket:%d]\n",socket);
+				//Send error and close connection
+				exchange->response.code = 400;
+				exchange->keepAlive = false;
+				exchange->done = true;
+				closing = true;
+				break;
+			}
+
+			//Get request, views point into our buffer
+			const auto& request = parser.GetRequest();
+			//Move to next one
+			start += consumed;
+			//Store persistence
+			exchange->keepAlive = request.IsKeepAlive();
+			//If connection is closed after this one, ignore anything else
+			closing = !exchange->keepAlive;
+
+			//Find handler
+			auto handler = server->GetHandler(request.GetURI());
+
+			//If not found
+			if (!handler)
+			{
+				//Not found
+				exchange->response.code = 404;
+				exchange->done = true;
+				continue;
+			}
+
+			//Get ordering key
+			QWORD key = handler->GetOrderingKey(request);
+
+			//Process it on the worker pool, the buffer is kept alive until done
+			server->workers.Post(key,[self=shared_from_this(),exchange,request,handler,data=buffer](){
+				//Process request
+				handler->ProcessRequest(request,exchange->response);
+				//Send response on the reactor
+				self->reactor->Async([self,exchange](auto now){
+					//Done
+					exchange->done = true;
+					//Send responses that are ready
+					self->OnResponse();
+				});
+			});
+		}
+
+		//Stop reading if we can't accept more requests until responses are sent
+		UpdateEvents();
+
+		//Send already completed responses
+		OnResponse();
+	}
+
+	void OnResponse()
+	{
+		//Check we are still connected
+		if (!running)
+			return;
+
+		//Serialize responses ready to be sent, in order
+		for (auto it=exchanges.begin(); it!=exchanges.end() && (*it)->done; ++it)
+		{
+			//Skip already serialized
+			if (!(*it)->head.empty())
+				continue;
+
+			auto& response = (*it)->response;
+			auto& head = (*it)->head;
+
+			//Serialize status line and headers
+			head.reserve(128);
+			head += "HTTP/1.1 " + std::to_string(response.code) + " " + GetReason(response.code) + "\r\n";
+			if (!response.contentType.empty())
+				head += "Content-Type: " + response.contentType + "\r\n";
+			head += "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+			head += (*it)->keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+
+			//Queue for writing
+			output.push_back(*it);
+		}
+
+		//Write them
+		Flush();
+	}
+
+	void Flush()
+	{
+		//Check we are still connected and socket is not full
+		if (!running || !writable)
+			return;
+
+		while (!output.empty())
+		{
+			//Gather responses without copying them
+			iovec iov[MaxIovecs];
+			int num = 0;
+			size_t size = 0;
+			//Skip already written data of first one
+			size_t offset = outputOffset;
+
+			for (auto it=output.begin(); it!=output.end() && num+2<=MaxIovecs; ++it)
+			{
+				const auto& head = (*it)->head;
+				const auto& body = (*it)->response.body;
+				//Check if head has not been written
+				if (offset<head.size())
+				{
+					iov[num].iov_base = (void*)(head.data()+offset);
+					iov[num].iov_len = head.size()-offset;
+					size += iov[num++].iov_len;
+					offset = 0;
+				} else {
+					//Skip head
+					offset -= head.size();
+				}
+				//Add body
+				if (offset<body.size())
+				{
+					iov[num].iov_base = (void*)(body.data()+offset);
+					iov[num].iov_len = body.size()-offset;
+					size += iov[num++].iov_len;
+				}
+				//Only first one may be partially written
+				offset = 0;
+			}
+
+			msghdr msg = {};
+			msg.msg_iov = iov;
+			msg.msg_iovlen = num;
+
+			//Send them, like writev but without raising SIGPIPE
+			ssize_t len = sendmsg(socket,&msg,MSG_NOSIGNAL | MSG_DONTWAIT);
+
+			//Check error
+			if (len<0)
+			{
+				//If interrupted
+				if (errno==EINTR)
+					continue;
+				//If socket buffer is full
+				if (errno==EAGAIN || errno==EWOULDBLOCK)
+					break;
+				//Let the reactor disconnect us
+				Debug("-HTTPServer::Connection::Flush() | Error writing [socket:%d,errno:%d]\n",socket,errno);
+				writable = false;
+				shutdown(socket,SHUT_RDWR);
+				return;
+			}
+
+			//We had activity
+			lastActivity = reactor->GetNow();
+
+			//Remove written responses
+			size_t left = len;
+			while (left)
+			{
+				const auto& exchange = output.front();
+				//Get remaining data on first one
+				size_t remaining = exchange->head.size()+exchange->response.body.size()-outputOffset;
+				//If partially written
+				if (left<remaining)
+				{
+					//Skip written
+					outputOffset += left;
+					break;
+				}
+				//Fully written
+				left -= remaining;
+				outputOffset = 0;
+				//If it was the last one
+				if (!exchange->keepAlive)
+				{
+					//Close connection, the reactor will disconnect us
+					writable = false;
+					shutdown(socket,SHUT_RDWR);
+					return;
+				}
+				//Remove from both queues, it is always the first one
+				output.pop_front();
+				exchanges.pop_front();
+			}
+
+			//If we could not write everything
+			if ((size_t)len<size)
+				break;
+		}
+
+		//If there is something pending
+		writable = output.empty();
+
+		//Resume reading requests if we have stopped and there are still some buffered
+		if (writable && !closing && exchanges.size()<MaxPipelinedRequests && end>start && !reading)
+			return Process();
+
+		//Update events
+		UpdateEvents();
+	}
+
+	void UpdateEvents()
+	{
+		//Read when we can accept more requests, write when socket was full
+		bool read = !closing && exchanges.size()<MaxPipelinedRequests;
+		bool write = !writable;
+
+		//Check if changed
+		if (!running || (read==reading && write==waitingWritable))
+			return;
+
+		//Update events on reactor
+		reactor->ModifyHandler(socket,(read ? EPOLLIN : 0) | (write ? EPOLLOUT : 0));
+
+		//Store
+		reading = read;
+		waitingWritable = write;
+	}
+
+	void OnTimeout(std::chrono::milliseconds now)
+	{
+		//Check we are still connected
+		if (!running)
+			return;
+
+		//Get time since last activity
+		auto elapsed = now - lastActivity;
+
+		//If idle and no request is being processed
+		if (elapsed>=IdleTimeout && exchanges.empty())
+			return Disconnect();
+
+		//Check again later
+		timeoutTimer->Again(IdleTimeout);
+	}
+private:
+	static constexpr size_t ReadSize = 16*1024;
+	static constexpr int MaxIovecs = 64;
+
+	HTTPServer* server;
+	EpollReactor* reactor;
+	int socket;
+	bool running = true;
+	bool closing = false;
+	bool writable = true;
+	bool reading = true;
+	bool waitingWritable = false;
+
+	Timer::shared timeoutTimer;
+	std::chrono::milliseconds lastActivity = 0ms;
+
+	//Receive buffer, shared with the requests being processed
+	std::shared_ptr<char[]> buffer;
+	size_t capacity = 0;
+	size_t start = 0;
+	size_t end = 0;
+	HTTPRequestParser parser;
+
+	//Requests in order of arrival, and the ones being written
+	std::deque<std::shared_ptr<Exchange>> exchanges;
+	std::deque<std::shared_ptr<Exchange>> output;
+	size_t outputOffset = 0;
+};
+
+HTTPServer::HTTPServer() :
+	listener("http"),
+	workers("http-worker")
+{
+}
+
+HTTPServer::~HTTPServer()
+{
+	//Check we have been correctly ended
+	if (inited)
+		//End it anyway
+		End();
+}
+
+void HTTPServer::AddHandler(const std::string& base, Handler* handler)
+{
+	Log("-HTTPServer::AddHandler() [base:%s]\n",base.c_str());
+
+	//Add it
+	handlers[base] = handler;
+}
+
+HTTPServer::Handler* HTTPServer::GetHandler(std::string_view uri) const
+{
+	//Search in reverse order, same as the xmlrpc server
+	for (auto it=handlers.rbegin(); it!=handlers.rend(); ++it)
+		//If uri starts with handler base
+		if (uri.substr(0,it->first.size())==it->first)
+			return it->second;
+	//Not found
+	return nullptr;
+}
+
+int HTTPServer::Init(int port, const char* iface, DWORD threads, DWORD numWorkers)
+{
+	//Check not already inited
+	if (inited)
+		//Error
+		return Error("-HTTPServer::Init() | already running\n");
+
+	Log("-HTTPServer::Init() [port:%d,threads:%u,workers:%u]\n",port,threads,numWorkers);
+
+	//Listen and create reactors, connections are multiplexed on them
+	if (!listener.Start(port,iface ? inet_addr(iface) : INADDR_ANY,threads,[this](int fd,EpollReactor* reactor){ CreateConnection(fd,reactor); }))
+		return 0;
+
+	//I am inited
+	inited = 1;
+
+	//Start workers
+	workers.Start(numWorkers);
+
+	//Return ok
+	return 1;
+}
+
+void HTTPServer::CreateConnection(int fd, EpollReactor* reactor)
+{
+	//Set no delay option, responses are written at once
+	int flag = 1;
+	(void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(int));
+
+	//Create new connection
+	auto connection = std::make_shared<Connection>(this,fd,reactor);
+
+	{
+		//Lock list
+		std::lock_guard<std::mutex> lock(mutex);
+		//Append before starting as it could be disconnected inmediatelly
+		connections.insert(connection);
+	}
+
+	//Register on its reactor
+	reactor->Async([connection](auto now){
+		connection->Start();
+	});
+}
+
+void HTTPServer::OnDisconnected(const std::shared_ptr<Connection>& connection)
+{
+	//Lock list
+	std::lock_guard<std::mutex> lock(mutex);
+	//Remove it, will be deleted when released by the reactor and workers
+	if (connections.erase(connection))
+		//Not running on its reactor anymore
+		listener.Release(connection->GetReactor());
+}
+
+int HTTPServer::End()
+{
+	//Check we have been inited
+	if (!inited)
+		//Do nothing
+		return 0;
+
+	Log(">HTTPServer::End()\n");
+
+	//Stop accepting
+	inited = 0;
+
+	//Close server socket
+	listener.StopAccepting();
+
+	std::set<std::shared_ptr<Connection>> ending;
+	{
+		//Lock list
+		std::lock_guard<std::mutex> lock(mutex);
+		//Get current connections
+		ending = connections;
+	}
+
+	//Disconnect them on their reactors
+	for (auto& connection : ending)
+		connection->GetReactor()->Future([connection](auto now){
+			connection->Disconnect();
+		}).wait();
+
+	//Run pending requests
+	workers.Stop();
+
+	//Stop reactors
+	listener.Stop();
+
+	{
+		//Lock list
+		std::lock_guard<std::mutex> lock(mutex);
+		//Clear all connections
+		connections.clear();
+	}
+
+	Log("<HTTPServer::End()\n");
+
+	return 1;
+}
+
+const char* HTTPServer::GetReason(WORD code)
+{
+	switch (code)
+	{
+		case 200: return "OK";
+		case 204: return "No Content";
+		case 400: return "Bad Request";
+		case 403: return "Forbidden";
+		case 404: return "Not Found";
+		case 405: return "Method Not Allowed";
+		case 411: return "Length Required";
+		case 413: return "Payload Too Large";
+		case 500: return "Internal Server Error";
+		case 503: return "Service Unavailable";
+		default:  return "Unknown";
+	}
+}
@@ -353,6 +353,11 @@ void MediaFrameListenerBridge::onMediaFrame(DWORD ignored, const MediaFrame& fra
 				//TODO: move out of here
 				VideoLayerSelector::GetLayerIds(packet);
 
+				//If it is a rendition of an encoding ladder
+				if (!video->GetRId().empty())
+					//Set its rid
+					packet->SetRId(video->GetRId());
+
 				//If video has a target bitrate and it is the first packet of an intra frame
 				if (i==0 && video->IsIntra() && video->GetTargetBitrate())
 				{
@@ -0,0 +1,144 @@
+#include "OrderedWorkerPool.h"
+
+#include <pthread.h>
+#include <algorithm>
+
+#include "log.h"
+
+OrderedWorkerPool::OrderedWorkerPool(const std::string& name) :
+	name(name)
+{
+}
+
+OrderedWorkerPool::~OrderedWorkerPool()
+{
+	//Stop just in case
+	Stop();
+}
+
+bool OrderedWorkerPool::Start(uint32_t num)
+{
+	//Use one per core by default
+	if (!num)
+		num = std::max(std::thread::hardware_concurrency(),1u);
+
+	Debug("-OrderedWorkerPool::Start() [name:%s,threads:%u]\n",name.c_str(),num);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		//Check not already running
+		if (running)
+			return Error("-OrderedWorkerPool::Start() | already running\n");
+		running = true;
+	}
+
+	//Create threads
+	for (uint32_t i=0;i<num;++i)
+	{
+		threads.emplace_back([this](){ Run(); });
+		//Set name, limited to 15 chars
+		pthread_setname_np(threads.back().native_handle(),(name + "-" + std::to_string(i)).substr(0,15).c_str());
+	}
+
+	//Done
+	return true;
+}
+
+bool OrderedWorkerPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		//Check running
+		if (!running)
+			return false;
+		//Stop once all tasks are run
+		running = false;
+	}
+
+	Debug("-OrderedWorkerPool::Stop() [name:%s]\n",name.c_str());
+
+	//Wake up all
+	cond.notify_all();
+
+	//Wait for them
+	for (auto& thread : threads)
+		thread.join();
+	threads.clear();
+
+	//Done
+	return true;
+}
+
+void OrderedWorkerPool::Post(uint64_t key, Task&& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		//If ordered
+		if (key)
+		{
+			//Check if there is already a task for that key
+			auto it = busy.find(key);
+			//If so
+			if (it!=busy.end())
+			{
+				//Wait for it to finish
+				it->second.push_back(std::move(task));
+				return;
+			}
+			//Mark key as busy
+			busy[key];
+		}
+
+		//Ready to be run
+		ready.push_back(Item{key,std::move(task)});
+	}
+
+	//Wake up one worker
+	cond.notify_one();
+}
+
+void OrderedWorkerPool::Run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true)
+	{
+		//Wait for tasks
+		cond.wait(lock,[this](){ return !ready.empty() || !running; });
+
+		//Exit when there is nothing left to do
+		if (ready.empty())
+			break;
+
+		//Get next task
+		Item item = std::move(ready.front());
+		ready.pop_front();
+
+		//Run it without lock
+		lock.unlock();
+		item.task();
+		//Release captured data before locking again
+		item.task = nullptr;
+		lock.lock();
+
+		//If it was ordered
+		if (item.key)
+		{
+			//Get tasks waiting for it
+			auto it = busy.find(item.key);
+			//If nothing else pending
+			if (it->second.empty())
+			{
+				//Not busy anymore
+				busy.erase(it);
+			} else {
+				//Next one is ready, queued after the others so keys are served fairly
+				ready.push_back(Item{item.key,std::move(it->second.front())});
+				it->second.pop_front();
+				//Wake up other worker in case we are busy
+				cond.notify_one();
+			}
+		}
+	}
+}
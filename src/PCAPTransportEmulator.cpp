@@ -36,8 +36,13 @@ void PCAPTransportEmulator::SetRemoteProperties(const Properties& properties)
 		AudioCodec::Type codec = AudioCodec::GetCodecForName(it->GetProperty("codec"));
 		//Get codec type
 		BYTE type = it->GetProperty("pt",0);
+		//Get fec codec, as audio can be protected too
+		VideoCodec::Type fec = VideoCodec::GetCodecForName(it->GetProperty("codec"));
 		//ADD it
-		rtpMap.SetCodecForType(type, codec);
+		if (codec==AudioCodec::UNKNOWN && (fec==VideoCodec::FLEXFEC || fec==VideoCodec::ULPFEC))
+			rtpMap.SetCodecForType(type, fec);
+		else
+			rtpMap.SetCodecForType(type, codec);
 	}
 	
 	//Clear codecs
@@ -205,6 +210,8 @@ bool PCAPTransportEmulator::SetReader(UDPReader* reader)
 	
 	//Store it
 	this->reader.reset(reader);
+	//Drop fec state of previous one
+	decoders.clear();
 	
 	//Get first timestamp to start playing from
 	first = reader->Seek(0)/1000;
@@ -267,6 +274,8 @@ uint64_t PCAPTransportEmulator::Seek(uint64_t time)
 	
 	//Store start time
 	first = time;
+	//Drop fec state, as packets will not be consecutive
+	decoders.clear();
 	
 	//Seek it and return which is the first packet that will be played
 	return reader->Seek(time*1000)/1000;
@@ -402,92 +411,9 @@ outher:	while(running)
 			//Next
 			goto outher;
 		}
-	
-		RTPHeader header;
-		RTPHeaderExtension extension;
-
-		//Parse RTP header
-		uint32_t len = header.Parse(data,size);
-
-		//On error
-		if (!len)
-		{
-			//Debug
-			Error("-PCAPTransportEmulator::Run() | Could not parse RTP header ini=%u len=%d\n",len,size-len);
-			//Dump it
-			Dump(data+len,size-len);
-			//Ignore this try again
-			goto outher;
-		}
-	
-		//If it has extension
-		if (header.extension)
-		{
-			//Parse extension
-			int l = extension.Parse(extMap,data+len,size-len);
-			//If not parsed
-			if (!l)
-			{
-				///Debug
-				Error("-PCAPTransportEmulator::Run() | Could not parse RTP header extension ini=%u len=%d\n",len,size-len);
-				//Dump it
-				Dump(data+len,size-len);
-				//retry
-				goto outher;
-			}
-			//Inc ini
-			len += l;
-		}
-	
-		//Check size with padding
-		if (header.padding)
-		{
-			//Get last 2 bytes
-			WORD padding = get1(data,size-1);
-			//Ensure we have enought size
-			if (size-len<padding)
-			{
-				///Debug
-				Debug("-PCAPTransportEmulator::Run() | RTP padding is bigger than size [padding:%u,size%u]\n",padding,size);
-				//Ignore this try again
-				goto outher;
-			}
-			//Remove from size
-			size -= padding;
-		}
-
-		//Check we have payload
-		if (len>=size)
-		{
-			///Debug
-			UltraDebug("-PCAPTransportEmulator::Run() | Refusing to create a packet with empty payload [ini:%u,len:%u]\n",size,len);
-			//Ignore this try again
-			goto outher;
-		}
 
-		//Get initial codec
-		BYTE codec = rtpMap.GetCodecForType(header.payloadType);
-
-		//Check codec
-		if (codec==RTPMap::NotFound)
-		{
-			//Error
-			Error("-PCAPTransportEmulator::Run() | RTP packet type unknown [%d]\n",header.payloadType);
-			//retry
-			goto outher;
-		}
-
-		//Get media
-		MediaFrame::Type media = GetMediaForCodec(codec);
-
-		//Create normal packet
-		auto packet = std::make_shared<RTPPacket>(media,codec,header,extension, ts);
-
-		//Set the payload
-		packet->SetPayload(data+len,size-len);
-		
-		//Get the packet relative time in ns
-		auto time = packet->GetTime() - first;
+		//Get the packet relative time in ms
+		auto time = ts - first;
 		
 		//Get relative play times since start in ns
 		now = getTimeDiff(ini)/1000;
@@ -511,122 +437,8 @@ outher:	while(running)
 			now = getTimeDiff(ini)/1000;
 		}
 		
-		//Get sssrc
-		DWORD ssrc = packet->GetSSRC();
-		
-		//Get group
-		RTPIncomingSourceGroup *group = GetIncomingSourceGroup(ssrc);
-
-		//TODO:support rids
-
-		//Ensure it has a group
-		if (!group)	
-		{
-			//If we have an unknown group for that kind
-			auto it = unknow.find(media);
-			//If not found
-			if (it==unknow.end())
-			{
-				//error
-				Debug("-PCAPTransportEmulator::Run()| Unknown group for ssrc [%u]\n",ssrc);
-				//Skip
-				continue;
-			}
-			//Get group
-			group = it->second;
-			
-			//Check if it is rtx or media
-			if (media==MediaFrame::Video && codec==VideoCodec::RTX)
-			{
-				//Log
-				Debug("-PCAPTransportEmulator::Run()| Assigning rtx ssrc [%u] to group [%p]\n", ssrc, group);
-				//Set rtx ssrc
-				group->rtx.ssrc = ssrc;
-				incoming[group->rtx.ssrc] = group;
-			} else {
-				//Log
-				Debug("-PCAPTransportEmulator::Run()| Assigning media ssrc [%u] to group [%p]\n", ssrc, group);
-				//Set media ssrc
-				group->media.ssrc = ssrc;
-				incoming[group->media.ssrc] = group;
-			}
-		}
-
-		//UltraDebug("-PCAPTransportEmulator::Run() | Got RTP on media:%s sssrc:%u seq:%u pt:%u codec:%s rid:'%s'\n",MediaFrame::TypeToString(group->type),ssrc,packet->GetSeqNum(),packet->GetPayloadType(),GetNameForCodec(group->type,codec),group->rid.c_str());
-
-		//Process packet and get source
-		RTPIncomingSource* source = group->Process(packet);
-
-		//Ensure it has a source
-		if (!source)
-		{
-			//error
-			Debug("-PCAPTransportEmulator::Run()| Group does not contain ssrc [%u]\n",ssrc);
-			//Continue
-			continue;
-		}
-		
-		//If it was an RTX packet
-		if (ssrc==group->rtx.ssrc) 
-		{
-			//Ensure that it is a RTX codec
-			if (packet->GetCodec()!=VideoCodec::RTX)
-			{
-				//error
-				Debug("-PCAPTransportEmulator::Run()| No RTX codec on rtx sssrc:%u type:%d codec:%d\n",packet->GetSSRC(),packet->GetPayloadType(),packet->GetCodec());
-				//Skip
-				continue;
-			}
-
-			//Find apt type
-			auto apt = aptMap.GetCodecForType(packet->GetPayloadType());
-			//Find codec 
-			codec = rtpMap.GetCodecForType(apt);
-			//Check codec
-			if (codec==RTPMap::NotFound)
-			{
-				//Error
-				Debug("-PCAPTransportEmulator::Run() | RTP RTX packet apt type unknown [%s %d]\n",MediaFrame::TypeToString(packet->GetMediaType()),packet->GetPayloadType());
-				//Skip
-				continue;
-			}
-
-			//Remove OSN and restore seq num
-			if (!packet->RecoverOSN())
-			{
-				//error
-				Debug("-PCAPTransportEmulator::Run() | RTX not enough data len:%d\n",packet->GetMediaLength());
-				//Skip
-				continue;
-			}
-			
-			//Set original ssrc
-			packet->SetSSRC(group->media.ssrc);
-			//Set corrected seq num cycles
-			packet->SetSeqCycles(group->media.RecoverSeqNum(packet->GetSeqNum()));
-			//Set corrected timestamp cycles
-			packet->SetTimestampCycles(group->media.RecoverTimestamp(packet->GetTimestamp()));
-			//Set codec
-			packet->SetCodec(codec);
-			packet->SetPayloadType(apt);
-			//TODO: Move from here
-			VideoLayerSelector::GetLayerIds(packet);
-		}
-		
-		//Log("-%llu(%lld) %s seqNum:%llu(%u) mark:%d\n",ini+now,now,MediaFrame::TypeToString(group->type),packet->GetExtSeqNum(),packet->GetSeqNum(),packet->GetMark());
-		
-		//Add packet and see if we have lost any in between
-		int lost = group->AddPacket(packet,size,ts);
-
-		//Check if it was rejected
-		if (lost<0)
-		{
-			UltraDebug("-PCAPTransportEmulator::Run()| Dropped packet [ssrc:%u,seq:%d]\n",packet->GetSSRC(),packet->GetSeqNum());
-			//Increase rejected counter
-			source->dropPackets++;
-		} else if (lost > 0) {
-			UltraDebug("-PCAPTransportEmulator::Run()| lost packets [ssrc:%u,seq:%d;lost:%d]\n", packet->GetSSRC(), packet->GetSeqNum(),lost);
-		}
+		//Process it
+		ProcessRTP(data,size,ts);
 	}
 
 	//Run
@@ -668,4 +480,304 @@ RTPIncomingSource* PCAPTransportEmulator::GetIncomingSource(DWORD ssrc)
 	//Get source
 	return it->second->GetSource(ssrc);
 
-}
\ No newline at end of file
+}
+
+void PCAPTransportEmulator::ProcessRTP(BYTE* data, DWORD size, QWORD ts)
+{
+	//Keep original size for fec
+	DWORD original = size;
+
+	RTPHeader header;
+	RTPHeaderExtension extension;
+
+	//Parse RTP header
+	uint32_t len = header.Parse(data,size);
+
+	//On error
+	if (!len)
+	{
+		//Debug
+		Error("-PCAPTransportEmulator::ProcessRTP() | Could not parse RTP header ini=%u len=%d\n",len,size-len);
+		//Dump it
+		Dump(data+len,size-len);
+		//Ignore this try again
+		return;
+	}
+
+	//If it has extension
+	if (header.extension)
+	{
+		//Parse extension
+		int l = extension.Parse(extMap,data+len,size-len);
+		//If not parsed
+		if (!l)
+		{
+			///Debug
+			Error("-PCAPTransportEmulator::ProcessRTP() | Could not parse RTP header extension ini=%u len=%d\n",len,size-len);
+			//Dump it
+			Dump(data+len,size-len);
+			//retry
+			return;
+		}
+		//Inc ini
+		len += l;
+	}
+
+	//Check size with padding
+	if (header.padding)
+	{
+		//Get last 2 bytes
+		WORD padding = get1(data,size-1);
+		//Ensure we have enought size
+		if (size-len<padding)
+		{
+			///Debug
+			Debug("-PCAPTransportEmulator::ProcessRTP() | RTP padding is bigger than size [padding:%u,size%u]\n",padding,size);
+			//Ignore this try again
+			return;
+		}
+		//Remove from size
+		size -= padding;
+	}
+
+	//Check we have payload
+	if (len>=size)
+	{
+		///Debug
+		UltraDebug("-PCAPTransportEmulator::ProcessRTP() | Refusing to create a packet with empty payload [ini:%u,len:%u]\n",size,len);
+		//Ignore this try again
+		return;
+	}
+
+	//Get initial codec
+	BYTE codec = rtpMap.GetCodecForType(header.payloadType);
+
+	//Check codec
+	if (codec==RTPMap::NotFound)
+	{
+		//Error
+		Error("-PCAPTransportEmulator::ProcessRTP() | RTP packet type unknown [%d]\n",header.payloadType);
+		//retry
+		return;
+	}
+
+	//If it is a fec packet
+	if (codec==VideoCodec::FLEXFEC || codec==VideoCodec::ULPFEC)
+		//Recover lost media with it
+		return ProcessFEC(codec,header.ssrc,data+len,size-len,ts);
+
+	//If we are receiving fec for this ssrc
+	auto decoder = decoders.find(header.ssrc);
+	if (decoder!=decoders.end())
+		//Keep it for recovering others
+		decoder->second->AddMediaPacket(data,original);
+
+	//Get media
+	MediaFrame::Type media = GetMediaForCodec(codec);
+
+	//Create normal packet
+	auto packet = std::make_shared<RTPPacket>(media,codec,header,extension, ts);
+
+	//Set the payload
+	packet->SetPayload(data+len,size-len);
+	
+	//Get sssrc
+	DWORD ssrc = packet->GetSSRC();
+	
+	//Get group
+	RTPIncomingSourceGroup *group = GetIncomingSourceGroup(ssrc);
+
+	//TODO:support rids
+
+	//Ensure it has a group
+	if (!group)	
+	{
+		//If we have an unknown group for that kind
+		auto it = unknow.find(media);
+		//If not found
+		if (it==unknow.end())
+		{
+			//error
+			Debug("-PCAPTransportEmulator::ProcessRTP()| Unknown group for ssrc [%u]\n",ssrc);
+			//Skip
+			return;
+		}
+		//Get group
+		group = it->second;
+		
+		//Check if it is rtx or media
+		if (media==MediaFrame::Video && codec==VideoCodec::RTX)
+		{
+			//Log
+			Debug("-PCAPTransportEmulator::ProcessRTP()| Assigning rtx ssrc [%u] to group [%p]\n", ssrc, group);
+			//Set rtx ssrc
+			group->rtx.ssrc = ssrc;
+			incoming[group->rtx.ssrc] = group;
+		} else {
+			//Log
+			Debug("-PCAPTransportEmulator::ProcessRTP()| Assigning media ssrc [%u] to group [%p]\n", ssrc, group);
+			//Set media ssrc
+			group->media.ssrc = ssrc;
+			incoming[group->media.ssrc] = group;
+		}
+	}
+
+	//UltraDebug("-PCAPTransportEmulator::ProcessRTP() | Got RTP on media:%s sssrc:%u seq:%u pt:%u codec:%s rid:'%s'\n",MediaFrame::TypeToString(group->type),ssrc,packet->GetSeqNum(),packet->GetPayloadType(),GetNameForCodec(group->type,codec),group->rid.c_str());
+
+	//Process packet and get source
+	RTPIncomingSource* source = group->Process(packet);
+
+	//Ensure it has a source
+	if (!source)
+	{
+		//error
+		Debug("-PCAPTransportEmulator::ProcessRTP()| Group does not contain ssrc [%u]\n",ssrc);
+		//Continue
+		return;
+	}
+	
+	//If it was an RTX packet
+	if (ssrc==group->rtx.ssrc) 
+	{
+		//Ensure that it is a RTX codec
+		if (packet->GetCodec()!=VideoCodec::RTX)
+		{
+			//error
+			Debug("-PCAPTransportEmulator::ProcessRTP()| No RTX codec on rtx sssrc:%u type:%d codec:%d\n",packet->GetSSRC(),packet->GetPayloadType(),packet->GetCodec());
+			//Skip
+			return;
+		}
+
+		//Find apt type
+		auto apt = aptMap.GetCodecForType(packet->GetPayloadType());
+		//Find codec 
+		codec = rtpMap.GetCodecForType(apt);
+		//Check codec
+		if (codec==RTPMap::NotFound)
+		{
+			//Error
+			Debug("-PCAPTransportEmulator::ProcessRTP() | RTP RTX packet apt type unknown [%s %d]\n",MediaFrame::TypeToString(packet->GetMediaType()),packet->GetPayloadType());
+			//Skip
+			return;
+		}
+
+		//Remove OSN and restore seq num
+		if (!packet->RecoverOSN())
+		{
+			//error
+			Debug("-PCAPTransportEmulator::ProcessRTP() | RTX not enough data len:%d\n",packet->GetMediaLength());
+			//Skip
+			return;
+		}
+		
+		//Set original ssrc
+		packet->SetSSRC(group->media.ssrc);
+		//Set corrected seq num cycles
+		packet->SetSeqCycles(group->media.RecoverSeqNum(packet->GetSeqNum()));
+		//Set corrected timestamp cycles
+		packet->SetTimestampCycles(group->media.RecoverTimestamp(packet->GetTimestamp()));
+		//Set codec
+		packet->SetCodec(codec);
+		packet->SetPayloadType(apt);
+		//TODO: Move from here
+		VideoLayerSelector::GetLayerIds(packet);
+	}
+	
+	//Log("-%llu(%lld) %s seqNum:%llu(%u) mark:%d\n",ini+now,now,MediaFrame::TypeToString(group->type),packet->GetExtSeqNum(),packet->GetSeqNum(),packet->GetMark());
+	
+	//Add packet and see if we have lost any in between
+	int lost = group->AddPacket(packet,size,ts);
+
+	//Check if it was rejected
+	if (lost<0)
+	{
+		UltraDebug("-PCAPTransportEmulator::ProcessRTP()| Dropped packet [ssrc:%u,seq:%d]\n",packet->GetSSRC(),packet->GetSeqNum());
+		//Increase rejected counter
+		source->dropPackets++;
+	} else if (lost > 0) {
+		UltraDebug("-PCAPTransportEmulator::ProcessRTP()| lost packets [ssrc:%u,seq:%d;lost:%d]\n", packet->GetSSRC(), packet->GetSeqNum(),lost);
+	}
+
+	//If receiving fec, packet may complete pending fec packets
+	if (decoder!=decoders.end())
+		//Recover lost ones
+		RecoverFECPackets(*decoder->second,ts);
+}
+
+void PCAPTransportEmulator::ProcessFEC(BYTE codec, DWORD ssrc, const BYTE* payload, DWORD size, QWORD ts)
+{
+	fec::Header header;
+
+	//Get scheme
+	fec::Scheme scheme = codec==VideoCodec::FLEXFEC ? fec::Scheme::FlexFEC : fec::Scheme::ULPFEC;
+
+	//Flexfec carries the protected ssrc, ulpfec is sent on the protected group
+	if (scheme==fec::Scheme::FlexFEC && fec::Parse(scheme,payload,size,header))
+		ssrc = header.ssrc;
+	else if (auto group = GetIncomingSourceGroup(ssrc))
+		ssrc = group->media.ssrc;
+	else
+	{
+		//Debug
+		Debug("-PCAPTransportEmulator::ProcessFEC() | Unknown protected ssrc for fec packet [ssrc:%u]\n",ssrc);
+		//Skip
+		return;
+	}
+
+	//Get decoder for it
+	auto& decoder = decoders[ssrc];
+
+	//If not created yet
+	if (!decoder)
+	{
+		//Log
+		Debug("-PCAPTransportEmulator::ProcessFEC() | Receiving fec [codec:%s,ssrc:%u]\n",VideoCodec::GetNameFor((VideoCodec::Type)codec),ssrc);
+		//Create new one, protected packets will be stored from now on
+		decoder = std::make_unique<FECDecoder>(scheme,ssrc);
+	}
+
+	//Add it
+	if (decoder->AddFECPacket(payload,size))
+		//Recover lost ones
+		RecoverFECPackets(*decoder,ts);
+}
+
+void PCAPTransportEmulator::RecoverFECPackets(FECDecoder& decoder, QWORD ts)
+{
+	std::vector<Packet> recovered;
+
+	//Recover lost packets
+	if (!decoder.Recover(recovered))
+		//Nothing
+		return;
+
+	//Process them as received now
+	for (auto& packet : recovered)
+	{
+		//Log
+		UltraDebug("-PCAPTransportEmulator::RecoverFECPackets() | Recovered packet [ssrc:%u,seq:%u]\n",decoder.GetSSRC(),get2(packet.GetData(),2));
+		//Handle it
+		ProcessRTP(packet.GetData(),packet.GetSize(),ts);
+	}
+}
+
+fec::Stats PCAPTransportEmulator::GetFECStats() const
+{
+	fec::Stats stats;
+
+	//Sum all decoders
+	for (const auto& [ssrc,decoder] : decoders)
+	{
+		const auto& decoderStats = decoder->GetStats();
+		stats.mediaPackets	+= decoderStats.mediaPackets;
+		stats.mediaBytes	+= decoderStats.mediaBytes;
+		stats.fecPackets	+= decoderStats.fecPackets;
+		stats.fecBytes		+= decoderStats.fecBytes;
+		stats.recovered		+= decoderStats.recovered;
+		stats.unrecoverable	+= decoderStats.unrecoverable;
+		stats.unused		+= decoderStats.unused;
+		stats.invalid		+= decoderStats.invalid;
+	}
+
+	return stats;
+}
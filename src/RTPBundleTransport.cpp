@@ -495,11 +495,11 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 
 		//UltraDebug("-RTPBundleTransport::OnRead() | stun\n");
 		
-		//Parse it
-		auto stun = std::unique_ptr<STUNMessage>(STUNMessage::Parse(data,size));
+		//Parse it without copying it
+		STUNMessage::View stun;
 
 		//It was not a valid STUN message
-		if (!stun)
+		if (!stun.Parse(data,size))
 		{
 			//Error
 			Error("-RTPBundleTransport::Read() | failed to parse STUN message\n");
@@ -507,8 +507,8 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			return;
 		}
 
-		STUNMessage::Type type = stun->GetType();
-		STUNMessage::Method method = stun->GetMethod();
+		STUNMessage::Type type = stun.GetType();
+		STUNMessage::Method method = stun.GetMethod();
 
 		//If it is a request
 		if (type==STUNMessage::Request && method==STUNMessage::Binding)
@@ -516,7 +516,7 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			//UltraDebug("-RTPBundleTransport::OnRead() | Binding request\n");
 			
 			//Check if it has the prio attribute
-			if (!stun->HasAttribute(STUNMessage::Attribute::Username))
+			if (!stun.HasAttribute(STUNMessage::Attribute::Username))
 			{
 				//Error
 				Debug("-RTPBundleTransport::Read() | STUN Message without username attribute\n");
@@ -524,11 +524,8 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 				return;
 			}
 			
-			//Get username
-			STUNMessage::Attribute* attr = stun->GetAttribute(STUNMessage::Attribute::Username);
-			
-			//Copy username string
-			std::string username((char*)attr->attr,attr->size);
+			//Get username pointing to the received data
+			std::string_view username = stun.GetUsername();
 			
 			//Check if we have an ICE transport for that username
 			auto it = connections.find(username);
@@ -538,7 +535,7 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			{
 				//TODO: Reject
 				//Error
-				Debug("-RTPBundleTransport::Read() | ICE username not found [%s}\n",username.c_str());
+				Debug("-RTPBundleTransport::Read() | ICE username not found [%.*s}\n",(int)username.size(),username.data());
 				//Done
 				return;
 			}
@@ -547,8 +544,8 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			auto connection = it->second;
 			auto transport = connection->transport;
 			
-			//Authenticate request with remote username
-			if (!stun->CheckAuthenticatedFingerPrint(data,size,transport->GetLocalPwd()))
+			//Authenticate request with precomputed local key
+			if (!stun.CheckAuthenticatedFingerPrint(transport->GetLocalKey()))
 			{
 				//Error
 				Error("-RTPBundleTransport::Read() | STUN Message request failed authentication [pwd:%s]\n",transport->GetLocalPwd());
@@ -560,7 +557,7 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			connection->iceRequestsReceived++;
 
 			//Check if it has the prio attribute
-			if (!stun->HasAttribute(STUNMessage::Attribute::Priority))
+			if (!stun.HasAttribute(STUNMessage::Attribute::Priority))
 			{
 				//Error
 				Debug("-RTPBundleTransport::Read() | STUN Message without priority attribute\n");
@@ -568,11 +565,8 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 				return;
 			}
 			
-			//Get attribute
-			STUNMessage::Attribute* priority = stun->GetAttribute(STUNMessage::Attribute::Priority);
-			
 			//Get prio
-			DWORD prio = priority ? get4(priority->attr,0) : 0;
+			DWORD prio = stun.GetPriority();
 			
 			//Find candidate or try to create one if not present
 			auto [itc, inserted] = candidates.try_emplace(remote,ip,port,transport);
@@ -591,19 +585,13 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			}
 			
 			//Set it active
-			transport->ActivateRemoteCandidate(candidate,stun->HasAttribute(STUNMessage::Attribute::UseCandidate),prio);
-			
-			//Create response
-			auto resp = std::unique_ptr<STUNMessage>(stun->CreateResponse());
-			
-			//Add received xor mapped addres
-			resp->AddXorAddressAttribute(htonl(ip),htons(port));
+			transport->ActivateRemoteCandidate(candidate,stun.HasAttribute(STUNMessage::Attribute::UseCandidate),prio);
 			
 			//Create new mesage
 			Packet buffer = loop.GetPacketPool().pick();
 		
-			//Serialize and autenticate
-			size_t len = resp->AuthenticatedFingerPrint(buffer.GetData(),buffer.GetCapacity(),transport->GetLocalPwd());
+			//Serialize response with received xor mapped addres straight into the packet and autenticate
+			size_t len = stun.CreateBindingResponse(buffer.GetData(),buffer.GetCapacity(),htonl(ip),htons(port),transport->GetLocalKey());
 			
 			//resize
 			buffer.SetSize(len);
@@ -617,8 +605,8 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 		} else if (type==STUNMessage::Response && method==STUNMessage::Binding) {
 			
 			//Get ts and id
-			uint32_t id = get4(stun->GetTransactionId(),0);
-			uint64_t ts = get8(stun->GetTransactionId(),4);
+			uint32_t id = get4(stun.GetTransactionId(),0);
+			uint64_t ts = get8(stun.GetTransactionId(),4);
 
 			//UltraDebug("-RTPBundleTransport::OnRead() | Binding response [id:%u,ts:%llu]\n", id, ts);
 			
@@ -669,8 +657,8 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			//Get it
 			ICERemoteCandidate* candidate = &candidateIterator->second;
 			
-			//Authenticate request with remote username
-			if (!stun->CheckAuthenticatedFingerPrint(data,size,transport->GetRemotePwd()))
+			//Authenticate response with precomputed remote key
+			if (!stun.CheckAuthenticatedFingerPrint(transport->GetRemoteKey()))
 			{
 				//Error
 				Error("-RTPBundleTransport::Read() | STUN Message response failed authentication [pwd:%s]\n",transport->GetRemotePwd());
@@ -678,14 +666,11 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 				return;
 			}
 
-			//Get attribute
-			STUNMessage::Attribute* priority = stun->GetAttribute(STUNMessage::Attribute::Priority);
-
 			//Get prio
-			DWORD prio = priority ? get4(priority->attr,0) : 0;
+			DWORD prio = stun.GetPriority();
 
 			//Set it active
-			transport->ActivateRemoteCandidate(candidate,stun->HasAttribute(STUNMessage::Attribute::UseCandidate),prio);
+			transport->ActivateRemoteCandidate(candidate,stun.HasAttribute(STUNMessage::Attribute::UseCandidate),prio);
 			
 			//Set state
 			candidate->SetState(ICERemoteCandidate::Connected);
@@ -826,7 +811,7 @@ void RTPBundleTransport::SendBindingRequest(Connection::shared connection,ICERem
 	Packet buffer = loop.GetPacketPool().pick();
 
 	//Serialize and autenticate
-	size_t len = request->AuthenticatedFingerPrint(buffer.GetData(),buffer.GetCapacity(),transport->GetRemotePwd());
+	size_t len = request->AuthenticatedFingerPrint(buffer.GetData(),buffer.GetCapacity(),transport->GetRemoteKey());
 
 	//resize
 	buffer.SetSize(len);
@@ -11,16 +11,14 @@
 #include "text.h"
 #include "log.h"
 #include "tools.h"
+#include <algorithm>
+#include <vector>
 
 RTPSmoother::RTPSmoother()
 {
 	//NO session
 	session = NULL;
 	inited = false;
-	
-	//Create objects
-	pthread_mutex_init(&mutex,NULL);
-	pthread_cond_init(&cond,NULL);
 }
 
 RTPSmoother::~RTPSmoother()
@@ -29,10 +27,6 @@ RTPSmoother::~RTPSmoother()
 	if (inited)
 		//End
 		End();
-	
-	//Clean object
-	pthread_mutex_destroy(&mutex);
-	pthread_cond_destroy(&cond);
 }
 
 
@@ -46,17 +40,32 @@ int RTPSmoother::Init(RTPSession *session)
 	//Store it
 	this->session = session;
 
+	//Create queue for this session
+	queue = std::make_shared<Queue>();
+	queue->session = session;
+
+	//Timer on the session loop, do not keep the queue alive from it
+	queue->timer = session->GetTimeService().CreateTimer([weak = std::weak_ptr<Queue>(queue)](auto now){
+		//If not ended
+		if (auto queue = weak.lock())
+			//Send pending packets
+			OnTimer(queue,now);
+	});
+	queue->timer->SetName("RTPSmoother - send");
+
 	//We are inited
 	inited = true;
 
-	//Run
-	createPriorityThread(&thread,run,this,1);
-
 	return 1;
 }
 
 int RTPSmoother::SendFrame(MediaFrame* frame,DWORD duration)
 {
+	//Check we are running
+	if (!inited)
+		//Error
+		return Error("-RTPSmoother::SendFrame() | not inited\n");
+
 	//Check
 	if (!frame || !frame->HasRtpPacketizationInfo())
 		//Error
@@ -112,6 +121,8 @@ int RTPSmoother::SendFrame(MediaFrame* frame,DWORD duration)
 		frameLength += info[i].GetTotalLength();
 
 	DWORD current = 0;
+	//Packets and sending time offset
+	std::vector<std::pair<std::chrono::milliseconds,RTPPacketSched::shared>> packets;
 	
 	//For each one
 	for (int i=0;i<info.size();i++)
@@ -150,19 +161,53 @@ int RTPSmoother::SendFrame(MediaFrame* frame,DWORD duration)
 		//Calculate partial lenght
 		current += rtp.GetPrefixLen()+rtp.GetSize();
 		//Append it
-		queue.Add(packet);
+		packets.emplace_back(std::chrono::milliseconds(packet->GetSendingTime()),packet);
 	}
 
+	//Same clock than the loop
+	auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+
+	//Lock
+	std::lock_guard<std::mutex> lock(queue->mutex);
+
+	//Previous frame should have been sent already
+	bool idle = queue->packets.empty();
+	//Check queue length
+	if (!idle)
+		//Log it
+		Debug("-RTPSmoother::SendFrame() | lagging behind [enqueued:%zu,duration:%u]\n",queue->packets.size(),duration);
+
+	//Frame starts when previous one is finished
+	auto start = std::max(now,queue->last);
+
+	//Schedule packets
+	for (auto& [offset,packet] : packets)
+		queue->packets.emplace_back(start+offset,std::move(packet));
+
+	//Update when this one will be finished
+	if (!queue->packets.empty())
+		queue->last = queue->packets.back().first;
+
+	//If timer was not waiting for previous packets
+	if (idle && !queue->packets.empty())
+		//Send first ones now
+		queue->timer->Again(std::chrono::milliseconds(0));
+
 	return 1;
 }
 
 int RTPSmoother::Cancel()
 {
-	//Cancel any pending operation
-	queue.Cancel();
+	//Check
+	if (!inited)
+		return 0;
+
+	//Lock
+	std::lock_guard<std::mutex> lock(queue->mutex);
 
-	//Cancel waiting
-	pthread_cond_signal(&cond);
+	//Drop pending packets
+	queue->packets.clear();
+	queue->last = std::chrono::milliseconds(0);
 
 	//exit
 	return 1;
@@ -177,87 +222,43 @@ int RTPSmoother::End()
 	//Not inited
 	inited = false;
 
-	//Cancel any pending send
-	Cancel();
+	{
+		//Lock, so we wait for the timer if it is sending
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		//Timer will not send anything else
+		queue->session = nullptr;
+		queue->packets.clear();
+	}
+
+	//Stop timer
+	queue->timer->Cancel();
 
-	//Wait
-	pthread_join(thread,NULL);
+	//Release queue, timer only has a weak reference to it
+	queue.reset();
 
 	return 1;
 }
 
-void* RTPSmoother::run(void *par)
+void RTPSmoother::OnTimer(const std::shared_ptr<Queue>& queue, std::chrono::milliseconds now)
 {
-        Log("RTPSmootherThread [%p]\n",pthread_self());
-        //Get endpoint
-	RTPSmoother *smooth = (RTPSmoother *)par;
-	//Run 
-        smooth->Run();
-	//Exit
-	return NULL;
-}
+	//Lock
+	std::lock_guard<std::mutex> lock(queue->mutex);
 
-int RTPSmoother::Run()
-{
-	timeval prev;
-	timespec wait;
-	DWORD	sendingTime = 0;
-	
-	//Calculate first
-	getUpdDifTime(&prev);
+	//If ended
+	if (!queue->session)
+		return;
 
-	Log(">RTPSmoother run\n");
-	
-	while(inited)
+	//Send all packets which are due
+	while (!queue->packets.empty() && queue->packets.front().first<=now)
 	{
-		//Wait for new frame
-		if (!queue.Wait(0))
-			//Check again
-			continue;
-
-		//Get it
-		auto sched = queue.Pop();
-
-		//Check it
-		if (!sched)
-			//Exit
-			continue;
-		
-		//Update sending time
-		sendingTime = sched->GetSendingTime();
-		
 		//Send it
-		session->SendPacket(sched);
-
-		//If it was not last
-		if (!sched->GetMark())
-		{
-			//If we have to sleep
-			if (sendingTime)
-			{
-				//Lock
-				pthread_mutex_lock(&mutex);
-
-				//Calculate timeout
-				calcAbsTimeout(&wait,&prev,sendingTime);
-
-				//Wait next or stopped
-				pthread_cond_timedwait(&cond,&mutex,&wait);
-
-				//Unlock
-				pthread_mutex_unlock(&mutex);
-			}
-		} else {
-			//Update time of the previous frame
-			DWORD frameTime = getUpdDifTime(&prev)/1000;
-			//Check queue length, it should be empty
-			if (queue.Length()>0)
-				//Log it
-				Debug("-RTPSmoother lagging behind [enqueued:%d,frameTime:%u,sendingTime:%u]\n",queue.Length(),frameTime,sendingTime);
-		}
+		queue->session->SendPacket(queue->packets.front().second);
+		//Remove it
+		queue->packets.pop_front();
 	}
 
-	Log("<RTPSmoother run\n");
-
-	return 1;
+	//If there are more pending
+	if (!queue->packets.empty())
+		//Wait for next one
+		queue->timer->Again(queue->packets.front().first-now);
 }
@@ -17,12 +17,18 @@
 #include <time.h>
 #include <openssl/opensslconf.h>
 #include <openssl/ossl_typ.h>
+#include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
 #include "log.h"
 #include "assertions.h"
 #include "tools.h"
 #include "rtp.h"
 #include "stunmessage.h"
 #include "RTPTransport.h"
+#include "LoopPool.h"
 
 BYTE rtpEmpty[] = {0x80,0x14,0x00,0x00,0x00,0x00,0x00,0x00};
 
@@ -37,6 +43,10 @@ SRTPLib srtp;
 DWORD RTPTransport::minLocalPort = 0;
 DWORD RTPTransport::maxLocalPort = 0;
 int RTPTransport::minLocalPortRange = 50;
+DWORD RTPTransport::defaultNumThreads = 0;
+
+//Shared reactors
+static LoopPool<EpollReactor> loops("rtp-transport",RTPTransport::MaxDefaultThreads);
 
 bool RTPTransport::SetPortRange(int minPort, int maxPort)
 {
@@ -92,10 +102,9 @@ bool RTPTransport::SetPortRange(int minPort, int maxPort)
 * 	Constructro
 **************************/
 RTPTransport::RTPTransport(Listener *listener) :
-	rtpLoop(this),
-	rtcpLoop(this),
-	endpoint(rtpLoop),
-	dtls(*this,rtpLoop,endpoint.GetTransport())
+	loop(loops.Acquire(defaultNumThreads)),
+	endpoint(*loop),
+	dtls(*this,*loop,endpoint.GetTransport())
 {
 	this->listener = listener;
 	//Init values
@@ -139,8 +148,16 @@ RTPTransport::RTPTransport(Listener *listener) :
 **************************/
 RTPTransport::~RTPTransport()
 {
+	//If still opened
+	if (simSocket!=FD_INVALID)
+		//Close sockets and unregister them
+		End();
 	//Reset
 	Reset();
+	//Make sure nothing runs on the reactor for us
+	Run([this](){ dtls.End(); });
+	//Not used anymore
+	loops.Release(loop);
 }
 
 void RTPTransport::Reset()
@@ -450,6 +467,31 @@ int RTPTransport::GetLocalPort()
 	return simPort;
 }
 
+void RTPTransport::SetMuxRTCP(int flag)
+{
+	//Store it
+	muxRTCP = flag;
+
+	//If rtcp socket was already opened
+	if (muxRTCP && simRtcpSocket!=FD_INVALID)
+	{
+		Log("-RTPTransport::SetMuxRTCP() | closing rtcp port [port:%d]\n",simRtcpPort);
+		//Stop receiving on it
+		Run([this](){
+			if (rtcpHandler)
+				loop->RemoveHandler(rtcpHandler->fd);
+		});
+		rtcpHandler.reset();
+		//Wait for packets being sent on it
+		std::unique_lock<std::shared_mutex> lock(socketsMutex);
+		//Close it
+		MCU_CLOSE(simRtcpSocket);
+		//Rtcp is received on the rtp port now
+		simRtcpSocket = FD_INVALID;
+		simRtcpPort = simPort;
+	}
+}
+
 /***********************************
 * SetRemotePort
 *	Inicia la sesion rtp de video remota
@@ -489,12 +531,17 @@ int RTPTransport::SetRemotePort(char *ip,int sendPort)
 
 void RTPTransport::SendEmptyPacket()
 {
+	//Sockets are not closed while sending
+	std::shared_lock<std::shared_mutex> lock(socketsMutex);
+	//Check we are opened
+	if (simSocket==FD_INVALID)
+		return;
 	//Open rtp
-	(void)sendto(simSocket,rtpEmpty,sizeof(rtpEmpty),0,(sockaddr *)&sendAddr,sizeof(struct sockaddr_in));
+	(void)sendto(simSocket,rtpEmpty,sizeof(rtpEmpty),MSG_DONTWAIT,(sockaddr *)&sendAddr,sizeof(struct sockaddr_in));
 	//If not muxing
-	if (!muxRTCP)
+	if (!muxRTCP && simRtcpSocket!=FD_INVALID)
 		//Send
-		(void)sendto(simRtcpSocket,rtpEmpty,sizeof(rtpEmpty),0,(sockaddr *)&sendRtcpAddr,sizeof(struct sockaddr_in));
+		(void)sendto(simRtcpSocket,rtpEmpty,sizeof(rtpEmpty),MSG_DONTWAIT,(sockaddr *)&sendRtcpAddr,sizeof(struct sockaddr_in));
 }
 
 /********************************
@@ -505,7 +552,12 @@ int RTPTransport::Init()
 {
 	int retries = 0;
 
-	Log(">RTPTransport::Init()\n");
+	Log(">RTPTransport::Init() [rtcp-mux:%d]\n",muxRTCP);
+
+	//If already started
+	if (rtpHandler)
+		//Unregister sockets first
+		Stop();
 
 	sockaddr_in recAddr;
 
@@ -515,6 +567,9 @@ int RTPTransport::Init()
 	//Set family
 	recAddr.sin_family     	= AF_INET;
 
+	//Previous sockets may be in use by senders
+	std::unique_lock<std::shared_mutex> lock(socketsMutex);
+
 	//Get two consecutive ramdom ports
 	while (retries++<100)
 	{
@@ -568,6 +623,16 @@ int RTPTransport::Init()
 			//Get final port
 			simPort = ntohs(recAddr.sin_port);
 		}
+		//If muxing rtcp
+		if (muxRTCP)
+		{
+			//Only one port needed
+			simRtcpPort = simPort;
+			//Everything ok
+			Log("-RTPTransport::Init() | Got port [%d]\n",simPort);
+			//Done
+			break;
+		}
 		//Create new sockets
 		simRtcpSocket = socket(PF_INET,SOCK_DGRAM,0);
 		//Next port
@@ -588,32 +653,43 @@ int RTPTransport::Init()
 #ifdef SO_PRIORITY
 		//Set COS
 		int cos = 5;
-		(void)setsockopt(simSocket,     SOL_SOCKET, SO_PRIORITY, &cos, sizeof(cos));
 		(void)setsockopt(simRtcpSocket, SOL_SOCKET, SO_PRIORITY, &cos, sizeof(cos));
 #endif
 		//Set TOS
 		int tos = 0x2E;
-		(void)setsockopt(simSocket,     IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
 		(void)setsockopt(simRtcpSocket, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
 		//Everything ok
 		Log("-RTPTransport::Init() | Got ports [%d,%d]\n",simPort,simRtcpPort);
-		//Start receiving
-		Start();
-		//Dump
-		char filename[256];
-		snprintf(filename,255,"/tmp/%d-%p.pcap",simPort,this);
-		if (dumping) pcap.Open(filename);
 		//Done
-		Log("<RTPTransport::Init()\n");
-		//Opened
-		return 1;
+		break;
 	}
 
-	//Error
-	Error("-RTPTransport::Init() | too many failed attemps opening sockets\n");
+	//Done with the sockets
+	lock.unlock();
+
+	//Check we got the rtp one at least
+	if (retries>100)
+		//Error
+		return Error("-RTPTransport::Init() | too many failed attemps opening sockets\n");
 
-	//Failed
-	return 0;
+#ifdef SO_PRIORITY
+	//Set COS
+	int cos = 5;
+	(void)setsockopt(simSocket, SOL_SOCKET, SO_PRIORITY, &cos, sizeof(cos));
+#endif
+	//Set TOS
+	int tos = 0x2E;
+	(void)setsockopt(simSocket, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+	//Start receiving
+	Start();
+	//Dump
+	char filename[256];
+	snprintf(filename,255,"/tmp/%d-%p.pcap",simPort,this);
+	if (dumping) pcap.Open(filename);
+	//Done
+	Log("<RTPTransport::Init()\n");
+	//Opened
+	return 1;
 }
 
 /*********************************
@@ -628,18 +704,21 @@ int RTPTransport::End()
 	Stop();
 
 	if (dumping) pcap.Close();
+
+	//Wait for packets being sent on them
+	std::unique_lock<std::shared_mutex> lock(socketsMutex);
 	
 	//If got socket
 	if (simSocket!=FD_INVALID)
 	{
-		//Will cause poll to return
+		//Already unregistered
 		MCU_CLOSE(simSocket);
 		//No sockets
 		simSocket = FD_INVALID;
 	}
 	if (simRtcpSocket!=FD_INVALID)
 	{
-		//Will cause poll to return
+		//Already unregistered
 		MCU_CLOSE(simRtcpSocket);
 		//No sockets
 		simRtcpSocket = FD_INVALID;
@@ -683,12 +762,10 @@ int RTPTransport::SendRTCPPacket(Packet&& packet)
 	//If muxin
 	if (muxRTCP)
 		//Send using RTP port
-		rtpLoop.Send(ntohl(sendAddr.sin_addr.s_addr),ntohs(sendAddr.sin_port),std::move(packet));
+		Send(false,sendAddr,std::move(packet));
 	else
-		//Send using RCTP port
-		rtcpLoop.Send(ntohl(sendRtcpAddr.sin_addr.s_addr),ntohs(sendRtcpAddr.sin_port),std::move(packet));
-	
-	
+		//Send using RCTP port, or RTP one if already closed
+		Send(true,sendRtcpAddr,std::move(packet));
 	
 	return 1;
 }
@@ -725,7 +802,7 @@ int RTPTransport::SendRTPPacket(Packet&& packet)
 				request->AddAttribute(STUNMessage::Attribute::Priority,(DWORD)33554431);
 				
 				//Create new mesage
-				Packet localPacket = rtpLoop.GetPacketPool().pick();
+				Packet localPacket;
 
 				//Serialize and autenticate
 				size_t len = request->AuthenticatedFingerPrint(localPacket.GetData(),localPacket.GetCapacity(),iceLocalPwd);
@@ -734,7 +811,7 @@ int RTPTransport::SendRTPPacket(Packet&& packet)
 				localPacket.SetSize(len);
 				
 				//Send response
-				rtpLoop.Send(ntohl(sendAddr.sin_addr.s_addr),ntohs(sendAddr.sin_port),std::move(localPacket));
+				Send(false,sendAddr,std::move(localPacket));
 
 				//Clean response
 				delete(request);
@@ -772,8 +849,8 @@ int RTPTransport::SendRTPPacket(Packet&& packet)
 		}
 	}
 
-	//Send response
-	rtpLoop.Send(ntohl(sendAddr.sin_addr.s_addr),ntohs(sendAddr.sin_port),std::move(packet));
+	//Send it directly
+	Send(false,sendAddr,std::move(packet));
 	 
 	return 1;
 }
@@ -781,7 +858,8 @@ int RTPTransport::SendRTPPacket(Packet&& packet)
 int RTPTransport::ReadRTCP(const uint8_t* data, const size_t size, const uint32_t ipAddr, const uint16_t port)
 {
 	//TOOD: remove and use ipAddr/port directly
-	sockaddr_in from_addr;
+	sockaddr_in from_addr = {};
+	from_addr.sin_family = AF_INET;
 	//Receive from everywhere
 	from_addr.sin_addr.s_addr = htonl(ipAddr);
 	from_addr.sin_port = htons(port);
@@ -812,7 +890,7 @@ int RTPTransport::ReadRTCP(const uint8_t* data, const size_t size, const uint32_
 			
 			//Create new mesage
 			size_t len = 0;
-			Packet packet = rtpLoop.GetPacketPool().pick();
+			Packet packet;
 		
 			//Check if we have local passworkd
 			if (iceLocalPwd)
@@ -825,8 +903,8 @@ int RTPTransport::ReadRTCP(const uint8_t* data, const size_t size, const uint32_
 			//resize
 			packet.SetSize(len);
 
-			//Send response
-			rtpLoop.Send(ipAddr,port,std::move(packet));
+			//Send response from the rtcp port it was received on
+			Send(true,from_addr,std::move(packet));
 			
 			//Clean response
 			delete(resp);
@@ -834,7 +912,7 @@ int RTPTransport::ReadRTCP(const uint8_t* data, const size_t size, const uint32_
 			//Do NAT
 			sendRtcpAddr.sin_addr.s_addr = from_addr.sin_addr.s_addr;
 			//Set port
-			sendRtcpAddr.sin_port = from_addr.sin_addr.s_addr;
+			sendRtcpAddr.sin_port = from_addr.sin_port;
 		}
 
 		//Delete message
@@ -893,7 +971,8 @@ int RTPTransport::ReadRTCP(const uint8_t* data, const size_t size, const uint32_
 int RTPTransport::ReadRTP(const uint8_t* data, const size_t size, const uint32_t ipAddr, const uint16_t port)
 {
 	//TOOD: remove and use ipAddr/port directly
-	sockaddr_in from_addr;
+	sockaddr_in from_addr = {};
+	from_addr.sin_family = AF_INET;
 	//Receive from everywhere
 	from_addr.sin_addr.s_addr = htonl(ipAddr);
 	from_addr.sin_port = htons(port);
@@ -923,7 +1002,7 @@ int RTPTransport::ReadRTP(const uint8_t* data, const size_t size, const uint32_t
 			
 			//Create new mesage
 			size_t len = 0;
-			Packet packet = rtpLoop.GetPacketPool().pick();
+			Packet packet;
 		
 			//Check if we have local passworkd
 			if (iceLocalPwd)
@@ -937,7 +1016,7 @@ int RTPTransport::ReadRTP(const uint8_t* data, const size_t size, const uint32_t
 			packet.SetSize(len);
 
 			//Send response
-			rtpLoop.Send(ipAddr,port,std::move(packet));
+			Send(false,from_addr,std::move(packet));
 
 			//Clean response
 			delete(resp);
@@ -1003,7 +1082,7 @@ int RTPTransport::ReadRTP(const uint8_t* data, const size_t size, const uint32_t
 
 				//Create  request
 				size_t len = 0;
-				Packet packet = rtpLoop.GetPacketPool().pick();
+				Packet packet;
 
 				//Check remote pwd
 				if (iceRemotePwd)
@@ -1017,7 +1096,7 @@ int RTPTransport::ReadRTP(const uint8_t* data, const size_t size, const uint32_t
 				packet.SetSize(len);
 				
 				//Send response
-				rtpLoop.Send(ipAddr,port,std::move(packet));
+				Send(false,from_addr,std::move(packet));
 
 				//Clean response
 				delete(request);
@@ -1033,7 +1112,7 @@ int RTPTransport::ReadRTP(const uint8_t* data, const size_t size, const uint32_t
 						//resize
 						packet.SetSize(len);
 						//Send response
-						rtpLoop.Send(ipAddr,port,std::move(packet));
+						Send(false,from_addr,std::move(packet));
 					}
 				}
 			}
@@ -1083,7 +1162,7 @@ int RTPTransport::ReadRTP(const uint8_t* data, const size_t size, const uint32_t
 		dtls.Write(data,size);
 
 		//REad dtls data
-		Packet packet = rtpLoop.GetPacketPool().pick();
+		Packet packet;
 		size_t len = dtls.Read(packet.GetData(),packet.GetCapacity());
 					
 		//Check it
@@ -1092,7 +1171,7 @@ int RTPTransport::ReadRTP(const uint8_t* data, const size_t size, const uint32_t
 			//resize
 			packet.SetSize(len);
 			//Send response
-			rtpLoop.Send(ipAddr,port,std::move(packet));
+			Send(false,from_addr,std::move(packet));
 		}
 
 		//Exit
@@ -1149,24 +1228,114 @@ int RTPTransport::ReadRTP(const uint8_t* data, const size_t size, const uint32_t
 
 void RTPTransport::Start()
 {
-	//Start loops
-	rtpLoop.Start(simSocket);
-	rtcpLoop.Start(simRtcpSocket);
+	//Create handlers for our sockets
+	rtpHandler = std::make_shared<Socket>(this,simSocket,false);
+	if (simRtcpSocket!=FD_INVALID)
+		rtcpHandler = std::make_shared<Socket>(this,simRtcpSocket,true);
+
+	//Register them on the reactor
+	Run([this](){
+		loop->AddHandler(rtpHandler->fd,EPOLLIN,rtpHandler);
+		if (rtcpHandler)
+			loop->AddHandler(rtcpHandler->fd,EPOLLIN,rtcpHandler);
+	});
 }
 
 void RTPTransport::Stop()
 {
-	//Stop loops
-	rtpLoop.Stop();
-	rtcpLoop.Stop();
+	//Unregister sockets, no more reads will be done after this
+	Run([this](){
+		if (rtpHandler)
+			loop->RemoveHandler(rtpHandler->fd);
+		if (rtcpHandler)
+			loop->RemoveHandler(rtcpHandler->fd);
+		//Stop dtls timers too
+		dtls.End();
+	});
+
+	//Release them
+	rtpHandler.reset();
+	rtcpHandler.reset();
 }
 
-void RTPTransport::OnRead(const int fd, const uint8_t* data, const size_t size, const uint32_t ipAddr, const uint16_t port)
+void RTPTransport::Run(const std::function<void(void)>& func)
 {
-	if (fd == simSocket)
+	//If we are already on the reactor thread
+	if (loop->IsReactorThread())
+		//Run inline
+		func();
+	else
+		//Run there and wait
+		loop->Sync([&](auto now){ func(); });
+}
+
+int RTPTransport::Send(bool rtcp, const sockaddr_in& addr, Packet&& packet)
+{
+	//Sockets are not closed while sending
+	std::shared_lock<std::shared_mutex> lock(socketsMutex);
+
+	//Use the rtp socket if rtcp one is not opened
+	int fd = rtcp && simRtcpSocket!=FD_INVALID ? simRtcpSocket : simSocket;
+
+	//Check we are opened
+	if (fd==FD_INVALID)
+		return 0;
+
+	//Send it directly, no need to go through the reactor for udp
+	if (sendto(fd,packet.GetData(),packet.GetSize(),MSG_DONTWAIT,(const sockaddr*)&addr,sizeof(sockaddr_in))<0)
+	{
+		//Dropped
+		UltraDebug("-RTPTransport::Send() | error sending packet [fd:%d,size:%zu,errno:%d]\n",fd,packet.GetSize(),errno);
+		return 0;
+	}
+
+	return 1;
+}
+
+void RTPTransport::Socket::OnEvent(uint32_t events)
+{
+	//Receiving buffers are shared by all the sockets of the reactor thread
+	static thread_local BYTE buffers[MaxReceivingBatch][MTU] ALIGNEDTO32;
+	static thread_local sockaddr_in froms[MaxReceivingBatch];
+	static thread_local iovec iovs[MaxReceivingBatch];
+	static thread_local mmsghdr messages[MaxReceivingBatch];
+
+	//Prepare messages
+	for (DWORD i=0;i<MaxReceivingBatch;++i)
+	{
+		iovs[i].iov_base = buffers[i];
+		iovs[i].iov_len = MTU;
+		messages[i].msg_hdr.msg_name = &froms[i];
+		messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+		messages[i].msg_hdr.msg_iov = &iovs[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+		messages[i].msg_hdr.msg_control = nullptr;
+		messages[i].msg_hdr.msg_controllen = 0;
+		messages[i].msg_hdr.msg_flags = 0;
+	}
+
+	//Read a batch, if there are more we will get a new event on next iteration
+	int num = recvmmsg(fd,messages,MaxReceivingBatch,MSG_DONTWAIT,nullptr);
+
+	//Check errors, icmp errors are reported here too
+	if (num<0)
+	{
+		if (errno!=EAGAIN && errno!=EWOULDBLOCK)
+			UltraDebug("-RTPTransport::Socket::OnEvent() | error reading [fd:%d,events:%x,errno:%d]\n",fd,events,errno);
+		return;
+	}
+
+	//Process them
+	for (int i=0;i<num;++i)
+		transport->OnRead(rtcp,buffers[i],messages[i].msg_len,ntohl(froms[i].sin_addr.s_addr),ntohs(froms[i].sin_port));
+}
+
+void RTPTransport::OnRead(bool rtcp, const uint8_t* data, const size_t size, const uint32_t ipAddr, const uint16_t port)
+{
+	if (!rtcp)
 		//Read rtp data
 		ReadRTP(data,size,ipAddr,port);
-	else if (fd == simRtcpSocket)
+	else
 		//Read rtcp data
 		ReadRTCP(data,size,ipAddr,port);
 }
@@ -1207,7 +1376,7 @@ void RTPTransport::onDTLSPendingData()
 	//Until depleted
 	while(true)
 	{
-		Packet packet = rtpLoop.GetPacketPool().pick();
+		Packet packet;
 		//Read from dtls
 		size_t len = dtls.Read(packet.GetData(),packet.GetCapacity());
 		if (!len)
@@ -1215,7 +1384,7 @@ void RTPTransport::onDTLSPendingData()
 		//resize
 		packet.SetSize(len);
 		//Send response
-		rtpLoop.Send(ntohl(sendAddr.sin_addr.s_addr),ntohs(sendAddr.sin_port),std::move(packet));
+		Send(false,sendAddr,std::move(packet));
 	}
 		
 }
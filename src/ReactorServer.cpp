@@ -0,0 +1,266 @@
+#include "ReactorServer.h"
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <thread>
+
+#include "log.h"
+#include "assertions.h"
+
+ReactorServer::ReactorServer(const std::string& name) :
+	name(name)
+{
+}
+
+ReactorServer::~ReactorServer()
+{
+	//Stop just in case
+	StopAccepting();
+	Stop();
+}
+
+bool ReactorServer::Start(int port, in_addr_t iface, DWORD threads, Accepted accepted)
+{
+	//Check not already started
+	if (!reactors.empty())
+		return Error("-ReactorServer::Start() | already started [name:%s]\n",name.c_str());
+
+	//Use one reactor per core by default
+	if (!threads)
+		threads = std::min(std::max(std::thread::hardware_concurrency(),1u),MaxDefaultThreads);
+
+	Log("-ReactorServer::Start() [name:%s,port:%d,threads:%u]\n",name.c_str(),port,threads);
+
+	//Store listening address and callback
+	this->port = port;
+	this->iface = iface;
+	this->accepted = std::move(accepted);
+
+	//Init server socket
+	if (!BindServer())
+	{
+		//Close it if it was created
+		if (server!=FD_INVALID)
+			MCU_CLOSE(server);
+		//Invalidate
+		server = FD_INVALID;
+		//Error
+		return false;
+	}
+
+	//Accepting
+	accepting = true;
+
+	//Create reactors, connections are multiplexed on them
+	for (DWORD i=0;i<threads;++i)
+	{
+		auto reactor = std::make_unique<Reactor>();
+		//Start it
+		reactor->loop.Start();
+		reactor->loop.SetThreadName(name + "-reactor-" + std::to_string(i));
+		//Add it
+		reactors.push_back(std::move(reactor));
+	}
+
+	//Accept incoming connections on first reactor
+	acceptor = std::make_shared<Acceptor>(this);
+	reactors[0]->loop.Async([this](auto now){
+		reactors[0]->loop.AddHandler(server,EPOLLIN,acceptor);
+	});
+
+	//Done
+	return true;
+}
+
+bool ReactorServer::BindServer()
+{
+	//Close socket just in case
+	if (server!=FD_INVALID)
+		MCU_CLOSE(server);
+
+	//Create socket
+	server = socket(AF_INET, SOCK_STREAM, 0);
+
+	//Check
+	if (server==FD_INVALID)
+		return Error("-ReactorServer::BindServer() | Can't create server socket [name:%s,errno:%d]\n",name.c_str(),errno);
+
+	//Set non blocking and close on exec
+	(void)fcntl(server, F_SETFL, fcntl(server, F_GETFL, 0) | O_NONBLOCK);
+	(void)fcntl(server, F_SETFD, FD_CLOEXEC);
+
+	//Set SO_REUSEADDR on a socket to true (1):
+	int optval = 1;
+	(void)setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+
+	//Bind to requested interface
+	sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = iface;
+	addr.sin_port = htons(port);
+
+	//Bind
+	if (bind(server, (sockaddr*)&addr, sizeof(addr)) < 0)
+		//Error
+		return Error("-ReactorServer::BindServer() | Can't bind server socket [name:%s,port:%d,errno:%d]\n",name.c_str(),port,errno);
+
+	//Listen for connections, allow bursts of clients connecting at the same time
+	if (listen(server, SOMAXCONN) < 0)
+		//Error
+		return Error("-ReactorServer::BindServer() | Can't listen on server socket [name:%s,errno:%d]\n",name.c_str(),errno);
+
+	//Get port in case it was not set
+	if (getsockname(server, (sockaddr*)&addr, &len) == 0)
+		port = ntohs(addr.sin_port);
+
+	//OK
+	return true;
+}
+
+void ReactorServer::Accept(uint32_t events)
+{
+	//Get accepting reactor
+	EpollReactor& reactor = reactors[0]->loop;
+
+	//Chek events
+	if ((events & EPOLLERR) || (events & EPOLLHUP))
+	{
+		//Error
+		Error("-ReactorServer::Accept() | poll error event [name:%s,event:%d,fd:%d,errno:%d]\n",name.c_str(),events,server,errno);
+		//Stop listening on it
+		reactor.RemoveHandler(server);
+		//Check if still accepting
+		if (!accepting)
+			//Exit
+			return;
+		//Try to restart server
+		if (BindServer())
+			//Listen again
+			reactor.AddHandler(server,EPOLLIN,acceptor);
+		//Done
+		return;
+	}
+
+	//Accept all pending connections
+	while (accepting)
+	{
+#if defined(__linux__)
+		//Accept incoming connection as non blocking
+		int fd = accept4(server,NULL,0,SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+		//Accept incoming connection
+		int fd = accept(server,NULL,0);
+#endif
+
+		//If error
+		if (fd<0)
+		{
+			//If interrupted
+			if (errno==EINTR)
+				//Try again
+				continue;
+			//If not just no more connections pending
+			if (errno!=EAGAIN && errno!=EWOULDBLOCK)
+				//LOg error
+				Error("-ReactorServer::Accept() | error accepting new connection [name:%s,fd:%d,errno:%d]\n",name.c_str(),server,errno);
+			//Wait for more
+			break;
+		}
+
+#if !defined(__linux__)
+		//Set non blocking and close on exec
+		(void)fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+		(void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+
+		//Create the connection on the least loaded reactor
+		accepted(fd,Assign());
+	}
+}
+
+EpollReactor* ReactorServer::Assign()
+{
+	//Get reactor with less connections assigned, only done on the accepting reactor
+	Reactor* reactor = reactors[0].get();
+	for (const auto& candidate : reactors)
+		if (candidate->assigned<reactor->assigned)
+			reactor = candidate.get();
+
+	//One more, counted before the connection is registered on it
+	reactor->assigned++;
+
+	//Done
+	return &reactor->loop;
+}
+
+void ReactorServer::Release(EpollReactor* loop)
+{
+	//Find reactor
+	for (const auto& reactor : reactors)
+	{
+		//If found
+		if (&reactor->loop==loop)
+		{
+			//One less, never below zero
+			size_t assigned = reactor->assigned;
+			while (assigned && !reactor->assigned.compare_exchange_weak(assigned,assigned-1));
+			//Done
+			return;
+		}
+	}
+}
+
+void ReactorServer::StopAccepting()
+{
+	//Check if accepting
+	if (!accepting.exchange(false))
+		//Do nothing
+		return;
+
+	Log("-ReactorServer::StopAccepting() [name:%s]\n",name.c_str());
+
+	//Get accepting reactor
+	EpollReactor& reactor = reactors[0]->loop;
+
+	//Remove server socket from reactor and close it
+	auto stop = [this,&reactor](auto now){
+		//Stop listening
+		reactor.RemoveHandler(server);
+		//Close server socket
+		shutdown(server,SHUT_RDWR);
+		MCU_CLOSE(server);
+		//Invalidate
+		server = FD_INVALID;
+	};
+
+	//If called from a callback on the accepting reactor, run it now as waiting for it would deadlock
+	if (reactor.IsReactorThread())
+		stop(reactor.GetNow());
+	else
+		reactor.Future(stop).wait();
+
+	//No more accepts
+	acceptor.reset();
+}
+
+void ReactorServer::Stop()
+{
+	//Check we have been started
+	if (reactors.empty())
+		//Do nothing
+		return;
+
+	Log("-ReactorServer::Stop() [name:%s]\n",name.c_str());
+
+	//Stop reactors
+	for (auto& reactor : reactors)
+		reactor->loop.Stop();
+	reactors.clear();
+}
@@ -1,4 +1,5 @@
 #include "SimulcastMediaFrameListener.h"
+#include <cassert>
 
 namespace {
 
@@ -0,0 +1,210 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <mutex>
+#include <new>
+
+#include "log.h"
+#include "StatsSnapshot.h"
+
+namespace {
+
+struct Storage
+{
+	std::mutex mutex;
+	StatsSnapshotRegistry::Header* header	= nullptr;
+	StatsSnapshotRegistry::Slot* slots	= nullptr;
+	std::atomic<bool> initialized		= false;
+	std::atomic<uint32_t> next		= 0;
+	bool full				= false;
+};
+
+Storage storage;
+
+StatsSnapshotRegistry::Slot* Construct(void* memory, uint32_t num)
+{
+	//Set header
+	auto header = new (memory) StatsSnapshotRegistry::Header{
+		StatsSnapshotRegistry::Magic,
+		StatsSnapshotRegistry::Version,
+		num,
+		sizeof(StatsSnapshotRegistry::Slot)
+	};
+	//Slots follow header
+	auto slots = reinterpret_cast<StatsSnapshotRegistry::Slot*>(header + 1);
+	//Init them
+	for (uint32_t i = 0; i < num; ++i)
+		new (slots + i) StatsSnapshotRegistry::Slot();
+	//Store
+	storage.header = header;
+	storage.slots = slots;
+	//Done
+	storage.initialized.store(true, std::memory_order_release);
+	return slots;
+}
+
+void Init()
+{
+	//Fast path
+	if (storage.initialized.load(std::memory_order_acquire))
+		return;
+
+	std::lock_guard<std::mutex> lock(storage.mutex);
+
+	//Check again
+	if (storage.initialized.load(std::memory_order_relaxed))
+		return;
+
+	//Allocate on heap, never released as publishers could outlive any owner
+	void* memory = ::operator new(sizeof(StatsSnapshotRegistry::Header) + sizeof(StatsSnapshotRegistry::Slot) * StatsSnapshotRegistry::DefaultSlots);
+	//Init
+	Construct(memory, StatsSnapshotRegistry::DefaultSlots);
+}
+
+}
+
+bool StatsSnapshotRegistry::Export(const char* name, uint32_t num)
+{
+	std::lock_guard<std::mutex> lock(storage.mutex);
+
+	//Can't move slots once they are in use
+	if (storage.initialized.load(std::memory_order_relaxed))
+		return Error("-StatsSnapshotRegistry::Export() | Already initialized [name:%s]\n", name);
+
+	//Get size
+	size_t size = sizeof(Header) + sizeof(Slot) * num;
+
+	//Create shared memory object
+	int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	//Check
+	if (fd < 0)
+		return Error("-StatsSnapshotRegistry::Export() | Could not open shared memory [name:%s,errno:%d]\n", name, errno);
+
+	//Set size
+	if (ftruncate(fd, size) < 0)
+	{
+		Error("-StatsSnapshotRegistry::Export() | Could not set shared memory size [name:%s,size:%zu,errno:%d]\n", name, size, errno);
+		close(fd);
+		return false;
+	}
+
+	//Map it
+	void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	//Not needed anymore
+	close(fd);
+	//Check
+	if (memory == MAP_FAILED)
+		return Error("-StatsSnapshotRegistry::Export() | Could not map shared memory [name:%s,size:%zu,errno:%d]\n", name, size, errno);
+
+	//Init slots on it
+	Construct(memory, num);
+
+	Log("-StatsSnapshotRegistry::Export() | Exporting stats [name:%s,slots:%u,slotSize:%zu]\n", name, num, sizeof(Slot));
+
+	//Done
+	return true;
+}
+
+StatsSnapshotRegistry::Slot* StatsSnapshotRegistry::Acquire()
+{
+	//Ensure we have slots
+	Init();
+
+	uint32_t num = storage.header->slots;
+	//Start after last acquired one
+	uint32_t start = storage.next.load(std::memory_order_relaxed);
+	//Find a free one
+	for (uint32_t i = 0; i < num; ++i)
+	{
+		uint32_t pos = (start + i) % num;
+		uint32_t expected = 0;
+		//Try to get it
+		if (storage.slots[pos].used.compare_exchange_strong(expected, 1, std::memory_order_acq_rel))
+		{
+			//Next search starts after this one
+			storage.next.store(pos + 1, std::memory_order_relaxed);
+			return storage.slots + pos;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(storage.mutex);
+	//Only report it once
+	if (!storage.full)
+		Warning("-StatsSnapshotRegistry::Acquire() | No free slots, stats will not be published [slots:%u]\n", num);
+	storage.full = true;
+
+	//No slot
+	return nullptr;
+}
+
+void StatsSnapshotRegistry::Release(Slot* slot)
+{
+	//Clean it so readers skip it
+	slot->snapshot.Publish(StatsSnapshot{});
+	//Free
+	slot->used.store(0, std::memory_order_release);
+}
+
+std::vector<StatsSnapshot> StatsSnapshotRegistry::GetSnapshots()
+{
+	std::vector<StatsSnapshot> snapshots;
+
+	//Nothing published yet
+	if (!storage.initialized.load(std::memory_order_acquire))
+		return snapshots;
+
+	uint32_t num = storage.header->slots;
+	//Copy all published ones
+	for (uint32_t i = 0; i < num; ++i)
+	{
+		//Skip unused
+		if (!storage.slots[i].used.load(std::memory_order_acquire))
+			continue;
+		//Copy it
+		auto snapshot = storage.slots[i].snapshot.Read();
+		//Skip if not published yet
+		if (snapshot.kind != StatsSnapshot::Empty)
+			snapshots.push_back(snapshot);
+	}
+
+	return snapshots;
+}
+
+uint32_t StatsSnapshotRegistry::GetSlots()
+{
+	//Ensure we have slots
+	Init();
+	return storage.header->slots;
+}
+
+uint32_t StatsSnapshotRegistry::GetUsedSlots()
+{
+	uint32_t used = 0;
+
+	//Nothing published yet
+	if (!storage.initialized.load(std::memory_order_acquire))
+		return used;
+
+	for (uint32_t i = 0; i < storage.header->slots; ++i)
+		if (storage.slots[i].used.load(std::memory_order_relaxed))
+			used++;
+
+	return used;
+}
+
+StatsSnapshotRegistry::Publisher::~Publisher()
+{
+	//Free slot
+	if (slot)
+		Release(slot);
+}
+
+void StatsSnapshotRegistry::Publisher::Publish(const StatsSnapshot& snapshot)
+{
+	//Get slot on first publish
+	if (!slot)
+		slot = Acquire();
+	//If we have one
+	if (slot)
+		slot->snapshot.Publish(snapshot);
+}
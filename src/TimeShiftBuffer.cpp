@@ -0,0 +1,520 @@
+#include "TimeShiftBuffer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "log.h"
+#include "tools.h"
+#include "audio.h"
+#include "video.h"
+#include "text.h"
+
+//Initial size of the arena
+static constexpr size_t MinArenaSize = 64*1024;
+//Size of each rtp packetization info record, without prefix
+static constexpr DWORD RtpPacketRecordSize = 10;
+
+size_t TimeShiftBuffer::Ring::Alloc(size_t size)
+{
+	size_t offset;
+
+	//Check it can fit at all, empty records would make the ring look both empty and full
+	if (!size || size>capacity)
+		return (size_t)-1;
+
+	//If empty start from the beginning
+	if (!count)
+	{
+		offset = 0;
+	//If not wrapped
+	} else if (tail>head) {
+		//Put it at the end, or wrap if there is room at the start
+		if (capacity-tail>=size)
+			offset = tail;
+		else if (head>=size)
+			offset = 0;
+		else
+			return (size_t)-1;
+	//Wrapped, only room between tail and head
+	} else if (head-tail>=size) {
+		offset = tail;
+	} else {
+		return (size_t)-1;
+	}
+
+	//Allocated
+	tail = offset+size;
+	used += size;
+	count++;
+
+	return offset;
+}
+
+void TimeShiftBuffer::Ring::Free(size_t size, size_t next)
+{
+	used -= size;
+	count--;
+	//If no more records
+	if (!count)
+		//Start again
+		Reset();
+	else
+		//Move head to next one
+		head = next;
+}
+
+void TimeShiftBuffer::Ring::Reset()
+{
+	head	= 0;
+	tail	= 0;
+	used	= 0;
+	count	= 0;
+}
+
+TimeShiftBuffer::TimeShiftBuffer() :
+	TimeShiftBuffer(Options{})
+{
+}
+
+TimeShiftBuffer::TimeShiftBuffer(const Options& options) :
+	options(options)
+{
+}
+
+TimeShiftBuffer::~TimeShiftBuffer()
+{
+	//Release memory and spill file
+	Clear();
+}
+
+void TimeShiftBuffer::SetOptions(const Options& options)
+{
+	//New limits apply to new frames
+	this->options = options;
+}
+
+bool TimeShiftBuffer::Push(DWORD ssrc, const MediaFrame& frame)
+{
+	//Check type
+	if (frame.GetType()!=MediaFrame::Audio && frame.GetType()!=MediaFrame::Video && frame.GetType()!=MediaFrame::Text)
+		return false;
+
+	//Get config and packetization sizes, ignore them if they don't fit on the entry
+	DWORD configSize = frame.HasCodecConfig() && frame.GetCodecConfigSize()<=0xFFFF ? frame.GetCodecConfigSize() : 0;
+	const auto& rtpInfo = frame.GetRtpPacketizationInfo();
+	DWORD numRtpPackets = rtpInfo.size()<=0xFFFF ? rtpInfo.size() : 0;
+	DWORD rtpSize = 0;
+	for (DWORD i=0;i<numRtpPackets;++i)
+		rtpSize += RtpPacketRecordSize + rtpInfo[i].GetPrefixLen();
+
+	Entry entry = {};
+	entry.time		= frame.GetTime();
+	entry.timestamp		= frame.GetTimeStamp();
+	entry.senderTime	= frame.GetSenderTime();
+	entry.ssrc		= ssrc;
+	entry.clockRate		= frame.GetClockRate();
+	entry.duration		= frame.GetDuration();
+	entry.length		= frame.GetLength();
+	entry.size		= configSize + rtpSize + entry.length;
+	entry.configSize	= configSize;
+	entry.numRtpPackets	= numRtpPackets;
+	entry.type		= frame.GetType();
+
+	//Get media specific info
+	if (frame.GetType()==MediaFrame::Audio)
+	{
+		const AudioFrame& audio = (const AudioFrame&)frame;
+		entry.codec	= audio.GetCodec();
+		entry.channels	= audio.GetNumChannels();
+	} else if (frame.GetType()==MediaFrame::Video) {
+		const VideoFrame& video = (const VideoFrame&)frame;
+		entry.codec	= video.GetCodec();
+		entry.width	= video.GetWidth();
+		entry.height	= video.GetHeight();
+		entry.intra	= video.IsIntra();
+		//Use first video stream for eviction
+		if (!hasReference)
+		{
+			reference = ssrc;
+			hasReference = true;
+		}
+	}
+
+	//Nothing to store
+	if (!entry.size)
+		return false;
+
+	//Drop frames out of the window
+	Trim(entry.time);
+
+	//Get room for it, without evicting anything if it would never fit
+	entry.offset = entry.size<=options.maxMemory ? Alloc(entry.size) : (size_t)-1;
+	//Check
+	if (entry.offset==(size_t)-1)
+	{
+		stats.overflows++;
+		return Warning("-TimeShiftBuffer::Push() | frame does not fit [size:%u,maxMemory:%zu]\n",entry.size,options.maxMemory);
+	}
+
+	//Serialize
+	BYTE* pos = arena.get() + entry.offset;
+	if (configSize)
+	{
+		memcpy(pos,frame.GetCodecConfigData(),configSize);
+		pos += configSize;
+	}
+	for (DWORD i=0;i<numRtpPackets;++i)
+	{
+		const auto& rtp = rtpInfo[i];
+		set4(pos,0,rtp.GetPos());
+		set4(pos,4,rtp.GetSize());
+		set2(pos,8,rtp.GetPrefixLen());
+		if (rtp.GetPrefixLen())
+			memcpy(pos+RtpPacketRecordSize,rtp.GetPrefixData(),rtp.GetPrefixLen());
+		pos += RtpPacketRecordSize + rtp.GetPrefixLen();
+	}
+	if (entry.length)
+		memcpy(pos,frame.GetData(),entry.length);
+
+	//Add it
+	entries.push_back(entry);
+	stats.frames++;
+
+	return true;
+}
+
+void TimeShiftBuffer::Drain(const Function& func)
+{
+	//For each frame in order
+	for (const auto& entry : entries)
+	{
+		//Get record
+		const BYTE* data = Read(entry);
+		//Skip if it could not be read
+		if (!data)
+			continue;
+
+		std::unique_ptr<MediaFrame> frame;
+		const BYTE* config = data;
+		const BYTE* rtp = config + entry.configSize;
+		const BYTE* media = data + entry.size - entry.length;
+
+		//Create frame
+		switch (entry.type)
+		{
+			case MediaFrame::Audio:
+			{
+				auto audio = std::make_unique<AudioFrame>((AudioCodec::Type)entry.codec);
+				audio->SetNumChannels(entry.channels);
+				audio->SetMedia(media,entry.length);
+				frame = std::move(audio);
+				break;
+			}
+			case MediaFrame::Video:
+			{
+				auto video = std::make_unique<VideoFrame>((VideoCodec::Type)entry.codec,entry.length);
+				video->SetWidth(entry.width);
+				video->SetHeight(entry.height);
+				video->SetIntra(entry.intra);
+				video->SetMedia(media,entry.length);
+				frame = std::move(video);
+				break;
+			}
+			default:
+				frame = std::make_unique<TextFrame>(entry.timestamp,media,entry.length);
+				break;
+		}
+
+		frame->SetTimestamp(entry.timestamp);
+		frame->SetTime(entry.time);
+		frame->SetSenderTime(entry.senderTime);
+		frame->SetClockRate(entry.clockRate);
+		frame->SetDuration(entry.duration);
+		if (entry.configSize)
+			frame->SetCodecConfig(config,entry.configSize);
+		for (DWORD i=0;i<entry.numRtpPackets;++i)
+		{
+			DWORD prefixLen = get2(rtp,8);
+			frame->AddRtpPacket(get4(rtp,0),get4(rtp,4),prefixLen ? rtp+RtpPacketRecordSize : nullptr,prefixLen);
+			rtp += RtpPacketRecordSize + prefixLen;
+		}
+
+		//Deliver it
+		func(entry.ssrc,*frame);
+	}
+
+	//Done
+	Clear();
+}
+
+void TimeShiftBuffer::Swap(TimeShiftBuffer& other)
+{
+	std::swap(options,other.options);
+	std::swap(stats,other.stats);
+	std::swap(entries,other.entries);
+	std::swap(arena,other.arena);
+	std::swap(memory,other.memory);
+	std::swap(fd,other.fd);
+	std::swap(spill,other.spill);
+	std::swap(scratch,other.scratch);
+	std::swap(reference,other.reference);
+	std::swap(hasReference,other.hasReference);
+}
+
+void TimeShiftBuffer::Clear()
+{
+	//Drop all
+	entries.clear();
+	hasReference = false;
+
+	//Release arena
+	arena.reset();
+	memory = {};
+
+	//Close spill file, it was already unlinked
+	if (fd!=FD_INVALID)
+		::close(fd);
+	fd = FD_INVALID;
+	spill = {};
+
+	//Release scratch buffer
+	std::vector<BYTE>().swap(scratch);
+}
+
+bool TimeShiftBuffer::IsSync(const Entry& entry) const
+{
+	//If there is no video all frames are sync
+	if (!hasReference)
+		return true;
+	//Only key frames of the reference video stream
+	return entry.type==MediaFrame::Video && entry.ssrc==reference && entry.intra;
+}
+
+size_t TimeShiftBuffer::Alloc(DWORD size)
+{
+	//Until it fits
+	while (true)
+	{
+		//Check if we have room
+		size_t offset = memory.Alloc(size);
+		//If we have
+		if (offset!=(size_t)-1)
+			return offset;
+		//Try to grow the arena
+		if (Grow(size))
+			continue;
+		//If there is nothing more to free
+		if (!memory.count)
+			return (size_t)-1;
+		//Move oldest frame to disk, or drop oldest gop
+		if (!Spill())
+			EvictGOP();
+	}
+}
+
+bool TimeShiftBuffer::Grow(size_t size)
+{
+	//Get new size
+	size_t capacity = std::min(std::max({memory.capacity*2,memory.used+size,MinArenaSize}),options.maxMemory);
+
+	//Check if it would be bigger
+	if (capacity<=memory.capacity)
+		return false;
+
+	auto grown = std::make_unique<BYTE[]>(capacity);
+
+	//Copy frames in memory in order
+	size_t pos = 0;
+	for (auto& entry : entries)
+	{
+		if (entry.spilled)
+			continue;
+		memcpy(grown.get()+pos,arena.get()+entry.offset,entry.size);
+		entry.offset = pos;
+		pos += entry.size;
+	}
+
+	//Use new one
+	arena = std::move(grown);
+	memory.capacity = capacity;
+	memory.head = 0;
+	memory.tail = pos;
+
+	Debug("-TimeShiftBuffer::Grow() [capacity:%zu,used:%zu]\n",capacity,memory.used);
+
+	return true;
+}
+
+bool TimeShiftBuffer::Spill()
+{
+	//Check if enabled
+	if (options.spillDir.empty())
+		return false;
+
+	//Open spill file on first use
+	if (fd==FD_INVALID)
+	{
+		std::string path = options.spillDir + "/timeshift-XXXXXX";
+		//Create unique file
+		fd = mkstemp(path.data());
+		//Check
+		if (fd<0)
+		{
+			fd = FD_INVALID;
+			Error("-TimeShiftBuffer::Spill() | could not create spill file, disabling spill [path:%s,errno:%d]\n",path.c_str(),errno);
+			//Don't try again
+			options.spillDir.clear();
+			return false;
+		}
+		//Remove it so it is deleted when closed
+		unlink(path.c_str());
+		//Init ring
+		spill = {};
+		spill.capacity = options.maxSpill;
+		Log("-TimeShiftBuffer::Spill() | spilling to disk [dir:%s,maxSpill:%zu]\n",options.spillDir.c_str(),options.maxSpill);
+	}
+
+	//Oldest frame in memory is the one after the spilled ones
+	size_t i = spill.count;
+	//Check
+	if (i>=entries.size() || entries[i].size>spill.capacity)
+		return false;
+
+	size_t offset;
+	bool evicted = false;
+	//Make room on disk dropping oldest frames
+	while ((offset = spill.Alloc(entries[spill.count].size))==(size_t)-1 && spill.count)
+	{
+		EvictOldest();
+		evicted = true;
+	}
+
+	//Check
+	if (offset==(size_t)-1)
+		return false;
+
+	//It is now the last one on disk
+	i = spill.count-1;
+	auto& entry = entries[i];
+
+	//Write it
+	const BYTE* data = arena.get()+entry.offset;
+	size_t written = 0;
+	while (written<entry.size)
+	{
+		ssize_t len = pwrite(fd,data+written,entry.size-written,offset+written);
+		//Check error
+		if (len<0 && errno==EINTR)
+			continue;
+		if (len<=0)
+		{
+			Error("-TimeShiftBuffer::Spill() | write failed, disabling spill [errno:%d]\n",errno);
+			//Drop frames on disk, this one is still in memory
+			while (!entries.empty() && entries.front().spilled)
+			{
+				entries.pop_front();
+				stats.evicted++;
+			}
+			//Close file
+			::close(fd);
+			fd = FD_INVALID;
+			spill = {};
+			options.spillDir.clear();
+			return false;
+		}
+		written += len;
+	}
+
+	//Free it from memory, it is the oldest one there
+	memory.Free(entry.size,NextOffset(i,false));
+
+	//Now on disk
+	entry.spilled = true;
+	entry.offset = offset;
+	stats.spilled++;
+
+	//If we have dropped frames, keep it gop aligned
+	while (evicted && !entries.empty() && entries.front().spilled && !IsSync(entries.front()))
+		EvictOldest();
+
+	return true;
+}
+
+void TimeShiftBuffer::EvictOldest()
+{
+	const auto& entry = entries.front();
+	//Free it
+	if (entry.spilled)
+		spill.Free(entry.size,NextOffset(0,true));
+	else
+		memory.Free(entry.size,NextOffset(0,false));
+	//Remove
+	entries.pop_front();
+	stats.evicted++;
+}
+
+void TimeShiftBuffer::EvictGOP()
+{
+	//Drop oldest
+	if (!entries.empty())
+		EvictOldest();
+	//And all until next key frame
+	while (!entries.empty() && !IsSync(entries.front()))
+		EvictOldest();
+}
+
+void TimeShiftBuffer::Trim(QWORD now)
+{
+	//Check if we have enough
+	if (now<=options.duration)
+		return;
+
+	//Get window start
+	QWORD start = now - options.duration;
+
+	//Find last sync frame before window start
+	size_t last = 0;
+	for (size_t i=0; i<entries.size() && entries[i].time<=start; ++i)
+		if (IsSync(entries[i]))
+			last = i;
+
+	//Drop all before it
+	for (size_t i=0; i<last; ++i)
+		EvictOldest();
+}
+
+size_t TimeShiftBuffer::NextOffset(size_t i, bool spilled) const
+{
+	//Spilled frames are always before the ones in memory
+	return i+1<entries.size() && entries[i+1].spilled==spilled ? entries[i+1].offset : 0;
+}
+
+const BYTE* TimeShiftBuffer::Read(const Entry& entry)
+{
+	//If in memory
+	if (!entry.spilled)
+		return arena.get()+entry.offset;
+
+	//Read from disk
+	scratch.resize(entry.size);
+	size_t read = 0;
+	while (read<entry.size)
+	{
+		ssize_t len = pread(fd,scratch.data()+read,entry.size-read,entry.offset+read);
+		//Check error
+		if (len<0 && errno==EINTR)
+			continue;
+		if (len<=0)
+		{
+			Error("-TimeShiftBuffer::Read() | read failed [errno:%d]\n",errno);
+			return nullptr;
+		}
+		read += len;
+	}
+
+	return scratch.data();
+}
@@ -1,6 +1,14 @@
 #include "VideoDecoderWorker.h"
 #include "media.h"
 #include "VideoCodecFactory.h"
+#include <algorithm>
+
+VideoDecoderWorker::VideoDecoderWorker() :
+	outputs([this](const VideoBuffer::const_shared& input, const VideoBuffer::shared& output) {
+		return scaler.Resize(input, output, true);
+	})
+{
+}
 
 VideoDecoderWorker::~VideoDecoderWorker()
 {
@@ -16,26 +24,21 @@ int VideoDecoderWorker::Start()
 		//Stop first
 		Stop();
 
+	//Reset decoding state
+	frameTime = (QWORD)-1;
+	lastSeq = RTPPacket::MaxExtSeqNum;
+	waitIntra = false;
+	lastFrameTimestamp = (QWORD)-1;
+	framePeriod = DefaultFramePeriod;
+
 	//Start decoding
 	decoding = 1;
 
-	//launc thread
-	createPriorityThread(&thread,startDecoding,this,0);
+	//Accept packets on the worker
+	worker->Start();
 
 	return 1;
 }
-void * VideoDecoderWorker::startDecoding(void *par)
-{
-	Log("VideoDecoderThread [%p]\n",pthread_self());
-	//Get worker
-	VideoDecoderWorker *worker = (VideoDecoderWorker *)par;
-	//Block all signals
-	blocksignals();
-	//Run
-	worker->Decode();
-	//Exit
-	return NULL;;
-}
 
 int  VideoDecoderWorker::Stop()
 {
@@ -47,210 +50,183 @@ int  VideoDecoderWorker::Stop()
 	//Stop
 	decoding=0;
 
-	//Cancel any pending wait
-	packets.Cancel();
-
-	//Esperamos
-	pthread_join(thread,NULL);
+	//Drop pending packets and wait for current one
+	worker->Stop();
 
 	Log("<VideoDecoderWorker::Stop()\n");
 
 	return 1;
 }
 
-void VideoDecoderWorker::AddVideoOutput(VideoOutput* output)
+void VideoDecoderWorker::AddVideoOutput(VideoOutput* output, uint32_t width, uint32_t height, uint32_t maxFps)
 {
-	//Ensure we have a valid value
-	if (!output)
-		//Done
-		return;
-		
-	ScopedLock scope(mutex);
-	//Add it
-	outputs.insert(output);
-
+	//Add it or update it
+	outputs.AddOutput(output,width,height,maxFps);
 }
 
 void VideoDecoderWorker::RemoveVideoOutput(VideoOutput* output)
 {
-	ScopedLock scope(mutex);
 	//Remove from ouput
-	outputs.erase(output);
+	outputs.RemoveOutput(output);
 }
 
-int VideoDecoderWorker::Decode()
+DWORD VideoDecoderWorker::GetDroppedFrames(VideoOutput* output)
 {
-	QWORD		frameTime = (QWORD)-1;
-	DWORD		lastSeq = RTPPacket::MaxExtSeqNum;
-	bool		waitIntra = false;
+	//Return dropped frames
+	return outputs.GetDroppedFrames(output);
+}
 
-	Log(">VideoDecoderWorker::Decode()\n");
+void VideoDecoderWorker::Decode(const RTPPacket::shared& packet)
+{
+	//Get extended sequence number and timestamp
+	DWORD seq = packet->GetExtSeqNum();
+	QWORD ts = packet->GetExtTimestamp();
 
-	//Mientras tengamos que capturar
-	while(decoding)
+	//If we don't have codec
+	if (!videoDecoder || (packet->GetCodec()!=videoDecoder->type))
 	{
-		//Obtenemos el paquete
-		if (!packets.Wait(0))
-			//Done
-			break;
+		//Create new codec from pacekt
+		videoDecoder.reset(VideoCodecFactory::CreateDecoder((VideoCodec::Type)packet->GetCodec()));
+			
+		//Check we found one
+		if (!videoDecoder)
+			//Skip
+			return;
+	}
+	
+	//Lost packets since last
+	DWORD lost = 0;
 
-		//Get packet in queue
-		auto packet = packets.Pop();
+	//If not first
+	if (lastSeq!=RTPPacket::MaxExtSeqNum)
+		//Calculate losts
+		lost = seq-lastSeq-1;
+	
+	//Update last sequence number
+	lastSeq = seq;
+	
+	//If lost some packets or still have not got an iframe
+	if(lost)
+		//Waiting for refresh
+		waitIntra = true;
 
+	//Check if we have lost the last packet from the previous frame by comparing both timestamps
+	if (ts>frameTime)
+	{
+		Debug("-VideoDecoderWorker::Decode() | lost mark packet ts:%llu frameTime:%llu\n",ts,frameTime);
+		//Try to decode what is in the buffer
+		videoDecoder->DecodePacket(NULL,0,1,1);
+		//Get picture
+		const VideoBuffer::shared& frame = videoDecoder->GetFrame();
 		//Check
-		if (!packet)
-			//Check condition again
-			continue;
-		
-		//Get extended sequence number and timestamp
-		DWORD seq = packet->GetExtSeqNum();
-		QWORD ts = packet->GetExtTimestamp();
-
-		//If we don't have codec
-		if (!videoDecoder || (packet->GetCodec()!=videoDecoder->type))
-		{
-			//Create new codec from pacekt
-			videoDecoder.reset(VideoCodecFactory::CreateDecoder((VideoCodec::Type)packet->GetCodec()));
-				
-			//Check we found one
-			if (!videoDecoder)
-				//Skip
-				continue;
-		}
-		
-		//Lost packets since last
-		DWORD lost = 0;
-
-		//If not first
-		if (lastSeq!=RTPPacket::MaxExtSeqNum)
-			//Calculate losts
-			lost = seq-lastSeq-1;
-		
-		//Update last sequence number
-		lastSeq = seq;
-		
-		//If lost some packets or still have not got an iframe
-		if(lost)
-			//Waiting for refresh
-			waitIntra = true;
+		if (frame && !muted)
+			//Send it to all outputs
+			outputs.Deliver(frame, frameTime*1000/packet->GetClockRate());
+	}
+	
+	//Update frame time
+	frameTime = ts;
+	
+	//Decode packet
+	if(!videoDecoder->DecodePacket(packet->GetMediaData(),packet->GetMediaLength(),lost,packet->GetMark()))
+		//Waiting for refresh
+		waitIntra = true;
 
-		//Check if we have lost the last packet from the previous frame by comparing both timestamps
-		if (ts>frameTime)
+	//Check if it is the last packet of a frame
+	if(packet->GetMark())
+	{
+		//Check if we got the waiting refresh
+		if (waitIntra && videoDecoder->IsKeyFrame())
 		{
-			Debug("-VideoDecoderWorker::Decode() | lost mark packet ts:%llu frameTime:%llu\n",ts,frameTime);
-			//Try to decode what is in the buffer
-			videoDecoder->DecodePacket(NULL,0,1,1);
-			//Get picture
-			const VideoBuffer::shared& frame = videoDecoder->GetFrame();
-			//Check
-			if (frame && !muted)
-			{
-				//Sync
-				ScopedLock scope(mutex);
-				//For each output
-				for (auto output : outputs)
-					//Send it
-					output->NextFrame(frame);
-			}
+			Debug("-VideoDecoderWorker::Decode() | Got Intra\n");
+			//Do not wait anymore
+			waitIntra = false;
 		}
 		
-		//Update frame time
-		frameTime = ts;
-		
-		//Decode packet
-		if(!videoDecoder->DecodePacket(packet->GetMediaData(),packet->GetMediaLength(),lost,packet->GetMark()))
-			//Waiting for refresh
-			waitIntra = true;
-
-		//Check if it is the last packet of a frame
-		if(packet->GetMark())
+		//No frame time yet for next frame
+		frameTime = (QWORD)-1;
+
+		//Estimate frame duration from the timestamps of consecutive frames
+		if (lastFrameTimestamp!=(QWORD)-1 && ts>lastFrameTimestamp && packet->GetClockRate())
+			framePeriod = std::clamp<QWORD>((ts-lastFrameTimestamp)*1000000/packet->GetClockRate(),MinFramePeriod,MaxFramePeriod);
+		//Store it for next one
+		lastFrameTimestamp = ts;
+
+		//Get picture
+		const VideoBuffer::shared& frame = videoDecoder->GetFrame();
+
+		//If no frame received yet
+		if (!frame)
+			//Get next one
+			return;
+
+		//Set reception time of the last packet of the frame
+		frame->SetTime(packet->GetTime()*1000);
+		//Update latency from reception to decoded picture
+		QWORD decoded = getTime();
+		if (decoded>=frame->GetTime())
+			decodeLatency.Record(decoded - frame->GetTime());
+
+		//Check if we need to apply deinterlacing
+		if (frame->IsInterlaced())
 		{
-			//Check if we got the waiting refresh
-			if (waitIntra && videoDecoder->IsKeyFrame())
+			//If we didn't had a deinterlacer or frame dimensions have changed (TODO)
+			if (!deinterlacer)
 			{
-				Debug("-VideoDecoderWorker::Decode() | Got Intra\n");
-				//Do not wait anymore
-				waitIntra = false;
-			}
-			
-			//No frame time yet for next frame
-			frameTime = (QWORD)-1;
+				//Create new deinterlacer
+				deinterlacer.reset(new Deinterlacer());
 
-			//Get picture
-			const VideoBuffer::shared& frame = videoDecoder->GetFrame();
-
-			//If no frame received yet
-			if (!frame)
-				//Get next one
-				continue;
-
-			//Check if we need to apply deinterlacing
-			if (frame->IsInterlaced())
-			{
-				//If we didn't had a deinterlacer or frame dimensions have changed (TODO)
-				if (!deinterlacer)
+				//Start it
+				if (!deinterlacer->Start(frame->GetWidth(), frame->GetHeight()))
 				{
-					//Create new deinterlacer
-					deinterlacer.reset(new Deinterlacer());
-
-					//Start it
-					if (!deinterlacer->Start(frame->GetWidth(), frame->GetHeight()))
-					{
-						Error("-VideoDecoderWorker::Decode() | Could not start deinterlacer\n");
-						deinterlacer.reset();
-						continue;
-					}
+					Error("-VideoDecoderWorker::Decode() | Could not start deinterlacer\n");
+					deinterlacer.reset();
+					return;
 				}
+			}
 
-				//Deinterlace decoded frame
-				deinterlacer->Process(frame);
+			//Deinterlace decoded frame
+			deinterlacer->Process(frame);
 
-				//Get any porcessed frame
-				while (auto deinterlaced = deinterlacer->GetNextFrame())
-				{
-					//Check if we are muted
-					if (!muted)
-					{
-						//Sync
-						ScopedLock scope(mutex);
-						//For each output
-						for (auto output : outputs)
-							//Send it
-							output->NextFrame(deinterlaced);
-					}
-				}
-			} else if (!muted) {
-				//Sync
-				ScopedLock scope(mutex);
-				//For each output
-				for (auto output : outputs)
-					//Send it
-					output->NextFrame(frame);
+			//Get any porcessed frame
+			while (auto deinterlaced = deinterlacer->GetNextFrame())
+			{
+				//Keep reception time
+				deinterlaced->SetTime(frame->GetTime());
+				//Check if we are muted
+				if (!muted)
+					//Send it to all outputs
+					outputs.Deliver(deinterlaced, ts*1000/packet->GetClockRate());
 			}
+		} else if (!muted) {
+			//Send it to all outputs
+			outputs.Deliver(frame, ts*1000/packet->GetClockRate());
 		}
 	}
-
-	Log("<VideoDecoderWorker::Decode()\n");
-
-	//Exit
-	return 0;
 }
 
 void VideoDecoderWorker::onRTP(const RTPIncomingMediaStream* stream, const RTPPacket::shared& packet)
 {
-	//Put it on the queue
-	packets.Add(packet->Clone());
+	//If not decoding
+	if (!decoding)
+		//Skip
+		return;
+
+	//Decode it before next frame is expected
+	worker->Post(getTime() + framePeriod, [this,packet = packet->Clone()](){
+		Decode(packet);
+	});
 }
 
 void VideoDecoderWorker::onEnded(const RTPIncomingMediaStream* stream)
 {
-	//Cancel packets wait
-	packets.Cancel();
+	//Drop pending packets
+	worker->Stop();
 }
 
 
 void VideoDecoderWorker::onBye(const RTPIncomingMediaStream* stream)
 {
-	//Cancel packets wait
-	packets.Cancel();
+	//Drop pending packets
+	worker->Stop();
 }
@@ -8,14 +8,14 @@
 #include "VideoEncoderWorker.h"
 #include "log.h"
 #include "tools.h"
-#include "acumulator.h"
 #include "VideoCodecFactory.h"
+#include <algorithm>
+#include <thread>
 
 VideoEncoderWorker::VideoEncoderWorker() 
 {
 	//Create objects
 	pthread_mutex_init(&mutex,NULL);
-	pthread_cond_init(&cond,NULL);
 }
 
 VideoEncoderWorker::~VideoEncoderWorker()
@@ -23,7 +23,6 @@ VideoEncoderWorker::~VideoEncoderWorker()
 	End();
 	//Clean object
 	pthread_mutex_destroy(&mutex);
-	pthread_cond_destroy(&cond);
 }
 
 int VideoEncoderWorker::Init(VideoInput *input)
@@ -47,7 +46,7 @@ int VideoEncoderWorker::SetVideoCodec(VideoCodec::Type codec, int width, int hei
 	if (!width || !height)
 		//Error
 		return Error("Wrong size\n");
-	
+
 	//Store parameters
 	this->codec	  = codec;
 	this->width	  = width;
@@ -65,40 +64,76 @@ int VideoEncoderWorker::SetVideoCodec(VideoCodec::Type codec, int width, int hei
 	return 1;
 }
 
+int VideoEncoderWorker::AddRendition(int width, int height, int bitrate, DWORD ssrc, const std::string& rid)
+{
+	Log("-VideoEncoderWorker::AddRendition() [rid:%s,ssrc:%u,width:%d,height:%d,bitrate:%d]\n",rid.c_str(),ssrc,width,height,bitrate);
+
+	//Check size
+	if (!width || !height)
+		//Error
+		return Error("-VideoEncoderWorker::AddRendition() | Wrong size\n");
+
+	//Can't change ladder while encoding
+	if (encoding)
+		//Error
+		return Error("-VideoEncoderWorker::AddRendition() | Already encoding\n");
+
+	//Add it
+	renditions.push_back({width, height, bitrate, ssrc, rid});
+
+	//Good
+	return 1;
+}
+
+void VideoEncoderWorker::ClearRenditions()
+{
+	//Remove all
+	renditions.clear();
+}
+
+void VideoEncoderWorker::SetMaxEncodingThreads(int threads)
+{
+	//Store it, at least one
+	maxEncodingThreads = std::max(threads, 1);
+}
+
 int VideoEncoderWorker::Start()
 {
 	Log("-VideoEncoderWorker::Start()\n");
-	
+
 	//Check
 	if (!input)
 		//Exit
 		return Error("-VideoEncoderWorker::Start() Error: null video input");
-	
-	
+
+
 	//Check if need to restart
 	if (encoding)
 		//Stop first
 		Stop();
 
-	//Start decoding
+	//Create encoders for a single rendition or for the whole ladder
+	if (!(renditions.empty() ? StartEncoder() : StartLadder()))
+	{
+		//Release anything created
+		ClearEncoders();
+		//Error
+		return 0;
+	}
+
+	//Start encoding
 	encoding = 1;
 
-	//launc thread
-	createPriorityThread(&thread,startEncoding,this,0);
+	//Accept tasks again
+	worker->Start();
+	for (auto& renditionWorker : renditionWorkers)
+		renditionWorker->Start();
 
-	return 1;
-}
+	//Capture first one now
+	next = getTime();
+	ScheduleNext(0);
 
-void * VideoEncoderWorker::startEncoding(void *par)
-{
-	//Get worker
-	VideoEncoderWorker *worker = (VideoEncoderWorker *)par;
-	//Block all signals
-	blocksignals();
-	//Run
-	worker->Encode();
-	//Exit
-	return NULL;
+	return 1;
 }
 
 int VideoEncoderWorker::Stop()
@@ -111,14 +146,18 @@ int VideoEncoderWorker::Stop()
 		//Stop
 		encoding=0;
 
-		//Cancel and frame grabbing
-		input->CancelGrabFrame();
+		//Stop capturing first, so no more renditions are encoded
+		worker->Stop();
+
+		//Wait for running renditions
+		for (auto& renditionWorker : renditionWorkers)
+			renditionWorker->Stop();
 
-		//Cancel sending
-		pthread_cond_signal(&cond);
+		//Terminamos de capturar
+		input->StopVideoCapture();
 
-		//Esperamos
-		pthread_join(thread,NULL);
+		//Release encoders and their threads
+		ClearEncoders();
 	}
 
 	Log("<VideoEncoderWorker::Stop()\n");
@@ -135,267 +174,496 @@ int VideoEncoderWorker::End()
 
 	//Set null
 	input = NULL;
-	
+
 	//Done
 	return 1;
 }
 
-int VideoEncoderWorker::Encode()
+std::vector<VideoWorkerPool::Stats> VideoEncoderWorker::GetLoad() const
+{
+	std::vector<VideoWorkerPool::Stats> load;
+	//Capture worker
+	load.push_back(worker->GetStats());
+	//And renditions
+	for (const auto& renditionWorker : renditionWorkers)
+		load.push_back(renditionWorker->GetStats());
+	return load;
+}
+
+Properties VideoEncoderWorker::GetCodecProperties(VideoWorkerPool::Worker& worker)
 {
-	timeval first;
-	timeval prev;
-	timeval lastFPU;
-	
-	DWORD num = 0;
-	QWORD overslept = 0;
+	Properties codecProperties(properties);
+
+	//Get property for the number of threads used by the codec
+	const char* key = codec==VideoCodec::VP8 ? "vp8.threads" : codec==VideoCodec::H264 ? "h264.threads" : nullptr;
+
+	//If codec doesn't use threads
+	if (!key)
+		//Nothing to budget
+		return codecProperties;
 
-	MinMaxAcumulator bitrateAcu(1000);
-	MinMaxAcumulator fpsAcu(1000);
+	//Get requested ones, 0 is auto on h264
+	int requested = properties.GetProperty(key, codec==VideoCodec::VP8 ? 1 : 0);
 
-	Log(">VideoEncoderWorker::Encode() [width:%d,height:%d,bitrate:%d,fps:%d,intra:%d]\n",width,height,bitrate,fps,intraPeriod);
+	//Take them from the budget shared by all encoders, auto is up to one per core
+	DWORD threads = worker.AcquireCodecThreads(requested>0 ? requested : std::max(std::thread::hardware_concurrency(),1u));
+
+	//Override it
+	codecProperties[key] = std::to_string(threads);
+
+	//Done
+	return codecProperties;
+}
+
+void VideoEncoderWorker::ClearEncoders()
+{
+	//Delete encoders
+	videoEncoder.reset();
+	encoders.clear();
+	scaleLadder.Clear();
+	scaled.clear();
+	encoded.clear();
+	ladder.clear();
+
+	//Give back codec threads
+	worker->ReleaseCodecThreads();
+	//Rendition workers are created for each ladder
+	renditionWorkers.clear();
+}
+
+void VideoEncoderWorker::ScheduleNext(QWORD delay)
+{
+	QWORD now = getTime();
+
+	//Time for next frame
+	next += delay;
+
+	//If we are more than a frame late, don't try to catch up
+	if (next + delay < now)
+		//Start from now
+		next = now;
+
+	//Capture it not before its time, and have it encoded before following one is due
+	worker->Post(next + 1E6/fps, [this]() {
+		if (ladder.empty())
+			Encode();
+		else
+			EncodeLadder();
+	}, next);
+}
+
+bool VideoEncoderWorker::StartEncoder()
+{
+	Log("-VideoEncoderWorker::StartEncoder() [width:%d,height:%d,bitrate:%d,fps:%d,intra:%d]\n",width,height,bitrate,fps,intraPeriod);
+
+	//Get codec properties with the threads we are allowed to use
+	encoderProperties = GetCodecProperties(*worker);
 
 	//Creamos el encoder
-	std::unique_ptr<VideoEncoder> videoEncoder(VideoCodecFactory::CreateEncoder(codec,properties));
+	videoEncoder.reset(VideoCodecFactory::CreateEncoder(codec,encoderProperties));
 
 	//Comprobamos que se haya creado correctamente
 	if (!videoEncoder)
 		//error
 		return Error("Can't create video encoder\n");
 
-	//Comrpobamos que tengamos video de entrada
-	if (input == NULL)
-		return Error("No video input");
-
 	//Iniciamos el tama�o del video
 	if (!input->StartVideoCapture(width,height,fps))
 		return Error("Couldn't set video capture\n");
 
 	//Start at 80%
-	int current = bitrate*0.8;
+	current = bitrate*0.8;
 
 	//Send at higher bitrate first frame, but skip frames after that so sending bitrate is kept
 	videoEncoder->SetFrameRate(fps,current*5,intraPeriod);
 
 	//No wait for first
-	QWORD frameTime = 0;
+	frameTime = 0;
 
 	//Iniciamos el tamama�o del encoder
  	videoEncoder->SetSize(width,height);
-	
-	//The time of the first one
-	gettimeofday(&first,NULL);
 
-	//The time of the previos one
-	gettimeofday(&prev,NULL);
+	//Reset stats
+	bitrateAcu.Reset(0);
+	fpsAcu.Reset(0);
+	num = 0;
+
+	//The time of the first one and fist FPU
+	first = getTime();
+	lastFPU = first;
+
+	//Done
+	return true;
+}
+
+void VideoEncoderWorker::Encode()
+{
+	//Check we have not been stopped
+	if (!encoding)
+		//Exit
+		return;
+
+	//Get new captured picture, if any, without waiting for it
+	auto pic = input->TryGrabFrame();
 
-	//Fist FPU
-	gettimeofday(&lastFPU,NULL);
+	//Check picture
+	if (!pic)
+		//Nothing new to encode, try again on next frame
+		return ScheduleNext(1E6/fps);
 
-	//Mientras tengamos que capturar
-	while(encoding)
+	//Check size
+	if (pic->GetWidth() != (DWORD)width || pic->GetHeight() != (DWORD)height)
 	{
-		//Capture video frame buffer
-		auto pic = input->GrabFrame(frameTime/1000);
+		//Update size
+		width	= pic->GetWidth();
+		height	= pic->GetHeight();
+		//Create encoder again
+		videoEncoder.reset(VideoCodecFactory::CreateEncoder(codec, encoderProperties));
+		//Reset bitrate
+		videoEncoder->SetFrameRate(fps,current,intraPeriod);
+		//Set on the encoder
+		videoEncoder->SetSize(width,height);
+	}
 
-		//Check picture
-		if (!pic)
-			//Exit
-			continue;
-		
-		//Check size
-		if (pic->GetWidth() != width || pic->GetHeight() != height)
+	//Check if we need to send intra
+	if (sendFPU)
+	{
+		//Do not send anymore
+		sendFPU = false;
+		//Do not send if just send one (100ms)
+		if ((getTime()-lastFPU)/100>100)
 		{
-			//Update size
-			width	= pic->GetWidth();
-			height	= pic->GetHeight();
-			//Create encoder again
-			videoEncoder.reset(VideoCodecFactory::CreateEncoder(codec, properties));
-			//Reset bitrate
-			videoEncoder->SetFrameRate(fps,current,intraPeriod);
-			//Set on the encoder
-			videoEncoder->SetSize(width,height);
+			//Set it
+			videoEncoder->FastPictureUpdate();
+			//Update last FPU
+			lastFPU = getTime();
 		}
+	}
+	//Calculate target bitrate
+	int target = current;
 
-		//Check if we need to send intra
-		if (sendFPU)
-		{
-			//Do not send anymore
-			sendFPU = false;
-			//Do not send if just send one (100ms)
-			if (getDifTime(&lastFPU)/100>100)
-			{
-				//Set it
-				videoEncoder->FastPictureUpdate();
-				//Update last FPU
-				getUpdDifTime(&lastFPU);
-			}
-		}
-		//Calculate target bitrate
-		int target = current;
+	//Check temporal limits for estimations
+	if (bitrateAcu.IsInWindow())
+	{
+		//Get real sent bitrate during last second and convert to kbits
+		DWORD instant = bitrateAcu.GetInstantAvg()/1000;
+		//If we are in quarentine
+		if (bitrateLimitCount)
+			//Limit sending bitrate
+			target = bitrateLimit;
+		//Check if sending below limits
+		else if (instant<bitrate)
+			//Increase a 8% each second or fps kbps
+			target += (DWORD)(target*0.08/fps)+1;
+	}
 
-		//Check temporal limits for estimations
-		if (bitrateAcu.IsInWindow())
-		{
-			//Get real sent bitrate during last second and convert to kbits
-			DWORD instant = bitrateAcu.GetInstantAvg()/1000;
-			//If we are in quarentine
-			if (bitrateLimitCount)
-				//Limit sending bitrate
-				target = bitrateLimit;
-			//Check if sending below limits
-			else if (instant<bitrate)
-				//Increase a 8% each second or fps kbps
-				target += (DWORD)(target*0.08/fps)+1;
-		}
+	//Check target bitrate agains max conf bitrate
+	if (target>bitrate*1.2)
+		//Set limit to max bitrate allowing a 20% overflow so instant bitrate can get closer to target
+		target = bitrate*1.2;
+
+	//Check limits counter
+	if (bitrateLimitCount>0)
+		//One frame less of limit
+		bitrateLimitCount--;
+
+	//Check if we have a new bitrate
+	if (target && target!=current)
+	{
+		//Reset bitrate
+		videoEncoder->SetFrameRate(fps,target,intraPeriod);
+		//Upate current
+		current = target;
+	}
 
-		//Check target bitrate agains max conf bitrate
-		if (target>bitrate*1.2)
-			//Set limit to max bitrate allowing a 20% overflow so instant bitrate can get closer to target
-			target = bitrate*1.2;
+	//Procesamos el frame
+	QWORD encodeStart = getTime();
+	VideoFrame *videoFrame = videoEncoder->EncodeFrame(pic);
+	//Update latencies
+	QWORD encoded = getTime();
+	encodeLatency.Record(encoded - encodeStart);
+	if (pic->GetTime() && encoded>=pic->GetTime())
+		receiveToEncodeLatency.Record(encoded - pic->GetTime());
+
+	//If was failed
+	if (!videoFrame)
+		//Try again on next frame
+		return ScheduleNext(1E6/fps);
+
+	//Increase frame counter
+	fpsAcu.Update(getTime()/1000,1);
+
+	//If first
+	if (!frameTime)
+	{
+		//Set frame time, slower
+		frameTime = 5*1E6/fps;
+		//Restore frame rate
+		videoEncoder->SetFrameRate(fps,current,intraPeriod);
+	} else {
+		//Set frame time
+		frameTime = 1E6/fps;
+	}
+
+	//Add frame size in bits to bitrate calculator
+	bitrateAcu.Update((getTime()-first)/1000,videoFrame->GetLength()*8);
 
-		//Check limits counter
-		if (bitrateLimitCount>0)
-			//One frame less of limit
-			bitrateLimitCount--;
+	//Set clock rate
+	videoFrame->SetClockRate(90000);
+	//Get now
+	auto now = (getTime()-first)/1000;
+	//Set frame timestamp
+	videoFrame->SetTimestamp(now*90);
+	videoFrame->SetTime(now);
+	//Set dudation
+	videoFrame->SetDuration(frameTime*90000/1E6);
 
-		//Check if we have a new bitrate
-		if (target && target!=current)
+	//Set target bitrate and fps
+	videoFrame->SetTargetBitrate(target);
+	videoFrame->SetTargetFps(fps);
+
+	//Lock
+	pthread_mutex_lock(&mutex);
+
+	//For each listener
+	for (auto &listener : listeners)
+	{
+		//If was not null
+		if (listener)
+			//Call listener
+			listener->onMediaFrame(*videoFrame);
+	}
+
+	//unlock
+	pthread_mutex_unlock(&mutex);
+
+	//Dump statistics
+	if (num && ((num%fps*10)==0))
+	{
+		//Debug("-Send bitrate current=%d avg=%llf rate=[%llf,%llf] fps=[%llf,%llf] limit=%d\n",current,bitrateAcu.GetInstantAvg()/1000,bitrateAcu.GetMinAvg()/1000,bitrateAcu.GetMaxAvg()/1000,fpsAcu.GetMinAvg(),fpsAcu.GetMaxAvg(),bitrateLimit);
+		bitrateAcu.ResetMinMax();
+		fpsAcu.ResetMinMax();
+	}
+	num++;
+
+	//Wait for next frame
+	ScheduleNext(frameTime);
+}
+
+bool VideoEncoderWorker::StartLadder()
+{
+	//Sort from higher to lower resolution, so each level is scaled from the previous one
+	ladder = renditions;
+	std::stable_sort(ladder.begin(), ladder.end(), [](const Rendition& a, const Rendition& b) {
+		return a.width*a.height > b.width*b.height;
+	});
+
+	Log("-VideoEncoderWorker::StartLadder() [renditions:%zu,fps:%d,intra:%d,threads:%d]\n",ladder.size(),fps,intraPeriod,maxEncodingThreads);
+
+	//Bounded number of workers encoding renditions in parallel, each encoder is always run on the same one
+	for (size_t i=0; i<std::min<size_t>(ladder.size(),maxEncodingThreads); ++i)
+		renditionWorkers.push_back(std::make_shared<VideoWorkerPool::Worker>(worker->GetPool(), "video-enc-" + std::to_string(i)));
+
+	//For each rendition
+	for (size_t i=0; i<ladder.size(); ++i)
+	{
+		//Create encoder with the threads allowed for the worker running it
+		std::unique_ptr<VideoEncoder> videoEncoder(VideoCodecFactory::CreateEncoder(codec,GetCodecProperties(*renditionWorkers[i % renditionWorkers.size()])));
+		//Check it
+		if (!videoEncoder)
+			//error
+			return Error("-VideoEncoderWorker::StartLadder() | Can't create video encoder\n");
+		//Set size and rate
+		videoEncoder->SetSize(ladder[i].width,ladder[i].height);
+		videoEncoder->SetFrameRate(fps,ladder[i].bitrate,intraPeriod);
+		//Add it
+		encoders.push_back(std::move(videoEncoder));
+	}
+
+	//Memory limit and huge pages for the scaled pictures of each rendition
+	scaleLadder.SetMaxMemory(properties.GetProperty("ladder.maxMemory",(QWORD)0));
+	scaleLadder.SetHugePages(properties.GetProperty("ladder.hugePages",false));
+
+	//Scale pictures to the size of each rendition
+	std::vector<VideoScaleLadder::Size> sizes;
+	for (const auto& rendition : ladder)
+		sizes.emplace_back(rendition.width,rendition.height);
+	scaleLadder.SetSizes(sizes);
+
+	//Capture at the top rendition size
+	if (!input->StartVideoCapture(ladder[0].width,ladder[0].height,fps))
+		return Error("Couldn't set video capture\n");
+
+	//Pictures and frames for each rendition
+	scaled.assign(ladder.size(), nullptr);
+	encoded.assign(ladder.size(), nullptr);
+
+	//No wait for first
+	frameTime = 0;
+	//No need to force intra on first
+	forceIntra = false;
+
+	//The time of the first one and fist FPU
+	first = getTime();
+	lastFPU = first;
+
+	//Done
+	return true;
+}
+
+void VideoEncoderWorker::EncodeLadder()
+{
+	//Check we have not been stopped
+	if (!encoding)
+		//Exit
+		return;
+
+	//Get new captured picture, if any, without waiting for it
+	auto pic = input->TryGrabFrame();
+
+	//Check picture
+	if (!pic)
+		//Nothing new to encode, try again on next frame
+		return ScheduleNext(1E6/fps);
+
+	//Build the scale tree
+	scaled = scaleLadder.Scale(pic);
+
+	//Check if we need to send intra
+	if (sendFPU)
+	{
+		//Do not send anymore
+		sendFPU = false;
+		//Do not send if just send one (100ms)
+		if ((getTime()-lastFPU)/100>100)
 		{
-			//Reset bitrate
-			videoEncoder->SetFrameRate(fps,target,intraPeriod);
-			//Upate current
-			current = target;
+			//Request it on all renditions
+			forceIntra = true;
+			//Update last FPU
+			lastFPU = getTime();
 		}
+	}
 
-		//Procesamos el frame
-		VideoFrame *videoFrame = videoEncoder->EncodeFrame(pic);
+	//If we need to have an intra on all renditions
+	if (forceIntra)
+	{
+		//Set it on all encoders so they are aligned
+		for (auto& videoEncoder : encoders)
+			videoEncoder->FastPictureUpdate();
+		//Done
+		forceIntra = false;
+	}
 
-		//If was failed
-		if (!videoFrame)
-			//Next
-			continue;
+	//Keep reception time for latency
+	pictureTime = pic->GetTime();
 
-		//Increase frame counter
-		fpsAcu.Update(getTime()/1000,1);
+	//Encode all renditions in parallel, last one to finish will deliver them
+	pendingRenditions = renditionWorkers.size();
+	for (size_t i=0; i<renditionWorkers.size(); ++i)
+		renditionWorkers[i]->Post(next + 1E6/fps, [this,i]() {
+			EncodeRenditions(i);
+		});
+}
 
-		//Check
-		if (frameTime)
+void VideoEncoderWorker::EncodeRenditions(size_t group)
+{
+	//Encode each rendition run by this worker
+	for (size_t i=group; i<ladder.size(); i+=renditionWorkers.size())
+	{
+		//Check we have a picture for this rendition
+		if (!scaled[i])
 		{
-			timespec ts;
-			//Lock
-			pthread_mutex_lock(&mutex);
-			//Calculate slept time
-			QWORD sleep = frameTime;
-			//Remove extra sleep from prev
-			if (overslept<sleep)
-				//Remove it
-				sleep -= overslept;
-			else
-				//Do not overflow
-				sleep = 1;
-			//Calculate timeout
-			calcAbsTimeoutNS(&ts,&prev,sleep);
-			//Wait next or stopped
-			int canceled  = !pthread_cond_timedwait(&cond,&mutex,&ts);
-			//Unlock
-			pthread_mutex_unlock(&mutex);
-			//Check if we have been canceled
-			if (canceled)
-				//Exit
-				break;
-			//Get differencence
-			QWORD diff = getDifTime(&prev);
-			//If it is biffer
-			if (diff>frameTime)
-				//Get what we have slept more
-				overslept = diff-frameTime;
-			else
-				//No oversletp (shoulddn't be possible)
-				overslept = 0;
+			encoded[i] = nullptr;
+			continue;
 		}
-		
-		//If first
-		if (!frameTime)
+		QWORD encodeStart = getTime();
+		encoded[i] = encoders[i]->EncodeFrame(scaled[i]);
+		encodeLatency.Record(getTime() - encodeStart);
+	}
+
+	//If we were the last ones
+	if (pendingRenditions.fetch_sub(1)==1)
+		//Send them all
+		DeliverLadder();
+}
+
+void VideoEncoderWorker::DeliverLadder()
+{
+	//Update latency from reception to all renditions encoded
+	QWORD done = getTime();
+	if (pictureTime && done>=pictureTime)
+		receiveToEncodeLatency.Record(done - pictureTime);
+
+	//Count encoded and intra frames
+	size_t count = 0;
+	size_t intra = 0;
+	for (const auto videoFrame : encoded)
+	{
+		if (videoFrame)
 		{
-			//Set frame time, slower
-			frameTime = 5*1E6/fps;
-			//Restore frame rate
-			videoEncoder->SetFrameRate(fps,current,intraPeriod);
-		} else {
-			//Set frame time
-			frameTime = 1E6/fps;
+			count++;
+			intra += videoFrame->IsIntra();
 		}
+	}
+
+	//If an encoder has produced a key frame by itself
+	if (intra && intra<ladder.size())
+	{
+		Debug("-VideoEncoderWorker::DeliverLadder() | Unaligned intra frame, forcing intra on all renditions [intra:%zu,renditions:%zu]\n",intra,ladder.size());
+		//Realign all of them on next frame
+		forceIntra = true;
+	}
+
+	//If nothing encoded
+	if (!count)
+		//Try again on next frame
+		return ScheduleNext(1E6/fps);
 
-		//Add frame size in bits to bitrate calculator
-		bitrateAcu.Update(getDifTime(&first)/1000,videoFrame->GetLength()*8);
+	//Set frame time
+	frameTime = 1E6/fps;
 
-		//Set clock rate
+	//Get now
+	auto now = (getTime()-first)/1000;
+
+	//Lock
+	pthread_mutex_lock(&mutex);
+
+	//For each rendition
+	for (size_t i=0; i<ladder.size(); ++i)
+	{
+		//Get encoded frame
+		VideoFrame* videoFrame = encoded[i];
+		//If it failed
+		if (!videoFrame)
+			//Next
+			continue;
+		//Set same timestamp on all renditions
 		videoFrame->SetClockRate(90000);
-		//Get now
-		auto now = getDifTime(&first)/1000;
-		//Set frame timestamp
 		videoFrame->SetTimestamp(now*90);
 		videoFrame->SetTime(now);
-		//Set dudation
 		videoFrame->SetDuration(frameTime*90000/1E6);
-
+		//Set rendition ssrc and rid
+		videoFrame->SetSSRC(ladder[i].ssrc);
+		videoFrame->SetRId(ladder[i].rid);
 		//Set target bitrate and fps
-		videoFrame->SetTargetBitrate(target);
+		videoFrame->SetTargetBitrate(ladder[i].bitrate);
 		videoFrame->SetTargetFps(fps);
 
-		//Lock
-		pthread_mutex_lock(&mutex);
-
 		//For each listener
 		for (auto &listener : listeners)
 		{
 			//If was not null
 			if (listener)
 				//Call listener
-				listener->onMediaFrame(*videoFrame);
-		}
-
-		//unlock
-		pthread_mutex_unlock(&mutex);
-
-		//Set sending time of previous frame
-		getUpdDifTime(&prev);
-		
-		//Calculate sending times based on bitrate
-		DWORD sendingTime = videoFrame->GetLength()*8/current;
-
-		//Adjust to maximum time
-		if (sendingTime>frameTime/1000)
-			//Cap it
-			sendingTime = frameTime/1000;
-
-//                //If it was a I frame
-//                if (videoFrame->IsIntra())
-//			//Clean rtp rtx buffer
-//			FlushRTXPackets();
-//
-//		//Send it smoothly
-//		SmoothFrame(videoFrame,sendingTime);
-
-
-		//Dump statistics
-		if (num && ((num%fps*10)==0))
-		{
-			//Debug("-Send bitrate current=%d avg=%llf rate=[%llf,%llf] fps=[%llf,%llf] limit=%d\n",current,bitrateAcu.GetInstantAvg()/1000,bitrateAcu.GetMinAvg()/1000,bitrateAcu.GetMaxAvg()/1000,fpsAcu.GetMinAvg(),fpsAcu.GetMaxAvg(),bitrateLimit);
-			bitrateAcu.ResetMinMax();
-			fpsAcu.ResetMinMax();
+				listener->onMediaFrame(ladder[i].ssrc, *videoFrame);
 		}
-		num++;
 	}
 
-	//Terminamos de capturar
-	input->StopVideoCapture();
+	//unlock
+	pthread_mutex_unlock(&mutex);
 
-	//Salimos
-	Log("<VideoEncoderWorker::Encode()  [%d]\n",encoding);
-	
-	//Done
-	return 1;
+	//Wait for next frame
+	ScheduleNext(frameTime);
 }
 
 int VideoEncoderWorker::SetTemporalBitrateLimit(int estimation)
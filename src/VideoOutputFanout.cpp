@@ -0,0 +1,138 @@
+#include "VideoOutputFanout.h"
+#include "log.h"
+
+VideoOutputFanout::VideoOutputFanout(Scaler scaler) :
+	scaler(std::move(scaler))
+{
+}
+
+void VideoOutputFanout::AddOutput(VideoOutput* output, uint32_t width, uint32_t height, uint32_t maxFps)
+{
+	//Ensure we have a valid value
+	if (!output)
+		//Done
+		return;
+
+	Log("-VideoOutputFanout::AddOutput() [output:%p,width:%u,height:%u,maxFps:%u]\n",output,width,height,maxFps);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	//Add it or update it
+	auto& config = outputs[output];
+	//Set target resolution and rate
+	config.width  = width & ~1;
+	config.height = height & ~1;
+	config.maxFps = maxFps;
+
+	//If it requires scaling and we don't have a pool for that size yet
+	if (config.width && config.height && !pools.count({config.width,config.height}))
+	{
+		//Create pool for the scaled frames, shared by all outputs of this size
+		auto pool = std::make_unique<VideoBufferPool>(2,4);
+		//Set size
+		pool->SetSize(config.width,config.height);
+		//Add it
+		pools.emplace(Size{config.width,config.height},std::move(pool));
+	}
+}
+
+void VideoOutputFanout::RemoveOutput(VideoOutput* output)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	//Remove from ouput
+	outputs.erase(output);
+
+	//Remove pools not used anymore
+	for (auto it = pools.begin(); it!=pools.end(); )
+	{
+		//Check if any output is using this size
+		bool used = false;
+		for (const auto& [other,config] : outputs)
+			used |= it->first == Size{config.width,config.height};
+		//Remove or skip
+		if (!used)
+			it = pools.erase(it);
+		else
+			++it;
+	}
+}
+
+DWORD VideoOutputFanout::GetDroppedFrames(VideoOutput* output)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	//Find it
+	auto it = outputs.find(output);
+	//Return dropped frames
+	return it!=outputs.end() ? it->second.dropped : 0;
+}
+
+size_t VideoOutputFanout::GetNumPools()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pools.size();
+}
+
+void VideoOutputFanout::Deliver(const VideoBuffer::const_shared& frame, QWORD time)
+{
+	//Scaled frames for this picture, only one per distinct resolution
+	std::map<Size,VideoBuffer::const_shared> scaled;
+
+	//Sync
+	std::lock_guard<std::mutex> lock(mutex);
+
+	//For each output
+	for (auto& [output,config] : outputs)
+	{
+		//If output is rate limited and it is too early for next frame
+		if (config.maxFps && config.last!=(QWORD)-1 && time>=config.last && time-config.last<1000/config.maxFps)
+		{
+			//Drop frame for this output only
+			config.dropped++;
+			//Next
+			continue;
+		}
+		//Update last delivered time
+		config.last = time;
+
+		//If it doesn't require scaling
+		if (!config.width || !config.height || (config.width==frame->GetWidth() && config.height==frame->GetHeight()))
+		{
+			//Send it
+			output->NextFrame(frame);
+			//Next
+			continue;
+		}
+
+		//Get target size
+		Size size = {config.width,config.height};
+
+		//Check if we have already scaled to this size
+		auto it = scaled.find(size);
+
+		//If not
+		if (it==scaled.end())
+		{
+			//Get pool for this size
+			auto pool = pools.find(size);
+			//Should not happen
+			if (pool==pools.end())
+				continue;
+			//Get new buffer
+			VideoBuffer::shared resized = pool->second->allocate();
+			//If we are out of memory
+			if (!resized)
+				//Skip this output
+				continue;
+			//Rescale
+			if (!scaler(frame, resized))
+				//Skip this output
+				continue;
+			//Keep reception time
+			resized->SetTime(frame->GetTime());
+			//Store it for the rest of outputs with same size
+			it = scaled.emplace(size, std::move(resized)).first;
+		}
+
+		//Send it
+		output->NextFrame(it->second);
+	}
+}
@@ -154,21 +154,63 @@ VideoBuffer::const_shared VideoPipe::GrabFrame(uint32_t timeout)
 	//Unlock
 	pthread_mutex_unlock(&newPicMutex);
 
+	//Scale it if needed
+	return Scale(std::move(videoBuffer));
+}
+
+VideoBuffer::const_shared VideoPipe::TryGrabFrame()
+{
+	VideoBuffer::const_shared videoBuffer;
+
+	//Lock
+	pthread_mutex_lock(&newPicMutex);
+
+	//If not inited or there is no new picture
+	if (!inited || !imgNew)
+	{
+		//Unlock
+		pthread_mutex_unlock(&newPicMutex);
+		//Nothing to grab yet
+		return nullptr;
+	}
+
+	//Consume it
+	imgNew=0;
+
+	//Get current picture
+	videoBuffer = imgBuffer[imgPos];
+
+	//Unlock
+	pthread_mutex_unlock(&newPicMutex);
+
+	//Scale it if needed
+	return Scale(std::move(videoBuffer));
+}
+
+VideoBuffer::const_shared VideoPipe::Scale(VideoBuffer::const_shared&& videoBuffer)
+{
 	//If we got a frame and it is from a different size
 	if (videoBuffer  && (videoBuffer->GetWidth() != videoWidth || videoBuffer->GetHeight() !=videoHeight))
 	{
 		//Get new buffer
 		VideoBuffer::shared resized = videoBufferPool.allocate();
 
+		//If we are out of memory
+		if (!resized)
+			//Skip frame
+			return Warning("-VideoPipe::Scale() | Could not allocate video buffer\n"), nullptr;
+
 		//Rescale
 		scaler.Resize(videoBuffer, resized, true);
+		//Keep reception time
+		resized->SetTime(videoBuffer->GetTime());
 
 		//Swap buffers
 		videoBuffer = std::move(resized);
 	}
 
 	//Done
-	return videoBuffer;
+	return std::move(videoBuffer);
 }
 
 void  VideoPipe::CancelGrabFrame()
@@ -229,6 +271,11 @@ void VideoPipe::ClearFrame()
 	//Get new buffer
 	VideoBuffer::shared black = videoBufferPool.allocate();
 
+	//If we are out of memory
+	if (!black)
+		//Skip it
+		return;
+
 	//Paint in black
 	black->Fill(0, (uint8_t)-128, (uint8_t)-128);
 
@@ -0,0 +1,81 @@
+#include "VideoScaleLadder.h"
+#include "log.h"
+
+VideoScaleLadder::VideoScaleLadder(Scaler scaler) :
+	scaler(std::move(scaler))
+{
+}
+
+void VideoScaleLadder::SetSizes(const std::vector<Size>& sizes)
+{
+	//Remove previous ones
+	Clear();
+
+	//Store new ones
+	this->sizes = sizes;
+
+	//For each level
+	for (const auto& [width,height] : sizes)
+	{
+		//Create pool for scaled pictures
+		auto pool = std::make_unique<VideoBufferPool>(2,4);
+		//Set limits before preallocating
+		pool->SetMaxMemory(maxMemory);
+		pool->SetHugePages(hugePages);
+		//Set size
+		pool->SetSize(width,height);
+		//Add it
+		pools.push_back(std::move(pool));
+	}
+
+	//Pictures for each level
+	scaled.assign(sizes.size(), nullptr);
+}
+
+void VideoScaleLadder::Clear()
+{
+	sizes.clear();
+	pools.clear();
+	scaled.clear();
+}
+
+const std::vector<VideoBuffer::const_shared>& VideoScaleLadder::Scale(const VideoBuffer::const_shared& picture)
+{
+	//Closest larger picture available, the captured one for the top level
+	VideoBuffer::const_shared source = picture;
+
+	//Build the scale tree
+	for (size_t i=0; i<sizes.size(); ++i)
+	{
+		//Get level size
+		auto [width,height] = sizes[i];
+
+		//If it has already the correct size
+		if (source->GetWidth()==width && source->GetHeight()==height)
+		{
+			//Use same picture
+			scaled[i] = source;
+			//Next
+			continue;
+		}
+		//Get new buffer
+		VideoBuffer::shared resized = pools[i]->allocate();
+		//If we are out of memory or could not rescale
+		if (!resized || !scaler(source, resized))
+		{
+			UltraDebug("-VideoScaleLadder::Scale() | Could not scale level [level:%zu,width:%u,height:%u]\n",i,width,height);
+			//Skip this level, next ones are scaled from previous one
+			scaled[i] = nullptr;
+			//Next
+			continue;
+		}
+		//Keep reception time
+		resized->SetTime(picture->GetTime());
+		//Store it
+		scaled[i] = std::move(resized);
+		//Next level is scaled from this one
+		source = scaled[i];
+	}
+
+	return scaled;
+}
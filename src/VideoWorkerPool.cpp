@@ -0,0 +1,414 @@
+#include "VideoWorkerPool.h"
+
+#include <pthread.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+#include "log.h"
+#include "tools.h"
+#include "EventLoop.h"
+
+DWORD VideoWorkerPool::defaultNumThreads = 0;
+std::vector<int> VideoWorkerPool::defaultCPUs;
+
+static std::mutex runningMutex;
+static std::set<const VideoWorkerPool*> runningPools;
+
+VideoWorkerPool::Worker::Worker(VideoWorkerPool& pool, const std::string& name) :
+	pool(pool),
+	name(name)
+{
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	//Get unique id
+	id = ++pool.lastId;
+	//Register it
+	pool.workers.insert(this);
+}
+
+VideoWorkerPool::Worker::~Worker()
+{
+	//Drop pending tasks and wait for running one
+	Stop();
+	//Give back codec threads
+	ReleaseCodecThreads();
+
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	//Unregister
+	pool.workers.erase(this);
+}
+
+bool VideoWorkerPool::Worker::Post(QWORD deadline, Function&& func, QWORD notBefore)
+{
+	std::lock_guard<std::mutex> lock(pool.mutex);
+
+	//Check we can accept tasks
+	if (!enabled)
+		return false;
+
+	//Add to the queue
+	queue.push_back({notBefore, deadline, std::move(func)});
+
+	//If it was idle, schedule it
+	if (!running && !scheduled)
+		pool.Schedule(this, getTime());
+
+	//Done
+	return true;
+}
+
+void VideoWorkerPool::Worker::Start()
+{
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	//Accept tasks again
+	enabled = true;
+}
+
+void VideoWorkerPool::Worker::Stop()
+{
+	std::deque<Item> dropped;
+
+	std::unique_lock<std::mutex> lock(pool.mutex);
+
+	//Reject new tasks
+	enabled = false;
+
+	//Remove from ready or delayed tasks
+	pool.Unschedule(this);
+
+	//Drop pending ones, destroyed without the lock
+	dropped.swap(queue);
+
+	//Wait for running task, unless we are being called from it
+	if (runner != std::this_thread::get_id())
+		pool.done.wait(lock, [this](){ return !running; });
+}
+
+DWORD VideoWorkerPool::Worker::AcquireCodecThreads(DWORD requested)
+{
+	std::lock_guard<std::mutex> lock(pool.mutex);
+
+	//Get budget
+	DWORD budget = pool.codecThreadBudget!=(DWORD)-1 ? pool.codecThreadBudget : pool.threads.size();
+	//Get available extra threads
+	DWORD available = budget>pool.usedCodecThreads ? budget-pool.usedCodecThreads : 0;
+	//Pool thread is always available
+	DWORD extra = std::min(requested ? requested-1 : 0, available);
+
+	//Take them
+	pool.usedCodecThreads += extra;
+	codecThreads += extra;
+
+	//Done
+	return extra + 1;
+}
+
+void VideoWorkerPool::Worker::ReleaseCodecThreads()
+{
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	//Give back all of them
+	pool.usedCodecThreads -= codecThreads;
+	codecThreads = 0;
+}
+
+VideoWorkerPool::Stats VideoWorkerPool::Worker::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	return Snapshot();
+}
+
+VideoWorkerPool::Stats VideoWorkerPool::Worker::Snapshot() const
+{
+	Stats stats = this->stats;
+	stats.id		= id;
+	stats.pool		= pool.name;
+	stats.name		= name;
+	stats.pending		= queue.size();
+	stats.codecThreads	= codecThreads;
+	return stats;
+}
+
+VideoWorkerPool::VideoWorkerPool(const std::string& name) :
+	name(name)
+{
+}
+
+VideoWorkerPool::~VideoWorkerPool()
+{
+	//Stop just in case
+	Stop();
+}
+
+VideoWorkerPool& VideoWorkerPool::GetInstance()
+{
+	//Created and started on first use
+	static VideoWorkerPool pool;
+	static bool started = pool.Start(defaultNumThreads,defaultCPUs);
+	(void)started;
+	return pool;
+}
+
+bool VideoWorkerPool::Start(DWORD num, const std::vector<int>& cpus)
+{
+	//Use one per cpu, or per core, by default
+	if (!num)
+		num = !cpus.empty() ? cpus.size() : std::max(std::thread::hardware_concurrency(),1u);
+
+	Log("-VideoWorkerPool::Start() [name:%s,threads:%u,cpus:%zu]\n",name.c_str(),num,cpus.size());
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		//Check not already running
+		if (running)
+			return Error("-VideoWorkerPool::Start() | already running\n");
+		running = true;
+	}
+
+	//Create threads
+	for (DWORD i=0;i<num;++i)
+	{
+		//Get cpu to pin it to, if any
+		int cpu = !cpus.empty() ? cpus[i % cpus.size()] : -1;
+		//Create it
+		threads.emplace_back([this,cpu](){ Run(cpu); });
+		//Set name
+		EventLoop::SetThreadName(threads.back().native_handle(),name + "-" + std::to_string(i));
+		//Pin it
+		if (cpu>=0 && !EventLoop::SetAffinity(threads.back().native_handle(),cpu))
+			Warning("-VideoWorkerPool::Start() | could not set thread affinity [name:%s,cpu:%d]\n",name.c_str(),cpu);
+	}
+
+	//Register it
+	std::lock_guard<std::mutex> lock(runningMutex);
+	runningPools.insert(this);
+
+	//Done
+	return true;
+}
+
+bool VideoWorkerPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		//Check running
+		if (!running)
+			return false;
+		//Stop
+		running = false;
+	}
+
+	Log("-VideoWorkerPool::Stop() [name:%s]\n",name.c_str());
+
+	{
+		//Unregister it
+		std::lock_guard<std::mutex> lock(runningMutex);
+		runningPools.erase(this);
+	}
+
+	//Wake up all
+	cond.notify_all();
+
+	//Wait for them
+	for (auto& thread : threads)
+		thread.join();
+	threads.clear();
+
+	//Done
+	return true;
+}
+
+void VideoWorkerPool::SetCodecThreadBudget(DWORD budget)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	//Threads already taken are not given back, new ones will be limited
+	codecThreadBudget = budget;
+}
+
+DWORD VideoWorkerPool::GetCodecThreadBudget() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return codecThreadBudget!=(DWORD)-1 ? codecThreadBudget : threads.size();
+}
+
+DWORD VideoWorkerPool::GetUsedCodecThreads() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return usedCodecThreads;
+}
+
+std::vector<VideoWorkerPool::Stats> VideoWorkerPool::GetWorkerStats() const
+{
+	std::vector<Stats> stats;
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto worker : workers)
+		stats.push_back(worker->Snapshot());
+	return stats;
+}
+
+std::vector<VideoWorkerPool::Stats> VideoWorkerPool::GetRunningStats()
+{
+	std::vector<Stats> stats;
+	std::lock_guard<std::mutex> lock(runningMutex);
+	//Get stats from workers of each running pool
+	for (auto pool : runningPools)
+		for (const auto& worker : pool->GetWorkerStats())
+			stats.push_back(worker);
+	return stats;
+}
+
+std::vector<int> VideoWorkerPool::GetNodeCPUs(int node)
+{
+	std::vector<int> cpus;
+
+	//Get list of cpus, like 0-3,8-11
+	std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+	std::string list;
+	if (!std::getline(file,list))
+		return cpus;
+
+	size_t pos = 0;
+	//For each range
+	while (pos<list.size())
+	{
+		size_t end = list.find(',',pos);
+		if (end==std::string::npos)
+			end = list.size();
+		std::string range = list.substr(pos,end-pos);
+		//Get first and last
+		size_t dash = range.find('-');
+		int first = atoi(range.c_str());
+		int last = dash!=std::string::npos ? atoi(range.c_str()+dash+1) : first;
+		for (int cpu=first;cpu<=last;++cpu)
+			cpus.push_back(cpu);
+		pos = end + 1;
+	}
+
+	return cpus;
+}
+
+void VideoWorkerPool::Schedule(Worker* worker, QWORD now)
+{
+	//Get next task
+	const auto& item = worker->queue.front();
+
+	//If it can't be run yet
+	if (item.notBefore>now)
+	{
+		//Wait for it
+		worker->delayed = true;
+		worker->key = item.notBefore;
+		delayed.emplace(worker->key,worker);
+	} else {
+		//Ready by deadline
+		worker->delayed = false;
+		worker->key = item.deadline;
+		ready.emplace(worker->key,worker);
+	}
+	worker->scheduled = true;
+
+	//Wake up one thread to run it, or to wait for it
+	cond.notify_one();
+}
+
+void VideoWorkerPool::Unschedule(Worker* worker)
+{
+	//If not scheduled
+	if (!worker->scheduled)
+		return;
+	//Remove it
+	if (worker->delayed)
+		delayed.erase({worker->key,worker});
+	else
+		ready.erase({worker->key,worker});
+	worker->scheduled = false;
+}
+
+void VideoWorkerPool::Run(int cpu)
+{
+	Log(">VideoWorkerPool::Run() [name:%s,cpu:%d]\n",name.c_str(),cpu);
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (running)
+	{
+		QWORD now = getTime();
+
+		//Move workers which can be run now to ready
+		while (!delayed.empty() && delayed.begin()->first<=now)
+		{
+			auto worker = delayed.begin()->second;
+			delayed.erase(delayed.begin());
+			worker->scheduled = false;
+			Schedule(worker,now);
+		}
+
+		//If nothing to run
+		if (ready.empty())
+		{
+			//Wait for new tasks or next delayed one
+			if (delayed.empty())
+				cond.wait(lock);
+			else
+				cond.wait_for(lock,std::chrono::microseconds(delayed.begin()->first-now));
+			//Check again
+			continue;
+		}
+
+		//Get the one with the earliest deadline
+		auto next = ready.begin()->second;
+		ready.erase(ready.begin());
+		next->scheduled = false;
+
+		//Keep it alive until we are done, it may be deleted from its own task
+		auto worker = next->weak_from_this().lock();
+		//If it is being deleted
+		if (!worker)
+			//Its tasks are dropped by the destructor
+			continue;
+
+		//Get its next task
+		Worker::Item item = std::move(worker->queue.front());
+		worker->queue.pop_front();
+		worker->running = true;
+		worker->runner = std::this_thread::get_id();
+
+		//Run it without lock
+		lock.unlock();
+		QWORD ini = getTime();
+		item.func();
+		QWORD end = getTime();
+		//Release captures before locking
+		item.func = nullptr;
+		lock.lock();
+
+		//Update stats
+		worker->stats.tasks++;
+		worker->stats.busyTime += end - ini;
+		worker->stats.cpu = cpu;
+		//Check if we were late
+		if (end>item.deadline)
+		{
+			worker->stats.missed++;
+			worker->stats.maxLateness = std::max(worker->stats.maxLateness,end-item.deadline);
+		}
+
+		//Done
+		worker->running = false;
+		worker->runner = std::thread::id();
+
+		//If it has more tasks
+		if (worker->enabled && !worker->queue.empty())
+			//Schedule it again
+			Schedule(worker.get(),end);
+
+		//Signal anyone waiting for it to finish
+		done.notify_all();
+
+		//Release it without lock, as it is deleted if it was the last reference
+		lock.unlock();
+		worker.reset();
+		lock.lock();
+	}
+
+	Log("<VideoWorkerPool::Run() [name:%s,cpu:%d]\n",name.c_str(),cpu);
+}
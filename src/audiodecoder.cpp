@@ -19,25 +19,17 @@ int AudioDecoderWorker::Start()
 		//Stop first
 		Stop();
 
+	//Clear any previous cancel
+	packets.Reset();
+
 	//Start decoding
 	decoding = 1;
 
-	//launc thread
-	createPriorityThread(&thread,startDecoding,this,0);
+	//Decode on each audio engine round
+	AudioEngine::GetInstance().AddTask(AudioEngine::Decode,this);
 
 	return 1;
 }
-void * AudioDecoderWorker::startDecoding(void *par)
-{
-	//Get worker
-	AudioDecoderWorker *worker = (AudioDecoderWorker *)par;
-	//Block all signals
-	blocksignals();
-	//Run
-	worker->Decode();
-	//Exit
-	return NULL;;
-}
 
 int  AudioDecoderWorker::Stop()
 {
@@ -49,11 +41,20 @@ int  AudioDecoderWorker::Stop()
 	//Stop
 	decoding=0;
 
-	//Cancel any pending wait
-	packets.Cancel();
+	//Remove from engine, once it returns we are not run anymore
+	AudioEngine::GetInstance().RemoveTask(AudioEngine::Decode,this);
 
-	//Esperamos
-	pthread_join(thread,NULL);
+	//SYNC
+	{
+		//Stop playing
+		ScopedLock scope(mutex);
+		//Check codec
+		if (codec)
+			//For each output
+			for (auto output : outputs)
+				//Stop it
+				output->StopPlaying();
+	}
 
 	Log("<AudioDecoderWorker::Stop()\n");
 
@@ -127,25 +128,18 @@ int AudioDecoderWorker::Decode()
 	SWORD		raw[4096];
 	DWORD		rawSize=4096;
 	QWORD		frameTime=0;
-	QWORD		lastTime=0;
-
-	Log(">AudioDecoderWorker::Decode()\n");
+	int		decoded=0;
 
-	//Mientras tengamos que capturar
+	//Decode all queued packets, without blocking
 	while(decoding)
 	{
-		//Obtenemos el paquete
-		if (!packets.Wait(0))
-			//Done
-			break;
-
 		//Get packet in queue
 		auto packet = packets.Pop();
 
 		//Check
 		if (!packet)
-			//Check condition again
-			continue;
+			//Done
+			break;
 		
 		//SYNC
 		{
@@ -225,25 +219,19 @@ int AudioDecoderWorker::Decode()
 				//Send buffer
 				output->PlayBuffer(raw, len, frameTime);
 		}
-	}
 
-	//SYNC
-	{
-		//Stop playing
-		ScopedLock scope(mutex);
-		//Check codec
-		if (codec)
-			//For each output
-			for (auto output : outputs)
-				//Stop it
-				output->StopPlaying();
+		//One more
+		decoded++;
 	}
 
-
-	Log("<AudioDecoderWorker::Decode()\n");
-
 	//Exit
-	return 0;
+	return decoded;
+}
+
+void AudioDecoderWorker::OnTick(AudioEngine::Phase phase, QWORD now)
+{
+	//Decode all received audio
+	Decode();
 }
 
 void AudioDecoderWorker::onRTP(const RTPIncomingMediaStream* stream,const RTPPacket::shared& packet)
@@ -82,35 +82,57 @@ int AudioEncoderWorker::Init(AudioInput *input)
 	return 1;
 }
 
-/***************************************
-* startencodingAudio
-*	Helper function
-***************************************/
-void * AudioEncoderWorker::startEncoding(void *par)
-{
-	AudioEncoderWorker *conf = (AudioEncoderWorker *)par;
-	blocksignals();
-	conf->Encode();
-	//Exit
-	return NULL;
-}
-
-
 /***************************************
 * StartSending
 *	Comienza a mandar a la ip y puertos especificados
 ***************************************/
 int AudioEncoderWorker::StartEncoding()
 {
+	Log(">AudioEncoderWorker::StartEncoding()\n");
+
 	//Si estabamos mandando tenemos que parar
 	if (encodingAudio)
 		//paramos
 		StopEncoding();
 
+	//Creamos el codec de audio
+	codec.reset(AudioCodecFactory::CreateEncoder(audioCodec,audioProperties));
+
+	//Check it
+	if (!codec)
+		return Error("-AudioEncoderWorker::StartEncoding() | Could not open encoder\n");
+
+	//Try to set native rate
+	numChannels = audioInput->GetNumChannels();
+	rate = audioInput->GetNativeRate();
+	
+	//Update codec
+	rate = codec->TrySetRate(rate, numChannels);
+	
+	//Create audio frame
+	frame = std::make_unique<AudioFrame>(audioCodec);
+
+	//Set codec config if needed
+	UpdateCodecConfig();
+	
+	//Disable shared buffer on clone
+	frame->DisableSharedBuffer();
+
+	//Set rate
+	frame->SetClockRate(rate);
+
+	//Reset time
+	frameTime = 0;
+
+	//Empezamos a grabar
+	audioInput->StartRecording(rate);
+
 	encodingAudio=1;
 
-	//Start thread
-	createPriorityThread(&encodingAudioThread,startEncoding,this,1);
+	//Encode on each audio engine round
+	AudioEngine::GetInstance().AddTask(AudioEngine::Encode,this);
+
+	Log("<AudioEncoderWorker::StartEncoding()\n");
 
 	return 1;
 }
@@ -137,17 +159,21 @@ int AudioEncoderWorker::StopEncoding()
 {
 	Log(">AudioEncoderWorker::StopEncoding()\n");
 
-	//Esperamos a que se cierren las threads de envio
+	//If we were encoding
 	if (encodingAudio)
 	{
 		//paramos
 		encodingAudio=0;
 
-		//Cancel any pending audio
-		audioInput->CancelRecBuffer();
+		//Remove from engine, once it returns we are not run anymore
+		AudioEngine::GetInstance().RemoveTask(AudioEngine::Encode,this);
 
-		//Y esperamos
-		pthread_join(encodingAudioThread,NULL);
+		//Paramos de grabar
+		audioInput->StopRecording();
+
+		//Borramos el codec
+		codec.reset();
+		frame.reset();
 	}
 
 	Log("<AudioEncoderWorker::StopEncoding()\n");
@@ -155,34 +181,14 @@ int AudioEncoderWorker::StopEncoding()
 	return 1;
 }
 
-
-
-/*******************************************
-* Encode
-*	Capturamos el audio y lo mandamos
-*******************************************/
-int AudioEncoderWorker::Encode()
+void AudioEncoderWorker::OnTick(AudioEngine::Phase phase, QWORD now)
 {
-	SWORD 		recBuffer[2048];
-	AudioEncoder* 	codec;
-	QWORD		frameTime=0;
-
-	Log(">AudioEncoderWorker::Encode()\n");
-
-	//Creamos el codec de audio
-	if ((codec = AudioCodecFactory::CreateEncoder(audioCodec,audioProperties))==NULL)
-		return Error("-AudioEncoderWorker::Encode() | Could not open encoder");
-
-	//Try to set native rate
-	DWORD numChannels = audioInput->GetNumChannels();
-	DWORD rate = audioInput->GetNativeRate();
-	
-	//Update codec
-	rate = codec->TrySetRate(rate, numChannels);
-	
-	//Create audio frame
-	AudioFrame frame(audioCodec);
+	//Encode all available audio
+	Encode();
+}
 
+void AudioEncoderWorker::UpdateCodecConfig()
+{
 	//If it is opus
 	if (audioCodec == AudioCodec::OPUS)
 	{
@@ -190,27 +196,22 @@ int AudioEncoderWorker::Encode()
 		OpusConfig config(numChannels, rate);
 
 		//Serialize config and add it to frame
-		frame.AllocateCodecConfig(config.GetSize());
-		config.Serialize(frame.GetCodecConfigData(), frame.GetCodecConfigSize());
+		frame->AllocateCodecConfig(config.GetSize());
+		config.Serialize(frame->GetCodecConfigData(), frame->GetCodecConfigSize());
 	}
-	
-	//Disable shared buffer on clone
-	frame.DisableSharedBuffer();
-
-	//Set rate
-	frame.SetClockRate(rate);
+}
 
-	//Empezamos a grabar
-	audioInput->StartRecording(rate);
+/*******************************************
+* Encode
+*	Capturamos el audio y lo mandamos
+*******************************************/
+int AudioEncoderWorker::Encode()
+{
+	int encoded = 0;
 
-	//Mientras tengamos que capturar
-	while(encodingAudio)
+	//Mientras tengamos muestras para 20ms, sin bloquear
+	while(encodingAudio && audioInput->TryRecBuffer(recBuffer,codec->numFrameSamples))
 	{
-		//Capturamos 20ms
-		if (audioInput->RecBuffer(recBuffer,codec->numFrameSamples)==0)
-			//Skip and probably exit
-			continue;
-
 		//Incrementamos el tiempo de envio
 		frameTime += codec->numFrameSamples;
 
@@ -221,21 +222,12 @@ int AudioEncoderWorker::Encode()
 			numChannels = audioInput->GetNumChannels();
 			//Set new channel count on codec
 			codec->TrySetRate(rate, numChannels);
-
-			//If it is opus
-			if (audioCodec == AudioCodec::OPUS)
-			{
-				//Create opus config
-				OpusConfig config(numChannels,rate);
-
-				//Serialize config and add it to frame
-				frame.AllocateCodecConfig(config.GetSize());
-				config.Serialize(frame.GetCodecConfigData(), frame.GetCodecConfigSize());
-			}
+			//Update config
+			UpdateCodecConfig();
 		}
 
 		//Lo codificamos
-		int len = codec->Encode(recBuffer,codec->numFrameSamples,frame.GetData(),frame.GetMaxMediaLength());
+		int len = codec->Encode(recBuffer,codec->numFrameSamples,frame->GetData(),frame->GetMaxMediaLength());
 
 		//Comprobamos que ha sido correcto
 		if(len<=0)
@@ -245,24 +237,24 @@ int AudioEncoderWorker::Encode()
 		}
 
 		//Set frame length
-		frame.SetLength(len);
+		frame->SetLength(len);
 		
 		//Set frame timestamp
-		frame.SetTimestamp(frameTime);
+		frame->SetTimestamp(frameTime);
 		//Set frame timestamp
-		frame.SetSenderTime(frameTime * 1000 / codec->GetClockRate());
+		frame->SetSenderTime(frameTime * 1000 / codec->GetClockRate());
 		//Set encoded time
-		frame.SetTime(getTime()/1000);
+		frame->SetTime(getTime()/1000);
 		//Set frame duration
-		frame.SetDuration(codec->numFrameSamples);
+		frame->SetDuration(codec->numFrameSamples);
 		//Set number of channels
-		frame.SetNumChannels(numChannels);
+		frame->SetNumChannels(numChannels);
 
 		//Clear rtp
-		frame.ClearRTPPacketizationInfo();
+		frame->ClearRTPPacketizationInfo();
 			
 		//Add rtp packet
-		frame.AddRtpPacket(0,len,NULL,0);
+		frame->AddRtpPacket(0,len,NULL,0);
 		 
 		//Lock
 		pthread_mutex_lock(&mutex);
@@ -273,26 +265,18 @@ int AudioEncoderWorker::Encode()
 			//If was not null
 			if (listener)
 				//Call listener
-				listener->onMediaFrame(frame);
+				listener->onMediaFrame(*frame);
 		}
 
 		//unlock
 		pthread_mutex_unlock(&mutex);
-	}
-
-	Debug("-AudioEncoderWorker::Encode() | cleanup[%d]\n",encodingAudio);
-
-	//Paramos de grabar por si acaso
-	audioInput->StopRecording();
 
-	
-	//Borramos el codec
-	delete codec;
+		//One more
+		encoded++;
+	}
 
 	//Salimos
-        Log("<AudioEncoderWorker::Encode()\n");
-	
-	return 1;
+	return encoded;
 }
 
 bool AudioEncoderWorker::AddListener(const MediaFrame::Listener::shared& listener)
@@ -20,6 +20,7 @@ AudioMixer::AudioMixer()
 {
 	//Not mixing
 	mixingAudio = 0;
+	lastMixed = 0;
 	//No sidebars
 	numSidebars = SidebarDefault;
 	//NO vad by default
@@ -35,70 +36,28 @@ AudioMixer::~AudioMixer()
 }
 
 /***********************************
-* startMixingAudio
-*	Crea el thread de mezclado de audio
+* OnTick
+*	Mezcla los audios en cada ronda del audio engine
 ************************************/
-void *AudioMixer::startMixingAudio(void *par)
+void AudioMixer::OnTick(AudioEngine::Phase phase, QWORD now)
 {
-	Log("-MixAudioThread [%p]\n",pthread_self());
-
-	//Obtenemos el parametro
-	AudioMixer *am = (AudioMixer *)par;
-
-	//Bloqueamos las se�ales
-	blocksignals();
-	
-	//Ejecutamos
-	am->MixAudio();
-	//Exit
-	return NULL;;
-}
-
-/***********************************
-* MixAudio
-*	Mezcla los audios
-************************************/
-int AudioMixer::MixAudio()
-{
-	timeval  tv;
-	DWORD step = 10;
-	QWORD prev = 0;
-
-	//Logeamos
-	Log(">MixAudio\n");
-
-	//Init ts
-	getUpdDifTime(&tv);
-
-	//Mientras estemos mezclando
-	while(mixingAudio)
+	//If it is first round
+	if (!lastMixed)
 	{
-		//Get processing time
-		DWORD proc = getDifTime(&tv)-prev;
-
-		//check we have not to hurry up
-		if (proc<step*1000)
-			//Wait until next to process again minus process time
-			msleep(step*1000-proc);
-
-		//Get new time
-		QWORD curr = getDifTime(&tv);
-		
-		//Get num samples at desired rate for the time difference
-		DWORD numSamples = (curr*rate)/1000000-(prev*rate)/1000000;
-
-		//Update curr
-		prev = curr;
-		
-		//Proesss them
-		Process(numSamples);
-
+		//Start from now
+		lastMixed = now;
+		//Nothing to mix yet
+		return;
 	}
 
-	//Logeamos
-	Log("<MixAudio\n");
+	//Get num samples at desired rate for the time difference
+	DWORD numSamples = (now*rate)/1000000-(lastMixed*rate)/1000000;
 
-	return 1;
+	//Update last
+	lastMixed = now;
+
+	//Proesss them
+	Process(numSamples);
 }
 
 void AudioMixer::Process(DWORD numSamples) 
@@ -120,6 +79,9 @@ void AudioMixer::Process(DWORD numSamples)
 		//Reset
 		sit->second->Reset();
 
+	//New round of shared conversions
+	resampleStage.Tick();
+
 	//First pass: Iterate through the audio inputs and calculate the sum of all streams
 	for(Audios::iterator it = audios.begin(); it != audios.end(); ++it)
 	{
@@ -165,8 +127,11 @@ void AudioMixer::Process(DWORD numSamples)
 		//And the audio buffer for participant
 		SWORD *buffer = audio->buffer;
 
-		//Check if we are also an input to the sidebar to remove ound sound
-		if (audio->sidebar->HasParticipant(id))
+		//Check if we are also an input to the sidebar
+		bool member = audio->sidebar->HasParticipant(id);
+
+		//If so remove our own sound, members always go through their own transrater so its filter state is not spliced
+		if (member)
 		{
 			//Get pointers to buffer
 			__m128i* b = (__m128i*) buffer;
@@ -188,8 +153,15 @@ void AudioMixer::Process(DWORD numSamples)
 			//Put the output
 			audio->input->PutSamples(buffer,numSamples);
 		} else {
-			//Copy everything as it is
-			audio->input->PutSamples((SWORD*)mixed,numSamples);
+			//Get the rate the encoder is using
+			DWORD recordRate = audio->input->GetRecordingRate();
+			DWORD num = 0;
+			//If it needs conversion, do it once for all the listeners of the sidebar with the same rate
+			const SWORD* converted = recordRate && recordRate!=rate ? resampleStage.Convert(audio->sidebar,mixed,numSamples,rate,recordRate,&num) : nullptr;
+			//Put it already converted if the rate has not changed meanwhile
+			if (!converted || !audio->input->PutSamples(converted,num,recordRate))
+				//Copy everything as it is
+				audio->input->PutSamples((SWORD*)mixed,numSamples);
 		}
 	}
 
@@ -226,17 +198,19 @@ int AudioMixer::Init(const Properties &properties)
 	//Set default
 	defaultSidebar = sidebars[id];
 
+	//Check if we are calculating vad
+	vad = properties.GetProperty("vad",vad);
+
 	//Check if we are in online or offline mode
 	if (properties.GetProperty("online",true))
 	{
 		// Mix audio
 		mixingAudio = true;
-		//Start trhead
-		createPriorityThread(&mixAudioThread,startMixingAudio,this,0);
+		//Start from next round
+		lastMixed = 0;
+		//Mix on each audio engine round
+		AudioEngine::GetInstance().AddTask(AudioEngine::Mix,this);
 	}
-	
-	//Check if we are calculating vad
-	vad = properties.GetProperty("vad",vad);
 
 	return 1;
 }
@@ -256,8 +230,8 @@ int AudioMixer::End()
 		//Terminamos la mezcla
 		mixingAudio = 0;
 
-		//Y esperamos
-		pthread_join(mixAudioThread,NULL);
+		//Remove from engine, once it returns we are not run anymore
+		AudioEngine::GetInstance().RemoveTask(AudioEngine::Mix,this);
 	}
 
 	//Lock
@@ -112,34 +112,6 @@ int AudioStream::SetRTPProperties(const Properties& properties)
 {
 	return rtp.SetProperties(properties);
 }
-/***************************************
-* startSendingAudio
-*	Helper function
-***************************************/
-void * AudioStream::startSendingAudio(void *par)
-{
-	AudioStream *conf = (AudioStream *)par;
-	blocksignals();
-	Log("SendAudioThread [%p]\n",pthread_self());
-	conf->SendAudio();
-	//Exit
-	return NULL;
-}
-
-/***************************************
-* startReceivingAudio
-*	Helper function
-***************************************/
-void * AudioStream::startReceivingAudio(void *par)
-{
-	AudioStream *conf = (AudioStream *)par;
-	blocksignals();
-	Log("RecvAudioThread [%p]\n",pthread_self());
-	conf->RecAudio();
-	//Exit
-	return NULL;;
-}
-
 /***************************************
 * StartSending
 *	Comienza a mandar a la ip y puertos especificados
@@ -158,6 +130,10 @@ int AudioStream::StartSending(char *sendAudioIp,int sendAudioPort,const RTPMap&
 		//Error
 		return Error("Audio port 0\n");
 
+	//Check input
+	if (!audioInput)
+		//Error
+		return Error("-StartSending failed, audioInput is null\n");
 
 	//Y la de audio
 	if(!rtp.SetRemotePort(sendAudioIp,sendAudioPort))
@@ -172,11 +148,31 @@ int AudioStream::StartSending(char *sendAudioIp,int sendAudioPort,const RTPMap&
 		//Error
 		return Error("%s audio codec not supported by peer\n",AudioCodec::GetNameFor(audioCodec));
 
-	//Arrancamos el thread de envio
+	//Create audio encoder
+	encoder = AudioCodecFactory::CreateEncoder(audioCodec,audioProperties);
+	
+	//Check it
+	if (!encoder)
+		//Error
+		return Error("-StartSending failed, could not create audio codec [codec:%d]\n",audioCodec);
+
+	//Get codec rate for native rate
+	rate = encoder->TrySetRate(audioInput->GetNativeRate(), 1);
+
+	//Start recording at codec rate
+	audioInput->StartRecording(rate);
+
+	//Get clock rate for codec
+	clock = encoder->GetClockRate();
+
+	//Get initial time
+	frameTime = getDifTime(&ini)*clock/1E6;
+
+	//Arrancamos el envio
 	sendingAudio=1;
 
-	//Start thread
-	createPriorityThread(&sendAudioThread,startSendingAudio,this,1);
+	//Send on each audio engine round
+	AudioEngine::GetInstance().AddTask(AudioEngine::Encode,this);
 
 	Log("<StartSending audio [%d]\n",sendingAudio);
 
@@ -203,8 +199,8 @@ int AudioStream::StartReceiving(const RTPMap& rtpMap,const RTPMap& aptMap)
 	//We are reciving audio
 	receivingAudio=1;
 
-	//Create thread
-	createPriorityThread(&recAudioThread,startReceivingAudio,this,1);
+	//Receive on each audio engine round
+	AudioEngine::GetInstance().AddTask(AudioEngine::Decode,this);
 
 	//Log
 	Log("<StartReceiving audio [%d]\n",recAudioPort);
@@ -240,17 +236,23 @@ int AudioStream::StopReceiving()
 {
 	Log(">StopReceiving Audio\n");
 
-	//Y esperamos a que se cierren las threads de recepcion
+	//If we were receiving
 	if (receivingAudio)
 	{	
-		//Paramos de enviar
+		//Paramos de recibir
 		receivingAudio=0;
 
-		//Cancel rtp
-		rtp.CancelGetPacket();
-		
-		//Y unimos
-		pthread_join(recAudioThread,NULL);
+		//Remove from engine, once it returns we are not run anymore
+		AudioEngine::GetInstance().RemoveTask(AudioEngine::Decode,this);
+
+		//Check not null
+		if (audioOutput)
+			//Terminamos de reproducir
+			audioOutput->StopPlaying();
+
+		//Delete codec
+		delete(decoder);
+		decoder = NULL;
 	}
 
 	Log("<StopReceiving Audio\n");
@@ -267,19 +269,21 @@ int AudioStream::StopSending()
 {
 	Log(">StopSending Audio\n");
 
-	//Esperamos a que se cierren las threads de envio
+	//If we were sending
 	if (sendingAudio)
 	{
 		//paramos
 		sendingAudio=0;
 
-		//Check audioInput
-		if (audioInput)
-			//Cancel
-			audioInput->CancelRecBuffer();
+		//Remove from engine, once it returns we are not run anymore
+		AudioEngine::GetInstance().RemoveTask(AudioEngine::Encode,this);
+
+		//Paramos de grabar
+		audioInput->StopRecording();
 
-		//Y esperamos
-		pthread_join(sendAudioThread,NULL);
+		//Borramos el codec
+		delete encoder;
+		encoder = NULL;
 	}
 
 	Log("<StopSending Audio\n");
@@ -287,6 +291,16 @@ int AudioStream::StopSending()
 	return 1;	
 }
 
+void AudioStream::OnTick(AudioEngine::Phase phase, QWORD now)
+{
+	//Check phase
+	if (phase==AudioEngine::Decode)
+		//Receive all pending packets
+		RecAudio();
+	else if (phase==AudioEngine::Encode)
+		//Send all available audio
+		SendAudio();
+}
 
 /****************************************
 * RecAudio
@@ -294,42 +308,37 @@ int AudioStream::StopSending()
 *****************************************/
 int AudioStream::RecAudio()
 {
-	int 		recBytes=0;
-	struct timeval 	before;
 	SWORD		playBuffer[1024];
 	const DWORD	playBufferSize = 1024;
-	AudioDecoder*	codec=NULL;
 	AudioCodec::Type type;
 	QWORD		frameTime=0;
-	QWORD		lastTime=0;
+	int		received=0;
 	
-	Log(">RecAudio\n");
-	
-	//Inicializamos el tiempo
-	gettimeofday(&before,NULL);
-
-	//Mientras tengamos que capturar
+	//Get all packets ready, without blocking
 	while(receivingAudio)
 	{
 		//Obtenemos el paquete
-		auto packet = rtp.GetPacket();
+		auto packet = rtp.TryGetPacket();
 		//Check
 		if (!packet)
-			//Next
-			continue;
+			//Done
+			break;
+
+		//One more
+		received++;
 		
 		//Get type
 		type = (AudioCodec::Type)packet->GetCodec();
 
 		//Comprobamos el tipo
-		if ((codec==NULL) || (type!=codec->type))
+		if ((decoder==NULL) || (type!=decoder->type))
 		{
 			//Si habia uno nos lo cargamos
-			if (codec!=NULL)
-				delete codec;
+			if (decoder!=NULL)
+				delete decoder;
 
 			//Creamos uno dependiendo del tipo
-			if ((codec = AudioCodecFactory::CreateDecoder(type))==NULL)
+			if ((decoder = AudioCodecFactory::CreateDecoder(type))==NULL)
 			{
 				//Next
 				Log("Error creando nuevo codec de audio [%d]\n",type);
@@ -337,14 +346,14 @@ int AudioStream::RecAudio()
 			}
 
 			//Try to set native pipe rate
-			DWORD rate = codec->TrySetRate(audioOutput->GetNativeRate());
+			DWORD rate = decoder->TrySetRate(audioOutput->GetNativeRate());
 
 			//Start playing at codec rate
 			audioOutput->StartPlaying(rate, 1);
 		}
 
 		//Lo decodificamos
-		int len = codec->Decode(packet->GetMediaData(),packet->GetMediaLength(),playBuffer,playBufferSize);
+		int len = decoder->Decode(packet->GetMediaData(),packet->GetMediaLength(),playBuffer,playBufferSize);
 
 		//Check len
 		if (len>0)
@@ -360,28 +369,10 @@ int AudioStream::RecAudio()
 				//Y lo reproducimos
 				audioOutput->PlayBuffer(playBuffer,len,frameTime, packet->HasAudioLevel() && packet->GetVAD() ? packet->GetLevel() : -1);
 		}
-
-
-		//Aumentamos el numero de bytes recividos
-		recBytes+=packet->GetMediaLength();
-
 	}
 
-	//Check not null
-	if (audioOutput)
-		//Terminamos de reproducir
-		audioOutput->StopPlaying();
-
-	//Check not null
-	if (codec)
-		//Delete codec
-		delete(codec);
-
-	//Exit
-	Log("<RecAudio\n");
-
 	//Done
-	return 1;
+	return received;
 }
 
 /*******************************************
@@ -391,47 +382,10 @@ int AudioStream::RecAudio()
 int AudioStream::SendAudio()
 {
 	SWORD 		recBuffer[1024];
-	int 		sendBytes=0;
-	struct timeval 	before;
-
-	//Log
-	Log(">SendAudio\n");
-
-	//Check input
-	if (!audioInput)
-		//Error
-		return Error("-SendAudio failed, audioInput is null");
-
-	//Obtenemos el tiempo ahora
-	gettimeofday(&before,NULL);
-
-	//Create audio encoder
-	AudioEncoder* codec = AudioCodecFactory::CreateEncoder(audioCodec,audioProperties);
-	
-	//Check it
-	if (!codec)
-		//Error
-		return Error("-SendAudio failed, could not create audio codec [codec:%d]\n",audioCodec);
+	int		sent=0;
 
-	//Get native rate
-	DWORD nativeRate = audioInput->GetNativeRate();
-
-	//Get codec rate
-	DWORD rate = codec->TrySetRate(nativeRate, 1);
-
-	//Start recording at codec rate
-	audioInput->StartRecording(rate);
-
-	//Get clock rate for codec
-	DWORD clock = codec->GetClockRate();
-
-	
-
-	//Get initial time
-	QWORD frameTime = getDifTime(&ini)*clock/1E6;
-
-	//Send audio
-	while(sendingAudio)
+	//Send all available audio, without blocking
+	while(sendingAudio && audioInput->TryRecBuffer(recBuffer,encoder->numFrameSamples))
 	{
 		//Create packet
 		RTPPacket::shared packet = std::make_shared<RTPPacket>(MediaFrame::Audio,audioCodec);
@@ -440,14 +394,10 @@ int AudioStream::SendAudio()
 		packet->SetClockRate(clock);
 			
 		//Increment rtp timestamp
-		frameTime += codec->numFrameSamples*clock/rate;
-
-		//Capture audio data
-		if (audioInput->RecBuffer(recBuffer,codec->numFrameSamples)==0)
-			continue;
+		frameTime += encoder->numFrameSamples*clock/rate;
 
 		//Encode it
-		int len = codec->Encode(recBuffer,codec->numFrameSamples,packet->AdquireMediaData(),packet->GetMaxMediaLength());
+		int len = encoder->Encode(recBuffer,encoder->numFrameSamples,packet->AdquireMediaData(),packet->GetMaxMediaLength());
 
 		//check result
 		if(len<=0)
@@ -461,21 +411,13 @@ int AudioStream::SendAudio()
 
 		//Send it
 		rtp.SendPacket(packet,frameTime);
-	}
-
-	Log("-SendAudio cleanup[%d]\n",sendingAudio);
 
-	//Paramos de grabar por si acaso
-	audioInput->StopRecording();
-
-	//Logeamos
-	Log("-Deleting codec\n");
-
-	//Borramos el codec
-	delete codec;
+		//One more
+		sent++;
+	}
 
-	//Salimos
-        Log("<SendAudio\n");
+	//Done
+	return sent;
 }
 
 MediaStatistics AudioStream::GetStatistics()
@@ -121,8 +121,8 @@ MediaFrame* AV1Depacketizer::AddPacket(const RTPPacket::shared& packet)
 			}
 		}
 		
-		//Add payload
-		AddPayload(packet->GetMediaData(), packet->GetMediaLength());
+		//Add payload referencing packet data
+		AddPayload(packet->SharePayload(), packet->GetMediaData(), packet->GetMediaLength());
 
 		//IF it is the first last packet of the layer frame
 		if (dependencyDescriptor && dependencyDescriptor->endOfFrame)
@@ -134,8 +134,8 @@ MediaFrame* AV1Depacketizer::AddPacket(const RTPPacket::shared& packet)
 
 		}
 	} else {
-		//Add payload
-		AddPayload(packet->GetMediaData(), packet->GetMediaLength());
+		//Add payload referencing packet data
+		AddPayload(packet->SharePayload(), packet->GetMediaData(), packet->GetMediaLength());
 	}
 
 
@@ -181,6 +181,12 @@ MediaFrame* AV1Depacketizer::AddPacket(const RTPPacket::shared& packet)
 }
 
 MediaFrame* AV1Depacketizer::AddPayload(const BYTE* payload, DWORD len)
+{
+	//Copy payload data
+	return AddPayload(nullptr, payload, len);
+}
+
+MediaFrame* AV1Depacketizer::AddPayload(const RTPPayload::shared& owner, const BYTE* payload, DWORD len)
 {
 	//Check length
 	if (!len)
@@ -273,8 +279,8 @@ MediaFrame* AV1Depacketizer::AddPayload(const BYTE* payload, DWORD len)
 				{
 					//We have a complete obu in the fragment
 					BufferReader obu(fragment);
-					// add to frame
-					AddObu(obu);
+					// add to frame, data is on the fragment so it will be copied
+					AddObu(nullptr, obu);
 					//Reset fragment data
 					fragment.Reset();
 				}
@@ -290,7 +296,7 @@ MediaFrame* AV1Depacketizer::AddPayload(const BYTE* payload, DWORD len)
 		//It is a complete obu element
 		} else {
 			//Add obu to frame
-			AddObu(element);
+			AddObu(owner, element);
 		}
 
 		//One more obu
@@ -301,7 +307,7 @@ MediaFrame* AV1Depacketizer::AddPayload(const BYTE* payload, DWORD len)
 }
 
 
-void AV1Depacketizer::AddObu(BufferReader& obu)
+void AV1Depacketizer::AddObu(const RTPPayload::shared& owner, BufferReader& obu)
 {
 	//Get obu header
 	uint8_t header = obu.Get1();
@@ -368,6 +374,8 @@ void AV1Depacketizer::AddObu(BufferReader& obu)
 		}
 	}
 
-	//Write the rest of the obu
-	frame.AppendMedia(obu);
+	//Get the rest of the obu
+	DWORD size = obu.GetLeft();
+	//Write it
+	frame.AppendMedia(owner, obu.GetData(size), size);
 }
\ No newline at end of file
@@ -14,7 +14,8 @@ public:
 	virtual MediaFrame* AddPayload(const BYTE* payload,DWORD payload_len) override;
 	virtual void ResetFrame() override;
 private:
-	void AddObu(BufferReader& obu);
+	MediaFrame* AddPayload(const RTPPayload::shared& owner,const BYTE* payload,DWORD payload_len);
+	void AddObu(const RTPPayload::shared& owner, BufferReader& obu);
 private:
 	Buffer fragment;
 	VideoFrame frame;
@@ -1,3 +1,5 @@
+#include <fcntl.h>
+#include <unistd.h>
 #include "tracing.h"
 #include <srtp2/srtp.h>
 #include "dtls.h"
@@ -14,6 +16,8 @@ std::string		DTLSConnection::cipher("ALL:NULL:eNULL:aNULL");
 SSL_CTX*		DTLSConnection::ssl_ctx		= NULL;
 X509*			DTLSConnection::certificate	= NULL;
 EVP_PKEY*		DTLSConnection::privateKey	= NULL;
+DTLSConnection::KeyType	DTLSConnection::keyType		= DTLSConnection::KEY_RSA;
+bool			DTLSConnection::saveCertificate	= false;
 bool			DTLSConnection::hasDTLS		= false;
 
 DTLSConnection::LocalFingerPrints	DTLSConnection::localFingerPrints;
@@ -29,64 +33,82 @@ void DTLSConnection::SetCertificate(const char* cert,const char* key)
 	DTLSConnection::pvtfile.assign(key);
 }
 
+void DTLSConnection::SetKeyType(KeyType keyType)
+{
+	//Log
+	Debug("-DTLSConnection::SetKeyType() | Set generated key type [type:%d]\n",keyType);
+	//Only used when certificate is generated
+	DTLSConnection::keyType = keyType;
+}
+
 int DTLSConnection::GenerateCertificate()
 {
-	TRACE_EVENT("dtls", "DTLSConnection::GenerateCertificate");
-	Debug(">DTLSConnection::GenerateCertificate()\n");
+	TRACE_EVENT("dtls", "DTLSConnection::GenerateCertificate", "keyType", keyType);
+	Debug(">DTLSConnection::GenerateCertificate() [keyType:%d]\n",keyType);
 	
 	int ret = 0;
-	BIGNUM* bne = NULL;
-	RSA* rsa_key = NULL;
-	int num_bits = 2048;
+	int id = EVP_PKEY_EC;
+	const EVP_MD* md = EVP_sha256();
+	EVP_PKEY_CTX* ctx = NULL;
 	X509_NAME* cert_name = NULL;
+	QWORD start = getTimeMS();
 
-	// Create a big number object.
-	bne = BN_new();
-	if (!bne)
-	{
-		Error("BN_new() failed");
-		goto error;
-	}
-
-	ret = BN_set_word(bne, RSA_F4); // RSA_F4 == 65537.
-	if (ret == 0)
+	//Get key algorithm
+	switch (keyType)
 	{
-		Error("BN_set_word() failed");
-		goto error;
+		case KEY_RSA:
+			id = EVP_PKEY_RSA;
+			break;
+		case KEY_ED25519:
+#ifdef EVP_PKEY_ED25519
+			id = EVP_PKEY_ED25519;
+			// Ed25519 signatures do not use a separate digest.
+			md = NULL;
+#else
+			Warning("-DTLSConnection::GenerateCertificate() | Ed25519 not supported by openssl, using ECDSA P-256\n");
+#endif
+			break;
+		case KEY_ECDSA_P256:
+		default:
+			break;
 	}
 
-	// Generate a RSA key.
-	rsa_key = RSA_new();
-	if (!rsa_key)
+	// Create key generation context.
+	ctx = EVP_PKEY_CTX_new_id(id, NULL);
+	if (!ctx)
 	{
-		Error("RSA_new() failed");
+		Error("EVP_PKEY_CTX_new_id() failed");
 		goto error;
 	}
 
-	// This takes some time.
-	ret = RSA_generate_key_ex(rsa_key, num_bits, bne, NULL);
-	if (ret == 0)
+	ret = EVP_PKEY_keygen_init(ctx);
+	if (ret <= 0)
 	{
-		Error("RSA_generate_key_ex() failed");
+		Error("EVP_PKEY_keygen_init() failed");
 		goto error;
 	}
 
-	// Create a private key object (needed to hold the RSA key).
-	privateKey = EVP_PKEY_new();
-	if (!privateKey)
+	// Set key parameters.
+	if (id == EVP_PKEY_RSA)
+		ret = EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048);
+	else if (id == EVP_PKEY_EC)
+		ret = EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1) > 0 
+			&& EVP_PKEY_CTX_set_ec_param_enc(ctx, OPENSSL_EC_NAMED_CURVE) > 0;
+	else 
+		ret = 1;
+	if (ret <= 0)
 	{
-		Error("EVP_PKEY_new() failed");
+		Error("Setting key generation parameters failed");
 		goto error;
 	}
 
-	ret = EVP_PKEY_assign_RSA(privateKey, rsa_key);
-	if (ret == 0)
+	// Generate the key, only slow for RSA.
+	ret = EVP_PKEY_keygen(ctx, &privateKey);
+	if (ret <= 0)
 	{
-		Error("EVP_PKEY_assign_RSA() failed");
+		Error("EVP_PKEY_keygen() failed");
 		goto error;
 	}
-	// The RSA key now belongs to the private key, so don't clean it up separately.
-	rsa_key = NULL;
 
 	// Create the X509 certificate.
 	certificate = X509_new();
@@ -134,7 +156,7 @@ int DTLSConnection::GenerateCertificate()
 	}
 
 	// Sign the certificate with its own private key.
-	ret = X509_sign(certificate, privateKey, EVP_sha1());
+	ret = X509_sign(certificate, privateKey, md);
 	if (ret == 0)
 	{
 		Error("X509_sign() failed");
@@ -142,20 +164,18 @@ int DTLSConnection::GenerateCertificate()
 	}
 
 	// Free stuff and return.
-	BN_free(bne);
+	EVP_PKEY_CTX_free(ctx);
 	
-	Debug("<DTLSConnection::GenerateCertificate()\n");
+	Debug("<DTLSConnection::GenerateCertificate() [keyType:%d,id:%d,elapsed:%llums]\n",keyType,id,getTimeMS()-start);
 	
 	return 1;
 
 error:
-	if (bne)
-		BN_free(bne);
-	if (rsa_key && !privateKey)
-		RSA_free(rsa_key);
+	if (ctx)
+		EVP_PKEY_CTX_free(ctx);
 	if (privateKey)
 	{
-		EVP_PKEY_free(privateKey); // NOTE: This also frees the RSA key.
+		EVP_PKEY_free(privateKey);
 		privateKey = NULL;
 	}
 	if (certificate)
@@ -205,7 +225,72 @@ int DTLSConnection::ReadCertificate()
 	
 	//Check it is correct
 	if (!privateKey)
+	{
+		X509_free(certificate);
+		certificate = NULL;
 		return Error("PEM_read_PrivateKey() failed");
+	}
+
+	//Done
+	return 1;
+}
+
+int DTLSConnection::SaveCertificate()
+{
+	TRACE_EVENT("dtls", "DTLSConnection::SaveCertificate");
+
+	//Create private key file, only readable by us
+	int fd = open(pvtfile.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+
+	//Check
+	if (fd<0)
+		return Error("-DTLSConnection::SaveCertificate() | error creating DTLS private key file [file:\"%s\",errno:%d]\n", pvtfile.c_str(), errno);
+
+	//Get stream
+	FILE* file = fdopen(fd, "w");
+
+	//Write key
+	bool written = file && PEM_write_PrivateKey(file, privateKey, NULL, NULL, 0, NULL, NULL);
+
+	//Close file
+	if (file)
+		fclose(file);
+	else
+		close(fd);
+
+	//Check
+	if (!written)
+	{
+		unlink(pvtfile.c_str());
+		return Error("-DTLSConnection::SaveCertificate() | PEM_write_PrivateKey() failed\n");
+	}
+
+	//Create certificate file, never overwriting an existing one
+	fd = open(certfile.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+	file = fd>=0 ? fdopen(fd, "w") : NULL;
+
+	//Check
+	if (!file)
+	{
+		if (fd>=0)
+			close(fd);
+		return Error("-DTLSConnection::SaveCertificate() | error creating DTLS certificate file [file:\"%s\",errno:%d]\n", certfile.c_str(), errno);
+	}
+
+	//Write certificate
+	written = PEM_write_X509(file, certificate);
+
+	//Close file
+	fclose(file);
+
+	//Check
+	if (!written)
+	{
+		unlink(certfile.c_str());
+		return Error("-DTLSConnection::SaveCertificate() | PEM_write_X509() failed\n");
+	}
+
+	Log("-DTLSConnection::SaveCertificate() | Saved generated certificate [crt:\"%s\",key:\"%s\"]\n", certfile.c_str(), pvtfile.c_str());
 
 	//Done
 	return 1;
@@ -257,8 +342,13 @@ int DTLSConnection::Initialize()
 		//Set it without GCM
 		SSL_CTX_set_tlsext_use_srtp(ssl_ctx, "SRTP_AES128_CM_SHA1_80");
 	
+	//Check if we have been given certificate files
+	bool files = certfile.size()>0 && pvtfile.size()>0;
+	//Only store the generated one if requested and none of them exist, so we never touch files managed by others
+	bool save = files && saveCertificate && access(certfile.c_str(), F_OK)!=0 && access(pvtfile.c_str(), F_OK)!=0;
+
 	//If we have a pre-generated certificate and private key
-	if (certfile.size()>0 && pvtfile.size()>0)
+	if (files && !save)
 	{
 		//Read it
 		if (!ReadCertificate())
@@ -267,6 +357,10 @@ int DTLSConnection::Initialize()
 		//Generate them it
 		if (!GenerateCertificate())
 			return Error("Could not generate SSL certificate or private key files\n");
+		//Store them so they are reused on next start
+		if (save)
+			//Logs the files written
+			SaveCertificate();
 	}
 	
 	// Set certificate.
@@ -359,6 +453,9 @@ int DTLSConnection::Terminate()
 	privateKey = nullptr;
 	certificate = nullptr;
 	ssl_ctx = nullptr;
+	localFingerPrints.clear();
+	availableHashes.clear();
+	hasDTLS = false;
 	
 	//All done
 	return 1;
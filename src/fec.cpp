@@ -0,0 +1,234 @@
+#include "fec.h"
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "tools.h"
+
+namespace fec
+{
+
+/*
+	ULPFEC header (RFC 5109) followed by the level 0 header, with 16 bit mask
+	or 48 bit mask when L is set:
+
+	 0                   1                   2                   3
+	 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	|E|L|P|X|   CC  |M| PT recovery |            SN base            |
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	|                          TS recovery                          |
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	|        length recovery        |       Protection Length       |
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	|             mask              |   mask cont. (only if L=1)    |
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	|   mask cont. (only if L=1)    |
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+*/
+static constexpr DWORD ULPFECHeaderSize		= 14;
+static constexpr DWORD ULPFECLongHeaderSize	= 18;
+
+/*
+	FlexFEC-03 header for a single ssrc, masks are split in chunks of 15, 31
+	and 63 bits, each one prefixed by a K bit set on the last one:
+
+	 0                   1                   2                   3
+	 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	|R|F|P|X|  CC   |M| PT recovery |        length recovery        |
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	|                          TS recovery                          |
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	|   SSRCCount   |                    reserved                   |
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	|                             SSRC_i                            |
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	|           SN base_i           |k|          Mask [0-14]        |
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	|k|                   Mask [15-45] (optional)                   |
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	|k|                                                             |
+	+-+                   Mask [46-108] (optional)                  |
+	|                                                               |
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+*/
+static constexpr DWORD FlexFECHeaderSizes[3]	= {20, 24, 32};
+static constexpr DWORD FlexFECMaskBits[3]	= {15, 46, 109};
+
+DWORD GetMaxProtected(Scheme scheme)
+{
+	return scheme==Scheme::FlexFEC ? MaxProtected : MaxProtectedULPFEC;
+}
+
+DWORD GetHeaderSize(Scheme scheme, const Mask& mask)
+{
+	DWORD length = mask.GetLength();
+
+	if (scheme==Scheme::ULPFEC)
+		return length>16 ? ULPFECLongHeaderSize : ULPFECHeaderSize;
+
+	for (DWORD i=0;i<3;++i)
+		if (length<=FlexFECMaskBits[i])
+			return FlexFECHeaderSizes[i];
+	//Too long
+	return 0;
+}
+
+// Reads count bits of the mask msb first, starting on the bit position from
+static void ReadMask(Mask& mask, QWORD bits, DWORD count, DWORD from)
+{
+	for (DWORD i=0;i<count;++i)
+		if ((bits >> (count-1-i)) & 1)
+			mask.Set(from+i);
+}
+
+// Writes count bits of the mask msb first, starting on the bit position from
+static QWORD WriteMask(const Mask& mask, DWORD count, DWORD from)
+{
+	QWORD bits = 0;
+	for (DWORD i=0;i<count;++i)
+		if (mask.Test(from+i))
+			bits |= ((QWORD)1) << (count-1-i);
+	return bits;
+}
+
+DWORD Parse(Scheme scheme, const BYTE* data, DWORD size, Header& header)
+{
+	header = {};
+
+	if (scheme==Scheme::ULPFEC)
+	{
+		//Check min size
+		if (size<ULPFECHeaderSize)
+			return 0;
+		//Extension flag is reserved
+		if (data[0] & 0x80)
+			return 0;
+		bool longMask = data[0] & 0x40;
+		DWORD headerSize = longMask ? ULPFECLongHeaderSize : ULPFECHeaderSize;
+		if (size<headerSize)
+			return 0;
+
+		header.recovery[0]	= data[0] & 0x3F;
+		header.recovery[1]	= data[1];
+		header.base		= get2(data,2);
+		header.timestamp	= get4(data,4);
+		header.length		= get2(data,8);
+		header.protectionLength	= get2(data,10);
+		ReadMask(header.mask,get2(data,12),16,0);
+		if (longMask)
+			ReadMask(header.mask,get4(data,14),32,16);
+
+		//Protection length can't go beyond the packet
+		if (header.protectionLength>size-headerSize)
+			return 0;
+		return headerSize;
+	}
+
+	//Check min size
+	if (size<FlexFECHeaderSizes[0])
+		return 0;
+	//Retransmissions and fixed masks are not supported
+	if (data[0] & 0xC0)
+		return 0;
+	//Only a single protected ssrc
+	if (data[8]!=1)
+		return 0;
+
+	header.recovery[0]	= data[0] & 0x3F;
+	header.recovery[1]	= data[1];
+	header.length		= get2(data,2);
+	header.timestamp	= get4(data,4);
+	header.ssrc		= get4(data,12);
+	header.base		= get2(data,16);
+
+	DWORD headerSize = FlexFECHeaderSizes[0];
+	ReadMask(header.mask,get2(data,18) & 0x7FFF,15,0);
+	//If not the last chunk
+	if (!(data[18] & 0x80))
+	{
+		headerSize = FlexFECHeaderSizes[1];
+		if (size<headerSize)
+			return 0;
+		ReadMask(header.mask,get4(data,20) & 0x7FFFFFFF,31,15);
+		//If not the last chunk either
+		if (!(data[20] & 0x80))
+		{
+			headerSize = FlexFECHeaderSizes[2];
+			if (size<headerSize)
+				return 0;
+			ReadMask(header.mask,get8(data,24) & 0x7FFFFFFFFFFFFFFFull,63,46);
+		}
+	}
+
+	//Protection goes up to the end of the packet
+	header.protectionLength = size-headerSize;
+	return headerSize;
+}
+
+DWORD Serialize(Scheme scheme, const Header& header, BYTE* data, DWORD size)
+{
+	DWORD headerSize = GetHeaderSize(scheme,header.mask);
+
+	//Check size
+	if (!headerSize || size<headerSize)
+		return 0;
+
+	if (scheme==Scheme::ULPFEC)
+	{
+		bool longMask = headerSize==ULPFECLongHeaderSize;
+		data[0] = (longMask ? 0x40 : 0x00) | (header.recovery[0] & 0x3F);
+		data[1] = header.recovery[1];
+		set2(data,2,header.base);
+		set4(data,4,header.timestamp);
+		set2(data,8,header.length);
+		set2(data,10,header.protectionLength);
+		set2(data,12,WriteMask(header.mask,16,0));
+		if (longMask)
+			set4(data,14,WriteMask(header.mask,32,16));
+		return headerSize;
+	}
+
+	data[0] = header.recovery[0] & 0x3F;
+	data[1] = header.recovery[1];
+	set2(data,2,header.length);
+	set4(data,4,header.timestamp);
+	//Single ssrc
+	set4(data,8,0x01000000);
+	set4(data,12,header.ssrc);
+	set2(data,16,header.base);
+	//Write mask chunks, setting k on the last one
+	set2(data,18,(headerSize==FlexFECHeaderSizes[0] ? 0x8000 : 0) | WriteMask(header.mask,15,0));
+	if (headerSize>FlexFECHeaderSizes[0])
+		set4(data,20,(headerSize==FlexFECHeaderSizes[1] ? 0x80000000 : 0) | WriteMask(header.mask,31,15));
+	if (headerSize>FlexFECHeaderSizes[1])
+		set8(data,24,0x8000000000000000ull | WriteMask(header.mask,63,46));
+	return headerSize;
+}
+
+void XOR(BYTE* dst, const BYTE* src, DWORD size)
+{
+	DWORD i = 0;
+#ifdef __AVX2__
+	//32 bytes at a time, dst is aligned
+	for (;i+32<=size;i+=32)
+		_mm256_store_si256((__m256i*)(dst+i),_mm256_xor_si256(_mm256_load_si256((const __m256i*)(dst+i)),_mm256_loadu_si256((const __m256i*)(src+i))));
+#endif
+	//16 bytes at a time
+	for (;i+16<=size;i+=16)
+		_mm_store_si128((__m128i*)(dst+i),_mm_xor_si128(_mm_load_si128((const __m128i*)(dst+i)),_mm_loadu_si128((const __m128i*)(src+i))));
+	//Remaining bytes
+	for (;i<size;++i)
+		dst[i] ^= src[i];
+}
+
+void XORHeader(Header& header, const BYTE* packet, DWORD size)
+{
+	header.recovery[0]	^= packet[0] & 0x3F;
+	header.recovery[1]	^= packet[1];
+	header.timestamp	^= get4(packet,4);
+	header.length		^= size-RTPHeaderSize;
+}
+
+}; //namespace fec
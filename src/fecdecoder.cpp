@@ -5,288 +5,256 @@
  * Created on 6 de febrero de 2013, 10:30
  */
 
-#include <set>
-#include <srtp2/srtp.h>
-
 #include "fecdecoder.h"
-#include "codecs.h"
-#include "bitstream.h"
+#include <cstring>
+#include "log.h"
+#include "tools.h"
 
+FECDecoder::FECDecoder(fec::Scheme scheme, DWORD ssrc) :
+	scheme(scheme),
+	ssrc(ssrc),
+	storage(nullptr,free)
+{
+}
 
-FECDecoder::FECDecoder()
+bool FECDecoder::Allocate()
 {
+	//If already done
+	if (storage)
+		return true;
+	//Media payloads followed by fec payloads
+	storage.reset((BYTE*)malloc32((WindowSize+MaxPending)*fec::BufferSize));
+	//Check
+	if (!storage)
+		return Error("-FECDecoder::Allocate() | Could not allocate fec buffers\n");
+	return true;
 }
 
-FECDecoder::~FECDecoder()
+DWORD FECDecoder::Extend(WORD seq) const
 {
-	//Delete all media
-	for(RTPOrderedPackets::iterator it = medias.begin(); it!=medias.end(); it++)
-		//Delete rtp packet
-		delete (it->second);
-	//Delete all media
-	for(FECOrderedData::iterator it = codes.begin(); it!=codes.end(); it++)
-		//Delete rtp packet
-		delete (it->second);
+	//Start on first cycle so older packets don't wrap below zero
+	if (!started)
+		return 1<<16 | seq;
+	//Get distance to the highest one
+	return highest + (SWORD)(seq-(WORD)highest);
 }
 
-bool FECDecoder::AddPacket(RTPPacket* packet)
+DWORD FECDecoder::Unwrap(WORD seq)
 {
-	//Check if it is a redundant packet
-	if (packet->GetCodec()==VideoCodec::RED)
-	{
-		//Get the redundant packet
-		RTPRedundantPacket *red = (RTPRedundantPacket *)packet;
+	DWORD extSeq = Extend(seq);
+	//Update highest
+	if (!started || extSeq>highest)
+		highest = extSeq;
+	started = true;
+	return extSeq;
+}
 
-		//Check primary redundant type
-		if (red->GetPrimaryCodec()==VideoCodec::ULPFEC)
-		{
-			//Create new FEC data
-			FECData *fec = new FECData(red->GetPrimaryPayloadData(),red->GetPrimaryPayloadSize());
-			//Log
-			Debug("-fec primary red data at %d\n",fec->GetBaseExtSeq());
-			//Append it
-			codes.insert(std::pair<DWORD,FECData*>(fec->GetBaseExtSeq(),fec));
-			//Packet contained no media
-			return false;
-		}
+FECDecoder::Slot* FECDecoder::GetSlot(DWORD extSeq)
+{
+	//Check it is still on the window
+	if (!IsInWindow(extSeq))
+		return nullptr;
+	Slot& slot = slots[extSeq & (WindowSize-1)];
+	//Check it has not been overwritten
+	return slot.valid && slot.extSeq==extSeq ? &slot : nullptr;
+}
 
-		//Ensure we don't have it already
-		if (medias.find(packet->GetExtSeqNum())==medias.end())
-			//Add media packet
-			medias[packet->GetExtSeqNum()] = red->CreatePrimaryPacket();
+void FECDecoder::Store(DWORD extSeq, const BYTE* data, DWORD size)
+{
+	DWORD index = extSeq & (WindowSize-1);
+	Slot& slot = slots[index];
+	//Store header
+	slot.extSeq = extSeq;
+	slot.size = size;
+	slot.valid = true;
+	memcpy(slot.header,data,fec::RTPHeaderSize);
+	//Store payload zero padded to the block size
+	DWORD len = size-fec::RTPHeaderSize;
+	BYTE* payload = GetPayload(index);
+	memcpy(payload,data+fec::RTPHeaderSize,len);
+	memset(payload+len,0,fec::Padded(len)-len);
+}
 
-		//For each redundant data
-		for (int i=0;i<red->GetRedundantCount();++i)
-		{
-			//Check if it is a FEC pacekt
-			if (red->GetRedundantCodec(i)==VideoCodec::ULPFEC)
-			{
-				//Create new FEC data
-				FECData *fec = new FECData(red->GetRedundantPayloadData(i),red->GetRedundantPayloadSize(i));
-				//Log
-				Debug("-fec red data at %d\n",fec->GetBaseExtSeq());
-				//Append it
-				codes.insert(std::pair<DWORD,FECData*>(fec->GetBaseExtSeq(),fec));
-			}
-		}
-	} else if (packet->GetCodec()==VideoCodec::ULPFEC ) {
-		//Create new FEC data
-		FECData *fec = new FECData(packet->GetMediaData(),packet->GetMediaLength());
-		//Log
-		Debug("-fec data at %d\n",fec->GetBaseExtSeq());
-		//Append it
-		codes.insert(std::pair<DWORD,FECData*>(fec->GetBaseExtSeq(),fec));
-		//Packet contained no media
-		return false;
-	} else if  (packet->GetCodec()==VideoCodec::FLEXFEC) {
-		//TODO
-		return false;
-	} else {
-		//Check if we have it already
-		if (medias.find(packet->GetExtSeqNum())!=medias.end())
-			//Do nothing
-			return false;
-		//Add media packet
-		medias[packet->GetExtSeqNum()] = packet->Clone();
-	}
-	//Get last seq number
-	DWORD seq = medias.rbegin()->first;
+void FECDecoder::AddMediaPacket(const BYTE* data, DWORD size)
+{
+	//Check size and version
+	if (size<fec::RTPHeaderSize || size>MTU || (data[0]>>6)!=2)
+		return;
+	//Allocate buffers on first use
+	if (!Allocate())
+		return;
+
+	DWORD extSeq = Unwrap(get2(data,2));
+
+	//Skip too old or duplicated packets
+	if (!IsInWindow(extSeq) || GetSlot(extSeq))
+		return;
+
+	//Update stats
+	stats.mediaPackets++;
+	stats.mediaBytes += size;
+
+	Store(extSeq,data,size);
+}
 
-	//Remove unused packets
-	RTPOrderedPackets::iterator it = medias.begin();
-	//Delete everything until seq-63
-	while (it->first<seq-63 && it!=medias.end())
+bool FECDecoder::AddFECPacket(const BYTE* data, DWORD size)
+{
+	fec::Header header;
+
+	//Parse fec header
+	DWORD len = fec::Parse(scheme,data,size,header);
+
+	//Check it is valid and protects our ssrc
+	if (!len || header.mask.IsEmpty() || header.protectionLength>fec::BufferSize || (scheme==fec::Scheme::FlexFEC && header.ssrc!=ssrc))
 	{
-		//Delete rtp packet
-		delete (it->second);
-		//Erase it
-		medias.erase(it++);
+		stats.invalid++;
+		Debug("-FECDecoder::AddFECPacket() | Invalid fec packet [size:%u]\n",size);
+		return false;
 	}
 
-	//Now clean recovery codes
-	FECOrderedData::iterator it2 = codes.begin();
-	//Check base sequence
-	while (it2->first<seq-63 && it2!=codes.end())
+	//Allocate buffers on first use
+	if (!Allocate())
+		return false;
+
+	//Update stats
+	stats.fecPackets++;
+	stats.fecBytes += fec::RTPHeaderSize + size;
+
+	//Get slot for it
+	DWORD index = nextPending;
+	Pending& slot = pending[index];
+	//If full drop the oldest one
+	if (slot.valid)
 	{
-		//Delete object
-		delete(it2->second);
-		//Erase and move to next
-		codes.erase(it2++);
+		stats.unrecoverable++;
+		numPending--;
 	}
+	nextPending = (nextPending+1) % MaxPending;
+
+	//Store it
+	slot.header = header;
+	slot.baseExtSeq = Extend(header.base);
+	slot.valid = true;
+	numPending++;
+
+	//Copy payload zero padded to the whole buffer, as protected packets may be longer
+	BYTE* payload = GetPendingPayload(index);
+	memcpy(payload,data+len,header.protectionLength);
+	memset(payload+header.protectionLength,0,fec::BufferSize-header.protectionLength);
 
-	//Packet had media
 	return true;
 }
 
-RTPPacket* FECDecoder::Recover()
+DWORD FECDecoder::Recover(std::vector<Packet>& recovered)
 {
-	BYTE aux[8];
-	QWORD lostMask = 0;
-
-	//Check we have media pacekts
-	if (!medias.size())
-		//Exit
-		return NULL;
-	//Get First packet
-	RTPPacket* first = medias.begin()->second;
-	//Get the SSRC
-	DWORD ssrc = first->GetSSRC();
-	//Get first media packet
-	DWORD minSeq = first->GetExtSeqNum();
-	//Iterator on seq
-	DWORD lastSeq = minSeq;
-
-	//Set to 0
-	memset(aux,0,8);
-	//Create writter
-	BitWritter w(aux,8);
-	//vector of lost pacekt seq
-	std::vector<DWORD> losts;
-
-	//For each media packet
-	for (RTPOrderedPackets::iterator it=medias.begin();it!=medias.end();++it)
+	DWORD num = 0;
+	bool progress = true;
+
+	//Each recovered packet may allow recovering another one
+	while (progress && numPending)
 	{
-		//Get seq
-		DWORD cur = it->first;
-		//Insert lost
-		for (DWORD i=lastSeq+1;i<cur;++i)
+		progress = false;
+
+		for (DWORD i=0;i<MaxPending;++i)
 		{
-			//set mask bit to not present
-			w.Put(1,0);
-			//Add to the vecotr
-			losts.push_back(i);
+			Pending& entry = pending[i];
+			//Skip empty
+			if (!entry.valid)
+				continue;
+
+			DWORD missing = 0;
+			DWORD lost = 0;
+			bool old = false;
+
+			//Check protected packets
+			entry.header.mask.ForEach([&](DWORD j){
+				DWORD extSeq = entry.baseExtSeq + j;
+				//If it has already gone out of the window
+				if (extSeq<=highest && highest-extSeq>=WindowSize)
+					old = true;
+				else if (!GetSlot(extSeq))
+				{
+					missing++;
+					lost = extSeq;
+				}
+			});
+
+			//Check what to do with it
+			if (old)
+				stats.unrecoverable++;
+			else if (!missing)
+				stats.unused++;
+			else if (missing==1 && Recover(entry,lost,recovered))
+				num++, progress = true;
+			else if (missing==1)
+				stats.unrecoverable++;
+			else
+				//Wait for more packets
+				continue;
+
+			//Done with it
+			entry.valid = false;
+			numPending--;
 		}
-		//Set last seq
-		lastSeq = cur;
-		//set mask bit to present
-		w.Put(1,1);
 	}
 
-	//End it
-	w.Flush();
+	return num;
+}
 
-	//Get mask
-	lostMask = get8(aux,0);
+bool FECDecoder::Recover(Pending& entry, DWORD extSeq, std::vector<Packet>& recovered)
+{
+	//Recover on the fec payload itself, as it is not used anymore
+	BYTE* payload = GetPendingPayload(&entry-pending);
+	fec::Header header = entry.header;
 
-	//Check we have lost pacekts
-	if (!losts.size())
-		//Exit
-		return NULL;
+	//XOR the other protected packets
+	entry.header.mask.ForEach([&](DWORD j){
+		DWORD protectedExtSeq = entry.baseExtSeq + j;
+		//Skip the lost one
+		if (protectedExtSeq==extSeq)
+			return;
+		Slot* slot = GetSlot(protectedExtSeq);
+		fec::XORHeader(header,slot->header,slot->size);
+		fec::XOR(payload,GetPayload(protectedExtSeq & (WindowSize-1)),fec::Padded(slot->size-fec::RTPHeaderSize));
+	});
 
-	//For each lost packet
-	for(std::vector<DWORD>::iterator it=losts.begin();it!=losts.end();++it)
+	//Check the recovered length was protected
+	if (header.length>entry.header.protectionLength || fec::RTPHeaderSize+header.length>MTU)
 	{
-		//Get lost packet sequence
-		DWORD seq = *it;
+		Debug("-FECDecoder::Recover() | Recovered packet not fully protected [seq:%u,length:%u,protection:%u]\n",extSeq,header.length,entry.header.protectionLength);
+		return false;
+	}
 
-		//Search FEC packets associated this media packet
-		for (FECOrderedData::iterator it2 = codes.begin();it2!=codes.end();++it2)
-		{
-			//Get FEC packet
-			FECData *fec = it2->second;
+	//Rebuild rtp header
+	BYTE rtp[fec::RTPHeaderSize];
+	rtp[0] = 0x80 | (header.recovery[0] & 0x3F);
+	rtp[1] = header.recovery[1];
+	set2(rtp,2,extSeq);
+	set4(rtp,4,header.timestamp);
+	set4(rtp,8,ssrc);
 
-			//Check if it is associated with this media pacekt in level 0
-			if (!fec->IsProtectedAtLevel0(seq))
-				//Next
-				continue;
+	Packet packet;
+	packet.SetData(rtp,sizeof(rtp));
+	packet.AppendData(payload,header.length);
 
-			//Get the seq difference between fec data and the media
-			// fec seq has to be <= media seq it fec data protect media data)
-			DWORD diff = seq-fec->GetBaseExtSeq();
-			//Shit mask of the lost packets to check the present ones from the base seq
-			QWORD mediaMask = lostMask << (fec->GetBaseExtSeq()-minSeq);
-			//Remove lost packet bit from the fec mask
-			QWORD fecMask = fec->GetLevel0Mask() & ~(((QWORD)1)<<(64-diff-1));
-
-			//Compare needed pacekts with actual pacekts, to check if we have all of them except the missing
-			if ((fecMask & mediaMask) == fecMask)
-			{
-				//Rocovered media data
-				BYTE	recovered[MTU+SRTP_MAX_TRAILER_LEN] ZEROALIGNEDTO32;
-				//Get attributes
-				bool  p  = fec->GetRecoveryP();
-				bool  x  = fec->GetRecoveryX();
-				BYTE  cc = fec->GetRecoveryCC();
-				bool  m  = fec->GetRecoveryM();
-				BYTE  pt = fec->GetRecoveryType();
-				DWORD ts = fec->GetRecoveryTimestamp();
-				WORD  l  = fec->GetRecoveryLength();
-				//Get protection length
-				DWORD level0Size = fec->GetLevel0Size();
-				//Ensure there is enought size
-				if (level0Size>MTU)
-				{
-					//Error
-					Error("-FEC level 0 data size too big [%d]\n",level0Size);
-					//Skip this one
-					continue;
-				}
-				//Copy data
-				memcpy(recovered,fec->GetLevel0Data(),level0Size);
-				//Set value in temp buffer
-				set8(aux,0,fecMask);
-				//Get bit reader
-				BitReader r(aux,8);
-				//Read all media packet
-				while(r.Left())
-				{
-					//If the media packet is used to reconstrud the packet
-					if (r.Get(1))
-					{
-						//Get media packet
-						RTPPacket* media = medias[fec->GetBaseExtSeq()+r.GetPos()-1];
-						//Calculate receovered attributes
-						p  ^= media->GetP();
-						x  ^= media->GetX();
-						cc ^= media->GetCC();
-						m  ^= media->GetMark();
-						pt ^= media->GetType();
-						ts ^= media->GetTimestamp();
-						l  ^= media->GetMediaLength();
-						//Get data
-						BYTE *payload = media->GetMediaData();
-						//Calculate the xor
-						for (int i=0;i<fmin(media->GetMediaLength(),level0Size);++i)
-							//XOR
-							recovered[i] ^= payload[i];
-					}
-				}
-				//Create new video packet
-				RTPPacket* packet = new RTPPacket(MediaFrame::Video,pt);
-				//Set values
-				packet->SetP(p);
-				packet->SetX(x);
-				packet->SetMark(m);
-				packet->SetTimestamp(ts);
-				//Set sequence number
-				packet->SetSeqNum(seq);
-				//Set seq cycles
-				packet->SetSeqCycles(fec->GetBaseSeqCylcles());
-				//Set ssrc
-				packet->SetSSRC(ssrc);
-				//Set payload and recovered length
-				if (!packet->SetPayloadWithExtensionData(recovered,l))
-				{
-					//Delete packet
-					delete(packet);
-					//Error
-					Error("-FEC payload of recovered packet to big [%u]\n",(unsigned int)l);
-					//Skip
-					continue;
-				}
+	//Add it back to the window, so it can be used for recovering others
+	if (extSeq>highest)
+		highest = extSeq;
+	Store(extSeq,packet.GetData(),packet.GetSize());
 
-				Debug("-recovered packet len:%u ts:%u pts:%u seq:%d\n",l,ts,packet->GetTimestamp() ,packet->GetSeqNum());
+	stats.recovered++;
+	recovered.push_back(std::move(packet));
+	return true;
+}
 
-				//Append the packet to the media packet list
-				if (AddPacket(packet))
-					//Return it if contained media
-					return packet;
-				else
-					//Discard and continue
-					delete(packet);
-			}
-		}
-	}
-	//Nothing found
-	return NULL;
+void FECDecoder::Reset()
+{
+	for (auto& slot : slots)
+		slot.valid = false;
+	for (auto& entry : pending)
+		entry.valid = false;
+	nextPending = 0;
+	numPending = 0;
+	started = false;
+	highest = 0;
 }
@@ -0,0 +1,91 @@
+#include "fecencoder.h"
+#include <cstring>
+#include <algorithm>
+#include "log.h"
+#include "tools.h"
+
+//Max size of fec headers
+static constexpr DWORD MaxHeaderSize = 32;
+
+FECEncoder::FECEncoder(const Options& options) :
+	options(options),
+	storage((BYTE*)malloc32(2*fec::BufferSize+MaxHeaderSize),free)
+{
+	//Accumulator is aligned, fec packet goes after it
+	accumulator = storage.get();
+	packet = accumulator + fec::BufferSize;
+	//Check group size
+	SetGroup(options.group);
+}
+
+void FECEncoder::SetGroup(DWORD group)
+{
+	//Must fit on the mask
+	options.group = std::max(1u,std::min(group,fec::GetMaxProtected(options.scheme)));
+}
+
+bool FECEncoder::AddPacket(const BYTE* data, DWORD size)
+{
+	//Check size
+	if (size<fec::RTPHeaderSize || size>MTU)
+		return false;
+
+	WORD seq = get2(data,2);
+	bool mark = data[1] & 0x80;
+
+	//Start new group if needed
+	if (count && (WORD)(seq-header.base)>=fec::GetMaxProtected(options.scheme))
+	{
+		Debug("-FECEncoder::AddPacket() | Sequence number out of group, dropping it [seq:%u,base:%u]\n",seq,header.base);
+		Reset();
+	}
+	if (!count)
+	{
+		header = {};
+		header.base = seq;
+		header.ssrc = options.ssrc;
+		memset(accumulator,0,fec::BufferSize);
+	}
+
+	//Protect it
+	DWORD len = size-fec::RTPHeaderSize;
+	header.mask.Set((WORD)(seq-header.base));
+	header.protectionLength = std::max(header.protectionLength,len);
+	fec::XORHeader(header,data,size);
+	fec::XOR(accumulator,data+fec::RTPHeaderSize,len);
+	count++;
+
+	//Update stats
+	stats.mediaPackets++;
+	stats.mediaBytes += size;
+
+	//Check if group is done
+	if (count<options.group && !(options.flushOnMarker && mark))
+		return false;
+
+	//Create fec packet
+	Generate();
+	return true;
+}
+
+void FECEncoder::Generate()
+{
+	//Write header
+	DWORD len = fec::Serialize(options.scheme,header,packet,MaxHeaderSize);
+	//Append protected payload
+	memcpy(packet+len,accumulator,header.protectionLength);
+	fecSize = len + header.protectionLength;
+
+	//Update stats, including rtp header
+	stats.fecPackets++;
+	stats.fecBytes += fec::RTPHeaderSize + fecSize;
+
+	//Next group
+	count = 0;
+}
+
+void FECEncoder::Reset()
+{
+	count = 0;
+	fecSize = 0;
+}
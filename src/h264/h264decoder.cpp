@@ -97,6 +97,11 @@ int H264Decoder::Decode(const BYTE *data,DWORD size)
 	//Get new frame
 	videoBuffer = videoBufferPool.allocate();
 
+	//Check we got one
+	if (!videoBuffer)
+		//Error
+		return Error("-H264Decoder::Decode() | Could not allocate video buffer\n");
+
 	//Set interlaced flags
 	videoBuffer->SetInterlaced(picture->interlaced_frame);
 
@@ -60,8 +60,8 @@ MediaFrame* H264Depacketizer::AddPacket(const RTPPacket::shared& packet)
 	}
 	//Set SSRC
 	frame.SetSSRC(packet->GetSSRC());
-	//Add payload
-	AddPayload(packet->GetMediaData(),packet->GetMediaLength());
+	//Add payload referencing packet data
+	AddPayload(packet->SharePayload(),packet->GetMediaData(),packet->GetMediaLength());
 	//If it is last return frame
 	if (!packet->GetMark())
 		return NULL;
@@ -74,6 +74,12 @@ MediaFrame* H264Depacketizer::AddPacket(const RTPPacket::shared& packet)
 }
 
 MediaFrame* H264Depacketizer::AddPayload(const BYTE* payload, DWORD payloadLen)
+{
+	//Copy payload data
+	return AddPayload(nullptr,payload,payloadLen);
+}
+
+MediaFrame* H264Depacketizer::AddPayload(const RTPPayload::shared& owner, const BYTE* payload, DWORD payloadLen)
 {
 	H264SeqParameterSet sps;
 	BYTE nalHeader[4];
@@ -213,7 +219,7 @@ MediaFrame* H264Depacketizer::AddPayload(const BYTE* payload, DWORD payloadLen)
 				frame.AppendMedia(nalHeader, sizeof (nalHeader));
 				
 				//Append data and get current post
-				pos = frame.AppendMedia(payload,nalSize);
+				pos = frame.AppendMedia(owner,payload,nalSize);
 				//Add RTP packet
 				frame.AddRtpPacket(pos,nalSize,NULL,0);
 				
@@ -283,7 +289,7 @@ MediaFrame* H264Depacketizer::AddPayload(const BYTE* payload, DWORD payloadLen)
 				return NULL;
 
 			//Append data and get current post
-			pos = frame.AppendMedia(payload+2,nalSize);
+			pos = frame.AppendMedia(owner,payload+2,nalSize);
 			//Add rtp payload
 			frame.AddRtpPacket(pos,nalSize,payload,2);
 
@@ -299,10 +305,12 @@ MediaFrame* H264Depacketizer::AddPayload(const BYTE* payload, DWORD payloadLen)
 				//Check if doing annex b
 				if (annexB)
 					//Set annex b start code
-					set4(frame.GetData(), iniFragNALU, AnnexBStartCode);
+					set4(nalHeader, 0, AnnexBStartCode);
 				else
 					//Set size
-					set4(frame.GetData(), iniFragNALU, nalSize);
+					set4(nalHeader, 0, nalSize);
+				//Overwrite empty header without flattening the frame
+				frame.WriteMedia(iniFragNALU, nalHeader, sizeof(nalHeader));
 				//Done with fragment
 				iniFragNALU = 0;
 				startedFrag = false;
@@ -360,7 +368,7 @@ MediaFrame* H264Depacketizer::AddPayload(const BYTE* payload, DWORD payloadLen)
 			//Append data
 			frame.AppendMedia(nalHeader, sizeof (nalHeader));
 			//Append data and get current post
-			pos = frame.AppendMedia(payload, nalSize);
+			pos = frame.AppendMedia(owner, payload, nalSize);
 			//Add RTP packet
 			frame.AddRtpPacket(pos,nalSize,NULL,0);
 			//Done
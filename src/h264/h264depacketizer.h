@@ -20,6 +20,7 @@ public:
 	virtual MediaFrame* AddPayload(const BYTE* payload,DWORD payload_len) override;
 	virtual void ResetFrame() override;
 private:
+	MediaFrame* AddPayload(const RTPPayload::shared& owner,const BYTE* payload,DWORD payload_len);
 	VideoFrame frame;
 	AVCDescriptor config;
 	DWORD iniFragNALU = 0;
@@ -69,8 +69,8 @@ MediaFrame* H265Depacketizer::AddPacket(const RTPPacket::shared& packet)
 	}
 	//Set SSRC
 	frame.SetSSRC(packet->GetSSRC());
-	//Add payload
-	AddPayload(packet->GetMediaData(), packet->GetMediaLength());
+	//Add payload referencing packet data
+	AddPayload(packet->SharePayload(), packet->GetMediaData(), packet->GetMediaLength());
 	//If it is last return frame
 	if (!packet->GetMark())
 		return nullptr;
@@ -105,7 +105,7 @@ bool DecodeNalHeader(const BYTE* payload, DWORD payloadLen, BYTE& nalUnitType, B
 	return true;
 }
 
-bool H265Depacketizer::AddSingleNalUnitPayload(const BYTE* nalUnit, DWORD nalSize /*include nalHeader*/)
+bool H265Depacketizer::AddSingleNalUnitPayload(const RTPPayload::shared& owner, const BYTE* nalUnit, DWORD nalSize /*include nalHeader*/)
 {
 	BYTE nalUnitType{0}, nuh_layer_id{0}, nuh_temporal_id_plus1{0};
 	if (!DecodeNalHeader(nalUnit, nalSize, nalUnitType, nuh_layer_id, nuh_temporal_id_plus1))
@@ -209,7 +209,7 @@ bool H265Depacketizer::AddSingleNalUnitPayload(const BYTE* nalUnit, DWORD nalSiz
 	//Append data
 	frame.AppendMedia(nalHeaderPreffix, sizeof(nalHeaderPreffix));
 	//Append data and get current post
-	auto pos = frame.AppendMedia(nalUnit, nalSize);
+	auto pos = frame.AppendMedia(owner, nalUnit, nalSize);
 	//Add RTP packet
 	if (nalSize >= RTPPAYLOADSIZE)
 	{
@@ -224,6 +224,12 @@ bool H265Depacketizer::AddSingleNalUnitPayload(const BYTE* nalUnit, DWORD nalSiz
 }
 
 MediaFrame* H265Depacketizer::AddPayload(const BYTE* payload, DWORD payloadLen)
+{
+	//Copy payload data
+	return AddPayload(nullptr, payload, payloadLen);
+}
+
+MediaFrame* H265Depacketizer::AddPayload(const RTPPayload::shared& owner, const BYTE* payload, DWORD payloadLen)
 {
 	BYTE nalHeaderPreffix[4]; // set as AnenexB or not
 	DWORD pos;
@@ -307,7 +313,7 @@ MediaFrame* H265Depacketizer::AddPayload(const BYTE* payload, DWORD payloadLen)
 					return nullptr;
 				}
 
-				if (!AddSingleNalUnitPayload(payload, nalSize))
+				if (!AddSingleNalUnitPayload(owner, payload, nalSize))
 				{
 					Error("-H265: Failed to add Nal Unit payload in AP RTP packet!\n");
 					return nullptr;
@@ -406,7 +412,7 @@ MediaFrame* H265Depacketizer::AddPayload(const BYTE* payload, DWORD payloadLen)
 			}
 
 			//Append data and get current post
-			pos = frame.AppendMedia(payload + nalAndFuHeadersLength, nalSize);
+			pos = frame.AppendMedia(owner, payload + nalAndFuHeadersLength, nalSize);
 			//Add rtp payload
 			frame.AddRtpPacket(pos, nalSize, payload, nalAndFuHeadersLength);
 
@@ -425,9 +431,11 @@ MediaFrame* H265Depacketizer::AddPayload(const BYTE* payload, DWORD payloadLen)
 				//Check if doing annex b
 				if (annexB)
 					//Set annex b start code
-					set4(frame.GetData(), iniFragNALU, AnnexBStartCode);
+					set4(nalHeaderPreffix, 0, AnnexBStartCode);
 				else
-					set4(frame.GetData(), iniFragNALU, nalSize);
+					set4(nalHeaderPreffix, 0, nalSize);
+				//Overwrite empty header without flattening the frame
+				frame.WriteMedia(iniFragNALU, nalHeaderPreffix, sizeof(nalHeaderPreffix));
 				//Done with fragment
 				iniFragNALU = 0;
 				startedFrag = false;
@@ -436,7 +444,7 @@ MediaFrame* H265Depacketizer::AddPayload(const BYTE* payload, DWORD payloadLen)
 			break;
 		}
 		default:
-			if (!AddSingleNalUnitPayload(payload, payloadLen))
+			if (!AddSingleNalUnitPayload(owner, payload, payloadLen))
 			{
 				Error("-H265: Failed to add Nal Unit payload\n");
 				return nullptr;
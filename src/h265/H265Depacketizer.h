@@ -14,8 +14,9 @@ public:
 	virtual MediaFrame* AddPayload(const BYTE* payload, DWORD payload_len) override;
 	virtual void ResetFrame() override;
 private:
+	MediaFrame* AddPayload(const RTPPayload::shared& owner,const BYTE* payload,DWORD payload_len);
 	void AddCodecConfig();
-	bool AddSingleNalUnitPayload(const BYTE* nalUnit, DWORD nalSize /*include nalHeader*/);
+	bool AddSingleNalUnitPayload(const RTPPayload::shared& owner, const BYTE* nalUnit, DWORD nalSize /*include nalHeader*/);
 
 	VideoFrame frame;
 	HEVCDescriptor config;
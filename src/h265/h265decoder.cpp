@@ -102,6 +102,11 @@ int H265Decoder::Decode(const BYTE *data,DWORD size)
 	//Get new frame
 	videoBuffer = videoBufferPool.allocate();
 
+	//Check we got one
+	if (!videoBuffer)
+		//Error
+		return Error("-H265Decoder::Decode() | Could not allocate video buffer\n");
+
 	//Set interlaced flags
 	videoBuffer->SetInterlaced(picture->interlaced_frame);
 
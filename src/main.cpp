@@ -2,6 +2,10 @@
 #include "assertions.h"
 #include "xmlrpcserver.h"
 #include "xmlhandler.h"
+#include "HTTPServer.h"
+#include "AudioEngine.h"
+#include "VideoWorkerPool.h"
+#include "mp4streamer.h"
 #include "xmlstreaminghandler.h"
 #include "ws/websockets.h"
 #include "statushandler.h"
@@ -149,14 +153,22 @@ int main(int argc,char **argv)
 	int port = 8080;
 	char* iface = NULL;
 	int wsPort = 9090;
+	int xmlrpcPort = 0;
 	int rtmpPort = 1935;
 	int minPort = 0;
 	int maxPort = 0;
 	int vadPeriod = 2000;
+	int audioThreads = 0;
+	int videoThreads = 0;
+	int videoNode = -1;
+	int mp4Threads = 0;
+	int rtpThreads = 0;
 	const char *logfile = "mcu.log";
 	const char *pidfile = "mcu.pid";
 	const char *crtfile = NULL;
 	const char *keyfile = NULL;
+	const char *keytype = NULL;
+	bool savecrt = false;
     
 	//Get all
 	for(int i=1;i<argc;i++)
@@ -166,7 +178,7 @@ int main(int argc,char **argv)
 		{
 			//Show usage
 			printf("Medooze MCU media mixer version %s %s\r\n",MCUVERSION,MCUDATE);
-			printf("Usage: mcu [-h] [--help] [--mcu-log logfile] [--mcu-pid pidfile] [--http-port port] [--rtmp-port port] [--min-rtp-port port] [--max-rtp-port port] [--vad-period ms]\r\n\r\n"
+			printf("Usage: mcu [-h] [--help] [--mcu-log logfile] [--mcu-pid pidfile] [--http-port port] [--xmlrpc-port port] [--rtmp-port port] [--min-rtp-port port] [--max-rtp-port port] [--vad-period ms] [--audio-threads num] [--video-threads num] [--video-numa-node node] [--mp4-threads num] [--rtp-threads num]\r\n\r\n"
 				"Options:\r\n"
 				" -h,--help        Print help\r\n"
 				" -f               Run as daemon in safe mode\r\n"
@@ -177,13 +189,21 @@ int main(int argc,char **argv)
 				" --mcu-pid        Set mcu pid file path (default: mcu.pid)\r\n"
 				" --mcu-crt        Set mcu SSL certificate file path (default: mcu.crt)\r\n"
 				" --mcu-key        Set mcu SSL key file path (default: mcu.pid)\r\n"
+				" --mcu-key-type   Set type of generated SSL key: rsa, ecdsa or ed25519 (default: rsa)\r\n"
+				" --mcu-save-crt   Write generated SSL certificate and key to their file paths if none of them exist\r\n"
 				" --http-port      Set HTTP xmlrpc api port\r\n"
 				" --http-ip        Set HTTP xmlrpc api listening interface ip\r\n"
+				" --xmlrpc-port    Set pipelined HTTP xmlrpc api port for /mcu (default: disabled)\r\n"
 				" --min-rtp-port   Set min rtp port\r\n"
 				" --max-rtp-port   Set max rtp port\r\n"
 				" --rtmp-port      Set RTMP port\r\n"
 				" --websocket-port Set WebSocket server port\r\n"
-				" --vad-period     Set the VAD based conference change period in milliseconds (default: 2000ms)\r\n");
+				" --vad-period     Set the VAD based conference change period in milliseconds (default: 2000ms)\r\n"
+				" --audio-threads  Set number of threads used for audio decoding, mixing and encoding (default: cores, up to 4)\r\n"
+				" --video-threads  Set number of threads used for video decoding and encoding (default: cores)\r\n"
+				" --video-numa-node Pin video threads to the cpus of a numa node (default: not pinned)\r\n"
+				" --mp4-threads    Set number of threads used for mp4 file playback (default: cores, up to 2)\r\n"
+				" --rtp-threads    Set number of threads used for plain rtp sessions (default: cores, up to 4)\r\n");
 			//Exit
 			return 0;
 		} else if (strcmp(argv[i],"-f")==0)
@@ -204,12 +224,30 @@ int main(int argc,char **argv)
 		else if (strcmp(argv[i],"--http-ip")==0 && (i+1<argc))
 			//Get ip
 			iface = argv[++i];
+		else if (strcmp(argv[i],"--xmlrpc-port")==0 && (i+1<argc))
+			//Get port
+			xmlrpcPort = atoi(argv[++i]);
 		else if (strcmp(argv[i],"--rtmp-port")==0 && (i+1<argc))
 			//Get rtmp port
 			rtmpPort = atoi(argv[++i]);
 		else if (strcmp(argv[i],"--websocket-port")==0 && (i+1<argc))
 			//Get port
 			wsPort = atoi(argv[++i]);
+		else if (strcmp(argv[i],"--audio-threads")==0 && (i+1<argc))
+			//Get number of audio threads
+			audioThreads = atoi(argv[++i]);
+		else if (strcmp(argv[i],"--video-threads")==0 && (i+1<argc))
+			//Get number of video threads
+			videoThreads = atoi(argv[++i]);
+		else if (strcmp(argv[i],"--video-numa-node")==0 && (i+1<argc))
+			//Get numa node for video threads
+			videoNode = atoi(argv[++i]);
+		else if (strcmp(argv[i],"--mp4-threads")==0 && (i+1<argc))
+			//Get number of mp4 playback threads
+			mp4Threads = atoi(argv[++i]);
+		else if (strcmp(argv[i],"--rtp-threads")==0 && (i+1<argc))
+			//Get number of rtp transport threads
+			rtpThreads = atoi(argv[++i]);
 		else if (strcmp(argv[i],"--min-rtp-port")==0 && (i+1<argc))
 			//Get rtmp port
 			minPort = atoi(argv[++i]);
@@ -228,6 +266,12 @@ int main(int argc,char **argv)
 		else if (strcmp(argv[i],"--mcu-key")==0 && (i+1<argc))
 			//Get certificate key file
 			keyfile = argv[++i];
+		else if (strcmp(argv[i],"--mcu-key-type")==0 && (i+1<argc))
+			//Get type of key to generate
+			keytype = argv[++i];
+		else if (strcmp(argv[i],"--mcu-save-crt")==0)
+			//Store generated certificate
+			savecrt = true;
 		else if (strcmp(argv[i],"--vad-period")==0 && (i+1<=argc))
 			//Get rtmp port
 			vadPeriod = atoi(argv[++i]);
@@ -347,6 +391,7 @@ int main(int argc,char **argv)
 	XmlRpcServer	server(port,iface);
 	RTMPServer	rtmpServer;
 	WebSocketServer wsServer;
+	HTTPServer	xmlrpcServer;
 
 	//Init OpenSSL lib
 	if (! OpenSSL::ClassInit()) {
@@ -361,6 +406,31 @@ int main(int argc,char **argv)
 	//Set default video mixer vad period
 	VideoMixer::SetVADDefaultChangePeriod(vadPeriod);
 
+	//Set audio engine threads before it is started
+	AudioEngine::SetDefaultNumThreads(audioThreads);
+
+	//Set video worker pool threads before it is started
+	VideoWorkerPool::SetDefaultNumThreads(videoThreads);
+
+	//Set mp4 playback loops before first file is played
+	MP4Streamer::SetDefaultNumThreads(mp4Threads);
+
+	//Set rtp transport reactors before first session is created
+	RTPTransport::SetDefaultNumThreads(rtpThreads);
+
+	//If video threads have to be run on a numa node
+	if (videoNode>=0)
+	{
+		//Get its cpus
+		auto cpus = VideoWorkerPool::GetNodeCPUs(videoNode);
+		//Check
+		if (!cpus.empty())
+			//Pin them
+			VideoWorkerPool::SetDefaultCPUs(cpus);
+		else
+			Error("-Could not get cpus of numa node %d, video threads not pinned\n",videoNode);
+	}
+
 	//Set port ramge
 	if (minPort && maxPort && !RTPTransport::SetPortRange(minPort,maxPort))
 		//Using default ones
@@ -370,6 +440,14 @@ int main(int argc,char **argv)
 	if (crtfile && keyfile)
 		//Set DTLS certificate
 		DTLSConnection::SetCertificate(crtfile,keyfile);
+
+	//Check if we have to change the type of generated key
+	if (keytype)
+		//Set it
+		DTLSConnection::SetKeyType(DTLSConnection::KeyTypeFromName(keytype));
+
+	//Store generated certificate on the certificate files if requested
+	DTLSConnection::SetSaveCertificate(savecrt);
 	
 	//Init DTLS
 	if (DTLSConnection::Initialize()) 
@@ -422,6 +500,9 @@ int main(int argc,char **argv)
 	//Add uploaders
 	server.AddHandler("/upload/mcu/app/",&uploadermcu);
 
+	//Append mcu cmd handler to the worker based http server too
+	xmlrpcServer.AddHandler("/mcu",&xmlrpcmcu);
+
 	//Add websocket handlers
 	wsServer.AddHandler("/echo", &echo);
 	wsServer.AddHandler("/mcu", &mcu);
@@ -436,6 +517,10 @@ int main(int argc,char **argv)
 	//Init web socket server
 	wsServer.Init(wsPort);
 
+	//Init xmlrpc server if enabled
+	if (xmlrpcPort)
+		xmlrpcServer.Init(xmlrpcPort,iface);
+
 	//Set mcu monitor listener
 	monitor.AddListener(&mcu);
 
@@ -457,6 +542,8 @@ int main(int argc,char **argv)
 	rtmpServer.End();
 	//ENd ws server
 	wsServer.End();
+	//End xmlrpc server
+	xmlrpcServer.End();
 
 	//End DTLS
 	DTLSConnection::Terminate();
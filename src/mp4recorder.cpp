@@ -608,7 +608,7 @@ MP4Recorder::MP4Recorder(Listener* listener) :
 MP4Recorder::~MP4Recorder()
 {
 	//If not closed
-        if (mp4!=MP4_INVALID_FILE_HANDLE)
+        if (IsOpened())
 		//Close sync
 		Close(false);
         
@@ -631,13 +631,26 @@ bool MP4Recorder::Create(const char* filename)
 	Log("-MP4Recorder::Create() Opening mp4 recording [%s]\n",filename);
 
 	//If we are recording
-	if (mp4!=MP4_INVALID_FILE_HANDLE)
-		//Close
-		Close();
+	if (IsOpened())
+		//Close, sync as fragmented writer is reused
+		Close(!fragmented);
 
 	// We have to wait for first I-Frame
 	waitVideo = 0;
 
+	//If writing natively
+	if (fragmentedOptions)
+	{
+		//Create writer
+		fragmented = std::make_unique<FragmentedMP4Writer>(*fragmentedOptions);
+		//Open it
+		if (!fragmented->Open(filename))
+			//Error
+			return Error("-MP4Recorder::Create() | Error opening fragmented mp4 file for recording\n");
+		//Success
+		return true;
+	}
+
 	// Create mp4 file
 	mp4 = MP4Create(filename,0);
 
@@ -666,7 +679,7 @@ bool MP4Recorder::Record(bool waitVideo, bool disableHints)
 	Log("-MP4Recorder::Record() [waitVideo:%d,disableHints:%d]\n",waitVideo,disableHints);
 	
         //Check mp4 file is opened
-        if (mp4 == MP4_INVALID_FILE_HANDLE)
+        if (!IsOpened())
                 //Error
                 return Error("No MP4 file opened for recording\n");
         
@@ -677,28 +690,50 @@ bool MP4Recorder::Record(bool waitVideo, bool disableHints)
 	
 	//Run in thread
 	loop.Async([=](auto now){
-		//Recording
-		recording = true;
-
-		//For all time shift frames
-		for (const auto& [ssrc,frame] : timeShiftBuffer)
-			//Process it
-			processMediaFrame(ssrc,*frame,frame->GetTime());
+		TimeShiftBuffer buffered;
+		{
+			std::lock_guard<std::mutex> lock(timeShiftMutex);
+			//Recording, new frames will be queued after the buffered ones
+			recording = true;
+			//Take buffered frames, so we don't block incoming ones while writing them
+			buffered.SetOptions(timeShiftBuffer.GetOptions());
+			buffered.Swap(timeShiftBuffer);
+		}
 
-		//clear buffer
-		timeShiftBuffer.clear();
+		//Process all time shift frames and release buffer
+		buffered.Drain([&](DWORD ssrc, const MediaFrame& frame){
+			processMediaFrame(ssrc,frame,frame.GetTime());
+		});
 	});
 	
 	//Exit
 	return true;
 }
 
+void MP4Recorder::SetTimeShiftDuration(DWORD duration)
+{
+	std::lock_guard<std::mutex> lock(timeShiftMutex);
+	//Store it so frames are buffered
+	timeShiftDuration = duration;
+	timeShiftBuffer.SetDuration(duration);
+}
+
+void MP4Recorder::SetTimeShiftOptions(const TimeShiftBuffer::Options& options)
+{
+	std::lock_guard<std::mutex> lock(timeShiftMutex);
+	//Keep current duration
+	auto opts = options;
+	opts.duration = timeShiftBuffer.GetDuration();
+	timeShiftBuffer.SetOptions(opts);
+}
+
 bool MP4Recorder::Stop()
 {
 	Log("-MP4Recorder::Stop()\n");
 	
 	//Signal async	
 	loop.Async([=](auto now){
+		std::lock_guard<std::mutex> lock(timeShiftMutex);
 		//not recording anymore
 		recording = false;
 	});
@@ -720,11 +755,13 @@ bool MP4Recorder::Close(bool async)
         auto res = loop.Future([=](auto now){
 		Debug(">MP4Recorder::Close() | Async\n");
 		
-		//Not recording anymore
-		recording = false;
-		
-		//Clear time buffer
-		timeShiftBuffer.clear();
+		{
+			std::lock_guard<std::mutex> lock(timeShiftMutex);
+			//Not recording anymore
+			recording = false;
+			//Clear time buffer
+			timeShiftBuffer.Clear();
+		}
 		
 		//Check mp4 file is opened
 		//For each audio track
@@ -745,6 +782,28 @@ bool MP4Recorder::Close(bool async)
 			// Close file
 			MP4Close(mp4);
 
+		//If writing natively
+		if (fragmented)
+		{
+			//Write last frame of each track
+			for (auto& [key,track] : fragmentedTracks)
+			{
+				//If we have it
+				if (track.id && track.prev)
+				{
+					//Get duration, or use previous one
+					DWORD duration = track.prev->GetDuration() ? track.prev->GetDuration() : track.duration;
+					//Check if it is intra
+					bool sync = track.prev->GetType()!=MediaFrame::Video || ((VideoFrame*)track.prev.get())->IsIntra();
+					//Write it
+					fragmented->WriteSample(track.id,track.prev->GetData(),track.prev->GetLength(),track.dts,duration,sync);
+				}
+			}
+			fragmentedTracks.clear();
+			//Write pending fragment and close
+			fragmented->Close();
+		}
+
 		//Empty file
 		mp4 = MP4_INVALID_FILE_HANDLE;
 		
@@ -772,37 +831,34 @@ void MP4Recorder::onMediaFrame(const MediaFrame &frame)
 
 void MP4Recorder::onMediaFrame(DWORD ssrc, const MediaFrame &frame)
 {
-	
+	{
+		std::lock_guard<std::mutex> lock(timeShiftMutex);
+		//If not recording yet
+		if (!recording)
+		{
+			//Copy it straight to the time shift buffer arena, it will drop frames out of the window
+			if (timeShiftDuration)
+				timeShiftBuffer.Push(ssrc,frame);
+			return;
+		}
+	}
+
 	//run async	
-	loop.Async([=,cloned = frame.Clone()](auto now){
-		//Check we are recording
+	loop.Async([=,cloned = std::shared_ptr<MediaFrame>(frame.Clone())](auto now){
+		//Check we are still recording
 		if (recording) 
-		{
 			//Set now as timestamp
 			processMediaFrame(ssrc,*cloned,cloned->GetTime());
-			//Delete
-			delete cloned;
-		} 
-		//Check if doing time shift recording
-		else if (timeShiftDuration) 
-		{
-			 //Push it to the end
-			timeShiftBuffer.emplace_back(ssrc,cloned);
-			//Get time shitft start
-			QWORD ini = getTimeMS() - timeShiftDuration;
-			//Discard all the timed out frames
-			while (!timeShiftBuffer.empty() && timeShiftBuffer.front().second->GetTime()<ini)
-				//Delete
-				timeShiftBuffer.pop_front();
-		} else {
-			//Delete
-			delete cloned;
-		}
 	});
 }
 
 void MP4Recorder::processMediaFrame(DWORD ssrc, const MediaFrame &frame, QWORD time)
 {
+	//If writing natively
+	if (fragmented)
+		//Do it there
+		return processFragmentedFrame(ssrc,frame,time);
+
 	// Check if we have to wait for video
 	if (waitVideo && (frame.GetType()!=MediaFrame::Video))
 		//Do nothing yet
@@ -1048,6 +1104,116 @@ void MP4Recorder::processMediaFrame(DWORD ssrc, const MediaFrame &frame, QWORD t
 	}
 }
 
+void MP4Recorder::processFragmentedFrame(DWORD ssrc, const MediaFrame &frame, QWORD time)
+{
+	//Only audio and video are supported
+	if (frame.GetType()!=MediaFrame::Audio && frame.GetType()!=MediaFrame::Video)
+		//Ignore
+		return;
+
+	//If it is video
+	if (frame.GetType()==MediaFrame::Video)
+	{
+		//Check if we have to wait for first I-Frame
+		if (waitVideo && !((const VideoFrame&)frame).IsIntra())
+			//Do nothing yet
+			return;
+		//Don't wait more
+		waitVideo = false;
+	// Check if we have to wait for video
+	} else if (waitVideo) {
+		//Do nothing yet
+		return;
+	}
+
+	//Check if it is the first
+	if (first==(QWORD)-1)
+	{
+		//Log
+		Log("-MP4Recorder::processFragmentedFrame() | Got first frame [time:%llu]\n", time);
+		//Set this one as first
+		first = time;
+		//If we have listener
+		if (this->listener)
+			//Send event
+			this->listener->onFirstFrame(first);
+	}
+
+	//Get track for the stream
+	auto& track = fragmentedTracks[{frame.GetType(),ssrc}];
+
+	//If not created yet
+	if (!track.created)
+	{
+		//Don't try again
+		track.created = true;
+
+		//Depending on the type
+		if (frame.GetType()==MediaFrame::Audio)
+		{
+			const AudioFrame& audioFrame = (const AudioFrame&)frame;
+			//Opus is always stereo
+			DWORD channels = audioFrame.GetCodec()==AudioCodec::OPUS ? 2 : 1;
+			//Add audio track, with AAC config if we have it
+			track.id = fragmented->AddAudioTrack(audioFrame.GetCodec(),audioFrame.GetClockRate(),channels,
+				audioFrame.HasCodecConfig() ? audioFrame.GetCodecConfigData() : nullptr,
+				audioFrame.HasCodecConfig() ? audioFrame.GetCodecConfigSize() : 0);
+		} else {
+			const VideoFrame& videoFrame = (const VideoFrame&)frame;
+			//Add video track
+			track.id = fragmented->AddVideoTrack(videoFrame.GetCodec(),videoFrame.GetClockRate(),videoFrame.GetWidth(),videoFrame.GetHeight());
+			//If it is h264 and we have parameter sets from sdp
+			if (track.id && videoFrame.GetCodec()==VideoCodec::H264 && h264SPS && h264PPS)
+			{
+				//Add NAL headers
+				std::vector<BYTE> sps = {0x67};
+				std::vector<BYTE> pps = {0x68};
+				sps.insert(sps.end(),h264SPS->GetData(),h264SPS->GetData()+h264SPS->GetSize());
+				pps.insert(pps.end(),h264PPS->GetData(),h264PPS->GetData()+h264PPS->GetSize());
+				//Set them
+				fragmented->SetH264ParameterSets(track.id,sps.data(),sps.size(),pps.data(),pps.size());
+			}
+		}
+
+		//If it could not be added
+		if (!track.id)
+		{
+			Warning("-MP4Recorder::processFragmentedFrame() | Could not add track, ignoring stream [ssrc:%u,type:%s]\n",ssrc,MediaFrame::TypeToString(frame.GetType()));
+			return;
+		}
+
+		//Set name as ssrc
+		fragmented->SetTrackName(track.id,std::to_string(ssrc));
+		//Start at its offset from the first frame
+		track.dts = (time>first ? time-first : 0)*frame.GetClockRate()/1000;
+	}
+
+	//If ignored
+	if (!track.id)
+		//Done
+		return;
+
+	//If we had a previous frame
+	if (track.prev)
+	{
+		//Get frame duration
+		DWORD duration = track.prev->GetDuration();
+		//If not set
+		if (!duration)
+			//calculate it
+			duration = frame.GetTimeStamp()-track.prev->GetTimeStamp();
+		//Check if it is intra
+		bool sync = track.prev->GetType()!=MediaFrame::Video || ((VideoFrame*)track.prev.get())->IsIntra();
+		//Write it
+		fragmented->WriteSample(track.id,track.prev->GetData(),track.prev->GetLength(),track.dts,duration,sync);
+		//Next one
+		track.dts += duration;
+		track.duration = duration;
+	}
+
+	//Store until next one arrives
+	track.prev.reset(frame.Clone());
+}
 
 bool MP4Recorder::SetH264ParameterSets(const std::string& sprop)
 {
@@ -2,18 +2,181 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
 #include "log.h"
 #include "codecs.h"
 #include "rtp.h"
 #include "mp4streamer.h"
+#include "LoopPool.h"
 #include "video.h"
 #include "audio.h"
 
+//Size of the chunks of the file prefetched ahead of the reads
+static constexpr size_t PrefetchSize = 1024*1024;
+
+// File mapped in memory, used as mp4v2 file provider
+struct MP4MappedFile
+{
+	int	fd	= FD_INVALID;
+	BYTE*	data	= nullptr;
+	size_t	size	= 0;
+	size_t	pos	= 0;
+	//Range of the last prefetched chunk
+	size_t	prefetchStart	= 0;
+	size_t	prefetchEnd	= 0;
+
+	static void* Open(const char* name, MP4FileMode mode)
+	{
+		//Only for reading
+		if (mode!=FILEMODE_READ)
+			return nullptr;
+
+		//Open file
+		int fd = ::open(name,O_RDONLY);
+		//Check
+		if (fd<0)
+			return nullptr;
+
+		//Get size
+		struct stat st;
+		if (fstat(fd,&st)<0)
+		{
+			::close(fd);
+			return nullptr;
+		}
+
+		auto file = new MP4MappedFile();
+		file->fd = fd;
+		file->size = st.st_size;
+
+		//Map it, if it fails we will pread it
+		if (file->size)
+		{
+			void* data = mmap(nullptr,file->size,PROT_READ,MAP_PRIVATE,fd,0);
+			//Check
+			if (data!=MAP_FAILED)
+				file->data = (BYTE*)data;
+			else
+				Warning("-MP4MappedFile::Open() | mmap failed, using pread [name:%s,errno:%d]\n",name,errno);
+		}
+
+		return file;
+	}
+
+	static int Seek(void* handle, int64_t pos)
+	{
+		auto file = (MP4MappedFile*)handle;
+		//Check it is inside the file, true on failure
+		if (pos<0 || (size_t)pos>file->size)
+			return true;
+		file->pos = pos;
+		return false;
+	}
+
+	static int Read(void* handle, void* buffer, int64_t size, int64_t* nin, int64_t maxChunkSize)
+	{
+		auto file = (MP4MappedFile*)handle;
+
+		//Check we have enought data, true on failure
+		if (size<0 || file->pos+size>file->size)
+			return true;
+
+		//Prefetch next chunk if reading out of the last one
+		if (file->pos<file->prefetchStart || file->pos+size>file->prefetchEnd)
+			file->Prefetch(file->pos,size);
+
+		//If mapped
+		if (file->data)
+		{
+			//Copy
+			memcpy(buffer,file->data+file->pos,size);
+		} else {
+			//Read it
+			int64_t read = 0;
+			while (read<size)
+			{
+				ssize_t len = pread(file->fd,(BYTE*)buffer+read,size-read,file->pos+read);
+				//Check error
+				if (len<0 && errno==EINTR)
+					continue;
+				if (len<=0)
+					return true;
+				read += len;
+			}
+		}
+
+		//Move
+		file->pos += size;
+		*nin = size;
+
+		return false;
+	}
+
+	static int Write(void* handle, const void* buffer, int64_t size, int64_t* nout, int64_t maxChunkSize)
+	{
+		//Read only
+		return true;
+	}
+
+	static int Close(void* handle)
+	{
+		auto file = (MP4MappedFile*)handle;
+		//Unmap and close
+		if (file->data)
+			munmap(file->data,file->size);
+		::close(file->fd);
+		delete file;
+		return false;
+	}
+
+	void Prefetch(size_t pos, size_t len)
+	{
+		//Align to page
+		static const size_t pageSize = sysconf(_SC_PAGESIZE);
+		size_t start = pos & ~(pageSize-1);
+		//Read ahead a whole chunk
+		size_t end = std::min(std::max(pos+len,start+PrefetchSize),size);
+
+		//Ask the kernel to start reading it
+		if (data)
+			madvise(data+start,end-start,MADV_WILLNEED);
+		else
+			posix_fadvise(fd,start,end-start,POSIX_FADV_WILLNEED);
+
+		prefetchStart = start;
+		prefetchEnd = end;
+	}
+};
+
+static const MP4FileProvider MappedFileProvider = {
+	MP4MappedFile::Open,
+	MP4MappedFile::Seek,
+	MP4MappedFile::Read,
+	MP4MappedFile::Write,
+	MP4MappedFile::Close
+};
+
+//Complete packet caches by file and track
+static std::mutex cachesMutex;
+static std::map<std::string,std::weak_ptr<MP4RtpTrack::Packetization>> caches;
+
+//Shared loops
+static LoopPool<EventLoop> loops("mp4-streamer",MP4Streamer::MaxDefaultThreads);
+
+DWORD MP4Streamer::defaultNumThreads = 0;
+std::atomic<size_t> MP4Streamer::maxCacheSize = MP4Streamer::DefaultMaxCacheSize;
 
 MP4Streamer::MP4Streamer(Listener *listener)
 {
 	//Save listener
 	this->listener = listener;
+	//Get loop to run on
+	loop = loops.Acquire(defaultNumThreads);
 }
 
 MP4Streamer::~MP4Streamer()
@@ -22,14 +185,12 @@ MP4Streamer::~MP4Streamer()
 	if (opened)
 		//Close us
 		Close();
-	
-	//Check tracks and delete
-	if (audio)
-		delete (audio);
-	if (video)
-		delete (video);
-	if (text)
-		delete (text);
+
+	//Make sure timer is not referenced anymore
+	Run([this](){ timer.reset(); });
+
+	//Done with the loop
+	loops.Release(loop);
 }
 
 int MP4Streamer::Open(const char *filename)
@@ -41,20 +202,19 @@ int MP4Streamer::Open(const char *filename)
 	if (opened)
 		//Return error
 		return Error("-MP4Streamer::Open() | Already opened\n");
-	
-	// Open mp4 file
-	mp4 = MP4Read(filename);
+
+	// Open mp4 file mapped in memory
+	mp4 = MP4ReadProvider(filename,&MappedFileProvider);
 
 	// If not valid
 	if (mp4 == MP4_INVALID_FILE_HANDLE)
 		//Return error
 		return Error("-MP4Streamer::Open() | Invalid file handle for %s\n",filename);
-	
+
 	//No tracks
 	audio = NULL;
 	video = NULL;
 	text = NULL;
-
 	//Iterate thougth tracks
 	DWORD i = 0;
 
@@ -115,8 +275,6 @@ int MP4Streamer::Open(const char *filename)
 				audio->mp4 = mp4;
 				audio->hint = hintId;
 				audio->track = trackId;
-				audio->sampleId = 1;
-				audio->packetIndex = 0;
 
 			} else if ((strcmp(type, MP4_VIDEO_TRACK_TYPE) == 0) && !video) {
 				if (!name)
@@ -143,8 +301,6 @@ int MP4Streamer::Open(const char *filename)
 				video->mp4 = mp4;
 				video->hint = hintId;
 				video->track = trackId;
-				video->sampleId = 1;
-				video->packetIndex = 0;
 			}
 		} 
 	} while (hintId != MP4_INVALID_TRACK_ID);
@@ -166,16 +322,34 @@ int MP4Streamer::Open(const char *filename)
 		text->timeScale = MP4GetTrackTimeScale(mp4, textId);
 	}
 
+
+	//Identify the file by its size and modification time so cache is not reused if changed
+	struct stat st = {};
+	stat(filename,&st);
+	std::string key = std::string(filename) + ":" + std::to_string(st.st_size) + ":" + std::to_string(st.st_mtime);
+
+	//Read sample tables in advance
+	if (audio && !audio->Load(key + ":" + std::to_string(audio->hint),maxCacheSize))
+	{
+		delete(audio);
+		audio = NULL;
+	}
+	if (video && !video->Load(key + ":" + std::to_string(video->hint),maxCacheSize))
+	{
+		delete(video);
+		video = NULL;
+	}
+
 	//We are opened
 	opened = true;
-	
+
 	return 1;
 }
 
 int MP4Streamer::Play()
 {
 	Log(">MP4Streamer:Play()\n");
-	
+
 	//Stop just in case
 	Stop();
 
@@ -183,28 +357,32 @@ int MP4Streamer::Play()
 	if (!opened)
 		//Exit
 		return Error("-MP4Streamer:Play() | not opened!\n");
-	
+
 	//We are playing
-	playing = 1;
+	playing = true;
 
 	//From the begining
 	seeked = 0;
-	
-	//Start event loop
-	loop.Start([this](){PlayLoop();});
+
+	//Start playback on the loop
+	loop->Async([this](auto now){ Start(); });
 
 	Log("<MP4Streamer:Play()\n");
 
-	return playing;
+	return 1;
 }
 
-int MP4Streamer::PlayLoop()
+void MP4Streamer::Start()
 {
-	QWORD audioNext = MP4_INVALID_TIMESTAMP;
-	QWORD videoNext = MP4_INVALID_TIMESTAMP;
-	QWORD textNext  = MP4_INVALID_TIMESTAMP;
+	//Check we have not been stopped meanwhile
+	if (!playing || !opened)
+		return;
+
+	Log(">MP4Streamer::Start() [seeked:%llu]\n",seeked);
 
-	Log(">MP4Streamer::PlayLoop()\n");
+	audioNext = MP4_INVALID_TIMESTAMP;
+	videoNext = MP4_INVALID_TIMESTAMP;
+	textNext  = MP4_INVALID_TIMESTAMP;
 
 	//If it is from the begining
 	if (!seeked)
@@ -256,69 +434,87 @@ int MP4Streamer::PlayLoop()
 		text->ReadPrevious(seeked,listener);
 
 	// Calculate start time
-	QWORD ini = getTime();
+	ini = getTime();
 
 	//Reset time counter
 	t = 0;
 
-	// Wait control messages or finish of both streams
-	while ( opened && playing && (!(audioNext==MP4_INVALID_TIMESTAMP && videoNext==MP4_INVALID_TIMESTAMP && textNext==MP4_INVALID_TIMESTAMP)))
+	//Running on the loop
+	running = true;
+
+	//Create timer on first playback
+	if (!timer)
+		timer = loop->CreateTimer([this](auto now){ OnTimer(); });
+
+	//Send first frames
+	OnTimer();
+}
+
+void MP4Streamer::OnTimer()
+{
+	//Get time since start
+	QWORD now = getTimeDiff(ini)/1000;
+
+	//Send all frames until next one is not due yet, callbacks may stop us
+	while (running && playing)
 	{
-		// Get next time
-		if (audioNext<videoNext)
+		//Check if we have finished all streams
+		if (audioNext==MP4_INVALID_TIMESTAMP && videoNext==MP4_INVALID_TIMESTAMP && textNext==MP4_INVALID_TIMESTAMP)
 		{
-			if (audioNext<textNext)
-				t = audioNext;
-			else
-				t = textNext;
-		} else {
-			if (videoNext<textNext)
-				t = videoNext;
-			else
-				t = textNext;
+			Log("-MP4Streamer::OnTimer() | end of file\n");
+			//Not playing anymore
+			running = false;
+			playing = false;
+			//End of file, listener may play again
+			if (listener)
+				listener->onEnd();
+			//Done
+			return;
 		}
 
-		// Wait time diff
-		QWORD now = getTimeDiff(ini)/1000;
+		// Get next time
+		t = std::min({audioNext,videoNext,textNext});
 
+		//If it is not due yet
 		if (t>now)
 		{
-			//Wait next or stopped
-			loop.Run(std::chrono::milliseconds(t-now));
-			//loop
-			continue;
+			//Wait for it
+			timer->Again(std::chrono::milliseconds(t-now));
+			//Done
+			return;
 		}
 
 		// if we have to send audio
 		if (audioNext<=t)
-			audioNext = audio->Read(listener);
+			audioNext = audio->Read(listener,maxCacheSize);
 
 		// or video
 		if (videoNext<=t)
-			videoNext = video->Read(listener);
+			videoNext = video->Read(listener,maxCacheSize);
 
 		// or text
 		if (textNext<=t)
 			textNext = text->Read(listener);
-
 	}
+}
 
-	Log("-MP4Streamer::PlayLoop()\n");
-
-	//Check if we were stoped
-	bool stoped = !opened || !playing;
-
-	//Not playing anymore
-	playing = 0;
-
-	//Check end of file
-	if (!stoped && listener)
-		//End of file
-		listener->onEnd();
-
-	Log("<MP4Streamer::PlayLoop()\n");
+void MP4Streamer::Halt()
+{
+	//Stop sending
+	running = false;
+	//Cancel next one
+	if (timer)
+		timer->Cancel();
+}
 
-	return 1;
+void MP4Streamer::Run(const std::function<void(void)>& func)
+{
+	//If called from a callback, we are already on the loop
+	if (loop->IsLoopThread())
+		func();
+	else
+		//Run it on the loop and wait
+		loop->Future([&](auto now){ func(); }).wait();
 }
 
 QWORD MP4Streamer::PreSeek(QWORD time)
@@ -329,7 +525,7 @@ QWORD MP4Streamer::PreSeek(QWORD time)
 	//If we have video
 	if (opened && video)
 		//Get nearest i frame
-		seeked = video->SeekNearestSyncFrame(time);
+		seeked = video->SearchNearestSyncFrame(time);
 
 	return seeked;
 }
@@ -343,18 +539,17 @@ int MP4Streamer::Seek(QWORD time)
 
 	//Check we are opened
 	if (!opened)
-	
 		//Exit
 		return Error("-MP4Streamer:Seek() | not opened!\n");
 
 	//We are playing
-	playing = 1;
+	playing = true;
 
 	//Seet seeked
 	seeked = time;
 
-	//Start event loop
-	loop.Start([this](){PlayLoop();});
+	//Start playback on the loop
+	loop->Async([this](auto now){ Start(); });
 
 	Log("<MP4Streamer:Seek() | seeked [%lld,%lld]\n",time,seeked);
 
@@ -370,31 +565,36 @@ int MP4Streamer::Stop()
 	Log(">MP4Streamer::Stop()\n");
 
 	//Change playing state
-	playing = 0;
+	playing = false;
 
-	//Stop loop
-	loop.Stop();
+	//Stop timer, once done no more frames will be sent
+	Run([this](){ Halt(); });
 
 	Log("<MP4Streamer::Stop()\n");
-	
-	return !playing;
-}
 
+	return 1;
+}
 
 int MP4Streamer::Close()
 {
+	//Check if we were open
+	if (!opened)
+		return 0;
+
 	Log(">MP4Streamer::Close()\n");
-	
-	//Check if we wher open
-	if (opened)
-		return Error("-MP4Streamer::Close() | Not opened");
-	
-	//Change  state
-	opened = false;
 
 	//Stop playback
 	Stop();
-	
+
+	//Change  state
+	opened = false;
+
+	//Wait for pending timer cancelation
+	Run([](){});
+
+	//Delete tracks
+	ReleaseTracks();
+
 	//If we have been opened
 	if (mp4!=MP4_INVALID_FILE_HANDLE)
 		// Close file
@@ -408,130 +608,146 @@ int MP4Streamer::Close()
 	return 1;
 }
 
-int MP4RtpTrack::SendH264Parameters(Listener *listener)
+void MP4Streamer::ReleaseTracks()
+{
+	//Check tracks and delete
+	if (audio)
+		delete (audio);
+	if (video)
+		delete (video);
+	if (text)
+		delete (text);
+	audio = nullptr;
+	video = nullptr;
+	text = nullptr;
+}
+
+int MP4RtpTrack::Load(const std::string& key, size_t maxCacheSize)
+{
+	//Get number of samples
+	MP4SampleId num = MP4GetTrackNumberOfSamples(mp4,hint);
+
+	//Read sample table
+	samples.clear();
+	samples.reserve(num);
+	for (MP4SampleId id=1;id<=num;++id)
+	{
+		Sample sample;
+		//Time of the hint in ms
+		sample.time		= MP4ConvertFromTrackTimestamp(mp4,hint,MP4GetSampleTime(mp4,hint,id),1000);
+		//Media sample info
+		sample.timestamp	= MP4GetSampleTime(mp4,track,id);
+		sample.duration		= MP4GetSampleDuration(mp4,track,id);
+		sample.sync		= MP4GetSampleSync(mp4,track,id)>0;
+		samples.push_back(sample);
+	}
+
+	//Get parameter sets once
+	if (codec==VideoCodec::H264)
+		LoadH264Parameters();
+
+	Debug("-MP4RtpTrack::Load() [hint:%d,track:%d,samples:%zu]\n",hint,track,samples.size());
+
+	//Check if caching
+	if (!maxCacheSize)
+		return 1;
+
+	//Store key
+	cacheKey = key;
+
+	//Get cache
+	AttachCache();
+
+	return 1;
+}
+
+void MP4RtpTrack::AttachCache()
+{
+	std::lock_guard<std::mutex> lock(cachesMutex);
+	//Check if it has been already played by another streamer
+	auto it = caches.find(cacheKey);
+	if (it!=caches.end())
+		cache = it->second.lock();
+	//If not found or not alive anymore
+	if (!cache)
+	{
+		//Remove it
+		if (it!=caches.end())
+			caches.erase(it);
+		//Create new one to be filled while playing
+		cache = std::make_shared<Packetization>();
+	}
+}
+
+void MP4RtpTrack::UpdateCache()
+{
+	//Nothing to do if not caching or already complete
+	if (cacheKey.empty() || (cache && cache->complete))
+		return;
+
+	//If the partial one can't be filled in order from the new position
+	if (cache && sampleId && sampleId-1>cache->frames.size())
+	{
+		Debug("-MP4RtpTrack::UpdateCache() | seeked past cached frames, dropping it [hint:%d,sampleId:%u,frames:%zu]\n",hint,sampleId,cache->frames.size());
+		//Drop it, it would never be completed
+		cache.reset();
+	}
+
+	//If playing from the begining again
+	if (!cache && sampleId==1)
+		//Use the one completed by another streamer meanwhile or start filling a new one
+		AttachCache();
+}
+
+int MP4RtpTrack::LoadH264Parameters()
 {
 	uint8_t **sequenceHeader;
 	uint8_t **pictureHeader;
 	uint32_t *pictureHeaderSize;
 	uint32_t *sequenceHeaderSize;
-	
-	uint8_t* data;
-	uint32_t len;
-
-	//Not mark
-	rtp.SetMark(false);
 
 	// Get SEI information
 	MP4GetTrackH264SeqPictHeaders(mp4, track, &sequenceHeader, &sequenceHeaderSize, &pictureHeader, &pictureHeaderSize);
-	
-	// Get data pointer
-	data = rtp.AdquireMediaData();
-	// Reset length
-	len = 0;
 
-	//Append stap-a header
-	data[len++] = 24;
-	
-	// Check we have sequence header
-	if (sequenceHeader)
-	{
-		uint32_t i = 0;
-		// Send sequence headers
-		while(sequenceHeader[i] && sequenceHeaderSize[i])
-		{
-			// Check if it can be handled in a single packeti
-			if (sequenceHeaderSize[i]+3<MTU)
-			{
-				// If there is not enought length
-				if (len+sequenceHeaderSize[i]+3>MTU)
-				{
-					// Set data length
-					rtp.SetMediaLength(len);
-					//Set seqnum
-					rtp.SetSeqNum(seqNum++);
-					rtp.Dump();
-					//Check listener
-					if (listener)
-						// Write frame
-						listener->onRTPPacket(rtp);
-					// Reset data
-					len = 0;
-					//Append stap-a header
-					data[len++] = 24;
-				}
-				//Set nal size
-				set2(data,len,sequenceHeaderSize[i]);
-				//Inc len
-				len += 2;
-				// Copy data
-				memcpy(data+len,sequenceHeader[i],sequenceHeaderSize[i]);	
-				// Increase pointer
-				len+=sequenceHeaderSize[i];
-			}
-			// Free memory
-			free(sequenceHeader[i]);
-			// Next header
-			i++;
-		}
-	}
+	//Start first STAP-A packet
+	h264Parameters.clear();
+	h264Parameters.push_back({24});
 
-	// Check we have picture header
-	if (pictureHeader)
+	//Append all headers
+	for (auto [headers,sizes] : {std::make_pair(sequenceHeader,sequenceHeaderSize),std::make_pair(pictureHeader,pictureHeaderSize)})
 	{
+		// Check we have headers
+		if (!headers)
+			continue;
+
 		uint32_t i = 0;
-		// Send picture headers
-		while(pictureHeader[i] && pictureHeaderSize[i])
+		// Add them
+		while(headers[i] && sizes[i])
 		{
-			// Check if it can be handled in a single packeti
-			if (pictureHeaderSize[i]+3<MTU)
+			// Check if it can be handled in a single packet
+			if (sizes[i]+3<MTU)
 			{
 				// If there is not enought length
-				if (len+pictureHeaderSize[i]+3>MTU)
-				{
-					// Set data length
-					rtp.SetMediaLength(len);
-					//Set seqnum
-					rtp.SetSeqNum(seqNum++);
-					rtp.Dump();
-					//Check listener
-					if (listener)
-						// Write frame
-						listener->onRTPPacket(rtp);
-					// Reset data
-					len = 0;
-					//Append stap-a header
-					data[len++] = 24;
-				}
+				if (h264Parameters.back().size()+sizes[i]+3>MTU)
+					// Start new STAP-A packet
+					h264Parameters.push_back({24});
+				auto& packet = h264Parameters.back();
 				//Set nal size
-				set2(data,len,pictureHeaderSize[i]);
-				//Inc len
-				len += 2;
+				packet.push_back(sizes[i]>>8);
+				packet.push_back(sizes[i]);
 				// Copy data
-				memcpy(data+len,pictureHeader[i],pictureHeaderSize[i]);	
-				// Increase pointer
-				len+=pictureHeaderSize[i];
+				packet.insert(packet.end(),headers[i],headers[i]+sizes[i]);
 			}
 			// Free memory
-			free(pictureHeader[i]);
+			free(headers[i]);
 			// Next header
 			i++;
 		}
 	}
 
-	// If there is still data
-	if (len>1)
-	{
-		// Set data length
-		rtp.SetMediaLength(len);
-		//Set seqnum
-		rtp.SetSeqNum(seqNum++);
-		//Check listenerG44
-		if (listener)
-			// Write frame
-			listener->onRTPPacket(rtp);
-		// Reset data
-		len = 0;
-	}
+	//Remove last one if empty
+	if (h264Parameters.back().size()<=1)
+		h264Parameters.pop_back();
 
 	// Free data
 	if (pictureHeader)
@@ -542,215 +758,272 @@ int MP4RtpTrack::SendH264Parameters(Listener *listener)
 		free(sequenceHeaderSize);
 	if (pictureHeaderSize)
 		free(pictureHeaderSize);
-	
+
+	return 1;
+}
+
+int MP4RtpTrack::SendH264Parameters(Listener *listener)
+{
+	//Not mark
+	rtp.SetMark(false);
+
+	//Send each STAP-A packet
+	for (const auto& packet : h264Parameters)
+	{
+		// Copy data
+		memcpy(rtp.AdquireMediaData(),packet.data(),packet.size());
+		// Set data length
+		rtp.SetMediaLength(packet.size());
+		//Set seqnum
+		rtp.SetSeqNum(seqNum++);
+		//Check listener
+		if (listener)
+			// Write frame
+			listener->onRTPPacket(rtp);
+	}
+
 	return 1;
 }
 
 int MP4RtpTrack::Reset()
 {
 	Debug("-MP4RtpTrack::Reset()\n");
-	
+
 	sampleId	= 1;
-	numHintSamples	= 0;
-	packetIndex	= 0;
-	
+
 	//Reset ssrc on rtp
 	rtp.SetSSRC(hint);
-	
+
+	//Restart caching if needed
+	UpdateCache();
+
 	return 1;
 }
 
-QWORD MP4RtpTrack::Read(Listener *listener)
+bool MP4RtpTrack::Packetize(Packetization& packetization)
 {
-	int last = 0;
-	uint8_t* data;
-	bool isSyncSample;
+	unsigned short numHintSamples = 0;
 
-	// If it's first packet of a frame
-	if (!numHintSamples)
-	{
-		// Get number of rtp packets for this sample
-		if (!MP4ReadRtpHint(mp4, hint, sampleId, &numHintSamples))
-		{
-			//Print error
-			Error("Error reading hintt");
-			//Exit
-			return MP4_INVALID_TIMESTAMP;
-		}
+	// Get number of rtp packets for this sample
+	if (!MP4ReadRtpHint(mp4, hint, sampleId, &numHintSamples))
+		//Error
+		return Error("-MP4RtpTrack::Packetize() | Error reading hint [hint:%d,sampleId:%d]\n",hint,sampleId);
 
-		// Get number of samples for this sample
-		frameSamples = MP4GetSampleDuration(mp4, track, sampleId);
+	// Get size of sample
+	DWORD size = MP4GetSampleSize(mp4, track, sampleId);
 
-		// Get size of sample
-		frameSize = MP4GetSampleSize(mp4, track, sampleId);
-		// extend buffer for frame size
-		if (frame->GetMaxMediaLength() < frameSize)
-		{
-			frame->Alloc(frameSize);
-		}
+	//Append frame
+	Packetization::Frame frame = {};
+	frame.offset = packetization.data.size();
+	frame.packet = packetization.packets.size();
+
+	//Make room for it
+	packetization.data.resize(frame.offset+size);
+
+	//Get buffer
+	BYTE *data = packetization.data.data()+frame.offset;
+	DWORD dataLen = size;
+
+	// Read it
+	if (!MP4ReadSample(
+		mp4,				// MP4FileHandle hFile
+		track,				// MP4TrackId hintTrackId
+		sampleId,			// MP4SampleId sampleId,
+		(uint8_t **) &data,		// uint8_t** ppBytes
+		(uint32_t *) &dataLen,		// uint32_t* pNumBytes
+		NULL,				// MP4Timestamp* pStartTime
+		NULL,				// MP4Duration* pDuration
+		NULL,				// MP4Duration* pRenderingOffset
+		NULL				// bool* pIsSyncSample
+		))
+	{
+		//Rollback
+		packetization.data.resize(frame.offset);
+		//Error
+		return Error("-MP4RtpTrack::Packetize() | Error reading sample [track:%d,sampleId:%d]\n",track,sampleId);
+	}
 
-		// Get sample timestamp
-		frameTime = MP4GetSampleTime(mp4, track, sampleId);
-		//Convert to miliseconds
-		frameTime = MP4ConvertFromTrackTimestamp(mp4, track, frameTime, 1000);
+	//Set actual size
+	frame.size = dataLen;
+	packetization.data.resize(frame.offset+dataLen);
 
+	//Read all packets
+	for (unsigned short packetIndex=0; packetIndex<numHintSamples; ++packetIndex)
+	{
+		// Use rtp buffer as scratch
+		data = rtp.AdquireMediaData();
 		//Get max data lenght
-		BYTE *data = NULL;
-		DWORD dataLen = 0;
-		MP4Timestamp	startTime;
-		MP4Duration	duration;
-		MP4Duration	renderingOffset;
-
-		//Get values
-		data	= frame->GetData();
-		dataLen = frame->GetMaxMediaLength();
-		
+		dataLen = rtp.GetMaxMediaLength();
+
 		// Read next rtp packet
-		if (!MP4ReadSample(
-			mp4,				// MP4FileHandle hFile
-			track,				// MP4TrackId hintTrackId
-			sampleId,			// MP4SampleId sampleId,
-			(uint8_t **) &data,		// uint8_t** ppBytes
-			(uint32_t *) &dataLen,		// uint32_t* pNumBytes
-			&startTime,			// MP4Timestamp* pStartTime
-			&duration,			// MP4Duration* pDuration
-			&renderingOffset,		// MP4Duration* pRenderingOffset
-			&isSyncSample			// bool* pIsSyncSample
-			))
+		if (!MP4ReadRtpPacket(
+					mp4,				// MP4FileHandle hFile
+					hint,				// MP4TrackId hintTrackId
+					packetIndex,			// uint16_t packetIndex
+					(uint8_t **) &data,		// uint8_t** ppBytes
+					(uint32_t *) &dataLen,		// uint32_t* pNumBytes
+					0,				// uint32_t ssrc DEFAULT(0)
+					0,				// bool includeHeader DEFAULT(true)
+					1				// bool includePayload DEFAULT(true)
+		) || dataLen>rtp.GetMaxMediaLength())
 		{
-			Error("Error reading sample [track:%d,sampleId:%d]\n",track,sampleId);
-			//Last
-			return MP4_INVALID_TIMESTAMP;
+			//Rollback
+			packetization.data.resize(frame.offset);
+			packetization.packets.resize(frame.packet);
+			//Error
+			return Error("-MP4RtpTrack::Packetize() | Error reading packet [hint:%d,track:%d,packetIndex:%d,len:%u]\n",hint,track,packetIndex,dataLen);
 		}
-		
-		UltraDebug("Got frame [time:%d,start:%lu,duration:%lu,lenght:%d,offset:%lu,sinc:%d\n",frameTime,startTime,duration,dataLen,renderingOffset,isSyncSample);
-		
-		//Check type
-		if (media == MediaFrame::Video)
+
+		//Append it
+		packetization.packets.push_back({(DWORD)packetization.data.size(),dataLen,packetIndex+1==numHintSamples});
+		packetization.data.insert(packetization.data.end(),data,data+dataLen);
+	}
+
+	//Add frame
+	frame.numPackets = numHintSamples;
+	packetization.frames.push_back(frame);
+
+	return true;
+}
+
+QWORD MP4RtpTrack::Read(Listener *listener, size_t maxCacheSize)
+{
+	//Check if we are at the end
+	if (!sampleId || sampleId>samples.size())
+		return MP4_INVALID_TIMESTAMP;
+
+	//Get sample info
+	const Sample& sample = samples[sampleId-1];
+
+	Packetization* packetization;
+	DWORD index;
+
+	//If already cached
+	if (cache && sampleId<=cache->frames.size())
+	{
+		packetization = cache.get();
+		index = sampleId-1;
+	} else {
+		//Append to cache if it is being filled in order, or just read this one
+		if (cache && !cache->complete && cache->frames.size()==sampleId-1)
 		{
-			//Get video frame
-			VideoFrame *video = (VideoFrame*)frame;
-			//Set lenght
-			video->SetLength(dataLen);
-			//Set clock rate
-			video->SetClockRate(1000);
-			//Timestamp
-			video->SetTimestamp(startTime);
-			//Set intra
-			video->SetIntra(isSyncSample);
-			//Set video duration (informative)
-			video->SetDuration(duration);
+			packetization = cache.get();
 		} else {
-			//Get Audio frame
-			AudioFrame *audio = (AudioFrame*)frame;
-			//Set lenght
-			audio->SetLength(dataLen);
-			//Set clock rate
-			audio->SetClockRate(1000);
-			//Timestamp
-			audio->SetTimestamp(startTime);
-			//Set audio duration (informative)
-			audio->SetDuration(duration);
+			packetization = &current;
+			current.Clear();
 		}
-		
-		//Set rtp timestamp
-		rtp.SetExtTimestamp(startTime);
-		
-		//Set key frame marking
-		rtp.SetKeyFrame(MP4GetSampleSync(mp4,track,sampleId));
-		
-		// Check if it is H264 and it is a Sync frame
-		if (codec==VideoCodec::H264 && rtp.IsKeyFrame())
-			// Send SPS/PPS info
-			SendH264Parameters(listener);
-		
-		//Check listener
-		if (listener)
-			//Frame callback
-			listener->onMediaFrame(*frame);
+		//Read frame and packets
+		if (!Packetize(*packetization))
+			//Last
+			return MP4_INVALID_TIMESTAMP;
+		//It is the last one
+		index = packetization->frames.size()-1;
 	}
 
-	// if it's the last
-	if (packetIndex + 1 == numHintSamples)
-		//Set last mark
-		last = 1;
-	
-	// Set mark bit
-	rtp.SetMark(last);
+	const auto& cached = packetization->frames[index];
 
-	// Get data pointer
-	data = rtp.AdquireMediaData();
-	//Get max data lenght
-	DWORD dataLen = rtp.GetMaxMediaLength();
+	//Set frame data
+	frame->SetMedia(packetization->data.data()+cached.offset,cached.size);
 
-	// Read next rtp packet
-	if (!MP4ReadRtpPacket(
-				mp4,				// MP4FileHandle hFile
-				hint,				// MP4TrackId hintTrackId
-				packetIndex++,			// uint16_t packetIndex
-				(uint8_t **) &data,		// uint8_t** ppBytes
-				(uint32_t *) &dataLen,		// uint32_t* pNumBytes
-				0,				// uint32_t ssrc DEFAULT(0)
-				0,				// bool includeHeader DEFAULT(true)
-				1				// bool includePayload DEFAULT(true)
-	))
+	UltraDebug("Got frame [time:%llu,start:%llu,duration:%llu,lenght:%u,sinc:%d\n",sample.time,sample.timestamp,sample.duration,cached.size,sample.sync);
+
+	//Check type
+	if (media == MediaFrame::Video)
 	{
-		//Error
-		Error("Error reading packet [%d,%d,%d]\n", hint, track,packetIndex);
-		//Exit
-		return MP4_INVALID_TIMESTAMP;
+		//Get video frame
+		VideoFrame *video = (VideoFrame*)frame;
+		//Set clock rate
+		video->SetClockRate(1000);
+		//Timestamp
+		video->SetTimestamp(sample.timestamp);
+		//Set intra
+		video->SetIntra(sample.sync);
+		//Set video duration (informative)
+		video->SetDuration(sample.duration);
+	} else {
+		//Get Audio frame
+		AudioFrame *audio = (AudioFrame*)frame;
+		//Set clock rate
+		audio->SetClockRate(1000);
+		//Timestamp
+		audio->SetTimestamp(sample.timestamp);
+		//Set audio duration (informative)
+		audio->SetDuration(sample.duration);
 	}
-		
 
-	//Check
-	if (dataLen>rtp.GetMaxMediaLength())
+	//Set rtp timestamp
+	rtp.SetExtTimestamp(sample.timestamp);
+
+	//Set key frame marking
+	rtp.SetKeyFrame(sample.sync);
+
+	// Check if it is H264 and it is a Sync frame
+	if (codec==VideoCodec::H264 && rtp.IsKeyFrame())
+		// Send SPS/PPS info
+		SendH264Parameters(listener);
+
+	//Check listener
+	if (listener)
+		//Frame callback
+		listener->onMediaFrame(*frame);
+
+	//Send all rtp packets
+	for (DWORD i=cached.packet; i<cached.packet+cached.numPackets; ++i)
 	{
-		//Error
-		Error("RTP packet too big [%u,%u]\n",dataLen,rtp.GetMaxMediaLength());
-		//Exit
-		return MP4_INVALID_TIMESTAMP;
+		const auto& packet = packetization->packets[i];
+		// Copy payload
+		memcpy(rtp.AdquireMediaData(),packetization->data.data()+packet.offset,packet.size);
+		//Set media length
+		rtp.SetMediaLength(packet.size);
+		// Set mark bit
+		rtp.SetMark(packet.mark);
+		//Set seqnum
+		rtp.SetSeqNum(seqNum++);
+		// Write frame
+		if (listener)
+			listener->onRTPPacket(rtp);
 	}
-	
-	//Set media length
-	rtp.SetMediaLength(dataLen);
-	
-	//Set seqnum
-	rtp.SetSeqNum(seqNum++);
-
-	// Write frame
-	listener->onRTPPacket(rtp);
 
-	// Are we the last packet in a hint?
-	if (last)
+	//If we are filling the cache
+	if (packetization==cache.get() && !cache->complete)
 	{
-		// The first hint
-		packetIndex = 0;
-		// Go for next sample
-		sampleId++;
-		numHintSamples = 0;
-		//Return next frame time
-		return GetNextFrameTime();
+		//If it is too big
+		if (cache->data.size()>maxCacheSize)
+		{
+			Debug("-MP4RtpTrack::Read() | track too big, not caching it [hint:%d,size:%zu]\n",hint,cache->data.size());
+			//Don't cache it, not even on next loops
+			cache.reset();
+			cacheKey.clear();
+		//If all samples are cached
+		} else if (cache->frames.size()==samples.size()) {
+			Debug("-MP4RtpTrack::Read() | track cached [hint:%d,size:%zu,frames:%zu,packets:%zu]\n",hint,cache->data.size(),cache->frames.size(),cache->packets.size());
+			//Release unused memory and make it available to other streamers
+			cache->data.shrink_to_fit();
+			cache->packets.shrink_to_fit();
+			cache->frames.shrink_to_fit();
+			cache->complete = true;
+			std::lock_guard<std::mutex> lock(cachesMutex);
+			caches[cacheKey] = cache;
+		}
 	}
 
-	// This packet is this one
-	return frameTime;
+	// Go for next sample
+	sampleId++;
+
+	//Return next frame time
+	return GetNextFrameTime();
 }
 
-QWORD MP4RtpTrack::GetNextFrameTime()
+QWORD MP4RtpTrack::GetNextFrameTime() const
 {
-	QWORD ts = MP4GetSampleTime(mp4, hint, sampleId);
-	//Check it
-	if (ts==MP4_INVALID_TIMESTAMP)
-		//Return it
-		return ts;
-	//Convert to miliseconds
-	ts = MP4ConvertFromTrackTimestamp(mp4, hint, ts, 1000);
+	//Check we have it
+	if (!sampleId || sampleId>samples.size())
+		return MP4_INVALID_TIMESTAMP;
 
 	//Get next timestamp
-	return ts;
+	return samples[sampleId-1].time;
 }
 
-
 int MP4TextTrack::Reset()
 {
 	sampleId	= 1;
@@ -998,27 +1271,29 @@ AVCDescriptor* MP4Streamer::GetAVCDescriptor()
 }
 
 
-QWORD MP4RtpTrack::SearchNearestSyncFrame(QWORD time)
+MP4SampleId MP4RtpTrack::FindSample(QWORD time) const
 {
-	//Get time in track units
-	MP4Duration when = time*timeScale/1000;
-	//Get nearest sample
-	MP4SampleId sampleId = MP4GetSampleIdFromTime(mp4,hint,when,false);
+	//Get first sample after time
+	auto it = std::upper_bound(samples.begin(),samples.end(),time,[](QWORD time, const Sample& sample){ return time<sample.time; });
 	//Check
-	if (sampleId == MP4_INVALID_SAMPLE_ID)
+	if (it==samples.begin())
 		//Nothing
-		return MP4_INVALID_TIMESTAMP;
+		return MP4_INVALID_SAMPLE_ID;
+	//The one before it contains the time
+	return it - samples.begin();
+}
+
+QWORD MP4RtpTrack::SearchNearestSyncFrame(QWORD time) const
+{
+	//Get nearest sample
+	MP4SampleId sampleId = FindSample(time);
 	//Find nearest sync
-	while(sampleId>1)
+	while(sampleId>0)
 	{
 		//If it is a sync frame
-		if (MP4GetSampleSync(mp4,hint,sampleId)>0)
-		{
-			//Get sample time
-			when = MP4GetSampleTime(mp4,hint,sampleId);
-			//And convert it to timescale
-			return when*1000/timeScale;
-		}
+		if (samples[sampleId-1].sync)
+			//Return its time
+			return samples[sampleId-1].time;
 		//new one
 		sampleId--;
 	}
@@ -1030,48 +1305,36 @@ QWORD MP4RtpTrack::SeekNearestSyncFrame(QWORD time)
 {
 	//Reset us
 	Reset();
-	//Get time in track units
-	MP4Duration when = time*timeScale/1000;
 	//Get nearest sample
-	sampleId = MP4GetSampleIdFromTime(mp4,hint,when,false);
-	//Check
-	if (sampleId == MP4_INVALID_SAMPLE_ID)
-		//Nothing
-		return MP4_INVALID_TIMESTAMP;
+	sampleId = FindSample(time);
 	//Find nearest sync
-	while(sampleId>0)
-	{
-		//If it is a sync frame
-		if (MP4GetSampleSync(mp4,hint,sampleId)>0)
-		{
-			//Get sample time
-			when = MP4GetSampleTime(mp4,hint,sampleId);
-			//And convert it to timescale
-			return when*1000/timeScale;
-		}
+	while(sampleId>0 && !samples[sampleId-1].sync)
 		//new one
 		sampleId--;
-	}
-	//Nothing found go to init
-	return MP4_INVALID_TIMESTAMP;
+	//Cached frames may not be contiguous anymore
+	UpdateCache();
+	//Check
+	if (sampleId == MP4_INVALID_SAMPLE_ID)
+		//Nothing found go to init
+		return MP4_INVALID_TIMESTAMP;
+	//Return its time
+	return samples[sampleId-1].time;
 }
 
 QWORD MP4RtpTrack::Seek(QWORD time)
 {
 	//Reset us
 	Reset();
-	//Get time in track units
-	MP4Duration when = time*timeScale/1000;
 	//Get nearest sample
-	sampleId = MP4GetSampleIdFromTime(mp4,hint,when,false);
+	sampleId = FindSample(time);
+	//Cached frames may not be contiguous anymore
+	UpdateCache();
 	//Check
 	if (sampleId == MP4_INVALID_SAMPLE_ID)
 		//Nothing
 		return MP4_INVALID_TIMESTAMP;
 	//Get sample time
-	when = MP4GetSampleTime(mp4,hint,sampleId);
-	//And convert it to timescale
-	return when*1000/timeScale;
+	return samples[sampleId-1].time;
 }
 
 QWORD MP4TextTrack::Seek(QWORD time)
@@ -0,0 +1,712 @@
+#include "mpegts/demuxer.h"
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "log.h"
+#include "audio.h"
+#include "video.h"
+#include "mpegts/psi.h"
+#include "aac/aacconfig.h"
+#include "opus/opusconfig.h"
+#include "h264/H264Packetizer.h"
+#include "h265/H265Packetizer.h"
+
+namespace mpegts
+{
+
+//Initial capacity of the PES buffers
+static constexpr DWORD VideoPESCapacity = 256*1024;
+static constexpr DWORD AudioPESCapacity = 8*1024;
+
+//Samples of an AAC frame
+static constexpr DWORD AACFrameSamples = 1024;
+
+static DWORD GetOpusDuration(const BYTE* data, DWORD size)
+{
+	if (!size)
+		return 0;
+	//Get frame size from toc
+	auto [mode, bandwidth, frameSize, stereo, code] = OpusTOC::TOC(data[0]);
+	//Get number of frames from code number
+	switch (data[0] & 0x03)
+	{
+		case OpusTOC::One:
+			return frameSize;
+		case OpusTOC::Two:
+		case OpusTOC::Three:
+			return 2*frameSize;
+		default:
+			return size>1 ? (data[1] & 0x3F)*frameSize : 0;
+	}
+}
+
+Demuxer::Demuxer(MediaFrame::Listener* listener) :
+	listener(listener)
+{
+}
+
+Demuxer::~Demuxer()
+{
+}
+
+const BYTE* Demuxer::FindSyncByte(const BYTE* data, const BYTE* end)
+{
+#ifdef __AVX2__
+	//32 bytes at a time
+	const __m256i ymm = _mm256_set1_epi8(SyncByte);
+	for (;end-data>=32;data+=32)
+		if (DWORD mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)data),ymm)))
+			return data + __builtin_ctz(mask);
+#endif
+	//16 bytes at a time
+	const __m128i xmm = _mm_set1_epi8(SyncByte);
+	for (;end-data>=16;data+=16)
+		if (DWORD mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)data),xmm)))
+			return data + __builtin_ctz(mask);
+	//Remaining bytes
+	for (;data<end;++data)
+		if (*data==SyncByte)
+			return data;
+	//Not found
+	return end;
+}
+
+void Demuxer::Process(const BYTE* data, size_t size, QWORD now)
+{
+	const BYTE* end = data + size;
+
+	//Update stats
+	stats.bytes += size;
+
+	//If we have a packet split from previous chunk
+	if (partialSize)
+	{
+		//Complete it
+		DWORD len = std::min<size_t>(PacketSize-partialSize,size);
+		memcpy(partial.data()+partialSize,data,len);
+		partialSize += len;
+		data += len;
+		//If still not complete
+		if (partialSize<PacketSize)
+			//Wait for more
+			return;
+		//Process it
+		ProcessPacket(partial.data(),now);
+		//Done
+		partialSize = 0;
+	}
+
+	while (data<end)
+	{
+		//Process all packets in sync
+		while ((size_t)(end-data)>=PacketSize && data[0]==SyncByte)
+		{
+			ProcessPacket(data,now);
+			data += PacketSize;
+		}
+
+		//If all have been processed
+		if (data==end)
+			//Done
+			break;
+
+		//If in sync, it is a packet split with next chunk
+		if (data[0]==SyncByte)
+		{
+			//Store it
+			partialSize = end-data;
+			memcpy(partial.data(),data,partialSize);
+			//Done
+			break;
+		}
+
+		//Lost sync
+		stats.resyncs++;
+
+		//Find next sync byte that is followed by another sync byte on next packet
+		do {
+			data = FindSyncByte(data+1,end);
+		} while ((size_t)(end-data)>PacketSize && data[PacketSize]!=SyncByte);
+	}
+}
+
+void Demuxer::ProcessPacket(const BYTE* packet, QWORD now)
+{
+	//Update stats
+	stats.packets++;
+
+	//Header fields are read directly, as this is done for every packet
+	bool error		= packet[1] & 0x80;
+	bool start		= packet[1] & 0x40;
+	WORD pid		= get2(packet,1) & 0x1FFF;
+	BYTE control		= (packet[3] >> 4) & 0x03;
+	BYTE continuity		= packet[3] & 0x0F;
+
+	//Check transport error
+	if (error)
+	{
+		stats.errors++;
+		return;
+	}
+
+	//Skip null packets
+	if (pid==NullPID)
+		return;
+
+	const BYTE* payload	= packet + 4;
+	const BYTE* end		= packet + PacketSize;
+	bool discontinuity	= false;
+	bool randomAccess	= false;
+
+	//If it has adaptation field
+	if (control & AdaptationFieldOnly)
+	{
+		try {
+			BufferReader reader(payload,end-payload);
+			//Parse it
+			auto adaptationField = AdaptationField::Parse(reader);
+			//Get flags
+			discontinuity = adaptationField.discontinuityIndicator;
+			randomAccess = adaptationField.randomAccessIndicator;
+			//If it carries the clock of the program
+			if (adaptationField.pcr && pid==pcrPid)
+				OnPCR(*adaptationField.pcr,discontinuity,now);
+			//Payload is after it
+			payload += reader.Mark();
+		} catch (const std::exception& e) {
+			stats.errors++;
+			return;
+		}
+	}
+
+	//If it has no payload
+	if (!(control & PayloadOnly) || payload>=end)
+		//Done
+		return;
+
+	//Check tables
+	if (pid==psi::ProgramAssociation::PID)
+		return ProcessSection(pat,pid,start,payload,end-payload);
+	if (pid==pmtPid)
+		return ProcessSection(pmt,pid,start,payload,end-payload);
+
+	//Get stream
+	auto it = streams.find(pid);
+	//If not found
+	if (it==streams.end())
+		//Skip
+		return;
+
+	Stream& stream = it->second;
+
+	//Check continuity
+	if (stream.continuity!=-1 && !discontinuity)
+	{
+		//Duplicated packet
+		if (continuity==stream.continuity)
+			//Skip
+			return;
+		//If we have lost packets
+		if (continuity!=((stream.continuity+1) & 0x0F))
+		{
+			Debug("-Demuxer::ProcessPacket() | Continuity error [pid:%u,expected:%u,got:%u]\n",pid,(stream.continuity+1) & 0x0F,continuity);
+			stats.discontinuities++;
+			//Drop the PES being reassembled and wait for next one
+			stream.started = false;
+			stream.pes->SetSize(0);
+		}
+	}
+	//Store last
+	stream.continuity = continuity;
+
+	//If it is the start of a new PES
+	if (start)
+	{
+		//Previous one is complete
+		if (stream.started && stream.pes->GetSize())
+			OnPES(stream,now);
+		//Start new one
+		stream.started = true;
+		stream.randomAccess = randomAccess;
+		//Get length if set on PES header
+		stream.expected = end-payload>=6 && get2(payload,4) ? 6 + get2(payload,4) : 0;
+	}
+
+	//Wait for start of a PES
+	if (!stream.started)
+		return;
+
+	//Append payload to the PES
+	stream.pes->AppendData(payload,end-payload);
+
+	//If we have got all of a PES with known size
+	if (stream.expected && stream.pes->GetSize()>=stream.expected)
+	{
+		//Process it now
+		OnPES(stream,now);
+		//Wait for next
+		stream.started = false;
+	}
+}
+
+void Demuxer::ProcessSection(Section& section, WORD pid, bool start, const BYTE* payload, DWORD size)
+{
+	//If it is a new section
+	if (start)
+	{
+		//Start it
+		section.data.assign(payload,payload+size);
+		section.started = true;
+	} else if (section.started) {
+		//Append
+		section.data.insert(section.data.end(),payload,payload+size);
+	} else {
+		//Wait for start
+		return;
+	}
+
+	//Check we have the pointer field and the table header
+	if (section.data.empty() || section.data.size()<1u+section.data[0]+3)
+		return;
+
+	//Get table start
+	DWORD pointer = 1 + section.data[0];
+	//Get whole table length
+	DWORD length = 3 + (get2(section.data.data(),pointer+1) & 0x03FF);
+
+	//Check it is complete
+	if (section.data.size()<pointer+length)
+		return;
+
+	//Done with it
+	section.started = false;
+
+	//Check crc
+	if (psi::CRC32(section.data.data()+pointer,length))
+	{
+		stats.errors++;
+		Warning("-Demuxer::ProcessSection() | Wrong table crc [pid:%u]\n",pid);
+		return;
+	}
+
+	try {
+		BufferReader reader(section.data.data(),pointer+length);
+		//Parse it
+		if (pid==psi::ProgramAssociation::PID)
+			OnProgramAssociation(reader);
+		else
+			OnProgramMap(reader);
+	} catch (const std::exception& e) {
+		stats.errors++;
+		Warning("-Demuxer::ProcessSection() | Could not parse table [pid:%u,error:%s]\n",pid,e.what());
+	}
+}
+
+void Demuxer::OnProgramAssociation(BufferReader& reader)
+{
+	//Follow first program
+	for (const auto& program : psi::ProgramAssociation::ParsePayloadUnit(reader))
+	{
+		//Skip network pid
+		if (!program.programNum)
+			continue;
+		//If changed
+		if (program.pmtPid!=pmtPid)
+		{
+			Debug("-Demuxer::OnProgramAssociation() | New program [num:%u,pmt:%u]\n",program.programNum,program.pmtPid);
+			//Start with new one
+			pmtPid = program.pmtPid;
+			pmtVersion = -1;
+			pmt = {};
+		}
+		//Done
+		return;
+	}
+}
+
+void Demuxer::OnProgramMap(BufferReader& reader)
+{
+	for (const auto& table : psi::ParsePayloadUnit(reader))
+	{
+		//Get table data
+		auto syntax = std::get_if<psi::SyntaxData>(&table.data);
+		//Check it is current program map
+		if (table.tableId!=psi::ProgramMap::TABLE_ID || !syntax || !syntax->isCurrent)
+			continue;
+
+		//If not changed
+		if (syntax->versionNumber==pmtVersion)
+			//Nothing to do
+			return;
+
+		//Parse it
+		BufferReader data = syntax->data;
+		auto programMap = psi::ProgramMap::Parse(data);
+
+		Debug("-Demuxer::OnProgramMap() | New program map [version:%u,pcr:%u,streams:%u]\n",syntax->versionNumber,programMap.pcrPid,programMap.streams.size());
+
+		//Store version and clock pid
+		pmtVersion = syntax->versionNumber;
+		pcrPid = programMap.pcrPid;
+
+		std::unordered_map<WORD,Stream> current;
+		for (const auto& elementaryStream : programMap.streams)
+		{
+			//If we already had it
+			auto it = streams.find(elementaryStream.pid);
+			if (it!=streams.end() && it->second.streamType==elementaryStream.streamType)
+			{
+				//Keep it
+				current.emplace(elementaryStream.pid,std::move(it->second));
+				continue;
+			}
+
+			Stream stream;
+			stream.pid = elementaryStream.pid;
+			stream.streamType = elementaryStream.streamType;
+
+			//Check type
+			switch (elementaryStream.streamType)
+			{
+				case psi::ProgramMap::H264:
+					stream.media = MediaFrame::Video;
+					stream.codec = VideoCodec::H264;
+					stream.packetizer = std::make_unique<H264Packetizer>();
+					break;
+				case psi::ProgramMap::H265:
+					stream.media = MediaFrame::Video;
+					stream.codec = VideoCodec::H265;
+					stream.packetizer = std::make_unique<H265Packetizer>();
+					break;
+				case psi::ProgramMap::AAC:
+					stream.media = MediaFrame::Audio;
+					stream.codec = AudioCodec::AAC;
+					break;
+				case psi::ProgramMap::PrivateData:
+				{
+					//Check registration descriptor
+					BufferReader descriptors = elementaryStream.descriptor;
+					while (descriptors.GetLeft()>=2)
+					{
+						BYTE tag = descriptors.Get1();
+						BYTE len = descriptors.Get1();
+						if (descriptors.GetLeft()<len)
+							break;
+						BufferReader descriptor = descriptors.GetReader(len);
+						//If it is opus
+						if (tag==psi::ProgramMap::REGISTRATION_DESCRIPTOR && len>=4 && descriptor.Get4()==psi::ProgramMap::OPUS_FORMAT_IDENTIFIER)
+						{
+							stream.media = MediaFrame::Audio;
+							stream.codec = AudioCodec::OPUS;
+						}
+					}
+					break;
+				}
+			}
+
+			//If not supported
+			if (stream.media==MediaFrame::Unknown)
+			{
+				Debug("-Demuxer::OnProgramMap() | Skipping unsupported stream [pid:%u,type:0x%.2x]\n",elementaryStream.pid,elementaryStream.streamType);
+				continue;
+			}
+
+			Debug("-Demuxer::OnProgramMap() | New stream [pid:%u,type:0x%.2x,media:%s]\n",elementaryStream.pid,elementaryStream.streamType,MediaFrame::TypeToString(stream.media));
+
+			//Create PES buffer
+			stream.pes = std::make_shared<Buffer>(stream.media==MediaFrame::Video ? VideoPESCapacity : AudioPESCapacity);
+			//Add it
+			current.emplace(elementaryStream.pid,std::move(stream));
+		}
+
+		//Streams no longer in the program are dropped
+		streams = std::move(current);
+		//Done
+		return;
+	}
+}
+
+QWORD Demuxer::Unwrap(QWORD value, QWORD reference)
+{
+	//Get signed distance between them on 33 bits
+	int64_t diff = (value - reference) & TimestampMask;
+	if (diff>(int64_t)(TimestampMask>>1))
+		diff -= TimestampMask + 1;
+	//Apply it to reference
+	return reference + diff;
+}
+
+void Demuxer::OnPCR(QWORD pcr, bool discontinuity, QWORD now)
+{
+	//Extend it
+	QWORD extended = clockStarted ? Unwrap(pcr,lastPCR) : pcr;
+
+	//Restart clock on first PCR, on discontinuities or when there is a jump
+	if (!clockFromPCR || discontinuity || extended<lastPCR || extended-lastPCR>MaxPCRJump)
+	{
+		Debug("-Demuxer::OnPCR() | Starting program clock [pcr:%llu,time:%llu,discontinuity:%d]\n",extended,now,discontinuity);
+		clockBase = extended;
+		clockTime = now;
+		clockStarted = true;
+		clockFromPCR = true;
+	}
+
+	//Store last
+	lastPCR = extended;
+}
+
+QWORD Demuxer::GetTime(QWORD pts) const
+{
+	//Get time relative to the clock start on ms
+	int64_t diff = ((int64_t)pts - (int64_t)clockBase)/90;
+	//Map it to local time
+	return clockTime + diff;
+}
+
+void Demuxer::OnPES(Stream& stream, QWORD now)
+{
+	//Get PES
+	auto pes = stream.pes;
+
+	try {
+		BufferReader reader(pes->GetData(),pes->GetSize());
+		//Parse header
+		auto packet = pes::Packet::Parse(reader);
+
+		//Check it is valid and has PTS
+		if (packet.header.packetStartCodePrefix!=1 || !packet.headerExtension || !packet.headerExtension->pts)
+			throw std::runtime_error("Invalid PES header or no PTS");
+
+		//Get payload size, as there may be stuffing after a bounded PES
+		DWORD size = reader.GetLeft();
+		if (packet.header.packetLength)
+			size = std::min<DWORD>(size,6 + packet.header.packetLength - reader.Mark());
+
+		//If program clock is not started yet
+		if (!clockStarted)
+		{
+			//Start from PTS until we get a PCR
+			clockBase = lastPCR = *packet.headerExtension->pts;
+			clockTime = now;
+			clockStarted = true;
+		}
+
+		//Extend PTS and get time
+		QWORD pts = Unwrap(*packet.headerExtension->pts,lastPCR);
+		QWORD time = GetTime(pts);
+		//Store last
+		stream.pts = pts;
+
+		//Get DTS if frames are reordered
+		QWORD dts = packet.headerExtension->dts ? Unwrap(*packet.headerExtension->dts,lastPCR) : pts;
+
+		const BYTE* payload = reader.PeekData();
+
+		//Get frames from payload
+		if (stream.media==MediaFrame::Video)
+			OnVideo(stream,payload,size,pts,dts,time);
+		else if (stream.codec==AudioCodec::AAC)
+			OnAAC(stream,payload,size,pts,time);
+		else
+			OnOpus(stream,payload,size,pts,time);
+	} catch (const std::exception& e) {
+		stats.errors++;
+		Debug("-Demuxer::OnPES() | Could not process PES [pid:%u,error:%s]\n",stream.pid,e.what());
+	}
+
+	//Not used anymore
+	pes.reset();
+
+	//If frames are still referencing it
+	if (stream.pes.use_count()>1)
+		//Use a new one
+		stream.pes = std::make_shared<Buffer>(stream.pes->GetCapacity());
+	else
+		//Reuse it
+		stream.pes->SetSize(0);
+}
+
+void Demuxer::OnVideo(Stream& stream, const BYTE* data, DWORD size, QWORD pts, QWORD dts, QWORD time)
+{
+	BufferReader reader(data,size);
+
+	//Slice annex B and packetize nals
+	auto frame = stream.packetizer->ProcessAU(reader);
+
+	//If there was no slice
+	if (!frame || !frame->GetLength())
+		//Skip
+		return;
+
+	//Set timing
+	frame->SetClockRate(90000);
+	frame->SetTimestamp(pts);
+	frame->SetTime(time);
+	frame->SetSSRC(stream.pid);
+	//If it is reordered
+	if (dts!=pts)
+		static_cast<VideoFrame*>(frame.get())->SetDecodingTimestamp(dts);
+
+	//Update stats
+	stats.frames++;
+
+	//Deliver it
+	listener->onMediaFrame(stream.pid,*frame);
+}
+
+void Demuxer::OnAAC(Stream& stream, const BYTE* data, DWORD size, QWORD pts, QWORD time)
+{
+	BufferReader reader(data,size);
+
+	//Each PES may carry several ADTS frames
+	for (DWORD num=0; reader.GetLeft()>=7; ++num)
+	{
+		DWORD start = reader.Mark();
+		//Parse header
+		auto header = pes::adts::Header::Parse(reader);
+		DWORD headerSize = reader.Mark() - start;
+
+		//Check it is valid
+		if (header.syncWord!=0xFFF || header.samplingFrequency>=AACSpecificConfig::rates.size() || header.frameLength<headerSize || header.frameLength>size-start)
+		{
+			stats.errors++;
+			Debug("-Demuxer::OnAAC() | Invalid ADTS frame [pid:%u]\n",stream.pid);
+			return;
+		}
+
+		DWORD rate = AACSpecificConfig::rates[header.samplingFrequency];
+
+		auto frame = std::make_unique<AudioFrame>(AudioCodec::AAC);
+		//Set timing
+		frame->SetClockRate(rate);
+		frame->SetTimestamp(pts*rate/90000 + num*AACFrameSamples);
+		frame->SetTime(time + num*AACFrameSamples*1000/rate);
+		frame->SetDuration(AACFrameSamples);
+		frame->SetNumChannels(header.channelConfiguration);
+		frame->SetSSRC(stream.pid);
+
+		//Set AudioSpecificConfig
+		AACSpecificConfig aacSpecificConfig(rate,header.channelConfiguration);
+		BYTE config[5];
+		frame->SetCodecConfig(config,aacSpecificConfig.Serialize(config,sizeof(config)));
+
+		//Reference raw frame from the PES
+		frame->AppendMedia(stream.pes,data+start+headerSize,header.frameLength-headerSize);
+
+		//Move to next
+		reader.GoTo(start+header.frameLength);
+
+		//Update stats
+		stats.frames++;
+
+		//Deliver it
+		listener->onMediaFrame(stream.pid,*frame);
+	}
+}
+
+void Demuxer::OnOpus(Stream& stream, const BYTE* data, DWORD size, QWORD pts, QWORD time)
+{
+	BufferReader reader(data,size);
+
+	//Samples from the PES start
+	DWORD samples = 0;
+
+	//Each PES may carry several access units, each one with an opus control header
+	while (reader.GetLeft()>=2)
+	{
+		/*
+			control_header_prefix	11	0x3FF
+			start_trim_flag		1
+			end_trim_flag		1
+			control_extension_flag	1
+			reserved		2
+			au_size			8*N	sum of bytes until one is not 0xFF
+		*/
+		WORD prefix = reader.Get2();
+		//Check it
+		if ((prefix & 0xFFE0)!=0x7FE0)
+		{
+			stats.errors++;
+			Debug("-Demuxer::OnOpus() | Invalid opus control header [pid:%u]\n",stream.pid);
+			return;
+		}
+
+		//Get au size
+		DWORD auSize = 0;
+		BYTE byte = 0xFF;
+		while (byte==0xFF && reader.GetLeft())
+			auSize += (byte = reader.Get1());
+
+		//Skip trims
+		if (prefix & 0x10 && reader.GetLeft()>=2)
+			reader.Skip(2);
+		if (prefix & 0x08 && reader.GetLeft()>=2)
+			reader.Skip(2);
+		//Skip extension
+		if (prefix & 0x04 && reader.GetLeft())
+			reader.Skip(std::min<DWORD>(reader.Get1(),reader.GetLeft()));
+
+		//Check size
+		if (reader.GetLeft()<auSize)
+		{
+			stats.errors++;
+			Debug("-Demuxer::OnOpus() | Opus access unit too big [pid:%u,size:%u,left:%u]\n",stream.pid,auSize,reader.GetLeft());
+			return;
+		}
+
+		const BYTE* au = reader.GetData(auSize);
+		DWORD duration = GetOpusDuration(au,auSize);
+
+		auto frame = std::make_unique<AudioFrame>(AudioCodec::OPUS);
+		//Set timing
+		frame->SetClockRate(48000);
+		frame->SetTimestamp(pts*48000/90000 + samples);
+		frame->SetTime(time + samples/48);
+		frame->SetDuration(duration);
+		frame->SetSSRC(stream.pid);
+
+		//Reference it from the PES, sent as a single rtp packet
+		frame->AppendMedia(stream.pes,au,auSize);
+		frame->AddRtpPacket(0,auSize);
+
+		//Next one
+		samples += duration;
+
+		//Update stats
+		stats.frames++;
+
+		//Deliver it
+		listener->onMediaFrame(stream.pid,*frame);
+	}
+}
+
+void Demuxer::Flush()
+{
+	//Process all pending PES
+	for (auto& [pid,stream] : streams)
+	{
+		if (stream.started && stream.pes->GetSize())
+			OnPES(stream,getTimeMS());
+		stream.started = false;
+	}
+}
+
+void Demuxer::Reset()
+{
+	//Reset everything but stats
+	partialSize = 0;
+	pat = {};
+	pmt = {};
+	pmtPid = NullPID;
+	pcrPid = NullPID;
+	pmtVersion = -1;
+	streams.clear();
+	clockStarted = false;
+	clockFromPCR = false;
+	clockBase = 0;
+	clockTime = 0;
+	lastPCR = 0;
+}
+
+}; //namespace mpegts
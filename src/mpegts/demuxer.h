@@ -0,0 +1,132 @@
+#ifndef MPEGTS_DEMUXER_H_
+#define MPEGTS_DEMUXER_H_
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "config.h"
+#include "tools.h"
+#include "media.h"
+#include "codecs.h"
+#include "rtp/RTPPacketizer.h"
+#include "mpegts/mpegts.h"
+
+namespace mpegts
+{
+
+/**
+ * Transport stream demuxer.
+ *
+ * Data is processed in batches of whole 188 byte packets directly from the
+ * input, only packets split between calls are copied. When sync is lost the
+ * next sync byte is searched with SIMD and checked against the following
+ * packet before resuming.
+ *
+ * PAT and PMT of the first program are followed, and PES of H264, H265, AAC
+ * (ADTS) and Opus streams are reassembled into a single buffer per stream.
+ * Video access units are packetized as length prefixed NALs with their rtp
+ * packetization info, audio frames reference the PES buffer without copying.
+ *
+ * Frames are delivered to the listener with the PID as ssrc, timestamps are
+ * the PTS on the codec clock rate and times are the PTS mapped to the local
+ * clock through the PCR of the program. Video frames carrying a DTS other
+ * than the PTS have it set as their decoding timestamp.
+ */
+class Demuxer
+{
+public:
+	struct Stats
+	{
+		QWORD	packets		= 0;
+		QWORD	bytes		= 0;
+		QWORD	frames		= 0;
+		//Times sync was lost
+		QWORD	resyncs		= 0;
+		//Continuity counter errors
+		QWORD	discontinuities	= 0;
+		//Packets with transport errors, invalid PES or tables
+		QWORD	errors		= 0;
+	};
+
+	//Max jump of the PCR before resetting the clock, 10s on 90khz
+	static constexpr QWORD MaxPCRJump = 10*90000;
+public:
+	explicit Demuxer(MediaFrame::Listener* listener);
+	~Demuxer();
+
+	// Process a chunk of the stream, it can be split at any position.
+	// Now is the local time in ms used when the program clock is (re)started.
+	void Process(const BYTE* data, size_t size, QWORD now = getTimeMS());
+	// Emits pending PES, to be called at end of stream
+	void Flush();
+	void Reset();
+
+	const Stats& GetStats() const	{ return stats;	}
+
+	// Returns first sync byte in [data,end) or end if not found
+	static const BYTE* FindSyncByte(const BYTE* data, const BYTE* end);
+private:
+	struct Section
+	{
+		std::vector<BYTE> data;
+		bool started = false;
+	};
+
+	struct Stream
+	{
+		WORD pid		= 0;
+		BYTE streamType		= 0;
+		MediaFrame::Type media	= MediaFrame::Unknown;
+		DWORD codec		= 0;
+		//Last continuity counter, -1 if none yet
+		int continuity		= -1;
+		//PES being reassembled
+		Buffer::shared pes;
+		bool started		= false;
+		//Expected size of the PES when set on the header, 0 if unbounded
+		DWORD expected		= 0;
+		bool randomAccess	= false;
+		std::unique_ptr<RTPPacketizer> packetizer;
+		//Last PTS unwrapped
+		QWORD pts		= 0;
+	};
+
+	void ProcessPacket(const BYTE* packet, QWORD now);
+	void ProcessSection(Section& section, WORD pid, bool start, const BYTE* payload, DWORD size);
+	void OnProgramAssociation(BufferReader& reader);
+	void OnProgramMap(BufferReader& reader);
+	void OnPCR(QWORD pcr, bool discontinuity, QWORD now);
+	void OnPES(Stream& stream, QWORD now);
+	void OnVideo(Stream& stream, const BYTE* data, DWORD size, QWORD pts, QWORD dts, QWORD time);
+	void OnAAC(Stream& stream, const BYTE* data, DWORD size, QWORD pts, QWORD time);
+	void OnOpus(Stream& stream, const BYTE* data, DWORD size, QWORD pts, QWORD time);
+	// Extends a 33 bit timestamp to the one closer to the reference
+	static QWORD Unwrap(QWORD value, QWORD reference);
+	QWORD GetTime(QWORD pts) const;
+private:
+	MediaFrame::Listener* listener;
+	Stats stats;
+
+	//Packet split between calls
+	std::array<BYTE,PacketSize> partial;
+	DWORD partialSize	= 0;
+
+	Section pat;
+	Section pmt;
+	WORD pmtPid		= NullPID;
+	WORD pcrPid		= NullPID;
+	int pmtVersion		= -1;
+	std::unordered_map<WORD,Stream> streams;
+
+	//Program clock, maps unwrapped PCR to local time
+	bool  clockStarted	= false;
+	bool  clockFromPCR	= false;
+	QWORD clockBase		= 0;
+	QWORD clockTime		= 0;
+	QWORD lastPCR		= 0;
+};
+
+}; //namespace mpegts
+
+#endif //MPEGTS_DEMUXER_H_
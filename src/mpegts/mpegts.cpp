@@ -89,11 +89,15 @@ AdaptationField AdaptationField::Parse(BufferReader& reader)
 	if (adaptationFieldLength + 1 > reader.GetLeft())
 		throw std::runtime_error("Not enought data to read mpegts adaptation field");
 
+	AdaptationField adaptationField = {};
+
+	//Single stuffing byte, no flags
+	if (!adaptationFieldLength)
+		return adaptationField;
+
 	//Get current position
 	uint32_t start = reader.Mark();
 
-	AdaptationField adaptationField = {};
-
 	//Get bit reader
 	BitReader bitreader(reader.GetData(1), 1);
 
@@ -106,6 +110,21 @@ AdaptationField AdaptationField::Parse(BufferReader& reader)
 	adaptationField.transportPrivateDataFlag		= bitreader.Get(1);
 	adaptationField.adaptationFieldExtensionFlag		= bitreader.Get(1);
 
+	//Read PCR
+	if (adaptationField.pcrFlag)
+	{
+		/*
+			PCR	48	Program clock reference, stored as 33 bits base, 6 bits reserved, 9 bits extension.
+		*/
+		if (adaptationFieldLength < 7)
+			throw std::runtime_error("Not enought data to read mpegts adaptation field PCR");
+
+		BitReader pcrreader(reader.GetData(6), 6);
+		//Get base
+		uint64_t pcr = pcrreader.Get(32);
+		adaptationField.pcr = pcr << 1 | pcrreader.Get(1);
+	}
+
 	//Go to the end of the adaptation field
 	reader.GoTo(start + adaptationFieldLength);
 
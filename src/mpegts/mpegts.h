@@ -7,6 +7,12 @@
 namespace mpegts
 {
 
+static constexpr size_t   PacketSize	= 188;
+static constexpr uint8_t  SyncByte	= 0x47;
+static constexpr uint16_t NullPID	= 0x1FFF;
+//PTS, DTS and PCR base are 33 bits on a 90khz clock
+static constexpr uint64_t TimestampMask	= 0x1FFFFFFFFull;
+
 enum AdaptationFieldControl
 {
 	Reserved = 0,
@@ -44,6 +50,8 @@ struct AdaptationField
 	bool transportPrivateDataFlag;
 	bool adaptationFieldExtensionFlag;
 
+	//Program clock reference base on 90khz, extension is ignored
+	std::optional<uint64_t> pcr = {};
 };
 
 struct Packet
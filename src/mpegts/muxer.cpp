@@ -0,0 +1,704 @@
+#include "mpegts/muxer.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "log.h"
+#include "tools.h"
+#include "audio.h"
+#include "video.h"
+#include "mpegts/psi.h"
+#include "aac/aacconfig.h"
+
+namespace mpegts
+{
+
+//Access unit delimiters with start code
+static const BYTE H264AUD[] = {0x00,0x00,0x00,0x01,0x09,0xF0};
+static const BYTE H265AUD[] = {0x00,0x00,0x00,0x01,0x46,0x01,0x50};
+static const BYTE StartCode[] = {0x00,0x00,0x00,0x01};
+
+//Stream ids of the PES
+static constexpr BYTE VideoStreamId = 0xE0;
+static constexpr BYTE AudioStreamId = 0xC0;
+static constexpr BYTE PrivateStream1Id = 0xBD;
+
+static void SetTimestamp(BYTE* data, BYTE prefix, QWORD ts)
+{
+	/*
+		prefix		4
+		ts[32..30]	3
+		marker		1
+		ts[29..15]	15
+		marker		1
+		ts[14..0]	15
+		marker		1
+	*/
+	data[0] = prefix << 4 | ((ts >> 29) & 0x0E) | 0x01;
+	data[1] = ts >> 22;
+	data[2] = ((ts >> 14) & 0xFE) | 0x01;
+	data[3] = ts >> 7;
+	data[4] = ((ts << 1) & 0xFE) | 0x01;
+}
+
+Muxer::Muxer(Output* output) :
+	Muxer(output,Options())
+{
+}
+
+Muxer::Muxer(Output* output, const Options& options) :
+	output(output),
+	options(options)
+{
+	//At least one packet per batch
+	if (!this->options.batchPackets)
+		this->options.batchPackets = 1;
+	//Allocate batch
+	batch.resize(this->options.batchPackets*PacketSize);
+}
+
+Muxer::~Muxer()
+{
+	//Write pending packets
+	Flush();
+}
+
+WORD Muxer::AddStream(MediaFrame::Type media, DWORD codec)
+{
+	//Check not started
+	if (started)
+		return Error("-Muxer::AddStream() | Streams must be added before first frame\n");
+
+	Stream stream;
+	stream.pid = FirstStreamPID + streams.size();
+	stream.media = media;
+	stream.codec = codec;
+
+	//Check codec
+	if (media==MediaFrame::Video && codec==VideoCodec::H264)
+	{
+		stream.streamType = psi::ProgramMap::H264;
+		stream.streamId = VideoStreamId;
+	} else if (media==MediaFrame::Video && codec==VideoCodec::H265) {
+		stream.streamType = psi::ProgramMap::H265;
+		stream.streamId = VideoStreamId;
+	} else if (media==MediaFrame::Audio && codec==AudioCodec::AAC) {
+		stream.streamType = psi::ProgramMap::AAC;
+		stream.streamId = AudioStreamId;
+	} else if (media==MediaFrame::Audio && codec==AudioCodec::OPUS) {
+		stream.streamType = psi::ProgramMap::PrivateData;
+		stream.streamId = PrivateStream1Id;
+	} else {
+		return Error("-Muxer::AddStream() | Codec not supported [media:%s,codec:%u]\n",MediaFrame::TypeToString(media),codec);
+	}
+
+	//Clock goes on first video, or first stream if there is none
+	if (pcrPid==NullPID || (media==MediaFrame::Video && GetStream(pcrPid)->media!=MediaFrame::Video))
+		pcrPid = stream.pid;
+
+	Debug("-Muxer::AddStream() | Added stream [pid:%u,media:%s,type:0x%.2x]\n",stream.pid,MediaFrame::TypeToString(media),stream.streamType);
+
+	//Add it
+	streams.push_back(std::move(stream));
+
+	return streams.back().pid;
+}
+
+Muxer::Stream* Muxer::GetStream(WORD pid)
+{
+	for (auto& stream : streams)
+		if (stream.pid==pid)
+			return &stream;
+	return nullptr;
+}
+
+bool Muxer::Mux(const MediaFrame& frame)
+{
+	//Get first stream of same media
+	for (const auto& stream : streams)
+		if (stream.media==frame.GetType())
+			return Mux(stream.pid,frame);
+	//Not found
+	stats.dropped++;
+	return false;
+}
+
+QWORD Muxer::GetPTS(Stream& stream, const MediaFrame& frame)
+{
+	//If it is the first frame of the stream
+	if (!stream.started)
+	{
+		//If it is the first of all
+		if (!started)
+		{
+			//Align all streams to it
+			started = true;
+			firstTime = frame.GetTime();
+		}
+		//Start stream at its time relative to first one
+		stream.started = true;
+		stream.firstTimestamp = frame.GetTimestamp();
+		stream.firstPTS = std::max<int64_t>(0,(int64_t)InitialPTS + ((int64_t)frame.GetTime()-(int64_t)firstTime)*90);
+	}
+
+	//Get clock rate
+	QWORD rate = frame.GetClockRate() ? frame.GetClockRate() : 90000;
+
+	//Convert timestamp to 90khz
+	return stream.firstPTS + ((int64_t)frame.GetTimestamp()-(int64_t)stream.firstTimestamp)*90000/(int64_t)rate;
+}
+
+bool Muxer::Mux(WORD pid, const MediaFrame& frame)
+{
+	//Get stream
+	Stream* stream = GetStream(pid);
+
+	//Check it is valid
+	if (!stream || stream->media!=frame.GetType() || !frame.GetLength())
+	{
+		stats.dropped++;
+		return false;
+	}
+
+	//Get timestamp
+	QWORD pts = GetPTS(*stream,frame);
+	QWORD dts = pts;
+	bool intra = false;
+
+	//If it is video
+	if (frame.GetType()==MediaFrame::Video)
+	{
+		const VideoFrame& video = static_cast<const VideoFrame&>(frame);
+		//Get clock rate
+		int64_t rate = frame.GetClockRate() ? frame.GetClockRate() : 90000;
+		//Decode before presentation if reordered
+		dts = pts - ((int64_t)video.GetTimestamp()-(int64_t)video.GetDecodingTimestamp())*90000/rate;
+		intra = video.IsIntra();
+	}
+
+	//Send tables at start, on key frames and periodically
+	if (!tablesSent || intra || (pid==pcrPid && dts>=lastTables+options.tableInterval*90))
+	{
+		WriteTables();
+		lastTables = dts;
+	}
+
+	const BYTE* data = frame.GetData();
+	DWORD len = frame.GetLength();
+
+	//Payload is written from frame and scratch data without copying it in between
+	std::vector<Piece> pieces;
+	DWORD size = 0;
+	scratch.clear();
+
+	if (stream->codec==VideoCodec::H264 || stream->codec==VideoCodec::H265)
+	{
+		bool h264 = stream->codec==VideoCodec::H264;
+		bool hasParameterSets = false;
+
+		//Start with AUD
+		if (h264)
+			pieces.push_back({H264AUD,sizeof(H264AUD)});
+		else
+			pieces.push_back({H265AUD,sizeof(H265AUD)});
+		size += pieces.back().size;
+
+		//Convert length prefixed nals to annex B
+		for (DWORD pos=0; pos+4<len;)
+		{
+			DWORD nalSize = get4(data,pos);
+			pos += 4;
+			//Check size
+			if (!nalSize || nalSize>len-pos)
+				break;
+			//Get type
+			BYTE type = h264 ? data[pos] & 0x1F : (data[pos] >> 1) & 0x3F;
+			//Skip delimiters, check if there is a SPS
+			if (h264 ? type==0x09 : type==35)
+			{
+				pos += nalSize;
+				continue;
+			}
+			if (h264 ? type==0x07 : type==33)
+				hasParameterSets = true;
+			//Add it
+			pieces.push_back({StartCode,sizeof(StartCode)});
+			pieces.push_back({data+pos,nalSize});
+			size += sizeof(StartCode) + nalSize;
+			//Next
+			pos += nalSize;
+		}
+
+		//Add parameter sets on key frames if they are not there
+		if (intra && !hasParameterSets && frame.HasCodecConfig())
+			AddParameterSets(*stream,frame,pieces,size);
+	} else if (stream->codec==AudioCodec::AAC) {
+		const AudioFrame& audio = static_cast<const AudioFrame&>(frame);
+		//If it is raw
+		if (len<2 || get2(data,0)>>4!=0xFFF)
+		{
+			//Get config from frame or from rate and channels
+			AACSpecificConfig config(frame.GetClockRate(),audio.GetNumChannels());
+			if (frame.HasCodecConfig())
+				config.Decode(frame.GetCodecConfigData(),frame.GetCodecConfigSize());
+			//Frame length with header
+			DWORD frameLength = len + 7;
+			//Write ADTS header without crc
+			scratch.resize(7);
+			BYTE* header = scratch.data();
+			header[0] = 0xFF;
+			header[1] = 0xF1;
+			header[2] = ((config.GetObjectType()-1) & 0x03) << 6 | (AACSpecificConfig::GetSampleRateIndex(config.GetRate()) & 0x0F) << 2 | (config.GetChannels() >> 2 & 0x01);
+			header[3] = (config.GetChannels() & 0x03) << 6 | (frameLength >> 11 & 0x03);
+			header[4] = frameLength >> 3;
+			header[5] = (frameLength & 0x07) << 5 | 0x1F;
+			header[6] = 0xFC;
+			pieces.push_back({header,7});
+			size += 7;
+		}
+		pieces.push_back({data,len});
+		size += len;
+	} else {
+		//Opus control header, prefix and size with 0xFF for each 255 bytes
+		scratch.resize(2 + len/255 + 1);
+		BYTE* header = scratch.data();
+		set2(header,0,0x7FE0);
+		DWORD pos = 2;
+		for (DWORD left=len; ; left-=255)
+		{
+			header[pos++] = std::min<DWORD>(left,255);
+			if (left<255)
+				break;
+		}
+		pieces.push_back({header,pos});
+		pieces.push_back({data,len});
+		size += pos + len;
+	}
+
+	//Write it
+	WritePES(*stream,pieces,size,pts,dts,intra || frame.GetType()==MediaFrame::Audio);
+
+	//Update stats
+	stats.frames++;
+
+	return true;
+}
+
+void Muxer::AddParameterSets(Stream& stream, const MediaFrame& frame, std::vector<Piece>& pieces, DWORD& size)
+{
+	//Parse config if changed
+	if (stream.config.size()!=frame.GetCodecConfigSize() || memcmp(stream.config.data(),frame.GetCodecConfigData(),frame.GetCodecConfigSize()))
+	{
+		stream.config.assign(frame.GetCodecConfigData(),frame.GetCodecConfigData()+frame.GetCodecConfigSize());
+		stream.avcDescriptor.reset();
+		stream.hevcDescriptor.reset();
+		if (stream.codec==VideoCodec::H264)
+		{
+			stream.avcDescriptor = std::make_unique<AVCDescriptor>();
+			if (!stream.avcDescriptor->Parse(stream.config.data(),stream.config.size()))
+				stream.avcDescriptor.reset();
+		} else {
+			stream.hevcDescriptor = std::make_unique<HEVCDescriptor>();
+			if (!stream.hevcDescriptor->Parse(stream.config.data(),stream.config.size()))
+				stream.hevcDescriptor.reset();
+		}
+	}
+
+	//Parameter sets go after the AUD
+	std::vector<Piece> parameterSets;
+	auto add = [&](const BYTE* data, DWORD len) {
+		parameterSets.push_back({StartCode,sizeof(StartCode)});
+		parameterSets.push_back({data,len});
+		size += sizeof(StartCode) + len;
+	};
+
+	if (stream.avcDescriptor)
+	{
+		for (BYTE i=0; i<stream.avcDescriptor->GetNumOfSequenceParameterSets(); ++i)
+			add(stream.avcDescriptor->GetSequenceParameterSet(i),stream.avcDescriptor->GetSequenceParameterSetSize(i));
+		for (BYTE i=0; i<stream.avcDescriptor->GetNumOfPictureParameterSets(); ++i)
+			add(stream.avcDescriptor->GetPictureParameterSet(i),stream.avcDescriptor->GetPictureParameterSetSize(i));
+	} else if (stream.hevcDescriptor) {
+		for (BYTE i=0; i<stream.hevcDescriptor->GetNumOfVideoParameterSets(); ++i)
+			add(stream.hevcDescriptor->GetVideoParameterSet(i),stream.hevcDescriptor->GetVideoParameterSetSize(i));
+		for (BYTE i=0; i<stream.hevcDescriptor->GetNumOfSequenceParameterSets(); ++i)
+			add(stream.hevcDescriptor->GetSequenceParameterSet(i),stream.hevcDescriptor->GetSequenceParameterSetSize(i));
+		for (BYTE i=0; i<stream.hevcDescriptor->GetNumOfPictureParameterSets(); ++i)
+			add(stream.hevcDescriptor->GetPictureParameterSet(i),stream.hevcDescriptor->GetPictureParameterSetSize(i));
+	}
+
+	pieces.insert(pieces.begin()+1,parameterSets.begin(),parameterSets.end());
+}
+
+BYTE* Muxer::NextPacket()
+{
+	//If batch is full
+	if (batchSize==batch.size())
+		//Send it
+		Flush();
+	//Get next one
+	BYTE* packet = batch.data() + batchSize;
+	batchSize += PacketSize;
+	//Update stats
+	stats.packets++;
+	stats.bytes += PacketSize;
+	return packet;
+}
+
+void Muxer::Flush()
+{
+	//If we have packets
+	if (batchSize && output)
+		//Send them
+		output->onTransportPackets(batch.data(),batchSize);
+	batchSize = 0;
+}
+
+void Muxer::WriteSection(WORD pid, BYTE& continuity, const std::vector<BYTE>& section)
+{
+	//Tables are small, always on a single packet
+	BYTE* packet = NextPacket();
+
+	//Header with payload start and payload only
+	packet[0] = SyncByte;
+	set2(packet,1,0x4000 | pid);
+	packet[3] = 0x10 | (continuity++ & 0x0F);
+	//No pointer
+	packet[4] = 0;
+	//Table
+	memcpy(packet+5,section.data(),section.size());
+	//Stuffing
+	memset(packet+5+section.size(),0xFF,PacketSize-5-section.size());
+}
+
+void Muxer::WriteTables()
+{
+	std::vector<BYTE> section;
+
+	auto start = [&](BYTE tableId, WORD tableIdExtension) {
+		section.clear();
+		//Table id, syntax section, length filled later
+		section.push_back(tableId);
+		section.push_back(0xB0);
+		section.push_back(0x00);
+		//Syntax section, version 0, current, single section
+		section.push_back(tableIdExtension >> 8);
+		section.push_back(tableIdExtension);
+		section.push_back(0xC1);
+		section.push_back(0x00);
+		section.push_back(0x00);
+	};
+	auto end = [&]() {
+		//Set length including crc
+		WORD length = section.size() - 3 + 4;
+		section[1] |= length >> 8;
+		section[2] = length;
+		//Append crc
+		DWORD crc = psi::CRC32(section.data(),section.size());
+		section.push_back(crc >> 24);
+		section.push_back(crc >> 16);
+		section.push_back(crc >> 8);
+		section.push_back(crc);
+	};
+
+	//PAT with single program
+	start(psi::ProgramAssociation::TABLE_ID,1);
+	section.push_back(ProgramNumber >> 8);
+	section.push_back(ProgramNumber & 0xFF);
+	section.push_back(0xE0 | PMTPID >> 8);
+	section.push_back(PMTPID & 0xFF);
+	end();
+	WriteSection(psi::ProgramAssociation::PID,patContinuity,section);
+
+	//PMT
+	start(psi::ProgramMap::TABLE_ID,ProgramNumber);
+	section.push_back(0xE0 | pcrPid >> 8);
+	section.push_back(pcrPid);
+	//No program info
+	section.push_back(0xF0);
+	section.push_back(0x00);
+	for (const auto& stream : streams)
+	{
+		section.push_back(stream.streamType);
+		section.push_back(0xE0 | stream.pid >> 8);
+		section.push_back(stream.pid);
+		//Opus needs registration and channel config descriptors
+		if (stream.codec==AudioCodec::OPUS && stream.media==MediaFrame::Audio)
+		{
+			section.push_back(0xF0);
+			section.push_back(10);
+			section.push_back(psi::ProgramMap::REGISTRATION_DESCRIPTOR);
+			section.push_back(4);
+			for (int i=3; i>=0; --i)
+				section.push_back(psi::ProgramMap::OPUS_FORMAT_IDENTIFIER >> (i*8));
+			//DVB extension descriptor with opus channel config, stereo
+			section.push_back(0x7F);
+			section.push_back(2);
+			section.push_back(0x80);
+			section.push_back(2);
+		} else {
+			section.push_back(0xF0);
+			section.push_back(0x00);
+		}
+	}
+	end();
+	WriteSection(PMTPID,pmtContinuity,section);
+
+	tablesSent = true;
+}
+
+void Muxer::WritePES(Stream& stream, const std::vector<Piece>& pieces, DWORD size, QWORD pts, QWORD dts, bool randomAccess)
+{
+	//Check if clock has to be sent, it must not be ahead of decoding
+	std::optional<QWORD> pcr;
+	if (stream.pid==pcrPid)
+	{
+		QWORD clock = dts>options.delay*90 ? dts - options.delay*90 : 0;
+		if (!pcrSent || clock>=lastPCR+options.pcrInterval*90)
+		{
+			pcr = clock;
+			pcrSent = true;
+			lastPCR = clock;
+		}
+	}
+
+	//PES header with PTS, and DTS only if it is different
+	BYTE header[19];
+	bool reordered = dts!=pts;
+	DWORD headerSize = reordered ? 19 : 14;
+	DWORD length = headerSize - 6 + size;
+	set3(header,0,0x000001);
+	header[3] = stream.streamId;
+	//Length can be unbounded only for video
+	set2(header,4,length<=0xFFFF ? length : 0);
+	//Marker bits and data alignment
+	header[6] = 0x84;
+	if (reordered)
+	{
+		//PTS and DTS
+		header[7] = 0xC0;
+		header[8] = 10;
+		SetTimestamp(header+9,0x03,pts & TimestampMask);
+		SetTimestamp(header+14,0x01,dts & TimestampMask);
+	} else {
+		//Only PTS
+		header[7] = 0x80;
+		header[8] = 5;
+		SetTimestamp(header+9,0x02,pts & TimestampMask);
+	}
+
+	//Pieces to write
+	DWORD left = headerSize + size;
+	const BYTE* data = header;
+	DWORD dataLeft = headerSize;
+	auto piece = pieces.begin();
+
+	bool first = true;
+	while (left)
+	{
+		BYTE* packet = NextPacket();
+
+		//Get adaptation field size needed for flags and clock
+		DWORD adaptationField = 0;
+		if (first && pcr)
+			adaptationField = 8;
+		else if (first && randomAccess)
+			adaptationField = 2;
+
+		//Get payload size, stuff the rest with the adaptation field
+		DWORD payload = std::min<DWORD>(left,PacketSize-4-adaptationField);
+		adaptationField = PacketSize-4-payload;
+
+		//Header
+		packet[0] = SyncByte;
+		set2(packet,1,(first ? 0x4000 : 0) | stream.pid);
+		packet[3] = (adaptationField ? 0x30 : 0x10) | (stream.continuity++ & 0x0F);
+
+		//Adaptation field
+		if (adaptationField)
+		{
+			BYTE* field = packet + 4;
+			//Length after it
+			field[0] = adaptationField - 1;
+			if (adaptationField>1)
+			{
+				//Flags
+				field[1] = (first && randomAccess ? 0x40 : 0x00) | (first && pcr ? 0x10 : 0x00);
+				DWORD pos = 2;
+				if (first && pcr)
+				{
+					//PCR base, reserved bits and no extension
+					QWORD base = *pcr & TimestampMask;
+					field[2] = base >> 25;
+					field[3] = base >> 17;
+					field[4] = base >> 9;
+					field[5] = base >> 1;
+					field[6] = (base & 0x01) << 7 | 0x7E;
+					field[7] = 0x00;
+					pos = 8;
+				}
+				//Stuffing
+				memset(field+pos,0xFF,adaptationField-pos);
+			}
+		}
+
+		//Copy payload from pieces
+		BYTE* out = packet + 4 + adaptationField;
+		for (DWORD written=0; written<payload;)
+		{
+			//If current one is done
+			if (!dataLeft)
+			{
+				data = piece->data;
+				dataLeft = piece->size;
+				++piece;
+				continue;
+			}
+			DWORD len = std::min(dataLeft,payload-written);
+			memcpy(out+written,data,len);
+			data += len;
+			dataLeft -= len;
+			written += len;
+		}
+
+		left -= payload;
+		first = false;
+	}
+}
+
+FileOutput::~FileOutput()
+{
+	Close();
+}
+
+bool FileOutput::Open(const char* filename)
+{
+	//Close previous
+	Close();
+	//Open it
+	fd = ::open(filename,O_CREAT|O_WRONLY|O_TRUNC,S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	//Check
+	if (fd<0)
+	{
+		fd = FD_INVALID;
+		return Error("-FileOutput::Open() | Could not open file [name:%s,errno:%d]\n",filename,errno);
+	}
+	return true;
+}
+
+void FileOutput::Close()
+{
+	if (fd!=FD_INVALID)
+		::close(fd);
+	fd = FD_INVALID;
+}
+
+void FileOutput::onTransportPackets(const BYTE* data, DWORD size)
+{
+	//Write all of it
+	while (size && fd!=FD_INVALID)
+	{
+		ssize_t len = ::write(fd,data,size);
+		//Check error
+		if (len<0 && errno==EINTR)
+			continue;
+		if (len<=0)
+		{
+			Error("-FileOutput::onTransportPackets() | Error writing [errno:%d]\n",errno);
+			return;
+		}
+		data += len;
+		size -= len;
+	}
+}
+
+UDPOutput::~UDPOutput()
+{
+	Close();
+}
+
+bool UDPOutput::Open(const char* ip, WORD port)
+{
+	//Close previous
+	Close();
+
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	//Check ip
+	if (inet_pton(AF_INET,ip,&addr.sin_addr)!=1)
+		return Error("-UDPOutput::Open() | Invalid ip [ip:%s]\n",ip);
+
+	//Create socket
+	fd = ::socket(AF_INET,SOCK_DGRAM,0);
+	if (fd<0)
+	{
+		fd = FD_INVALID;
+		return Error("-UDPOutput::Open() | Could not create socket [errno:%d]\n",errno);
+	}
+
+	//Connect so we do not need to pass the address on each send
+	if (::connect(fd,(sockaddr*)&addr,sizeof(addr))<0)
+	{
+		Close();
+		return Error("-UDPOutput::Open() | Could not connect socket [ip:%s,port:%u,errno:%d]\n",ip,port,errno);
+	}
+
+	return true;
+}
+
+void UDPOutput::Close()
+{
+	if (fd!=FD_INVALID)
+		::close(fd);
+	fd = FD_INVALID;
+}
+
+void UDPOutput::onTransportPackets(const BYTE* data, DWORD size)
+{
+	if (fd==FD_INVALID)
+		return;
+#ifdef __APPLE__
+	//One datagram at a time
+	for (DWORD pos=0; pos<size; pos+=DatagramSize)
+		if (::send(fd,data+pos,std::min(size-pos,DatagramSize),0)<0)
+			dropped++;
+#else
+	static constexpr DWORD MaxMessages = 64;
+	mmsghdr messages[MaxMessages];
+	iovec iovs[MaxMessages];
+
+	//Send datagrams in batches with a single syscall
+	for (DWORD pos=0; pos<size;)
+	{
+		DWORD num = 0;
+		for (; num<MaxMessages && pos<size; ++num, pos+=DatagramSize)
+		{
+			iovs[num].iov_base = (void*)(data+pos);
+			iovs[num].iov_len = std::min(size-pos,DatagramSize);
+			messages[num] = {};
+			messages[num].msg_hdr.msg_iov = &iovs[num];
+			messages[num].msg_hdr.msg_iovlen = 1;
+		}
+		//It may send only some of them, so resend the rest
+		for (DWORD sent=0; sent<num;)
+		{
+			int len = sendmmsg(fd,messages+sent,num-sent,0);
+			//Check error
+			if (len<0 && errno==EINTR)
+				continue;
+			if (len<=0)
+			{
+				Debug("-UDPOutput::onTransportPackets() | Error sending [errno:%d,dropped:%u]\n",errno,num-sent);
+				//Drop the rest of the batch
+				dropped += num-sent;
+				break;
+			}
+			sent += len;
+		}
+	}
+#endif
+}
+
+}; //namespace mpegts
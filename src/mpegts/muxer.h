@@ -0,0 +1,181 @@
+#ifndef MPEGTS_MUXER_H_
+#define MPEGTS_MUXER_H_
+
+#include <memory>
+#include <vector>
+#include "config.h"
+#include "media.h"
+#include "codecs.h"
+#include "avcdescriptor.h"
+#include "h265/HEVCDescriptor.h"
+#include "mpegts/mpegts.h"
+
+namespace mpegts
+{
+
+/**
+ * Transport stream muxer of a single program.
+ *
+ * Packets are written directly on a batch buffer that is passed to the
+ * output when full, so the PES is never assembled on its own buffer. H264 and
+ * H265 frames are length prefixed NALs and are written as annex B with an
+ * AUD, adding the parameter sets from the codec config on key frames that do
+ * not carry them. Raw AAC frames are written as ADTS, and Opus with its
+ * control header.
+ *
+ * PTS are derived from frame timestamps on the stream clock rate, aligned
+ * between streams by the time of their first frame. DTS is written too for
+ * video frames with a different decoding timestamp. PCR is sent on the first
+ * video stream, or the first one if there is no video, options.delay ms
+ * behind the DTS. PAT and PMT are sent before each key frame and every
+ * options.tableInterval ms.
+ */
+class Muxer : public MediaFrame::Listener
+{
+public:
+	class Output
+	{
+	public:
+		virtual ~Output() = default;
+		// Called with a batch of whole transport packets
+		virtual void onTransportPackets(const BYTE* data, DWORD size) = 0;
+	};
+
+	struct Options
+	{
+		//Packets passed to the output at once, 7 fit on an UDP datagram
+		DWORD	batchPackets	= 7;
+		//Interval between PAT and PMT in ms
+		DWORD	tableInterval	= 100;
+		//Max interval between PCRs in ms
+		DWORD	pcrInterval	= 20;
+		//Delay of PTS over PCR in ms
+		DWORD	delay		= 100;
+	};
+
+	struct Stats
+	{
+		QWORD	packets		= 0;
+		QWORD	bytes		= 0;
+		QWORD	frames		= 0;
+		//Frames of unknown streams or without data
+		QWORD	dropped		= 0;
+	};
+
+	static constexpr WORD ProgramNumber	= 1;
+	static constexpr WORD PMTPID		= 0x1000;
+	static constexpr WORD FirstStreamPID	= 0x100;
+	//PTS of the first frame, so PCR does not start negative
+	static constexpr QWORD InitialPTS	= 90000;
+public:
+	explicit Muxer(Output* output);
+	Muxer(Output* output, const Options& options);
+	virtual ~Muxer();
+
+	// Returns pid of the new stream or 0 if codec is not supported,
+	// streams must be added before muxing the first frame
+	WORD AddStream(MediaFrame::Type media, DWORD codec);
+	// Muxes frame on the first stream of its media type
+	bool Mux(const MediaFrame& frame);
+	bool Mux(WORD pid, const MediaFrame& frame);
+	// Writes pending packets to the output
+	void Flush();
+
+	const Stats& GetStats() const	{ return stats;	}
+
+	//MediaFrame::Listener
+	virtual void onMediaFrame(const MediaFrame& frame) override			{ Mux(frame);	}
+	virtual void onMediaFrame(DWORD ssrc, const MediaFrame& frame) override	{ Mux(frame);	}
+private:
+	struct Stream
+	{
+		WORD pid		= 0;
+		MediaFrame::Type media	= MediaFrame::Unknown;
+		DWORD codec		= 0;
+		BYTE streamType		= 0;
+		BYTE streamId		= 0;
+		BYTE continuity		= 0;
+		//Timestamp of first frame and its PTS
+		bool  started		= false;
+		QWORD firstTimestamp	= 0;
+		QWORD firstPTS		= 0;
+		//Last codec config parsed
+		std::vector<BYTE> config;
+		std::unique_ptr<AVCDescriptor>	avcDescriptor;
+		std::unique_ptr<HEVCDescriptor> hevcDescriptor;
+	};
+
+	//Part of the PES payload
+	struct Piece
+	{
+		const BYTE* data;
+		DWORD size;
+	};
+
+	Stream* GetStream(WORD pid);
+	QWORD GetPTS(Stream& stream, const MediaFrame& frame);
+	void WriteTables();
+	void WriteSection(WORD pid, BYTE& continuity, const std::vector<BYTE>& section);
+	void WritePES(Stream& stream, const std::vector<Piece>& pieces, DWORD size, QWORD pts, QWORD dts, bool randomAccess);
+	void AddParameterSets(Stream& stream, const MediaFrame& frame, std::vector<Piece>& pieces, DWORD& size);
+	BYTE* NextPacket();
+private:
+	Output* output;
+	Options options;
+	Stats stats;
+
+	std::vector<Stream> streams;
+	WORD pcrPid		= NullPID;
+
+	//Batch of packets being written
+	std::vector<BYTE> batch;
+	DWORD batchSize		= 0;
+
+	bool  started		= false;
+	QWORD firstTime		= 0;
+	bool  pcrSent		= false;
+	QWORD lastPCR		= 0;
+	bool  tablesSent	= false;
+	QWORD lastTables	= 0;
+	BYTE  patContinuity	= 0;
+	BYTE  pmtContinuity	= 0;
+
+	//Scratch data for pieces not in the frame
+	std::vector<BYTE> scratch;
+};
+
+// Writes transport packets to a file
+class FileOutput : public Muxer::Output
+{
+public:
+	~FileOutput();
+	bool Open(const char* filename);
+	void Close();
+
+	virtual void onTransportPackets(const BYTE* data, DWORD size) override;
+private:
+	int fd = FD_INVALID;
+};
+
+// Sends transport packets over UDP, 7 per datagram
+class UDPOutput : public Muxer::Output
+{
+public:
+	static constexpr DWORD DatagramSize = 7*PacketSize;
+public:
+	~UDPOutput();
+	bool Open(const char* ip, WORD port);
+	void Close();
+
+	// Datagrams that could not be sent
+	QWORD GetDropped() const	{ return dropped;	}
+
+	virtual void onTransportPackets(const BYTE* data, DWORD size) override;
+private:
+	int fd = FD_INVALID;
+	QWORD dropped = 0;
+};
+
+}; //namespace mpegts
+
+#endif //MPEGTS_MUXER_H_
@@ -1,4 +1,5 @@
 #include "mpegts/psi.h"
+#include <array>
 #include "log.h"
 #include "bitstream.h"
 namespace mpegts
@@ -110,6 +111,27 @@ std::vector<Table> ParsePayloadUnit(BufferReader& reader)
 	return tables;
 }
 
+uint32_t CRC32(const uint8_t* data, size_t size)
+{
+	//Table for the 0x04C11DB7 polynomial, not reflected
+	static const auto table = [](){
+		std::array<uint32_t,256> table;
+		for (uint32_t i=0; i<256; ++i)
+		{
+			uint32_t crc = i << 24;
+			for (int j=0; j<8; ++j)
+				crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+			table[i] = crc;
+		}
+		return table;
+	}();
+
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i=0; i<size; ++i)
+		crc = (crc << 8) ^ table[(crc >> 24) ^ data[i]];
+	return crc;
+}
+
 // PAT
 
 ProgramAssociation ProgramAssociation::Parse(BufferReader& reader)
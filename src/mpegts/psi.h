@@ -46,6 +46,9 @@ struct Table
 /** parse a full PSI payload unit */
 std::vector<Table> ParsePayloadUnit(BufferReader& reader);
 
+/** MPEG-2 CRC32 of a table section, it is 0 when calculated over a section including its CRC */
+uint32_t CRC32(const uint8_t* data, size_t size);
+
 /** PSI table data for a Program Association Table */
 struct ProgramAssociation
 {
@@ -67,6 +70,19 @@ struct ProgramMap
 {
 	static const uint8_t TABLE_ID = 0x02;
 
+	/** stream types of the elementary streams */
+	enum StreamType : uint8_t
+	{
+		PrivateData	= 0x06,
+		AAC		= 0x0F,
+		H264		= 0x1B,
+		H265		= 0x24,
+	};
+
+	/** descriptors of the elementary streams */
+	static constexpr uint8_t REGISTRATION_DESCRIPTOR = 0x05;
+	static constexpr uint32_t OPUS_FORMAT_IDENTIFIER = 0x4F707573; // 'Opus'
+
 	/** data for an Elementary Stream entry in a PMT */
 	struct ElementaryStream
 	{
@@ -265,6 +265,20 @@ int MultiConf::StartRecordingBroadcaster(const char* filename)
 	} else if (strncasecmp(ext,".mp4",4)==0) {
 		//MP4
 		recorder = new MP4Recorder();
+	} else if (strncasecmp(ext,".m3u8",5)==0) {
+		//CMAF segments and playlist on the same dir
+		FragmentedMP4Writer::Options options;
+		//Find last "/"
+		const char* slash = strrchr(filename,'/');
+		//Get dir
+		options.segmentDir = slash ? std::string(filename,slash-filename) : ".";
+		//Create MP4 recorder writing natively
+		MP4Recorder* mp4 = new MP4Recorder();
+		mp4->SetFragmented(options);
+		recorder = mp4;
+		//Playlist name inside the dir
+		if (slash)
+			filename = slash+1;
 	} else {
 		//Unlcok
 		broacasterLock.Unlock();
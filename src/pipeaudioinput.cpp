@@ -14,6 +14,7 @@ PipeAudioInput::PipeAudioInput()
 	recording = false;
 	canceled = false;
 	nativeRate = 8000;
+	recordRate = 0;
 }
 
 PipeAudioInput::~PipeAudioInput()
@@ -71,6 +72,24 @@ end:
 	return len;
 }
 
+int PipeAudioInput::TryRecBuffer(SWORD *buffer,DWORD size)
+{
+	int len = 0;
+
+	//Bloqueamos
+	pthread_mutex_lock(&mutex);
+
+	//Only if we have enought samples
+	if (recording && fifoBuffer.length()>=size)
+		//Get samples from queue
+		len = fifoBuffer.pop(buffer,size);
+
+	//Desbloqueamos
+	pthread_mutex_unlock(&mutex);
+
+	return len;
+}
+
 int PipeAudioInput::StartRecording(DWORD rate)
 {
 	Log("-PipeAudioInput start recording [rate:%d]\n",rate);
@@ -136,6 +155,48 @@ int PipeAudioInput::PutSamples(SWORD *buffer,DWORD size)
 		size = resampledSize;
 	}
 
+	//Queue them
+	Push(buffer,size);
+
+	//Desbloqueamos
+	pthread_mutex_unlock(&mutex);
+
+	//Salimos
+	return true;
+
+}
+
+int PipeAudioInput::PutSamples(const SWORD *buffer,DWORD size,DWORD rate)
+{
+	//If they are at the native rate
+	if (rate==nativeRate)
+		//Transrate them as usual
+		return PutSamples((SWORD*)buffer,size);
+
+	//Block
+	pthread_mutex_lock(&mutex);
+
+	//Check it is the recording rate, as it could have changed meanwhile
+	if (!recording || rate!=recordRate)
+	{
+		//Desbloqueamos
+		pthread_mutex_unlock(&mutex);
+		//Not done
+		return false;
+	}
+
+	//Queue them
+	Push(buffer,size);
+
+	//Desbloqueamos
+	pthread_mutex_unlock(&mutex);
+
+	//Salimos
+	return true;
+}
+
+void PipeAudioInput::Push(const SWORD *buffer,DWORD size)
+{
 	//Si estamos reproduciendo
 	if (recording)
 	{
@@ -150,13 +211,6 @@ int PipeAudioInput::PutSamples(SWORD *buffer,DWORD size)
 		//Se�alamos
 		pthread_cond_signal(&cond);
 	}
-
-	//Desbloqueamos
-	pthread_mutex_unlock(&mutex);
-
-	//Salimos
-	return true;
-
 }
 
 int PipeAudioInput::Init(DWORD rate)
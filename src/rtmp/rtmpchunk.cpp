@@ -139,7 +139,6 @@ RTMPChunkOutputStream::RTMPChunkOutputStream(DWORD chunkStreamId) : RTMPChunkStr
 {
 	//Empty message
 	message = NULL;
-	msgBuffer = NULL;
 	//Store own id
 	this->chunkStreamId = chunkStreamId;
 	//Init mutex
@@ -156,10 +155,7 @@ RTMPChunkOutputStream::~RTMPChunkOutputStream()
 		delete(*it);
 
 	if (message)
-	{
-		delete(msgBuffer);
 		delete(message);
-	}
 	//Unlock
 	pthread_mutex_unlock(&mutex);
 	//Destroy mutex
@@ -179,6 +175,24 @@ void RTMPChunkOutputStream::SendMessage(RTMPMessage *msg)
 }
 
 DWORD RTMPChunkOutputStream::GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSize)
+{
+	RTMPChunk chunk;
+	//Get next chunk
+	if (!GetNextChunk(chunk,maxChunkSize))
+		//No more data to send here
+		return 0;
+	//Check size
+	if (chunk.GetSize()>size)
+		throw std::runtime_error("Not enought size for chunk");
+	//Copy header
+	memcpy(data,chunk.header,chunk.headerLen);
+	//Copy payload
+	memcpy(data+chunk.headerLen,chunk.payload,chunk.payloadLen);
+	//Return copied data
+	return chunk.GetSize();
+}
+
+bool RTMPChunkOutputStream::GetNextChunk(RTMPChunk& chunk,DWORD maxChunkSize)
 {
 	//lock now
 	pthread_mutex_lock(&mutex);
@@ -202,7 +216,7 @@ DWORD RTMPChunkOutputStream::GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSi
 			//Unlock
 			pthread_mutex_unlock(&mutex);
 			//No more data to send here
-			return 0;
+			return false;
 		}
 		//Get the next message to send
 		message = messages.front();
@@ -217,10 +231,17 @@ DWORD RTMPChunkOutputStream::GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSi
 		//Start sending 
 		pos = 0;
 
-		//Allocate data for serialized message
-		msgBuffer = (BYTE*)malloc(msgLength);
-		//Serialize it
-		message->Serialize(msgBuffer,msgLength);
+		//If it was already serialized and shared with other connections
+		if (message->GetSerialized())
+		{
+			//Reference it, only the chunk headers are created for this connection
+			msgBuffer = message->GetSerialized();
+		} else {
+			//Allocate data for serialized message, it is shared with the chunks until they are sent
+			msgBuffer = std::shared_ptr<BYTE[]>(new BYTE[msgLength]);
+			//Serialize it
+			message->Serialize(msgBuffer.get(),msgLength);
+		}
 
 		//Select wich header
 		if (!msgStreamId || msgStreamId!=streamId || msgTimestamp<timestamp)
@@ -291,15 +312,15 @@ DWORD RTMPChunkOutputStream::GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSi
 	}
 
 	//Serialize header
-	DWORD headersLen = header.Serialize(data,size);
+	DWORD headersLen = header.Serialize(chunk.header,RTMPChunk::MaxHeaderSize);
 	//Check if we need chunk header
 	if (chunkHeader)
 		//Serialize chunk header
-		headersLen += chunkHeader->Serialize(data+headersLen,size-headersLen);
+		headersLen += chunkHeader->Serialize(chunk.header+headersLen,RTMPChunk::MaxHeaderSize-headersLen);
 	//Check if need to use extended timestamp
 	if (useExtTimestamp)
 		//Serialize extened header
-		headersLen += extts.Serialize(data+headersLen,size-headersLen);
+		headersLen += extts.Serialize(chunk.header+headersLen,RTMPChunk::MaxHeaderSize-headersLen);
 
 	//Size of the msg data of the chunk
 	DWORD payloadLen = maxChunkSize;
@@ -308,18 +329,19 @@ DWORD RTMPChunkOutputStream::GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSi
 		//Just copy until the oend of the object
 		payloadLen = length-pos;
 	
-	//Copy
-	memcpy(data+headersLen,msgBuffer+pos,payloadLen);
+	//Reference payload instead of copying it
+	chunk.headerLen = headersLen;
+	chunk.buffer = msgBuffer;
+	chunk.payload = msgBuffer.get()+pos;
+	chunk.payloadLen = payloadLen;
 
 	//Increase sent data from msg
 	pos += payloadLen;
 	//Check if we have finished with this message	
 	if (pos==length)
 	{
-		//Delete buffer
-		free(msgBuffer);
-		//Null
-		msgBuffer = NULL;
+		//Release buffer, chunk keeps its own reference
+		msgBuffer.reset();
 		//Delete message
 		delete(message);
 		//Next one
@@ -334,8 +356,8 @@ DWORD RTMPChunkOutputStream::GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSi
 	//Unlock
 	pthread_mutex_unlock(&mutex);
 
-	//Return copied data
-	return headersLen+payloadLen;	
+	//Got chunk
+	return true;
 }
 
 bool RTMPChunkOutputStream::HasData()
@@ -377,10 +399,8 @@ bool RTMPChunkOutputStream::ResetStream(DWORD id)
 	//If we have message of this stream
 	if (message && message->GetStreamId()==id)
 	{
-		//Delete buffer
-		free(msgBuffer);
-		//Null
-		msgBuffer = NULL;
+		//Release buffer
+		msgBuffer.reset();
 		//Delete message
 		delete(message);
 		//Next one
@@ -6,7 +6,7 @@
 #include <signal.h>
 #include <errno.h>
 #include <stdio.h>
-#include <thread>
+#include <string.h>
 #include "log.h"
 #include "assertions.h"
 #include "tools.h"
@@ -64,8 +64,10 @@ RTMPConnection::RTMPConnection(Listener *listener)
 RTMPConnection::~RTMPConnection()
 {
 	Log("-RTMPConnection::~RTMPConnection() [%p]\n",this);
-	//End just in case
-	End();
+	//If it was never registered on the reactor
+	if (running)
+		//Close socket
+		MCU_CLOSE(socket);
 	//For each chunk strean
 	for (RTMPChunkInputStreams::iterator it=chunkInputStreams.begin(); it!=chunkInputStreams.end(); ++it)
 		//Delete it
@@ -78,50 +80,72 @@ RTMPConnection::~RTMPConnection()
 	pthread_mutex_destroy(&mutex);
 }
 
-int RTMPConnection::Init(int fd)
+int RTMPConnection::Init(int fd,EpollReactor* reactor)
 {
-	Log(">RTMP Connection init [%d]\n",fd);
+	Log(">RTMPConnection::Init() [fd:%d,reactor:%p]\n",fd,reactor);
 
-	//Store socket
+	//Store socket and reactor
 	socket = fd;
+	this->reactor = reactor;
+
+	//Set non blocking, we only read or write when the reactor tells us
+	int fsflags = fcntl(socket,F_GETFL,0);
+	fsflags |= O_NONBLOCK;
+	(void)fcntl(socket,F_SETFL,fsflags);
+
+	//Set no delay option
+	int flag = 1;
+	(void)setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(int));
 
 	//I am inited
 	inited = true;
+	//We are running
+	running = true;
 
-	//Start
-	Start();
+	//Register on the reactor thread, hold reference to us until then
+	reactor->Async([self=shared_from_this()](auto now){
+		self->Start();
+	});
 
-	Log("<RTMP Connection init\n");
+	Log("<RTMPConnection::Init()\n");
 
 	return 1;
 }
 
 void RTMPConnection::Start()
 {
-	//We are running
-	running = true;
-	
-	//Start thread and run, hold reference to us to prevent being destroyed before Run ends.
-	thread = std::thread([=, self=shared_from_this()](){
-		//Block signals to avoid exiting on SIGUSR1
-		blocksignals();
-		//Run
-		Run();
+	Log("-RTMPConnection::Start() [connection:%p,socket:%d]\n",this,socket);
+
+	//Last time we had activity
+	lastActivity = reactor->GetNow();
+
+	//Wait for incoming data, the reactor holds a reference to us until disconnected
+	if (!reactor->AddHandler(socket,EPOLLIN,shared_from_this()))
+	{
+		//Close it
+		Disconnect();
+		//Done
+		return;
+	}
+
+	//Disconnect if there is no activity
+	timeoutTimer = reactor->CreateTimer(std::chrono::milliseconds(PoolTimeout),[self=weak_from_this()](auto now){
+		//If still alive
+		if (auto connection = self.lock())
+			//Check activity
+			connection->OnTimeout(now);
 	});
 }
 
 void RTMPConnection::Stop()
 {
+	//Lock so the socket is not closed meanwhile
+	std::lock_guard<std::mutex> lock(stopMutex);
+
 	//If got socket
-	if (running)
-	{
-		//Not running;
-		running = false;
-		//Close socket
+	if (running && socket!=FD_INVALID)
+		//Will cause the reactor to get a hangup event and disconnect us
 		shutdown(socket,SHUT_RDWR);
-		//Will cause poll to return
-		MCU_CLOSE(socket);
-	}
 }
 
 int RTMPConnection::End()
@@ -139,16 +163,12 @@ int RTMPConnection::End()
 	//Stop just in case
 	Stop();
 
-	//If thread is already running
-	if (thread.joinable())
+	//If we are on a different thread than the reactor
+	if (reactor && !reactor->IsReactorThread())
 	{
-		//If we are on different thread
-		if (std::this_thread::get_id()!=thread.get_id())
-			//Join it
-			thread.join();
-		else
-			//Detach as we are ending ourselves
-			thread.detach();
+		//Wait until the reactor has disconnected us
+		std::unique_lock<std::mutex> lock(stopMutex);
+		stopCond.wait(lock,[this](){ return disconnected; });
 	}
 
 	//Ended
@@ -157,80 +177,38 @@ int RTMPConnection::End()
 	return 1;
 }
 
-
-/***************************
- * Run
- * 	Server running thread
- ***************************/
-int RTMPConnection::Run()
+void RTMPConnection::OnEvent(uint32_t events)
 {
-	BYTE data[1400];
-	unsigned int size = 1400;
-
-	Log(">RTMPConnection::Run() [connection:%p]\n",this);
-
-	//Set values for polling
-	ufds[0].fd = socket;
-	ufds[0].events = POLLIN | POLLERR | POLLHUP;
-
-	//Set non blocking so we can get an error when we are closed by end
-	int fsflags = fcntl(socket,F_GETFL,0);
-	fsflags |= O_NONBLOCK;
-	(void)fcntl(socket,F_SETFL,fsflags);
-
-	//Set no delay option
-	int flag = 1;
-        (void)setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(int));
-	//Catch all IO errors
-	signal(SIGIO, EmptyCatch);
-	signal(SIGPIPE, EmptyCatch);
+	//Check if we can write more
+	if (events & EPOLLOUT)
+	{
+		//We can write again
+		writable = true;
+		//Write pending data
+		Flush();
+	}
 
-	//Run until ended
-	while(running)
+	if (events & EPOLLIN)
 	{
-		//Wait for events
-		int ret = poll(ufds,1,PoolTimeout);
-		
-		//If there was an error
-		if (ret<0)
-			//Check again
-			continue;
-		
-		//If timed out
-		if (ret==0)
-		{
-			//Log and exit run loop
-			Log("-RTMPConnection::Run() Timedout [connection:%p]\n",this);
-			break;
-		}
-			
-		if (ufds[0].revents & POLLOUT)
-		{
-			//Write data buffer
-			DWORD len = SerializeChunkData(data,size);
-			//Check length
-			if (len)
-			{
-				//Send it
-				WriteData(data,len);
-				//Increase sent bytes
-				outBytes += len;
-			}
-		}
+		BYTE data[16384];
+
+		//Read data from connection
+		int len = read(socket,data,sizeof(data));
 
-		if (ufds[0].revents & POLLIN)
+		//Check error
+		if (len<0 && (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR))
 		{
-			//Read data from connection
-			int len = read(socket,data,size);
-			if (len<=0)
-			{
-				//Error
-				Log("Readed [%d,%d]\n",len,errno);
-				//Exit
-				break;
-			}
+			//Nothing to read yet
+		} else if (len<=0) {
+			//Error
+			Log("-RTMPConnection::OnEvent() | Readed [len:%d,errno:%d]\n",len,errno);
+			//Exit
+			return Disconnect();
+		} else {
 			//Increase in bytes
 			inBytes += len;
+			//We had activity
+			lastActivity = reactor->GetNow();
 
 			try {
 				//Parse data
@@ -241,20 +219,73 @@ int RTMPConnection::Run()
 				//Dump it
 				Dump(data,len);
 				//Break on any error
-				break;
+				return Disconnect();
 			}
 		}
+	}
 
-		if ((ufds[0].revents & POLLHUP) || (ufds[0].revents & POLLERR))
-		{
-			//Error
-			Log("Pool error event [%d]\n",ufds[0].revents);
-			//Exit
-			break;
-		}
+	if ((events & EPOLLHUP) || (events & EPOLLERR))
+	{
+		//Error
+		Log("-RTMPConnection::OnEvent() | Pool error event [events:%d]\n",events);
+		//Exit
+		return Disconnect();
 	}
-	
-	Log("-RTMPConnection::Run() Disconnecting [connection:%p]\n",this);
+}
+
+void RTMPConnection::OnTimeout(std::chrono::milliseconds now)
+{
+	//Check we are still connected
+	if (!running)
+		return;
+
+	//Get time since last activity
+	auto elapsed = now - lastActivity;
+
+	//If timed out
+	if (elapsed>=std::chrono::milliseconds(PoolTimeout))
+	{
+		//Log and disconnect
+		Log("-RTMPConnection::OnTimeout() Timedout [connection:%p]\n",this);
+		return Disconnect();
+	}
+
+	//Check again when it would expire
+	timeoutTimer->Again(std::chrono::milliseconds(PoolTimeout)-elapsed);
+}
+
+void RTMPConnection::Disconnect()
+{
+	//Check not already disconnected
+	if (!running)
+		return;
+
+	Log("-RTMPConnection::Disconnect() Disconnecting [connection:%p]\n",this);
+
+	//Stop timer
+	if (timeoutTimer)
+		timeoutTimer->Cancel();
+	timeoutTimer.reset();
+
+	//Keep us alive until we are done
+	auto self = shared_from_this();
+
+	//Remove from reactor before closing the socket
+	reactor->RemoveHandler(socket);
+
+	{
+		//Lock so no one can shutdown it meanwhile
+		std::lock_guard<std::mutex> lock(stopMutex);
+		//Not running anymore
+		running = false;
+		//Close socket
+		MCU_CLOSE(socket);
+	}
+
+	//Drop pending data
+	pending.clear();
+	pendingOffset = 0;
+	pendingSize = 0;
 
 	//If got application
 	if (app)
@@ -282,110 +313,215 @@ int RTMPConnection::Run()
 	//Check listener
 	if (listener)
 		//launch event
-		listener->onDisconnect(shared_from_this());
-	
-	Log("<RTMPConnection::Run() Disconnected [connection:%p]\n",this);
+		listener->onDisconnect(self);
 
-	//Done
-	return 1;
+	{
+		//Signal End() we are done
+		std::lock_guard<std::mutex> lock(stopMutex);
+		disconnected = true;
+	}
+	stopCond.notify_all();
+	
+	Log("<RTMPConnection::Disconnect() Disconnected [connection:%p]\n",this);
 }
 
 void RTMPConnection::SignalWriteNeeded()
 {
-	//lock now
-	pthread_mutex_lock(&mutex);
+	//Check we are still connected
+	if (!running)
+		return;
+
+	//If there is already a write pending
+	if (writeSignaled.exchange(true))
+		//Data will be sent by it
+		return;
+
+	//Write on the reactor thread
+	reactor->Async([self=shared_from_this()](auto now){
+		//Allow new signals
+		self->writeSignaled = false;
+		//Write all that we can
+		self->Flush();
+	});
+}
+
+void RTMPConnection::WaitWritable(bool wait)
+{
+	//Check if changed
+	if (waitingWritable==wait)
+		return;
+
+	//Update events on reactor
+	reactor->ModifyHandler(socket,wait ? EPOLLIN | EPOLLOUT : EPOLLIN);
+
+	//Store
+	waitingWritable = wait;
+}
 
-	//Check if there was not anyhting left in the queeue
-	if (!(ufds[0].events & POLLOUT))
+void RTMPConnection::Flush()
+{
+	//Check we are still connected and socket is not full
+	if (!running || !writable)
+		return;
+
+	//Check if there was not anything being sent
+	if (!sending)
 	{
 		//Init bandwidth calculation
 		bandIni = getDifTime(&startTime);
 		//Nothing sent
 		bandSize = 0;
+		//Sending now
+		sending = true;
 	}
 
-	//Set to wait also for read events
-	ufds[0].events = POLLIN | POLLOUT | POLLERR | POLLHUP;
-
-	//Unlock
-	pthread_mutex_unlock(&mutex);
+	while (true)
+	{
+		//Get more chunks while there is room, more important streams first
+		while (pendingSize<MaxPendingSize)
+		{
+			RTMPChunk chunk;
+			bool found = false;
 
-	//Signal the pthread this will cause the poll call to exit
-	pthread_kill(thread.native_handle(),SIGIO);
-}
+			//Iterate the chunks in ascendig order
+			for (auto& [chunkStreamId,chunkOutputStream] : chunkOutputStreams)
+				//Get next chunk from this stream
+				if ((found = chunkOutputStream->GetNextChunk(chunk,maxOutChunkSize)))
+					break;
 
-DWORD RTMPConnection::SerializeChunkData(BYTE *data,DWORD size)
-{
-	DWORD len = 0;
+			//If nothing left
+			if (!found)
+				break;
 
-	//Lock mutex
-	pthread_mutex_lock(&mutex);
+			//Enqueue it
+			pendingSize += chunk.GetSize();
+			pending.push_back(std::move(chunk));
+		}
 
-	//Remove the write signal
-	//ufds[0].events = POLLIN | POLLERR | POLLHUP;
+		//If we have written everything
+		if (pending.empty())
+			break;
 
-	//Iterate the chunks in ascendig order (more important firsts)
-	for (RTMPChunkOutputStreams::iterator it=chunkOutputStreams.begin(); it!=chunkOutputStreams.end();++it)
-	{
-		//Get stream
-		RTMPChunkOutputStream* chunkOutputStream = it->second;
+		//Gather pending chunks without copying them
+		iovec iov[MaxIovecs];
+		int num = 0;
+		size_t size = 0;
+		//Skip already written data of first chunk
+		DWORD offset = pendingOffset;
 
-		//Check it it has data pending
-		while (chunkOutputStream->HasData())
+		for (auto it=pending.begin(); it!=pending.end() && num+2<=MaxIovecs; ++it)
 		{
-			//Check if we do not have enought space left for more
-			if(size-len<maxOutChunkSize+12)
+			//Check if header has not been written
+			if (offset<it->headerLen)
 			{
-				//We have more data to write
-				//ufds[0].events = POLLIN | POLLOUT | POLLERR | POLLHUP;
-				//End this writing
-				goto end;
+				iov[num].iov_base = it->header+offset;
+				iov[num].iov_len = it->headerLen-offset;
+				size += iov[num++].iov_len;
+				offset = 0;
+			} else {
+				//Skip header
+				offset -= it->headerLen;
 			}
+			//Add payload
+			if (offset<it->payloadLen)
+			{
+				iov[num].iov_base = (void*)(it->payload+offset);
+				iov[num].iov_len = it->payloadLen-offset;
+				size += iov[num++].iov_len;
+			}
+			//Only first one may be partially written
+			offset = 0;
+		}
 
-			//Write next chunk from this stream
-			len += chunkOutputStream->GetNextChunk(data+len,size-len,maxOutChunkSize);
+		msghdr msg = {};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = num;
 
+		//Send them, like writev but without raising SIGPIPE
+		ssize_t len = sendmsg(socket,&msg,MSG_NOSIGNAL | MSG_DONTWAIT);
+
+		//Check error
+		if (len<0)
+		{
+			//If interrupted
+			if (errno==EINTR)
+				//Try again
+				continue;
+			//If socket buffer is full
+			if (errno==EAGAIN || errno==EWOULDBLOCK)
+			{
+				//Wait until we can write again
+				writable = false;
+				WaitWritable(true);
+				return;
+			}
+			//Error
+			Error("-RTMPConnection::Flush() | Error writing [connection:%p,errno:%d]\n",this,errno);
+			//Do not disconnect here as we may be called from other connection events, let the reactor do it
+			writable = false;
+			shutdown(socket,SHUT_RDWR);
+			return;
 		}
-	}
 
+		//Increase sent bytes
+		outBytes += len;
+		bandSize += len;
+		pendingSize -= len;
+		//We had activity
+		lastActivity = reactor->GetNow();
 
-end:
-	//Add size
-	bandSize += len;
-	//Calc elapsed time
-	QWORD elapsed = getDifTime(&startTime)-bandIni;
-	//Check if
-	if (!len)
-	{
-		//Do not wait for write anymore
-		ufds[0].events = POLLIN | POLLERR | POLLHUP;
+		//Remove written chunks
+		size_t left = len;
+		while (left)
+		{
+			//Get remaining data on first chunk
+			DWORD remaining = pending.front().GetSize()-pendingOffset;
+			//If partially written
+			if (left<remaining)
+			{
+				//Skip written
+				pendingOffset += left;
+				break;
+			}
+			//Fully written
+			left -= remaining;
+			pendingOffset = 0;
+			pending.pop_front();
+		}
 
-		//Check
-		if (elapsed)
+		//If we could not write everything
+		if ((size_t)len<size)
 		{
-			//Calculate bandwith in kbps
-			bandCalc = bandSize*8000/elapsed;
-			//LOg
-			//Debug("-Band calc ended [%d,%dkbps in %dns]\n",bandSize,bandCalc,elapsed);
+			//Socket buffer is full, stop taking chunks from the streams until we can write again
+			writable = false;
+			WaitWritable(true);
+			return;
 		}
-	} else {
+
+		//Calc elapsed time
+		QWORD elapsed = getDifTime(&startTime)-bandIni;
 		//Check
 		if (elapsed>1000000)
 		{
 			//Calculate bandwith in kbps
 			bandCalc = bandSize*8000/elapsed;
-			//LOg
-			//Debug("-Band calc resetd [%d,%dkbps in %dns]\n",bandSize,bandCalc,elapsed);
+			//Reset
 			bandIni = getDifTime(&startTime);
 			bandSize = 0;
 		}
 	}
 
-	//Un Lock mutex
-	pthread_mutex_unlock(&mutex);
+	//Nothing left, do not wait for write anymore
+	WaitWritable(false);
 
-	//Return chunks data length
-	return len;
+	//Calc elapsed time
+	QWORD elapsed = getDifTime(&startTime)-bandIni;
+	//Check
+	if (elapsed && bandSize)
+		//Calculate bandwith in kbps
+		bandCalc = bandSize*8000/elapsed;
+	//Not sending
+	sending = false;
 }
 
 /***********************
@@ -787,14 +923,19 @@ void RTMPConnection::ParseData(BYTE *data,const DWORD size)
  ***********************/
 int RTMPConnection::WriteData(BYTE *data,const DWORD size)
 {
-#ifdef DEBUG
-	/*char name[256];
-	sprintf(name,"/tmp/mcu_out_%p.raw",this);
-	int fd = open(name,O_CREAT|O_WRONLY|O_APPEND, S_IRUSR | S_IWUSR, 0644);
-	write(fd,data,size);
-	MCU_CLOSE(fd);*/
-#endif
-	return send(socket, data, size, MSG_NOSIGNAL);
+	//Copy raw data
+	RTMPChunk chunk;
+	chunk.buffer = std::shared_ptr<BYTE[]>(new BYTE[size]);
+	memcpy(chunk.buffer.get(),data,size);
+	chunk.payload = chunk.buffer.get();
+	chunk.payloadLen = size;
+	//Enqueue before any chunk
+	pendingSize += size;
+	pending.push_back(std::move(chunk));
+	//Write it
+	Flush();
+	//Queued
+	return size;
 }
 
 void RTMPConnection::ProcessControlMessage(DWORD streamId,BYTE type,RTMPObject* msg)
@@ -1300,15 +1441,18 @@ void RTMPConnection::onMediaFrame(DWORD streamId,RTMPMediaFrame *frame)
 		//Calculate timestamp based on current time
 		ts = getDifTime(&startTime)/1000;
 
+	//Get frame serialized, it is shared with the rest of connections sending it instead of cloned
+	auto serialized = frame->GetSerialized();
+
 	//Dependign on the streams
 	switch(frame->GetType())
 	{
 		case RTMPMediaFrame::Audio:
 			//Append to the audio trunk
-			chunkOutputStreams[4]->SendMessage(new RTMPMessage(streamId,ts,frame->Clone()));
+			chunkOutputStreams[4]->SendMessage(new RTMPMessage(streamId,ts,RTMPMessage::Audio,serialized,frame->GetSize()));
 			break;
 		case RTMPMediaFrame::Video:
-			chunkOutputStreams[5]->SendMessage(new RTMPMessage(streamId,ts,frame->Clone()));
+			chunkOutputStreams[5]->SendMessage(new RTMPMessage(streamId,ts,RTMPMessage::Video,serialized,frame->GetSize()));
 			break;
 	}
 	//Signal frames
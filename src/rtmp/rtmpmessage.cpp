@@ -201,6 +201,21 @@ RTMPMessage::RTMPMessage(DWORD streamId,QWORD timestamp,RTMPMetaData* meta)
 	this->media = NULL;
 }
 
+RTMPMessage::RTMPMessage(DWORD streamId,QWORD timestamp,Type type,const std::shared_ptr<BYTE[]>& serialized,DWORD length)
+{
+	//Store values
+	this->streamId = streamId;
+	this->type = type;
+	this->timestamp = timestamp;
+	this->length = length;
+	//Reference serialized data
+	this->serialized = serialized;
+	this->ctrl = NULL;
+	this->cmd = NULL;
+	this->meta = NULL;
+	this->media = NULL;
+}
+
 RTMPMessage::~RTMPMessage()
 {
 	//Free
@@ -224,6 +239,12 @@ DWORD RTMPMessage::Serialize(BYTE* data,DWORD size)
 		return meta->Serialize(data,size);
 	if (media)
 		return media->Serialize(data,size);
+	if (serialized && size>=length)
+	{
+		//Copy it
+		memcpy(data,serialized.get(),length);
+		return length;
+	}
 	return 0;
 }
 
@@ -917,6 +938,44 @@ RTMPMediaFrame::~RTMPMediaFrame()
 		free(buffer);
 }
 
+std::shared_ptr<BYTE[]> RTMPMediaFrame::GetSerialized()
+{
+	//If already serialized
+	if (serialized)
+		//Share it
+		return serialized;
+
+	//Get size
+	DWORD size = GetSize();
+	//Allocate buffer
+	std::shared_ptr<BYTE[]> data(new BYTE[size]);
+	//Serialize it
+	Serialize(data.get(),size);
+
+	//Keep it for the rest of connections
+	if (caching)
+		serialized = data;
+
+	return data;
+}
+
+bool RTMPMediaFrame::EnableSerializedCache()
+{
+	//If already enabled by a previous stream in the chain
+	if (caching)
+		return false;
+	//Enable
+	caching = true;
+	return true;
+}
+
+void RTMPMediaFrame::DisableSerializedCache()
+{
+	//Frame could be modified after this
+	caching = false;
+	serialized.reset();
+}
+
 void RTMPMediaFrame::Dump()
 {
 	//Dump
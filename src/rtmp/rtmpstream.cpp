@@ -79,6 +79,8 @@ DWORD RTMPMediaStream::RemoveMediaListener(Listener *listener)
 
 void RTMPMediaStream::SendMediaFrame(RTMPMediaFrame* frame)
 {
+	//Serialize it only once for all the connections sending it
+	bool cached = frame->EnableSerializedCache();
 	//Lock mutexk
 	lock.IncUse();
 	//Iterate
@@ -87,6 +89,10 @@ void RTMPMediaStream::SendMediaFrame(RTMPMediaFrame* frame)
 		(*it)->onMediaFrame(id,frame);
 	//Unlock
 	lock.DecUse();
+	//If we enabled it
+	if (cached)
+		//Release it, connections hold their own reference
+		frame->DisableSerializedCache();
 }
 
 void RTMPMediaStream::SendCommand(const wchar_t *name,AMFData* obj)
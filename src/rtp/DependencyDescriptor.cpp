@@ -45,6 +45,30 @@ void TemplateDependencyStructure::CalculateLayerMapping()
 			return a.second.temporalLayerId>b.second.temporalLayerId;
 		return a.second.spatialLayerId>b.second.spatialLayerId;
 	});
+	
+	//Clean masks
+	templateDecodeTargetsMask.clear();
+	templateSwitchMask.clear();
+	chainDecodeTargetsMask.assign(chainsCount,0);
+	
+	//For each template
+	for (const auto& frameDependencyTemplate : frameDependencyTemplates)
+	{
+		//Get decode targets in which the frame is present and the ones it can switch to
+		templateDecodeTargetsMask.push_back(DependencyDescriptor::GetDecodeTargetsMask(frameDependencyTemplate.decodeTargetIndications));
+		templateSwitchMask.push_back(DependencyDescriptor::GetDecodeTargetsMask(frameDependencyTemplate.decodeTargetIndications, true));
+	}
+	
+	//For each decode target protected by a chain
+	for (uint32_t dt=0; dt<decodeTargetProtectedByChain.size() && dt<DependencyDescriptor::MaxDecodeTargets; ++dt)
+	{
+		//Get chain
+		auto chain = decodeTargetProtectedByChain[dt];
+		//If valid
+		if (chain<chainDecodeTargetsMask.size())
+			//Add decode target to chain
+			chainDecodeTargetsMask[chain] |= 1u << dt;
+	}
 }
 
 std::optional<TemplateDependencyStructure> TemplateDependencyStructure::Parse(BitReader& reader)
@@ -162,7 +186,7 @@ std::optional<TemplateDependencyStructure> TemplateDependencyStructure::Parse(Bi
 	return tds;
 }
 	
-std::optional<DependencyDescriptor> DependencyDescriptor::Parse(BitReader& reader, const std::optional<TemplateDependencyStructure>& templateDependencyStructure)
+std::optional<DependencyDescriptor> DependencyDescriptor::Parse(BitReader& reader, const TemplateDependencyStructure* templateDependencyStructure)
 {
 	auto dd = std::make_optional<DependencyDescriptor>({});
 	
@@ -294,6 +294,16 @@ DWORD RTPHeaderExtension::Parse(const RTPMap &extMap,const BYTE* data,const DWOR
 			case Type::DependencyDescriptor:
 				//Leave it for later
 				dependencyDescryptorReader.Wrap(ext+i,len);
+				//If it is small enough, keep raw copy so we don't have to serialize it again
+				if (len<=sizeof(rawDependencyDescryptor))
+				{
+					//Copy it
+					memcpy(rawDependencyDescryptor,ext+i,len);
+					rawDependencyDescryptorLen = len;
+				} else {
+					//Serialize it on send
+					rawDependencyDescryptorLen = 0;
+				}
 				break;
 			case Type::AbsoluteCaptureTime:
 				//	Data layout of the shortened version of abs-capture-time with a 1-byte header + 8 bytes of data:
@@ -588,7 +598,7 @@ DWORD RTPHeaderExtension::Parse(const RTPMap &extMap,const BYTE* data,const DWOR
 	return 4+length;
 }
 
-bool RTPHeaderExtension::ParseDependencyDescriptor(const std::optional<TemplateDependencyStructure>& templateDependencyStructure)
+bool RTPHeaderExtension::ParseDependencyDescriptor(const TemplateDependencyStructure* templateDependencyStructure)
 {
 	//Check we have anything to read
 	if (!dependencyDescryptorReader.Left())
@@ -602,10 +612,28 @@ bool RTPHeaderExtension::ParseDependencyDescriptor(const std::optional<TemplateD
 	//Release reader
 	dependencyDescryptorReader.Release();
 
+	//If it was not valid
+	if (!hasDependencyDescriptor)
+		//Do not reuse it
+		rawDependencyDescryptorLen = 0;
+
 	//Done
 	return hasDependencyDescriptor;
 }
 
+void RTPHeaderExtension::OverrideDependencyDescriptorFrameNumber(uint16_t frameNumber)
+{
+	//Check we have it
+	if (!dependencyDescryptor)
+		//Nothing to do
+		return;
+	//Update parsed one
+	dependencyDescryptor->frameNumber = frameNumber;
+	//Patch raw one, frame number is always at the 2nd and 3rd bytes
+	if (rawDependencyDescryptorLen>=3)
+		set2(rawDependencyDescryptor,1,frameNumber);
+}
+
 DWORD RTPHeaderExtension::Serialize(const RTPMap &extMap,BYTE* data,const DWORD size) const
 {
 	size_t n;
@@ -625,8 +653,27 @@ DWORD RTPHeaderExtension::Serialize(const RTPMap &extMap,BYTE* data,const DWORD
 	DWORD len = 4;
 	
 	//First dependency descriptor to make sure it fits 
-	if (hasDependencyDescriptor && dependencyDescryptor)
+	if (hasDependencyDescriptor && dependencyDescryptor && rawDependencyDescryptorLen)
 	{
+		//Get id for extension
+		BYTE id = extMap.GetTypeForCodec(DependencyDescriptor);
+
+		//Check length
+		if (rawDependencyDescryptorLen>0x0f)
+			//We need to use 2 byte header extensions
+			headerLength = 2;
+
+		//Write header and copy received one as it has not been modified
+		if ((n = WriteHeaderIdAndLength(data,len,id,rawDependencyDescryptorLen,headerLength)))
+		{
+			//Inc header len
+			len += n;
+			//Copy contents
+			memcpy(data + len, rawDependencyDescryptor, rawDependencyDescryptorLen);
+			//Append length
+			len += rawDependencyDescryptorLen;
+		}
+	} else if (hasDependencyDescriptor && dependencyDescryptor) {
 		//Use a temporary memory to serialize and check final size
 		BYTE ext[255];
 
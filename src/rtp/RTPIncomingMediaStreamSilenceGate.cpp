@@ -0,0 +1,283 @@
+#include "tracing.h"
+
+#include "rtp/RTPIncomingMediaStreamSilenceGate.h"
+#include "codecs.h"
+
+#include <cstring>
+
+//Celt only 20ms fullband silence frame
+static const BYTE OpusSilence[] = {0xF8, 0xFF, 0xFE};
+
+RTPIncomingMediaStreamSilenceGate::RTPIncomingMediaStreamSilenceGate(const RTPIncomingMediaStream::shared& incomingMediaStream,TimeService& timeService) :
+	incomingMediaStream(incomingMediaStream),
+	timeService(timeService)
+{
+	Debug("-RTPIncomingMediaStreamSilenceGate::RTPIncomingMediaStreamSilenceGate() [stream:%p,this:%p]\n", incomingMediaStream.get(), this);
+
+	if (incomingMediaStream)
+		//Add us as listeners
+		incomingMediaStream->AddListener(this);
+}
+
+void RTPIncomingMediaStreamSilenceGate::Stop()
+{
+	Debug("-RTPIncomingMediaStreamSilenceGate::Stop() [this:%p,forwarded:%llu,dropped:%llu,comfortNoise:%llu]\n", this, stats.forwarded, stats.dropped, stats.comfortNoise);
+
+	//Wait until all the previous async have finished as async calls are executed in order
+	timeService.Sync([=](auto now){
+		//If the source stream is alive
+		if (incomingMediaStream)
+			//Do not listen anymore
+			incomingMediaStream->RemoveListener(this);
+		//Deliver to all listeners
+		for (auto listener : listeners)
+			//Stream is gone
+			listener->onEnded(this);
+		//Remove all listeners
+		listeners.clear();
+	});
+}
+
+void RTPIncomingMediaStreamSilenceGate::AddListener(RTPIncomingMediaStream::Listener* listener)
+{
+	Debug("-RTPIncomingMediaStreamSilenceGate::AddListener() [listener:%p,this:%p]\n",listener,this);
+
+	//Dispatch in thread sync
+	timeService.Async([=](auto now){
+		listeners.insert(listener);
+	});
+}
+
+void RTPIncomingMediaStreamSilenceGate::RemoveListener(RTPIncomingMediaStream::Listener* listener)
+{
+	Debug("-RTPIncomingMediaStreamSilenceGate::RemoveListener() [listener:%p,this:%p]\n", listener, this);
+
+	//Dispatch in thread sync
+	timeService.Sync([=](auto now){
+		listeners.erase(listener);
+	});
+}
+
+bool RTPIncomingMediaStreamSilenceGate::IsSilence(const RTPPacket::shared& packet, BYTE threshold)
+{
+	//Opus DTX frames are just the toc or empty
+	if (packet->GetCodec()==AudioCodec::OPUS && packet->GetMediaLength()<=2)
+		return true;
+	//Check level, expressed in -dBov so 127 is digital silence
+	return packet->HasAudioLevel() && packet->GetLevel()>=threshold;
+}
+
+RTPPacket::shared RTPIncomingMediaStreamSilenceGate::CreateComfortNoise(const RTPPacket::shared& packet) const
+{
+	//Clone it, as original is shared with other listeners
+	auto cloned = packet->Clone();
+
+	//Replace payload with a silence frame of the same duration
+	switch (packet->GetCodec())
+	{
+		case AudioCodec::OPUS:
+			cloned->SetPayload(OpusSilence,sizeof(OpusSilence));
+			break;
+		case AudioCodec::PCMU:
+			memset(cloned->AdquireMediaData(),0xFF,cloned->GetMediaLength());
+			break;
+		case AudioCodec::PCMA:
+			memset(cloned->AdquireMediaData(),0xD5,cloned->GetMediaLength());
+			break;
+		default:
+			//Send the silent packet as it is
+			break;
+	}
+	//Not a talkspurt
+	cloned->SetMark(false);
+	//Do not let it count as voice for active speaker detection downstream
+	if (cloned->HasAudioLevel())
+		cloned->SetAudioLevel(false,127);
+
+	return cloned;
+}
+
+RTPPacket::shared RTPIncomingMediaStreamSilenceGate::Gate(const RTPPacket::shared& packet, QWORD now)
+{
+	//Only audio is gated
+	if (packet->GetMediaType()!=MediaFrame::Audio)
+		return packet;
+
+	DWORD extSeqNum = packet->GetExtSeqNum();
+	bool silence = IsSilence(packet,threshold);
+	bool talkspurt = false;
+
+	//If it is a late packet
+	if (started && extSeqNum<=lastExtSeqNum)
+	{
+		//If it is older than a dropped one, it would collide with the already renumbered packets, so leave a gap instead
+		//Same while not talking, as counting it as dropped would renumber the following ones over the already sent ones
+		if (silence || !talking || (dropped && extSeqNum<=lastDroppedExtSeqNum))
+		{
+			stats.dropped++;
+			return nullptr;
+		}
+	} else {
+		//Update state
+		if (!silence)
+		{
+			//Check if voice restarted
+			talkspurt = !talking;
+			talking = true;
+			lastVoice = now;
+		} else if (talking && now-lastVoice>=hangover) {
+			//Voice ended
+			talking = false;
+		}
+		lastExtSeqNum = extSeqNum;
+		started = true;
+	}
+
+	//If not talking
+	if (!talking)
+	{
+		//Check if we need to send comfort noise
+		if (comfortNoiseInterval && now-lastComfortNoise>=comfortNoiseInterval)
+		{
+			auto comfortNoise = CreateComfortNoise(packet);
+			//Keep sequence contiguous
+			comfortNoise->SetExtSeqNum(extSeqNum-dropped);
+			lastComfortNoise = now;
+			stats.comfortNoise++;
+			return comfortNoise;
+		}
+		//Drop it and renumber the following ones
+		dropped++;
+		//Never move it backwards on reordered packets
+		if (extSeqNum>lastDroppedExtSeqNum)
+			lastDroppedExtSeqNum = extSeqNum;
+		stats.dropped++;
+		return nullptr;
+	}
+
+	//Restart comfort noise interval
+	lastComfortNoise = now;
+	stats.forwarded++;
+
+	if (talkspurt)
+		stats.talkspurts++;
+
+	//If nothing to change
+	if (!dropped && !(talkspurt && !packet->GetMark()))
+		//Forward as it is
+		return packet;
+
+	//Clone it, as original is shared with other listeners
+	auto cloned = packet->Clone();
+	//Keep sequence contiguous
+	cloned->SetExtSeqNum(extSeqNum-dropped);
+	//First packet after silence starts a talkspurt
+	if (talkspurt)
+		cloned->SetMark(true);
+
+	return cloned;
+}
+
+RTPPacket::shared RTPIncomingMediaStreamSilenceGate::GetForwarded(const RTPPacket::shared& packet) const
+{
+	//Only audio is gated
+	if (packet->GetMediaType()!=MediaFrame::Audio)
+		return packet;
+
+	DWORD extSeqNum = packet->GetExtSeqNum();
+
+	//If not processed yet or dropped
+	if (!started || extSeqNum>lastExtSeqNum || !talking)
+		return nullptr;
+	//If forwarded before a dropped one, it was renumbered with a previous count
+	if (dropped && extSeqNum<=lastDroppedExtSeqNum)
+		return nullptr;
+
+	//If nothing to change
+	if (!dropped)
+		return packet;
+
+	//Clone it, as original is shared with other listeners
+	auto cloned = packet->Clone();
+	//Same number as when it was forwarded
+	cloned->SetExtSeqNum(extSeqNum-dropped);
+
+	return cloned;
+}
+
+void RTPIncomingMediaStreamSilenceGate::Dispatch(const RTPPacket::shared& packet)
+{
+	//Deliver to all listeners
+	for (auto listener : listeners)
+		//Dispatch rtp packet
+		listener->onRTP(this,packet);
+}
+
+void RTPIncomingMediaStreamSilenceGate::onRTP(const RTPIncomingMediaStream* stream,const RTPPacket::shared& packet)
+{
+	//Trace method
+	TRACE_EVENT("rtp", "RTPIncomingMediaStreamSilenceGate::onRTP", "ssrc", stream->GetMediaSSRC());
+
+	//If muted
+	if (muted || !packet)
+		return;
+
+	//Dispatch in thread async
+	timeService.Async([=](auto now){
+		//Check if it has to be forwarded
+		if (auto gated = Gate(packet,now.count()))
+			Dispatch(gated);
+	});
+}
+
+void RTPIncomingMediaStreamSilenceGate::onRTP(const RTPIncomingMediaStream* stream,const std::vector<RTPPacket::shared>& packets)
+{
+	//Trace method
+	TRACE_EVENT("rtp", "RTPIncomingMediaStreamSilenceGate::onRTP", "ssrc", stream->GetMediaSSRC(), "packets", packets.size());
+
+	//If muted
+	if (muted)
+		return;
+
+	//Dispatch in thread async
+	timeService.Async([=](auto now){
+		//Process each packet in order
+		for (const auto& packet : packets)
+			//Check if it has to be forwarded
+			if (auto gated = Gate(packet,now.count()))
+				Dispatch(gated);
+	});
+}
+
+void RTPIncomingMediaStreamSilenceGate::onBye(const RTPIncomingMediaStream* stream)
+{
+	//Dispatch in thread async
+	timeService.Async([=](auto now){
+		//Deliver to all listeners
+		for (auto listener : listeners)
+			//Dispatch bye
+			listener->onBye(this);
+	});
+}
+
+void RTPIncomingMediaStreamSilenceGate::onEnded(const RTPIncomingMediaStream* stream)
+{
+	Debug("-RTPIncomingMediaStreamSilenceGate::onEnded() [stream:%p,this:%p]\n", stream, this);
+
+	//Dispatch in thread sync
+	timeService.Sync([=](auto now) {
+		//Check
+		if (incomingMediaStream.get() == stream)
+			//No stream
+			incomingMediaStream.reset();
+	});
+}
+
+void RTPIncomingMediaStreamSilenceGate::Mute(bool muting)
+{
+	//Log
+	UltraDebug("-RTPIncomingMediaStreamSilenceGate::Mute() | [muting:%d]\n", muting);
+
+	//Update state
+	muted = muting;
+}
@@ -168,12 +168,8 @@ void RTPIncomingSourceGroup::Update()
 
 	//Update it sync
 	timeService.Sync([=](std::chrono::milliseconds now) {
-		//Set last updated time
-		lastUpdated = now.count();
-		//Update
-		media.Update(now.count());
-		//Update
-		rtx.Update(now.count());
+		//Update stats and publish them
+		UpdateStats(now.count());
 	});
 }
 
@@ -184,15 +180,54 @@ void RTPIncomingSourceGroup::UpdateAsync(std::function<void(std::chrono::millise
 
 	//Update it sync
 	timeService.Async([=](std::chrono::milliseconds now) {
-		//Set last updated time
-		lastUpdated = now.count();
-		//Update
-		media.Update(now.count());
-		//Update
-		rtx.Update(now.count());
+		//Update stats and publish them
+		UpdateStats(now.count());
 	}, callback);
 }
 
+void RTPIncomingSourceGroup::UpdateStats(QWORD now)
+{
+	//Set last updated time
+	lastUpdated = now;
+	//Update
+	media.Update(now);
+	//Update
+	rtx.Update(now);
+	//Publish stats
+	PublishStats(now);
+}
+
+void RTPIncomingSourceGroup::PublishStats(QWORD now)
+{
+	StatsSnapshot snapshot;
+
+	snapshot.kind			= StatsSnapshot::IncomingSourceGroup;
+	snapshot.media			= type;
+	snapshot.ssrc			= media.ssrc;
+	snapshot.rtxSsrc		= rtx.ssrc;
+	snprintf(snapshot.id, sizeof(snapshot.id), "%s%s%s", mid.c_str(), rid.empty() ? "" : "/", rid.c_str());
+	snapshot.timestamp		= now;
+	snapshot.totalPackets		= media.numPackets;
+	snapshot.totalBytes		= media.totalBytes;
+	snapshot.totalRtxPackets	= rtx.numPackets;
+	snapshot.bitrate		= media.bitrate;
+	snapshot.rtxBitrate		= rtx.bitrate;
+	snapshot.numFrames		= media.numFrames;
+	snapshot.jitter			= media.jitter;
+	snapshot.rtt			= rtt;
+	snapshot.lost			= media.lostPackets;
+	snapshot.lostDelta		= media.lostPacketsDelta;
+	snapshot.totalNACKs		= media.totalNACKs;
+	snapshot.totalPLIs		= media.totalPLIs;
+	snapshot.estimatedBitrate	= remoteBitrateEstimation;
+	snapshot.minWaitedTime		= minWaitedTime;
+	snapshot.maxWaitedTime		= maxWaitedTime;
+	snapshot.avgWaitedTime		= avgWaitedTime;
+
+	//Readers will get it without going through the loop
+	statsPublisher.Publish(snapshot);
+}
+
 void RTPIncomingSourceGroup::SetMaxWaitTime(DWORD maxWaitingTime)
 {
 	//Update it sync
@@ -281,6 +316,9 @@ void RTPIncomingSourceGroup::DispatchPackets(uint64_t time)
 	{
 		//We need to adjust the seq num due the in band probing packets
 		packet->SetExtSeqNum(packet->GetExtSeqNum() - packets.GetNumDiscardedPackets());
+		//Record time waited in the jitter buffer
+		if (time>=packet->GetTime())
+			jitterBufferLatency.Record((time - packet->GetTime())*1000);
 		//Add to packets
 		ordered.emplace_back(std::move(packet));
 	}
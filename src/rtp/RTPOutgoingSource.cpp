@@ -26,6 +26,8 @@ RTPOutgoingSource::RTPOutgoingSource() :
 	reportedFractionLost	= 0;
 	reportedJitter		= 0;
 	rtt			= 0;
+	totalPLIs		= 0;
+	totalNACKs		= 0;
 }
 
 DWORD RTPOutgoingSource::CorrectExtSeqNum(DWORD extSeqNum) 
@@ -104,6 +106,8 @@ void RTPOutgoingSource::Reset()
 	reportedFractionLost	= 0;
 	reportedJitter		= 0;
 	rtt			= 0;
+	totalPLIs		= 0;
+	totalNACKs		= 0;
 }
 
 void RTPOutgoingSource::Update(QWORD now,DWORD seqNum,DWORD size)
@@ -112,12 +112,8 @@ void RTPOutgoingSourceGroup::UpdateAsync(std::function<void(std::chrono::millise
 {
 	//Update it sync
 	timeService.Async([=](auto now) {
-		//Set last updated time
-		lastUpdated = now.count();
-		//Update
-		media.Update(now.count());
-		//Update
-		rtx.Update(now.count());
+		//Update stats and publish them
+		UpdateStats(now.count());
 	}, callback);
 }
 
@@ -125,12 +121,8 @@ void RTPOutgoingSourceGroup::Update()
 {
 	//Update it sync
 	timeService.Sync([=](auto now) {
-		//Set last updated time
-		lastUpdated = now.count();
-		//Update
-		media.Update(now.count());
-		//Update
-		rtx.Update(now.count());
+		//Update stats and publish them
+		UpdateStats(now.count());
 	});
 }
 
@@ -138,15 +130,51 @@ void RTPOutgoingSourceGroup::Update(QWORD now)
 {
 	//Update it sync
 	timeService.Sync([=](auto) {
-		//Set last updated time
-		lastUpdated = now;
-		//Update
-		media.Update(now);
-		//Update
-		rtx.Update(now);
+		//Update stats and publish them
+		UpdateStats(now);
 	});
 }
 
+void RTPOutgoingSourceGroup::UpdateStats(QWORD now)
+{
+	//Set last updated time
+	lastUpdated = now;
+	//Update
+	media.Update(now);
+	//Update
+	rtx.Update(now);
+	//Publish stats
+	PublishStats(now);
+}
+
+void RTPOutgoingSourceGroup::PublishStats(QWORD now)
+{
+	StatsSnapshot snapshot;
+
+	snapshot.kind			= StatsSnapshot::OutgoingSourceGroup;
+	snapshot.media			= type;
+	snapshot.ssrc			= media.ssrc;
+	snapshot.rtxSsrc		= rtx.ssrc;
+	snprintf(snapshot.id, sizeof(snapshot.id), "%s", mid.c_str());
+	snapshot.timestamp		= now;
+	snapshot.totalPackets		= media.numPackets;
+	snapshot.totalBytes		= media.totalBytes;
+	snapshot.totalRtxPackets	= rtx.numPackets;
+	snapshot.bitrate		= media.bitrate;
+	snapshot.rtxBitrate		= rtx.bitrate;
+	snapshot.numFrames		= media.numFrames;
+	snapshot.jitter			= media.reportedJitter;
+	snapshot.rtt			= media.rtt;
+	snapshot.lost			= media.reportedLostCount;
+	snapshot.lostDelta		= media.reportedLostCountDelta;
+	snapshot.fractionLost		= media.reportedFractionLost;
+	snapshot.totalNACKs		= media.totalNACKs;
+	snapshot.totalPLIs		= media.totalPLIs;
+	snapshot.estimatedBitrate	= media.remb;
+
+	//Readers will get it without going through the loop
+	statsPublisher.Publish(snapshot);
+}
 
 void RTPOutgoingSourceGroup::Stop()
 {
@@ -275,9 +275,9 @@ DWORD RTPPacket::Serialize(BYTE* data,DWORD size,const RTPMap& extMap) const
 	return len;
 }
 
-BYTE* RTPPacket::AdquireMediaData()
+void RTPPacket::AdquirePayload()
 {
-	//If the packet was cloned and doesn't own the payload
+	//If the packet was cloned or shared and doesn't own the payload
 	if (!ownedPayload)
 	{
 		//Store old one
@@ -289,8 +289,6 @@ BYTE* RTPPacket::AdquireMediaData()
 		//We own the payload
 		ownedPayload = true;
 	}
-	//You can write on payload now
-	return payload->GetMediaData();
 }
 
 bool RTPPacket::RecoverOSN()
@@ -353,24 +351,30 @@ void RTPPacket::Dump() const
 }
 
 
-bool RTPPacket::ParseDependencyDescriptor(const std::optional<TemplateDependencyStructure>& templateDependencyStructure, std::optional<std::vector<bool>>& activeDecodeTargets)
+bool RTPPacket::ParseDependencyDescriptor(const TemplateDependencyStructure::shared& templateDependencyStructure, const std::optional<uint32_t>& activeDecodeTargets)
 {
 	//parse it
-	if (!extension.ParseDependencyDescriptor(templateDependencyStructure))
+	if (!extension.ParseDependencyDescriptor(templateDependencyStructure.get()))
 		//Nothing to do
 		return false;
 
 	//If packet has a new dependency structure
 	if (extension.dependencyDescryptor && extension.dependencyDescryptor->templateDependencyStructure)
 	{
-		//Store it
-		this->templateDependencyStructure = extension.dependencyDescryptor->templateDependencyStructure;
-		this->activeDecodeTargets	  = extension.dependencyDescryptor->activeDecodeTargets;
+		//If it is the same than the current one
+		if (templateDependencyStructure && *templateDependencyStructure==*extension.dependencyDescryptor->templateDependencyStructure)
+			//Reuse it so precomputed tables are kept
+			this->templateDependencyStructure = templateDependencyStructure;
+		else
+			//Store it, it will be shared by all the following packets
+			this->templateDependencyStructure = std::make_shared<TemplateDependencyStructure>(*extension.dependencyDescryptor->templateDependencyStructure);
+		this->activeDecodeTargets	  = extension.dependencyDescryptor->activeDecodeTargets ?
+			std::make_optional(DependencyDescriptor::GetDecodeTargetsMask(*extension.dependencyDescryptor->activeDecodeTargets)) : std::nullopt;
 	} else {
 		//Keep previous
 		this->templateDependencyStructure = templateDependencyStructure;
 		this->activeDecodeTargets	  = extension.dependencyDescryptor && extension.dependencyDescryptor->activeDecodeTargets.has_value() ?
-			extension.dependencyDescryptor->activeDecodeTargets : activeDecodeTargets;
+			std::make_optional(DependencyDescriptor::GetDecodeTargetsMask(*extension.dependencyDescryptor->activeDecodeTargets)) : activeDecodeTargets;
 	}
 	//Done
 	return true;
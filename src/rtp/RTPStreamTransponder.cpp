@@ -474,12 +474,12 @@ void RTPStreamTransponder::onRTP(const RTPIncomingMediaStream* stream,const RTPP
 		}
 
 		//Dependency descriptor active decodte target mask
-		std::optional<std::vector<bool>> forwaredDecodeTargets;
+		std::optional<uint32_t> forwaredDecodeTargets;
 
 		//If it is AV1
 		if (codec==VideoCodec::AV1 && selector)
 			//Get decode target
-			forwaredDecodeTargets = static_cast<DependencyDescriptorLayerSelector*>(selector.get())->GetForwardedDecodeTargets();
+			forwaredDecodeTargets = static_cast<DependencyDescriptorLayerSelector*>(selector.get())->GetForwardedDecodeTargetsMask();
 
 		//Continous frame number
 		uint64_t continousFrameNumber = NoFrameNum;
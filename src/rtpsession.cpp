@@ -49,6 +49,12 @@ RTPSession::RTPSession(MediaFrame::Type media,Listener *listener) :
 	//Don't use PLI by default
 	usePLI = false;
 	useRTX = false;
+	//Don't protect with fec by default
+	useFEC = false;
+	fecGroup = 5;
+	fecSSRC = 0;
+	fecType = RTPMap::NotFound;
+	fecSeqNum = 0;
 	//Default cname
 	cname = strdup("default@localhost");
 	
@@ -137,6 +143,10 @@ void RTPSession::Reset()
 	recv->media.Reset();
 	send->rtx.Reset();
 	recv->rtx.Reset();
+
+	//Drop fec state
+	fecEncoder.reset();
+	fecDecoder.reset();
 }
 
 void RTPSession::FlushRTXPackets()
@@ -214,6 +224,15 @@ int RTPSession::SetProperties(const Properties& properties)
 		} else if (it->first.compare("ssrcRTX")==0) {
 			//Set ssrc for sending
 			send->rtx.ssrc = atoi(it->second.c_str());	
+		} else if (it->first.compare("ssrcFEC")==0) {
+			//Set ssrc for sending fec
+			fecSSRC = atoi(it->second.c_str());
+		} else if (it->first.compare("useFEC")==0) {
+			//Protect sent packets with fec
+			useFEC = atoi(it->second.c_str());
+		} else if (it->first.compare("fecGroup")==0) {
+			//Number of packets protected by each fec packet
+			fecGroup = atoi(it->second.c_str());
 		} else if (it->first.compare("cname")==0) {
 			//Check if already got one
 			if (cname)
@@ -469,9 +488,18 @@ int RTPSession::SendPacket(const RTPPacket::shared &packet,DWORD timestamp)
 		//Add it to que
 		rtxs[packet->GetExtSeqNum()] = packet;
 	
+	//If protecting with fec, before sending it as buffer is moved
+	Packet fec;
+	bool protect = useFEC && ProtectPacket(data,len,fec);
+
 	//No error yet, send packet
 	len = transport.SendRTPPacket(std::move(buffer));
 
+	//Send fec after the last packet of the group, so it is not used to recover the one in flight
+	if (protect)
+		//Stats are on the encoder
+		transport.SendRTPPacket(std::move(fec));
+
 	//Inc stats
 	send->media.numPackets++;
 	send->media.totalBytes += len;
@@ -538,6 +566,15 @@ void RTPSession::onRTPPacket(const BYTE* data, DWORD size)
 		//Exit
 		return;
 	}
+
+	//If it is a fec packet
+	if (codec==VideoCodec::FLEXFEC || codec==VideoCodec::ULPFEC)
+	{
+		//Recover lost media with it
+		ProcessFECPacket(codec,packet->GetMediaData(),packet->GetMediaLength());
+		//Exit
+		return;
+	}
 	
 	//Check if we got a different SSRC
 	if (recv->media.ssrc!=ssrc && codec!=VideoCodec::RTX)
@@ -575,6 +612,11 @@ void RTPSession::onRTPPacket(const BYTE* data, DWORD size)
 		return;
 	}
 	
+	//If we are receiving fec for the media
+	if (fecDecoder && ssrc==fecDecoder->GetSSRC())
+		//Keep it for recovering others
+		fecDecoder->AddMediaPacket(data,size);
+
 	//If it was an RTX packet and not a padding only one
 	if (codec==VideoCodec::RTX && packet->GetMediaLength()) 
 	{
@@ -683,16 +725,120 @@ void RTPSession::onRTPPacket(const BYTE* data, DWORD size)
 		//Send it
 		SendSenderReport();
 
+	//If receiving fec, packet may complete pending fec packets
+	if (fecDecoder)
+		//Recover lost ones
+		RecoverFECPackets();
+
 	//OK
 	return;
 }
 
+bool RTPSession::ProtectPacket(const BYTE* data, DWORD size, Packet& fec)
+{
+	//Create encoder on first packet or if ssrc has changed
+	if (!fecEncoder || fecEncoder->GetOptions().ssrc!=send->media.ssrc)
+	{
+		FECEncoder::Options options;
+		//Prefer flexfec if negotiated
+		if ((fecType = rtpMapOut->GetTypeForCodec(VideoCodec::FLEXFEC))!=RTPMap::NotFound)
+			options.scheme = fec::Scheme::FlexFEC;
+		else if ((fecType = rtpMapOut->GetTypeForCodec(VideoCodec::ULPFEC))!=RTPMap::NotFound)
+			options.scheme = fec::Scheme::ULPFEC;
+		//Check we have all we need
+		if (fecType==RTPMap::NotFound || !fecSSRC)
+		{
+			//Disable it
+			useFEC = false;
+			//Error
+			return Error("-RTPSession::ProtectPacket(%s) | FEC type or ssrc not set, disabling it [type:%d,ssrc:%u]\n",MediaFrame::TypeToString(media),fecType,fecSSRC);
+		}
+		options.ssrc = send->media.ssrc;
+		options.group = fecGroup;
+		//Create new one
+		fecEncoder = std::make_unique<FECEncoder>(options);
+		//Log
+		Log("-RTPSession::ProtectPacket(%s) | Protecting with fec [type:%d,ssrc:%u,group:%u]\n",MediaFrame::TypeToString(media),fecType,fecSSRC,fecEncoder->GetOptions().group);
+	}
+
+	//Add it and check if fec is ready
+	if (!fecEncoder->AddPacket(data,size))
+		//Wait for more
+		return false;
+
+	//Create rtp header for fec packet on its own stream
+	RTPHeader header;
+	header.payloadType	= fecType;
+	header.sequenceNumber	= fecSeqNum++;
+	header.timestamp	= get4(data,4);
+	header.ssrc		= fecSSRC;
+
+	BYTE* out = fec.GetData();
+	//Serialize header
+	DWORD len = header.Serialize(out,fec.GetCapacity());
+	//Check size
+	if (!len || len+fecEncoder->GetFECSize()>fec.GetCapacity())
+		//Error
+		return Error("-RTPSession::ProtectPacket(%s) | Error serializing fec packet\n",MediaFrame::TypeToString(media));
+	//Append fec payload
+	memcpy(out+len,fecEncoder->GetFECData(),fecEncoder->GetFECSize());
+	fec.SetSize(len+fecEncoder->GetFECSize());
+
+	//Ready to be sent after the protected one
+	return true;
+}
+
+void RTPSession::ProcessFECPacket(DWORD codec, const BYTE* payload, DWORD size)
+{
+	//Get scheme
+	fec::Scheme scheme = codec==VideoCodec::FLEXFEC ? fec::Scheme::FlexFEC : fec::Scheme::ULPFEC;
+
+	//If we don't have decoder for current media ssrc
+	if (!fecDecoder || fecDecoder->GetScheme()!=scheme || fecDecoder->GetSSRC()!=recv->media.ssrc)
+	{
+		//Log
+		Log("-RTPSession::ProcessFECPacket(%s) | Receiving fec [codec:%s,ssrc:%u]\n",MediaFrame::TypeToString(media),VideoCodec::GetNameFor((VideoCodec::Type)codec),recv->media.ssrc);
+		//Create new one, protected packets will be stored from now on
+		fecDecoder = std::make_unique<FECDecoder>(scheme,recv->media.ssrc);
+	}
+
+	//Add it
+	if (fecDecoder->AddFECPacket(payload,size))
+		//Recover lost ones
+		RecoverFECPackets();
+}
+
+void RTPSession::RecoverFECPackets()
+{
+	std::vector<Packet> recovered;
+
+	//Recover lost packets
+	if (!fecDecoder->Recover(recovered))
+		//Nothing
+		return;
+
+	//Process them as received
+	for (const auto& packet : recovered)
+	{
+		//Log
+		UltraDebug("-RTPSession::RecoverFECPackets(%s) | Recovered packet [seq:%u]\n",MediaFrame::TypeToString(media),get2(packet.GetData(),2));
+		//Handle it
+		onRTPPacket(packet.GetData(),packet.GetSize());
+	}
+}
+
 RTPPacket::shared RTPSession::GetPacket()
 {
 	//Wait for pacekts
 	return packets.Wait();
 }
 
+RTPPacket::shared RTPSession::TryGetPacket()
+{
+	//Get next packet if ready
+	return packets.TryWait();
+}
+
 void RTPSession::CancelGetPacket()
 {
 	//cancel
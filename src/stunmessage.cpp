@@ -12,6 +12,7 @@
 #include <openssl/opensslconf.h>
 #include <openssl/sha.h>
 #include <openssl/hmac.h>
+#include <openssl/crypto.h>
 
 static const BYTE MagicCookie[4] = {0x21,0x12,0xA4,0x42};
 
@@ -45,10 +46,29 @@ bool STUNMessage::IsSTUN(const BYTE* data,DWORD size)
 }
 
 STUNMessage* STUNMessage::Parse(const BYTE* data,DWORD size)
+{
+	View view;
+
+	//Parse and validate it without copying
+	if (!view.Parse(data,size))
+		return NULL;
+
+	//Create new message
+	STUNMessage* msg = new STUNMessage(view.GetType(),view.GetMethod(),view.GetTransactionId());
+
+	//Copy all attributes
+	for (DWORD i=0;i<view.GetNumAttributes();++i)
+		msg->AddAttribute((Attribute::Type)view.GetAttributes()[i].type,view.GetAttributes()[i].attr,view.GetAttributes()[i].size);
+
+	//Return it
+	return msg;
+}
+
+bool STUNMessage::View::Parse(const BYTE* data,DWORD size)
 {
 	//Ensure it looks like a STUN message.
 	if (! IsSTUN(data, size))
-		return NULL;
+		return false;
 
 	/*
 	 * The message type field is decomposed further into the following
@@ -76,8 +96,13 @@ STUNMessage* STUNMessage::Parse(const BYTE* data,DWORD size)
 	//Get class
 	WORD type = ((data[0] & 0x01) << 1) | ((data[1] & 0x10) >> 4);
 
-	//Create new message
-	STUNMessage* msg = new STUNMessage((Type)type,(Method)method,data+8);
+	//Store header values
+	this->data = data;
+	this->size = size;
+	this->type = (Type)type;
+	this->method = (Method)method;
+	this->numAttributes = 0;
+	this->posMessageIntegrity = 0;
 
 	/*
 	  STUN Attributes
@@ -116,42 +141,47 @@ STUNMessage* STUNMessage::Parse(const BYTE* data,DWORD size)
 		//Ensure the attribute length is not greater than the remaining size.
 		if (size<i+4+attrLen) 
 		{
-			::Debug("-STUNMessage::Parse() | the attribute length exceeds the remaining size | message discarded\n");
-			delete msg;
-			return NULL;
+			::Debug("-STUNMessage::View::Parse() | the attribute length exceeds the remaining size | message discarded\n");
+			return false;
 		}
 
 		//FINGERPRINT must be the last attribute.
 		if (hasFingerprint) 
 		{
-			::Debug("-STUNMessage::Parse() | attribute after FINGERPRINT is not allowed | message discarded\n");
-			delete msg;
-			return NULL;
+			::Debug("-STUNMessage::View::Parse() | attribute after FINGERPRINT is not allowed | message discarded\n");
+			return false;
 		}
 
 		//After a MESSAGE-INTEGRITY attribute just FINGERPRINT is allowed.
 		if (hasMessageIntegrity && attrType != Attribute::FingerPrint) 
 		{
-			::Debug("-STUNMessage::Parse() | attribute after MESSAGE_INTEGRITY other than FINGERPRINT is not allowed | message discarded\n");
-			delete msg;
-			return NULL;
+			::Debug("-STUNMessage::View::Parse() | attribute after MESSAGE_INTEGRITY other than FINGERPRINT is not allowed | message discarded\n");
+			return false;
 		}
 
+		bool integrity = false;
+
 		switch(attrType) 
 		{
 			case Attribute::MessageIntegrity:
 				hasMessageIntegrity = true;
+				posMessageIntegrity = i;
+				integrity = true;
 				break;
 			case Attribute::FingerPrint:
 				hasFingerprint = true;
 				posFingerprint = i;
+				integrity = true;
 				break;
 			default:
 				break;
 		}
 
-		//Add it
-		msg->AddAttribute((Attribute::Type)attrType,data+i+4,attrLen);
+		//Add it if there is room, last two are kept for message integrity and fingerprint which appear once at the end
+		if (integrity || numAttributes<MaxAttributes-2)
+			attributes[numAttributes++] = {attrType,attrLen,data+i+4};
+		else
+			::Debug("-STUNMessage::View::Parse() | too many attributes, skipping it [type:0x%.4x]\n",attrType);
 
 		//Next
 		i = pad32(i+4+attrLen);
@@ -160,9 +190,8 @@ STUNMessage* STUNMessage::Parse(const BYTE* data,DWORD size)
 	//Ensure current position matches the total length.
 	if ((DWORD)i != size) 
 	{
-		::Debug("-STUNMessage::Parse() | computed message size does not match total size | message discarded\n");
-		delete msg;
-		return NULL;
+		::Debug("-STUNMessage::View::Parse() | computed message size does not match total size | message discarded\n");
+		return false;
 	}
 
 	// If it has FINGERPRINT attribute then verify it.
@@ -181,38 +210,216 @@ STUNMessage* STUNMessage::Parse(const BYTE* data,DWORD size)
 		// Compare them.
 		if (announced != computed)
 		{
-			::Debug("-STUNMessage::Parse() | computed FINGERPRINT value does not match the value in the message | message discarded\n");
-			delete msg;
-			return NULL;
+			::Debug("-STUNMessage::View::Parse() | computed FINGERPRINT value does not match the value in the message | message discarded\n");
+			return false;
 		}
 	}
 
-	//Return it
-	return msg;
+	//Parsed
+	return true;
 }
-DWORD STUNMessage::NonAuthenticatedFingerPrint(BYTE* data,DWORD size)
+
+bool STUNMessage::View::CheckAuthenticatedFingerPrint(const Key& key) const
 {
-	//Get size - Message attribute - FINGERPRINT
-	WORD msgSize = GetSize()-24-8;
+	//Ensure we have the attribute and the key
+	if (!posMessageIntegrity || !key.IsSet() || get2(data,posMessageIntegrity+2)!=Key::Size)
+		return false;
+
+	BYTE header[20];
+	BYTE hmac[Key::Size];
+
+	//Copy header
+	memcpy(header,data,20);
+
+	//Change length to omit the Fingerprint attribute from the HMAC calculation of the message integrity
+	set2(header,2,posMessageIntegrity+4+Key::Size-20);
+
+	//Calculate HMAC up to the message integrity attribute
+	key.Calculate(header,20,data+20,posMessageIntegrity-20,hmac);
+
+	//Compare generated hmac with integrity attribute
+	return CRYPTO_memcmp(data+posMessageIntegrity+4,hmac,Key::Size)==0;
+}
+
+DWORD STUNMessage::View::CreateBindingResponse(BYTE* data,DWORD size,uint32_t addr,uint16_t port,const Key& key) const
+{
+	//Header + XOR-MAPPED-ADDRESS + MESSAGE-INTEGRITY + FINGERPRINT
+	DWORD msgSize = 20+12+24+8;
 
 	//Check
 	if (size<msgSize)
 		//Not enought
-		return ::Error("Not enought size");
+		return ::Error("-STUNMessage::View::CreateBindingResponse() | Not enought size [size:%u,need:%u]\n",size,msgSize);
+
+	//Set type
+	set2(data,0,GetTypeField(Response,method));
+
+	//Set cookie
+	memcpy(data+4,MagicCookie,4);
 
+	//Set same transaction than request
+	memcpy(data+8,GetTransactionId(),12);
+
+	//Set xor mapped address
+	set2(data,20,Attribute::XorMappedAddress);
+	set2(data,22,8);
+	SetXorAddress(data+24,addr,port);
+
+	//Authenticate
+	return AppendIntegrityAndFingerPrint(data,32,key);
+}
+
+const STUNMessage::View::AttributeView* STUNMessage::View::GetAttribute(Attribute::Type type) const
+{
+	//For each
+	for (DWORD i=0;i<numAttributes;++i)
+		//Check attr
+		if (attributes[i].type==type)
+			//Return it
+			return &attributes[i];
+	//Not found
+	return nullptr;
+}
+
+std::string_view STUNMessage::View::GetUsername() const
+{
+	//Get attribute
+	auto attr = GetAttribute(Attribute::Username);
+	//Return it
+	return attr ? std::string_view((const char*)attr->attr,attr->size) : std::string_view();
+}
+
+DWORD STUNMessage::View::GetPriority() const
+{
+	//Get attribute
+	auto attr = GetAttribute(Attribute::Priority);
+	//Return it
+	return attr && attr->size>=4 ? get4(attr->attr,0) : 0;
+}
+
+void STUNMessage::Key::Set(const char* pwd)
+{
+	BYTE block[SHA_CBLOCK] = {};
+	BYTE ipad[SHA_CBLOCK];
+	BYTE opad[SHA_CBLOCK];
+
+	//Get key length
+	size_t len = strlen(pwd);
+
+	//Keys longer than the block are hashed first
+	if (len>SHA_CBLOCK)
+		SHA1((const BYTE*)pwd,len,block);
+	else
+		memcpy(block,pwd,len);
+
+	//Xor pads
+	for (size_t i=0;i<SHA_CBLOCK;++i)
+	{
+		ipad[i] = block[i] ^ 0x36;
+		opad[i] = block[i] ^ 0x5c;
+	}
+
+	//Hash them once, precomputed pads need the low level SHA1 api, deprecated but still available on openssl 3
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+	SHA1_Init(&inner);
+	SHA1_Update(&inner,ipad,SHA_CBLOCK);
+	SHA1_Init(&outer);
+	SHA1_Update(&outer,opad,SHA_CBLOCK);
+#pragma GCC diagnostic pop
+
+	//Done
+	set = true;
+}
+
+void STUNMessage::Key::Calculate(const BYTE* data,DWORD size,BYTE* hmac) const
+{
+	Calculate(data,size,nullptr,0,hmac);
+}
+
+void STUNMessage::Key::Calculate(const BYTE* first,DWORD firstSize,const BYTE* second,DWORD secondSize,BYTE* hmac) const
+{
+	BYTE digest[SHA_DIGEST_LENGTH];
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+	//Continue from the hashed inner pad
+	SHA_CTX ctx = inner;
+	SHA1_Update(&ctx,first,firstSize);
+	if (secondSize)
+		SHA1_Update(&ctx,second,secondSize);
+	SHA1_Final(digest,&ctx);
+
+	//Continue from the hashed outer pad
+	ctx = outer;
+	SHA1_Update(&ctx,digest,SHA_DIGEST_LENGTH);
+	SHA1_Final(hmac,&ctx);
+#pragma GCC diagnostic pop
+}
+
+WORD STUNMessage::GetTypeField(Type type,Method method)
+{
 	//Convert so we can sift
 	WORD msgType = type;
 	WORD msgMethod = method;
 
 	//Merge the type and method
-	DWORD msgTypeField =  (msgMethod & 0x0f80) << 2;
+	WORD msgTypeField =  (msgMethod & 0x0f80) << 2;
 	msgTypeField |= (msgMethod & 0x0070) << 1;
 	msgTypeField |= (msgMethod & 0x000f);
 	msgTypeField |= (msgType & 0x02) << 7;
 	msgTypeField |= (msgType & 0x01) << 4;
 
+	return msgTypeField;
+}
+
+DWORD STUNMessage::AppendIntegrityAndFingerPrint(BYTE* data,DWORD i,const Key& key)
+{
+	CRC32Calc crc32calc;
+
+	//Change length to omit the Fingerprint attribute from the HMAC calculation of the message integrity
+	set2(data,2,i+4+Key::Size-20);
+
+	//Calculate HMAC and put it in the attibute value
+	key.Calculate(data,i,data+i+4);
+
+	//Set message integriti attribute
+	set2(data,i,Attribute::MessageIntegrity);
+	set2(data,i+2,Key::Size);
+
+	//INcrease sixe
+	i = pad32(i+4+Key::Size);
+
+	//Set final length
+	set2(data,2,i+8-20);
+
+	//Calculate crc 32 XOR'ed with the 32-bit value 0x5354554e
+	DWORD crc32 = crc32calc.Update(data,i) ^ 0x5354554e;
+
+	//Set fingerprint attribute
+	set2(data,i,Attribute::FingerPrint);
+	set2(data,i+2,4);
+	set4(data,i+4,crc32);
+
+	//INcrease sixe
+	i = pad32(i+8);
+
+	//Return size
+	return i;
+}
+
+DWORD STUNMessage::NonAuthenticatedFingerPrint(BYTE* data,DWORD size)
+{
+	//Get size - Message attribute - FINGERPRINT
+	WORD msgSize = GetSize()-24-8;
+
+	//Check
+	if (size<msgSize)
+		//Not enought
+		return ::Error("Not enought size");
+
 	//Set it
-	set2(data,0,msgTypeField);
+	set2(data,0,GetTypeField(type,method));
 
 	//Set attributte length
 	set2(data,2,msgSize-20);
@@ -244,6 +451,11 @@ DWORD STUNMessage::NonAuthenticatedFingerPrint(BYTE* data,DWORD size)
 }
 
 DWORD STUNMessage::AuthenticatedFingerPrint(BYTE* data,DWORD size,const char* pwd)
+{
+	return AuthenticatedFingerPrint(data,size,Key(pwd));
+}
+
+DWORD STUNMessage::AuthenticatedFingerPrint(BYTE* data,DWORD size,const Key& key)
 {
 	//Get size
 	WORD msgSize = GetSize();
@@ -253,22 +465,8 @@ DWORD STUNMessage::AuthenticatedFingerPrint(BYTE* data,DWORD size,const char* pw
 		//Not enought
 		return ::Error("Not enought size [size:%u,need:%u\n",size,msgSize);
 
-	//Convert so we can sift
-	WORD msgType = type;
-	WORD msgMethod = method;
-
-	//Merge the type and method
-	DWORD msgTypeField =  (msgMethod & 0x0f80) << 2;
-	msgTypeField |= (msgMethod & 0x0070) << 1;
-	msgTypeField |= (msgMethod & 0x000f);
-	msgTypeField |= (msgType & 0x02) << 7;
-	msgTypeField |= (msgType & 0x01) << 4;
-
 	//Set it
-	set2(data,0,msgTypeField);
-
-	//Set attributte length
-	set2(data,2,msgSize-20);
+	set2(data,0,GetTypeField(type,method));
 
 	//Set cookie
 	memcpy(data+4,MagicCookie,4);
@@ -292,38 +490,8 @@ DWORD STUNMessage::AuthenticatedFingerPrint(BYTE* data,DWORD size,const char* pw
 		i = pad32(i+4+(*it)->size);
 	}
 
-	DWORD len;
-	CRC32Calc crc32calc;
-
-	//Change length to omit the Fingerprint attribute from the HMAC calculation of the message integrity
-	set2(data,2,msgSize-20-8);
-
-	//Calculate HMAC and put it in the attibute value
-	HMAC(EVP_sha1(),(BYTE*)pwd, strlen(pwd),data,i,data+i+4,&len);
-
-	//Set message integriti attribute
-	set2(data,i,Attribute::MessageIntegrity);
-	set2(data,i+2,len);
-
-	//INcrease sixe
-	i = pad32(i+4+len);
-
-	//REstore length
-	set2(data,2,msgSize-20);
-
-	//Calculate crc 32 XOR'ed with the 32-bit value 0x5354554e
-	DWORD crc32 = crc32calc.Update(data,i) ^ 0x5354554e;
-
-	//Set fingerprint attribute
-	set2(data,i,Attribute::FingerPrint);
-	set2(data,i+2,4);
-	set4(data,i+4,crc32);
-
-	//INcrease sixe
-	i = pad32(i+8);
-
-	//Return size
-	return i;
+	//Add message integrity and fingerprint, sets the length too
+	return AppendIntegrityAndFingerPrint(data,i,key);
 }
 
 
@@ -358,28 +526,28 @@ bool STUNMessage::CheckAuthenticatedFingerPrint(const BYTE* data,DWORD size,cons
 	//Ensure we have found the attribute
 	if (!hasMessageIntegrity)
 		return false;
+
+	//Get the parsed attribute
+	Attribute* integrity = GetAttribute(Attribute::MessageIntegrity);
+
+	//Check size
+	if (!integrity || integrity->size!=Key::Size)
+		return false;
 	
-	//Create new data for authentication and hmac
-	BYTE* authentication = (BYTE*)malloc(i+20);
-	
-	//Copy input
-	memcpy(authentication,data,i);
+	BYTE header[20];
+	BYTE hmac[Key::Size];
+
+	//Copy header
+	memcpy(header,data,20);
 	
 	//Change length to add the Fingerprint attribute from the HMAC calculation of the message integrity
-	set2(authentication,2,i+4);
+	set2(header,2,i+4);
 
-	//Calculate HMAC and put it in the attibute value
-	DWORD len = 0;
-	HMAC(EVP_sha1(),(BYTE*)pwd, strlen(pwd),authentication,i,authentication+i,&len);
+	//Calculate HMAC
+	Key(pwd).Calculate(header,20,data+20,i-20,hmac);
 	
 	//Compare generated hmac with integrity attribute
-	bool result = len && memcmp(GetAttribute(Attribute::MessageIntegrity)->attr,authentication+i,len)==0;
-	
-	//Free mem
-	free(authentication);
-	
-	//Return result
-	return result;
+	return memcmp(integrity->attr,hmac,Key::Size)==0;
 }
 
 DWORD STUNMessage::GetSize()
@@ -480,10 +648,8 @@ void  STUNMessage::AddAddressAttribute(sockaddr_in* addr)
 	AddAttribute(Attribute::MappedAddress,aux,8);
 }
 
-void  STUNMessage::AddXorAddressAttribute(uint32_t addr, uint16_t port)
+void STUNMessage::SetXorAddress(BYTE* aux,uint32_t addr,uint16_t port)
 {
-	BYTE aux[8];
-
 	//Unused
 	aux[0] = 0;
 	//Family
@@ -500,6 +666,14 @@ void  STUNMessage::AddXorAddressAttribute(uint32_t addr, uint16_t port)
 	aux[5] ^= MagicCookie[1];
 	aux[6] ^= MagicCookie[2];
 	aux[7] ^= MagicCookie[3];
+}
+
+void  STUNMessage::AddXorAddressAttribute(uint32_t addr, uint16_t port)
+{
+	BYTE aux[8];
+
+	//Set xored address
+	SetXorAddress(aux,addr,port);
 	//Add it
 	AddAttribute(Attribute::XorMappedAddress,aux,8);
 }
@@ -114,6 +114,11 @@ int VP8Decoder::Decode(const BYTE* data, DWORD size)
 	//Get new frame
 	videoBuffer = videoBufferPool.allocate();
 
+	//Check we got one
+	if (!videoBuffer)
+		//Error
+		return Error("-VP8Decoder::Decode() | Could not allocate video buffer\n");
+
 	//Set color range
 	switch (img->range)
 	{
@@ -78,8 +78,8 @@ MediaFrame* VP8Depacketizer::AddPacket(const RTPPacket::shared& packet)
 
 	if (state != State::Error)
 	{
-		//Add payload
-		AddPayload(packet->GetMediaData(),packet->GetMediaLength());
+		//Add payload referencing packet data
+		AddPayload(packet->SharePayload(),packet->GetMediaData(),packet->GetMediaLength());
 	}
 
 	//Check if it has vp8 descriptor
@@ -123,6 +123,12 @@ MediaFrame* VP8Depacketizer::AddPacket(const RTPPacket::shared& packet)
 }
 
 MediaFrame* VP8Depacketizer::AddPayload(const BYTE* payload, DWORD len)
+{
+	//Copy payload data
+	return AddPayload(nullptr,payload,len);
+}
+
+MediaFrame* VP8Depacketizer::AddPayload(const RTPPayload::shared& owner, const BYTE* payload, DWORD len)
 {
 	//Check lenght
 	if (!len)
@@ -149,7 +155,7 @@ MediaFrame* VP8Depacketizer::AddPayload(const BYTE* payload, DWORD len)
 	}
 
 	//Skip desc
-	DWORD pos = frame.AppendMedia(payload+descLen, len-descLen);
+	DWORD pos = frame.AppendMedia(owner, payload+descLen, len-descLen);
 
 	//Add RTP packet
 	frame.AddRtpPacket(pos,len-descLen,payload,descLen);
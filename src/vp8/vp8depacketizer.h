@@ -18,6 +18,8 @@ public:
 	virtual MediaFrame* AddPacket(const RTPPacket::shared& packet) override;
 	virtual MediaFrame* AddPayload(const BYTE* payload,DWORD payload_len) override;
 	virtual void ResetFrame() override;
+private:
+	MediaFrame* AddPayload(const RTPPayload::shared& owner,const BYTE* payload,DWORD payload_len);
 private:
 	enum class State
 	{
@@ -102,6 +102,11 @@ int VP9Decoder::Decode(const BYTE * data,DWORD size)
 	//Get new frame
 	videoBuffer = videoBufferPool.allocate();
 
+	//Check we got one
+	if (!videoBuffer)
+		//Error
+		return Error("-VP9Decoder::Decode() | Could not allocate video buffer\n");
+
 	//Set color range
 	switch (img->range)
 	{
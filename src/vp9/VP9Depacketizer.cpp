@@ -65,13 +65,19 @@ MediaFrame* VP9Depacketizer::AddPacket(const RTPPacket::shared& packet)
 	}
 	//Set SSRC
 	frame.SetSSRC(packet->GetSSRC());
-	//Add payload
-	AddPayload(packet->GetMediaData(),packet->GetMediaLength());
+	//Add payload referencing packet data
+	AddPayload(packet->SharePayload(),packet->GetMediaData(),packet->GetMediaLength());
 	//If it is last return frame
 	return packet->GetMark() ? &frame : NULL;
 }
 
 MediaFrame* VP9Depacketizer::AddPayload(const BYTE* payload, DWORD len)
+{
+	//Copy payload data
+	return AddPayload(nullptr,payload,len);
+}
+
+MediaFrame* VP9Depacketizer::AddPayload(const RTPPayload::shared& owner, const BYTE* payload, DWORD len)
 {
 	//Check length
 	if (!len)
@@ -95,7 +101,7 @@ MediaFrame* VP9Depacketizer::AddPayload(const BYTE* payload, DWORD len)
 	}
 	
 	//Skip desc
-	DWORD pos = frame.AppendMedia(payload+descLen, len-descLen);
+	DWORD pos = frame.AppendMedia(owner, payload+descLen, len-descLen);
 	
 	//If it is the first one
 	if (desc.startOfLayerFrame)
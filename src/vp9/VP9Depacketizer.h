@@ -12,6 +12,7 @@ public:
 	virtual MediaFrame* AddPayload(const BYTE* payload,DWORD payload_len) override;
 	virtual void ResetFrame() override;
 private:
+	MediaFrame* AddPayload(const RTPPayload::shared& owner,const BYTE* payload,DWORD payload_len);
 	VideoFrame frame;
 	LayerFrame layer;
 };
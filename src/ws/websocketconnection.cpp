@@ -12,7 +12,6 @@
 #include <signal.h>
 #include <errno.h>
 #include <stdio.h>
-#include <list>
 #include "log.h"
 #include "assertions.h"
 #include "tools.h"
@@ -30,67 +29,63 @@ WebSocketConnection::WebSocketConnection(Listener *listener)
 	inited = false;
 	running = false;
 	socket = FD_INVALID;
-	setZeroThread(&thread);
-	//No pong
-	pong = NULL;
 	//Not uypgraded yet
 	upgraded = false;
-	//No incoming frame yet
-	incomingFrameLength = 0;
-	//NO outgoing
-	outgoingFramesLength = 0;
-	//No request or response
+	//Byte counters
+	recvSize = 0;
+	inBytes = 0;
+	outBytes = 0;
+	bandIni = 0;
+	bandSize = 0;
+	bandCalc = 0;
+	//No request
 	request = NULL;
-	response = NULL;
 	header = NULL;
 	wsl = NULL;
+	framePos = 0;
 	//Set initial time
 	gettimeofday(&startTime,0);
-	//Init mutex recursive to be able to call it from withing listener
-	pthread_mutexattr_t attr;
-	pthread_mutexattr_init(&attr);
-	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-	pthread_mutex_init(&mutex,&attr);
-	pthread_mutex_init(&mutexListener,&attr);
 }
 
 WebSocketConnection::~WebSocketConnection()
 {
-	//End just in case
-	End();
-	//Remove pending frames
-	while (!frames.empty())
-	{
-		//Delete first frame from list
-		delete(frames.front());
-		//Remove from queue
-		frames.pop_front();
-	}
+	//If it was never registered on the reactor
+	if (running)
+		//Close socket
+		MCU_CLOSE(socket);
 	if (request)  delete(request);
-	if (response) delete(response);
 	if (header)   delete(header);
-	//Check unsent pong
-	if (pong)     delete(pong);
-	//Destroy mutex
-	pthread_mutex_destroy(&mutex);
-	pthread_mutex_destroy(&mutexListener);
 }
 
-int WebSocketConnection::Init(int fd)
+int WebSocketConnection::Init(int fd,EpollReactor* reactor)
 {
-	Log(">WebSocket Connection init [ws:%p,%d]\n",this,fd);
+	Log(">WebSocket Connection init [ws:%p,%d,reactor:%p]\n",this,fd,reactor);
 
-	//Store socket
+	//Store socket and reactor
 	socket = fd;
+	this->reactor = reactor;
+
+	//Set non blocking, we only read or write when the reactor tells us
+	int fsflags = fcntl(socket,F_GETFL,0);
+	fsflags |= O_NONBLOCK;
+	fcntl(socket,F_SETFL,fsflags);
+
+	//Set no delay option
+	int flag = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(int));
 
 	//I am inited
 	inited = true;
+	//We are running
+	running = true;
 
 	//Start parser
 	parser.Init(this,HTTPParser::HTTP_REQUEST);
 
-	//Start
-	Start();
+	//Register on the reactor thread, hold reference to us until then
+	reactor->Async([self=shared_from_this()](auto now){
+		self->Start();
+	});
 
 	Log("<WebSocket Connection init\n");
 
@@ -99,30 +94,43 @@ int WebSocketConnection::Init(int fd)
 
 void WebSocketConnection::Start()
 {
-	//We are running
-	running = true;
+	Log("-WebSocketConnection::Start() [ws:%p,socket:%d]\n",this,socket);
+
+	//Last time we had activity
+	lastActivity = reactor->GetNow();
+
+	//Wait for incoming data, the reactor holds a reference to us until disconnected
+	if (!reactor->AddHandler(socket,EPOLLIN,shared_from_this()))
+	{
+		//Close it
+		Disconnect();
+		//Done
+		return;
+	}
 
-	//Create thread
-	createPriorityThread(&thread,run,this,0);
+	//Send pings or disconnect if there is no activity
+	keepAliveTimer = reactor->CreateTimer(std::chrono::milliseconds(KEEP_ALIVE/2),[self=weak_from_this()](auto now){
+		//If still alive
+		if (auto connection = self.lock())
+			//Check activity
+			connection->OnTimeout(now);
+	});
 }
 
 void WebSocketConnection::Stop()
 {
 	Log("-WebSocketConnection Stop [ws:%p]\n",this);
 
+	//Lock so the socket is not closed meanwhile
+	std::lock_guard<std::mutex> lock(stopMutex);
+
 	if (!this->running) {
 		Error("WebSocketConnection::Stop() called when not running\n");
 		return;
 	}
 
-	//Not running;
-	running = false;
-	//Close socket
+	//Will cause the reactor to get a hangup event and disconnect us
 	shutdown(socket,SHUT_RDWR);
-	//Will cause poll to return
-	MCU_CLOSE(socket);
-	//No socket
-	socket = FD_INVALID;
 }
 
 void WebSocketConnection::Detach()
@@ -134,12 +142,10 @@ void WebSocketConnection::Detach()
 		return;
 	}
 
-	//Lock mutex
-	pthread_mutex_lock(&mutexListener);
+	//Lock mutex, waits for current event to end if running in other thread
+	std::lock_guard<std::recursive_mutex> lock(mutexListener);
 	//Remove websocket listener
 	wsl = NULL;
-	//Un Lock mutex
-	pthread_mutex_unlock(&mutexListener);
 }
 
 void WebSocketConnection::ForceClose()
@@ -166,12 +172,8 @@ void WebSocketConnection::Close()
 		return;
 	}
 
-	//Lock mutex
-	pthread_mutex_lock(&mutex);
-	//Push pong frame
-	frames.push_back(new Frame(true,WebSocketFrameHeader::Close,NULL,0));
-	//Un Lock mutex
-	pthread_mutex_unlock(&mutex);
+	//Push close frame, connection will be closed after sending it
+	Enqueue(Frame(true,WebSocketFrameHeader::Close,NULL,0));
 	//We need to write data!
 	SignalWriteNeeded();
 }
@@ -189,20 +191,14 @@ void WebSocketConnection::Close(const WORD code, const std::wstring& reason)
 	UTF8Parser utf8(reason);
 
 	//Create new frame with no data yet
-	Frame *frame = new Frame(true,WebSocketFrameHeader::Close,NULL,utf8.GetUTF8Size()+2);
+	Frame frame(true,WebSocketFrameHeader::Close,NULL,utf8.GetUTF8Size()+2);
 	//Set reason
-	set2(frame->GetPayloadData(),0,code);
+	set2(frame.GetPayloadData(),0,code);
 	//Serialize reason
-	utf8.Serialize(frame->GetPayloadData()+2,frame->GetPayloadSize());
+	utf8.Serialize(frame.GetPayloadData()+2,frame.GetPayloadSize()-2);
 
-	//Lock mutex
-	pthread_mutex_lock(&mutex);
-	//Push pong frame
-	frames.push_back(frame);
-	//Add size
-	outgoingFramesLength += frame->GetPayloadSize();
-	//Un Lock mutex
-	pthread_mutex_unlock(&mutex);
+	//Push close frame
+	Enqueue(std::move(frame));
 	//We need to write data!
 	SignalWriteNeeded();
 }
@@ -219,16 +215,21 @@ int WebSocketConnection::End()
 	//Not inited any more
 	inited = false;
 
-	//Stop just in case
-	Stop();
+	{
+		//Lock so the socket is not closed meanwhile
+		std::lock_guard<std::mutex> lock(stopMutex);
+		//If still connected
+		if (running)
+			//Will cause the reactor to get a hangup event and disconnect us
+			shutdown(socket,SHUT_RDWR);
+	}
 
-	//If running
-	if (!isZeroThread(thread))
+	//If we are on a different thread than the reactor
+	if (reactor && !reactor->IsReactorThread())
 	{
-		//Wait for server thread to close
-		pthread_join(thread,NULL);
-		//No thread
-		setZeroThread(&thread);
+		//Wait until the reactor has disconnected us
+		std::unique_lock<std::mutex> lock(stopMutex);
+		stopCond.wait(lock,[this](){ return disconnected; });
 	}
 
 	//Ended
@@ -237,121 +238,38 @@ int WebSocketConnection::End()
 	return 1;
 }
 
-/***********************
-* run
-*       Helper thread function
-************************/
-void * WebSocketConnection::run(void *par)
+void WebSocketConnection::OnEvent(uint32_t events)
 {
-	Log("-WebSocket Connecttion Thread [ws:%p,pid:%d]\n",par,getpid());
-
-	//Block signals to avoid exiting on SIGUSR1
-	blocksignals();
-
-	//Obtenemos el parametro
-	WebSocketConnection *con = (WebSocketConnection *)par;
-
-	//Ejecutamos
-	con->Run();
-
-	//OK
-	return 0;
-}
-
-/***************************
- * Run
- * 	Server running thread
- ***************************/
-int WebSocketConnection::Run()
-{
-	Log("-WebSocket Connecttion Run [ws:%p]\n", this);
-
-	if (!this->running) {
-		Error("WebSocketConnection::Run() called when not running\n");
-		return 0;
+	//Check if we can write more
+	if (events & EPOLLOUT)
+	{
+		//We can write again
+		writable = true;
+		//Write pending data
+		Flush();
 	}
 
-	BYTE data[MTU] ZEROALIGNEDTO32;
-	DWORD size = MTU;
-
-	//Set values for polling
-	ufds[0].fd = socket;
-	ufds[0].events = POLLIN | POLLERR | POLLHUP;
-
-	//Set non blocking so we can get an error when we are closed by end
-	int fsflags = fcntl(socket,F_GETFL,0);
-	fsflags |= O_NONBLOCK;
-	fcntl(socket,F_SETFL,fsflags);
-
-	//Set no delay option
-	int flag = 1;
-        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(int));
-	//Catch all IO errors
-	signal(SIGIO,EmptyCatch);
-	
-	//Get first activity time
-	timeval last;
-	getUpdDifTime(&last);
-
-	//Run until ended
-	while(running)
+	if (events & EPOLLIN)
 	{
-		//Wait for events
-		if(poll(ufds,1,KEEP_ALIVE/2)<0)
-			//Check again
-			continue;
+		BYTE data[MTU] ZEROALIGNEDTO32;
 
-		if (ufds[0].revents & POLLOUT)
-		{
-			//Check if we have http response
-			if (response)
-			{
-				//Serialize
-				std::string out = response->Serialize();
-				Debug("WS RESPONSE:%s\n",out.c_str());
-				//Send it
-				outBytes += write(socket,out.c_str(),out.length());
-				//Chec if it is not upgrade
-				if (response->GetCode()!=101)
-					//End connection
-					End();
-				//Delete it
-				delete(response);
-				//Nullify
-				response = NULL;
-			} else {
-				//Get next frame to send
-				Frame* frame = GetNextFrame();
-				//Check length
-				if (frame)
-				{
-					//Send it
-					outBytes += write(socket,frame->GetData(),frame->GetSize());
-					//Check if it is a close frame
-					if (frame->GetOpCode()==WebSocketFrameHeader::Close)
-						//Close web socket now
-						Stop();
-					//Delete it
-					delete(frame);
-				}
-			}
-		}
+		//Read data from connection
+		int len = read(socket,data,sizeof(data));
 
-		if (ufds[0].revents & POLLIN)
+		//Check error
+		if (len<0 && (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR))
 		{
-			//Read data from connection
-			int len = read(socket,data,size);
-			if (len<=0)
-			{
-				//Error
-				Log("Readed [%d,%d]\n",len,errno);
-				//Exit
-				break;
-			}
+			//Nothing to read yet
+		} else if (len<=0) {
+			//Error
+			Log("-WebSocketConnection::OnEvent() | Readed [len:%d,errno:%d]\n",len,errno);
+			//Exit
+			return Disconnect();
+		} else {
 			//Increase in bytes
 			inBytes += len;
 			//Update last received time
-			getUpdDifTime(&last);
+			lastActivity = reactor->GetNow();
 
 			try {
 				//Parse data
@@ -362,145 +280,364 @@ int WebSocketConnection::Run()
 				//Dump it
 				Dump(data,len);
 				//Break on any error
-				break;
+				return Disconnect();
 			}
 		}
+	}
 
-		if ((ufds[0].revents & POLLHUP) || (ufds[0].revents & POLLERR))
-		{
-			//Error
-			Log("Pool error event [%d]\n",ufds[0].revents);
-			//Exit
-			break;
-		}
-		
-		//Check last read activity
-		if (getDifTime(&last)/1000>KEEP_ALIVE)
-		{
-			//Debug
-			Debug("-Inactivity timer on ws:%p\n",this);
-			//Update last received time
-			getUpdDifTime(&last);
-			//Check if it has been already upgraded or not
-			if (upgraded)
-				//Send ping
-				Ping();
-			else
-				//Stop
-				Stop();
-		}
+	if ((events & EPOLLHUP) || (events & EPOLLERR))
+	{
+		//Error
+		Log("-WebSocketConnection::OnEvent() | Pool error event [events:%d]\n",events);
+		//Exit
+		return Disconnect();
+	}
+}
+
+void WebSocketConnection::OnTimeout(std::chrono::milliseconds now)
+{
+	//Check we are still connected
+	if (!running)
+		return;
+
+	//Get time since last activity
+	auto elapsed = now - lastActivity;
+
+	//Check last read activity
+	if (elapsed>=std::chrono::milliseconds(KEEP_ALIVE))
+	{
+		//Debug
+		Debug("-Inactivity timer on ws:%p\n",this);
+		//Update last received time
+		lastActivity = now;
+		//Check if it has been already upgraded or not
+		if (upgraded)
+			//Send ping
+			Ping();
+		else
+			//Stop
+			return Disconnect();
 	}
 
-	//lock now
-	pthread_mutex_lock(&mutexListener);
-	//If we were opened
-	if (upgraded && wsl)
-		//Send close
-		wsl->onClose(this);
-	//unlock now
-	pthread_mutex_unlock(&mutexListener);
+	//Check again later
+	keepAliveTimer->Again(std::chrono::milliseconds(KEEP_ALIVE/2));
+}
+
+void WebSocketConnection::Disconnect()
+{
+	//Check not already disconnected
+	if (!running)
+		return;
+
+	Log(">WebSocketConnection::Disconnect() [ws:%p]\n", this);
+
+	//Stop timer
+	if (keepAliveTimer)
+		keepAliveTimer->Cancel();
+	keepAliveTimer.reset();
+
+	//Keep us alive until we are done
+	auto self = shared_from_this();
+
+	//Remove from reactor before closing the socket
+	reactor->RemoveHandler(socket);
+
+	{
+		//Lock so no one can shutdown it meanwhile
+		std::lock_guard<std::mutex> lock(stopMutex);
+		//Not running anymore
+		running = false;
+		//Close socket
+		MCU_CLOSE(socket);
+	}
+
+	//Drop pending data
+	pending.clear();
+	pendingOffset = 0;
+	pendingSize = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		frames.clear();
+		outgoingFramesLength = 0;
+	}
+
+	{
+		//lock now
+		std::lock_guard<std::recursive_mutex> lock(mutexListener);
+		//If we were opened
+		if (upgraded && wsl)
+			//Send close
+			wsl->onClose(this);
+		//Don't send more events
+		wsl = NULL;
+	}
 
 	//If got listener
 	if (listener)
 		//Send end
-		listener->onDisconnected(this);
+		listener->onDisconnected(self);
 
 	//Don't send more events
 	listener = NULL;
 
-	Log("<Run WebSocket connection [ws:%p]\n", this);
+	{
+		//Signal End() we are done
+		std::lock_guard<std::mutex> lock(stopMutex);
+		disconnected = true;
+	}
+	stopCond.notify_all();
+
+	Log("<WebSocketConnection::Disconnect() [ws:%p]\n", this);
+}
+
+void WebSocketConnection::Enqueue(Frame&& frame)
+{
+	//Lock queue
+	std::lock_guard<std::mutex> lock(mutex);
+	//Add size
+	outgoingFramesLength += frame.GetPayloadSize();
+	//Push frame
+	frames.push_back(std::move(frame));
 }
 
 void WebSocketConnection::SignalWriteNeeded()
 {
-	//lock now
-	pthread_mutex_lock(&mutex);
+	//Check we are still connected
+	if (!running)
+		return;
+
+	//If there is already a write pending
+	if (writeSignaled.exchange(true))
+		//Data will be sent by it
+		return;
+
+	//Write on the reactor thread
+	reactor->Async([self=shared_from_this()](auto now){
+		//Allow new signals
+		self->writeSignaled = false;
+		//Write all that we can
+		self->Flush();
+	});
+}
+
+void WebSocketConnection::WaitWritable(bool wait)
+{
+	//Check if changed
+	if (waitingWritable==wait)
+		return;
+
+	//Update events on reactor
+	reactor->ModifyHandler(socket,wait ? EPOLLIN | EPOLLOUT : EPOLLIN);
+
+	//Store
+	waitingWritable = wait;
+}
 
-	//Check if there was not anyhting left in the queeue
-	if (!(ufds[0].events & POLLOUT))
+void WebSocketConnection::Flush()
+{
+	//Avoid reentering from the listener, the running flush will send any new data
+	if (flushing)
+		return;
+
+	//Flushing now
+	flushing = true;
+
+	//Write until socket is full or there is nothing left
+	while (WritePending())
+	{
+		{
+			//Lock mutex
+			std::lock_guard<std::recursive_mutex> lock(mutexListener);
+			//Check listener
+			if (wsl)
+				//We have emptied the writ buffer
+				wsl->onWriteBufferEmpty(this);
+		}
+
+		//Lock queue
+		std::lock_guard<std::mutex> lock(mutex);
+		//If listener has not sent anything else
+		if (frames.empty())
+			//Done
+			break;
+	}
+
+	//Not flushing anymore
+	flushing = false;
+}
+
+bool WebSocketConnection::WritePending()
+{
+	//Check we are still connected and socket is not full
+	if (!running || !writable)
+		return false;
+
+	//Check if there was not anything being sent
+	if (!sending)
 	{
 		//Init bandwidth calculation
 		bandIni = getDifTime(&startTime);
 		//Nothing sent
 		bandSize = 0;
+		//Sending now
+		sending = true;
 	}
 
-	//Set to wait also for read events
-	ufds[0].events = POLLIN | POLLOUT | POLLERR | POLLHUP;
+	while (true)
+	{
+		{
+			//Lock queue
+			std::lock_guard<std::mutex> lock(mutex);
+			//Get more frames while there is room, nothing is sent after a close
+			while (pendingSize<MaxPendingSize && !closing && !frames.empty())
+			{
+				//Remove size
+				outgoingFramesLength -= frames.front().GetPayloadSize();
+				//Check if we have to close after this one
+				closing = frames.front().IsClose();
+				//Move to pending
+				pendingSize += frames.front().GetSize();
+				pending.push_back(std::move(frames.front()));
+				frames.pop_front();
+			}
+		}
 
-	//Unlock
-	pthread_mutex_unlock(&mutex);
+		//If we have written everything
+		if (pending.empty())
+			break;
 
-	//Check thred
-	if (!isZeroThread(thread))
-		//Signal the pthread this will cause the poll call to exit
-		pthread_kill(thread,SIGIO);
-}
+		//Gather pending frames without copying them
+		iovec iov[MaxIovecs];
+		int num = 0;
+		size_t size = 0;
+		//Skip already written data of first frame
+		DWORD offset = pendingOffset;
 
-WebSocketConnection::Frame* WebSocketConnection::GetNextFrame()
-{
-	Frame* frame = NULL;
-
-	//Lock mutex
-	pthread_mutex_lock(&mutex);
+		for (auto it=pending.begin(); it!=pending.end() && num+2<=MaxIovecs; ++it)
+		{
+			//Check if header has not been written
+			if (offset<it->GetHeaderSize())
+			{
+				iov[num].iov_base = (void*)(it->GetHeaderData()+offset);
+				iov[num].iov_len = it->GetHeaderSize()-offset;
+				size += iov[num++].iov_len;
+				offset = 0;
+			} else {
+				//Skip header
+				offset -= it->GetHeaderSize();
+			}
+			//Add payload
+			if (offset<it->GetPayloadSize())
+			{
+				iov[num].iov_base = it->GetPayloadData()+offset;
+				iov[num].iov_len = it->GetPayloadSize()-offset;
+				size += iov[num++].iov_len;
+			}
+			//Only first one may be partially written
+			offset = 0;
+		}
 
-	//Calc elapsed time
-	QWORD elapsed = getDifTime(&startTime)-bandIni;
+		msghdr msg = {};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = num;
 
-	//if there are frames waiting (should always be)
-	if (frames.size())
-	{
-		//Write next chunk from this stream
-		frame = frames.front();
+		//Send them, like writev but without raising SIGPIPE
+		ssize_t len = sendmsg(socket,&msg,MSG_NOSIGNAL | MSG_DONTWAIT);
 
-		//remove size
-		outgoingFramesLength -= frame->GetPayloadSize();
+		//Check error
+		if (len<0)
+		{
+			//If interrupted
+			if (errno==EINTR)
+				//Try again
+				continue;
+			//If socket buffer is full
+			if (errno==EAGAIN || errno==EWOULDBLOCK)
+			{
+				//Wait until we can write again
+				writable = false;
+				WaitWritable(true);
+				return false;
+			}
+			//Error
+			Error("-WebSocketConnection::Flush() | Error writing [ws:%p,errno:%d]\n",this,errno);
+			//Do not disconnect here as we may be called from the listener, let the reactor do it
+			writable = false;
+			shutdown(socket,SHUT_RDWR);
+			return false;
+		}
 
-		//Remove it
-		frames.pop_front();
+		//Increase sent bytes
+		outBytes += len;
+		bandSize += len;
+		pendingSize -= len;
 
-		//Update length
-		DWORD len = frame->GetSize();
+		//Remove written frames
+		size_t left = len;
+		while (left)
+		{
+			//Get remaining data on first frame
+			DWORD remaining = pending.front().GetSize()-pendingOffset;
+			//If partially written
+			if (left<remaining)
+			{
+				//Skip written
+				pendingOffset += left;
+				break;
+			}
+			//Fully written
+			left -= remaining;
+			pendingOffset = 0;
+			//If it was a close frame or a rejected upgrade
+			if (pending.front().IsClose())
+			{
+				//Nothing more to send
+				pending.clear();
+				pendingSize = 0;
+				writable = false;
+				//Close web socket now, the reactor will disconnect us
+				shutdown(socket,SHUT_RDWR);
+				return false;
+			}
+			pending.pop_front();
+		}
 
-		//Add size
-		bandSize += len;
+		//If we could not write everything
+		if ((size_t)len<size)
+		{
+			//Socket buffer is full, stop taking frames from the queue until we can write again
+			writable = false;
+			WaitWritable(true);
+			return false;
+		}
 
+		//Calc elapsed time
+		QWORD elapsed = getDifTime(&startTime)-bandIni;
 		//Check elapset time
 		if (elapsed>1000000)
 		{
 			//Calculate bandwith in kbps
 			bandCalc = bandSize*8000/elapsed;
-			//LOg
+			//Reset
 			bandIni = getDifTime(&startTime);
 			bandSize = 0;
 		}
-	} else {
-		//Do not wait for write anymore
-		ufds[0].events = POLLIN | POLLERR | POLLHUP;
-
-		//Check
-		if (elapsed)
-			//Calculate bandwith in kbps
-			bandCalc = bandSize*8000/elapsed;
-		//No size
-		outgoingFramesLength = 0;
-		
-		//Lock mutex
-		pthread_mutex_lock(&mutexListener);
-		//Check listener
-		if (wsl)
-			//We have emptied the writ buffer
-			wsl->onWriteBufferEmpty(this);
-		//Un Lock mutex
-		pthread_mutex_unlock(&mutexListener);
 	}
 
-	//Un Lock mutex
-	pthread_mutex_unlock(&mutex);
-	
+	//Nothing left, do not wait for write anymore
+	WaitWritable(false);
 
-	//Return frame
-	return frame;
+	//Calc elapsed time
+	QWORD elapsed = getDifTime(&startTime)-bandIni;
+	//Check
+	if (elapsed && bandSize)
+		//Calculate bandwith in kbps
+		bandCalc = bandSize*8000/elapsed;
+	//Not sending
+	sending = false;
+
+	//All written
+	return true;
 }
 
 /***********************
@@ -519,8 +656,8 @@ void WebSocketConnection::ProcessData(BYTE *data,DWORD size)
 		//Parse request
 		parser.Execute((char*)data,size);
 	} else {
-		//Process all input
-		while(size)
+		//Process all input, frames may be split between reads
+		while(size && running)
 		{
 			//If we still don't have header
 			if (!header)
@@ -544,129 +681,124 @@ void WebSocketConnection::ProcessData(BYTE *data,DWORD size)
 							//Do nothing
 							break;
 						case WebSocketFrameHeader::TextFrame:
+						{
 							//lock now
-							pthread_mutex_lock(&mutexListener);
+							std::lock_guard<std::recursive_mutex> lock(mutexListener);
 							//Check listener
 							if (wsl)
 								//Start frame
 								wsl->onMessageStart(this,WebSocket::Text,header->GetPayloadLength());
-							//unlock now
-							pthread_mutex_unlock(&mutexListener);
 							break;
+						}
 						case WebSocketFrameHeader::Close:
 							//Log
 							Log("-Received close request\n");
-							//End us
-							End();
+							//Close us, the reactor will disconnect us
+							Stop();
 							break;
 						case WebSocketFrameHeader::BinaryFrame:
+						{
 							//lock now
-							pthread_mutex_lock(&mutexListener);
+							std::lock_guard<std::recursive_mutex> lock(mutexListener);
 							//Check listener
 							if (wsl)
 								//Start frame
 								wsl->onMessageStart(this,WebSocket::Binary,header->GetPayloadLength());
-							//unlock now
-							pthread_mutex_unlock(&mutexListener);
 							break;
+						}
 						case WebSocketFrameHeader::Ping:
 							//Debug
 							Debug("-Received ping\n");
 							//Create new pong frame
-							pong = new Frame(true,WebSocketFrameHeader::Pong,NULL,header->GetPayloadLength());
+							pong = std::make_unique<Frame>(true,WebSocketFrameHeader::Pong,nullptr,header->GetPayloadLength());
 							break;
 						case WebSocketFrameHeader::Pong:
 							//Debug
 							Debug("-Received pong\n");
 							break;
+						default:
+							break;
 					}
 				}
-			} else {
-				//Get missing
-				QWORD len = header->GetPayloadLength()-framePos;
-				//Check how much data do we have readed
-				if (len>size)
-					//Limit
-					len = size;
-				//Check if it is masked
-				if (header->IsMasked())
+				//Frames with no payload are done with the header
+				if (!header || header->GetPayloadLength())
+					continue;
+			}
+
+			//Get missing
+			QWORD len = header->GetPayloadLength()-framePos;
+			//Check how much data do we have readed
+			if (len>size)
+				//Limit
+				len = size;
+			//Check if it is masked
+			if (header->IsMasked())
+				//XOR in place
+				WebSocketFrameHeader::Unmask(data,len,header->GetMask(),framePos);
+			//Check type
+			switch(header->GetOpCode())
+			{
+				case WebSocketFrameHeader::ContinuationFrame:
+				case WebSocketFrameHeader::TextFrame:
+				case WebSocketFrameHeader::BinaryFrame:
 				{
-					BYTE mask[4];
-					//Get mask
-					set4(mask,0,header->GetMask());
-					//For each byte
-					for (int i=0;i<len;++i)
-						//XOR
-						data[i] = data[i] ^ mask[(framePos+i) & 0x03];
+					//lock now
+					std::lock_guard<std::recursive_mutex> lock(mutexListener);
+					//Check listener
+					if (wsl && len)
+						//Send data
+						wsl->onMessageData(this,data,len);
+					break;
 				}
+				case WebSocketFrameHeader::Ping:
+					//data here to the PONG
+					pong->Append(data,len);
+					break;
+				default:
+					break;
+			}
+			//Move pos
+			framePos +=len;
+			//Reduce size
+			size-=len;
+			data+=len;
+			//Check if we have ended with the frame
+			if (framePos==header->GetPayloadLength())
+			{
 				//Check type
 				switch(header->GetOpCode())
 				{
 					case WebSocketFrameHeader::ContinuationFrame:
 					case WebSocketFrameHeader::TextFrame:
 					case WebSocketFrameHeader::BinaryFrame:
-						//lock now
-						pthread_mutex_lock(&mutexListener);
-						//Check listener
-						if (wsl)
-							//Send data
-							wsl->onMessageData(this,data,len);
-						//unlock now
-						pthread_mutex_unlock(&mutexListener);
+						//Check if it is end frame for message
+						if (header->IsFin())
+						{
+							//lock now
+							std::lock_guard<std::recursive_mutex> lock(mutexListener);
+							//check listener
+							if (wsl)
+								//Send data
+								wsl->onMessageEnd(this);
+						}
 						break;
 					case WebSocketFrameHeader::Ping:
-						//data here to the PONG
-						pong->Append(data,len);
+						//Debug
+						Debug("-Sending pong\n");
+						//Push pong frame
+						Enqueue(std::move(*pong));
+						//NO pong to send
+						pong.reset();
+						//We need to write data!
+						SignalWriteNeeded();
+						break;
+					default:
 						break;
 				}
-				//Move pos
-				framePos +=len;
-				//Reduce size
-				size-=len;
-				data+=len;
-				//Check if we have ended with the frame
-				if (framePos==header->GetPayloadLength())
-				{
-					//Check type
-					switch(header->GetOpCode())
-					{
-						case WebSocketFrameHeader::ContinuationFrame:
-						case WebSocketFrameHeader::TextFrame:
-						case WebSocketFrameHeader::BinaryFrame:
-							//Check if it is end frame for message
-							if (header->IsFin())
-							{
-								//lock now
-								pthread_mutex_lock(&mutexListener);
-								//check listener
-								if (wsl)
-									//Send data
-									wsl->onMessageEnd(this);
-								//Un Lock mutex
-								pthread_mutex_unlock(&mutexListener);
-							}
-
-							break;
-						case WebSocketFrameHeader::Ping:
-							//Debug
-							Debug("-Sending pong\n");
-							//Lock mutex
-							pthread_mutex_lock(&mutex);
-							//Push pong frame
-							frames.push_back(pong);
-							//NO pong to send
-							pong = NULL;
-							//Un Lock mutex
-							pthread_mutex_unlock(&mutex);
-							//We need to write data!
-							SignalWriteNeeded();
-							break;
-					}
-					//Delete header
-					delete(header);
-					//Parse new header
-					header = NULL;
-				}
+				//Delete header
+				delete(header);
+				//Parse new header
+				header = NULL;
 			}
 		}
 	}
@@ -674,7 +806,6 @@ void WebSocketConnection::ProcessData(BYTE *data,DWORD size)
 
 void WebSocketConnection::SendMessage(MessageType type,const BYTE* data, const DWORD size)
 {
-    
 	if (!this->running) {
 		Error("WebSocketConnection::SendMessage() called when not running\n");
 		return;
@@ -689,80 +820,65 @@ void WebSocketConnection::SendMessage(MessageType type,const BYTE* data, const D
 
 	//Binary type
 	WebSocketFrameHeader::OpCode code;
-        
-        switch (type)
-        {
-            case Binary:
-                code = WebSocketFrameHeader::BinaryFrame;
-                break;
-            case Text:
-                code = WebSocketFrameHeader::TextFrame;
-                break;
-            default:
-                Error("Unknown type %d\n",type);
-        }
+
+	switch (type)
+	{
+		case Binary:
+			code = WebSocketFrameHeader::BinaryFrame;
+			break;
+		case Text:
+			code = WebSocketFrameHeader::TextFrame;
+			break;
+		default:
+			Error("Unknown type %d\n",type);
+			return;
+	}
 
 	//Sent length
 	DWORD pos = 0;
 
-	//Lock mutex
-	pthread_mutex_lock(&mutex);
-
-	//Send 1300 byte frames
-	while (!last)
 	{
-		//Get remaining frame size
-		DWORD len = size-pos;
+		//Lock queue, so frames of different messages are not interleaved
+		std::lock_guard<std::mutex> lock(mutex);
 
-		//Check if bigger than desired frame length
-		if (len>1300)
-			//Set new length
-			len = 1300;
+		//Send 1300 byte frames
+		while (!last)
+		{
+			//Get remaining frame size
+			DWORD len = size-pos;
 
-		//Check if it is last
-		last = (len+pos==size);
+			//Check if bigger than desired frame length
+			if (len>1300)
+				//Set new length
+				len = 1300;
 
-		//Create new frame
-		Frame *frame = new Frame(last,code,data+pos,len);
+			//Check if it is last
+			last = (len+pos==size);
 
-		//Push frame
-		frames.push_back(frame);
+			//Add size
+			outgoingFramesLength += len;
 
-		//Add size
-		outgoingFramesLength += frame->GetPayloadSize();
+			//Push new frame
+			frames.emplace_back(last,code,data+pos,len);
 
-		//Next is always a continuation frame
-		code = WebSocketFrameHeader::ContinuationFrame;
+			//Next is always a continuation frame
+			code = WebSocketFrameHeader::ContinuationFrame;
 
-		//Move pos
-		pos += len;
+			//Move pos
+			pos += len;
+		}
 	}
 
-	//Un Lock mutex
-	pthread_mutex_unlock(&mutex);
-
-
 	//We need to write data!
 	SignalWriteNeeded();
 }
+
 void WebSocketConnection::Ping()
 {
 	Debug("-Sending ping [ws:%p]\n",this);
-	
-	//Create ping frame
-	Frame *frame = new Frame(true,WebSocketFrameHeader::Ping,NULL,0);
-	
-	//Lock mutex
-	pthread_mutex_lock(&mutex);
-
-	//Push frame
-	frames.push_back(frame);
-
-	//Add size
-	outgoingFramesLength += frame->GetPayloadSize();
 
-	//Un Lock mutex
-	pthread_mutex_unlock(&mutex);
+	//Push ping frame
+	Enqueue(Frame(true,WebSocketFrameHeader::Ping,NULL,0));
 
 	//We need to write data!
 	SignalWriteNeeded();
@@ -780,22 +896,13 @@ void WebSocketConnection::SendMessage(const std::wstring& message)
 	UTF8Parser utf8(message);
 
 	//Create new frame with no data yet
-	Frame *frame = new Frame(true,WebSocketFrameHeader::TextFrame,NULL,utf8.GetUTF8Size());
+	Frame frame(true,WebSocketFrameHeader::TextFrame,NULL,utf8.GetUTF8Size());
 
 	//Serialize
-	utf8.Serialize(frame->GetPayloadData(),frame->GetPayloadSize());
-
-	//Lock mutex
-	pthread_mutex_lock(&mutex);
+	utf8.Serialize(frame.GetPayloadData(),frame.GetPayloadSize());
 
 	//Push frame
-	frames.push_back(frame);
-
-	//Add size
-	outgoingFramesLength += frame->GetPayloadSize();
-
-	//Un Lock mutex
-	pthread_mutex_unlock(&mutex);
+	Enqueue(std::move(frame));
 
 	//We need to write data!
 	SignalWriteNeeded();
@@ -886,6 +993,9 @@ int WebSocketConnection::on_message_complete (HTTPParser*)
 	if (listener)
 		//Send event
 		listener->onUpgradeRequest(this);
+
+	//OK
+	return 0;
 }
 
 void WebSocketConnection::Accept(WebSocket::Listener *wsl)
@@ -905,12 +1015,12 @@ void WebSocketConnection::Accept(WebSocket::Listener *wsl)
 	//If not found
 	if (secWebSocketKey.size()==0)
 	{
-		//Update
-		response = new HTTPResponse(400,"Bad request, no Sec-WebSocket-Key",1,1);
+		//Send response and close connection after it
+		Enqueue(Frame(HTTPResponse(400,"Bad request, no Sec-WebSocket-Key",1,1).Serialize(),true));
 		//Signal write needed
 		SignalWriteNeeded();
-		//End
-		End();
+		//Done
+		return;
 	}
 	//Append
 	secWebSocketKey += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
@@ -923,30 +1033,36 @@ void WebSocketConnection::Accept(WebSocket::Listener *wsl)
 	av_base64_encode(secWebSocketAccept64,SHA_DIGEST_LENGTH*2,secWebSocketAccept,SHA_DIGEST_LENGTH);
 
 	//Update
-	response = new HTTPResponse(101,"Switching Protocols",1,1);
+	HTTPResponse response(101,"Switching Protocols",1,1);
 	//Add headers
-	response->AddHeader("Upgrade"			, "Websocket");
-	response->AddHeader("Connection"		, "Upgrade");
+	response.AddHeader("Upgrade"			, "Websocket");
+	response.AddHeader("Connection"		, "Upgrade");
 	//Check if we have input protocols
 	if (request->HasHeader("Sec-WebSocket-Protocol"))
 		//Add websockets protocols back
-		response->AddHeader("Sec-WebSocket-Protocol"	, request->GetHeader("Sec-WebSocket-Protocol"));
+		response.AddHeader("Sec-WebSocket-Protocol"	, request->GetHeader("Sec-WebSocket-Protocol"));
 	//Add accept key
-	response->AddHeader("Sec-WebSocket-Accept"	, secWebSocketAccept64);
+	response.AddHeader("Sec-WebSocket-Accept"	, secWebSocketAccept64);
+
+	//Serialize
+	std::string out = response.Serialize();
+	Debug("WS RESPONSE:%s\n",out.c_str());
+	//Queue it before any frame sent from the listener
+	Enqueue(Frame(out,false));
 
 	//We are upgraded
 	upgraded = true;
 
-	//lock now
-	pthread_mutex_lock(&mutexListener);
-	//Store websocket listener
-	this->wsl = wsl;
-	//check listener
-	if (wsl)
-		//We are opened
-		wsl->onOpen(this);
-	//Un Lock mutex
-	pthread_mutex_unlock(&mutexListener);
+	{
+		//lock now
+		std::lock_guard<std::recursive_mutex> lock(mutexListener);
+		//Store websocket listener
+		this->wsl = wsl;
+		//check listener
+		if (wsl)
+			//We are opened
+			wsl->onOpen(this);
+	}
 
 	//Signal write needed
 	SignalWriteNeeded();
@@ -956,8 +1072,8 @@ void WebSocketConnection::Reject(const WORD code, const char* reason)
 {
 	//Print error
 	Error("-WebSocketConnection rejected [%d:%s]\n",code,reason);
-	//Update
-	response = new HTTPResponse(code,reason,1,1);
+	//Send response and close connection after it
+	Enqueue(Frame(HTTPResponse(code,reason,1,1).Serialize(),true));
 	//Signal write needed
 	SignalWriteNeeded();
 }
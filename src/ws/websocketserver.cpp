@@ -4,7 +4,6 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
-#include <sys/poll.h>
 #include <fcntl.h>
 #include "tools.h"
 #include "log.h"
@@ -15,15 +14,11 @@
 * WebSocketServer
 * 	Constructor
 *************************/
-WebSocketServer::WebSocketServer()
+WebSocketServer::WebSocketServer() :
+	listener("ws")
 {
 	//Y no tamos iniciados
 	inited = 0;
-	serverPort = 0;
-	server = FD_INVALID;
-
-	//Create mutx
-	pthread_mutex_init(&sessionMutex,0);
 }
 
 
@@ -37,8 +32,6 @@ WebSocketServer::~WebSocketServer()
 	if (inited)
 		//End it anyway
 		End();
-	//Destroy mutex
-	pthread_mutex_destroy(&sessionMutex);
 }
 
 void WebSocketServer::AddHandler(const std::string base,Handler* hnd)
@@ -53,215 +46,74 @@ void WebSocketServer::AddHandler(const std::string base,Handler* hnd)
 * Init
 * 	Open the listening server port
 *************************/
-int WebSocketServer::Init(int port)
+int WebSocketServer::Init(int port,DWORD threads)
 {
 	//Check not already inited
 	if (inited)
 		//Error
 		return Error("-Init: WebSocket Server is already running.\n");
 
-	Log("-Init WebSocket Server [%d]\n",port);
+	Log("-Init WebSocket Server [%d,threads:%u]\n",port,threads);
 
-	//Save server port
-	serverPort = port;
+	//Listen and create reactors, connections are multiplexed on them
+	if (!listener.Start(port,INADDR_ANY,threads,[this](int fd,EpollReactor* reactor){ CreateConnection(fd,reactor); }))
+		return 0;
 
 	//I am inited
 	inited = 1;
 
-	//Create threads
-	createPriorityThread(&serverThread,run,this,0);
-
 	//Return ok
 	return 1;
 }
 
-/***************************
- * Run
- * 	Server running thread
- ***************************/
-int WebSocketServer::Run()
-{
-	sockaddr_in addr;
-	pollfd ufds[1];
-
-init:
-	//Log
-	Log(">Run WebSocket Server [%p,port:%d]\n",this,serverPort);
-	//Create socket
-	server = socket(AF_INET, SOCK_STREAM, 0);
-
-	//Set SO_REUSEADDR on a socket to true (1):
-	int optval = 1;
-	setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
-
-	//Bind to first available port
-	memset(&addr,0,sizeof(addr));
-	addr.sin_family 	= AF_INET;
-	addr.sin_addr.s_addr 	= INADDR_ANY;
-	addr.sin_port 		= htons(serverPort);
-
-	//Bind
-     	if (bind(server, (sockaddr *) &addr, sizeof(addr)) < 0)
-		//Error
-		return Error("Can't bind server socket. errno = %d.\n", errno);
-
-	//Listen for connections
-	if (listen(server,5)<0)
-		//Error
-		return Error("Can't listen on server socket. errno = %d\n", errno);
-
-	//Set values for polling
-	ufds[0].fd = server;
-	ufds[0].events = POLLIN | POLLHUP | POLLERR ;
-
-	//Set non blocking so we can get an error when we are closed by end
-	int fsflags = fcntl(server,F_GETFL,0);
-	fsflags |= O_NONBLOCK;
-	fcntl(server,F_SETFL,fsflags);
-
-	//Run until ended
-	while(inited)
-	{
-		//Log
-		Log("-WebSocket Server accepting connections [fd:%d]\n", ufds[0].fd);
-
-		//Clean zombies each time
-		CleanZombies();
-
-		//Wait for events
-		if (poll(ufds,1,-1)<0)
-		{
-			//Error
-			Error("WebSocketServer: pool error [fd:%d,errno:%d]\n",ufds[0].fd,errno);
-			//Check if already inited
-			if (!inited)
-				//Exit
-				break;
-			//Close socket just in case
-			MCU_CLOSE(server);
-			//Invalidate
-			server = FD_INVALID;
-			//Re-init
-			goto init;
-		}
-
-		//Chek events, will fail if closed by End() so we can exit
-		if (ufds[0].revents!=POLLIN)
-		{
-			//Error
-			Error("WebSocketServer: poolin error event [event:%d,fd:%d,errno:%d]\n",ufds[0].revents,ufds[0].fd,errno);
-			//Check if already inited
-			if (!inited)
-				//Exit
-				break;
-			//Close socket just in case
-			MCU_CLOSE(server);
-			//Invalidate
-			server = FD_INVALID;
-			//Re-init
-			goto init;
-		}
-
-		//Accpept incoming connections
-		int fd = accept(server,NULL,0);
-
-		//If error
-		if (fd<0)
-		{
-			//LOg error
-			Error("WebSocketServer: error accepting new connection [fd:%d,errno:%d]\n",server,errno);
-			//Check if already inited
-			if (!inited)
-				//Exit
-				break;
-			//Close socket just in case
-			MCU_CLOSE(server);
-			//Invalidate
-			server = FD_INVALID;
-			//Re-init
-			goto init;
-		}
-
-		//Set non blocking again
-		fsflags = fcntl(fd,F_GETFL,0);
-		fsflags |= O_NONBLOCK;
-		fcntl(fd,F_SETFL,fsflags);
-
-		//Create the connection
-		CreateConnection(fd);
-	}
-
-	Log("<Run WebSocket Server\n");
-
-	return 0;
-}
-
 /*************************
  * CreateConnection
  * 	Create new WebSocket Connection for socket
  *************************/
-void WebSocketServer::CreateConnection(int fd)
+void WebSocketServer::CreateConnection(int fd,EpollReactor* reactor)
 {
-	Log(">Creating connection\n");
-
 	//Create new WebSocket connection
-	WebSocketConnection* con = new WebSocketConnection(this);
-
-	Log("-Incoming connection [%d,%p]\n",fd,con);
-
-	//Init connection
-	con->Init(fd);
+	auto con = std::make_shared<WebSocketConnection>(this);
 
-	Log("<Creating connection [0x%x]\n",con);
-}
+	Log("-Incoming connection [%d,%p,reactor:%p]\n",fd,con.get(),reactor);
 
-/**************************
- * DeleteConnection
- * 	DeleteConnection
- **************************/
-void WebSocketServer::CleanZombies()
-{
-	//Lock list
-	pthread_mutex_lock(&sessionMutex);
-
-	//Zombie iterator
-	for (Connections::iterator it=zombies.begin();it!=zombies.end();++it)
 	{
-		//Get connection
-		WebSocketConnection *con = *it;
-		//Delete connection
-		delete con;
+		//Lock list
+		std::lock_guard<std::mutex> lock(mutex);
+		//Append before init as it could be disconnected inmediatelly
+		connections.insert(con);
 	}
 
-	//Clear zombies
-	zombies.clear();
-
-	//Unlock list
-	pthread_mutex_unlock(&sessionMutex);
-
+	//Init connection
+	con->Init(fd,reactor);
 }
 
-/***********************
-* run
-*       Helper thread function
-************************/
-void * WebSocketServer::run(void *par)
+/*********************
+ * DeleteAllConnections
+ *	End all connections and clean list
+ *********************/
+void WebSocketServer::DeleteAllConnections()
 {
-        Log("-WebSocket Server Thread [%d]\n",pthread_self());
+	Connections ending;
 
-        //Obtenemos el parametro
-        WebSocketServer *ses = (WebSocketServer *)par;
+	{
+		//Lock list
+		std::lock_guard<std::mutex> lock(mutex);
+		//Get current connections
+		ending = connections;
+	}
 
-        //Bloqueamos las señales
-        blocksignals();
+	//For all connections, without lock as they are removed from the list when disconnected
+	for (auto& con : ending)
+		//End it and wait until disconnected
+		con->End();
 
-        //Ejecutamos
-        ses->Run();
-	//Exit
-	return NULL;
+	//Lock list
+	std::lock_guard<std::mutex> lock(mutex);
+	//Clear all connections
+	connections.clear();
 }
 
-
 /************************
 * End
 * 	End server and close all connections
@@ -275,22 +127,21 @@ int WebSocketServer::End()
 		//Do nothing
 		return 0;
 
-	//Stop thread
+	//Stop accepting
 	inited = 0;
 
 	//Close server socket
-	shutdown(server,SHUT_RDWR);
-	//Will cause poll function to exit
-	MCU_CLOSE(server);
-	//Invalidate
-	server = FD_INVALID;
+	listener.StopAccepting();
 
-	//Wait for server thread to close
-        Log("Joining server thread [%d,%d]\n",serverThread,inited);
-        pthread_join(serverThread,NULL);
-        Log("Joined server thread [%d]\n",serverThread);
+	//Delete connections
+	DeleteAllConnections();
+
+	//Stop reactors
+	listener.Stop();
 
 	Log("<End WebSocket Server\n");
+
+	return 1;
 }
 
 void WebSocketServer::onUpgradeRequest(WebSocketConnection* conn)
@@ -315,12 +166,12 @@ void WebSocketServer::onUpgradeRequest(WebSocketConnection* conn)
 	conn->Reject(404,"No handlers for that url found");
 }
 
-void WebSocketServer::onDisconnected(WebSocketConnection* conn)
+void WebSocketServer::onDisconnected(const WebSocketConnection::shared& conn)
 {
 	//Lock list
-	pthread_mutex_lock(&sessionMutex);
-	//Add to zombie
-	zombies.push_back(conn);
-	//Unlock list
-	pthread_mutex_unlock(&sessionMutex);
+	std::lock_guard<std::mutex> lock(mutex);
+	//Remove it, will be deleted when the reactor releases it
+	if (connections.erase(conn))
+		//Not running on its reactor anymore
+		listener.Release(conn->GetReactor());
 }
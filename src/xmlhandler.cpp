@@ -180,13 +180,7 @@ int XmlHandler::ProcessRequest(TRequestInfo *req,TSession * const ses)
 	xmlrpc_DECREF(params);
 
 	//Generamos la respuesta
-	xmlrpc_mem_block *output = xmlrpc_registry_process_call(
-			&env, 
-			registry, 
-			NULL,
-			buffer,
-			inputLen
-		);
+	xmlrpc_mem_block *output = ProcessCall(&env,buffer,inputLen);
 
 	//Si todo ha ido bien
 	if (!env.fault_occurred)
@@ -211,3 +205,119 @@ int XmlHandler::ProcessRequest(TRequestInfo *req,TSession * const ses)
 	return 1;
 }
 
+/**************************************
+* ProcessCall
+*	Runs the xml call on the registry
+*************************************/
+xmlrpc_mem_block* XmlHandler::ProcessCall(xmlrpc_env *env,const char* buffer,size_t len)
+{
+	return xmlrpc_registry_process_call(
+			env,
+			registry,
+			NULL,
+			buffer,
+			len
+		);
+}
+
+/**************************************
+* GetOrderingKey
+*	Get conference id from first int param of the call
+*************************************/
+QWORD XmlHandler::GetOrderingKey(const HTTPRequestParser::Request& request)
+{
+	std::string_view body = request.GetBody();
+
+	//Find first param value
+	auto pos = body.find("<param>");
+	if (pos==std::string_view::npos)
+		return 0;
+	pos = body.find("<value>",pos);
+	if (pos==std::string_view::npos)
+		return 0;
+	pos = body.find_first_not_of(" \t\r\n",pos+7);
+	if (pos==std::string_view::npos)
+		return 0;
+
+	//Only integers are conference ids
+	body.remove_prefix(pos);
+	if (body.substr(0,4)=="<i4>")
+		body.remove_prefix(4);
+	else if (body.substr(0,5)=="<int>")
+		body.remove_prefix(5);
+	else
+		return 0;
+
+	//Parse it
+	QWORD id = 0;
+	size_t i = 0;
+	for (;i<body.size() && body[i]>='0' && body[i]<='9' && i<10;++i)
+		id = id*10 + body[i]-'0';
+
+	//Must have at least one digit, 0 means unordered so shift it
+	return i ? id+1 : 0;
+}
+
+/**************************************
+* ProcessRequest
+*	Process request from the HTTPServer
+*************************************/
+void XmlHandler::ProcessRequest(const HTTPRequestParser::Request& request, HTTPServer::Response& response)
+{
+	xmlrpc_env env;
+	timeval tv;
+
+	Log(">ProcessRequest [uri:%.*s]\n",(int)request.GetURI().size(),request.GetURI().data());
+
+	//Init timer
+	getUpdDifTime(&tv);
+
+	//Si no es post
+	if (request.GetMethod()!="POST")
+	{
+		response.code = 405;
+		response.body = "Only POST allowed";
+		return;
+	}
+
+	//Check content type
+	if (request.GetHeader("content-type")!="text/xml")
+	{
+		response.code = 400;
+		response.body = "Wrong content-type";
+		return;
+	}
+
+	//Check size
+	std::string_view body = request.GetBody();
+	if (body.empty() || body.size()>xmlrpc_limit_get(XMLRPC_XML_SIZE_LIMIT_ID))
+	{
+		response.code = 400;
+		response.body = "Size limit";
+		return;
+	}
+
+	//Creamos un enviroment
+	xmlrpc_env_init(&env);
+
+	//Generamos la respuesta directamente desde el buffer de recepcion
+	xmlrpc_mem_block *output = ProcessCall(&env,body.data(),body.size());
+
+	//Si todo ha ido bien
+	if (!env.fault_occurred)
+	{
+		//Set response
+		response.contentType = "text/xml; charset=\"utf-8\"";
+		response.body.assign(XMLRPC_MEMBLOCK_CONTENTS(char, output), XMLRPC_MEMBLOCK_SIZE(char, output));
+		//Liberamos
+		XMLRPC_MEMBLOCK_FREE(char, output);
+	} else {
+		//Error
+		Error("Error processing requests [%s]\n",env.fault_string);
+		response.code = 500;
+	}
+
+	xmlrpc_env_clean(&env);
+
+	Log("<ProcessRequest [time:%llu]\n",getDifTime(&tv)/1000);
+}
@@ -113,7 +113,7 @@ std::vector<RTPPacket::shared> generateRTPStream(const std::vector<FrameDescript
 			
 		//Set dependency descriptor and template dependency structure
 		packet->SetDependencyDescriptor(dependencyDescriptor);
-		packet->OverrideTemplateDependencyStructure(templateDependencyStructure);
+		packet->OverrideTemplateDependencyStructure(std::make_shared<TemplateDependencyStructure>(templateDependencyStructure));
 		
 		packets.push_back(packet);
 	}
@@ -0,0 +1,175 @@
+#include <deque>
+#include <memory>
+#include <vector>
+#include "test.h"
+#include "dtls.h"
+#include "EventLoop.h"
+
+class DTLSPlan: public TestPlan
+{
+public:
+	DTLSPlan() : TestPlan("DTLS test plan")
+	{
+
+	}
+
+	virtual void Execute()
+	{
+		//Without debug logs, or we will be measuring them
+		Logger::EnableDebug(false);
+		Logger::EnableUltraDebug(false);
+
+		benchmarkHandshakes(DTLSConnection::KEY_RSA);
+		benchmarkHandshakes(DTLSConnection::KEY_ECDSA_P256);
+		benchmarkHandshakes(DTLSConnection::KEY_ED25519);
+
+		//Restore default
+		DTLSConnection::SetKeyType(DTLSConnection::KEY_RSA);
+
+		Logger::EnableDebug(true);
+		Logger::EnableUltraDebug(true);
+	}
+
+private:
+	//No datachannels on the benchmark
+	class NullTransport : public datachannels::Transport
+	{
+	public:
+		virtual size_t ReadPacket(uint8_t *data, uint32_t size) override	{ return 0;	}
+		virtual size_t WritePacket(uint8_t *data, uint32_t size) override	{ return size;	}
+		virtual void OnPendingData(std::function<void(void)> callback) override {}
+	};
+
+	//One side of the connection
+	class Peer : public DTLSConnection::Listener
+	{
+	public:
+		Peer(TimeService& timeService, std::deque<Peer*>& pending) :
+			dtls(*this, timeService, sctp),
+			pending(pending)
+		{
+		}
+
+		virtual void onDTLSPendingData() override
+		{
+			//Flush it later, we may be inside the peer Write
+			if (!queued)
+				pending.push_back(this);
+			queued = true;
+		}
+		virtual void onDTLSSetup(DTLSConnection::Suite suite,BYTE* localMasterKey,DWORD localMasterKeySize,BYTE* remoteMasterKey,DWORD remoteMasterKeySize) override
+		{
+			done = true;
+		}
+		virtual void onDTLSSetupError() override	{ failed = true; }
+		virtual void onDTLSShutdown() override		{}
+
+		void Flush()
+		{
+			BYTE data[MTU];
+			int len;
+			queued = false;
+			//Pass all records to the other side
+			while ((len = dtls.Read(data, sizeof(data)))>0)
+				other->dtls.Write(data, len);
+		}
+
+	public:
+		NullTransport sctp;
+		DTLSConnection dtls;
+		Peer* other = nullptr;
+		bool queued = false;
+		bool done = false;
+		bool failed = false;
+	private:
+		std::deque<Peer*>& pending;
+	};
+
+	void benchmarkHandshakes(DTLSConnection::KeyType keyType)
+	{
+		const int connections = 200;
+
+		//Generate new certificate with requested key
+		DTLSConnection::Terminate();
+		DTLSConnection::SetKeyType(keyType);
+
+		QWORD ini = getTime();
+		int ret = DTLSConnection::Initialize();
+		QWORD generated = getTime();
+		assert(ret);
+
+		//Both sides use the same certificate
+		auto fingerprint = DTLSConnection::GetCertificateFingerPrint(DTLSConnection::SHA256);
+
+		EventLoop loop;
+		loop.Start();
+
+		int completed = 0;
+		QWORD elapsed = 0;
+
+		//Run all of them concurrently in the loop thread
+		loop.Sync([&](auto now) {
+			std::deque<Peer*> pending;
+			std::vector<std::unique_ptr<Peer>> peers;
+
+			QWORD start = getTime();
+
+			for (int i = 0; i < connections; ++i)
+			{
+				auto client = std::make_unique<Peer>(loop, pending);
+				auto server = std::make_unique<Peer>(loop, pending);
+				client->other = server.get();
+				server->other = client.get();
+				//Set roles
+				client->dtls.SetRemoteSetup(DTLSConnection::SETUP_PASSIVE);
+				server->dtls.SetRemoteSetup(DTLSConnection::SETUP_ACTIVE);
+				client->dtls.SetRemoteFingerprint(DTLSConnection::SHA256, fingerprint.c_str());
+				server->dtls.SetRemoteFingerprint(DTLSConnection::SHA256, fingerprint.c_str());
+				assert(server->dtls.Init());
+				assert(client->dtls.Init());
+				//Send client hello
+				client->onDTLSPendingData();
+				peers.push_back(std::move(client));
+				peers.push_back(std::move(server));
+			}
+
+			//Exchange records until all are done
+			while (!pending.empty())
+			{
+				auto peer = pending.front();
+				pending.pop_front();
+				peer->Flush();
+			}
+
+			elapsed = getTime() - start;
+
+			for (auto& peer : peers)
+			{
+				assert(!peer->failed);
+				if (peer->done)
+					completed++;
+			}
+
+			//Release them in the loop thread
+			peers.clear();
+		});
+
+		loop.Stop();
+
+		Log("-DTLSPlan::benchmarkHandshakes() [keyType:%d,generation:%lluus,handshakes:%d,elapsed:%lluus,rate:%.1f/s]\n",
+			keyType,
+			generated - ini,
+			completed / 2,
+			elapsed,
+			elapsed ? completed * 500000.0 / elapsed : 0.0
+		);
+
+		//Older openssl versions can generate Ed25519 certificates but not use them on DTLS
+		if (keyType == DTLSConnection::KEY_ED25519 && !completed)
+			Log("-DTLSPlan::benchmarkHandshakes() | Ed25519 not supported on DTLS by this openssl version\n");
+		else
+			assert(completed == connections * 2);
+	}
+};
+
+DTLSPlan dtls;
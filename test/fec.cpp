@@ -1 +1,210 @@
-
+#include <vector>
+#include <random>
+#include <atomic>
+#include <thread>
+#include "test.h"
+#include "tools.h"
+#include "fecencoder.h"
+#include "fecdecoder.h"
+#include "PCAPTransportEmulator.h"
+
+class FECPlan: public TestPlan
+{
+public:
+	FECPlan() : TestPlan("FEC test plan")
+	{
+
+	}
+
+	virtual void Execute()
+	{
+		throughput(fec::Scheme::ULPFEC);
+		throughput(fec::Scheme::FlexFEC);
+
+		//Opus on 20ms packets and low bitrate video
+		for (auto scheme : {fec::Scheme::ULPFEC, fec::Scheme::FlexFEC})
+		{
+			simulate(scheme,"audio",false,3,0.05,1);
+			simulate(scheme,"audio",false,3,0.05,3);
+			simulate(scheme,"video",true,5,0.05,1);
+			simulate(scheme,"video",true,5,0.05,3);
+			simulate(scheme,"video",true,10,0.02,1);
+		}
+	}
+
+	// Datagrams played by the emulator
+	class Reader : public UDPReader
+	{
+	public:
+		void Add(uint64_t ts, const BYTE* data, DWORD size)
+		{
+			packets.emplace_back(ts,std::vector<BYTE>(data,data+size));
+		}
+		virtual uint64_t Next() override
+		{
+			//If at the end
+			if (pos>=packets.size())
+			{
+				done = true;
+				return 0;
+			}
+			current = &packets[pos++];
+			return current->first;
+		}
+		virtual uint8_t* GetUDPData() const override	{ return current->second.data();		}
+		virtual uint32_t GetUDPSize() const override	{ return current->second.size();		}
+		virtual uint64_t Seek(const uint64_t time) override	{ pos = 0; return packets.empty() ? 0 : packets[0].first;	}
+		virtual void Rewind() override			{ pos = 0;	}
+		virtual bool Close() override			{ return true;	}
+
+		std::atomic<bool> done = false;
+	private:
+		std::vector<std::pair<uint64_t,std::vector<BYTE>>> packets;
+		std::pair<uint64_t,std::vector<BYTE>>* current = nullptr;
+		size_t pos = 0;
+	};
+
+	static std::vector<BYTE> CreatePacket(BYTE pt, WORD seq, DWORD timestamp, DWORD ssrc, bool mark, DWORD size)
+	{
+		std::vector<BYTE> packet(size);
+		packet[0] = 0x80;
+		packet[1] = (mark ? 0x80 : 0x00) | pt;
+		set2(packet.data(),2,seq);
+		set4(packet.data(),4,timestamp);
+		set4(packet.data(),8,ssrc);
+		for (DWORD i=12;i<size;++i)
+			packet[i] = seq + i;
+		return packet;
+	}
+
+	//Encode and recover a minute of 300kbps video, 3 packets per frame, losing
+	//one packet of each group
+	void throughput(fec::Scheme scheme)
+	{
+		const DWORD num = 60*15*3;
+		std::vector<std::vector<BYTE>> media;
+		for (DWORD i=0;i<num;++i)
+			media.push_back(CreatePacket(96,i,i/3*6000,0x1234,i%3==2,900+(i*37)%300));
+
+		FECEncoder::Options options;
+		options.scheme = scheme;
+		options.ssrc = 0x1234;
+		options.group = 5;
+		options.flushOnMarker = false;
+		FECEncoder encoder(options);
+		FECDecoder decoder(scheme,0x1234);
+		std::vector<Packet> recovered;
+
+		QWORD start = getTime();
+		QWORD encoding = 0;
+		for (DWORD i=0;i<num;++i)
+		{
+			QWORD ini = getTime();
+			bool ready = encoder.AddPacket(media[i].data(),media[i].size());
+			encoding += getTime()-ini;
+			//Lose first packet of each group
+			if (i%options.group)
+				decoder.AddMediaPacket(media[i].data(),media[i].size());
+			if (ready)
+				decoder.AddFECPacket(encoder.GetFECData(),encoder.GetFECSize());
+			decoder.Recover(recovered);
+		}
+		QWORD elapsed = getTime()-start;
+
+		Log("-FECPlan::throughput() [scheme:%s,packets:%u,recovered:%zu,encode:%.3fus/packet,decode:%.3fus/packet]\n",
+			scheme==fec::Scheme::FlexFEC ? "flexfec" : "ulpfec",num,recovered.size(),
+			(double)encoding/num,(double)(elapsed-encoding)/num);
+	}
+
+	//Plays a stream with fec through the emulator, dropping packets with a
+	//Gilbert-Elliott model of the given loss rate and mean burst length
+	void simulate(fec::Scheme scheme, const char* name, bool video, DWORD group, double loss, double burst)
+	{
+		const DWORD ssrc = 0x1234;
+		const DWORD fecSSRC = 0x5678;
+		const BYTE pt = video ? 96 : 111;
+		const BYTE fecPt = scheme==fec::Scheme::FlexFEC ? 113 : 108;
+		const DWORD num = video ? 20*15*3 : 20*50;
+
+		//Transitions to keep the loss rate with the mean burst length
+		const double badToGood = 1/burst;
+		const double goodToBad = loss*badToGood/(1-loss);
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<double> uniform(0,1);
+		bool bad = false;
+
+		FECEncoder::Options options;
+		options.scheme = scheme;
+		options.ssrc = ssrc;
+		options.group = group;
+		options.flushOnMarker = video;
+		FECEncoder encoder(options);
+
+		auto reader = new Reader();
+		DWORD lost = 0;
+		WORD fecSeq = 0;
+		//All packets on the same ms so it is played at once
+		uint64_t ts = 1000000;
+
+		for (DWORD i=0;i<num;++i)
+		{
+			//3 packets per frame for video, one for audio
+			auto packet = video ?
+				CreatePacket(pt,i,i/3*6000,ssrc,i%3==2,800+(i*37)%400):
+				CreatePacket(pt,i,i*960,ssrc,true,100+(i*7)%40);
+			//Move state
+			bad = uniform(rng) < (bad ? 1-badToGood : goodToBad);
+			if (!bad)
+				reader->Add(ts++,packet.data(),packet.size());
+			else
+				lost++;
+			//Generate fec
+			if (encoder.AddPacket(packet.data(),packet.size()))
+			{
+				auto fec = CreatePacket(fecPt,fecSeq++,get4(packet.data(),4),fecSSRC,false,12+encoder.GetFECSize());
+				memcpy(fec.data()+12,encoder.GetFECData(),encoder.GetFECSize());
+				//Fec is lost too
+				bad = uniform(rng) < (bad ? 1-badToGood : goodToBad);
+				if (!bad)
+					reader->Add(ts++,fec.data(),fec.size());
+			}
+		}
+
+		PCAPTransportEmulator emulator;
+		Properties properties;
+		const char* media = video ? "video" : "audio";
+		properties.SetProperty(std::string(media)+".codecs.length","2");
+		properties.SetProperty(std::string(media)+".codecs.0.codec",video ? "VP8" : "opus");
+		properties.SetProperty(std::string(media)+".codecs.0.pt",std::to_string(pt));
+		properties.SetProperty(std::string(media)+".codecs.1.codec",scheme==fec::Scheme::FlexFEC ? "flexfec-03" : "ulpfec");
+		properties.SetProperty(std::string(media)+".codecs.1.pt",std::to_string(fecPt));
+		emulator.SetRemoteProperties(properties);
+
+		RTPIncomingSourceGroup incoming(video ? MediaFrame::Video : MediaFrame::Audio,emulator.GetTimeService());
+		incoming.media.ssrc = ssrc;
+		//Ulpfec does not carry the protected ssrc, so map its stream to the group
+		if (scheme==fec::Scheme::ULPFEC)
+			incoming.rtx.ssrc = fecSSRC;
+		emulator.AddIncomingSourceGroup(&incoming);
+
+		emulator.SetReader(reader);
+
+		QWORD start = getTime();
+		emulator.Play();
+		//Wait until all played
+		while (!reader->done)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		emulator.Stop();
+		QWORD elapsed = getTime()-start;
+
+		auto stats = emulator.GetFECStats();
+		emulator.RemoveIncomingSourceGroup(&incoming);
+
+		Log("-FECPlan::simulate() [scheme:%s,media:%s,group:%u,loss:%.0f%%,burst:%.0f,lost:%u,recovered:%llu,residual:%.2f%%,overhead:%.1f%%,time:%lluus]\n",
+			scheme==fec::Scheme::FlexFEC ? "flexfec" : "ulpfec",name,group,loss*100,burst,
+			lost,stats.recovered,(lost-stats.recovered)*100.0/num,
+			encoder.GetStats().GetOverhead(),elapsed);
+	}
+};
+
+FECPlan fecPlan;
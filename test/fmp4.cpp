@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "test.h"
+#include "tools.h"
+#include "FragmentedMP4Writer.h"
+
+class FragmentedMP4Plan: public TestPlan
+{
+public:
+	FragmentedMP4Plan() : TestPlan("Fragmented MP4 writer test plan")
+	{
+
+	}
+
+	virtual void Execute()
+	{
+		//Disk to test, tmp by default
+		const char* dir = getenv("FMP4_BENCH_DIR");
+		std::string path = dir ? dir : "/tmp";
+
+		FragmentedMP4Writer::Options buffered;
+		benchmarkRecordings(path,buffered,"buffered");
+
+		FragmentedMP4Writer::Options direct;
+		direct.directIO = true;
+		benchmarkRecordings(path,direct,"direct");
+	}
+
+	//Write recordings of 2mbps video and opus audio as fast as possible, and
+	//check how many could be sustained in real time
+	void benchmarkRecordings(const std::string& dir, const FragmentedMP4Writer::Options& options, const char* name)
+	{
+		const int recordings = 16;
+		const int seconds = 60;
+		const int fps = 30;
+		const DWORD frameSize = 2000000/8/fps;
+
+		std::vector<std::thread> threads;
+		std::vector<FragmentedMP4Writer::Stats> stats(recordings);
+
+		QWORD start = getTime();
+
+		for (int i=0;i<recordings;++i)
+		{
+			threads.emplace_back([&,i](){
+				std::vector<BYTE> frame(frameSize,0xAA);
+				std::vector<BYTE> opus(120,0x55);
+				std::string filename = dir + "/fmp4bench-" + std::to_string(i) + ".mp4";
+
+				FragmentedMP4Writer writer(options);
+				assert(writer.Open(filename.c_str()));
+				DWORD video = writer.AddVideoTrack(VideoCodec::VP8,90000,1280,720);
+				DWORD audio = writer.AddAudioTrack(AudioCodec::OPUS,48000,2);
+
+				//Key frame each 2 seconds, 50 audio packets per second
+				for (int j=0;j<seconds*fps;++j)
+				{
+					assert(writer.WriteSample(video,frame.data(),frame.size(),j*3000,3000,j%(2*fps)==0));
+					for (int k=j*50/fps;k<(j+1)*50/fps;++k)
+						assert(writer.WriteSample(audio,opus.data(),opus.size(),k*960,960,true));
+				}
+				assert(writer.Close());
+				stats[i] = writer.GetStats();
+				unlink(filename.c_str());
+			});
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+
+		QWORD elapsed = getTime() - start;
+
+		QWORD bytes = 0;
+		QWORD writes = 0;
+		for (const auto& stat : stats)
+		{
+			bytes += stat.bytes;
+			writes += stat.writes;
+		}
+
+		//Seconds of media written per second
+		double realtime = (double)recordings*seconds*1E6/elapsed;
+
+		Log("-FragmentedMP4Plan::benchmarkRecordings() [mode:%s,recordings:%d,seconds:%d,elapsed:%lluus,bytes:%llu,writes:%llu,rate:%.1fMB/s,realtime:%.0f]\n",
+			name,recordings,seconds,elapsed,bytes,writes,bytes/(double)elapsed,realtime);
+	}
+};
+
+FragmentedMP4Plan fmp4;
@@ -0,0 +1,246 @@
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "test.h"
+#include "HTTPServer.h"
+
+class HTTPPlan: public TestPlan
+{
+public:
+	HTTPPlan() : TestPlan("HTTP server test plan")
+	{
+
+	}
+
+	virtual void Execute()
+	{
+		testPipelining();
+		benchmarkRequests();
+	}
+
+	//Echoes body, ordered by the number in the uri
+	class EchoHandler : public HTTPServer::Handler
+	{
+	public:
+		virtual QWORD GetOrderingKey(const HTTPRequestParser::Request& request) override
+		{
+			auto uri = request.GetURI();
+			auto pos = uri.rfind('/');
+			return pos != std::string_view::npos ? atoi(std::string(uri.substr(pos+1)).c_str()) : 0;
+		}
+
+		virtual void ProcessRequest(const HTTPRequestParser::Request& request, HTTPServer::Response& response) override
+		{
+			QWORD key = GetOrderingKey(request);
+			if (key)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				//Check no other request for same key is being run
+				if (running[key]++)
+					overlapped = true;
+			}
+			//Simulate some work
+			if (delay)
+				usleep(delay);
+			response.contentType = "text/plain";
+			response.body.assign(request.GetBody().data(),request.GetBody().size());
+			if (key)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				running[key]--;
+			}
+		}
+
+		DWORD delay = 0;
+		bool overlapped = false;
+	private:
+		std::mutex mutex;
+		std::map<QWORD,int> running;
+	};
+
+	static int Connect(int port)
+	{
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(port);
+
+		int fd = socket(AF_INET,SOCK_STREAM,0);
+		assert(fd >= 0);
+		assert(connect(fd,(sockaddr*)&addr,sizeof(addr)) == 0);
+		return fd;
+	}
+
+	static std::string Request(const std::string& uri,const std::string& body,bool close = false)
+	{
+		return "POST " + uri + " HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Content-Type: text/plain\r\n"
+			+ (close ? "Connection: close\r\n" : "") +
+			"Content-Length: " + std::to_string(body.size()) + "\r\n"
+			"\r\n" + body;
+	}
+
+	//Reads next response, false if connection was closed
+	static bool ReadResponse(int fd,std::string& buffer,int& code,std::string& body)
+	{
+		size_t end;
+		//Read until headers are complete
+		while ((end = buffer.find("\r\n\r\n")) == std::string::npos)
+		{
+			char data[4096];
+			int len = read(fd,data,sizeof(data));
+			if (len <= 0)
+				return false;
+			buffer.append(data,len);
+		}
+		code = atoi(buffer.c_str() + 9);
+		auto pos = buffer.find("Content-Length: ");
+		assert(pos != std::string::npos && pos < end);
+		size_t length = atoi(buffer.c_str() + pos + 16);
+		//Read body
+		while (buffer.size() < end + 4 + length)
+		{
+			char data[4096];
+			int len = read(fd,data,sizeof(data));
+			if (len <= 0)
+				return false;
+			buffer.append(data,len);
+		}
+		body = buffer.substr(end + 4,length);
+		buffer.erase(0,end + 4 + length);
+		return true;
+	}
+
+	void testPipelining()
+	{
+		EchoHandler echo;
+		echo.delay = 500;
+		HTTPServer server;
+		server.AddHandler("/echo",&echo);
+		assert(server.Init(0,"127.0.0.1",2,4));
+		assert(server.GetPort());
+
+		//Send all requests at once on several connections, some of them sharing ordering key
+		const int clients = 8;
+		const int requests = 50;
+		std::vector<int> fds;
+		for (int i = 0; i < clients; ++i)
+		{
+			int fd = Connect(server.GetPort());
+			std::string pipelined;
+			for (int j = 0; j < requests; ++j)
+				pipelined += Request("/echo/" + std::to_string(j % 3 + 1),std::to_string(i) + "-" + std::to_string(j));
+			assert(write(fd,pipelined.data(),pipelined.size()) == (int)pipelined.size());
+			fds.push_back(fd);
+		}
+
+		//Responses come in order
+		for (int i = 0; i < clients; ++i)
+		{
+			std::string buffer;
+			for (int j = 0; j < requests; ++j)
+			{
+				int code;
+				std::string body;
+				assert(ReadResponse(fds[i],buffer,code,body));
+				assert(code == 200);
+				assert(body == std::to_string(i) + "-" + std::to_string(j));
+			}
+		}
+		assert(!echo.overlapped);
+
+		//Unknown uri and close after it
+		std::string request = Request("/unknown","",true);
+		assert(write(fds[0],request.data(),request.size()) == (int)request.size());
+		std::string buffer;
+		int code;
+		std::string body;
+		assert(ReadResponse(fds[0],buffer,code,body));
+		assert(code == 404);
+		assert(!ReadResponse(fds[0],buffer,code,body));
+
+		//Bad request closes the connection
+		const char* invalid = "GET / SIP/2.0\r\n\r\n";
+		assert(write(fds[1],invalid,strlen(invalid)) == (int)strlen(invalid));
+		assert(ReadResponse(fds[1],buffer,code,body));
+		assert(code == 400);
+		assert(!ReadResponse(fds[1],buffer,code,body));
+
+		//Server closes the rest
+		server.End();
+
+		for (int i = 2; i < clients; ++i)
+		{
+			char data[1];
+			assert(read(fds[i],data,1) == 0);
+		}
+
+		for (auto fd : fds)
+			close(fd);
+	}
+
+	void benchmarkRequests()
+	{
+		const int clients = 16;
+		const int depth = 16;
+		const QWORD duration = 2000000;
+
+		EchoHandler echo;
+		HTTPServer server;
+		server.AddHandler("/echo",&echo);
+		assert(server.Init(0,"127.0.0.1"));
+
+		std::string body(256,'x');
+		std::atomic<QWORD> total = 0;
+		QWORD start = getTime();
+
+		//Each client keeps a window of pipelined requests in flight on a keep-alive connection
+		std::vector<std::thread> threads;
+		for (int i = 0; i < clients; ++i)
+		{
+			threads.emplace_back([&,i](){
+				int fd = Connect(server.GetPort());
+				std::string request = Request("/echo/" + std::to_string(i + 1),body);
+				std::string window;
+				for (int j = 0; j < depth; ++j)
+					window += request;
+				std::string buffer;
+				QWORD count = 0;
+				while (getTime() - start < duration)
+				{
+					assert(write(fd,window.data(),window.size()) == (int)window.size());
+					for (int j = 0; j < depth; ++j)
+					{
+						int code;
+						std::string response;
+						assert(ReadResponse(fd,buffer,code,response));
+						assert(code == 200 && response.size() == body.size());
+					}
+					count += depth;
+				}
+				close(fd);
+				total += count;
+			});
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+
+		QWORD elapsed = getTime() - start;
+
+		server.End();
+
+		Log("-HTTPPlan::benchmarkRequests() [clients:%d,depth:%d,requests:%llu,elapsed:%lluus,rate:%.1f/s]\n",
+			clients,depth,(unsigned long long)total.load(),(unsigned long long)elapsed,total * 1E6 / elapsed);
+	}
+};
+
+HTTPPlan http;
@@ -0,0 +1,231 @@
+#include <unistd.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "test.h"
+#include "tools.h"
+#include "mp4streamer.h"
+#include "mp4recorder.h"
+
+class MP4StreamerPlan: public TestPlan
+{
+public:
+	//Collects the frames sent by a streamer, callbacks run on the shared loop
+	class Collector : public MP4Streamer::Listener
+	{
+	public:
+		virtual void onRTPPacket(RTPPacket &packet)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			//Payload is filled with the frame number
+			frames.push_back(packet.GetMediaData()[0]);
+			timestamps.push_back(packet.GetTimestamp());
+		}
+		virtual void onMediaFrame(const MediaFrame &frame) {}
+		virtual void onMediaFrame(DWORD ssrc, const MediaFrame &frame) {}
+		virtual void onTextFrame(TextFrame &text) {}
+		virtual void onEnd()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			//Loop once if requested, as MP4Player does
+			if (!ended++ && loop)
+				streamer->Play();
+			cond.notify_all();
+		}
+
+		bool WaitEnd(DWORD num)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			return cond.wait_for(lock,std::chrono::seconds(5),[&](){ return ended>=num; });
+		}
+
+		size_t GetNumFrames()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return frames.size();
+		}
+
+		MP4Streamer* streamer = nullptr;
+		bool loop = false;
+		std::mutex mutex;
+		std::condition_variable cond;
+		std::vector<BYTE> frames;
+		std::vector<DWORD> timestamps;
+		DWORD ended = 0;
+	};
+
+	static constexpr DWORD NumFrames = 50;
+	static constexpr DWORD FrameDuration = 160;
+public:
+	MP4StreamerPlan() : TestPlan("MP4 streamer test plan")
+	{
+
+	}
+
+	virtual void Execute()
+	{
+		//All streamers on the same loop
+		MP4Streamer::SetDefaultNumThreads(1);
+
+		std::string filename = "/tmp/mp4streamer-" + std::to_string(getpid()) + ".mp4";
+		assert(createFile(filename));
+
+		Log("testPlay\n");
+		testPlay(filename);
+		Log("testSeek\n");
+		testSeek(filename);
+		Log("testStop\n");
+		testStop(filename);
+
+		unlink(filename.c_str());
+	}
+
+	//Write one second of PCMU audio with a hint track, each frame filled with its number
+	bool createFile(const std::string& filename)
+	{
+		MP4FileHandle mp4 = MP4Create(filename.c_str(),0);
+		if (mp4==MP4_INVALID_FILE_HANDLE)
+			return false;
+
+		mp4track track(mp4);
+		track.CreateAudioTrack(AudioCodec::PCMU,8000);
+
+		for (DWORD i=0;i<NumFrames;++i)
+		{
+			std::vector<BYTE> data(FrameDuration,i);
+			AudioFrame frame(AudioCodec::PCMU);
+			frame.SetClockRate(8000);
+			frame.SetTimestamp(i*FrameDuration);
+			frame.SetDuration(FrameDuration);
+			frame.SetMedia(data.data(),data.size());
+			track.WriteAudioFrame(frame);
+		}
+		track.Close();
+
+		MP4Close(mp4);
+
+		return true;
+	}
+
+	//Check frames are sent in order starting at the first one
+	void checkFrames(const Collector& collector, size_t start, size_t first, size_t num)
+	{
+		assert(collector.frames.size()>=start+num);
+		for (size_t i=0;i<num;++i)
+		{
+			assert(collector.frames[start+i]==first+i);
+			assert(collector.timestamps[start+i]==(first+i)*FrameDuration);
+		}
+	}
+
+	void testPlay(const std::string& filename)
+	{
+		Collector first;
+		Collector second;
+		MP4Streamer one(&first);
+		MP4Streamer other(&second);
+		first.streamer = &one;
+		first.loop = true;
+
+		assert(one.Open(filename.c_str()));
+		assert(other.Open(filename.c_str()));
+
+		//Play both on the same loop, first one loops once from onEnd
+		assert(one.Play());
+		assert(other.Play());
+		assert(second.WaitEnd(1));
+		assert(first.WaitEnd(2));
+
+		//Loop is served from the cache filled on first playback
+		checkFrames(first,0,0,NumFrames);
+		checkFrames(first,NumFrames,0,NumFrames);
+		checkFrames(second,0,0,NumFrames);
+
+		//Now it is shared with new streamers
+		Collector third;
+		MP4Streamer another(&third);
+		assert(another.Open(filename.c_str()));
+		assert(another.Play());
+		assert(third.WaitEnd(1));
+		checkFrames(third,0,0,NumFrames);
+
+		one.Close();
+		other.Close();
+		another.Close();
+	}
+
+	void testSeek(const std::string& filename)
+	{
+		//Use another file so cache is not shared with previous test
+		std::string copy = filename + ".seek";
+		assert(createFile(copy));
+
+		Collector collector;
+		MP4Streamer streamer(&collector);
+		assert(streamer.Open(copy.c_str()));
+
+		//Play some frames, so cache is partially filled
+		assert(streamer.Play());
+		while (collector.GetNumFrames()<5)
+			usleep(1000);
+
+		//Seek past the cached frames
+		assert(streamer.Seek(600));
+		assert(collector.WaitEnd(1));
+
+		//Frames after the seek are read from the file
+		size_t played = collector.frames.size();
+		size_t seeked = 600*8/FrameDuration;
+		checkFrames(collector,played-(NumFrames-seeked),seeked,NumFrames-seeked);
+
+		//Play again from the start, cache is refilled in order
+		assert(streamer.Play());
+		assert(collector.WaitEnd(2));
+		checkFrames(collector,played,0,NumFrames);
+
+		//Seek backwards into the cached frames
+		assert(streamer.Seek(200));
+		assert(collector.WaitEnd(3));
+		seeked = 200*8/FrameDuration;
+		checkFrames(collector,played+NumFrames,seeked,NumFrames-seeked);
+
+		streamer.Close();
+		unlink(copy.c_str());
+	}
+
+	void testStop(const std::string& filename)
+	{
+		Collector collector;
+		MP4Streamer streamer(&collector);
+		assert(streamer.Open(filename.c_str()));
+
+		//Play some frames
+		assert(streamer.Play());
+		while (collector.GetNumFrames()<5)
+			usleep(1000);
+
+		//Once stopped no more frames are sent
+		assert(streamer.Stop());
+		size_t num = collector.GetNumFrames();
+		usleep(100000);
+		assert(collector.GetNumFrames()==num);
+		assert(!collector.ended);
+
+		//Not playing anymore
+		assert(!streamer.Stop());
+
+		//Closing while playing stops it too
+		assert(streamer.Play());
+		while (collector.GetNumFrames()<num+5)
+			usleep(1000);
+		assert(streamer.Close());
+		num = collector.GetNumFrames();
+		usleep(100000);
+		assert(collector.GetNumFrames()==num);
+		assert(!collector.ended);
+	}
+};
+
+MP4StreamerPlan mp4StreamerPlan;
@@ -0,0 +1,111 @@
+#include <vector>
+#include "test.h"
+#include "tools.h"
+#include "video.h"
+#include "audio.h"
+#include "mpegts/demuxer.h"
+#include "mpegts/muxer.h"
+
+class MpegTsPlan: public TestPlan
+{
+public:
+	MpegTsPlan() : TestPlan("MPEG-TS muxer and demuxer test plan")
+	{
+
+	}
+
+	virtual void Execute()
+	{
+		benchmark(2000000,"sd");
+		benchmark(8000000,"hd");
+	}
+
+	//Mux and demux a minute of h264 and aac at the given bitrate and check
+	//how many streams a core could sustain
+	void benchmark(DWORD bitrate, const char* name)
+	{
+		const int seconds = 60;
+		const int fps = 30;
+		const DWORD frameSize = bitrate/8/fps;
+
+		class Buffered : public mpegts::Muxer::Output, public MediaFrame::Listener
+		{
+		public:
+			void onTransportPackets(const BYTE* data, DWORD size) override	{ ts.insert(ts.end(),data,data+size);	}
+			void onMediaFrame(const MediaFrame& frame) override		{ frames++;	}
+			void onMediaFrame(DWORD ssrc, const MediaFrame& frame) override	{ frames++;	}
+
+			std::vector<BYTE> ts;
+			DWORD frames = 0;
+		} buffered;
+
+		//Single slice frames with in band sps and pps on key frames
+		const BYTE sps[] = {0x67, 0x42, 0xc0, 0x0d, 0x95, 0xa0, 0x50, 0x67, 0xe7, 0x84, 0x00, 0x00, 0x0f,
+				    0xa0, 0x00, 0x03, 0xa9, 0x80, 0x3c, 0x70, 0x8a, 0x80};
+		const BYTE pps[] = {0x68, 0xce, 0x3c, 0x80};
+		std::vector<BYTE> key;
+		std::vector<BYTE> delta;
+		for (auto nal : {std::vector<BYTE>(sps,sps+sizeof(sps)),std::vector<BYTE>(pps,pps+sizeof(pps)),std::vector<BYTE>(frameSize,0xAA)})
+		{
+			BYTE prefix[4];
+			if (nal.size()==frameSize)
+				nal[0] = 0x65;
+			set4(prefix,0,nal.size());
+			key.insert(key.end(),prefix,prefix+4);
+			key.insert(key.end(),nal.begin(),nal.end());
+		}
+		delta.assign(key.end()-frameSize-4,key.end());
+		delta[4] = 0x41;
+
+		VideoFrame video(VideoCodec::H264,key.size());
+		video.SetClockRate(90000);
+		AudioFrame audio(AudioCodec::AAC);
+		audio.SetClockRate(48000);
+		audio.SetNumChannels(2);
+		std::vector<BYTE> aac(380,0x55);
+
+		mpegts::Muxer muxer(&buffered);
+		muxer.AddStream(MediaFrame::Video,VideoCodec::H264);
+		muxer.AddStream(MediaFrame::Audio,AudioCodec::AAC);
+
+		QWORD start = getTime();
+
+		DWORD audioNum = 0;
+		for (int i=0;i<seconds*fps;++i)
+		{
+			//Key frame each 2 seconds
+			bool intra = i%(2*fps)==0;
+			video.SetMedia(intra ? key.data() : delta.data(),intra ? key.size() : delta.size());
+			video.SetIntra(intra);
+			video.SetTimestamp(i*3000);
+			video.SetTime(i*1000/fps);
+			muxer.Mux(video);
+			for (;audioNum*1024*fps<(i+1)*48000u;++audioNum)
+			{
+				audio.SetMedia(aac.data(),aac.size());
+				audio.SetTimestamp(audioNum*1024);
+				audio.SetTime(audioNum*1024/48);
+				muxer.Mux(audio);
+			}
+		}
+		muxer.Flush();
+
+		QWORD muxed = getTime();
+
+		//Demux in datagram sized chunks
+		mpegts::Demuxer demuxer(&buffered);
+		for (size_t pos=0;pos<buffered.ts.size();pos+=mpegts::UDPOutput::DatagramSize)
+			demuxer.Process(buffered.ts.data()+pos,std::min<size_t>(mpegts::UDPOutput::DatagramSize,buffered.ts.size()-pos),0);
+		demuxer.Flush();
+
+		QWORD demuxed = getTime();
+
+		double mbits = buffered.ts.size()*8/1E6;
+		Log("-MpegTsPlan::benchmark() [name:%s,bytes:%zu,frames:%llu/%u,mux:%lluus,demux:%lluus,mux:%.0fMbps,demux:%.0fMbps,streams:%.0f]\n",
+			name,buffered.ts.size(),muxer.GetStats().frames,buffered.frames,muxed-start,demuxed-muxed,
+			mbits*1E6/(muxed-start),mbits*1E6/(demuxed-muxed),
+			seconds*1E6/(demuxed-start));
+	}
+};
+
+MpegTsPlan mpegtsPlan;
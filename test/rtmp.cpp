@@ -4,8 +4,10 @@
  * and open the template in the editor.
  */
 #include <memory>
+#include <vector>
 #include "test.h"
 #include "rtmp/rtmpmessage.h"
+#include "rtmp/rtmpchunk.h"
 
 class RTMPPlan: public TestPlan
 {
@@ -20,6 +22,8 @@ public:
 	{
 		testFailedCommand();
 		testMetadata();
+		testSharedChunks();
+		benchmarkSubscribers();
 	}
 	
 	void testFailedCommand()
@@ -77,6 +81,135 @@ public:
 		assert(meta.Parse(buffer+1, sizeof(buffer)-1));
 		meta.Dump();
 	}
+
+	static RTMPVideoFrame* createFrame(DWORD size)
+	{
+		auto frame = new RTMPVideoFrame(0, size);
+		frame->SetVideoCodec(RTMPVideoFrame::AVC);
+		frame->SetFrameType(RTMPVideoFrame::INTER);
+		frame->SetAVCType(RTMPVideoFrame::AVCNALU);
+		frame->SetAVCTS(0);
+		//Fill it
+		for (DWORD i = 0; i < size; ++i)
+			frame->GetMediaData()[i] = i;
+		frame->SetMediaSize(size);
+		return frame;
+	}
+
+	//Get all chunks, with copies
+	static std::vector<BYTE> copyChunks(RTMPChunkOutputStream& stream, DWORD maxChunkSize)
+	{
+		std::vector<BYTE> out;
+		BYTE data[4096 + RTMPChunk::MaxHeaderSize];
+		DWORD len;
+		while ((len = stream.GetNextChunk(data, sizeof(data), maxChunkSize)))
+			out.insert(out.end(), data, data + len);
+		return out;
+	}
+
+	//Get all chunks, referencing the payload
+	static std::vector<BYTE> gatherChunks(RTMPChunkOutputStream& stream, DWORD maxChunkSize, const BYTE* shared, DWORD sharedSize)
+	{
+		std::vector<BYTE> out;
+		RTMPChunk chunk;
+		while (stream.GetNextChunk(chunk, maxChunkSize))
+		{
+			//Payload must not be copied
+			assert(chunk.payload >= shared && chunk.payload + chunk.payloadLen <= shared + sharedSize);
+			out.insert(out.end(), chunk.header, chunk.header + chunk.headerLen);
+			out.insert(out.end(), chunk.payload, chunk.payload + chunk.payloadLen);
+		}
+		return out;
+	}
+
+	void testSharedChunks()
+	{
+		Log("-testSharedChunks\n");
+
+		std::unique_ptr<RTMPVideoFrame> frame(createFrame(3000));
+
+		//Not cached by default
+		assert(frame->GetSerialized() != frame->GetSerialized());
+
+		//Cached while enabled
+		assert(frame->EnableSerializedCache());
+		assert(!frame->EnableSerializedCache());
+		auto serialized = frame->GetSerialized();
+		assert(serialized == frame->GetSerialized());
+
+		for (DWORD maxChunkSize : { 128u, 1000u, 4096u })
+		{
+			//Old path, cloning the frame for each connection
+			RTMPChunkOutputStream cloned(5);
+			cloned.SendMessage(new RTMPMessage(1, 100, frame->Clone()));
+			cloned.SendMessage(new RTMPMessage(1, 133, frame->Clone()));
+			auto expected = copyChunks(cloned, maxChunkSize);
+
+			//Shared payload
+			RTMPChunkOutputStream shared(5);
+			shared.SendMessage(new RTMPMessage(1, 100, RTMPMessage::Video, serialized, frame->GetSize()));
+			shared.SendMessage(new RTMPMessage(1, 133, RTMPMessage::Video, serialized, frame->GetSize()));
+			auto gathered = gatherChunks(shared, maxChunkSize, serialized.get(), frame->GetSize());
+
+			assert(gathered == expected);
+		}
+
+		//Released when disabled, connections keep their own reference
+		frame->DisableSerializedCache();
+		assert(serialized != frame->GetSerialized());
+		assert(serialized.use_count() == 1);
+	}
+
+	void benchmarkSubscribers()
+	{
+		const int subscribers = 100;
+		const int frames = 200;
+		const DWORD maxChunkSize = 4096;
+
+		Logger::EnableDebug(false);
+
+		std::unique_ptr<RTMPVideoFrame> frame(createFrame(30000));
+
+		//Clone, serialize and copy chunks for each subscriber
+		std::vector<std::unique_ptr<RTMPChunkOutputStream>> streams;
+		for (int i = 0; i < subscribers; ++i)
+			streams.emplace_back(new RTMPChunkOutputStream(5));
+
+		QWORD ini = getTime();
+		size_t copied = 0;
+		for (int n = 0; n < frames; ++n)
+			for (auto& stream : streams)
+			{
+				stream->SendMessage(new RTMPMessage(1, n * 33, frame->Clone()));
+				copied += copyChunks(*stream, maxChunkSize).size();
+			}
+		QWORD cloning = getTime() - ini;
+
+		//Serialize once per frame and gather
+		ini = getTime();
+		size_t gathered = 0;
+		for (int n = 0; n < frames; ++n)
+		{
+			frame->EnableSerializedCache();
+			for (auto& stream : streams)
+			{
+				auto serialized = frame->GetSerialized();
+				stream->SendMessage(new RTMPMessage(1, n * 33, RTMPMessage::Video, serialized, frame->GetSize()));
+				RTMPChunk chunk;
+				while (stream->GetNextChunk(chunk, maxChunkSize))
+					gathered += chunk.GetSize();
+			}
+			frame->DisableSerializedCache();
+		}
+		QWORD sharing = getTime() - ini;
+
+		Logger::EnableDebug(true);
+
+		assert(copied == gathered);
+
+		Log("-RTMPPlan::benchmarkSubscribers() [subscribers:%d,frames:%d,size:%u,cloning:%lluus,sharing:%lluus]\n",
+			subscribers, frames, frame->GetSize(), cloning, sharing);
+	}
 };
 
 RTMPPlan rtmp;
@@ -0,0 +1,354 @@
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "test.h"
+#include "tools.h"
+#include "stunmessage.h"
+#include "RTPTransport.h"
+#include "RTPSmoother.h"
+#include "rtpsession.h"
+#include "video.h"
+
+//Minimal receiver report
+static const BYTE rtcp[] = {0x80,0xC9,0x00,0x01,0x00,0x00,0x00,0x01};
+
+class RTPTransportPlan: public TestPlan
+{
+public:
+	//Remote peer on a loopback udp socket
+	class Peer
+	{
+	public:
+		Peer()
+		{
+			fd = socket(AF_INET,SOCK_DGRAM,0);
+			sockaddr_in addr = {};
+			addr.sin_family = AF_INET;
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			assert(bind(fd,(sockaddr*)&addr,sizeof(addr))==0);
+			socklen_t len = sizeof(addr);
+			assert(getsockname(fd,(sockaddr*)&addr,&len)==0);
+			port = ntohs(addr.sin_port);
+			//Do not wait forever
+			timeval timeout = {1,0};
+			setsockopt(fd,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+		}
+		~Peer()
+		{
+			close(fd);
+		}
+
+		void SendTo(int to, const BYTE* data, DWORD size)
+		{
+			sockaddr_in addr = {};
+			addr.sin_family = AF_INET;
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			addr.sin_port = htons(to);
+			assert(sendto(fd,data,size,0,(sockaddr*)&addr,sizeof(addr))==(ssize_t)size);
+		}
+
+		//Get next datagram and the port it was sent from, -1 on timeout
+		int Recv(BYTE* data, DWORD size, int* from)
+		{
+			sockaddr_in addr = {};
+			socklen_t len = sizeof(addr);
+			int num = recvfrom(fd,data,size,0,(sockaddr*)&addr,&len);
+			if (from)
+				*from = ntohs(addr.sin_port);
+			return num;
+		}
+
+		//Get next rtcp datagram skipping the rest, -1 on timeout
+		int RecvRTCP(BYTE* data, DWORD size, int* from)
+		{
+			int num;
+			while ((num = Recv(data,size,from))>0 && !(num>=8 && data[1]>=200 && data[1]<=204));
+			return num;
+		}
+
+		int fd;
+		int port;
+	};
+
+	class Listener : public RTPTransport::Listener
+	{
+	public:
+		virtual void onRemotePeer(const char* ip, const short port) {}
+		virtual void onRTPPacket(const BYTE* buffer, DWORD size)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			rtp++;
+			cond.notify_all();
+		}
+		virtual void onRTCPPacket(const BYTE* buffer, DWORD size)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			rtcp++;
+			cond.notify_all();
+		}
+
+		bool WaitRTCP(DWORD num)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			return cond.wait_for(lock,std::chrono::seconds(1),[&](){ return rtcp>=num; });
+		}
+
+		std::mutex mutex;
+		std::condition_variable cond;
+		DWORD rtp = 0;
+		DWORD rtcp = 0;
+	};
+
+	class SessionListener : public RTPSession::Listener
+	{
+	public:
+		virtual void onFPURequested(RTPSession *session) {}
+		virtual void onReceiverEstimatedMaxBitrate(RTPSession *session,DWORD bitrate) {}
+		virtual void onTempMaxMediaStreamBitrateRequest(RTPSession *session,DWORD bitrate,DWORD overhead) {}
+	};
+public:
+	RTPTransportPlan() : TestPlan("RTP transport test plan")
+	{
+
+	}
+
+	virtual void Execute()
+	{
+		Log("testMuxRTCP\n");
+		testMuxRTCP();
+		Log("testCloseWhileSending\n");
+		testCloseWhileSending();
+		Log("testSTUNOnRTCPPort\n");
+		testSTUNOnRTCPPort();
+		Log("testSmoother\n");
+		testSmoother();
+		Log("testFECOrder\n");
+		testFECOrder();
+	}
+
+	static Packet CreateRTCP()
+	{
+		Packet packet;
+		memcpy(packet.GetData(),rtcp,sizeof(rtcp));
+		packet.SetSize(sizeof(rtcp));
+		return packet;
+	}
+
+	void testMuxRTCP()
+	{
+		Peer peer;
+		Listener listener;
+		RTPTransport transport(&listener);
+		char ip[] = "127.0.0.1";
+		BYTE data[MTU];
+		int from = 0;
+
+		//Only rtp port is opened when muxing from the start
+		transport.SetMuxRTCP(1);
+		assert(transport.Init());
+		int port = transport.GetLocalPort();
+		assert(transport.SetRemotePort(ip,peer.port));
+
+		//Rtcp is received on the rtp port
+		peer.SendTo(port,rtcp,sizeof(rtcp));
+		assert(listener.WaitRTCP(1));
+
+		//And sent from it
+		assert(transport.SendRTCPPacket(CreateRTCP()));
+		assert(peer.RecvRTCP(data,sizeof(data),&from)==sizeof(rtcp));
+		assert(from==port);
+
+		transport.End();
+	}
+
+	void testCloseWhileSending()
+	{
+		Peer peer;
+		Listener listener;
+		RTPTransport transport(&listener);
+		char ip[] = "127.0.0.1";
+		BYTE data[MTU];
+		int from = 0;
+
+		//Open both ports
+		assert(transport.Init());
+		int port = transport.GetLocalPort();
+		assert(transport.SetRemotePort(ip,peer.port));
+
+		//Rtcp is sent from the rtcp port
+		assert(transport.SendRTCPPacket(CreateRTCP()));
+		assert(peer.RecvRTCP(data,sizeof(data),&from)==sizeof(rtcp));
+		assert(from==port+1);
+
+		//Keep sending from another thread while sockets are closed
+		std::atomic<bool> running = true;
+		std::thread sender([&](){
+			while (running)
+			{
+				transport.SendRTCPPacket(CreateRTCP());
+				Packet packet;
+				memcpy(packet.GetData(),rtcp,sizeof(rtcp));
+				packet.GetData()[1] = 96;
+				packet.SetSize(sizeof(rtcp));
+				transport.SendRTPPacket(std::move(packet));
+			}
+		});
+
+		//Close rtcp port, sent from the rtp one after it
+		transport.SetMuxRTCP(1);
+		while (peer.RecvRTCP(data,sizeof(data),&from)>0 && from!=port);
+		assert(from==port);
+
+		//Close all while sending
+		transport.End();
+		running = false;
+		sender.join();
+
+		//Nothing is sent after it
+		while (peer.Recv(data,sizeof(data),nullptr)>0);
+		transport.SendRTCPPacket(CreateRTCP());
+		assert(peer.Recv(data,sizeof(data),nullptr)<0);
+	}
+
+	void testSTUNOnRTCPPort()
+	{
+		Peer peer;
+		Listener listener;
+		RTPTransport transport(&listener);
+		BYTE data[MTU];
+		int from = 0;
+
+		//Open both ports
+		assert(transport.Init());
+		int port = transport.GetLocalPort();
+
+		//Send binding request to the rtcp port
+		BYTE transId[12] = {};
+		set8(transId,4,getTime());
+		STUNMessage request(STUNMessage::Request,STUNMessage::Binding,transId);
+		DWORD len = request.NonAuthenticatedFingerPrint(data,sizeof(data));
+		peer.SendTo(port+1,data,len);
+
+		//Response comes from the rtcp port
+		int num = peer.Recv(data,sizeof(data),&from);
+		assert(num>0);
+		assert(from==port+1);
+		std::unique_ptr<STUNMessage> response(STUNMessage::Parse(data,num));
+		assert(response);
+		assert(response->GetType()==STUNMessage::Response);
+		assert(memcmp(response->GetTransactionId(),transId,sizeof(transId))==0);
+
+		//Rtcp now goes to the peer on the rtcp port
+		assert(transport.SendRTCPPacket(CreateRTCP()));
+		assert(peer.RecvRTCP(data,sizeof(data),&from)==sizeof(rtcp));
+		assert(from==port+1);
+
+		transport.End();
+	}
+
+	void testSmoother()
+	{
+		Peer peer;
+		SessionListener listener;
+		RTPSession session(MediaFrame::Video,&listener);
+		char ip[] = "127.0.0.1";
+		BYTE data[MTU];
+
+		assert(session.Init());
+		assert(session.SetRemotePort(ip,peer.port));
+		RTPMap rtpMap;
+		RTPMap aptMap;
+		rtpMap.SetCodecForType(96,VideoCodec::VP8);
+		session.SetSendingRTPMap(rtpMap,aptMap);
+
+		RTPSmoother smoother;
+		smoother.Init(&session);
+
+		//Frame of 10 packets sent over 100ms
+		VideoFrame frame(VideoCodec::VP8,10000);
+		std::vector<BYTE> media(10000,0xAA);
+		frame.SetMedia(media.data(),media.size());
+		frame.SetClockRate(90000);
+		frame.SetTimestamp(0);
+		for (DWORD i=0;i<10;++i)
+			frame.AddRtpPacket(i*1000,1000);
+		assert(smoother.SendFrame(&frame,100));
+
+		//Get arrival times of the video packets
+		std::vector<QWORD> times;
+		while (times.size()<10)
+		{
+			int num = peer.Recv(data,sizeof(data),nullptr);
+			assert(num>0);
+			if (num>12 && (data[1] & 0x7F)==96)
+				times.push_back(getTimeMS());
+		}
+
+		//Spread over the frame duration, not sent in a burst
+		QWORD spread = times.back() - times.front();
+		Log("-RTPTransportPlan::testSmoother() [spread:%llums]\n",spread);
+		assert(spread>=70 && spread<200);
+
+		smoother.End();
+		session.End();
+	}
+
+	void testFECOrder()
+	{
+		Peer peer;
+		SessionListener listener;
+		RTPSession session(MediaFrame::Video,&listener);
+		char ip[] = "127.0.0.1";
+		BYTE data[MTU];
+
+		//Protect each 5 packets with flexfec
+		Properties properties;
+		properties.SetProperty("useFEC",1);
+		properties.SetProperty("ssrcFEC",1234);
+		properties.SetProperty("fecGroup",5);
+		session.SetProperties(properties);
+
+		assert(session.Init());
+		assert(session.SetRemotePort(ip,peer.port));
+		RTPMap rtpMap;
+		RTPMap aptMap;
+		rtpMap.SetCodecForType(96,VideoCodec::VP8);
+		rtpMap.SetCodecForType(97,VideoCodec::FLEXFEC);
+		session.SetSendingRTPMap(rtpMap,aptMap);
+
+		//Send two groups
+		std::vector<BYTE> payload(100,0xAA);
+		for (DWORD i=0;i<10;++i)
+		{
+			auto packet = std::make_shared<RTPPacket>(MediaFrame::Video,VideoCodec::VP8);
+			packet->SetPayload(payload.data(),payload.size());
+			assert(session.SendPacket(packet,i*3000));
+		}
+
+		//Get payload types in the order they are sent
+		std::vector<BYTE> types;
+		while (types.size()<12)
+		{
+			int num = peer.Recv(data,sizeof(data),nullptr);
+			assert(num>0);
+			BYTE type = data[1] & 0x7F;
+			if (num>12 && (type==96 || type==97))
+				types.push_back(type);
+		}
+
+		//Fec packet goes after the last packet of its group
+		for (DWORD i=0;i<types.size();++i)
+			assert(types[i]==(i%6==5 ? 97 : 96));
+
+		session.End();
+	}
+};
+
+RTPTransportPlan rtpTransportPlan;
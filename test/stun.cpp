@@ -1,6 +1,7 @@
 #include <memory>
 #include "test.h"
 #include "stunmessage.h"
+#include <openssl/hmac.h>
 
 class StunPlan: public TestPlan
 {
@@ -14,6 +15,8 @@ public:
 	virtual void Execute()
 	{
 		testAuth();
+		testView();
+		benchmarkChecks();
 	}
 	
 	void testAuth()
@@ -45,11 +48,149 @@ public:
 		
 		parsed->Dump();
 		//Ensure it is athenticated correctly
-		assert(parsed->CheckAuthenticatedFingerPrint(data,size,"pwd"));
+		assert(parsed->CheckAuthenticatedFingerPrint(data,len,"pwd"));
 		
 		delete parsed;
 		
 	}
+
+	size_t createRequest(BYTE* data,size_t size,const char* pwd,DWORD extra = 0)
+	{
+		//Create trans id
+		BYTE transId[12];
+		//Set first to 0
+		set4(transId,0,0);
+		//Set timestamp as trans id
+		set8(transId,4,getTime());
+		//Create binding request like the browsers send
+		STUNMessage request(STUNMessage::Request,STUNMessage::Binding,transId);
+		request.AddUsernameAttribute("localusername","remoteusername");
+		request.AddAttribute(STUNMessage::Attribute::IceControlling,(QWORD)1);
+		request.AddAttribute(STUNMessage::Attribute::UseCandidate);
+		request.AddAttribute(STUNMessage::Attribute::Priority,(DWORD)33554431);
+		//Add unknown comprehension optional attributes
+		for (DWORD i=0;i<extra;++i)
+			request.AddAttribute((STUNMessage::Attribute::Type)0x8030,i);
+		//Serialize and autenticate
+		return request.AuthenticatedFingerPrint(data,size,pwd);
+	}
+
+	void testView()
+	{
+		const char* pwd = "0123456789abcdefghijkl";
+		//Longer than the sha1 block, so key is hashed
+		std::string longPwd(100,'x');
+
+		uint8_t data[1024];
+		size_t len = createRequest(data,sizeof(data),pwd);
+		assert(len);
+
+		//Precomputed keys must match openssl hmac
+		for (const char* key : {pwd,longPwd.c_str()})
+		{
+			BYTE expected[EVP_MAX_MD_SIZE];
+			BYTE calculated[STUNMessage::Key::Size];
+			unsigned int expectedLen = 0;
+			HMAC(EVP_sha1(),key,strlen(key),data,len,expected,&expectedLen);
+			STUNMessage::Key(key).Calculate(data,len,calculated);
+			assert(expectedLen==STUNMessage::Key::Size);
+			assert(memcmp(expected,calculated,expectedLen)==0);
+		}
+
+		//Parse without copying
+		STUNMessage::View view;
+		assert(view.Parse(data,len));
+		assert(view.GetType()==STUNMessage::Request);
+		assert(view.GetMethod()==STUNMessage::Binding);
+		assert(view.GetUsername()=="remoteusername:localusername");
+		assert(view.GetPriority()==33554431);
+		assert(view.HasAttribute(STUNMessage::Attribute::UseCandidate));
+		assert(!view.HasAttribute(STUNMessage::Attribute::IceControlled));
+
+		//Check authentication with precomputed keys
+		assert(view.CheckAuthenticatedFingerPrint(STUNMessage::Key(pwd)));
+		assert(!view.CheckAuthenticatedFingerPrint(STUNMessage::Key("wrong")));
+		assert(!view.CheckAuthenticatedFingerPrint(STUNMessage::Key()));
+
+		//Check keys longer than the block
+		len = createRequest(data,sizeof(data),longPwd.c_str());
+		assert(view.Parse(data,len));
+		assert(view.CheckAuthenticatedFingerPrint(STUNMessage::Key(longPwd.c_str())));
+		len = createRequest(data,sizeof(data),pwd);
+		assert(view.Parse(data,len));
+
+		//Attributes that don't fit are skipped but the message is still valid
+		len = createRequest(data,sizeof(data),pwd,STUNMessage::View::MaxAttributes);
+		assert(view.Parse(data,len));
+		assert(view.GetNumAttributes()==STUNMessage::View::MaxAttributes);
+		assert(view.GetUsername()=="remoteusername:localusername");
+		assert(view.GetPriority()==33554431);
+		assert(view.HasAttribute(STUNMessage::Attribute::FingerPrint));
+		assert(view.CheckAuthenticatedFingerPrint(STUNMessage::Key(pwd)));
+		len = createRequest(data,sizeof(data),pwd);
+		assert(view.Parse(data,len));
+
+		//Corrupted messages are rejected
+		data[len-1] ^= 0xFF;
+		assert(!view.Parse(data,len));
+		data[len-1] ^= 0xFF;
+		assert(!view.Parse(data,len-4));
+
+		//Response must be the same as the one serialized from the message
+		uint8_t expected[1024];
+		uint8_t response[1024];
+		auto stun = std::unique_ptr<STUNMessage>(STUNMessage::Parse(data,len));
+		auto resp = std::unique_ptr<STUNMessage>(stun->CreateResponse());
+		resp->AddXorAddressAttribute(htonl(0x7F000001),htons(5000));
+		size_t expectedLen = resp->AuthenticatedFingerPrint(expected,sizeof(expected),pwd);
+		size_t responseLen = view.CreateBindingResponse(response,sizeof(response),htonl(0x7F000001),htons(5000),STUNMessage::Key(pwd));
+		assert(expectedLen && expectedLen==responseLen);
+		assert(memcmp(expected,response,responseLen)==0);
+
+		//And parseable
+		assert(view.Parse(response,responseLen));
+		assert(view.GetType()==STUNMessage::Response);
+		assert(view.CheckAuthenticatedFingerPrint(STUNMessage::Key(pwd)));
+	}
+
+	void benchmarkChecks()
+	{
+		const char* pwd = "0123456789abcdefghijkl";
+		const int checks = 200000;
+
+		uint8_t data[1024];
+		uint8_t response[1024];
+		size_t len = createRequest(data,sizeof(data),pwd);
+
+		//Allocating path: parse, authenticate with password and serialize response
+		QWORD ini = getTime();
+		for (int i=0;i<checks;++i)
+		{
+			auto stun = std::unique_ptr<STUNMessage>(STUNMessage::Parse(data,len));
+			assert(stun && stun->CheckAuthenticatedFingerPrint(data,len,pwd));
+			auto resp = std::unique_ptr<STUNMessage>(stun->CreateResponse());
+			resp->AddXorAddressAttribute(htonl(0x7F000001),htons(5000));
+			assert(resp->AuthenticatedFingerPrint(response,sizeof(response),pwd));
+		}
+		QWORD allocating = getTime() - ini;
+
+		//Fast path: view parse, precomputed key and response written in place
+		STUNMessage::Key key(pwd);
+		ini = getTime();
+		for (int i=0;i<checks;++i)
+		{
+			STUNMessage::View view;
+			assert(view.Parse(data,len) && view.CheckAuthenticatedFingerPrint(key));
+			assert(view.CreateBindingResponse(response,sizeof(response),htonl(0x7F000001),htons(5000),key));
+		}
+		QWORD fast = getTime() - ini;
+
+		Log("-StunPlan::benchmarkChecks() [checks:%d,allocating:%.0f/s,fast:%.0f/s]\n",
+			checks,
+			checks * 1E6 / allocating,
+			checks * 1E6 / fast
+		);
+	}
 	
 };
 
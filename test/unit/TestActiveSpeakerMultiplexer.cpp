@@ -0,0 +1,140 @@
+#include "TestCommon.h"
+#include "ActiveSpeakerMultiplexer.h"
+#include "EventLoop.h"
+#include "codecs.h"
+
+#include <set>
+#include <unistd.h>
+
+namespace
+{
+	//Incoming stream delivering the packets on the loop
+	class MockRTPIncomingMediaStream : public RTPIncomingMediaStream
+	{
+	public:
+		MockRTPIncomingMediaStream(TimeService& timeService) : timeService(timeService) {};
+		virtual void AddListener(Listener* listener) { timeService.Sync([=](auto) { listeners.insert(listener); }); };
+		virtual void RemoveListener(Listener* listener) { timeService.Sync([=](auto) { listeners.erase(listener); }); };
+		virtual DWORD GetMediaSSRC() const { return 0x1234; };
+		virtual TimeService& GetTimeService() { return timeService; };
+		virtual void Mute(bool muting) {};
+
+		void Send(const RTPPacket::shared& packet)
+		{
+			timeService.Sync([=](auto) {
+				for (auto listener : listeners)
+					listener->onRTP(this, packet);
+			});
+		}
+
+		size_t GetNumListeners()
+		{
+			size_t num = 0;
+			timeService.Sync([&](auto) { num = listeners.size(); });
+			return num;
+		}
+	private:
+		TimeService& timeService;
+		std::set<Listener*> listeners;
+	};
+
+	class MockRTPSender : public RTPSender
+	{
+	public:
+		virtual int Enqueue(const RTPPacket::shared& packet)
+		{
+			packets.push_back(packet);
+			return 0;
+		};
+
+		std::vector<RTPPacket::shared> packets;
+	};
+
+	class MockListener : public ActiveSpeakerMultiplexer::Listener
+	{
+	public:
+		virtual void onActiveSpeakerChanged(uint32_t speakerId, uint32_t multiplexId) { changed = true; }
+		virtual void onActiveSpeakerRemoved(uint32_t multiplexId) { removed = true; }
+
+		std::atomic<bool> changed = false;
+		std::atomic<bool> removed = false;
+	};
+
+	RTPPacket::shared CreatePacket(DWORD extSeqNum, BYTE level)
+	{
+		auto packet = std::make_shared<RTPPacket>(MediaFrame::Audio, AudioCodec::OPUS);
+		packet->SetSSRC(0x1234);
+		packet->SetExtSeqNum(extSeqNum);
+		packet->SetTimestamp(extSeqNum*960);
+		packet->SetAudioLevel(level<127, level);
+		std::vector<BYTE> payload(80, 0x55);
+		packet->SetPayload(payload.data(), payload.size());
+		return packet;
+	}
+}
+
+TEST(TestActiveSpeakerMultiplexer, SilenceGating)
+{
+	EventLoop loop;
+	loop.Start();
+
+	MockListener listener;
+	ActiveSpeakerMultiplexer multiplexer(loop, &listener);
+	multiplexer.SetNoiseGatingThreshold(60);
+	EXPECT_TRUE(multiplexer.SetSilenceGating(true));
+
+	auto stream = std::make_shared<MockRTPIncomingMediaStream>(loop);
+	multiplexer.AddIncomingSourceGroup(stream, 1);
+	//Listened by the multiplexer and the gate
+	EXPECT_EQ(stream->GetNumListeners(), 2u);
+	//Can't be changed once sources are added
+	EXPECT_FALSE(multiplexer.SetSilenceGating(false));
+
+	auto sender = std::make_shared<MockRTPSender>();
+	RTPStreamTransponder transponder(std::make_shared<RTPOutgoingSourceGroup>(MediaFrame::Audio, loop), sender);
+	multiplexer.AddRTPStreamTransponder(&transponder, 100);
+
+	//Talk until selected
+	DWORD seq = 0;
+	while (!listener.changed && seq<50)
+	{
+		stream->Send(CreatePacket(seq++, 30));
+		usleep(20000);
+	}
+	ASSERT_TRUE(listener.changed);
+	loop.Sync([](auto){});
+	//Voice buffered before the selection is replayed through the gate
+	size_t replayed = sender->packets.size();
+	EXPECT_GE(replayed, 1u);
+
+	//Voice is forwarded
+	for (DWORD i=0; i<10; ++i)
+	{
+		stream->Send(CreatePacket(seq++, 30));
+		usleep(20000);
+	}
+	loop.Sync([](auto){});
+	EXPECT_EQ(sender->packets.size(), replayed + 10u);
+	//Without gaps
+	for (size_t i=1; i<sender->packets.size(); ++i)
+		EXPECT_EQ(sender->packets[i]->GetSeqNum(), (WORD)(sender->packets[i-1]->GetSeqNum()+1));
+
+	//Silence only for the hangover time
+	for (DWORD i=0; i<50; ++i)
+	{
+		stream->Send(CreatePacket(seq++, 90));
+		usleep(20000);
+	}
+	loop.Sync([](auto){});
+	EXPECT_GT(sender->packets.size(), replayed + 10u);
+	EXPECT_LT(sender->packets.size(), replayed + 30u);
+
+	//Nothing listening on the stream once removed
+	multiplexer.RemoveIncomingSourceGroup(stream);
+	EXPECT_TRUE(listener.removed);
+	EXPECT_EQ(stream->GetNumListeners(), 0u);
+
+	multiplexer.Stop();
+	transponder.Close();
+	loop.Stop();
+}
@@ -0,0 +1,238 @@
+#include "TestCommon.h"
+
+#include "AudioEngine.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+class TestAudioTask : public AudioEngine::Task
+{
+public:
+	virtual void OnTick(AudioEngine::Phase phase, QWORD now) override
+	{
+		//Phases must be run in order in each round
+		if (phase != (AudioEngine::Phase)((last + 1) % AudioEngine::NumPhases) && last != -1)
+			misordered = true;
+		last = phase;
+		ticks[phase]++;
+		//Check all previous phase tasks are done
+		if (phase != AudioEngine::Decode && counters && (*counters)[phase - 1] % numTasks)
+			misordered = true;
+		if (counters)
+			(*counters)[phase]++;
+	}
+
+	std::atomic<int> ticks[AudioEngine::NumPhases] = {};
+	std::vector<std::atomic<QWORD>>* counters = nullptr;
+	size_t numTasks = 1;
+	bool misordered = false;
+	int last = -1;
+};
+
+TEST(TestAudioEngine, Rounds)
+{
+	AudioEngine engine("test");
+
+	const size_t numTasks = 50;
+	std::vector<std::atomic<QWORD>> counters(AudioEngine::NumPhases);
+	std::vector<std::unique_ptr<TestAudioTask>> tasks;
+	for (size_t i = 0; i < numTasks; ++i)
+	{
+		tasks.emplace_back(new TestAudioTask());
+		tasks.back()->counters = &counters;
+		tasks.back()->numTasks = numTasks;
+	}
+
+	//Add all of them in all phases, in reverse order
+	for (int phase = AudioEngine::NumPhases - 1; phase >= 0; --phase)
+		for (auto& task : tasks)
+			engine.AddTask((AudioEngine::Phase)phase, task.get());
+	ASSERT_EQ(engine.GetNumTasks(), numTasks * AudioEngine::NumPhases);
+
+	ASSERT_TRUE(engine.Start(4, 5));
+	ASSERT_EQ(engine.GetNumThreads(), 4u);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	ASSERT_TRUE(engine.Stop());
+	ASSERT_FALSE(engine.Stop());
+
+	int ticks = tasks[0]->ticks[AudioEngine::Decode];
+
+	for (auto& task : tasks)
+	{
+		EXPECT_FALSE(task->misordered);
+		//Every phase of a task run the same number of rounds
+		EXPECT_EQ(task->ticks[AudioEngine::Decode], ticks);
+		EXPECT_EQ(task->ticks[AudioEngine::Mix], ticks);
+		EXPECT_EQ(task->ticks[AudioEngine::Encode], ticks);
+	}
+	EXPECT_GT(ticks, 10);
+	EXPECT_EQ(engine.GetStats().rounds, (QWORD)ticks);
+
+	//Remove them
+	for (int phase = 0; phase < (int)AudioEngine::NumPhases; ++phase)
+		for (auto& task : tasks)
+			ASSERT_TRUE(engine.RemoveTask((AudioEngine::Phase)phase, task.get()));
+	ASSERT_FALSE(engine.RemoveTask(AudioEngine::Decode, tasks[0].get()));
+	ASSERT_EQ(engine.GetNumTasks(), 0u);
+}
+
+TEST(TestAudioEngine, RemoveTask)
+{
+	AudioEngine engine("test");
+	ASSERT_TRUE(engine.Start(2, 5));
+
+	TestAudioTask task;
+	engine.AddTask(AudioEngine::Encode, &task);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ASSERT_TRUE(engine.RemoveTask(AudioEngine::Encode, &task));
+
+	//Once removed it is not run anymore
+	int ticks = task.ticks[AudioEngine::Encode];
+	EXPECT_GT(ticks, 0);
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	EXPECT_EQ(task.ticks[AudioEngine::Encode], ticks);
+	EXPECT_EQ(task.ticks[AudioEngine::Decode], 0);
+
+	engine.Stop();
+}
+
+class RemovingAudioTask : public AudioEngine::Task
+{
+public:
+	RemovingAudioTask(AudioEngine& engine) : engine(engine) {}
+
+	virtual void OnTick(AudioEngine::Phase phase, QWORD now) override
+	{
+		ticks++;
+		//Remove itself, or another one, from the engine thread
+		if (ticks==2)
+			removed = other ? engine.RemoveTask(AudioEngine::Mix, other) : engine.RemoveTask(phase, this);
+	}
+
+	AudioEngine& engine;
+	AudioEngine::Task* other = nullptr;
+	std::atomic<int> ticks = 0;
+	std::atomic<bool> removed = false;
+};
+
+TEST(TestAudioEngine, RemoveTaskFromTask)
+{
+	for (DWORD threads : {1, 4})
+	{
+		AudioEngine engine("test");
+		ASSERT_TRUE(engine.Start(threads, 5));
+
+		//Enough tasks so they are spread across threads
+		std::vector<std::unique_ptr<RemovingAudioTask>> tasks;
+		for (int i = 0; i < 8; ++i)
+		{
+			tasks.emplace_back(new RemovingAudioTask(engine));
+			engine.AddTask(AudioEngine::Decode, tasks.back().get());
+		}
+		//Last one removes one not run by itself
+		TestAudioTask victim;
+		tasks.back()->other = &victim;
+		engine.AddTask(AudioEngine::Mix, &victim);
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		engine.Stop();
+
+		//Removed without blocking the round
+		QWORD rounds = engine.GetStats().rounds;
+		EXPECT_GT(rounds, 5u);
+		for (size_t i = 0; i < tasks.size(); ++i)
+		{
+			EXPECT_TRUE(tasks[i]->removed);
+			//Not run anymore, except the one removing the other task
+			EXPECT_EQ((QWORD)tasks[i]->ticks, i + 1 < tasks.size() ? 2 : rounds);
+		}
+		//Removed before its second round
+		EXPECT_EQ(victim.ticks[AudioEngine::Mix], 1);
+		EXPECT_EQ(engine.GetNumTasks(), 1u);
+	}
+}
+
+class SlowAudioTask : public AudioEngine::Task
+{
+public:
+	virtual void OnTick(AudioEngine::Phase phase, QWORD now) override
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(15));
+	}
+};
+
+TEST(TestAudioEngine, DeadlineMiss)
+{
+	AudioEngine engine("test");
+	ASSERT_TRUE(engine.Start(1, 10));
+
+	SlowAudioTask task;
+	engine.AddTask(AudioEngine::Mix, &task);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	engine.RemoveTask(AudioEngine::Mix, &task);
+
+	auto stats = engine.GetStats();
+	EXPECT_GT(stats.missed, 0u);
+	EXPECT_GE(stats.maxRoundTime, 15000u);
+
+	engine.Stop();
+}
+
+class BusyAudioTask : public AudioEngine::Task
+{
+public:
+	virtual void OnTick(AudioEngine::Phase phase, QWORD now) override
+	{
+		inside = true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		inside = false;
+	}
+
+	std::atomic<bool> inside = false;
+};
+
+class RemovingBusyAudioTask : public AudioEngine::Task
+{
+public:
+	RemovingBusyAudioTask(AudioEngine& engine, BusyAudioTask& other) : engine(engine), other(other) {}
+
+	virtual void OnTick(AudioEngine::Phase phase, QWORD now) override
+	{
+		if (removed)
+			return;
+		//Wait for the other one to be running on the other thread
+		for (int i = 0; i < 100 && !other.inside; ++i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		wasInside = other.inside.load();
+		removed = engine.RemoveTask(phase, &other);
+		//It has finished once removed
+		stillInside = other.inside.load();
+	}
+
+	AudioEngine& engine;
+	BusyAudioTask& other;
+	std::atomic<bool> removed = false;
+	std::atomic<bool> wasInside = false;
+	std::atomic<bool> stillInside = false;
+};
+
+TEST(TestAudioEngine, RemoveRunningTaskFromTask)
+{
+	AudioEngine engine("test");
+
+	BusyAudioTask busy;
+	RemovingBusyAudioTask removing(engine, busy);
+	engine.AddTask(AudioEngine::Mix, &busy);
+	engine.AddTask(AudioEngine::Mix, &removing);
+
+	ASSERT_TRUE(engine.Start(2, 5));
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	engine.Stop();
+
+	ASSERT_TRUE(removing.removed);
+	EXPECT_TRUE(removing.wasInside);
+	EXPECT_FALSE(removing.stillInside);
+	EXPECT_EQ(engine.GetNumTasks(), 1u);
+}
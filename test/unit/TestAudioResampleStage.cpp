@@ -0,0 +1,106 @@
+#include "TestCommon.h"
+#include "AudioResampleStage.h"
+#include "audiotransrater.h"
+#include <cmath>
+
+namespace
+{
+	//10ms of a 1khz tone starting at the given sample
+	std::vector<SWORD> Tone(DWORD rate, DWORD start, DWORD num)
+	{
+		std::vector<SWORD> samples(num);
+		for (DWORD i=0; i<num; ++i)
+			samples[i] = 16000*sin(2*M_PI*1000*(start+i)/rate);
+		return samples;
+	}
+}
+
+TEST(TestAudioResampleStage, FormatConversion)
+{
+	//Odd size so the scalar tail is used too
+	std::vector<SWORD> samples = {0, 1, -1, 32767, -32768, 1234, -4321, 100, -100, 7};
+	std::vector<float> floats(samples.size());
+	AudioResampleStage::ToFloat(samples.data(), floats.data(), samples.size());
+	for (size_t i=0; i<samples.size(); ++i)
+		EXPECT_EQ(floats[i], samples[i]);
+
+	std::vector<SWORD> back(samples.size());
+	AudioResampleStage::ToInt16(floats.data(), back.data(), floats.size());
+	EXPECT_EQ(back, samples);
+
+	//Saturate and round
+	std::vector<float> out = {40000.f, -40000.f, 1.4f, -1.6f, 2.6f, 32767.4f, -32768.4f, 0.f, 50000.f};
+	std::vector<SWORD> expected = {32767, -32768, 1, -2, 3, 32767, -32768, 0, 32767};
+	std::vector<SWORD> converted(out.size());
+	AudioResampleStage::ToInt16(out.data(), converted.data(), out.size());
+	EXPECT_EQ(converted, expected);
+}
+
+TEST(TestAudioResampleStage, SharedConversion)
+{
+	AudioResampleStage stage;
+	int mix = 0;
+	int other = 0;
+
+	auto samples = Tone(8000, 0, 80);
+
+	stage.Tick();
+	DWORD num1 = 0, num2 = 0, num3 = 0;
+	auto out1 = stage.Convert(&mix, samples.data(), samples.size(), 8000, 48000, &num1);
+	auto out2 = stage.Convert(&mix, samples.data(), samples.size(), 8000, 48000, &num2);
+	auto out3 = stage.ConvertFloat(&mix, samples.data(), samples.size(), 8000, 16000, &num3);
+	ASSERT_TRUE(out1);
+	ASSERT_TRUE(out3);
+	//Same conversion only done once
+	EXPECT_EQ(out1, out2);
+	EXPECT_EQ(num1, num2);
+	EXPECT_EQ(num1, 480u);
+	EXPECT_EQ(num3, 160u);
+	EXPECT_EQ(stage.GetStats().conversions, 2u);
+	EXPECT_EQ(stage.GetStats().shared, 1u);
+
+	//Other source is not shared
+	DWORD num4 = 0;
+	auto out4 = stage.Convert(&other, samples.data(), samples.size(), 8000, 48000, &num4);
+	EXPECT_NE(out1, out4);
+	EXPECT_EQ(stage.GetStats().conversions, 3u);
+	EXPECT_EQ(stage.GetNumResamplers(), 3u);
+
+	//Same rate is passed through
+	DWORD num5 = 0;
+	EXPECT_EQ(stage.Convert(&mix, samples.data(), samples.size(), 8000, 8000, &num5), samples.data());
+	EXPECT_EQ(num5, samples.size());
+
+	//Unused resamplers are released
+	for (DWORD i=0; i<AudioResampleStage::MaxIdleTicks+1; ++i)
+		stage.Tick();
+	EXPECT_EQ(stage.GetNumResamplers(), 0u);
+}
+
+TEST(TestAudioResampleStage, MatchesTransrater)
+{
+	AudioResampleStage stage;
+	AudioTransrater transrater;
+	ASSERT_TRUE(transrater.Open(8000, 48000));
+	int mix = 0;
+
+	//One second in 10ms ticks
+	for (DWORD tick=0; tick<100; ++tick)
+	{
+		auto samples = Tone(8000, tick*80, 80);
+
+		stage.Tick();
+		DWORD num = 0;
+		auto shared = stage.Convert(&mix, samples.data(), samples.size(), 8000, 48000, &num);
+		ASSERT_TRUE(shared);
+
+		SWORD resampled[4096];
+		DWORD resampledSize = sizeof(resampled)/sizeof(SWORD);
+		ASSERT_TRUE(transrater.ProcessBuffer(samples.data(), samples.size(), resampled, &resampledSize));
+
+		//Same filter, only rounding may differ
+		ASSERT_EQ(num, resampledSize);
+		for (DWORD i=0; i<num; ++i)
+			ASSERT_NEAR(shared[i], resampled[i], 1);
+	}
+}
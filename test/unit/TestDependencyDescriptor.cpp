@@ -0,0 +1,168 @@
+#include "TestCommon.h"
+
+#include "config.h"
+#include "log.h"
+#include "rtp.h"
+#include "rtp/RTPHeaderExtension.h"
+#include "DependencyDescriptorLayerSelector.h"
+#include <array>
+
+namespace {
+
+//L1T2 with one chain protecting both decode targets
+TemplateDependencyStructure CreateL1T2()
+{
+	TemplateDependencyStructure tds;
+	tds.dtsCount	= 2;
+	tds.chainsCount	= 1;
+	tds.decodeTargetProtectedByChain = {0,0};
+	//Key frame
+	tds.frameDependencyTemplates.push_back({{0,0},{Switch,Switch},{},{0}});
+	//T0 delta frame
+	tds.frameDependencyTemplates.push_back({{0,0},{Switch,Switch},{2},{2}});
+	//T1 delta frame
+	tds.frameDependencyTemplates.push_back({{1,0},{NotPresent,Discardable},{1},{1}});
+	tds.CalculateLayerMapping();
+	return tds;
+}
+
+RTPPacket::shared CreatePacket(const TemplateDependencyStructure::shared& tds, uint32_t templateId, uint16_t frameNumber)
+{
+	auto packet = std::make_shared<RTPPacket>(MediaFrame::Video, VideoCodec::AV1);
+	packet->SetClockRate(90000);
+	packet->SetSeqNum(frameNumber);
+	packet->SetTimestamp(frameNumber*3000);
+	packet->SetMark(true);
+	DependencyDescriptor dd = {true, true, templateId, frameNumber};
+	if (!templateId)
+		dd.templateDependencyStructure = *tds;
+	packet->SetDependencyDescriptor(dd);
+	packet->OverrideTemplateDependencyStructure(tds);
+	return packet;
+}
+
+}
+
+TEST(TestDependencyDescriptor, DecodeTargetMasks)
+{
+	auto tds = CreateL1T2();
+
+	ASSERT_EQ(tds.templateDecodeTargetsMask.size(), 3u);
+	EXPECT_EQ(tds.templateDecodeTargetsMask[0], 0b11u);
+	EXPECT_EQ(tds.templateDecodeTargetsMask[1], 0b11u);
+	EXPECT_EQ(tds.templateDecodeTargetsMask[2], 0b10u);
+	EXPECT_EQ(tds.templateSwitchMask[0], 0b11u);
+	EXPECT_EQ(tds.templateSwitchMask[2], 0u);
+	ASSERT_EQ(tds.chainDecodeTargetsMask.size(), 1u);
+	EXPECT_EQ(tds.chainDecodeTargetsMask[0], 0b11u);
+
+	EXPECT_EQ(tds.GetAllDecodeTargetsMask(), 0b11u);
+	EXPECT_EQ(tds.GetDecodeTargetsMask(0,0), 0b01u);
+	EXPECT_EQ(tds.GetDecodeTargetsMask(0,1), 0b11u);
+
+	EXPECT_EQ(DependencyDescriptor::GetDecodeTargets(0b01, 2), std::vector<bool>({true,false}));
+	EXPECT_EQ(DependencyDescriptor::GetDecodeTargetsMask(std::vector<bool>{false,true}), 0b10u);
+}
+
+TEST(TestDependencyDescriptor, SelectTemporalLayer)
+{
+	auto tds = std::make_shared<TemplateDependencyStructure>(CreateL1T2());
+
+	std::vector<RTPPacket::shared> packets = {
+		CreatePacket(tds, 0, 1),
+		CreatePacket(tds, 2, 2),
+		CreatePacket(tds, 1, 3),
+		CreatePacket(tds, 2, 4),
+	};
+
+	bool mark = false;
+
+	//No content adaptation
+	{
+		DependencyDescriptorLayerSelector selector(VideoCodec::AV1);
+		for (const auto& packet : packets)
+			EXPECT_TRUE(selector.Select(packet, mark));
+		EXPECT_FALSE(selector.GetForwardedDecodeTargetsMask());
+	}
+
+	//Only T0
+	{
+		std::vector<uint16_t> selected;
+		DependencyDescriptorLayerSelector selector(VideoCodec::AV1);
+		selector.SelectSpatialLayer(0);
+		selector.SelectTemporalLayer(0);
+		for (const auto& packet : packets)
+			if (selector.Select(packet, mark))
+				selected.push_back(packet->GetSeqNum());
+		EXPECT_EQ(selected, std::vector<uint16_t>({1,3}));
+		ASSERT_TRUE(selector.GetForwardedDecodeTargetsMask());
+		EXPECT_EQ(*selector.GetForwardedDecodeTargetsMask(), 0b01u);
+		EXPECT_EQ(*selector.GetForwardedDecodeTargets(), std::vector<bool>({true,false}));
+	}
+}
+
+TEST(TestDependencyDescriptor, UnreportedChainIsBroken)
+{
+	//L1T2 with a chain for each decode target, but frames only report the first one
+	auto l1t2 = CreateL1T2();
+	l1t2.chainsCount = 2;
+	l1t2.decodeTargetProtectedByChain = {0,1};
+	l1t2.CalculateLayerMapping();
+	auto tds = std::make_shared<TemplateDependencyStructure>(l1t2);
+	ASSERT_EQ(tds->chainDecodeTargetsMask.size(), 2u);
+
+	bool mark = false;
+	DependencyDescriptorLayerSelector selector(VideoCodec::AV1);
+	EXPECT_TRUE(selector.Select(CreatePacket(tds, 0, 1), mark));
+	EXPECT_FALSE(selector.IsWaitingForIntra());
+	//T0 frame with its chain intact but referencing a frame not received
+	auto packet = CreatePacket(tds, 1, 3);
+	auto dd = *packet->GetDependencyDescriptor();
+	dd.customFrameDiffs = std::vector<uint32_t>{1};
+	packet->SetDependencyDescriptor(dd);
+	EXPECT_FALSE(selector.Select(packet, mark));
+	//Top decode target can't be trusted, so ask for an intra
+	EXPECT_TRUE(selector.IsWaitingForIntra());
+}
+
+TEST(TestDependencyDescriptor, RewriteFrameNumberWithoutSerializing)
+{
+	RTPMap	extMap;
+	extMap.SetCodecForType(RTPHeaderExtension::DependencyDescriptor, RTPHeaderExtension::DependencyDescriptor);
+
+	auto tds = CreateL1T2();
+
+	std::array<uint8_t, MTU> buffer = {};
+	std::array<uint8_t, MTU> rewritten = {};
+
+	RTPHeaderExtension extension;
+	extension.hasDependencyDescriptor = true;
+	extension.dependencyDescryptor = DependencyDescriptor{true, true, 1, 5};
+
+	int len = extension.Serialize(extMap, buffer.data(), buffer.size());
+	ASSERT_GT(len, 0);
+
+	//Parse received one
+	RTPHeaderExtension parsed;
+	ASSERT_GT(parsed.Parse(extMap, buffer.data(), len), 0);
+	ASSERT_TRUE(parsed.ParseDependencyDescriptor(&tds));
+	EXPECT_EQ(parsed.rawDependencyDescryptorLen, 3);
+
+	//Rewrite frame number
+	parsed.OverrideDependencyDescriptorFrameNumber(0x1234);
+	int rewrittenLen = parsed.Serialize(extMap, rewritten.data(), rewritten.size());
+	ASSERT_EQ(rewrittenLen, len);
+
+	//Must be the same than serializing it again
+	extension.dependencyDescryptor->frameNumber = 0x1234;
+	len = extension.Serialize(extMap, buffer.data(), buffer.size());
+	ASSERT_EQ(rewrittenLen, len);
+	EXPECT_TRUE(std::equal(buffer.begin(), buffer.begin() + len, rewritten.begin()));
+
+	//Parse it back
+	RTPHeaderExtension reparsed;
+	ASSERT_GT(reparsed.Parse(extMap, rewritten.data(), rewrittenLen), 0);
+	ASSERT_TRUE(reparsed.ParseDependencyDescriptor(&tds));
+	EXPECT_EQ(reparsed.dependencyDescryptor->frameNumber, 0x1234);
+	EXPECT_EQ(reparsed.dependencyDescryptor->frameDependencyTemplateId, 1u);
+}
@@ -0,0 +1,126 @@
+#include "TestCommon.h"
+
+#include "EpollReactor.h"
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <future>
+
+namespace {
+
+class EchoHandler : public EpollReactor::Handler
+{
+public:
+	EchoHandler(EpollReactor& reactor, int fd) : reactor(reactor), fd(fd) {}
+
+	virtual void OnEvent(uint32_t events) override
+	{
+		char data[256];
+		int len = read(fd, data, sizeof(data));
+		//Closed
+		if (len<=0)
+		{
+			reactor.RemoveHandler(fd);
+			close(fd);
+			closed.set_value();
+			return;
+		}
+		(void)write(fd, data, len);
+	}
+
+	EpollReactor& reactor;
+	int fd;
+	std::promise<void> closed;
+};
+
+}
+
+TEST(TestEpollReactor, MultiplexSockets)
+{
+	EpollReactor reactor;
+	ASSERT_TRUE(reactor.Start());
+
+	const int num = 32;
+	int clients[num];
+	std::vector<std::shared_ptr<EchoHandler>> handlers;
+
+	for (int i = 0; i < num; ++i)
+	{
+		int fds[2];
+		ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+		clients[i] = fds[0];
+		handlers.push_back(std::make_shared<EchoHandler>(reactor, fds[1]));
+		//Register on loop thread
+		reactor.Future([&reactor, handler = handlers.back()](auto now) {
+			EXPECT_TRUE(reactor.AddHandler(handler->fd, EPOLLIN, handler));
+		}).wait();
+	}
+
+	EXPECT_EQ(reactor.GetNumHandlers(), (size_t)num);
+
+	//All of them are served by the same thread
+	for (int i = 0; i < num; ++i)
+	{
+		char out = '0' + i;
+		ASSERT_EQ(write(clients[i], &out, 1), 1);
+	}
+	for (int i = 0; i < num; ++i)
+	{
+		char in = 0;
+		//Wait for echo
+		for (int retries = 0; retries < 1000 && read(clients[i], &in, 1) != 1; ++retries)
+			usleep(1000);
+		EXPECT_EQ(in, (char)('0' + i));
+	}
+
+	//Close them, handlers remove themselves
+	for (int i = 0; i < num; ++i)
+	{
+		auto closed = handlers[i]->closed.get_future();
+		close(clients[i]);
+		EXPECT_EQ(closed.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+	}
+
+	EXPECT_EQ(reactor.GetNumHandlers(), 0u);
+	EXPECT_TRUE(reactor.Stop());
+
+	//Handlers are not referenced by the reactor anymore
+	for (auto& handler : handlers)
+		EXPECT_EQ(handler.use_count(), 1);
+}
+
+TEST(TestEpollReactor, TimersAndTasks)
+{
+	EpollReactor reactor;
+	ASSERT_TRUE(reactor.Start());
+
+	std::promise<bool> fired;
+	std::promise<bool> inLoop;
+
+	auto timer = reactor.CreateTimer(10ms, [&](auto now) {
+		fired.set_value(reactor.IsReactorThread());
+	});
+
+	reactor.Async([&](auto now) {
+		inLoop.set_value(reactor.IsReactorThread());
+	});
+
+	EXPECT_TRUE(inLoop.get_future().get());
+	auto future = fired.get_future();
+	ASSERT_EQ(future.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+	EXPECT_TRUE(future.get());
+	EXPECT_FALSE(reactor.IsReactorThread());
+
+	//Loop is accounted as the event loops
+	auto stats = reactor.GetStats();
+	EXPECT_GT(stats.iterations, 0u);
+	EXPECT_GT(stats.waitTime, 0u);
+	EXPECT_GT(stats.tid, 0);
+	EXPECT_EQ(stats.state, EventLoop::State::Normal);
+	bool found = false;
+	for (const auto& running : EventLoop::GetRunningStats())
+		found |= running.tid==stats.tid;
+	EXPECT_TRUE(found);
+
+	EXPECT_TRUE(reactor.Stop());
+}
@@ -0,0 +1,250 @@
+#include "TestCommon.h"
+
+#include "fecencoder.h"
+#include "fecdecoder.h"
+#include "tools.h"
+#include <set>
+
+namespace
+{
+	constexpr DWORD SSRC = 0x11223344;
+
+	std::vector<BYTE> CreatePacket(WORD seq, DWORD timestamp, bool mark, DWORD size)
+	{
+		std::vector<BYTE> packet(size);
+		packet[0] = 0x80;
+		packet[1] = (mark ? 0x80 : 0x00) | 96;
+		set2(packet.data(),2,seq);
+		set4(packet.data(),4,timestamp);
+		set4(packet.data(),8,SSRC);
+		for (DWORD i=fec::RTPHeaderSize; i<size; ++i)
+			packet[i] = seq*3 + i;
+		return packet;
+	}
+
+	// Generates num packets of varying sizes, with fec packets after each group
+	void Generate(fec::Scheme scheme, WORD first, DWORD num, DWORD group, std::vector<std::vector<BYTE>>& media, std::vector<std::vector<BYTE>>& fecs, std::vector<DWORD>& fecAfter)
+	{
+		FECEncoder::Options options;
+		options.scheme = scheme;
+		options.ssrc = SSRC;
+		options.group = group;
+		options.flushOnMarker = false;
+		FECEncoder encoder(options);
+
+		for (DWORD i=0; i<num; ++i)
+		{
+			media.push_back(CreatePacket(first+i,i*3000,false,100 + (i*37)%1000));
+			if (encoder.AddPacket(media.back().data(),media.back().size()))
+			{
+				fecs.emplace_back(encoder.GetFECData(),encoder.GetFECData()+encoder.GetFECSize());
+				fecAfter.push_back(i);
+			}
+		}
+	}
+
+	// Decodes dropping the lost packets, returns the recovered ones
+	std::vector<Packet> Decode(fec::Scheme scheme, const std::vector<std::vector<BYTE>>& media, const std::vector<std::vector<BYTE>>& fecs, const std::vector<DWORD>& fecAfter, const std::set<DWORD>& lost, FECDecoder& decoder)
+	{
+		std::vector<Packet> recovered;
+		DWORD j = 0;
+		for (DWORD i=0; i<media.size(); ++i)
+		{
+			if (!lost.count(i))
+				decoder.AddMediaPacket(media[i].data(),media[i].size());
+			for (;j<fecAfter.size() && fecAfter[j]==i; ++j)
+				EXPECT_TRUE(decoder.AddFECPacket(fecs[j].data(),fecs[j].size()));
+			decoder.Recover(recovered);
+		}
+		return recovered;
+	}
+
+	void CheckRecovered(const std::vector<std::vector<BYTE>>& media, const std::vector<Packet>& recovered, WORD first)
+	{
+		for (const auto& packet : recovered)
+		{
+			DWORD i = (WORD)(get2(packet.GetData(),2)-first);
+			ASSERT_LT(i,media.size());
+			ASSERT_EQ(packet.GetSize(),media[i].size());
+			EXPECT_EQ(0,memcmp(packet.GetData(),media[i].data(),media[i].size()));
+		}
+	}
+}
+
+TEST(TestFEC, XOR)
+{
+	alignas(32) BYTE dst[fec::BufferSize];
+	std::vector<BYTE> src(fec::BufferSize+1);
+
+	//Any size and unaligned source
+	for (DWORD size : {0u, 1u, 15u, 16u, 31u, 32u, 33u, 100u, 1500u})
+	{
+		for (DWORD i=0; i<size; ++i)
+		{
+			dst[i] = i;
+			src[i+1] = i*7;
+		}
+		dst[size] = 0xAA;
+		fec::XOR(dst,src.data()+1,size);
+		for (DWORD i=0; i<size; ++i)
+			ASSERT_EQ(dst[i],(BYTE)(i ^ (i*7)));
+		//Not overwritten
+		ASSERT_EQ(dst[size],0xAA);
+	}
+}
+
+TEST(TestFEC, HeaderRoundTrip)
+{
+	for (auto scheme : {fec::Scheme::ULPFEC, fec::Scheme::FlexFEC})
+	{
+		for (DWORD bits : {1u, 15u, 16u, 17u, 46u, 48u, 60u, 109u})
+		{
+			if (bits>fec::GetMaxProtected(scheme))
+				continue;
+
+			fec::Header header;
+			header.recovery[0] = 0x15;
+			header.recovery[1] = 0xE0;
+			header.timestamp = 0xDEADBEEF;
+			header.length = 1234;
+			header.base = 65530;
+			header.ssrc = SSRC;
+			header.protectionLength = 10;
+			for (DWORD i=0; i<bits; i+=3)
+				header.mask.Set(i);
+			header.mask.Set(bits-1);
+
+			BYTE data[64] = {};
+			DWORD len = fec::Serialize(scheme,header,data,sizeof(data));
+			ASSERT_EQ(len,fec::GetHeaderSize(scheme,header.mask));
+
+			fec::Header parsed;
+			ASSERT_EQ(len,fec::Parse(scheme,data,len+header.protectionLength,parsed));
+			EXPECT_EQ(parsed.recovery[0],header.recovery[0]);
+			EXPECT_EQ(parsed.recovery[1],header.recovery[1]);
+			EXPECT_EQ(parsed.timestamp,header.timestamp);
+			EXPECT_EQ(parsed.length,header.length);
+			EXPECT_EQ(parsed.base,header.base);
+			EXPECT_EQ(parsed.protectionLength,header.protectionLength);
+			EXPECT_EQ(parsed.mask.bits[0],header.mask.bits[0]);
+			EXPECT_EQ(parsed.mask.bits[1],header.mask.bits[1]);
+			if (scheme==fec::Scheme::FlexFEC)
+			{
+				EXPECT_EQ(parsed.ssrc,header.ssrc);
+			}
+		}
+	}
+}
+
+TEST(TestFEC, RecoverSingleLoss)
+{
+	for (auto scheme : {fec::Scheme::ULPFEC, fec::Scheme::FlexFEC})
+	{
+		std::vector<std::vector<BYTE>> media, fecs;
+		std::vector<DWORD> fecAfter;
+		//Wrap sequence numbers
+		Generate(scheme,65500,100,5,media,fecs,fecAfter);
+		ASSERT_EQ(fecs.size(),20u);
+
+		//One loss per group
+		std::set<DWORD> lost;
+		for (DWORD i=0; i<media.size(); i+=5)
+			lost.insert(i + (i/5)%5);
+
+		FECDecoder decoder(scheme,SSRC);
+		auto recovered = Decode(scheme,media,fecs,fecAfter,lost,decoder);
+		ASSERT_EQ(recovered.size(),lost.size());
+		CheckRecovered(media,recovered,65500);
+		EXPECT_EQ(decoder.GetStats().recovered,lost.size());
+		EXPECT_EQ(decoder.GetStats().unrecoverable,0u);
+		EXPECT_EQ(decoder.GetStats().invalid,0u);
+	}
+}
+
+TEST(TestFEC, NoLossAndDoubleLoss)
+{
+	for (auto scheme : {fec::Scheme::ULPFEC, fec::Scheme::FlexFEC})
+	{
+		std::vector<std::vector<BYTE>> media, fecs;
+		std::vector<DWORD> fecAfter;
+		Generate(scheme,1000,20,10,media,fecs,fecAfter);
+
+		//Two losses on the first group, none on the second
+		FECDecoder decoder(scheme,SSRC);
+		auto recovered = Decode(scheme,media,fecs,fecAfter,{2,7},decoder);
+		EXPECT_TRUE(recovered.empty());
+		EXPECT_EQ(decoder.GetStats().unused,1u);
+
+		//Push the window so the first fec goes out of it
+		for (DWORD i=0; i<FECDecoder::WindowSize; ++i)
+		{
+			auto packet = CreatePacket(1020+i,0,false,100);
+			decoder.AddMediaPacket(packet.data(),packet.size());
+		}
+		decoder.Recover(recovered);
+		EXPECT_TRUE(recovered.empty());
+		EXPECT_EQ(decoder.GetStats().unrecoverable,1u);
+	}
+}
+
+TEST(TestFEC, ChainedRecovery)
+{
+	for (auto scheme : {fec::Scheme::ULPFEC, fec::Scheme::FlexFEC})
+	{
+		//Two overlapping fec packets, one protecting 0..3 and the other 3..4
+		std::vector<std::vector<BYTE>> media;
+		for (DWORD i=0; i<5; ++i)
+			media.push_back(CreatePacket(i,i*960,true,60+i*10));
+
+		FECEncoder::Options options;
+		options.scheme = scheme;
+		options.ssrc = SSRC;
+		options.group = 4;
+		options.flushOnMarker = false;
+		FECEncoder first(options);
+		options.group = 2;
+		FECEncoder second(options);
+
+		std::vector<BYTE> fec1, fec2;
+		for (DWORD i=0; i<4; ++i)
+			if (first.AddPacket(media[i].data(),media[i].size()))
+				fec1.assign(first.GetFECData(),first.GetFECData()+first.GetFECSize());
+		for (DWORD i=3; i<5; ++i)
+			if (second.AddPacket(media[i].data(),media[i].size()))
+				fec2.assign(second.GetFECData(),second.GetFECData()+second.GetFECSize());
+		ASSERT_FALSE(fec1.empty());
+		ASSERT_FALSE(fec2.empty());
+
+		//Lose 1 and 3, 3 is recovered from second fec and then 1 from the first one
+		FECDecoder decoder(scheme,SSRC);
+		for (DWORD i : {0, 2, 4})
+			decoder.AddMediaPacket(media[i].data(),media[i].size());
+		decoder.AddFECPacket(fec1.data(),fec1.size());
+		decoder.AddFECPacket(fec2.data(),fec2.size());
+
+		std::vector<Packet> recovered;
+		ASSERT_EQ(decoder.Recover(recovered),2u);
+		CheckRecovered(media,recovered,0);
+	}
+}
+
+TEST(TestFEC, EncoderFlushOnMarker)
+{
+	FECEncoder::Options options;
+	options.scheme = fec::Scheme::FlexFEC;
+	options.ssrc = SSRC;
+	options.group = 10;
+	FECEncoder encoder(options);
+
+	//Frame of 3 packets
+	for (DWORD i=0; i<3; ++i)
+	{
+		auto packet = CreatePacket(i,0,i==2,200);
+		EXPECT_EQ(encoder.AddPacket(packet.data(),packet.size()),i==2);
+	}
+	//Header for up to 15 packets and the payload
+	EXPECT_EQ(encoder.GetFECSize(),20u+200u-fec::RTPHeaderSize);
+	EXPECT_EQ(encoder.GetStats().fecPackets,1u);
+	EXPECT_EQ(encoder.GetStats().mediaPackets,3u);
+	EXPECT_NEAR(encoder.GetStats().GetOverhead(),(20.0+200.0)*100/600,0.01);
+}
@@ -0,0 +1,343 @@
+#include "TestCommon.h"
+
+#include "FragmentedMP4Writer.h"
+#include "tools.h"
+#include <fstream>
+#include <iterator>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace
+{
+	struct Box
+	{
+		std::string type;
+		size_t offset;
+		size_t size;
+	};
+
+	std::vector<BYTE> ReadFile(const std::string& path)
+	{
+		std::ifstream file(path,std::ios::binary);
+		return std::vector<BYTE>(std::istreambuf_iterator<char>(file),std::istreambuf_iterator<char>());
+	}
+
+	std::vector<Box> GetBoxes(const std::vector<BYTE>& data, size_t start = 0, size_t end = 0)
+	{
+		std::vector<Box> boxes;
+		if (!end)
+			end = data.size();
+		for (size_t pos = start; pos + 8 <= end;)
+		{
+			DWORD size = get4(data.data(),pos);
+			if (size < 8 || pos + size > end)
+				break;
+			boxes.push_back({std::string((const char*)data.data()+pos+4,4),pos,size});
+			pos += size;
+		}
+		return boxes;
+	}
+
+	const Box* Find(const std::vector<Box>& boxes, const std::string& type)
+	{
+		for (const auto& box : boxes)
+			if (box.type == type)
+				return &box;
+		return nullptr;
+	}
+
+	//Length prefixed H264 NALs
+	std::vector<BYTE> H264Frame(bool intra, DWORD size)
+	{
+		std::vector<BYTE> frame;
+		auto nal = [&](BYTE type, DWORD len) {
+			BYTE header[4];
+			set4(header,0,len);
+			frame.insert(frame.end(),header,header+4);
+			frame.push_back(type);
+			for (DWORD i = 1; i < len; ++i)
+				frame.push_back(i);
+		};
+		if (intra)
+		{
+			//SPS with profile 0x64, compat 0x00, level 0x1F
+			frame.insert(frame.end(),{0,0,0,4,0x67,0x64,0x00,0x1F});
+			frame.insert(frame.end(),{0,0,0,2,0x68,0xCE});
+			nal(0x65,size);
+		} else {
+			nal(0x41,size);
+		}
+		return frame;
+	}
+
+	class TestFragmentedMP4Writer : public ::testing::Test
+	{
+	protected:
+		void SetUp() override
+		{
+			char tmp[] = "/tmp/fmp4XXXXXX";
+			ASSERT_TRUE(mkdtemp(tmp));
+			dir = tmp;
+		}
+
+		void TearDown() override
+		{
+			system(("rm -rf " + dir).c_str());
+		}
+
+		std::string dir;
+	};
+}
+
+TEST_F(TestFragmentedMP4Writer, FragmentPerGOP)
+{
+	FragmentedMP4Writer::Options options;
+	options.fragmentDuration = 0;
+	FragmentedMP4Writer writer(options);
+
+	std::string path = dir + "/out.mp4";
+	ASSERT_TRUE(writer.Open(path.c_str()));
+	DWORD video = writer.AddVideoTrack(VideoCodec::H264,90000,640,480);
+	DWORD audio = writer.AddAudioTrack(AudioCodec::OPUS,48000,2);
+	ASSERT_EQ(video, 1u);
+	ASSERT_EQ(audio, 2u);
+
+	//Non key frames before the first one are dropped
+	ASSERT_TRUE(writer.WriteSample(video,H264Frame(false,100).data(),104,0,3000,false));
+	EXPECT_EQ(writer.GetStats().dropped, 1u);
+
+	//Two gops of 30 frames
+	for (int i = 0; i < 60; ++i)
+	{
+		auto frame = H264Frame(i % 30 == 0,1000);
+		ASSERT_TRUE(writer.WriteSample(video,frame.data(),frame.size(),i*3000,3000,i % 30 == 0));
+		BYTE opus[80] = {};
+		ASSERT_TRUE(writer.WriteSample(audio,opus,sizeof(opus),i*1600,1600,true));
+	}
+
+	//First gop already written
+	EXPECT_EQ(writer.GetStats().fragments, 1u);
+
+	//Tracks can't be added once init segment is written
+	EXPECT_EQ(writer.AddAudioTrack(AudioCodec::PCMU,8000), 0u);
+
+	ASSERT_TRUE(writer.Close());
+	EXPECT_EQ(writer.GetStats().fragments, 2u);
+	//One write for init and one per fragment
+	EXPECT_EQ(writer.GetStats().writes, 3u);
+
+	auto data = ReadFile(path);
+	EXPECT_EQ(data.size(), writer.GetStats().bytes);
+
+	auto boxes = GetBoxes(data);
+	ASSERT_EQ(boxes.size(), 6u);
+	EXPECT_EQ(boxes[0].type, "ftyp");
+	EXPECT_EQ(boxes[1].type, "moov");
+	EXPECT_EQ(boxes[2].type, "moof");
+	EXPECT_EQ(boxes[3].type, "mdat");
+	EXPECT_EQ(boxes[4].type, "moof");
+	EXPECT_EQ(boxes[5].type, "mdat");
+
+	//Two tracks on moov
+	auto moov = GetBoxes(data,boxes[1].offset+8,boxes[1].offset+boxes[1].size);
+	int traks = 0;
+	for (const auto& box : moov)
+		traks += box.type == "trak";
+	EXPECT_EQ(traks, 2);
+	ASSERT_TRUE(Find(moov,"mvex"));
+
+	//avcC taken from first key frame
+	auto it = std::search(data.begin(),data.end(),std::begin("avcC"),std::end("avcC")-1);
+	ASSERT_NE(it, data.end());
+	size_t avcC = it - data.begin();
+	EXPECT_EQ(data[avcC+4], 1);
+	EXPECT_EQ(data[avcC+5], 0x64);
+	EXPECT_EQ(data[avcC+7], 0x1F);
+
+	//Check second fragment
+	const auto& moof = boxes[4];
+	auto trafs = GetBoxes(data,moof.offset+8,moof.offset+moof.size);
+	ASSERT_EQ(trafs.size(), 3u);
+	EXPECT_EQ(trafs[0].type, "mfhd");
+	EXPECT_EQ(get4(data.data(),trafs[0].offset+12), 2u);
+
+	auto traf = GetBoxes(data,trafs[1].offset+8,trafs[1].offset+trafs[1].size);
+	ASSERT_EQ(traf.size(), 3u);
+	EXPECT_EQ(traf[0].type, "tfhd");
+	EXPECT_EQ(traf[1].type, "tfdt");
+	EXPECT_EQ(traf[2].type, "trun");
+	//Decode time of first frame of second gop
+	EXPECT_EQ(get8(data.data(),traf[1].offset+12), 30*3000u);
+	//Sample count and data offset pointing to the key frame
+	const auto& trun = traf[2];
+	EXPECT_EQ(get4(data.data(),trun.offset+12), 30u);
+	DWORD dataOffset = get4(data.data(),trun.offset+16);
+	EXPECT_EQ(dataOffset, moof.size + 8);
+	EXPECT_EQ(data[moof.offset+dataOffset+4], 0x67);
+	//First sample is sync, second is not
+	EXPECT_EQ(get4(data.data(),trun.offset+28), 0x02000000u);
+	EXPECT_EQ(get4(data.data(),trun.offset+40), 0x01010000u);
+}
+
+TEST_F(TestFragmentedMP4Writer, FragmentDurationAndAlignment)
+{
+	FragmentedMP4Writer::Options options;
+	options.fragmentDuration = 500;
+	options.alignment = 4096;
+	FragmentedMP4Writer writer(options);
+
+	std::string path = dir + "/audio.mp4";
+	ASSERT_TRUE(writer.Open(path.c_str()));
+	DWORD audio = writer.AddAudioTrack(AudioCodec::AAC,44100,2);
+	ASSERT_TRUE(audio);
+
+	//2 seconds of audio
+	BYTE aac[200] = {};
+	for (int i = 0; i < 2*44100/1024; ++i)
+		ASSERT_TRUE(writer.WriteSample(audio,aac,sizeof(aac),i*1024,1024,true));
+	ASSERT_TRUE(writer.Close());
+
+	EXPECT_EQ(writer.GetStats().fragments, 4u);
+
+	auto data = ReadFile(path);
+	EXPECT_EQ(data.size() % 4096, 0u);
+
+	//Each write padded with a free box
+	auto boxes = GetBoxes(data);
+	int moofs = 0, frees = 0;
+	for (const auto& box : boxes)
+	{
+		moofs += box.type == "moof";
+		frees += box.type == "free";
+		//All fragments start aligned
+		if (box.type == "moof")
+		{
+			EXPECT_EQ(box.offset % 4096, 0u);
+		}
+	}
+	EXPECT_EQ(moofs, 4);
+	EXPECT_EQ(frees, 5);
+}
+
+TEST_F(TestFragmentedMP4Writer, WaitForParameterSets)
+{
+	FragmentedMP4Writer::Options options;
+	options.fragmentDuration = 0;
+	options.maxTrackBytes = 16*1024;
+	FragmentedMP4Writer writer(options);
+
+	std::string path = dir + "/params.mp4";
+	ASSERT_TRUE(writer.Open(path.c_str()));
+	DWORD video = writer.AddVideoTrack(VideoCodec::H264,90000,640,480);
+
+	//Key frames without SPS and PPS
+	for (int i = 0; i < 10; ++i)
+	{
+		auto frame = H264Frame(false,1000);
+		ASSERT_TRUE(writer.WriteSample(video,frame.data(),frame.size(),i*3000,3000,i % 5 == 0));
+	}
+	ASSERT_TRUE(writer.Flush());
+
+	//Nothing written yet
+	EXPECT_EQ(writer.GetStats().writes, 0u);
+	EXPECT_TRUE(ReadFile(path).empty());
+
+	//Held samples are dropped when not fitting in memory
+	for (int i = 10; i < 30; ++i)
+	{
+		auto frame = H264Frame(false,1000);
+		ASSERT_TRUE(writer.WriteSample(video,frame.data(),frame.size(),i*3000,3000,i % 5 == 0));
+	}
+	EXPECT_LE(writer.GetStats().maxTrackBytes, 16*1024u);
+	EXPECT_GT(writer.GetStats().dropped, 0u);
+	EXPECT_EQ(writer.GetStats().writes, 0u);
+
+	//Key frame with parameter sets
+	auto frame = H264Frame(true,1000);
+	ASSERT_TRUE(writer.WriteSample(video,frame.data(),frame.size(),30*3000,3000,true));
+	ASSERT_TRUE(writer.Close());
+	//Held gop and the new one
+	EXPECT_EQ(writer.GetStats().fragments, 2u);
+
+	//avcC has one SPS and one PPS
+	auto data = ReadFile(path);
+	auto it = std::search(data.begin(),data.end(),std::begin("avcC"),std::end("avcC")-1);
+	ASSERT_NE(it, data.end());
+	size_t avcC = it - data.begin();
+	EXPECT_EQ(data[avcC+4], 1);
+	EXPECT_EQ(data[avcC+5], 0x64);
+	EXPECT_EQ(data[avcC+9], 0xE1);
+	EXPECT_EQ(get2(data.data(),avcC+10), 4u);
+	EXPECT_EQ(data[avcC+16], 1);
+}
+
+TEST_F(TestFragmentedMP4Writer, BoundedMemory)
+{
+	FragmentedMP4Writer::Options options;
+	options.fragmentDuration = 0;
+	options.maxTrackBytes = 64*1024;
+	FragmentedMP4Writer writer(options);
+
+	std::string path = dir + "/video.mp4";
+	ASSERT_TRUE(writer.Open(path.c_str()));
+	DWORD video = writer.AddVideoTrack(VideoCodec::VP8,90000,640,480);
+
+	//Single long gop
+	std::vector<BYTE> frame(10000);
+	for (int i = 0; i < 100; ++i)
+		ASSERT_TRUE(writer.WriteSample(video,frame.data(),frame.size(),i*3000,3000,i == 0));
+	ASSERT_TRUE(writer.Close());
+
+	EXPECT_LE(writer.GetStats().maxTrackBytes, 64*1024u);
+	EXPECT_GE(writer.GetStats().fragments, 100/6u);
+}
+
+TEST_F(TestFragmentedMP4Writer, Segments)
+{
+	FragmentedMP4Writer::Options options;
+	options.segmentDir = dir;
+	options.segmentDuration = 2000;
+	options.fragmentDuration = 500;
+	FragmentedMP4Writer writer(options);
+
+	ASSERT_TRUE(writer.Open("playlist.m3u8"));
+	DWORD video = writer.AddVideoTrack(VideoCodec::H264,90000,640,480);
+
+	//5 seconds, key frame each second and fragments each 500ms
+	for (int i = 0; i < 150; ++i)
+	{
+		auto frame = H264Frame(i % 30 == 0,500);
+		ASSERT_TRUE(writer.WriteSample(video,frame.data(),frame.size(),i*3000,3000,i % 30 == 0));
+	}
+
+	//Playlist is updated while recording
+	auto live = ReadFile(dir + "/playlist.m3u8");
+	std::string playlist(live.begin(),live.end());
+	EXPECT_NE(playlist.find("#EXT-X-MAP:URI=\"init.mp4\""), std::string::npos);
+	EXPECT_NE(playlist.find("#EXT-X-PART:DURATION=0.500,URI=\"segment-1.m4s\",BYTERANGE="), std::string::npos);
+	EXPECT_NE(playlist.find("\n#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=1.500\n#EXT-X-PART-INF:PART-TARGET=0.500\n"), std::string::npos);
+	EXPECT_EQ(playlist.find("#EXT-X-ENDLIST"), std::string::npos);
+
+	ASSERT_TRUE(writer.Close());
+	EXPECT_EQ(writer.GetStats().segments, 3u);
+
+	auto ended = ReadFile(dir + "/playlist.m3u8");
+	playlist.assign(ended.begin(),ended.end());
+	EXPECT_NE(playlist.find("#EXTINF:2.000,\nsegment-1.m4s\n#EXTINF:2.000,\nsegment-2.m4s\n#EXTINF:1.000,\nsegment-3.m4s\n#EXT-X-ENDLIST\n"), std::string::npos);
+	//No parts once ended
+	EXPECT_EQ(playlist.find("#EXT-X-PART"), std::string::npos);
+
+	//Init segment has only ftyp and moov
+	auto init = ReadFile(dir + "/init.mp4");
+	auto boxes = GetBoxes(init);
+	ASSERT_EQ(boxes.size(), 2u);
+	EXPECT_EQ(boxes[0].type, "ftyp");
+	EXPECT_EQ(boxes[1].type, "moov");
+
+	//Segments start with a key frame fragment
+	auto segment = ReadFile(dir + "/segment-2.m4s");
+	boxes = GetBoxes(segment);
+	ASSERT_EQ(boxes.size(), 8u);
+	EXPECT_EQ(boxes[0].type, "moof");
+	EXPECT_EQ(boxes[0].offset, 0u);
+}
@@ -0,0 +1,140 @@
+#include "TestCommon.h"
+
+#include "HTTPRequestParser.h"
+#include <string>
+
+TEST(TestHTTPRequestParser, ParseRequest)
+{
+	std::string data =
+		"POST /mcu HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Content-Type:  text/xml \r\n"
+		"content-length: 11\r\n"
+		"\r\n"
+		"hello world";
+
+	HTTPRequestParser parser;
+	size_t consumed = 0;
+	ASSERT_EQ(parser.Parse(data.data(), data.size(), consumed), HTTPRequestParser::Complete);
+	EXPECT_EQ(consumed, data.size());
+
+	const auto& request = parser.GetRequest();
+	EXPECT_EQ(request.GetMethod(), "POST");
+	EXPECT_EQ(request.GetURI(), "/mcu");
+	EXPECT_EQ(request.GetVersion(), "HTTP/1.1");
+	EXPECT_EQ(request.GetNumHeaders(), 3u);
+	EXPECT_EQ(request.GetHeader("Content-Type"), "text/xml");
+	EXPECT_EQ(request.GetHeader("CONTENT-LENGTH"), "11");
+	EXPECT_FALSE(request.HasHeader("Connection"));
+	EXPECT_EQ(request.GetBody(), "hello world");
+	EXPECT_TRUE(request.IsKeepAlive());
+
+	//Views point into the buffer
+	EXPECT_EQ(request.GetBody().data(), data.data() + data.size() - 11);
+}
+
+TEST(TestHTTPRequestParser, Incremental)
+{
+	std::string data =
+		"POST /mcu HTTP/1.1\r\n"
+		"Content-Length: 5\r\n"
+		"\r\n"
+		"12345";
+
+	HTTPRequestParser parser;
+	size_t consumed = 0;
+
+	//Feed it byte by byte in a buffer that is moved on each call
+	for (size_t i = 1; i < data.size(); ++i)
+	{
+		std::string copy = data.substr(0, i);
+		ASSERT_EQ(parser.Parse(copy.data(), copy.size(), consumed), HTTPRequestParser::NeedMoreData) << i;
+	}
+
+	std::string copy = data;
+	ASSERT_EQ(parser.Parse(copy.data(), copy.size(), consumed), HTTPRequestParser::Complete);
+	EXPECT_EQ(consumed, data.size());
+	EXPECT_EQ(parser.GetRequest().GetURI(), "/mcu");
+	EXPECT_EQ(parser.GetRequest().GetBody(), "12345");
+	EXPECT_EQ(parser.GetRequest().GetBody().data(), copy.data() + data.size() - 5);
+}
+
+TEST(TestHTTPRequestParser, Pipelining)
+{
+	std::string data =
+		"GET /first HTTP/1.1\r\n"
+		"\r\n"
+		"POST /second HTTP/1.1\r\n"
+		"Content-Length: 3\r\n"
+		"\r\n"
+		"abc"
+		"GET /third HTTP/1.0\r\n"
+		"\r\n"
+		"GET /fourth HTTP/1.1\r\n";
+
+	HTTPRequestParser parser;
+	size_t pos = 0;
+	size_t consumed = 0;
+
+	ASSERT_EQ(parser.Parse(data.data() + pos, data.size() - pos, consumed), HTTPRequestParser::Complete);
+	EXPECT_EQ(parser.GetRequest().GetURI(), "/first");
+	EXPECT_EQ(parser.GetRequest().GetBody(), "");
+	pos += consumed;
+
+	ASSERT_EQ(parser.Parse(data.data() + pos, data.size() - pos, consumed), HTTPRequestParser::Complete);
+	EXPECT_EQ(parser.GetRequest().GetURI(), "/second");
+	EXPECT_EQ(parser.GetRequest().GetBody(), "abc");
+	pos += consumed;
+
+	ASSERT_EQ(parser.Parse(data.data() + pos, data.size() - pos, consumed), HTTPRequestParser::Complete);
+	EXPECT_EQ(parser.GetRequest().GetURI(), "/third");
+	//Not persistent by default on HTTP/1.0
+	EXPECT_FALSE(parser.GetRequest().IsKeepAlive());
+	pos += consumed;
+
+	//Last one is not complete yet
+	EXPECT_EQ(parser.Parse(data.data() + pos, data.size() - pos, consumed), HTTPRequestParser::NeedMoreData);
+}
+
+TEST(TestHTTPRequestParser, KeepAlive)
+{
+	HTTPRequestParser parser;
+	size_t consumed = 0;
+
+	std::string close = "GET / HTTP/1.1\r\nConnection: Upgrade, close\r\n\r\n";
+	ASSERT_EQ(parser.Parse(close.data(), close.size(), consumed), HTTPRequestParser::Complete);
+	EXPECT_FALSE(parser.GetRequest().IsKeepAlive());
+
+	std::string keepAlive = "GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n";
+	ASSERT_EQ(parser.Parse(keepAlive.data(), keepAlive.size(), consumed), HTTPRequestParser::Complete);
+	EXPECT_TRUE(parser.GetRequest().IsKeepAlive());
+}
+
+TEST(TestHTTPRequestParser, Errors)
+{
+	const char* invalid[] = {
+		"GET\r\n\r\n",
+		"GET  / HTTP/1.1\r\n\r\n",
+		"GET / SIP/2.0\r\n\r\n",
+		"GET / HTTP/1.1\r\nNoColon\r\n\r\n",
+		"GET / HTTP/1.1\r\nName : value\r\n\r\n",
+		"GET / HTTP/1.1\r\nName: value\r\n folded\r\n\r\n",
+		"POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n",
+		"POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n",
+		"POST / HTTP/1.1\r\nContent-Length: 999999999\r\n\r\n",
+		"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n",
+	};
+
+	for (auto str : invalid)
+	{
+		HTTPRequestParser parser;
+		size_t consumed = 0;
+		EXPECT_EQ(parser.Parse(str, strlen(str), consumed), HTTPRequestParser::Failed) << str;
+	}
+
+	//Headers too big
+	HTTPRequestParser parser;
+	size_t consumed = 0;
+	std::string big = "GET / HTTP/1.1\r\nName: " + std::string(HTTPRequestParser::MaxHeaderSize, 'a');
+	EXPECT_EQ(parser.Parse(big.data(), big.size(), consumed), HTTPRequestParser::Failed);
+}
@@ -0,0 +1,90 @@
+#include "TestCommon.h"
+
+#include "LatencyHistogram.h"
+#include <thread>
+
+TEST(TestLatencyHistogram, BucketBounds)
+{
+	//Small values are exact
+	for (uint64_t value = 0; value < LatencyHistogram::SubBuckets * 2; ++value)
+	{
+		auto bucket = LatencyHistogram::GetBucket(value);
+		EXPECT_EQ(LatencyHistogram::GetBucketLowerBound(bucket), value);
+		EXPECT_EQ(LatencyHistogram::GetBucketUpperBound(bucket), value);
+	}
+
+	//Each value falls between its bucket bounds with bounded relative error
+	for (uint64_t value = 1; value < LatencyHistogram::MaxValue; value = value * 3 + 1)
+	{
+		auto bucket = LatencyHistogram::GetBucket(value);
+		ASSERT_LT(bucket, LatencyHistogram::Buckets);
+		auto lower = LatencyHistogram::GetBucketLowerBound(bucket);
+		auto upper = LatencyHistogram::GetBucketUpperBound(bucket);
+		EXPECT_LE(lower, value);
+		EXPECT_GE(upper, value);
+		EXPECT_LE(upper - lower, value / LatencyHistogram::SubBuckets);
+		//Next bucket starts after this one
+		if (bucket + 1 < LatencyHistogram::Buckets)
+		{
+			EXPECT_EQ(LatencyHistogram::GetBucketLowerBound(bucket + 1), upper + 1);
+		}
+	}
+
+	//Out of range values are clamped
+	EXPECT_EQ(LatencyHistogram::GetBucket(~0ull), LatencyHistogram::Buckets - 1);
+}
+
+TEST(TestLatencyHistogram, Percentiles)
+{
+	LatencyHistogram histogram("test.percentiles");
+
+	EXPECT_EQ(histogram.GetSnapshot().GetP50(), 0u);
+
+	for (uint64_t value = 1; value <= 10000; ++value)
+		histogram.Record(value);
+
+	auto snapshot = histogram.GetSnapshot();
+	EXPECT_EQ(snapshot.count, 10000u);
+	EXPECT_EQ(snapshot.max, 10000u);
+	EXPECT_DOUBLE_EQ(snapshot.GetMean(), 5000.5);
+
+	//Within the precision of the buckets
+	EXPECT_NEAR(snapshot.GetP50(), 5000, 5000 / LatencyHistogram::SubBuckets);
+	EXPECT_NEAR(snapshot.GetP99(), 9900, 9900 / LatencyHistogram::SubBuckets);
+	EXPECT_NEAR(snapshot.GetP999(), 9990, 9990 / LatencyHistogram::SubBuckets);
+	EXPECT_EQ(snapshot.GetPercentile(100), 10000u);
+}
+
+TEST(TestLatencyHistogram, MergeThreadsAndInstances)
+{
+	auto before = LatencyHistogram::GetSnapshot("test.merge").count;
+
+	{
+		LatencyHistogram first("test.merge");
+		LatencyHistogram second("test.merge");
+
+		//Record from several threads
+		std::vector<std::thread> threads;
+		for (int i = 0; i < 4; ++i)
+			threads.emplace_back([&first]() {
+				for (int j = 0; j < 1000; ++j)
+					first.Record(100);
+			});
+		for (auto& thread : threads)
+			thread.join();
+
+		second.Record(1000000);
+
+		EXPECT_EQ(first.GetSnapshot().count, 4000u);
+		EXPECT_EQ(first.GetSnapshot().max, 100u);
+
+		auto merged = LatencyHistogram::GetSnapshot("test.merge");
+		EXPECT_EQ(merged.count - before, 4001u);
+		EXPECT_EQ(merged.max, 1000000u);
+	}
+
+	//Values are kept once the histograms are destroyed
+	EXPECT_EQ(LatencyHistogram::GetSnapshot("test.merge").count - before, 4001u);
+	auto names = LatencyHistogram::GetNames();
+	EXPECT_NE(std::find(names.begin(), names.end(), "test.merge"), names.end());
+}
@@ -0,0 +1,48 @@
+#include "TestCommon.h"
+
+#include "log.h"
+#include <thread>
+
+TEST(TestLogger, RateLimitPerCallsite)
+{
+	bool debug = Logger::IsDebugEnabled();
+	Logger::EnableDebug(true);
+	Logger::SetRateLimit(10);
+
+	QWORD suppressed = Logger::GetSuppressedMessages();
+
+	//Log from a new thread so the whole burst falls in a fresh rate limit window
+	std::thread([](){
+		for (int i=0; i<100; ++i)
+			Warning("-TestLogger::RateLimitPerCallsite() | burst [i:%d]\n", i);
+		//Other callsites are not affected
+		Warning("-TestLogger::RateLimitPerCallsite() | other callsite\n");
+	}).join();
+
+	Logger::Flush();
+
+	//At most two windows may have been crossed
+	EXPECT_GE(Logger::GetSuppressedMessages() - suppressed, 70u);
+	EXPECT_LE(Logger::GetSuppressedMessages() - suppressed, 90u);
+
+	Logger::SetRateLimit(Logger::DefaultRateLimit);
+	Logger::EnableDebug(debug);
+}
+
+TEST(TestLogger, ErrorsAreNotRateLimited)
+{
+	Logger::SetRateLimit(5);
+
+	QWORD suppressed = Logger::GetSuppressedMessages();
+
+	std::thread([](){
+		for (int i=0; i<20; ++i)
+			Error("-TestLogger::ErrorsAreNotRateLimited() | burst [i:%d]\n", i);
+	}).join();
+
+	Logger::Flush();
+
+	EXPECT_EQ(Logger::GetSuppressedMessages(), suppressed);
+
+	Logger::SetRateLimit(Logger::DefaultRateLimit);
+}
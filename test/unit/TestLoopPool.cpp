@@ -0,0 +1,43 @@
+#include "TestCommon.h"
+
+#include "LoopPool.h"
+#include "EventLoop.h"
+#include "EpollReactor.h"
+
+TEST(TestLoopPool, Balance)
+{
+	LoopPool<EventLoop> pool("test-pool",4);
+
+	//Started on first use
+	EXPECT_EQ(pool.GetNumLoops(), 0u);
+	EventLoop* first = pool.Acquire(2);
+	EventLoop* second = pool.Acquire(2);
+	EXPECT_EQ(pool.GetNumLoops(), 2u);
+	EXPECT_NE(first, second);
+
+	//Loops are running
+	std::thread::id id;
+	first->Sync([&](auto now){ id = std::this_thread::get_id(); });
+	EXPECT_NE(id, std::this_thread::get_id());
+
+	//Least used one is reused once released
+	pool.Release(first);
+	EXPECT_EQ(pool.Acquire(2), first);
+	EventLoop* third = pool.Acquire(2);
+	EXPECT_TRUE(third == first || third == second);
+
+	//Releasing unknown loops is ignored
+	pool.Release(nullptr);
+	EXPECT_EQ(pool.GetNumLoops(), 2u);
+}
+
+TEST(TestLoopPool, DefaultNumThreads)
+{
+	LoopPool<EpollReactor> pool("test-reactor",1);
+
+	//Max default threads used when not set
+	EpollReactor* first = pool.Acquire();
+	EpollReactor* second = pool.Acquire();
+	EXPECT_EQ(pool.GetNumLoops(), 1u);
+	EXPECT_EQ(first, second);
+}
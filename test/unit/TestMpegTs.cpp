@@ -0,0 +1,477 @@
+#include "TestCommon.h"
+
+#include "mpegts/demuxer.h"
+#include "mpegts/muxer.h"
+#include "mpegts/psi.h"
+#include "audio.h"
+#include "video.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+	const BYTE sps[] = {0x67, 0x42, 0xc0, 0x0d, 0x95, 0xa0, 0x50, 0x67, 0xe7, 0x84, 0x00, 0x00, 0x0f,
+			    0xa0, 0x00, 0x03, 0xa9, 0x80, 0x3c, 0x70, 0x8a, 0x80};
+	const BYTE pps[] = {0x68, 0xce, 0x3c, 0x80};
+
+	void AppendNal(std::vector<BYTE>& data, const BYTE* nal, DWORD size)
+	{
+		BYTE prefix[4];
+		set4(prefix,0,size);
+		data.insert(data.end(),prefix,prefix+4);
+		data.insert(data.end(),nal,nal+size);
+	}
+
+	std::vector<BYTE> CreateSlice(DWORD num, bool intra, DWORD size)
+	{
+		std::vector<BYTE> slice(size);
+		slice[0] = intra ? 0x65 : 0x41;
+		//No zeros, so there are no start codes inside
+		for (DWORD i=1; i<size; ++i)
+			slice[i] = (i*7 + num) % 250 + 1;
+		return slice;
+	}
+
+	std::unique_ptr<VideoFrame> CreateVideoFrame(DWORD num, bool intra, DWORD size)
+	{
+		std::vector<BYTE> data;
+		if (intra)
+		{
+			AppendNal(data,sps,sizeof(sps));
+			AppendNal(data,pps,sizeof(pps));
+		}
+		auto slice = CreateSlice(num,intra,size);
+		AppendNal(data,slice.data(),slice.size());
+
+		auto frame = std::make_unique<VideoFrame>(VideoCodec::H264,data.size());
+		frame->SetMedia(data.data(),data.size());
+		frame->SetIntra(intra);
+		frame->SetClockRate(90000);
+		frame->SetTimestamp(num*3000);
+		frame->SetTime(5000 + num*100/3);
+		return frame;
+	}
+
+	std::unique_ptr<AudioFrame> CreateAudioFrame(AudioCodec::Type codec, DWORD num, DWORD size)
+	{
+		std::vector<BYTE> data(size);
+		for (DWORD i=0; i<size; ++i)
+			data[i] = num + i;
+		//Opus toc, 20ms celt
+		if (codec==AudioCodec::OPUS)
+			data[0] = 0xF8;
+
+		auto frame = std::make_unique<AudioFrame>(codec);
+		frame->SetMedia(data.data(),data.size());
+		frame->SetNumChannels(2);
+		if (codec==AudioCodec::AAC)
+		{
+			frame->SetClockRate(48000);
+			frame->SetTimestamp(num*1024);
+			frame->SetTime(5000 + num*1024/48);
+		} else {
+			frame->SetClockRate(48000);
+			frame->SetTimestamp(num*960);
+			frame->SetTime(5000 + num*20);
+		}
+		return frame;
+	}
+
+	DWORD AudioSize(DWORD num)
+	{
+		return 200 + num*3;
+	}
+
+	class Collector :
+		public mpegts::Muxer::Output,
+		public MediaFrame::Listener
+	{
+	public:
+		void onTransportPackets(const BYTE* data, DWORD size) override
+		{
+			EXPECT_EQ(size % mpegts::PacketSize, 0u);
+			batches++;
+			ts.insert(ts.end(),data,data+size);
+		}
+		void onMediaFrame(const MediaFrame& frame) override {}
+		void onMediaFrame(DWORD ssrc, const MediaFrame& frame) override
+		{
+			ssrcs.push_back(ssrc);
+			frames.emplace_back(frame.Clone());
+		}
+
+		DWORD batches = 0;
+		std::vector<BYTE> ts;
+		std::vector<DWORD> ssrcs;
+		std::vector<std::unique_ptr<MediaFrame>> frames;
+	};
+
+	std::vector<const MediaFrame*> Filter(const Collector& collector, MediaFrame::Type type)
+	{
+		std::vector<const MediaFrame*> filtered;
+		for (const auto& frame : collector.frames)
+			if (frame->GetType()==type)
+				filtered.push_back(frame.get());
+		return filtered;
+	}
+
+	//Mux 30 video frames with key frame each 10 and 20ms audio frames
+	void Mux(Collector& output, AudioCodec::Type audioCodec, DWORD sliceSize = 3000)
+	{
+		mpegts::Muxer muxer(&output);
+		WORD video = muxer.AddStream(MediaFrame::Video,VideoCodec::H264);
+		WORD audio = muxer.AddStream(MediaFrame::Audio,audioCodec);
+		ASSERT_EQ(video, mpegts::Muxer::FirstStreamPID);
+		ASSERT_EQ(audio, mpegts::Muxer::FirstStreamPID + 1);
+
+		DWORD audioNum = 0;
+		for (DWORD i=0; i<30; ++i)
+		{
+			ASSERT_TRUE(muxer.Mux(*CreateVideoFrame(i,i%10==0,sliceSize)));
+			for (; audioNum*20<(i+1)*100/3; ++audioNum)
+				ASSERT_TRUE(muxer.Mux(*CreateAudioFrame(audioCodec,audioNum,AudioSize(audioNum))));
+		}
+		muxer.Flush();
+	}
+}
+
+TEST(TestMpegTs, CRC)
+{
+	//Empty PAT of the spec examples
+	const BYTE pat[] = {0x00, 0xB0, 0x0D, 0x00, 0x01, 0xC1, 0x00, 0x00, 0x00, 0x01, 0xF0, 0x00};
+	std::vector<BYTE> section(pat,pat+sizeof(pat));
+	DWORD crc = mpegts::psi::CRC32(section.data(),section.size());
+	for (int i=3; i>=0; --i)
+		section.push_back(crc >> (i*8));
+	//Checking a section with its crc gives 0
+	EXPECT_EQ(mpegts::psi::CRC32(section.data(),section.size()), 0u);
+}
+
+TEST(TestMpegTs, FindSyncByte)
+{
+	std::vector<BYTE> data(1000,0x00);
+	for (size_t pos : {0, 1, 15, 16, 31, 32, 33, 500, 998, 999})
+	{
+		std::fill(data.begin(),data.end(),0x00);
+		data[pos] = mpegts::SyncByte;
+		EXPECT_EQ(mpegts::Demuxer::FindSyncByte(data.data(),data.data()+data.size()), data.data()+pos);
+	}
+	std::fill(data.begin(),data.end(),0x00);
+	EXPECT_EQ(mpegts::Demuxer::FindSyncByte(data.data(),data.data()+data.size()), data.data()+data.size());
+}
+
+TEST(TestMpegTs, RoundTripH264AAC)
+{
+	Collector output;
+	Mux(output,AudioCodec::AAC);
+	ASSERT_FALSE(output.ts.empty());
+	//Batches of 7 packets
+	EXPECT_GE(output.batches, output.ts.size()/(7*mpegts::PacketSize));
+
+	Collector input;
+	mpegts::Demuxer demuxer(&input);
+	demuxer.Process(output.ts.data(),output.ts.size(),1000);
+	demuxer.Flush();
+
+	EXPECT_EQ(demuxer.GetStats().packets, output.ts.size()/mpegts::PacketSize);
+	EXPECT_EQ(demuxer.GetStats().resyncs, 0u);
+	EXPECT_EQ(demuxer.GetStats().discontinuities, 0u);
+	EXPECT_EQ(demuxer.GetStats().errors, 0u);
+
+	//Delivered with the pid as ssrc
+	for (size_t i=0; i<input.frames.size(); ++i)
+		EXPECT_EQ(input.ssrcs[i], input.frames[i]->GetType()==MediaFrame::Video ? mpegts::Muxer::FirstStreamPID : mpegts::Muxer::FirstStreamPID + 1u);
+
+	auto videos = Filter(input,MediaFrame::Video);
+	ASSERT_EQ(videos.size(), 30u);
+	for (DWORD i=0; i<videos.size(); ++i)
+	{
+		auto expected = CreateVideoFrame(i,i%10==0,3000);
+		const VideoFrame* video = static_cast<const VideoFrame*>(videos[i]);
+		EXPECT_EQ(video->GetCodec(), VideoCodec::H264);
+		EXPECT_EQ(video->IsIntra(), i%10==0);
+		EXPECT_EQ(video->GetClockRate(), 90000u);
+		//Same length prefixed nals
+		ASSERT_EQ(video->GetLength(), expected->GetLength());
+		EXPECT_EQ(memcmp(video->GetData(),expected->GetData(),expected->GetLength()), 0);
+		EXPECT_TRUE(video->HasRtpPacketizationInfo());
+		if (video->IsIntra())
+		{
+			EXPECT_TRUE(video->HasCodecConfig());
+		}
+		//Timestamps keep distance
+		EXPECT_EQ(video->GetTimestamp() - videos[0]->GetTimestamp(), i*3000u);
+	}
+
+	auto audios = Filter(input,MediaFrame::Audio);
+	ASSERT_GT(audios.size(), 45u);
+	for (DWORD i=0; i<audios.size(); ++i)
+	{
+		auto expected = CreateAudioFrame(AudioCodec::AAC,i,AudioSize(i));
+		const AudioFrame* audio = static_cast<const AudioFrame*>(audios[i]);
+		EXPECT_EQ(audio->GetCodec(), AudioCodec::AAC);
+		EXPECT_EQ(audio->GetClockRate(), 48000u);
+		EXPECT_EQ(audio->GetNumChannels(), 2);
+		EXPECT_TRUE(audio->HasCodecConfig());
+		//Raw frame without ADTS header
+		ASSERT_EQ(audio->GetLength(), expected->GetLength());
+		EXPECT_EQ(memcmp(audio->GetData(),expected->GetData(),expected->GetLength()), 0);
+		EXPECT_EQ(audio->GetTimestamp() - audios[0]->GetTimestamp(), i*1024u);
+	}
+}
+
+TEST(TestMpegTs, RoundTripOpus)
+{
+	Collector output;
+	Mux(output,AudioCodec::OPUS);
+
+	Collector input;
+	mpegts::Demuxer demuxer(&input);
+	demuxer.Process(output.ts.data(),output.ts.size(),1000);
+	demuxer.Flush();
+
+	EXPECT_EQ(demuxer.GetStats().errors, 0u);
+	auto audios = Filter(input,MediaFrame::Audio);
+	ASSERT_EQ(audios.size(), 50u);
+	for (DWORD i=0; i<audios.size(); ++i)
+	{
+		auto expected = CreateAudioFrame(AudioCodec::OPUS,i,AudioSize(i));
+		const AudioFrame* audio = static_cast<const AudioFrame*>(audios[i]);
+		EXPECT_EQ(audio->GetCodec(), AudioCodec::OPUS);
+		EXPECT_EQ(audio->GetDuration(), 960u);
+		//Sizes over 255 are split on the control header
+		ASSERT_EQ(audio->GetLength(), expected->GetLength());
+		EXPECT_EQ(memcmp(audio->GetData(),expected->GetData(),expected->GetLength()), 0);
+		EXPECT_EQ(audio->GetTimestamp() - audios[0]->GetTimestamp(), i*960u);
+		EXPECT_EQ(audio->GetRtpPacketizationInfo().size(), 1u);
+	}
+}
+
+TEST(TestMpegTs, RoundTripReordered)
+{
+	Collector output;
+	mpegts::Muxer muxer(&output);
+	muxer.AddStream(MediaFrame::Video,VideoCodec::H264);
+
+	//Decode order I0 P3 B1 B2 P6 B4 B5, presented one frame later
+	const DWORD order[] = {0, 3, 1, 2, 6, 4, 5};
+	for (DWORD i=0; i<7; ++i)
+	{
+		auto frame = CreateVideoFrame(order[i],i==0,500);
+		frame->SetTimestamp((order[i]+1)*3000);
+		frame->SetDecodingTimestamp(i*3000);
+		ASSERT_TRUE(muxer.Mux(*frame));
+	}
+	muxer.Flush();
+
+	Collector input;
+	mpegts::Demuxer demuxer(&input);
+	demuxer.Process(output.ts.data(),output.ts.size(),1000);
+	demuxer.Flush();
+	EXPECT_EQ(demuxer.GetStats().errors, 0u);
+
+	auto videos = Filter(input,MediaFrame::Video);
+	ASSERT_EQ(videos.size(), 7u);
+	QWORD first = static_cast<const VideoFrame*>(videos[0])->GetDecodingTimestamp();
+	for (DWORD i=0; i<videos.size(); ++i)
+	{
+		const VideoFrame* video = static_cast<const VideoFrame*>(videos[i]);
+		//Both timestamps keep distance from first decoded frame
+		EXPECT_EQ(video->GetDecodingTimestamp() - first, i*3000u);
+		EXPECT_EQ(video->GetTimestamp() - first, (order[i]+1)*3000u);
+	}
+
+	//PCR is sent behind the DTS of first frame, time is its PTS
+	mpegts::Muxer::Options options;
+	EXPECT_EQ(videos[0]->GetTime(), 1000u + options.delay + 3000/90);
+}
+
+TEST(TestMpegTs, NotReordered)
+{
+	Collector output;
+	Mux(output,AudioCodec::AAC);
+
+	//Only PTS is written when frames are not reordered
+	for (size_t pos=0; pos+mpegts::PacketSize<=output.ts.size(); pos+=mpegts::PacketSize)
+	{
+		const BYTE* packet = output.ts.data() + pos;
+		//Skip packets not starting a PES
+		WORD pid = get2(packet,1) & 0x1FFF;
+		if (!(packet[1] & 0x40) || pid<mpegts::Muxer::FirstStreamPID || pid>mpegts::Muxer::FirstStreamPID+1)
+			continue;
+		DWORD payload = 4 + ((packet[3] & 0x20) ? packet[4] + 1 : 0);
+		EXPECT_EQ(packet[payload+7], 0x80);
+	}
+
+	Collector input;
+	mpegts::Demuxer demuxer(&input);
+	demuxer.Process(output.ts.data(),output.ts.size(),1000);
+	demuxer.Flush();
+
+	for (const auto video : Filter(input,MediaFrame::Video))
+		EXPECT_EQ(static_cast<const VideoFrame*>(video)->GetDecodingTimestamp(), video->GetTimestamp());
+}
+
+TEST(TestMpegTs, PCRTiming)
+{
+	Collector output;
+	Mux(output,AudioCodec::AAC);
+
+	Collector input;
+	mpegts::Demuxer demuxer(&input);
+	demuxer.Process(output.ts.data(),output.ts.size(),1000);
+	demuxer.Flush();
+
+	auto videos = Filter(input,MediaFrame::Video);
+	auto audios = Filter(input,MediaFrame::Audio);
+	ASSERT_FALSE(videos.empty());
+	ASSERT_FALSE(audios.empty());
+
+	//First PCR is sent with first video frame, delay ms before its PTS
+	mpegts::Muxer::Options options;
+	EXPECT_EQ(videos[0]->GetTime(), 1000u + options.delay);
+	//Times follow the PTS on the program clock
+	for (DWORD i=0; i<videos.size(); ++i)
+		EXPECT_NEAR((double)videos[i]->GetTime(), 1000.0 + options.delay + i*100.0/3, 1.0);
+	//Audio is aligned with video by the time of the frames
+	for (DWORD i=0; i<audios.size(); ++i)
+		EXPECT_NEAR((double)audios[i]->GetTime(), 1000.0 + options.delay + i*1024/48.0, 1.0);
+}
+
+TEST(TestMpegTs, SplitChunks)
+{
+	Collector output;
+	Mux(output,AudioCodec::AAC);
+
+	Collector whole;
+	mpegts::Demuxer reference(&whole);
+	reference.Process(output.ts.data(),output.ts.size(),1000);
+	reference.Flush();
+
+	//Feed it in chunks not aligned to packets
+	Collector input;
+	mpegts::Demuxer demuxer(&input);
+	for (size_t pos=0; pos<output.ts.size(); pos+=1000)
+		demuxer.Process(output.ts.data()+pos,std::min<size_t>(1000,output.ts.size()-pos),1000);
+	demuxer.Flush();
+
+	EXPECT_EQ(demuxer.GetStats().packets, reference.GetStats().packets);
+	EXPECT_EQ(demuxer.GetStats().resyncs, 0u);
+	ASSERT_EQ(input.frames.size(), whole.frames.size());
+	for (size_t i=0; i<input.frames.size(); ++i)
+	{
+		ASSERT_EQ(input.frames[i]->GetLength(), whole.frames[i]->GetLength());
+		EXPECT_EQ(memcmp(input.frames[i]->GetData(),whole.frames[i]->GetData(),whole.frames[i]->GetLength()), 0);
+		EXPECT_EQ(input.frames[i]->GetTimestamp(), whole.frames[i]->GetTimestamp());
+	}
+}
+
+TEST(TestMpegTs, Resync)
+{
+	Collector output;
+	Mux(output,AudioCodec::AAC);
+
+	//Insert garbage after the first few packets
+	std::vector<BYTE> ts(output.ts.begin(),output.ts.begin()+10*mpegts::PacketSize);
+	for (DWORD i=0; i<100; ++i)
+		ts.push_back(i==50 ? mpegts::SyncByte : 0xFF);
+	ts.insert(ts.end(),output.ts.begin()+10*mpegts::PacketSize,output.ts.end());
+
+	Collector input;
+	mpegts::Demuxer demuxer(&input);
+	demuxer.Process(ts.data(),ts.size(),1000);
+	demuxer.Flush();
+
+	//Sync byte inside garbage is not followed by another one
+	EXPECT_EQ(demuxer.GetStats().resyncs, 1u);
+	EXPECT_EQ(demuxer.GetStats().packets, output.ts.size()/mpegts::PacketSize);
+	EXPECT_EQ(Filter(input,MediaFrame::Video).size(), 30u);
+}
+
+TEST(TestMpegTs, ContinuityError)
+{
+	Collector output;
+	Mux(output,AudioCodec::AAC,30000);
+
+	//Drop a packet of the second video frame
+	Collector input;
+	mpegts::Demuxer demuxer(&input);
+	std::vector<BYTE> ts;
+	DWORD videoStarts = 0;
+	bool dropped = false;
+	for (size_t pos=0; pos<output.ts.size(); pos+=mpegts::PacketSize)
+	{
+		const BYTE* packet = output.ts.data()+pos;
+		WORD pid = get2(packet,1) & 0x1FFF;
+		bool start = packet[1] & 0x40;
+		if (pid==mpegts::Muxer::FirstStreamPID && start)
+			videoStarts++;
+		if (pid==mpegts::Muxer::FirstStreamPID && !start && videoStarts==2 && !dropped)
+		{
+			dropped = true;
+			continue;
+		}
+		ts.insert(ts.end(),packet,packet+mpegts::PacketSize);
+	}
+	ASSERT_TRUE(dropped);
+
+	demuxer.Process(ts.data(),ts.size(),1000);
+	demuxer.Flush();
+
+	EXPECT_EQ(demuxer.GetStats().discontinuities, 1u);
+	//Broken frame is not delivered
+	auto videos = Filter(input,MediaFrame::Video);
+	ASSERT_EQ(videos.size(), 29u);
+	EXPECT_EQ(videos[1]->GetTimestamp() - videos[0]->GetTimestamp(), 6000u);
+}
+
+TEST(TestMpegTs, UDPOutput)
+{
+	//Receiver on a random port
+	int fd = socket(AF_INET,SOCK_DGRAM,0);
+	ASSERT_GE(fd, 0);
+	int rcvbuf = 4*1024*1024;
+	setsockopt(fd,SOL_SOCKET,SO_RCVBUF,&rcvbuf,sizeof(rcvbuf));
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	ASSERT_EQ(bind(fd,(sockaddr*)&addr,sizeof(addr)), 0);
+	socklen_t len = sizeof(addr);
+	ASSERT_EQ(getsockname(fd,(sockaddr*)&addr,&len), 0);
+	WORD port = ntohs(addr.sin_port);
+
+	mpegts::UDPOutput output;
+	ASSERT_TRUE(output.Open("127.0.0.1",port));
+
+	//More datagrams than a single batch, last one not full
+	std::vector<BYTE> packets(200*mpegts::UDPOutput::DatagramSize + mpegts::PacketSize,0x47);
+	output.onTransportPackets(packets.data(),packets.size());
+	EXPECT_EQ(output.GetDropped(), 0u);
+
+	//All of them received
+	DWORD received = 0;
+	size_t bytes = 0;
+	BYTE datagram[2048];
+	int size;
+	while ((size = recv(fd,datagram,sizeof(datagram),MSG_DONTWAIT))>0)
+	{
+		received++;
+		bytes += size;
+	}
+	EXPECT_EQ(received, 201u);
+	EXPECT_EQ(bytes, packets.size());
+
+	//Nobody listening anymore
+	close(fd);
+
+	//Sending fails once the port is known to be unreachable
+	for (int i = 0; i < 10 && !output.GetDropped(); ++i)
+	{
+		output.onTransportPackets(packets.data(),mpegts::UDPOutput::DatagramSize);
+		usleep(1000);
+	}
+	EXPECT_GT(output.GetDropped(), 0u);
+	output.Close();
+}
@@ -0,0 +1,82 @@
+#include "TestCommon.h"
+
+#include "OrderedWorkerPool.h"
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <set>
+
+TEST(TestOrderedWorkerPool, OrderPerKey)
+{
+	OrderedWorkerPool pool("test");
+	ASSERT_TRUE(pool.Start(4));
+	EXPECT_EQ(pool.GetNumThreads(), 4u);
+
+	std::mutex mutex;
+	std::map<uint64_t, std::vector<int>> executed;
+	std::map<uint64_t, std::atomic<int>> running;
+	std::atomic<bool> overlapped = false;
+
+	for (uint64_t key = 1; key <= 8; ++key)
+		running[key] = 0;
+
+	//Interleave tasks of different keys
+	for (int i = 0; i < 200; ++i)
+	{
+		for (uint64_t key = 1; key <= 8; ++key)
+		{
+			pool.Post(key, [&, key, i]() {
+				//No other task for the same key must be running
+				if (running.at(key)++)
+					overlapped = true;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					executed[key].push_back(i);
+				}
+				running.at(key)--;
+			});
+		}
+	}
+
+	//Runs all pending tasks
+	pool.Stop();
+
+	EXPECT_FALSE(overlapped);
+	for (uint64_t key = 1; key <= 8; ++key)
+	{
+		ASSERT_EQ(executed[key].size(), 200u);
+		for (int i = 0; i < 200; ++i)
+			EXPECT_EQ(executed[key][i], i);
+	}
+}
+
+TEST(TestOrderedWorkerPool, Parallel)
+{
+	OrderedWorkerPool pool("test");
+	ASSERT_TRUE(pool.Start(4));
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	int waiting = 0;
+	std::set<std::thread::id> threads;
+
+	//Unordered tasks and tasks with different keys run at the same time, would block otherwise
+	for (uint64_t key = 0; key < 4; ++key)
+	{
+		pool.Post(key, [&]() {
+			std::unique_lock<std::mutex> lock(mutex);
+			threads.insert(std::this_thread::get_id());
+			++waiting;
+			cond.notify_all();
+			cond.wait(lock, [&]() { return waiting == 4; });
+		});
+	}
+
+	pool.Stop();
+
+	EXPECT_EQ(waiting, 4);
+	EXPECT_EQ(threads.size(), 4u);
+
+	//Can't stop twice
+	EXPECT_FALSE(pool.Stop());
+}
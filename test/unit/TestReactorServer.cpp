@@ -0,0 +1,120 @@
+#include "TestCommon.h"
+
+#include "ReactorServer.h"
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+namespace {
+
+class Accepted
+{
+public:
+	void OnAccepted(int fd, EpollReactor* reactor)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		fds.push_back(fd);
+		reactors.push_back(reactor);
+		cond.notify_all();
+	}
+
+	bool Wait(size_t num)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		return cond.wait_for(lock, std::chrono::seconds(5), [&]() { return fds.size()>=num; });
+	}
+
+	~Accepted()
+	{
+		for (auto fd : fds)
+			close(fd);
+	}
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::vector<int> fds;
+	std::vector<EpollReactor*> reactors;
+};
+
+int Connect(int port)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	EXPECT_EQ(connect(fd, (sockaddr*)&addr, sizeof(addr)), 0);
+	return fd;
+}
+
+}
+
+TEST(TestReactorServer, BalanceBurstOfAccepts)
+{
+	Accepted accepted;
+	ReactorServer server("test");
+	ASSERT_TRUE(server.Start(0, htonl(INADDR_LOOPBACK), 2, [&](int fd, EpollReactor* reactor) {
+		accepted.OnAccepted(fd, reactor);
+	}));
+	ASSERT_NE(server.GetPort(), 0);
+	ASSERT_EQ(server.GetNumReactors(), 2u);
+
+	//Connect all at once, nothing gets registered on the reactors meanwhile
+	std::vector<int> clients;
+	for (int i = 0; i < 8; ++i)
+		clients.push_back(Connect(server.GetPort()));
+	ASSERT_TRUE(accepted.Wait(8));
+
+	//Spread evenly
+	std::map<EpollReactor*,int> count;
+	for (auto reactor : accepted.reactors)
+		count[reactor]++;
+	ASSERT_EQ(count.size(), 2u);
+	for (const auto& [reactor,num] : count)
+		EXPECT_EQ(num, 4);
+	EXPECT_EQ(server.GetAssigned(0), 4u);
+	EXPECT_EQ(server.GetAssigned(1), 4u);
+
+	//Close two connections on the same reactor
+	EpollReactor* released = accepted.reactors[0];
+	server.Release(released);
+	server.Release(released);
+
+	//Next ones go to the one with less connections
+	clients.push_back(Connect(server.GetPort()));
+	clients.push_back(Connect(server.GetPort()));
+	ASSERT_TRUE(accepted.Wait(10));
+	EXPECT_EQ(accepted.reactors[8], released);
+	EXPECT_EQ(accepted.reactors[9], released);
+	EXPECT_EQ(server.GetAssigned(0), 4u);
+	EXPECT_EQ(server.GetAssigned(1), 4u);
+
+	//Not accepting anymore
+	server.StopAccepting();
+	server.Stop();
+	EXPECT_EQ(server.GetNumReactors(), 0u);
+
+	for (auto fd : clients)
+		close(fd);
+}
+
+TEST(TestReactorServer, StopAcceptingFromCallback)
+{
+	Accepted accepted;
+	ReactorServer server("test");
+	ASSERT_TRUE(server.Start(0, htonl(INADDR_LOOPBACK), 1, [&](int fd, EpollReactor* reactor) {
+		//Stop on first connection, from the accepting reactor
+		server.StopAccepting();
+		accepted.OnAccepted(fd, reactor);
+	}));
+
+	int client = Connect(server.GetPort());
+	ASSERT_TRUE(accepted.Wait(1));
+	EXPECT_EQ(accepted.fds.size(), 1u);
+
+	server.Stop();
+	close(client);
+}
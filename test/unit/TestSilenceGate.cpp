@@ -0,0 +1,221 @@
+#include "TestCommon.h"
+#include "rtp/RTPIncomingMediaStreamSilenceGate.h"
+#include "codecs.h"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+	class MockRTPIncomingMediaStream : public RTPIncomingMediaStream
+	{
+	public:
+		MockRTPIncomingMediaStream(TimeService& timeService) : timeService(timeService) {};
+		virtual void AddListener(Listener* listener) {};
+		virtual void RemoveListener(Listener* listener) {};
+		virtual DWORD GetMediaSSRC() const { return 0; };
+		virtual TimeService& GetTimeService() { return timeService; };
+		virtual void Mute(bool muting) {};
+	private:
+		TimeService& timeService;
+	};
+
+	class Collector : public RTPIncomingMediaStream::Listener
+	{
+	public:
+		virtual void onRTP(const RTPIncomingMediaStream* stream, const RTPPacket::shared& packet) override
+		{
+			packets.push_back(packet);
+		}
+		virtual void onBye(const RTPIncomingMediaStream* stream) override {}
+		virtual void onEnded(const RTPIncomingMediaStream* stream) override {}
+
+		std::vector<RTPPacket::shared> packets;
+	};
+
+	RTPPacket::shared CreatePacket(BYTE codec, DWORD extSeqNum, BYTE level, DWORD size = 80)
+	{
+		auto packet = std::make_shared<RTPPacket>(MediaFrame::Audio, codec);
+		packet->SetExtSeqNum(extSeqNum);
+		packet->SetTimestamp(extSeqNum*960);
+		packet->SetAudioLevel(level<127, level);
+		std::vector<BYTE> payload(size, 0x55);
+		packet->SetPayload(payload.data(), payload.size());
+		return packet;
+	}
+}
+
+class TestSilenceGate : public ::testing::Test
+{
+public:
+	TestSilenceGate() :
+		stream(std::make_shared<MockRTPIncomingMediaStream>(timeService)),
+		gate(stream, timeService)
+	{
+		timeService.SetNow(1000ms);
+		gate.AddListener(&collector);
+	}
+
+	//Sends a packet each 20ms
+	void Send(const RTPPacket::shared& packet)
+	{
+		gate.onRTP(stream.get(), packet);
+		timeService.SetNow(timeService.GetNow() + 20ms);
+	}
+
+protected:
+	TestTimeService timeService;
+	std::shared_ptr<MockRTPIncomingMediaStream> stream;
+	RTPIncomingMediaStreamSilenceGate gate;
+	Collector collector;
+};
+
+TEST_F(TestSilenceGate, DropsSilenceAfterHangover)
+{
+	gate.SetThreshold(60);
+	gate.SetHangover(100);
+
+	//1s of voice, 1s of silence and 1s of voice
+	DWORD seq = 0;
+	for (DWORD i=0; i<50; ++i)
+		Send(CreatePacket(AudioCodec::OPUS, seq++, 30));
+	for (DWORD i=0; i<50; ++i)
+		Send(CreatePacket(AudioCodec::OPUS, seq++, 90));
+	for (DWORD i=0; i<50; ++i)
+		Send(CreatePacket(AudioCodec::OPUS, seq++, 30));
+
+	//Hangover keeps the silent packets of the first 100ms
+	ASSERT_EQ(collector.packets.size(), 104u);
+	EXPECT_EQ(gate.GetStats().dropped, 46u);
+	EXPECT_EQ(gate.GetStats().talkspurts, 2u);
+
+	//Sequence numbers are contiguous
+	for (DWORD i=0; i<collector.packets.size(); ++i)
+		ASSERT_EQ(collector.packets[i]->GetExtSeqNum(), i);
+
+	//Talkspurt starts are marked
+	EXPECT_TRUE(collector.packets[0]->GetMark());
+	EXPECT_FALSE(collector.packets[1]->GetMark());
+	EXPECT_TRUE(collector.packets[54]->GetMark());
+	EXPECT_FALSE(collector.packets[55]->GetMark());
+	//Timestamp is not changed
+	EXPECT_EQ(collector.packets[54]->GetTimestamp(), 100u*960);
+}
+
+TEST_F(TestSilenceGate, GetForwarded)
+{
+	gate.SetThreshold(60);
+	gate.SetHangover(0);
+
+	//Voice, silence and voice again
+	DWORD seq = 0;
+	for (DWORD i=0; i<5; ++i)
+		Send(CreatePacket(AudioCodec::OPUS, seq++, 30));
+	for (DWORD i=0; i<5; ++i)
+		Send(CreatePacket(AudioCodec::OPUS, seq++, 90));
+	std::vector<RTPPacket::shared> voice;
+	for (DWORD i=0; i<5; ++i)
+	{
+		voice.push_back(CreatePacket(AudioCodec::OPUS, seq++, 30));
+		Send(voice.back());
+	}
+
+	//Same number than when forwarded
+	for (const auto& packet : voice)
+	{
+		auto forwarded = gate.GetForwarded(packet);
+		ASSERT_TRUE(forwarded);
+		EXPECT_EQ(forwarded->GetExtSeqNum(), packet->GetExtSeqNum()-5);
+	}
+	EXPECT_EQ(collector.packets.back()->GetExtSeqNum(), gate.GetForwarded(voice.back())->GetExtSeqNum());
+
+	//Forwarded before the dropped ones, not processed yet and dropped ones
+	EXPECT_FALSE(gate.GetForwarded(CreatePacket(AudioCodec::OPUS, 2, 30)));
+	EXPECT_FALSE(gate.GetForwarded(CreatePacket(AudioCodec::OPUS, 7, 90)));
+	EXPECT_FALSE(gate.GetForwarded(CreatePacket(AudioCodec::OPUS, seq, 30)));
+	//Nothing changed
+	EXPECT_EQ(collector.packets.size(), 10u);
+}
+
+TEST_F(TestSilenceGate, DropsOpusDTX)
+{
+	DWORD seq = 0;
+	Send(CreatePacket(AudioCodec::OPUS, seq++, 30));
+	gate.SetHangover(0);
+	//DTX frames, even without silent level
+	for (DWORD i=0; i<10; ++i)
+		Send(CreatePacket(AudioCodec::OPUS, seq++, 30, 1));
+	//Not for other codecs
+	Send(CreatePacket(AudioCodec::PCMU, seq++, 30, 1));
+
+	ASSERT_EQ(collector.packets.size(), 2u);
+	EXPECT_EQ(collector.packets[1]->GetExtSeqNum(), 1u);
+	EXPECT_EQ(gate.GetStats().dropped, 10u);
+}
+
+TEST_F(TestSilenceGate, ComfortNoise)
+{
+	gate.SetHangover(0);
+	gate.SetComfortNoiseInterval(200);
+
+	DWORD seq = 0;
+	Send(CreatePacket(AudioCodec::OPUS, seq++, 30));
+	//1s of digital silence
+	for (DWORD i=0; i<50; ++i)
+		Send(CreatePacket(AudioCodec::OPUS, seq++, 127));
+
+	//One comfort noise frame each 200ms
+	ASSERT_EQ(collector.packets.size(), 6u);
+	EXPECT_EQ(gate.GetStats().comfortNoise, 5u);
+	for (DWORD i=1; i<collector.packets.size(); ++i)
+	{
+		const auto& packet = collector.packets[i];
+		ASSERT_EQ(packet->GetExtSeqNum(), i);
+		ASSERT_EQ(packet->GetMediaLength(), 3u);
+		EXPECT_EQ(packet->GetMediaData()[0], 0xF8);
+		EXPECT_FALSE(packet->GetVAD());
+		EXPECT_EQ(packet->GetLevel(), 127);
+	}
+}
+
+TEST_F(TestSilenceGate, LatePackets)
+{
+	gate.SetHangover(0);
+
+	Send(CreatePacket(AudioCodec::OPUS, 0, 30));
+	Send(CreatePacket(AudioCodec::OPUS, 2, 127));
+	Send(CreatePacket(AudioCodec::OPUS, 3, 30));
+	//Older than a dropped one, would collide with 3
+	Send(CreatePacket(AudioCodec::OPUS, 1, 30));
+	//Late but after the dropped one
+	Send(CreatePacket(AudioCodec::OPUS, 5, 30));
+	Send(CreatePacket(AudioCodec::OPUS, 4, 30));
+
+	ASSERT_EQ(collector.packets.size(), 4u);
+	EXPECT_EQ(collector.packets[0]->GetExtSeqNum(), 0u);
+	EXPECT_EQ(collector.packets[1]->GetExtSeqNum(), 2u);
+	EXPECT_EQ(collector.packets[2]->GetExtSeqNum(), 4u);
+	EXPECT_EQ(collector.packets[3]->GetExtSeqNum(), 3u);
+}
+
+TEST_F(TestSilenceGate, LatePacketsWhileSilent)
+{
+	gate.SetHangover(0);
+	gate.SetComfortNoiseInterval(40);
+
+	Send(CreatePacket(AudioCodec::OPUS, 0, 30));
+	Send(CreatePacket(AudioCodec::OPUS, 1, 127));
+	//Sent as comfort noise
+	Send(CreatePacket(AudioCodec::OPUS, 3, 127));
+	//Late voice while silent, leaves a gap
+	Send(CreatePacket(AudioCodec::OPUS, 2, 30));
+	Send(CreatePacket(AudioCodec::OPUS, 4, 30));
+	//Too late
+	Send(CreatePacket(AudioCodec::OPUS, 1, 30));
+
+	ASSERT_EQ(collector.packets.size(), 3u);
+	EXPECT_EQ(collector.packets[0]->GetExtSeqNum(), 0u);
+	EXPECT_EQ(collector.packets[1]->GetExtSeqNum(), 2u);
+	EXPECT_EQ(collector.packets[2]->GetExtSeqNum(), 3u);
+	EXPECT_EQ(gate.GetStats().comfortNoise, 1u);
+	EXPECT_EQ(gate.GetStats().dropped, 3u);
+}
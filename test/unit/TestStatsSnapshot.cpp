@@ -0,0 +1,97 @@
+#include "TestCommon.h"
+
+#include "StatsSnapshot.h"
+#include <thread>
+
+namespace {
+
+struct Counters
+{
+	uint64_t first;
+	uint64_t values[15];
+	uint64_t last;
+};
+
+}
+
+TEST(TestStatsSnapshot, ReadersNeverSeeTornValues)
+{
+	SeqLock<Counters> lock;
+	std::atomic<bool> running = true;
+	std::atomic<uint64_t> torn = 0;
+	std::atomic<uint64_t> reads = 0;
+
+	//Readers check that all values belong to the same publish
+	std::vector<std::thread> readers;
+	for (int i = 0; i < 2; ++i)
+		readers.emplace_back([&]() {
+			while (running)
+			{
+				auto counters = lock.Read();
+				for (auto value : counters.values)
+					if (value != counters.first)
+						torn++;
+				if (counters.last != counters.first)
+					torn++;
+				reads++;
+			}
+		});
+
+	//Publish from this thread
+	for (uint64_t i = 1; i <= 200000; ++i)
+	{
+		Counters counters;
+		counters.first = counters.last = i;
+		std::fill(std::begin(counters.values), std::end(counters.values), i);
+		lock.Publish(counters);
+	}
+
+	running = false;
+	for (auto& reader : readers)
+		reader.join();
+
+	EXPECT_EQ(torn, 0u);
+	EXPECT_GT(reads, 0u);
+	EXPECT_EQ(lock.Read().last, 200000u);
+	EXPECT_EQ(lock.GetVersion(), 400000u);
+}
+
+TEST(TestStatsSnapshot, PublishersOwnSlotsWhileAlive)
+{
+	auto used = StatsSnapshotRegistry::GetUsedSlots();
+
+	{
+		StatsSnapshotRegistry::Publisher publisher;
+		//No slot until first publish
+		EXPECT_EQ(StatsSnapshotRegistry::GetUsedSlots(), used);
+
+		StatsSnapshot snapshot;
+		snapshot.kind	 = StatsSnapshot::OutgoingSourceGroup;
+		snapshot.ssrc	 = 0x12345678;
+		snapshot.bitrate = 1000;
+		publisher.Publish(snapshot);
+
+		EXPECT_EQ(StatsSnapshotRegistry::GetUsedSlots(), used + 1);
+
+		//Update it
+		snapshot.bitrate = 2000;
+		publisher.Publish(snapshot);
+
+		//Find it from other thread
+		std::vector<StatsSnapshot> found;
+		std::thread([&]() {
+			for (const auto& snapshot : StatsSnapshotRegistry::GetSnapshots())
+				if (snapshot.ssrc == 0x12345678)
+					found.push_back(snapshot);
+		}).join();
+
+		ASSERT_EQ(found.size(), 1u);
+		EXPECT_EQ(found[0].kind, StatsSnapshot::OutgoingSourceGroup);
+		EXPECT_EQ(found[0].bitrate, 2000u);
+	}
+
+	//Released
+	EXPECT_EQ(StatsSnapshotRegistry::GetUsedSlots(), used);
+	for (const auto& snapshot : StatsSnapshotRegistry::GetSnapshots())
+		EXPECT_NE(snapshot.ssrc, 0x12345678u);
+}
@@ -0,0 +1,291 @@
+#include "TestCommon.h"
+
+#include "TimeShiftBuffer.h"
+#include "audio.h"
+#include "video.h"
+#include <stdlib.h>
+
+namespace
+{
+	std::unique_ptr<VideoFrame> CreateVideoFrame(DWORD num, bool intra, DWORD size, QWORD time)
+	{
+		auto frame = std::make_unique<VideoFrame>(VideoCodec::VP8,size);
+		std::vector<BYTE> data(size,(BYTE)num);
+		//Put frame number at the start
+		if (size >= 4)
+			set4(data.data(),0,num);
+		frame->SetMedia(data.data(),data.size());
+		frame->SetIntra(intra);
+		frame->SetWidth(640);
+		frame->SetHeight(480);
+		frame->SetClockRate(90000);
+		frame->SetTimestamp(num*3000);
+		frame->SetTime(time);
+		return frame;
+	}
+
+	std::unique_ptr<AudioFrame> CreateAudioFrame(DWORD num, QWORD time)
+	{
+		auto frame = std::make_unique<AudioFrame>(AudioCodec::OPUS);
+		BYTE data[40] = {};
+		set4(data,0,num);
+		frame->SetMedia(data,sizeof(data));
+		frame->SetClockRate(48000);
+		frame->SetTimestamp(num*960);
+		frame->SetTime(time);
+		frame->SetDuration(960);
+		return frame;
+	}
+
+	struct Drained
+	{
+		DWORD ssrc;
+		MediaFrame::Type type;
+		DWORD num;
+		bool intra;
+		QWORD time;
+	};
+
+	std::vector<Drained> Drain(TimeShiftBuffer& buffer)
+	{
+		std::vector<Drained> drained;
+		buffer.Drain([&](DWORD ssrc, const MediaFrame& frame) {
+			bool intra = frame.GetType() == MediaFrame::Video && ((const VideoFrame&)frame).IsIntra();
+			drained.push_back({ssrc,frame.GetType(),get4(frame.GetData(),0),intra,frame.GetTime()});
+		});
+		return drained;
+	}
+}
+
+TEST(TestTimeShiftBuffer, RoundTrip)
+{
+	TimeShiftBuffer::Options options;
+	options.duration = 10000;
+	TimeShiftBuffer buffer(options);
+
+	//Audio with config and packetization info
+	auto audio = CreateAudioFrame(7,1000);
+	BYTE config[] = {0x12,0x10};
+	audio->SetCodecConfig(config,sizeof(config));
+	BYTE prefix[] = {0xAA,0xBB,0xCC};
+	audio->AddRtpPacket(0,20);
+	audio->AddRtpPacket(20,20,prefix,sizeof(prefix));
+	ASSERT_TRUE(buffer.Push(1,*audio));
+
+	auto video = CreateVideoFrame(9,true,5000,1010);
+	ASSERT_TRUE(buffer.Push(2,*video));
+
+	EXPECT_EQ(buffer.GetNumFrames(), 2u);
+	EXPECT_EQ(buffer.GetBufferedDuration(), 10u);
+	EXPECT_EQ(buffer.GetMemoryUsage(), 40 + 2 + 10 + 10 + 3 + 5000u);
+
+	int frames = 0;
+	buffer.Drain([&](DWORD ssrc, const MediaFrame& frame) {
+		if (frames++ == 0)
+		{
+			ASSERT_EQ(frame.GetType(), MediaFrame::Audio);
+			const AudioFrame& drained = (const AudioFrame&)frame;
+			EXPECT_EQ(ssrc, 1u);
+			EXPECT_EQ(drained.GetCodec(), AudioCodec::OPUS);
+			EXPECT_EQ(drained.GetTimeStamp(), 7*960u);
+			EXPECT_EQ(drained.GetTime(), 1000u);
+			EXPECT_EQ(drained.GetClockRate(), 48000u);
+			EXPECT_EQ(drained.GetDuration(), 960u);
+			ASSERT_EQ(drained.GetLength(), 40u);
+			EXPECT_EQ(memcmp(drained.GetData(),audio->GetData(),40), 0);
+			ASSERT_EQ(drained.GetCodecConfigSize(), 2u);
+			EXPECT_EQ(memcmp(drained.GetCodecConfigData(),config,2), 0);
+			const auto& rtp = drained.GetRtpPacketizationInfo();
+			ASSERT_EQ(rtp.size(), 2u);
+			EXPECT_EQ(rtp[1].GetPos(), 20u);
+			EXPECT_EQ(rtp[1].GetSize(), 20u);
+			ASSERT_EQ(rtp[1].GetPrefixLen(), 3u);
+			EXPECT_EQ(memcmp(rtp[1].GetPrefixData(),prefix,3), 0);
+		} else {
+			ASSERT_EQ(frame.GetType(), MediaFrame::Video);
+			const VideoFrame& drained = (const VideoFrame&)frame;
+			EXPECT_EQ(ssrc, 2u);
+			EXPECT_EQ(drained.GetCodec(), VideoCodec::VP8);
+			EXPECT_TRUE(drained.IsIntra());
+			EXPECT_EQ(drained.GetWidth(), 640u);
+			EXPECT_EQ(drained.GetHeight(), 480u);
+			ASSERT_EQ(drained.GetLength(), 5000u);
+			EXPECT_EQ(memcmp(drained.GetData(),video->GetData(),5000), 0);
+		}
+	});
+	EXPECT_EQ(frames, 2);
+
+	//Memory is released
+	EXPECT_TRUE(buffer.IsEmpty());
+	EXPECT_EQ(buffer.GetMemorySize(), 0u);
+}
+
+TEST(TestTimeShiftBuffer, GOPAlignedEviction)
+{
+	TimeShiftBuffer::Options options;
+	options.duration = 1000;
+	TimeShiftBuffer buffer(options);
+
+	//3 seconds of 30fps video with key frames each 500ms and audio each 20ms
+	for (DWORD i = 0; i < 90; ++i)
+	{
+		QWORD time = 10000 + i*1000/30;
+		ASSERT_TRUE(buffer.Push(1,*CreateVideoFrame(i,i % 15 == 0,1000,time)));
+		ASSERT_TRUE(buffer.Push(2,*CreateAudioFrame(i,time)));
+	}
+
+	//Covers the duration, but less than a gop more
+	EXPECT_GE(buffer.GetBufferedDuration(), 1000u);
+	EXPECT_LT(buffer.GetBufferedDuration(), 1500u);
+
+	auto drained = Drain(buffer);
+	ASSERT_FALSE(drained.empty());
+	//Starts on a key frame
+	EXPECT_EQ(drained.front().type, MediaFrame::Video);
+	EXPECT_TRUE(drained.front().intra);
+	EXPECT_EQ(drained.front().num % 15, 0u);
+	//And ends with last frames
+	EXPECT_EQ(drained.back().num, 89u);
+	//In order
+	for (size_t i = 1; i < drained.size(); ++i)
+		EXPECT_GE(drained[i].time, drained[i-1].time);
+}
+
+TEST(TestTimeShiftBuffer, AudioOnly)
+{
+	TimeShiftBuffer::Options options;
+	options.duration = 100;
+	TimeShiftBuffer buffer(options);
+
+	for (DWORD i = 0; i < 100; ++i)
+		ASSERT_TRUE(buffer.Push(1,*CreateAudioFrame(i,i*20)));
+
+	//All audio frames are sync, so it is trimmed exactly
+	EXPECT_EQ(buffer.GetBufferedDuration(), 100u);
+	auto drained = Drain(buffer);
+	ASSERT_EQ(drained.size(), 6u);
+	EXPECT_EQ(drained.front().num, 94u);
+}
+
+TEST(TestTimeShiftBuffer, EmptyFrames)
+{
+	TimeShiftBuffer::Options options;
+	options.duration = 1000;
+	TimeShiftBuffer buffer(options);
+
+	//Empty frames are not stored
+	EXPECT_FALSE(buffer.Push(1,*CreateVideoFrame(0,true,0,0)));
+	EXPECT_TRUE(buffer.IsEmpty());
+	EXPECT_EQ(buffer.GetStats().overflows, 0u);
+
+	//Interleaved with non empty ones
+	for (DWORD i = 0; i < 20; ++i)
+	{
+		ASSERT_TRUE(buffer.Push(1,*CreateVideoFrame(i,i == 0,100,i*33)));
+		EXPECT_FALSE(buffer.Push(1,*CreateVideoFrame(i,false,0,i*33)));
+	}
+
+	EXPECT_EQ(buffer.GetNumFrames(), 20u);
+	EXPECT_EQ(buffer.GetMemoryUsage(), 20*100u);
+	auto drained = Drain(buffer);
+	ASSERT_EQ(drained.size(), 20u);
+	EXPECT_EQ(drained.back().num, 19u);
+}
+
+TEST(TestTimeShiftBuffer, Swap)
+{
+	TimeShiftBuffer::Options options;
+	options.duration = 1000;
+	TimeShiftBuffer buffer(options);
+
+	for (DWORD i = 0; i < 10; ++i)
+		ASSERT_TRUE(buffer.Push(1,*CreateAudioFrame(i,i*20)));
+
+	//Take frames keeping the options
+	TimeShiftBuffer taken;
+	taken.SetOptions(buffer.GetOptions());
+	taken.Swap(buffer);
+
+	EXPECT_TRUE(buffer.IsEmpty());
+	EXPECT_EQ(buffer.GetDuration(), 1000u);
+	EXPECT_EQ(taken.GetNumFrames(), 10u);
+
+	//Both can be used independently
+	ASSERT_TRUE(buffer.Push(1,*CreateAudioFrame(10,200)));
+	EXPECT_EQ(Drain(taken).size(), 10u);
+	auto drained = Drain(buffer);
+	ASSERT_EQ(drained.size(), 1u);
+	EXPECT_EQ(drained.front().num, 10u);
+}
+
+TEST(TestTimeShiftBuffer, BoundedMemory)
+{
+	TimeShiftBuffer::Options options;
+	options.duration = 60000;
+	options.maxMemory = 256*1024;
+	TimeShiftBuffer buffer(options);
+
+	//Way more than max memory
+	for (DWORD i = 0; i < 300; ++i)
+		ASSERT_TRUE(buffer.Push(1,*CreateVideoFrame(i,i % 10 == 0,10000,i*33)));
+
+	EXPECT_LE(buffer.GetMemorySize(), 256*1024u);
+	EXPECT_EQ(buffer.GetStats().overflows, 0u);
+	EXPECT_GT(buffer.GetStats().evicted, 0u);
+
+	//Frame bigger than the arena
+	EXPECT_FALSE(buffer.Push(1,*CreateVideoFrame(300,true,512*1024,300*33)));
+	EXPECT_EQ(buffer.GetStats().overflows, 1u);
+
+	auto drained = Drain(buffer);
+	ASSERT_FALSE(drained.empty());
+	EXPECT_TRUE(drained.front().intra);
+	EXPECT_EQ(drained.back().num, 299u);
+	//Consecutive
+	for (size_t i = 1; i < drained.size(); ++i)
+		EXPECT_EQ(drained[i].num, drained[i-1].num + 1);
+}
+
+TEST(TestTimeShiftBuffer, Spill)
+{
+	char dir[] = "/tmp/timeshiftXXXXXX";
+	ASSERT_TRUE(mkdtemp(dir));
+
+	TimeShiftBuffer::Options options;
+	options.duration = 60000;
+	options.maxMemory = 64*1024;
+	options.spillDir = dir;
+	options.maxSpill = 1024*1024;
+	TimeShiftBuffer buffer(options);
+
+	//Fits on memory and disk
+	for (DWORD i = 0; i < 200; ++i)
+		ASSERT_TRUE(buffer.Push(1,*CreateVideoFrame(i,i % 10 == 0,4000,i*33)));
+
+	EXPECT_LE(buffer.GetMemorySize(), 64*1024u);
+	EXPECT_GT(buffer.GetStats().spilled, 0u);
+	EXPECT_GT(buffer.GetSpillUsage(), 0u);
+	EXPECT_EQ(buffer.GetStats().evicted, 0u);
+
+	//All frames are kept in order
+	auto drained = Drain(buffer);
+	ASSERT_EQ(drained.size(), 200u);
+	for (DWORD i = 0; i < 200; ++i)
+		EXPECT_EQ(drained[i].num, i);
+
+	//Now overflow disk too
+	for (DWORD i = 0; i < 1000; ++i)
+		ASSERT_TRUE(buffer.Push(1,*CreateVideoFrame(i,i % 10 == 0,4000,i*33)));
+	EXPECT_GT(buffer.GetStats().evicted, 0u);
+	EXPECT_LE(buffer.GetSpillUsage(), 1024*1024u);
+
+	drained = Drain(buffer);
+	ASSERT_FALSE(drained.empty());
+	EXPECT_TRUE(drained.front().intra);
+	EXPECT_EQ(drained.back().num, 999u);
+	for (size_t i = 1; i < drained.size(); ++i)
+		EXPECT_EQ(drained[i].num, drained[i-1].num + 1);
+
+	//Spill file is not left behind
+	EXPECT_EQ(rmdir(dir), 0);
+}
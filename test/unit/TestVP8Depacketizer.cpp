@@ -3,6 +3,7 @@
 
 #include <limits>
 #include <memory>
+#include <thread>
 
 class TestVP8Depacketizer : public VP8TestBase
 {
@@ -105,4 +106,70 @@ TEST_F(TestVP8Depacketizer, NormalPacketsMaxSeqnum)
 	ASSERT_NE(nullptr, Add(MarkerPacket(1000, 0)));
 
 	ASSERT_EQ(3, currentSeqNum);
-}
\ No newline at end of file
+}
+TEST_F(TestVP8Depacketizer, FragmentedFrame)
+{
+	std::vector<std::shared_ptr<RTPPacket>> packets = {
+		StartPacket(1000, 0),
+		MiddlePacket(1000, 0),
+		MarkerPacket(1000, 0)
+	};
+
+	std::vector<BYTE> expected;
+	BYTE value = 0;
+
+	for (auto& packet : packets)
+	{
+		VP8PayloadDescriptor desc;
+		auto descLen = desc.Parse(packet->GetMediaData(), packet->GetMediaLength());
+		ASSERT_NE(0, descLen);
+
+		// Fill media data after the descriptor with a known pattern
+		BYTE* data = packet->AdquireMediaData();
+		for (DWORD i = descLen; i < packet->GetMediaLength(); ++i)
+			data[i] = value++;
+
+		expected.insert(expected.end(), data + descLen, data + packet->GetMediaLength());
+	}
+
+	MediaFrame* frame = nullptr;
+	for (auto& packet : packets)
+		frame = Add(packet);
+
+	ASSERT_NE(nullptr, frame);
+
+	// Payloads are referenced, not copied
+	ASSERT_TRUE(frame->IsFragmented());
+	ASSERT_EQ(expected.size(), frame->GetLength());
+
+	// Writing on the packets after depacketizing must not change the frame
+	for (auto& packet : packets)
+		memset(packet->AdquireMediaData(), 0xFF, packet->GetMediaLength());
+
+	// Clones share the same fragments
+	std::unique_ptr<MediaFrame> cloned(frame->Clone());
+	ASSERT_TRUE(cloned->IsFragmented());
+
+	// Const readers on several threads get the same contiguous copy, without modifying the frame
+	const MediaFrame& constFrame = *frame;
+	const BYTE* data[4] = {};
+	std::vector<std::thread> readers;
+	for (auto& read : data)
+		readers.emplace_back([&constFrame,&read]() { read = constFrame.GetData(); });
+	for (auto& reader : readers)
+		reader.join();
+	for (auto read : data)
+		ASSERT_EQ(data[0], read);
+	ASSERT_EQ(0, memcmp(expected.data(), data[0], expected.size()));
+	ASSERT_TRUE(frame->IsFragmented());
+	ASSERT_EQ(expected.size(), frame->GetLength());
+
+	// Flattened when modified
+	frame->GetData()[0] ^= 0xFF;
+	ASSERT_FALSE(frame->IsFragmented());
+	ASSERT_EQ(expected.size(), frame->GetLength());
+	// Readers copy is not changed
+	ASSERT_EQ(expected[0], data[0][0]);
+
+	ASSERT_EQ(0, memcmp(expected.data(), cloned->GetData(), expected.size()));
+}
@@ -0,0 +1,85 @@
+#include "TestCommon.h"
+#include "VideoBufferPool.h"
+
+TEST(TestVideoBufferPool, Reuse)
+{
+	VideoBufferPool pool(2, 4);
+	pool.SetSize(640, 360);
+
+	auto stats = pool.GetStats();
+	EXPECT_EQ(stats.idle, 2u);
+	EXPECT_EQ(stats.bytesResident, 2*VideoBuffer::GetRequiredSize(640, 360));
+
+	//Preallocated ones first
+	auto first = pool.allocate();
+	auto second = pool.allocate();
+	auto third = pool.allocate();
+	ASSERT_TRUE(first && second && third);
+	stats = pool.GetStats();
+	EXPECT_EQ(stats.hits, 2u);
+	EXPECT_EQ(stats.misses, 1u);
+	EXPECT_EQ(stats.allocated, 3u);
+	EXPECT_EQ(stats.idle, 0u);
+	EXPECT_EQ(stats.bytesResident, 3*third->GetSize());
+
+	//Returned to the pool on release
+	auto ptr = first.get();
+	first.reset();
+	EXPECT_EQ(pool.GetStats().idle, 1u);
+	auto again = pool.allocate();
+	EXPECT_EQ(again.get(), ptr);
+
+	//Buffers of previous size are kept for switching back
+	pool.SetSize(320, 180);
+	second.reset();
+	pool.SetSize(640, 360);
+	EXPECT_EQ(pool.allocate()->GetWidth(), 640u);
+	EXPECT_EQ(pool.GetStats().misses, 1u);
+
+	//Buffers outliving the pool are deleted
+	auto orphan = pool.allocate();
+	{
+		VideoBufferPool other(0, 1);
+		other.SetSize(64, 64);
+		orphan = other.allocate();
+	}
+	orphan.reset();
+}
+
+TEST(TestVideoBufferPool, MemoryLimit)
+{
+	size_t small = VideoBuffer::GetRequiredSize(320, 180);
+	size_t big = VideoBuffer::GetRequiredSize(640, 360);
+
+	VideoBufferPool pool(1, 2);
+	//Room for a big one, or for the small ones fitting in it
+	pool.SetMaxMemory(big + small/2);
+	pool.SetSize(320, 180);
+	size_t fitting = (big + small/2)/small;
+
+	std::vector<VideoBuffer::shared> buffers;
+	for (size_t i=0; i<fitting; ++i)
+	{
+		buffers.push_back(pool.allocate());
+		ASSERT_TRUE(buffers.back());
+	}
+	//Over the limit, rejected before allocating
+	EXPECT_FALSE(pool.allocate());
+	auto stats = pool.GetStats();
+	EXPECT_EQ(stats.failed, 1u);
+	EXPECT_EQ(stats.allocated, fitting);
+	EXPECT_EQ(stats.bytesResident, fitting*small);
+
+	//Idle small ones are trimmed to make room for a big one
+	buffers.clear();
+	EXPECT_EQ(pool.GetStats().idle, 2u);
+	pool.SetSize(640, 360);
+	auto bigger = pool.allocate();
+	ASSERT_TRUE(bigger);
+	EXPECT_EQ(bigger->GetWidth(), 640u);
+	EXPECT_LE(pool.GetStats().bytesResident, big + small/2);
+
+	//No room for another one
+	EXPECT_FALSE(pool.allocate());
+	EXPECT_EQ(pool.GetStats().failed, 2u);
+}
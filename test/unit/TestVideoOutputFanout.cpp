@@ -0,0 +1,103 @@
+#include "TestCommon.h"
+#include "VideoOutputFanout.h"
+
+namespace
+{
+	class Collector : public VideoOutput
+	{
+	public:
+		virtual void ClearFrame() override {}
+		virtual int NextFrame(const VideoBuffer::const_shared& videoBuffer) override
+		{
+			frames.push_back(videoBuffer);
+			return 1;
+		}
+
+		std::vector<VideoBuffer::const_shared> frames;
+	};
+
+	//Fake scaler, counts the resize calls
+	struct Scaler
+	{
+		bool operator()(const VideoBuffer::const_shared& input, const VideoBuffer::shared& output)
+		{
+			calls++;
+			return ok;
+		}
+		int calls = 0;
+		bool ok = true;
+	};
+}
+
+TEST(TestVideoOutputFanout, RateLimit)
+{
+	Scaler scaler;
+	VideoOutputFanout fanout(std::ref(scaler));
+	Collector full, limited;
+
+	fanout.AddOutput(&full);
+	fanout.AddOutput(&limited, 0, 0, 10);
+
+	auto frame = std::make_shared<VideoBuffer>(64, 64);
+
+	//1s at 30fps
+	for (QWORD i=0; i<30; ++i)
+		fanout.Deliver(frame, i*1000/30);
+
+	//All frames for the unlimited one
+	EXPECT_EQ(full.frames.size(), 30u);
+	EXPECT_EQ(fanout.GetDroppedFrames(&full), 0u);
+	//One each 100ms for the limited one
+	EXPECT_EQ(limited.frames.size(), 10u);
+	EXPECT_EQ(fanout.GetDroppedFrames(&limited), 20u);
+	//No scaling was needed
+	EXPECT_EQ(scaler.calls, 0);
+	EXPECT_EQ(full.frames[0], frame);
+}
+
+TEST(TestVideoOutputFanout, ScaleOncePerSize)
+{
+	Scaler scaler;
+	VideoOutputFanout fanout(std::ref(scaler));
+	Collector same, small1, small2, big;
+
+	//Odd sizes are rounded down
+	fanout.AddOutput(&same, 64, 64);
+	fanout.AddOutput(&small1, 32, 33);
+	fanout.AddOutput(&small2, 32, 32);
+	fanout.AddOutput(&big, 128, 128);
+	EXPECT_EQ(fanout.GetNumPools(), 3u);
+
+	auto frame = std::make_shared<VideoBuffer>(64, 64);
+	frame->SetTime(1234);
+
+	for (QWORD i=0; i<3; ++i)
+		fanout.Deliver(frame, i*33);
+
+	//One resize per frame and distinct size
+	EXPECT_EQ(scaler.calls, 6);
+	ASSERT_EQ(small1.frames.size(), 3u);
+	ASSERT_EQ(small2.frames.size(), 3u);
+	ASSERT_EQ(big.frames.size(), 3u);
+	ASSERT_EQ(same.frames.size(), 3u);
+	//Same picture for all the outputs of the same size
+	EXPECT_EQ(small1.frames[2], small2.frames[2]);
+	EXPECT_EQ(small1.frames[2]->GetWidth(), 32u);
+	EXPECT_EQ(small1.frames[2]->GetHeight(), 32u);
+	EXPECT_EQ(small1.frames[2]->GetTime(), 1234u);
+	EXPECT_EQ(big.frames[2]->GetWidth(), 128u);
+	//Not scaled when it already has the size
+	EXPECT_EQ(same.frames[2], frame);
+
+	//Pools are removed with their last output
+	fanout.RemoveOutput(&small1);
+	EXPECT_EQ(fanout.GetNumPools(), 3u);
+	fanout.RemoveOutput(&small2);
+	EXPECT_EQ(fanout.GetNumPools(), 2u);
+
+	//Failed resizes are not delivered
+	scaler.ok = false;
+	fanout.Deliver(frame, 100);
+	EXPECT_EQ(big.frames.size(), 3u);
+	EXPECT_EQ(same.frames.size(), 4u);
+}
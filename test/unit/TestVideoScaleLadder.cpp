@@ -0,0 +1,72 @@
+#include "TestCommon.h"
+#include "VideoScaleLadder.h"
+
+namespace
+{
+	//Fake scaler, records the size of the pictures scaled from
+	struct Scaler
+	{
+		bool operator()(const VideoBuffer::const_shared& input, const VideoBuffer::shared& output)
+		{
+			//Fail for the given output width
+			if (output->GetWidth()==fail)
+				return false;
+			inputs.push_back(input->GetWidth());
+			return true;
+		}
+		std::vector<uint32_t> inputs;
+		uint32_t fail = 0;
+	};
+}
+
+TEST(TestVideoScaleLadder, ScaleTree)
+{
+	Scaler scaler;
+	VideoScaleLadder ladder(std::ref(scaler));
+	ladder.SetSizes({{1280,720},{640,360},{320,180}});
+	ASSERT_EQ(ladder.GetNumLevels(), 3u);
+
+	auto picture = std::make_shared<VideoBuffer>(1280, 720);
+	picture->SetTime(1234);
+
+	const auto& scaled = ladder.Scale(picture);
+	ASSERT_EQ(scaled.size(), 3u);
+	//Top level is the captured picture
+	EXPECT_EQ(scaled[0], picture);
+	//Each level scaled from the previous one
+	EXPECT_EQ(scaler.inputs, std::vector<uint32_t>({1280, 640}));
+	ASSERT_TRUE(scaled[1]);
+	ASSERT_TRUE(scaled[2]);
+	EXPECT_EQ(scaled[1]->GetWidth(), 640u);
+	EXPECT_EQ(scaled[2]->GetWidth(), 320u);
+	EXPECT_EQ(scaled[2]->GetTime(), 1234u);
+}
+
+TEST(TestVideoScaleLadder, SkipFailedLevel)
+{
+	Scaler scaler;
+	VideoScaleLadder ladder(std::ref(scaler));
+	ladder.SetSizes({{1280,720},{640,360},{320,180}});
+
+	auto picture = std::make_shared<VideoBuffer>(1920, 1080);
+
+	//Middle level can't be scaled
+	scaler.fail = 640;
+	const auto& scaled = ladder.Scale(picture);
+	ASSERT_EQ(scaled.size(), 3u);
+	EXPECT_TRUE(scaled[0]);
+	EXPECT_FALSE(scaled[1]);
+	//Lower one is scaled from the closest larger one available
+	ASSERT_TRUE(scaled[2]);
+	EXPECT_EQ(scaler.inputs, std::vector<uint32_t>({1920, 1280}));
+
+	//Recovers on next picture
+	scaler.fail = 0;
+	ladder.Scale(picture);
+	EXPECT_TRUE(scaled[1]);
+
+	//Nothing to scale after clearing it
+	ladder.Clear();
+	EXPECT_EQ(ladder.GetNumLevels(), 0u);
+	EXPECT_TRUE(ladder.Scale(picture).empty());
+}
@@ -0,0 +1,203 @@
+#include "TestCommon.h"
+
+#include "VideoWorkerPool.h"
+#include "tools.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+
+TEST(TestVideoWorkerPool, EarliestDeadlineFirst)
+{
+	VideoWorkerPool pool("test");
+	ASSERT_TRUE(pool.Start(1));
+
+	auto blocker = std::make_shared<VideoWorkerPool::Worker>(pool, "blocker");
+	std::vector<std::shared_ptr<VideoWorkerPool::Worker>> workers;
+	for (int i = 0; i < 4; ++i)
+		workers.push_back(std::make_shared<VideoWorkerPool::Worker>(pool, "worker-" + std::to_string(i)));
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool blocked = true;
+	std::vector<int> executed;
+
+	//Keep the only thread busy while posting
+	blocker->Post(0, [&]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [&]() { return !blocked; });
+	});
+
+	//Post in reverse order of deadline
+	QWORD now = getTime();
+	for (int i = 3; i >= 0; --i)
+		ASSERT_TRUE(workers[i]->Post(now + 1000000 + i * 1000, [&, i]() {
+			std::lock_guard<std::mutex> lock(mutex);
+			executed.push_back(i);
+		}));
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		blocked = false;
+	}
+	cond.notify_all();
+
+	//Wait for all of them to be run
+	for (auto& worker : workers)
+		while (worker->GetStats().tasks != 1)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	ASSERT_EQ(executed.size(), 4u);
+	for (int i = 0; i < 4; ++i)
+		EXPECT_EQ(executed[i], i);
+
+	EXPECT_EQ(blocker->GetStats().missed, 1u);
+	EXPECT_EQ(workers[0]->GetStats().missed, 0u);
+}
+
+TEST(TestVideoWorkerPool, OrderPerWorker)
+{
+	VideoWorkerPool pool("test");
+	ASSERT_TRUE(pool.Start(4));
+	EXPECT_EQ(pool.GetNumThreads(), 4u);
+
+	std::vector<std::shared_ptr<VideoWorkerPool::Worker>> workers;
+	std::vector<std::vector<int>> executed(8);
+	std::vector<std::atomic<int>> running(8);
+	std::atomic<bool> overlapped = false;
+
+	for (int i = 0; i < 8; ++i)
+		workers.push_back(std::make_shared<VideoWorkerPool::Worker>(pool, "worker"));
+
+	//Interleave tasks of all workers, with decreasing deadlines
+	QWORD now = getTime();
+	for (int j = 0; j < 200; ++j)
+		for (int i = 0; i < 8; ++i)
+			workers[i]->Post(now + 1000000 - j, [&, i, j]() {
+				//No other task for the same worker must be running
+				if (running[i]++)
+					overlapped = true;
+				executed[i].push_back(j);
+				running[i]--;
+			});
+
+	for (auto& worker : workers)
+		while (worker->GetStats().tasks != 200)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	EXPECT_FALSE(overlapped);
+	for (int i = 0; i < 8; ++i)
+	{
+		ASSERT_EQ(executed[i].size(), 200u);
+		for (int j = 0; j < 200; ++j)
+			EXPECT_EQ(executed[i][j], j);
+	}
+}
+
+TEST(TestVideoWorkerPool, NotBefore)
+{
+	VideoWorkerPool pool("test");
+	ASSERT_TRUE(pool.Start(2));
+
+	auto worker = std::make_shared<VideoWorkerPool::Worker>(pool, "worker");
+	std::atomic<QWORD> ran = 0;
+
+	QWORD now = getTime();
+	worker->Post(now + 40000, [&]() { ran = getTime(); }, now + 20000);
+
+	while (!ran)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	EXPECT_GE(ran.load(), now + 20000);
+}
+
+TEST(TestVideoWorkerPool, Stop)
+{
+	VideoWorkerPool pool("test");
+	ASSERT_TRUE(pool.Start(2));
+
+	auto worker = std::make_shared<VideoWorkerPool::Worker>(pool, "worker");
+	std::atomic<int> executed = 0;
+
+	//Pending delayed tasks are dropped
+	QWORD now = getTime();
+	for (int i = 0; i < 10; ++i)
+		ASSERT_TRUE(worker->Post(now + 2000000, [&]() { executed++; }, now + 1000000));
+	EXPECT_EQ(worker->GetStats().pending, 10u);
+
+	worker->Stop();
+	EXPECT_EQ(worker->GetStats().pending, 0u);
+	EXPECT_FALSE(worker->Post(now, [&]() { executed++; }));
+
+	//Accepts tasks again
+	worker->Start();
+	ASSERT_TRUE(worker->Post(now, [&]() { executed++; }));
+	while (worker->GetStats().tasks != 1)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	EXPECT_EQ(executed, 1);
+
+	//Task can stop its own worker
+	ASSERT_TRUE(worker->Post(now, [&]() { worker->Stop(); executed++; }));
+	while (worker->GetStats().tasks != 2)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	EXPECT_EQ(executed, 2);
+	EXPECT_FALSE(worker->Post(now, [&]() { executed++; }));
+
+	EXPECT_TRUE(pool.Stop());
+	EXPECT_FALSE(pool.Stop());
+}
+
+TEST(TestVideoWorkerPool, DeleteFromTask)
+{
+	VideoWorkerPool pool("test");
+	ASSERT_TRUE(pool.Start(2));
+
+	auto worker = std::make_shared<VideoWorkerPool::Worker>(pool, "worker");
+	std::atomic<bool> executed = false;
+
+	//Task stops and releases its own worker, the pool keeps it alive until the task is done
+	ASSERT_TRUE(worker->Post(getTime(), [&]() {
+		worker->Stop();
+		worker.reset();
+		executed = true;
+	}));
+
+	//Wait until it is deleted
+	while (!pool.GetWorkerStats().empty())
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	EXPECT_TRUE(executed);
+	EXPECT_TRUE(pool.Stop());
+}
+
+TEST(TestVideoWorkerPool, CodecThreadBudget)
+{
+	VideoWorkerPool pool("test");
+	ASSERT_TRUE(pool.Start(2));
+	EXPECT_EQ(pool.GetCodecThreadBudget(), 2u);
+	pool.SetCodecThreadBudget(4);
+
+	{
+		auto first = std::make_shared<VideoWorkerPool::Worker>(pool, "first");
+		auto second = std::make_shared<VideoWorkerPool::Worker>(pool, "second");
+
+		EXPECT_EQ(first->AcquireCodecThreads(1), 1u);
+		EXPECT_EQ(first->AcquireCodecThreads(4), 4u);
+		EXPECT_EQ(pool.GetUsedCodecThreads(), 3u);
+		//Only one left on the budget
+		EXPECT_EQ(second->AcquireCodecThreads(4), 2u);
+		//Always gets at least one
+		EXPECT_EQ(second->AcquireCodecThreads(4), 1u);
+		EXPECT_EQ(first->GetStats().codecThreads, 3u);
+		EXPECT_EQ(second->GetStats().codecThreads, 1u);
+
+		first->ReleaseCodecThreads();
+		EXPECT_EQ(pool.GetUsedCodecThreads(), 1u);
+		EXPECT_EQ(first->AcquireCodecThreads(8), 4u);
+
+		auto stats = pool.GetWorkerStats();
+		EXPECT_EQ(stats.size(), 2u);
+		EXPECT_EQ(VideoWorkerPool::GetRunningStats().size(), 2u);
+	}
+
+	//Given back when workers are destroyed
+	EXPECT_EQ(pool.GetUsedCodecThreads(), 0u);
+}
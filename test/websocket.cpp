@@ -0,0 +1,201 @@
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "test.h"
+#include "ws/websocketserver.h"
+
+class WebSocketPlan: public TestPlan
+{
+public:
+	WebSocketPlan() : TestPlan("WebSocket test plan")
+	{
+
+	}
+
+	virtual void Execute()
+	{
+		testUnmask();
+		testEcho();
+	}
+
+	void testUnmask()
+	{
+		BYTE data[300];
+		BYTE unmasked[300];
+		DWORD mask = 0x37FA213D;
+		BYTE key[4];
+		set4(key,0,mask);
+
+		//Different sizes and frame offsets so all code paths are exercised
+		for (QWORD pos = 0; pos < 8; ++pos)
+		{
+			for (QWORD size = 0; size < sizeof(data); size += 7)
+			{
+				for (QWORD i = 0; i < size; ++i)
+					data[i] = unmasked[i] = (BYTE)(i * 31 + pos);
+				//Unmask
+				WebSocketFrameHeader::Unmask(data,size,mask,pos);
+				//Compare with byte by byte XOR
+				for (QWORD i = 0; i < size; ++i)
+					assert(data[i] == (unmasked[i] ^ key[(pos + i) & 0x03]));
+			}
+		}
+	}
+
+	//Echo back complete binary messages
+	class EchoHandler :
+		public WebSocketServer::Handler,
+		public WebSocket::Listener
+	{
+	public:
+		virtual void onWebSocketConnection(const HTTPRequest& request,WebSocket *ws) override	{ ws->Accept(this);	}
+		virtual void onOpen(WebSocket *ws) override {}
+		virtual void onMessageStart(WebSocket *ws,const WebSocket::MessageType type,const DWORD length) override {}
+		virtual void onMessageData(WebSocket *ws,const BYTE* data, const DWORD size) override
+		{
+			//Get message for this connection, all events are called on the connection reactor
+			std::lock_guard<std::mutex> lock(mutex);
+			auto& message = messages[ws];
+			message.insert(message.end(),data,data+size);
+		}
+		virtual void onMessageEnd(WebSocket *ws) override
+		{
+			std::vector<BYTE> message;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				message.swap(messages[ws]);
+			}
+			ws->SendMessage(message.data(),message.size());
+		}
+		virtual void onWriteBufferEmpty(WebSocket *ws) override {}
+		virtual void onError(WebSocket *ws) override {}
+		virtual void onClose(WebSocket *ws) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			messages.erase(ws);
+		}
+	private:
+		std::mutex mutex;
+		std::map<WebSocket*,std::vector<BYTE>> messages;
+	};
+
+	static bool ReadFully(int fd,BYTE* data,DWORD size)
+	{
+		DWORD pos = 0;
+		while (pos < size)
+		{
+			int len = read(fd,data+pos,size-pos);
+			if (len <= 0)
+				return false;
+			pos += len;
+		}
+		return true;
+	}
+
+	void testEcho()
+	{
+		const int port = 18990;
+		const int clients = 100;
+		const DWORD size = 5000;
+
+		EchoHandler echo;
+		WebSocketServer server;
+		server.AddHandler("/echo",&echo);
+		assert(server.Init(port,2));
+
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(port);
+
+		//Open all connections at the same time
+		std::vector<int> fds;
+		for (int i = 0; i < clients; ++i)
+		{
+			int fd = socket(AF_INET,SOCK_STREAM,0);
+			assert(fd >= 0);
+			assert(connect(fd,(sockaddr*)&addr,sizeof(addr)) == 0);
+			std::string upgrade =
+				"GET /echo HTTP/1.1\r\n"
+				"Host: localhost\r\n"
+				"Upgrade: websocket\r\n"
+				"Connection: Upgrade\r\n"
+				"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+				"Sec-WebSocket-Version: 13\r\n"
+				"\r\n";
+			assert(write(fd,upgrade.c_str(),upgrade.length()) == (int)upgrade.length());
+			fds.push_back(fd);
+		}
+
+		for (int i = 0; i < clients; ++i)
+		{
+			int fd = fds[i];
+
+			//Read response headers
+			std::string response;
+			char c;
+			while (response.find("\r\n\r\n") == std::string::npos && read(fd,&c,1) == 1)
+				response += c;
+			assert(response.find("HTTP/1.1 101") == 0);
+			assert(response.find("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") != std::string::npos);
+
+			//Create masked binary frame
+			std::vector<BYTE> payload(size);
+			for (DWORD j = 0; j < size; ++j)
+				payload[j] = (BYTE)(i + j);
+			DWORD mask = 0x01020304 * (i + 1);
+			WebSocketFrameHeader header(true,WebSocketFrameHeader::BinaryFrame,size,mask);
+			std::vector<BYTE> frame(header.GetData(),header.GetData() + header.GetSize());
+			frame.insert(frame.end(),payload.begin(),payload.end());
+			WebSocketFrameHeader::Unmask(frame.data() + header.GetSize(),size,mask,0);
+
+			//Send it in two writes, split inside the header
+			assert(write(fd,frame.data(),3) == 3);
+			assert(write(fd,frame.data() + 3,frame.size() - 3) == (int)frame.size() - 3);
+
+			//Read echoed frames until last one
+			std::vector<BYTE> echoed;
+			bool fin = false;
+			while (!fin)
+			{
+				BYTE data[14];
+				//Read fixed part
+				assert(ReadFully(fd,data,2));
+				fin = data[0] & 0x80;
+				assert(!(data[1] & 0x80));
+				QWORD len = data[1] & 0x7F;
+				if (len == 126)
+				{
+					assert(ReadFully(fd,data+2,2));
+					len = get2(data,2);
+				}
+				//Read payload
+				DWORD pos = echoed.size();
+				echoed.resize(pos + len);
+				assert(ReadFully(fd,echoed.data() + pos,len));
+			}
+			assert(echoed == payload);
+		}
+
+		//Close half of them from the client side
+		for (int i = 0; i < clients / 2; ++i)
+			close(fds[i]);
+
+		//Server closes the rest
+		server.End();
+
+		//Remaining clients get the connection closed
+		for (int i = clients / 2; i < clients; ++i)
+		{
+			BYTE data[1];
+			assert(read(fds[i],data,1) == 0);
+			close(fds[i]);
+		}
+	}
+};
+
+WebSocketPlan websocket;